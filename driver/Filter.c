@@ -29,11 +29,6 @@
 #include "SerialClone.tmh"
 #endif
 
-static NTSTATUS IgnoreRequest(PDEVICE_OBJECT pdo, PIRP Irp);
-static NTSTATUS OnRepeaterComplete(PDEVICE_OBJECT tdo, PIRP subirp, PVOID needsvote);
-static NTSTATUS RepeatRequest(PDEVICE_OBJECT pdo, PIRP Irp);
-static NTSTATUS SucceedRequest(PDEVICE_OBJECT pdo, PIRP Irp);
-
 NTSTATUS FilterPnpDispatch(
     IN PDEVICE_OBJECT   DeviceObject,
     IN PIRP             Irp
@@ -44,7 +39,7 @@ NTSTATUS FilterPnpDispatch(
     PIO_STACK_LOCATION              irpStack;
     PDEVICE_CAPABILITIES            deviceCapabilities;
 
-    SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our current IRP stack location
     irpStack = IoGetCurrentIrpStackLocation(Irp);
@@ -55,7 +50,7 @@ NTSTATUS FilterPnpDispatch(
 
     if(deviceExtension->TypeFlag != ISFILTER)
 	{
-		SerialCloneDebugPrint(DBG_PNP, DBG_ERR, __FUNCTION__" !! IRP:%p Not Filter Device", Irp);
+		SCDebug(DBG_PNP, DBG_ERR, (__FUNCTION__" !! IRP:%p Not Filter Device", Irp));
 		FailRequest(DeviceObject,Irp,STATUS_NO_SUCH_DEVICE);
 	}
 
@@ -65,7 +60,7 @@ NTSTATUS FilterPnpDispatch(
 
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
 
@@ -92,6 +87,9 @@ NTSTATUS FilterPnpDispatch(
 		//SerialCloneCreateComName(deviceExtension);
 		//IoSetDeviceInterfaceState(&deviceExtension->ntDeviceName,TRUE);
 
+		// the port comes up with its defaults, forget what we snooped before
+		SCPortStateInvalidate(deviceExtension);
+
         // Update our PnP state
 		deviceExtension->PnpState = PnpStateStarted;
 
@@ -116,7 +114,7 @@ NTSTATUS FilterPnpDispatch(
 
         SerialCloneReleaseRemoveLock(deviceExtension);
 
-        SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
 
@@ -153,7 +151,7 @@ NTSTATUS FilterPnpDispatch(
 
             SerialCloneReleaseRemoveLock(deviceExtension);
 
-            SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+            SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
             return status;
         }
 
@@ -172,7 +170,7 @@ NTSTATUS FilterPnpDispatch(
 
         SerialCloneReleaseRemoveLock(deviceExtension);
 
-        SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
 
@@ -190,7 +188,7 @@ NTSTATUS FilterPnpDispatch(
 
         SerialCloneReleaseRemoveLock(deviceExtension);
 
-        SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
 
@@ -215,7 +213,7 @@ NTSTATUS FilterPnpDispatch(
             {
                 // Nobody can fail this IRP. This is a fatal error.
                 ASSERTMSG("Cancel remove failed. Fatal error!", FALSE);
-                SerialCloneDebugPrint(DBG_PNP, DBG_ERR, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+                SCDebug(DBG_PNP, DBG_ERR, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
             }
         }
         else
@@ -225,11 +223,11 @@ NTSTATUS FilterPnpDispatch(
             IoSkipCurrentIrpStackLocation(Irp);
             status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
 
-            SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+            SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
             SerialCloneReleaseRemoveLock(deviceExtension);
 
-            SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+            SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
             return status;
         }
@@ -243,6 +241,10 @@ NTSTATUS FilterPnpDispatch(
 
         deviceExtension->PnpState = PnpStateSurpriseRemoved;
 
+        // fail the writes the pacer is still holding, and the clone's wait
+        SCPaceStop(deviceExtension);
+        SCWaitStop(deviceExtension->Extension);
+
         // We must set Irp->IoStatus.Status to STATUS_SUCCESS before
         // passing it down.
         Irp->IoStatus.Status = STATUS_SUCCESS;
@@ -254,7 +256,7 @@ NTSTATUS FilterPnpDispatch(
         SerialCloneReleaseRemoveLock(deviceExtension);
 
 		// GCH* TellCLone!
-        SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
 
@@ -266,10 +268,23 @@ NTSTATUS FilterPnpDispatch(
         // Update our PnP state
         deviceExtension->PnpState = PnpStateRemoved;
 
+        // fail the writes the pacer is still holding, and the clone's wait
+        SCPaceStop(deviceExtension);
+        SCWaitStop(deviceExtension->Extension);
+
+        // a read buffer kept for a reopen holds a remove lock, don't wait it out
+        SCRxBufferCancelRetain(deviceExtension);
+        SCRxBufferCancelRetain(deviceExtension->Extension);
+
 		// GCH* Tell clone to remove
         SerialCloneReleaseRemoveLock(deviceExtension);
         SerialCloneWaitForSafeRemove(deviceExtension);
 
+        // no IRP of ours is left to put data in the read buffer
+        SCRxBufferStop(deviceExtension);
+
+		SCWmiDeregister(deviceExtension);
+
 		// Send the remove IRP down the stack.
 		Irp->IoStatus.Status = STATUS_SUCCESS;
 		IoSkipCurrentIrpStackLocation(Irp);
@@ -278,10 +293,24 @@ NTSTATUS FilterPnpDispatch(
 	// Detach our device object from the device stack
 		IoDetachDevice(deviceExtension->LowerDeviceObject);
 
+		// the clone goes with the port, it waits out its own IRPs first.
+		// Handles still open on it keep the object, and its counters and
+		// remove lock in the extension, until they close.
+		SerialCloneWaitForSafeRemove(deviceExtension->Extension);
+		SCRxBufferStop(deviceExtension->Extension);
+		IoDeleteDevice(deviceExtension->CDeviceObject);
+
+		// neither is left to sample into the capture ring or drain it
+		SCCaptureFree(deviceExtension);
+
+		// the name is shared by both extensions, the instance goes back last
+		ExFreePool(deviceExtension->ntDeviceName.Buffer);
+		SCInstanceFree(deviceExtension->Instance);
+
 		// attempt to delete our device object
 		IoDeleteDevice(deviceExtension->FDeviceObject);
 
-        SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
 
@@ -351,7 +380,7 @@ NTSTATUS FilterPnpDispatch(
 		status = IoCallDriver (deviceExtension->LowerDeviceObject, Irp);
 		// Adjust our active I/O count
 		SerialCloneReleaseRemoveLock(deviceExtension);
-        SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
     Irp->IoStatus.Status = status;
@@ -359,7 +388,7 @@ NTSTATUS FilterPnpDispatch(
 
     // Adjust the active I/O count
     SerialCloneReleaseRemoveLock(deviceExtension);
-    SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
     return status;
 }
 
@@ -371,7 +400,7 @@ NTSTATUS FilterPowerDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_POWER, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_POWER, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
     if (!SerialCloneAcquireRemoveLock(deviceExtension))
@@ -381,14 +410,14 @@ NTSTATUS FilterPowerDispatch(
         PoStartNextPowerIrp(Irp);
         Irp->IoStatus.Status = status;
         IoCompleteRequest(Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_POWER, DBG_WARN, __FUNCTION__"--. Delete Pending IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_POWER, DBG_WARN, (__FUNCTION__"--. Delete Pending IRP %p STATUS %x", Irp, status));
         return status;
     }
     PoStartNextPowerIrp(Irp);
     IoSkipCurrentIrpStackLocation(Irp);
     status = PoCallDriver(deviceExtension->LowerDeviceObject, Irp);
     SerialCloneReleaseRemoveLock(deviceExtension);
-    SerialCloneDebugPrint(DBG_POWER, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_POWER, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
     return status;
 }
 
@@ -424,15 +453,15 @@ NTSTATUS FilterSystemControlDispatch(
 
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
 
-    IoSkipCurrentIrpStackLocation(Irp);
-    status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
+    // our counters block, everything else goes on down
+    status = SCWmiSystemControl(deviceExtension, Irp);
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -459,7 +488,7 @@ NTSTATUS FilterCloseDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -472,7 +501,7 @@ NTSTATUS FilterCloseDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
@@ -482,7 +511,7 @@ NTSTATUS FilterCloseDispatch(
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -509,7 +538,7 @@ NTSTATUS FilterCleanupDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -522,16 +551,19 @@ NTSTATUS FilterCleanupDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
 
+    // writes from this handle still in the pacer never reached the port
+    SCPaceFlush(deviceExtension, IoGetCurrentIrpStackLocation(Irp)->FileObject);
+
     IoSkipCurrentIrpStackLocation(Irp);
     status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -553,42 +585,17 @@ NTSTATUS FilterCleanupDispatch(
 //
 NTSTATUS ReadComplete( IN  PDEVICE_OBJECT  DeviceObject,IN  PIRP  Irp,PSERIALCLONE_DEVICE_EXTENSION pdx)
 {
-	NTSTATUS status;
-    PIO_STACK_LOCATION    irpStack;
-
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p ", Irp);
-    // Get our current IRP stack location
-    irpStack = IoGetCurrentIrpStackLocation(Irp);
+	SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p ", Irp));
 
 	if(Irp->PendingReturned)
 		IoMarkIrpPending(Irp);
-	//*GCH for now dump the data buffer
-    if(pdx->FDeviceObject->Flags & DO_BUFFERED_IO)
-	{
-		ULONG bufsiz;
-		char tbuff[200];
-		size_t strnglen;
-		char * tmp = Irp->AssociatedIrp.SystemBuffer;
-		bufsiz = irpStack->Parameters.Read.Length;
-		status = RtlStringCbLengthA(tmp,bufsiz,&strnglen);
-		
-		RtlCopyMemory(tbuff,tmp,197);
-		tbuff[197]=0;
-		tbuff[198]=0;
-
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, "Buffer:: %s",tbuff);
-
-
-
-	}
-    else if(pdx->FDeviceObject->Flags & DO_DIRECT_IO)
-	{
-
 
-	}
+	// sampled into the capture ring when that is on, see SCCaptureData
+    if(pdx->FDeviceObject->Flags & DO_BUFFERED_IO)
+		SCCaptureData(pdx, SERIALCLONE_CAPTURE_RX, (PUCHAR)Irp->AssociatedIrp.SystemBuffer, (ULONG)Irp->IoStatus.Information);
 
 	SerialCloneReleaseRemoveLock(pdx);
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p STATUS %x", Irp, STATUS_SUCCESS);
+	SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p STATUS %x", Irp, STATUS_SUCCESS));
 	return STATUS_SUCCESS;
 }
 NTSTATUS FilterReadDispatch(
@@ -599,7 +606,7 @@ NTSTATUS FilterReadDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -610,7 +617,7 @@ NTSTATUS FilterReadDispatch(
         status = STATUS_DELETE_PENDING;
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
 
@@ -621,7 +628,7 @@ NTSTATUS FilterReadDispatch(
 		
     
 	//SerialCloneReleaseRemoveLock(deviceExtension);
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -650,7 +657,7 @@ NTSTATUS FilterWriteDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -663,7 +670,7 @@ NTSTATUS FilterWriteDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
@@ -673,7 +680,7 @@ NTSTATUS FilterWriteDispatch(
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -703,8 +710,13 @@ NTSTATUS FilterDeviceIoControlDispatch(
 {
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
+    ULONG                           code;
+    BOOLEAN                         bLocal;
+    ULONG                           start;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
+
+    start = SCLatencyNow();
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -716,17 +728,80 @@ NTSTATUS FilterDeviceIoControlDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
 
-    IoSkipCurrentIrpStackLocation(Irp);
-    status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
+    code = IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.IoControlCode;
+    bLocal = TRUE;
+
+    switch (code)
+    {
+    // ours, the port would not know them
+    case IOCTL_SERIALCLONE_GET_PORT_STATE:
+        status = SCPortStateSnapshot(deviceExtension, Irp);
+        break;
+
+    case IOCTL_SERIALCLONE_GET_COUNTERS:
+        status = SCStatsIoctl(deviceExtension, Irp);
+        break;
+
+    // every port's activity, only for a privileged caller here; anyone
+    // may have the port open
+    case IOCTL_SERIALCLONE_GET_TRACE:
+        if (SCCallerPrivileged(Irp))
+        {
+            status = SCTraceIoctl(Irp, TRUE);
+        }
+        else
+        {
+            status = STATUS_ACCESS_DENIED;
+        }
+        break;
+
+    case IOCTL_SERIALCLONE_GET_LATENCY:
+        status = SCLatencyIoctl(deviceExtension, Irp, FALSE);
+        break;
+
+    // the port's data, drained for good; only through the clone, whoever
+    // has the port open may not take it
+    case IOCTL_SERIALCLONE_GET_CAPTURE:
+        status = STATUS_INVALID_DEVICE_REQUEST;
+        break;
+
+    // only the owner's purge reaches the port
+    case IOCTL_SERIAL_PURGE:
+        bLocal = !SCPurgeConsumer(deviceExtension, Irp, &status);
+        break;
+
+    default:
+        bLocal = FALSE;
+        break;
+    }
+
+    if (bLocal)
+    {
+        // a warning such as STATUS_BUFFER_OVERFLOW still returns data
+        if (NT_ERROR(status))
+        {
+            Irp->IoStatus.Information = 0;
+        }
+        Irp->IoStatus.Status = status;
+        IoCompleteRequest (Irp, IO_NO_INCREMENT);
+        SCLatencyRecord(deviceExtension, SERIALCLONE_LATENCY_IOCTL, SERIALCLONE_LATENCY_TOTAL,
+            SCLatencyNow() - start);
+    }
+    else
+    {
+        // watch the port configuration go by, and time the port
+        SCSnoopIoctl(deviceExtension, Irp, start);
+        status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
+    }
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -753,7 +828,7 @@ NTSTATUS FilterInternalDeviceIoControlDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -766,7 +841,7 @@ NTSTATUS FilterInternalDeviceIoControlDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
@@ -776,7 +851,7 @@ NTSTATUS FilterInternalDeviceIoControlDispatch(
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -42,8 +42,8 @@ NTSTATUS DriverEntry(
     NTSTATUS            status = STATUS_SUCCESS;
     ULONG               i;
 
-    SerialCloneDebugPrint(DBG_INIT, DBG_TRACE, __FUNCTION__"++");
-    SerialCloneDebugPrint(DBG_INIT, DBG_INFO, "Compiled at %s on %s", __TIME__, __DATE__);
+    SCDebug(DBG_INIT, DBG_TRACE, (__FUNCTION__"++"));
+    SCDebug(DBG_INIT, DBG_INFO, ("Compiled at %s on %s", __TIME__, __DATE__));
 
 #ifdef DBG
 //    DbgBreakPoint();
@@ -68,13 +68,22 @@ NTSTATUS DriverEntry(
     {
         status = STATUS_INSUFFICIENT_RESOURCES;
 
-        SerialCloneDebugPrint(DBG_INIT, DBG_ERR, __FUNCTION__": Failed to allocate memory for RegistryPath");
+        SCDebug(DBG_INIT, DBG_ERR, (__FUNCTION__": Failed to allocate memory for RegistryPath"));
 
         return status;
     }
 
     RtlCopyUnicodeString(&g_Data.RegistryPath, RegistryPath);
 
+    // pick up our tunables
+    SerialCloneReadParameters(RegistryPath);
+    SCInstanceInit();
+    SCTraceInit();
+
+    // lock times and latencies are counted in performance counter ticks
+    KeQueryPerformanceCounter(&g_Data.PerfFrequency);
+    SCLatencyInit();
+
     for (i = 0; i <= IRP_MJ_MAXIMUM_FUNCTION; ++i)
     {
         DriverObject->MajorFunction[i] = SerialClonePassThrough;
@@ -92,7 +101,7 @@ NTSTATUS DriverEntry(
     DriverObject->MajorFunction[IRP_MJ_SYSTEM_CONTROL] = SerialCloneSystemControlDispatch;
     DriverObject->DriverExtension->AddDevice = SerialCloneAddDevice;
     DriverObject->DriverUnload = SerialCloneUnload;
-    SerialCloneDebugPrint(DBG_INIT, DBG_TRACE, __FUNCTION__"--. STATUS %x", status);
+    SCDebug(DBG_INIT, DBG_TRACE, (__FUNCTION__"--. STATUS %x", status));
     return status;
 }
 
@@ -141,8 +150,7 @@ NTSTATUS SerialCloneAddDevice(
 
 	WCHAR name[64];
 	ANSI_STRING							dbgString;
-	char *								buffptr;
-    SerialCloneDebugPrint(DBG_INIT, DBG_TRACE, __FUNCTION__"++, PDO %p", PhysicalDeviceObject);
+    SCDebug(DBG_INIT, DBG_TRACE, (__FUNCTION__"++, PDO %p", PhysicalDeviceObject));
 
     if (!IoIsWdmVersionAvailable(1, 0x20))
     {
@@ -160,7 +168,7 @@ NTSTATUS SerialCloneAddDevice(
     //**************** create our filter device object *************************
     status = IoCreateDevice(
                 DriverObject,
-                sizeof(SERIALCLONE_DEVICE_EXTENSION),
+                SCStatsExtensionSize(),
                 NULL,
                 deviceType,
                 FILE_DEVICE_SECURE_OPEN,
@@ -170,10 +178,10 @@ NTSTATUS SerialCloneAddDevice(
 
     if (!NT_SUCCESS(status))
     {
-        SerialCloneDebugPrint(DBG_INIT, DBG_ERR, __FUNCTION__"--, IoCreateDevice returned STATUS %x", status);
+        SCDebug(DBG_INIT, DBG_ERR, (__FUNCTION__"--, IoCreateDevice returned STATUS %x", status));
         return status;
     }
-    SerialCloneDebugPrint(DBG_INIT, DBG_INFO, __FUNCTION__": Created FiDO %p", fdeviceObject);
+    SCDebug(DBG_INIT, DBG_INFO, (__FUNCTION__": Created FiDO %p", fdeviceObject));
     // Initialize the device extension.
     fdeviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)fdeviceObject->DeviceExtension;
     // Zero the memory
@@ -199,7 +207,7 @@ NTSTATUS SerialCloneAddDevice(
     fdeviceExtension->LowerDeviceObject = IoAttachDeviceToDeviceStack(fdeviceObject, PhysicalDeviceObject);
     if (fdeviceExtension->LowerDeviceObject == NULL) 
     {
-        SerialCloneDebugPrint(DBG_INIT, DBG_ERR, __FUNCTION__": IoAttachDeviceToDeviceStack failed!");
+        SCDebug(DBG_INIT, DBG_ERR, (__FUNCTION__": IoAttachDeviceToDeviceStack failed!"));
         IoDeleteDevice(fdeviceObject);
         return STATUS_DEVICE_REMOVED;
     }
@@ -210,30 +218,37 @@ NTSTATUS SerialCloneAddDevice(
     fdeviceObject->DeviceType = fdeviceExtension->LowerDeviceObject->DeviceType;
     fdeviceObject->Characteristics = fdeviceExtension->LowerDeviceObject->Characteristics;
 
-	// allocate lookaside list
-
-	ExInitializeNPagedLookasideList(&fdeviceExtension->LookasideBuffer,NULL,NULL,0,
-		sizeof(SERIALCLONE_IRP_STATUS),SERIALCLONE_POOL_TAG,0);
+	// one spare stack location below ours holds the tracking of reads we
+	// send down, see SCReadTracking. The clone copies this size.
+	fdeviceObject->StackSize++;
 
 	// initialize the IRP lists
 	InitializeListHead(&fdeviceExtension->Reads);
 	ASSERT(IsListEmpty(&fdeviceExtension->Reads));
+	InitializeListHead(&fdeviceExtension->ReadsToSend);
+	InitializeListHead(&fdeviceExtension->ReadsDone);
 	KeInitializeSpinLock(&fdeviceExtension->ListLock);
 
-	// Allocate our read buffer
-    buffptr = (PCHAR)ExAllocatePoolWithTag(NonPagedPool ,8192 , SERIALCLONE_POOL_TAG);
+	// snooped port settings and the transmit pacer
+	SCPortStateInit(fdeviceExtension);
+	SCPaceInit(fdeviceExtension);
+
+	SCStatsInit(fdeviceExtension);
+
+	// our read buffer, allocated when we are opened
+	SCRxBufferInit(fdeviceExtension);
 
-    if (buffptr == NULL) 
+    //**************** create our clone device object *************************
+    // the port's slot in the instance table numbers the clone
+    status = SCInstanceAllocate(&fdeviceExtension->Instance);
+    if (!NT_SUCCESS(status))
     {
-        SerialCloneDebugPrint(DBG_INIT, DBG_ERR, __FUNCTION__": Insufficient memory");
-        ExDeleteNPagedLookasideList(&fdeviceExtension->LookasideBuffer);
-		IoDeleteDevice(fdeviceObject);
-        return STATUS_DEVICE_REMOVED;
+        IoDetachDevice(fdeviceExtension->LowerDeviceObject);
+        IoDeleteDevice(fdeviceObject);
+        SCDebug(DBG_INIT, DBG_ERR, (__FUNCTION__"--. no free instance STATUS %x", status));
+        return status;
     }
-	SCFifoInit(&fdeviceExtension->ReadBuffer, buffptr, 8192);
-	KeInitializeSpinLock(&fdeviceExtension->ReadBuffer.FifoLock);
 
-    //**************** create our clone device object *************************
     // create device object name 
 
     ntName.Length = 0;
@@ -242,8 +257,10 @@ NTSTATUS SerialCloneAddDevice(
     if (ntName.Buffer == NULL)
     {
         status = STATUS_INSUFFICIENT_RESOURCES;
+        SCInstanceFree(fdeviceExtension->Instance);
+        IoDetachDevice(fdeviceExtension->LowerDeviceObject);
         IoDeleteDevice(fdeviceObject);
-        SerialCloneDebugPrint(DBG_INIT, DBG_ERR, __FUNCTION__"--. STATUS %x", status);
+        SCDebug(DBG_INIT, DBG_ERR, (__FUNCTION__"--. STATUS %x", status));
         return status;
     }
 
@@ -253,12 +270,12 @@ NTSTATUS SerialCloneAddDevice(
     instanceString.Length = 0;
     instanceString.MaximumLength = sizeof(instanceStringBuffer);
     instanceString.Buffer = instanceStringBuffer;
-    RtlIntegerToUnicodeString(5, 10, &instanceString);
+    RtlIntegerToUnicodeString(fdeviceExtension->Instance, 10, &instanceString);
     RtlAppendUnicodeStringToString(&ntName, &instanceString);
 
     status = IoCreateDevice(
                 DriverObject,
-                sizeof(SERIALCLONE_DEVICE_EXTENSION),
+                SCStatsExtensionSize(),
                 &ntName,
                 FILE_DEVICE_SERIAL_PORT,
                 FILE_DEVICE_SECURE_OPEN,
@@ -268,13 +285,18 @@ NTSTATUS SerialCloneAddDevice(
 
     if (!NT_SUCCESS(status))
     {
-        SerialCloneDebugPrint(DBG_INIT, DBG_ERR, __FUNCTION__"--, IoCreateDevice returned STATUS %x", status);
+        SCDebug(DBG_INIT, DBG_ERR, (__FUNCTION__"--, IoCreateDevice returned STATUS %x", status));
+        ExFreePool(ntName.Buffer);
+        SCInstanceFree(fdeviceExtension->Instance);
+        IoDetachDevice(fdeviceExtension->LowerDeviceObject);
         IoDeleteDevice(fdeviceObject);
 		return status;
     }
 	//status = RtlUnicodeStringToAnsiString(&dbgString,&ntName,TRUE);
 	if(NT_SUCCESS(status))
-		SerialCloneDebugPrint(DBG_INIT, DBG_INFO, __FUNCTION__": Created ClDO::%p ", cdeviceObject);
+	{
+		SCDebug(DBG_INIT, DBG_INFO, (__FUNCTION__": Created ClDO::%p ", cdeviceObject));
+	}
     // Initialize the device extension.
     cdeviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)cdeviceObject->DeviceExtension;
     // Zero the memory
@@ -299,6 +321,7 @@ NTSTATUS SerialCloneAddDevice(
 	cdeviceExtension->OpenState=OpenStateClosed;
 	fdeviceExtension->ntDeviceName=ntName; 
 	cdeviceExtension->ntDeviceName=ntName; 
+	cdeviceExtension->Instance = fdeviceExtension->Instance;
 
     // Initialize the device object flags
     cdeviceObject->Flags = fdeviceObject->Flags;
@@ -319,18 +342,24 @@ NTSTATUS SerialCloneAddDevice(
 
 	cdeviceExtension->Extension= fdeviceExtension;
 	fdeviceExtension->Extension= cdeviceExtension;
-	// Allocate our read buffer
-    buffptr = (PCHAR)ExAllocatePoolWithTag(NonPagedPool ,8192 , SERIALCLONE_POOL_TAG);
+	// our read buffer, allocated when we are opened
+	SCRxBufferInit(cdeviceExtension);
 
-    if (buffptr == NULL) 
-    {
-        SerialCloneDebugPrint(DBG_INIT, DBG_ERR, __FUNCTION__": Insufficient memory");
-		IoDeleteDevice(fdeviceObject);
-        return STATUS_DEVICE_REMOVED;
-    }
-	
-	SCFifoInit(&cdeviceExtension->ReadBuffer, buffptr, 8192);
-	KeInitializeSpinLock(&cdeviceExtension->ReadBuffer.FifoLock);
+	// the clone's own wait mask
+	SCWaitInit(cdeviceExtension);
+
+	SCStatsInit(cdeviceExtension);
+
+	// the port's capture ring, when Parameters\CaptureEvery asks for one
+	SCCaptureInit(fdeviceExtension);
+
+	// counters as a WMI block. The port works without it, only the
+	// counters can't be read through WMI.
+	status = SCWmiRegister(fdeviceExtension);
+	if(!NT_SUCCESS(status))
+	{
+		SCDebug(DBG_INIT, DBG_WARN, (__FUNCTION__": SCWmiRegister returned STATUS %x", status));
+	}
 	
 	//************************************************
 
@@ -343,7 +372,7 @@ NTSTATUS SerialCloneAddDevice(
     fdeviceObject->Flags &= ~DO_DEVICE_INITIALIZING;
     cdeviceObject->Flags &= ~DO_DEVICE_INITIALIZING;
 
-    SerialCloneDebugPrint(DBG_INIT, DBG_TRACE, __FUNCTION__"--, STATUS %x", status);
+    SCDebug(DBG_INIT, DBG_TRACE, (__FUNCTION__"--, STATUS %x", status));
 
     return status;
 }
@@ -363,9 +392,10 @@ VOID SerialCloneUnload(
     IN  PDRIVER_OBJECT  DriverObject
     )
 {
-    SerialCloneDebugPrint(DBG_UNLOAD, DBG_TRACE, __FUNCTION__"++");
+    SCDebug(DBG_UNLOAD, DBG_TRACE, (__FUNCTION__"++"));
 
     ASSERT(DriverObject->DeviceObject == NULL);
+    ASSERT(g_Data.InstanceCount == 0);
 
     // release memory block allocated for registry path
     if (g_Data.RegistryPath.Buffer != NULL)
@@ -374,7 +404,9 @@ VOID SerialCloneUnload(
         g_Data.RegistryPath.Buffer = NULL;
     }
 
-    SerialCloneDebugPrint(DBG_UNLOAD, DBG_TRACE, __FUNCTION__"--");
+    SCTraceFree();
+
+    SCDebug(DBG_UNLOAD, DBG_TRACE, (__FUNCTION__"--"));
 
 #ifdef SERIALCLONE_WMI_TRACE
     WPP_CLEANUP(DriverObject);
@@ -405,7 +437,7 @@ NTSTATUS __stdcall SerialClonePassThrough(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
 
@@ -416,7 +448,7 @@ NTSTATUS __stdcall SerialClonePassThrough(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
@@ -426,7 +458,7 @@ NTSTATUS __stdcall SerialClonePassThrough(
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -547,6 +579,7 @@ NTSTATUS SerialCloneCreateDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     PSERIALCLONE_DEVICE_EXTENSION	fdeviceExtension;
 	NTSTATUS                        status;
+    BOOLEAN                         fdeviceHeld;
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
         // Make sure we can accept IRPs
 	fdeviceExtension= (deviceExtension->TypeFlag == ISCLONE) ? deviceExtension->Extension:deviceExtension;
@@ -556,7 +589,7 @@ NTSTATUS SerialCloneCreateDispatch(
         status = STATUS_DELETE_PENDING;
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
 
@@ -570,24 +603,40 @@ NTSTATUS SerialCloneCreateDispatch(
         Irp->IoStatus.Information = 0;
         IoCompleteRequest(Irp, IO_NO_INCREMENT);
         SerialCloneReleaseRemoveLock(deviceExtension);
-        SerialCloneDebugPrint(DBG_CREATECLOSE, DBG_WARN, __FUNCTION__"$$--. IRP %p, STATUS %x", Irp, status);
+        SCDebug(DBG_CREATECLOSE, DBG_WARN, (__FUNCTION__"$$--. IRP %p, STATUS %x", Irp, status));
         return status;
     }
+	// we are open now, we need somewhere to put what we receive
+	status = SCRxBufferOpen(deviceExtension);
+	if (!NT_SUCCESS(status))
+	{
+        InterlockedDecrement(&deviceExtension->OpenHandleCount);
+        Irp->IoStatus.Status = status;
+        Irp->IoStatus.Information = 0;
+        IoCompleteRequest(Irp, IO_NO_INCREMENT);
+        SerialCloneReleaseRemoveLock(deviceExtension);
+        SCDebug(DBG_CREATECLOSE, DBG_WARN, (__FUNCTION__"$$--. IRP %p, STATUS %x", Irp, status));
+        return status;
+	}
+	deviceExtension->OpenState=OpenStateCreate;
     // then see if other has open it
 	if(deviceExtension->Extension->OpenHandleCount !=0)
 	{
 		// the other device has it open
 		// return success	
 		SerialCloneReleaseRemoveLock(deviceExtension);
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, STATUS_SUCCESS);
+		SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, STATUS_SUCCESS));
 	    return SucceedRequest(DeviceObject,Irp);
 	}
-    if (!SerialCloneAcquireRemoveLock(fdeviceExtension))
+    // the filter's stack is below us for the open; the reference taken on
+    // it goes back once the port has answered
+    fdeviceHeld = SerialCloneAcquireRemoveLock(fdeviceExtension);
+    if (!fdeviceHeld)
     {
         //status = STATUS_DELETE_PENDING;
         //Irp->IoStatus.Status = status;
         //IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p" , Irp);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p" , Irp));
         //return status;
     }
 	// No we must open it...
@@ -595,20 +644,25 @@ NTSTATUS SerialCloneCreateDispatch(
 		status = IoForwardIrpSynchronously(fdeviceExtension->LowerDeviceObject, Irp);
 	else
 		status = SerialCloneSubmitIrpSync(deviceExtension->LowerDeviceObject, Irp);
+    if (fdeviceHeld)
+    {
+        SerialCloneReleaseRemoveLock(fdeviceExtension);
+    }
     if (!NT_SUCCESS(status)) 
 	{
+        InterlockedDecrement(&deviceExtension->OpenHandleCount);
+        SCRxBufferClose(deviceExtension);
         IoCompleteRequest(Irp, IO_NO_INCREMENT);
         SerialCloneReleaseRemoveLock(deviceExtension);
-        SerialCloneDebugPrint(DBG_CREATECLOSE, DBG_WARN, __FUNCTION__"$$--. IRP %p, STATUS %x", Irp, status);
+        SCDebug(DBG_CREATECLOSE, DBG_WARN, (__FUNCTION__"$$--. IRP %p, STATUS %x", Irp, status));
 		return status;		
 	}
 	// Mark Owner
 	deviceExtension->Owner = deviceExtension->TypeFlag;
 	deviceExtension->Extension->Owner = deviceExtension->TypeFlag;
-	deviceExtension->OpenState=OpenStateCreate;
 
     SerialCloneReleaseRemoveLock(deviceExtension);
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
     return status;
 
 }
@@ -635,7 +689,7 @@ NTSTATUS SerialCloneCloseDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
     
     // Make sure we can accept IRPs
@@ -644,7 +698,7 @@ NTSTATUS SerialCloneCloseDispatch(
         status = STATUS_DELETE_PENDING;
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
 	if(deviceExtension->OpenHandleCount!=1)
@@ -655,11 +709,12 @@ NTSTATUS SerialCloneCloseDispatch(
         Irp->IoStatus.Information = 0;
         IoCompleteRequest(Irp, IO_NO_INCREMENT);
         SerialCloneReleaseRemoveLock(deviceExtension);
-        SerialCloneDebugPrint(DBG_CREATECLOSE, DBG_WARN, __FUNCTION__"$$--. IRP %p, STATUS %x", Irp, status);
+        SCDebug(DBG_CREATECLOSE, DBG_WARN, (__FUNCTION__"$$--. IRP %p, STATUS %x", Irp, status));
         return status;
 	}
 	// decrement our count
     InterlockedDecrement(&deviceExtension->OpenHandleCount);
+	SCRxBufferClose(deviceExtension);
 	if((deviceExtension->Extension->OpenHandleCount==0)&&(deviceExtension->Owner == deviceExtension->TypeFlag))
 	{
 		// We are the only one open, issue the close
@@ -688,7 +743,7 @@ NTSTATUS SerialCloneCloseDispatch(
 		}
 	}
 	SerialCloneReleaseRemoveLock(deviceExtension);
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+	SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 
@@ -728,36 +783,269 @@ NTSTATUS SerialCloneCleanupDispatch(
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-//  SerialCloneReadDispatch
-//      Dispatch routine to handle IRP_MJ_READ
+//  SCReadSend
+//      Passes the reads queued on ReadsToSend to the port in the order
+//      they were put on Reads, so the port fills them in that order. Only
+//      one caller runs the loop at a time; anyone arriving while it runs
+//      bumps ReadSendCount so the running caller makes another pass.
 //
 //  Arguments:
-//      IN  DeviceObject
-//              pointer to our device object
+//      IN  FilterExtension
+//              filter device extension
 //
-//      IN  Irp
-//              pointer to the IRP_MJ_READ IRP
+//  Return Value:
+//      None
+//
+static VOID SCReadSend(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	PLIST_ENTRY		entry;
+	SCLOCK_HANDLE	lockHandle;
+
+	if(InterlockedIncrement(&FilterExtension->ReadSendCount) != 1)
+		return;
+
+	do
+	{
+		for(;;)
+		{
+			SCLockAcquire(FilterExtension, &FilterExtension->ListLock, &lockHandle);
+			entry = IsListEmpty(&FilterExtension->ReadsToSend) ? NULL : RemoveHeadList(&FilterExtension->ReadsToSend);
+			SCLockRelease(FilterExtension, &lockHandle);
+			if(entry == NULL)
+				break;
+
+			IoCallDriver(FilterExtension->LowerDeviceObject, CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry));
+		}
+	}
+	while(InterlockedDecrement(&FilterExtension->ReadSendCount) != 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCReadNextDone
+//      Takes the next read to deliver off ReadsDone, and its tracking off
+//      Reads: the oldest read if the port has returned it, or any read
+//      that came back with nothing, which has nothing to keep in order.
+//      A read SCReadAbort is cancelling waits, and those after it with it.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
 //
 //  Return Value:
-//      NT status code
+//      the read, or NULL if the oldest one is still at the port
 //
+static PIRP SCReadNextDone(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	PSERIALCLONE_IRP_STATUS	pIrpInfo;
+	PLIST_ENTRY				entry;
+	PIRP					irp;
+	SCLOCK_HANDLE			lockHandle;
 
-NTSTATUS SCReadComplete( IN  PDEVICE_OBJECT  DeviceObject,IN  PIRP  Irp,PSERIALCLONE_DEVICE_EXTENSION pdx)
+	SCLockAcquire(FilterExtension, &FilterExtension->ListLock, &lockHandle);
+	for(entry = FilterExtension->ReadsDone.Flink; entry != &FilterExtension->ReadsDone; entry = entry->Flink)
+	{
+		irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+		pIrpInfo = SCReadTracking(IoGetCurrentIrpStackLocation(irp));
+		// SCReadAbort still needs it, and its place in Reads
+		if(SCReadDevice(pIrpInfo)->ReadAborting == irp)
+			continue;
+		if((FilterExtension->Reads.Flink == &pIrpInfo->link) || (irp->IoStatus.Information == 0))
+		{
+			RemoveEntryList(entry);
+			RemoveEntryList(&pIrpInfo->link);
+			SCLockRelease(FilterExtension, &lockHandle);
+			return irp;
+		}
+	}
+	SCLockRelease(FilterExtension, &lockHandle);
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCReadFinish
+//      Puts what a read got from the port into the filter's and the
+//      clone's buffers and fills the read from its own device's
+//
+//  Arguments:
+//      IN  Irp
+//              the read, off Reads and ReadsDone, current stack location
+//              the spare one
+//
+//  Return Value:
+//      None
+//
+static VOID SCReadFinish(
+    IN  PIRP    Irp
+    )
 {
-	NTSTATUS status;
-	NTSTATUS fifostatus;
     PIO_STACK_LOCATION    irpStack;
-	PSERIALCLONE_DEVICE_EXTENSION filterExtension;
+	PSERIALCLONE_DEVICE_EXTENSION pdx;
 	PSERIALCLONE_DEVICE_EXTENSION odx;
 	ULONG bufsiz,actsiz;
+	ULONG oldsiz,newsiz;
+	ULONG received;
+	ULONG entered;
+	char * tmp;
 
 	int cc=2;
-	PLIST_ENTRY plist;
-	PSERIALCLONE_IRP_STATUS pIrpInfo;
+	SCLOCK_HANDLE lockHandle;
 
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p ", Irp);
-    // Get our current IRP stack location
     irpStack = IoGetCurrentIrpStackLocation(Irp);
+	pdx = (PSERIALCLONE_DEVICE_EXTENSION)irpStack->DeviceObject->DeviceExtension;
+	received = (ULONG)Irp->IoStatus.Information;
+	entered = SCIrpQueuedTime(Irp);
+
+	SCCaptureData(pdx, SERIALCLONE_CAPTURE_RX, (PUCHAR)Irp->AssociatedIrp.SystemBuffer, received);
+
+	odx = pdx;
+	bufsiz = received;
+
+	// for each device filter and clone 
+	while(cc--)
+	{
+		//char tbuff[200];
+		//size_t strnglen;
+
+		// copy data into fifo of a device that has been opened, one
+		// without storage drops it
+		if(odx->OpenState!=OpenStateClosed)
+		{
+			if(odx->FDeviceObject->Flags & DO_BUFFERED_IO)
+			{
+				tmp = Irp->AssociatedIrp.SystemBuffer;
+				bufsiz = received;
+				//************ Fifo Lock ******************
+				SCLockAcquire(odx, &odx->ReadBuffer.FifoLock, &lockHandle);
+				oldsiz = odx->ReadBuffer.Size;
+				SCFifoWrite(&odx->ReadBuffer,  tmp,  bufsiz);
+				newsiz = odx->ReadBuffer.Size;
+				if(newsiz > odx->FifoHighWater)
+					odx->FifoHighWater = newsiz;
+
+				SCLockRelease(odx, &lockHandle);
+				//****************** end lock *******************
+				SCTraceEvent(odx, SERIALCLONE_TRACE_FIFO_WRITE, Irp, bufsiz, oldsiz, newsiz);
+
+				SCStatAdd(odx, BytesIn, bufsiz);
+				if(oldsiz + bufsiz > odx->ReadBuffer.BuffSize)
+					SCStatAdd(odx, OverflowBytes, oldsiz + bufsiz - odx->ReadBuffer.BuffSize);
+
+				// wake a clone reader sitting in WaitCommEvent
+				if(odx->TypeFlag == ISCLONE)
+					SCWaitRaise(odx, tmp, (ULONG)Irp->IoStatus.Information, oldsiz, newsiz);
+
+				//RtlCopyMemory(tbuff,tmp,197);
+				//tbuff[197]=0;
+				//tbuff[198]=0;
+				//SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, "Buffer:: %s",tbuff);
+
+			}
+			else if(pdx->FDeviceObject->Flags & DO_DIRECT_IO)
+			{
+
+
+			}
+		}
+		odx=odx->Extension;
+	}
+	//************ Fifo Lock ******************
+	SCLockAcquire(pdx, &pdx->ReadBuffer.FifoLock, &lockHandle);
+	bufsiz = (SCReadRequested(irpStack)<pdx->ReadBuffer.Size) ? SCReadRequested(irpStack):pdx->ReadBuffer.Size;
+	SCFifoRead(&pdx->ReadBuffer,  Irp->AssociatedIrp.SystemBuffer, bufsiz,&actsiz);
+	SCLockRelease(pdx, &lockHandle);
+	//****************** end lock *******************
+
+	Irp->IoStatus.Information= actsiz;
+	SCStatsLatency(pdx, entered - SCIrpStartTime(irpStack));
+
+
+	SCTraceEvent(pdx, SERIALCLONE_TRACE_READ_COMPLETE, Irp, (ULONG)Irp->IoStatus.Status, received,
+		(ULONG)Irp->IoStatus.Information);
+	SCLatencyComplete(pdx, SERIALCLONE_LATENCY_READ, Irp, entered);
+	SerialCloneReleaseRemoveLock(pdx);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCReadDeliver
+//      Finishes the reads the port has returned, in the order they went
+//      down. Only one caller runs the loop at a time, as in SCReadSend;
+//      the reads it finishes for others are completed again from here.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//      IN  Irp
+//              the read whose completion routine is calling
+//
+//  Return Value:
+//      TRUE if Irp was finished and its completion can go on, FALSE if
+//      it was left for a caller already in the loop or for the read
+//      before it
+//
+static BOOLEAN SCReadDeliver(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp
+    )
+{
+	PIRP		irp;
+	BOOLEAN		finished;
+
+	if(InterlockedIncrement(&FilterExtension->ReadDeliverCount) != 1)
+		return FALSE;
+
+	finished = FALSE;
+	do
+	{
+		while((irp = SCReadNextDone(FilterExtension)) != NULL)
+		{
+			SCReadFinish(irp);
+			if(irp == Irp)
+				finished = TRUE;
+			else
+				IoCompleteRequest(irp, IO_NO_INCREMENT);
+		}
+	}
+	while(InterlockedDecrement(&FilterExtension->ReadDeliverCount) != 0);
+
+	return finished;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCReadComplete
+//      Completion routine for reads passed to the port. Two reads can
+//      come back on two processors at once, so the read waits on
+//      ReadsDone and SCReadDeliver buffers the data in the order the
+//      reads went down.
+//
+//  Arguments:
+//      IN  DeviceObject
+//              the filter or clone device object the read came in on
+//
+//      IN  Irp
+//              the completed read
+//
+//      IN  pdx
+//              that device's extension
+//
+//  Return Value:
+//      STATUS_SUCCESS, or STATUS_MORE_PROCESSING_REQUIRED if it is
+//      finished and completed again later
+//
+NTSTATUS SCReadComplete( IN  PDEVICE_OBJECT  DeviceObject,IN  PIRP  Irp,PSERIALCLONE_DEVICE_EXTENSION pdx)
+{
+	PSERIALCLONE_DEVICE_EXTENSION filterExtension;
+	PSERIALCLONE_IRP_STATUS pIrpInfo;
+	SCLOCK_HANDLE lockHandle;
+	BOOLEAN unordered;
+
+	// the completion time runs from here even if another read's
+	// completion finishes it
+	SCIrpQueuedTime(Irp) = SCLatencyNow();
 
 	if(Irp->PendingReturned)
 		IoMarkIrpPending(Irp);
@@ -767,80 +1055,113 @@ NTSTATUS SCReadComplete( IN  PDEVICE_OBJECT  DeviceObject,IN  PIRP  Irp,PSERIALC
 	else
 		filterExtension= pdx;
 
-	odx = pdx;
-	bufsiz = irpStack->Parameters.Read.Length;
+	pIrpInfo = SCReadTracking(IoGetCurrentIrpStackLocation(Irp));
 
+	//************ list lock **********************
+	SCLockAcquire(pdx, &filterExtension->ListLock, &lockHandle);
+	unordered = (filterExtension->Reads.Flink != &pIrpInfo->link);
+	InsertTailList(&filterExtension->ReadsDone, &Irp->Tail.Overlay.ListEntry);
+	//************ release list lock ************************
+	SCLockRelease(pdx, &lockHandle);
 
-	if(!IsListEmpty(&filterExtension->Reads))
+	if(unordered)
 	{
-		char * tmp ;
-		// for each device filter and clone 
-		while(cc--)
-		{
-			//char tbuff[200];
-			//size_t strnglen;
-	
-			// copy data into fifo
-			if(odx->OpenState=OpenStateReading)
-			{
-				if(odx->FDeviceObject->Flags & DO_BUFFERED_IO)
-				{
-					tmp = Irp->AssociatedIrp.SystemBuffer;
-					bufsiz = irpStack->Parameters.Read.Length;
-					//************ Fifo Lock ******************
-					KeAcquireSpinLock(&odx->ReadBuffer.FifoLock,&odx->ReadBuffer.SpunIRQ);
-					SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"FifoLock IN IRP %p ", Irp);
-					fifostatus = SCFifoWrite(&odx->ReadBuffer,  tmp,  bufsiz);
-					SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"FifoLock OUT IRP %p ", Irp);
-
-					KeReleaseSpinLock(&odx->ReadBuffer.FifoLock,odx->ReadBuffer.SpunIRQ);
-					//****************** end lock *******************
-
-					//RtlCopyMemory(tbuff,tmp,197);
-					//tbuff[197]=0;
-					//tbuff[198]=0;
-					//SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, "Buffer:: %s",tbuff);
-
-				}
-				else if(pdx->FDeviceObject->Flags & DO_DIRECT_IO)
-				{
-
-
-				}
-			}
-			odx=odx->Extension;
-		}
-		//************ list lock **********************
-		//KeAcquireSpinLock(&filterExtension->ListLock,&filterExtension->SpunListIRQ);
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE,__FUNCTION__"ListLock IN IRP %p ", Irp);
-		// get back the origional size
-		plist = 	RemoveHeadList(&filterExtension->Reads);	
-		//************ release list lock ************************
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"ListOut OUT IRP %p ", Irp);
-
-		//KeReleaseSpinLock(&filterExtension->ListLock,filterExtension->SpunListIRQ);
-		
-		pIrpInfo = CONTAINING_RECORD(plist,SERIALCLONE_IRP_STATUS,link);
-		if(pIrpInfo->Irp != Irp)
-		{
-			SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"Read out of sync. IRP:%p Fifo IRP:%p", Irp, pIrpInfo->Irp);
-		}
-		//************ Fifo Lock ******************
-		KeAcquireSpinLock(&odx->ReadBuffer.FifoLock,&odx->ReadBuffer.SpunIRQ);
-		bufsiz = (pIrpInfo->RequestedSize<pdx->ReadBuffer.Size) ? pIrpInfo->RequestedSize:pdx->ReadBuffer.Size;
-		fifostatus = SCFifoRead(&pdx->ReadBuffer,  Irp->AssociatedIrp.SystemBuffer, bufsiz,&actsiz);
-		KeReleaseSpinLock(&odx->ReadBuffer.FifoLock,odx->ReadBuffer.SpunIRQ);
-		//****************** end lock *******************
-
-		irpStack->Parameters.Read.Length=actsiz;
-		Irp->IoStatus.Information= actsiz;
-		ExFreePool(pIrpInfo);
+		SCTraceEvent(pdx, SERIALCLONE_TRACE_READ_UNORDERED, Irp, 0, 0, 0);
 	}
 
-	SerialCloneReleaseRemoveLock(pdx);
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, STATUS_SUCCESS);
+	if(!SCReadDeliver(filterExtension, Irp))
+		return STATUS_MORE_PROCESSING_REQUIRED;
 	return STATUS_SUCCESS;
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCReadAbort
+//      Cancels one device's reads sent to the port, for a PURGE_RXABORT
+//      that isn't passed down. The port completes them with what they
+//      had and they are delivered in order as usual. Each read is pinned
+//      in ReadAborting while it is cancelled outside the lock, so it can't
+//      be completed and freed under IoCancelIrp and the walk can go on
+//      from it. Reads sent after the abort started are left alone, as
+//      they are by a purge at the port.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension the purge came in on
+//
+//  Return Value:
+//      None
+//
+static VOID SCReadAbort(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension
+    )
+{
+	PSERIALCLONE_DEVICE_EXTENSION	filterExtension;
+	PSERIALCLONE_IRP_STATUS			pIrpInfo;
+	PLIST_ENTRY						entry;
+	PIRP							irp;
+	ULONG							count;
+	SCLOCK_HANDLE					lockHandle;
+
+	if(DeviceExtension->TypeFlag == ISCLONE)
+		filterExtension = DeviceExtension->Extension;
+	else
+		filterExtension = DeviceExtension;
+
+	//************ list lock **********************
+	SCLockAcquire(DeviceExtension, &filterExtension->ListLock, &lockHandle);
+	if(DeviceExtension->ReadAborting != NULL)
+	{
+		// another purge is already cancelling them
+		SCLockRelease(DeviceExtension, &lockHandle);
+		return;
+	}
+
+	count = 0;
+	for(entry = filterExtension->Reads.Flink; entry != &filterExtension->Reads; entry = entry->Flink)
+		if(SCReadDevice(entry) == DeviceExtension)
+			count++;
+
+	// the pinned read stays on Reads, its Flink is good after relocking
+	for(entry = filterExtension->Reads.Flink; (count != 0) && (entry != &filterExtension->Reads); entry = entry->Flink)
+	{
+		pIrpInfo = CONTAINING_RECORD(entry, SERIALCLONE_IRP_STATUS, link);
+		if(SCReadDevice(pIrpInfo) != DeviceExtension)
+			continue;
+
+		count--;
+		irp = pIrpInfo->Irp;
+		if(irp->Cancel)
+			continue;
+
+		DeviceExtension->ReadAborting = irp;
+		SCLockRelease(DeviceExtension, &lockHandle);
+		SCTraceEvent(DeviceExtension, SERIALCLONE_TRACE_READ_ABORT, irp, 0, 0, 0);
+		IoCancelIrp(irp);
+		SCLockAcquire(DeviceExtension, &filterExtension->ListLock, &lockHandle);
+	}
+	DeviceExtension->ReadAborting = NULL;
+	SCLockRelease(DeviceExtension, &lockHandle);
+	//************ release list lock ************************
+
+	// whatever came back while pinned
+	SCReadDeliver(filterExtension, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneReadDispatch
+//      Dispatch routine to handle IRP_MJ_READ
+//
+//  Arguments:
+//      IN  DeviceObject
+//              pointer to our device object
+//
+//      IN  Irp
+//              pointer to the IRP_MJ_READ IRP
+//
+//  Return Value:
+//      NT status code
+//
+
 NTSTATUS SerialCloneReadDispatch(
     IN  PDEVICE_OBJECT  DeviceObject,
     IN  PIRP            Irp
@@ -851,9 +1172,13 @@ NTSTATUS SerialCloneReadDispatch(
 	NTSTATUS							status;
 	PSERIALCLONE_IRP_STATUS				pIrpInfo;
     PIO_STACK_LOCATION					irpStack;
+	ULONG								requested;
+	ULONG								length;
+	ULONG								pending;
+	ULONG								start;
+	SCLOCK_HANDLE						lockHandle;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
-
+	start = SCLatencyNow();
     irpStack = IoGetCurrentIrpStackLocation(Irp);
 
     // Get our device extension from the device object
@@ -862,12 +1187,13 @@ NTSTATUS SerialCloneReadDispatch(
     if (!SerialCloneAcquireRemoveLock(deviceExtension))
     {
         status = STATUS_DELETE_PENDING;
+        SCTraceEvent(deviceExtension, SERIALCLONE_TRACE_REJECTED, Irp, IRP_MJ_READ, status, 0);
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
         return status;
     }
 	deviceExtension->OpenState=OpenStateReading;
+	SCStatInc(deviceExtension, ReadIrps);
 
 	// we need the extension for the filter to get the lists..
 	if(deviceExtension->TypeFlag == ISCLONE)
@@ -875,93 +1201,88 @@ NTSTATUS SerialCloneReadDispatch(
 	else
 		filterExtension= deviceExtension;
 
-    
-	// 1) allocate an IRP info struct
-
-	pIrpInfo = (PSERIALCLONE_IRP_STATUS)ExAllocateFromNPagedLookasideList(&filterExtension->LookasideBuffer);
-	if(pIrpInfo==NULL)
-	{
-        status = STATUS_INSUFFICIENT_RESOURCES;
-        Irp->IoStatus.Status = status;
-        IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
-        return status;
-	}
-	pIrpInfo->Irp=Irp;
-	pIrpInfo->RequestedSize = irpStack->Parameters.Read.Length;
-	pIrpInfo->Status=0;
+	requested = irpStack->Parameters.Read.Length;
+	SCTraceEvent(deviceExtension, SERIALCLONE_TRACE_READ, Irp, requested, deviceExtension->ReadBuffer.Size, 0);
 	//
-	//		check the buffer for this device for the request data 
+	// 1)	check the buffer for this device for the request data 
 	//			if the buffer has enough data to satify read
 
 	//************ Fifo Lock ******************
-	KeAcquireSpinLock(&deviceExtension->ReadBuffer.FifoLock,&deviceExtension->ReadBuffer.SpunIRQ);
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"Fifolock IN IRP %p ", Irp);
+	SCLockAcquire(deviceExtension, &deviceExtension->ReadBuffer.FifoLock, &lockHandle);
 
-	if(deviceExtension->ReadBuffer.Size>pIrpInfo->RequestedSize)
+	if(deviceExtension->ReadBuffer.Size>requested)
 	{
 		//				Copy the data
 		ULONG readsz;
-		SCFifoRead(&deviceExtension->ReadBuffer,Irp->AssociatedIrp.SystemBuffer,pIrpInfo->RequestedSize,&readsz);
-		KeReleaseSpinLock(&deviceExtension->ReadBuffer.FifoLock,deviceExtension->ReadBuffer.SpunIRQ);
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"Fifolock OUT IRP %p ", Irp);
+		SCFifoRead(&deviceExtension->ReadBuffer,Irp->AssociatedIrp.SystemBuffer,requested,&readsz);
+		SCLockRelease(deviceExtension, &lockHandle);
 
+		SCStatInc(deviceExtension, FastReads);
+		SCTraceEvent(deviceExtension, SERIALCLONE_TRACE_READ_FAST, Irp, requested, 0, 0);
 		Irp->IoStatus.Status = STATUS_SUCCESS;
-		Irp->IoStatus.Information= pIrpInfo->RequestedSize;
+		Irp->IoStatus.Information= requested;
 		IoCompleteRequest(Irp, IO_NO_INCREMENT);
-	    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--.Fifo Completed! IRP %p STATUS %x", Irp, STATUS_SUCCESS);
+		SCLatencyRecord(deviceExtension, SERIALCLONE_LATENCY_READ, SERIALCLONE_LATENCY_TOTAL,
+			SCLatencyNow() - start);
+		SerialCloneReleaseRemoveLock(deviceExtension);
 	
 		return STATUS_SUCCESS;
 	}
 	
-	//			else adjust the request size in the IRP
-	irpStack->Parameters.Read.Length -=deviceExtension->ReadBuffer.Size;
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"Fifolock OUT IRP %p ", Irp);
-	KeReleaseSpinLock(&deviceExtension->ReadBuffer.FifoLock,deviceExtension->ReadBuffer.SpunIRQ);
+	//			else adjust the request size
+	length = requested - deviceExtension->ReadBuffer.Size;
+	SCLockRelease(deviceExtension, &lockHandle);
 	//****************** end lock *******************
 
+	// 2) step into the spare stack location below ours. The port gets a
+	//	copy of our read parameters in the one below that, and the spare
+	//	one keeps our tracking until SCReadComplete. Our own location is
+	//	marked pending now since the port completes the read, not us.
+	IoMarkIrpPending(Irp);
+	irpStack = SCLatencyForward(Irp, start);
+
+	pIrpInfo = SCReadTracking(irpStack);
+	pIrpInfo->Irp = Irp;
+
 	// 3) check pending list - list of outstanding IRP's
 	//		Get amount requested in pending
 	//		if amount greater than current request size
 	
 	//****************** get list lock **************************
-	if(deviceExtension->TypeFlag==ISCLONE)
-	{
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__" Clone attempting Listlock IRP %p ", Irp);
-	}
+	SCLockAcquire(deviceExtension, &filterExtension->ListLock, &lockHandle);
 
-	//KeAcquireSpinLock(&filterExtension->ListLock,&filterExtension->SpunListIRQ);
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__" Listlock IN IRP %p ", Irp);
-
-	if(GetPendingSize(&filterExtension->Reads) >= irpStack->Parameters.Read.Length)	
+	pending = GetPendingSize(&filterExtension->Reads);
+	if(pending >= length)
 	{
 	//	always issue the irp 1 byte min.
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__" Requesting min 1 byte read IRP %p ", Irp);
-		pIrpInfo->Status = READWAITING;
-		irpStack->Parameters.Read.Length=1;
+		length=1;
 	}
 	else
 	{
 	//		else adjust request size
-		irpStack->Parameters.Read.Length-= GetPendingSize(&filterExtension->Reads);
-		SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__" Requesting %d bytes IRP %p ",irpStack->Parameters.Read.Length, Irp);
-
+		length-= pending;
 	}
-		//
-	// 4)send read request along to next lower device
-	pIrpInfo->Status = READPENDING;
+	pIrpInfo->Size = length;
+	IoGetNextIrpStackLocation(Irp)->Parameters.Read.Length = length;
+	IoSetCompletionRoutine(Irp,(PIO_COMPLETION_ROUTINE)SCReadComplete,deviceExtension,TRUE,TRUE,TRUE);
+
+	//	both lists in the same order, the port is sent the reads as
+	//	they are listed
 	InsertTailList(&filterExtension->Reads,&pIrpInfo->link);		
-	SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"Listlock OUT IRP %p ", Irp);
-	//KeReleaseSpinLock(&filterExtension->ListLock,filterExtension->SpunListIRQ);
+	InsertTailList(&filterExtension->ReadsToSend,&Irp->Tail.Overlay.ListEntry);
+	SCLockRelease(deviceExtension, &lockHandle);
 	//******************* release list lock ******************
 
-	IoCopyCurrentIrpStackLocationToNext(Irp); 
-	IoSetCompletionRoutine(Irp,(PIO_COMPLETION_ROUTINE)SCReadComplete,deviceExtension,TRUE,TRUE,TRUE);
-	status = IoCallDriver(filterExtension->LowerDeviceObject, Irp);
-		
+	//
+	// 4)send read request along to next lower device
+	SCStatInc(deviceExtension, LowerReads);
+	SCTraceEvent(deviceExtension, SERIALCLONE_TRACE_READ_LOWER, Irp, requested, length, pending);
+	SCLatencyRecord(deviceExtension, SERIALCLONE_LATENCY_READ, SERIALCLONE_LATENCY_DISPATCH,
+		SCLatencyNow() - start);
+	SCReadSend(filterExtension);
+	status = STATUS_PENDING;
     
 	//SerialCloneReleaseRemoveLock(deviceExtension);
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
 
     return status;
 }
@@ -986,38 +1307,48 @@ NTSTATUS SerialCloneWriteDispatch(
     )
 {
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
+    PSERIALCLONE_DEVICE_EXTENSION    filterExtension;
     NTSTATUS                        status;
+    ULONG                           length;
+    ULONG                           start;
 
+    start = SCLatencyNow();
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+	length = IoGetCurrentIrpStackLocation(Irp)->Parameters.Write.Length;
+	filterExtension = (deviceExtension->TypeFlag == ISCLONE) ? deviceExtension->Extension : deviceExtension;
 	    // Make sure we can accept IRPs
     if (!SerialCloneAcquireRemoveLock(deviceExtension))
     {
         status = STATUS_DELETE_PENDING;
+        SCTraceEvent(deviceExtension, SERIALCLONE_TRACE_REJECTED, Irp, IRP_MJ_WRITE, status, 0);
 
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
-
         return status;
     }
 
+	SCStatInc(deviceExtension, WriteIrps);
+
 	if(deviceExtension->Owner==deviceExtension->TypeFlag)
 	{
-		// we are in control
-		IoSkipCurrentIrpStackLocation(Irp);
-		status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
-
+		// we are in control, the pacer decides when it goes down
+		SCStatAdd(deviceExtension, BytesOut, length);
+		SCCaptureData(deviceExtension, SERIALCLONE_CAPTURE_TX, (PUCHAR)Irp->AssociatedIrp.SystemBuffer, length);
+		SCIrpQueuedTime(Irp) = start;
+		status = SCPaceWrite(filterExtension, Irp);
 	}
 	else
 	{
         status = STATUS_ACCESS_DENIED;
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
+        SCLatencyRecord(deviceExtension, SERIALCLONE_LATENCY_WRITE, SERIALCLONE_LATENCY_TOTAL,
+            SCLatencyNow() - start);
 	}
 
+    SCTraceEvent(deviceExtension, SERIALCLONE_TRACE_WRITE, Irp, length, status, 0);
     SerialCloneReleaseRemoveLock(deviceExtension);
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
 
     return status;
 
@@ -1190,6 +1521,13 @@ NTSTATUS SerialCloneSubmitIrpSync(
 //  SerialCloneAcquireRemoveLock
 //      Acquires remove lock.
 //
+//      References are counted per processor in the Stats slots so the
+//      dispatch routines don't all fight over one counter. A slot holds
+//      twice its reference count; SerialCloneWaitForSafeRemove moves the
+//      counts into RemoveCount and leaves SCREMOVE_DRAINED in every slot.
+//      A reference may be released on another processor than it was
+//      taken on, so a single slot can go negative, only the sum counts.
+//
 //  Arguments:
 //      IN  DeviceExtension
 //              our device extension
@@ -1197,11 +1535,27 @@ NTSTATUS SerialCloneSubmitIrpSync(
 //  Return Value:
 //      FALSE if remove device pending, TRUE otherwise.
 //
+#define SCREMOVE_DRAINED	1
+#define SCREMOVE_BIAS		0x40000000
+
 BOOLEAN SerialCloneAcquireRemoveLock(
     IN  PSERIALCLONE_DEVICE_EXTENSION    DeviceExtension
     )
 {
-    InterlockedIncrement(&DeviceExtension->RemoveCount);
+    PLONG   slot;
+    LONG    refs;
+
+    slot = &DeviceExtension->Stats[KeGetCurrentProcessorNumber()].RemoveRefs;
+    do
+    {
+        refs = *(volatile LONG *)slot;
+        if (refs & SCREMOVE_DRAINED)
+        {
+            return FALSE;
+        }
+    }
+    while (InterlockedCompareExchange(slot, refs + 2, refs) != refs);
+
     if (PnpStateRemoved == DeviceExtension->PnpState)
     {
         SerialCloneReleaseRemoveLock(DeviceExtension);
@@ -1227,10 +1581,24 @@ VOID SerialCloneReleaseRemoveLock(
     IN  PSERIALCLONE_DEVICE_EXTENSION    DeviceExtension
     )
 {
-    if (InterlockedDecrement(&DeviceExtension->RemoveCount) == 0)
+    PLONG   slot;
+    LONG    refs;
+
+    slot = &DeviceExtension->Stats[KeGetCurrentProcessorNumber()].RemoveRefs;
+    do
     {
-        KeSetEvent(&DeviceExtension->RemoveEvent, IO_NO_INCREMENT, FALSE);
+        refs = *(volatile LONG *)slot;
+        if (refs & SCREMOVE_DRAINED)
+        {
+            // removal has taken the count over
+            if (InterlockedDecrement(&DeviceExtension->RemoveCount) == 0)
+            {
+                KeSetEvent(&DeviceExtension->RemoveEvent, IO_NO_INCREMENT, FALSE);
+            }
+            return;
+        }
     }
+    while (InterlockedCompareExchange(slot, refs - 2, refs) != refs);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1252,8 +1620,28 @@ VOID SerialCloneWaitForSafeRemove(
     IN  PSERIALCLONE_DEVICE_EXTENSION    DeviceExtension
     )
 {
+    LONG    refs;
+    LONG    total;
+    ULONG   i;
+
     DeviceExtension->PnpState = PnpStateRemoved;
-    SerialCloneReleaseRemoveLock(DeviceExtension);
+
+    // the bias keeps releases landing on already drained slots from
+    // taking RemoveCount to zero before all the slots are in
+    InterlockedExchangeAdd(&DeviceExtension->RemoveCount, SCREMOVE_BIAS);
+
+    total = 0;
+    for (i = 0; i < DeviceExtension->StatsCpus; i++)
+    {
+        refs = InterlockedExchange(&DeviceExtension->Stats[i].RemoveRefs, SCREMOVE_DRAINED);
+        total += refs / 2;
+    }
+
+    // add the references found, drop the bias and our own initial one
+    if (InterlockedExchangeAdd(&DeviceExtension->RemoveCount, total - SCREMOVE_BIAS - 1) == SCREMOVE_BIAS + 1 - total)
+    {
+        KeSetEvent(&DeviceExtension->RemoveEvent, IO_NO_INCREMENT, FALSE);
+    }
 
     KeWaitForSingleObject(
         &DeviceExtension->RemoveEvent, 
@@ -1680,7 +2068,6 @@ NTSTATUS RepeatRequest(PDEVICE_OBJECT pdo, PIRP Irp)
 	{							// RepeatRequest
 	PSERIALCLONE_DEVICE_EXTENSION pdx;
 	PDEVICE_OBJECT fdo;
-	PSERIALCLONE_DEVICE_EXTENSION pfx;
 	PIO_STACK_LOCATION stack;
 
 	PDEVICE_OBJECT tdo;
@@ -1689,7 +2076,6 @@ NTSTATUS RepeatRequest(PDEVICE_OBJECT pdo, PIRP Irp)
 
 	pdx = (PSERIALCLONE_DEVICE_EXTENSION) pdo->DeviceExtension;
 	fdo = pdx->FDeviceObject;
-	pfx = (PSERIALCLONE_DEVICE_EXTENSION) fdo->DeviceExtension;
 	stack =IoGetCurrentIrpStackLocation(Irp);
 	tdo  = IoGetAttachedDeviceReference(fdo);
 	subirp  = IoAllocateIrp(tdo->StackSize + 1, FALSE);
@@ -1780,6 +2166,14 @@ void SCFifoInit(PSCFIFO  fifo, char * buffer, ULONG size)
 	fifo->Size=0;
 }
 
+// drop everything buffered, the storage is kept
+void SCFifoPurge(PSCFIFO  fifo)
+{
+	fifo->In = fifo->Buffer;
+	fifo->Out = fifo->Buffer;
+	fifo->Size=0;
+}
+
 
 
 NTSTATUS SCFifoRead(PSCFIFO  fifo, char * dest, ULONG size,ULONG * rsltSize)
@@ -1824,7 +2218,7 @@ NTSTATUS SCFifoWrite(PSCFIFO  fifo, char * src, ULONG size)
 		{
 			RtlCopyMemory(fifo->In,src,spacebeforwrap);
 			RtlCopyMemory(fifo->Buffer,src+spacebeforwrap,size-spacebeforwrap);
-			fifo->In=fifo->Buffer+size-spacebeforwrap+1;
+			fifo->In=fifo->Buffer+size-spacebeforwrap;
 		}
 		else
 		{
@@ -1842,6 +2236,100 @@ NTSTATUS SCFifoWrite(PSCFIFO  fifo, char * src, ULONG size)
 	return 0;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPurgeConsumer
+//      IOCTL_SERIAL_PURGE for one consumer of the port. PURGE_RXCLEAR empties
+//      the consumer's own read buffer. The port itself, and with it the
+//      other consumer's data, is only purged for the owner. For the other
+//      consumer PURGE_RXABORT cancels its own reads at the port, and
+//      PURGE_TXABORT and PURGE_TXCLEAR cancel its writes the pacer holds,
+//      of which it has none while it may not write.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension the purge came in on
+//
+//      IN  Irp
+//              the IOCTL_SERIAL_PURGE IRP
+//
+//      OUT Status
+//              status to complete the IRP with when it is not passed down
+//
+//  Return Value:
+//      TRUE if the IRP still has to go to the port
+//
+BOOLEAN SCPurgeConsumer(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  PIRP                            Irp,
+    OUT NTSTATUS *                      Status
+    )
+{
+	ULONG	mask;
+	SCLOCK_HANDLE	lockHandle;
+
+	*Status = STATUS_SUCCESS;
+
+	if(IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.InputBufferLength < sizeof(ULONG))
+	{
+		*Status = STATUS_BUFFER_TOO_SMALL;
+		return FALSE;
+	}
+
+	mask = *(PULONG)Irp->AssociatedIrp.SystemBuffer;
+	if((mask == 0) || (mask & ~(SERIAL_PURGE_TXABORT | SERIAL_PURGE_RXABORT | SERIAL_PURGE_TXCLEAR | SERIAL_PURGE_RXCLEAR)))
+	{
+		*Status = STATUS_INVALID_PARAMETER;
+		return FALSE;
+	}
+
+	if(mask & SERIAL_PURGE_RXCLEAR)
+	{
+		SCLockAcquire(DeviceExtension, &DeviceExtension->ReadBuffer.FifoLock, &lockHandle);
+		SCFifoPurge(&DeviceExtension->ReadBuffer);
+		SCLockRelease(DeviceExtension, &lockHandle);
+	}
+
+	SCDebug(DBG_IO, DBG_INFO, (__FUNCTION__": type %d mask %x owner %d",
+		DeviceExtension->TypeFlag, mask, DeviceExtension->Owner));
+
+	if(DeviceExtension->Owner == DeviceExtension->TypeFlag)
+		return TRUE;
+
+	if(mask & SERIAL_PURGE_RXABORT)
+		SCReadAbort(DeviceExtension);
+
+	if(mask & (SERIAL_PURGE_TXABORT | SERIAL_PURGE_TXCLEAR))
+		SCPaceFlush((DeviceExtension->TypeFlag == ISCLONE) ? DeviceExtension->Extension : DeviceExtension,
+			IoGetCurrentIrpStackLocation(Irp)->FileObject);
+
+	return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCallerPrivileged
+//      Whether the sender of one of our IOCTLs may see what goes on
+//      inside the driver, other ports and kernel addresses included: the
+//      kernel, or a process holding the system profile privilege, which
+//      only administrators have by default. Called at PASSIVE_LEVEL for
+//      a user mode caller.
+//
+//  Arguments:
+//      IN  Irp
+//              the IOCTL
+//
+//  Return Value:
+//      TRUE if it may
+//
+BOOLEAN SCCallerPrivileged(
+    IN  PIRP    Irp
+    )
+{
+	if(Irp->RequestorMode == KernelMode)
+		return TRUE;
+
+	return SeSinglePrivilegeCheck(RtlConvertLongToLuid(SE_SYSTEM_PROFILE_PRIVILEGE), Irp->RequestorMode);
+}
+
 ULONG GetPendingSize(LIST_ENTRY * list)
 {
 	ULONG size = 0;
@@ -93,6 +93,10 @@ SOURCE="$(InputPath)"
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\capture.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\clone.c
 DEP_CPP_CLONE=\
 	"..\..\..\WINDDK\2600~1.110\inc\crt\basetsd.h"\
@@ -117,6 +121,10 @@ NODEP_CPP_CLONE=\
 # End Source File
 # Begin Source File
 
+SOURCE=.\CloneIOctl.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\debug.c
 DEP_CPP_DEBUG=\
 	"..\..\..\WINDDK\2600~1.110\inc\crt\basetsd.h"\
@@ -165,6 +173,30 @@ NODEP_CPP_FILTE=\
 # End Source File
 # Begin Source File
 
+SOURCE=.\instance.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\latency.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\list.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\lock.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\pace.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\portstate.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\registry.c
 DEP_CPP_REGIS=\
 	"..\..\..\WINDDK\2600~1.110\inc\crt\basetsd.h"\
@@ -189,6 +221,10 @@ NODEP_CPP_REGIS=\
 # End Source File
 # Begin Source File
 
+SOURCE=.\rxbuffer.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\SerialClone.c
 DEP_CPP_SERIA=\
 	"..\..\..\WINDDK\2600~1.110\inc\crt\basetsd.h"\
@@ -210,6 +246,18 @@ DEP_CPP_SERIA=\
 NODEP_CPP_SERIA=\
 	".\SerialClone.tmh"\
 	
+# End Source File
+# Begin Source File
+
+SOURCE=.\stats.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\trace.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\wait.c
 # End Source File
 # End Group
 # Begin Group "Header Files"
@@ -235,6 +283,10 @@ SOURCE=.\SerialClone.h
 
 SOURCE=.\SerialClone.rc
 # End Source File
+# Begin Source File
+
+SOURCE=.\SerialClone.mof
+# End Source File
 # End Group
 # Begin Source File
 
@@ -242,6 +294,10 @@ SOURCE=.\makefile
 # End Source File
 # Begin Source File
 
+SOURCE=.\makefile.inc
+# End Source File
+# Begin Source File
+
 SOURCE=.\SerialClone.inf.txt
 # End Source File
 # Begin Source File
@@ -72,9 +72,43 @@ typedef struct _SERIALCLONE_IO_LOCK
 typedef struct _SERIALCLONE_DATA
 {
     UNICODE_STRING      RegistryPath;
-    ULONG               InstanceCount;
+    ULONG               InstanceCount;      // ports in the instance table
+    ULONG               TxPaceMs;           // Parameters\TxPaceMs, 0 turns pacing off
+    ULONG               LockTiming;         // Parameters\LockTiming, nonzero times how long locks are held
+    ULONG               LatencyHistograms;  // Parameters\LatencyHistograms, nonzero keeps SCLATENCY_CPU slots
+    ULONG               RxRetainMs;         // Parameters\RxRetainMs, read buffer kept this long after last close
+    ULONG               TraceRecords;       // Parameters\TraceRecords, per processor trace ring size, 0 for none
+    ULONG               CaptureEvery;       // Parameters\CaptureEvery, sample one read or write in this many, 0 for none
+    ULONG               CaptureBytes;       // Parameters\CaptureBytes, bytes kept of a sampled read or write
+    ULONG               CaptureRecords;     // Parameters\CaptureRecords, samples the capture ring holds
+    LARGE_INTEGER       PerfFrequency;      // KeQueryPerformanceCounter ticks per second
+    ULONG               LatencyShift;       // performance counter to latency tick shift
+    ULONG               LatencyFrequency;   // latency ticks per second
 } SERIALCLONE_DATA, *PSERIALCLONE_DATA;
 
+// transmit pacing, off unless Parameters\TxPaceMs turns it on
+#define SCPACE_DEFAULT_MS   0
+#define SCPACE_MAX_MS       10000
+
+// read buffer of an opened device, and the longest it is kept after close
+#define SCRX_BUFFER_SIZE    8192
+#define SCRX_RETAIN_MAX_MS  600000
+
+// ports the instance table can hold, a multiple of 32
+#define SC_MAX_INSTANCES    1024
+
+// binary trace ring size, per processor
+#define SCTRACE_DEFAULT_RECORDS 1024
+#define SCTRACE_MIN_RECORDS     16
+#define SCTRACE_MAX_RECORDS     65536
+
+// sampled capture of received and written data
+#define SCCAPTURE_DEFAULT_BYTES     64
+#define SCCAPTURE_MAX_BYTES         4096
+#define SCCAPTURE_DEFAULT_RECORDS   256
+#define SCCAPTURE_MIN_RECORDS       16
+#define SCCAPTURE_MAX_RECORDS       16384
+
 extern SERIALCLONE_DATA g_Data;
 
 // PnP states
@@ -89,26 +123,40 @@ typedef enum _SERIALCLONE_PNP_STATE
     PnpStateSurpriseRemoved
 } SERIALCLONE_PNP_STATE;
 
+// Tracking for a read we sent down to the port. It is not allocated: the
+// device objects have one spare stack location between us and the lower
+// driver, and while the read is down there its Parameters are ours.
 typedef struct _SERIALCLONE_IRP_STATUS
 {
-	PIRP		Irp;
-	ULONG		RequestedSize;		// Initial request size
-	ULONG		Size;				// size actually passed along after adjustments
-	ULONG		Status;				// Pending - irp has been issued
-									// Waiting - Irp is waiting for previous request
-	KIRQL  			SpunIRQ;
 	LIST_ENTRY	link;				// list support
+	PIRP		Irp;				// the read, for SCReadAbort
+	ULONG		Size;				// size actually passed along after adjustments
 } SERIALCLONE_IRP_STATUS, *PSERIALCLONE_IRP_STATUS;
 
-#define READWAITING	1
-#define READPENDING 2
+C_ASSERT(sizeof(SERIALCLONE_IRP_STATUS) <= sizeof(((PIO_STACK_LOCATION)0)->Parameters));
+
+// tracking and arrival time (SCLatencyNow) in the spare stack location
+#define SCReadTracking(stack)	((PSERIALCLONE_IRP_STATUS)&(stack)->Parameters)
+// what the read asked for, still in our own location above the spare one
+#define SCReadRequested(stack)	(((stack) + 1)->Parameters.Read.Length)
+// the filter or clone device extension the read came in on, from its tracking
+#define SCReadDevice(info)		((PSERIALCLONE_DEVICE_EXTENSION) \
+	CONTAINING_RECORD(info, IO_STACK_LOCATION, Parameters)->DeviceObject->DeviceExtension)
+#define SCIrpStartTime(stack)	(*(PULONG)&(stack)->Context)
+
+// arrival time of a write while the pacer holds it, DriverContext[0] is the list's;
+// for a read, when the port returned it, in case it waits on ReadsDone
+#define SCIrpQueuedTime(irp)	(*(PULONG)&(irp)->Tail.Overlay.DriverContext[1])
+
+// latency timestamp, the performance counter scaled down to at most
+// 10MHz so the low 32 bits last minutes rather than a second
+#define SCLatencyNow()	((ULONG)(KeQueryPerformanceCounter(NULL).QuadPart >> g_Data.LatencyShift))
 
 typedef struct _SCFIFO 
 {
 	KSPIN_LOCK FifoLock;
-	KIRQL  			SpunIRQ;
 
-	char	* Buffer;	// base pointer to buffer
+	char	* Buffer;	// base pointer to buffer, NULL until the device is opened
 	ULONG	BuffSize;	// Size of total buffer
 	char	* End;		// pointer to last byte
 	char	* In;		// pointer to incomming
@@ -116,6 +164,71 @@ typedef struct _SCFIFO
 	ULONG	Size;		// number of characters in buffer
 } SCFIFO,*PSCFIFO;
 
+// port configuration snooped from the IOCTLs the owner sends down
+typedef struct _SCPORT_STATE
+{
+	KSPIN_LOCK				StateLock;
+	ULONG					Valid;			// SCPORT_xxx, which fields below have been seen
+	ULONG					BaudRate;
+	SERIAL_LINE_CONTROL		LineControl;
+	SERIAL_TIMEOUTS			Timeouts;
+	SERIAL_CHARS			Chars;
+	SERIAL_HANDFLOW			HandFlow;
+} SCPORT_STATE, *PSCPORT_STATE;
+
+// a port's ring of sampled received and written data, see Capture.c
+typedef struct _SCCAPTURE
+{
+	KSPIN_LOCK				Lock;			// guards everything below but Offered
+	PUCHAR					Slots;			// NULL while capture is off
+	ULONG					SlotSize;		// bytes from one record to the next
+	ULONG					Count;			// slots in the ring, a power of 2
+	ULONG					Head;			// samples ever taken, the next one's slot
+	ULONG					Tail;			// first sample not drained yet
+	ULONG					Dropped;		// overwritten undrained since the last drain
+	LONG					Offered;		// reads and writes seen, picks every Nth
+} SCCAPTURE, *PSCCAPTURE;
+
+// same bits as SERIALCLONE_STATE_xxx in intrface.h
+#define SCPORT_BAUD_RATE		0x00000001
+#define SCPORT_LINE_CONTROL		0x00000002
+#define SCPORT_TIMEOUTS			0x00000004
+#define SCPORT_CHARS			0x00000008
+#define SCPORT_HANDFLOW			0x00000010
+
+// one processor's counters and share of the remove lock, padded out to
+// whole cache lines
+#define SC_CACHE_LINE	64
+
+typedef struct _SCSTATS_CPU
+{
+	SERIALCLONE_COUNTERS	Counters;		// FifoHighWater is not used here
+	LONG					RemoveRefs;		// see SerialCloneAcquireRemoveLock
+	UCHAR					Pad[SC_CACHE_LINE -
+		(sizeof(SERIALCLONE_COUNTERS) + sizeof(LONG)) % SC_CACHE_LINE];
+} SCSTATS_CPU, *PSCSTATS_CPU;
+
+// one processor's latency histograms, over 4 KB, so a device only has
+// them with Parameters\LatencyHistograms set
+typedef struct _SCLATENCY_CPU
+{
+	SERIALCLONE_LATENCY		Latency;
+	UCHAR					Pad[SC_CACHE_LINE - sizeof(SERIALCLONE_LATENCY) % SC_CACHE_LINE];
+} SCLATENCY_CPU, *PSCLATENCY_CPU;
+
+// counter updates, each processor only ever touches its own slot
+#define SCStatCpu(ext)			(&(ext)->Stats[KeGetCurrentProcessorNumber()].Counters)
+#define SCStatInc(ext, f)		InterlockedIncrement((PLONG)&SCStatCpu(ext)->f)
+#define SCStatAdd(ext, f, n)	ExInterlockedAddLargeStatistic((PLARGE_INTEGER)&SCStatCpu(ext)->f, (ULONG)(n))
+
+// an acquisition of one of the timed read path locks, kept on the
+// acquirer's stack along with its saved IRQL
+typedef struct _SCLOCK_HANDLE
+{
+	KLOCK_QUEUE_HANDLE		Queue;
+	LONGLONG				Acquired;		// performance counter when taken, 0 when not timing
+} SCLOCK_HANDLE, *PSCLOCK_HANDLE;
+
 typedef enum _SERIALCLONE_OPEN_STATE 
 {
     OpenStateClosed = 0,
@@ -124,21 +237,47 @@ typedef enum _SERIALCLONE_OPEN_STATE
     OpenStateReadPaused,
 } SERIALCLONE_OPEN_STATE;
 
-// The device extension for the device object
+// The device extension for the device object. Fields are grouped by who
+// touches them; the groups written on the read path are kept a whole cache
+// line apart so one processor completing a read doesn't keep stealing the
+// line another is dispatching from.
+#define SC_CACHE_PAD(name)	UCHAR name[SC_CACHE_LINE]
+
 typedef struct _SERIALCLONE_DEVICE_EXTENSION
 {
+	// read mostly, looked at on every IRP
 	ULONG					TypeFlag;				// 0001 if filter, 0002 if clone
-	ULONG					OpenState;
     PDEVICE_OBJECT          FDeviceObject;           // pointer to the Filter DeviceObject
     PDEVICE_OBJECT          CDeviceObject;           // pointer to the Clone DeviceObject
-    
 	PDEVICE_OBJECT          PhysicalDeviceObject;   // underlying PDO
     PDEVICE_OBJECT          LowerDeviceObject;      // top of the device stack
+	struct _SERIALCLONE_DEVICE_EXTENSION *	Extension ; // pointer to others extension (clone or filter) 
+	PSCSTATS_CPU			Stats;			// per processor counters and remove lock, end of the extension
+	ULONG					StatsCpus;		// number of slots in Stats
+	PSCLATENCY_CPU			Latency;		// StatsCpus histograms after Stats, NULL when not kept
+    SERIALCLONE_PNP_STATE   PnpState;               // PnP state variable
 
-    LONG                    RemoveCount;            // 1-based reference count
+	SC_CACHE_PAD(PadReads);
+	// reads sent down to the port, filter only
+    KSPIN_LOCK				ListLock;
+	LIST_ENTRY				Reads;			// list of waiting irp's
+	LIST_ENTRY				ReadsToSend;	// IRPs on Reads not passed down yet, in the same order
+	LIST_ENTRY				ReadsDone;		// IRPs the port returned, waiting for those before them
+	LONG					ReadSendCount;	// SCReadSend re-entrancy guard
+	LONG					ReadDeliverCount;	// SCReadDeliver re-entrancy guard
+	PIRP					ReadAborting;	// SCReadAbort's place in Reads, each device's, under the filter's ListLock
+
+	SC_CACHE_PAD(PadFifo);
+	// received data for this device, filled by read completion and
+	// drained by read dispatch under its FifoLock
+	ULONG					OpenState;		// both of them write it
+	struct	_SCFIFO			ReadBuffer;
+	ULONG					FifoHighWater;	// most bytes in ReadBuffer, under its FifoLock
+
+	SC_CACHE_PAD(PadCold);
+    LONG                    RemoveCount;            // 1-based reference count, only used once removal drains Stats
     KEVENT                  RemoveEvent;            // event to sync device removal
 
-    SERIALCLONE_PNP_STATE   PnpState;               // PnP state variable
     SERIALCLONE_PNP_STATE   PreviousPnpState;       // Previous PnP state variable
     
 	UNICODE_STRING          ntDeviceName;
@@ -147,12 +286,24 @@ typedef struct _SERIALCLONE_DEVICE_EXTENSION
 	DEVICE_CAPABILITIES		devcaps;				// copy of most recent device capabilities
     LONG                    OpenHandleCount;
 	ULONG					Owner;					// ID of device that did the open 
-    KSPIN_LOCK				ListLock;
-	KIRQL  					SpunListIRQ;
-	LIST_ENTRY				Reads;			// list of waiting irp's
-	NPAGED_LOOKASIDE_LIST	LookasideBuffer;
-	struct	_SCFIFO			ReadBuffer;
-	struct _SERIALCLONE_DEVICE_EXTENSION *	Extension ; // pointer to others extension (clone or filter) 
+	ULONG					Instance;				// port's slot in the instance table, names the clone
+	KTIMER					RxRetainTimer;	// frees ReadBuffer a while after the last close
+	KDPC					RxRetainDpc;
+
+	// filter only
+	SCPORT_STATE			PortState;		// snooped port configuration
+	SERIALCLONE_LIST		TxQueue;		// writes held back by the pacer
+	LONG					TxOutstanding;	// bytes passed down and not yet completed
+	LONG					TxPumpCount;	// pacer re-entrancy guard
+	ULONG					TxPaceMs;		// ms of transmit data allowed below us
+	SCCAPTURE				Capture;		// the port's sampled data, drained through the clone
+	BOOLEAN					WmiRegistered;	// SCWmiRegister succeeded, SCWmiDeregister undoes it
+
+	// clone only
+	KSPIN_LOCK				WaitLock;		// guards WaitMask and WaitHistory
+	ULONG					WaitMask;		// SERIAL_EV_xxx the reader waits for
+	ULONG					WaitHistory;	// events seen with no wait pending
+	SERIALCLONE_LIST		WaitQueue;		// the pending IOCTL_SERIAL_WAIT_ON_MASK
 
 } SERIALCLONE_DEVICE_EXTENSION, *PSERIALCLONE_DEVICE_EXTENSION;
 
@@ -281,6 +432,8 @@ NTSTATUS __stdcall FilterDeviceIoControlDispatch(IN  PDEVICE_OBJECT  DeviceObjec
     IN  PIRP   Irp );
 NTSTATUS __stdcall CloneDeviceIoControlDispatch(IN  PDEVICE_OBJECT  DeviceObject,
     IN  PIRP  Irp );
+NTSTATUS CloneSerialIoControl(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension,
+    IN  PIRP  Irp );
 
 NTSTATUS __stdcall FilterInternalDeviceIoControlDispatch(
     IN  PDEVICE_OBJECT  DeviceObject,
@@ -346,9 +499,89 @@ NTSTATUS __stdcall CloneSystemControlDispatch(
     );
 
 void SCFifoInit(PSCFIFO  fifo, char * buffer, ULONG size);
+void SCFifoPurge(PSCFIFO  fifo);
 NTSTATUS SCFifoWrite(PSCFIFO  fifo, char * src, ULONG size);
 NTSTATUS SCFifoRead(PSCFIFO  fifo, char * dest, ULONG size,ULONG * rsltSize);
 ULONG GetPendingSize(LIST_ENTRY * list);
+BOOLEAN SCPurgeConsumer(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN PIRP Irp, OUT NTSTATUS * Status);
+BOOLEAN SCCallerPrivileged(IN PIRP Irp);
+
+// port state snooping
+VOID SCPortStateInit(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+VOID SCPortStateInvalidate(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+ULONG SCPortBitsPerChar(IN PSERIAL_LINE_CONTROL LineControl);
+VOID SCSnoopIoctl(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PIRP Irp, IN ULONG StartTime);
+BOOLEAN SCPortStateQuery(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PIRP Irp,
+	IN ULONG Valid, IN PVOID Source, IN ULONG Size);
+NTSTATUS SCPortStateSnapshot(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PIRP Irp);
+
+// transmit pacing
+VOID SCPaceInit(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+NTSTATUS SCPaceWrite(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PIRP Irp);
+VOID SCPaceStartNext(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+VOID SCPaceFlush(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PFILE_OBJECT FileObject);
+VOID SCPaceStop(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+
+// performance counters
+ULONG SCStatsCpus(VOID);
+ULONG SCStatsExtensionSize(VOID);
+VOID SCStatsInit(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension);
+VOID SCStatsLatency(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN ULONG Elapsed);
+VOID SCStatsQuery(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, OUT PSERIALCLONE_COUNTERS Counters);
+NTSTATUS SCStatsIoctl(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PIRP Irp);
+NTSTATUS SCWmiRegister(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+VOID SCWmiDeregister(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+NTSTATUS SCWmiSystemControl(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PIRP Irp);
+
+// latency histograms
+VOID SCLatencyInit(VOID);
+VOID SCLatencyRecord(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN ULONG Major, IN ULONG Phase,
+	IN ULONG Elapsed);
+PIO_STACK_LOCATION SCLatencyForward(IN PIRP Irp, IN ULONG StartTime);
+VOID SCLatencyComplete(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN ULONG Major, IN PIRP Irp,
+	IN ULONG Entered);
+NTSTATUS SCLatencyIoctl(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension, IN PIRP Irp, IN BOOLEAN Clone);
+
+// instance table
+VOID SCInstanceInit(VOID);
+NTSTATUS SCInstanceAllocate(OUT PULONG Instance);
+VOID SCInstanceFree(IN ULONG Instance);
+
+// binary trace
+VOID SCTraceInit(VOID);
+VOID SCTraceFree(VOID);
+VOID SCTraceEvent(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN USHORT Event, IN PIRP Irp,
+	IN ULONG Arg0, IN ULONG Arg1, IN ULONG Arg2);
+NTSTATUS SCTraceIoctl(IN PIRP Irp, IN BOOLEAN Privileged);
+
+// sampled capture of received and written data
+VOID SCCaptureInit(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+VOID SCCaptureFree(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension);
+VOID SCCaptureData(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN UCHAR Direction, IN PUCHAR Data,
+	IN ULONG Length);
+NTSTATUS SCCaptureIoctl(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN PIRP Irp);
+
+// read buffer storage
+VOID SCRxBufferInit(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension);
+NTSTATUS SCRxBufferOpen(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension);
+VOID SCRxBufferClose(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension);
+VOID SCRxBufferCancelRetain(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension);
+VOID SCRxBufferStop(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension);
+
+// timed read path locks
+VOID SCLockAcquire(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN PKSPIN_LOCK Lock, OUT PSCLOCK_HANDLE Handle);
+VOID SCLockRelease(IN PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, IN PSCLOCK_HANDLE Handle);
+ULONGLONG SCLockTicksTo100ns(IN ULONGLONG Ticks);
+
+// clone wait on mask
+VOID SCWaitInit(IN PSERIALCLONE_DEVICE_EXTENSION CloneExtension);
+NTSTATUS SCWaitSetMask(IN PSERIALCLONE_DEVICE_EXTENSION CloneExtension, IN PIRP Irp);
+NTSTATUS SCWaitGetMask(IN PSERIALCLONE_DEVICE_EXTENSION CloneExtension, IN PIRP Irp);
+NTSTATUS SCWaitOnMask(IN PSERIALCLONE_DEVICE_EXTENSION CloneExtension, IN PIRP Irp);
+VOID SCWaitRaise(IN PSERIALCLONE_DEVICE_EXTENSION CloneExtension, IN PCHAR Data, IN ULONG Length,
+	IN ULONG OldSize, IN ULONG NewSize);
+VOID SCWaitFlush(IN PSERIALCLONE_DEVICE_EXTENSION CloneExtension, IN PFILE_OBJECT FileObject);
+VOID SCWaitStop(IN PSERIALCLONE_DEVICE_EXTENSION CloneExtension);
 #ifdef __cplusplus
 }
 #endif
@@ -454,9 +687,45 @@ __inline PCHAR DevicePowerStateString(
 
 #if DBG
 
-VOID SerialCloneDebugPrint(
-    IN ULONG    Area,
-    IN ULONG    Level,
+// Messages are written SCDebug(Area, Level, (Format, ...)). A site above
+// SC_DEBUG_LEVEL or outside SC_DEBUG_AREAS is not compiled at all, its
+// arguments included; set them in C_DEFINES to trim a checked build.
+// The rest cost one test of g_DebugAreas[Level], which is what to change
+// from the debugger to turn areas on and off.
+
+#ifndef SC_DEBUG_LEVEL
+#define SC_DEBUG_LEVEL      DBG_INFO
+#endif
+#ifndef SC_DEBUG_AREAS
+#define SC_DEBUG_AREAS      DBG_ALL
+#endif
+
+#define SC_DEBUG_COMPILED(Area, Level)  (((Level) <= SC_DEBUG_LEVEL) && (((Area) & SC_DEBUG_AREAS) != 0))
+
+#define SCDebug(Area, Level, Args) \
+    if (!SC_DEBUG_COMPILED(Area, Level) || !(g_DebugAreas[Level] & (Area))) {} else SCDebugPrint_##Level Args
+
+// the level picks the message prefix
+#define SCDebugPrint_DBG_ERR    SerialCloneDebugError
+#define SCDebugPrint_DBG_WARN   SerialCloneDebugWarning
+#define SCDebugPrint_DBG_TRACE  SerialCloneDebugMessage
+#define SCDebugPrint_DBG_INFO   SerialCloneDebugMessage
+#define SCDebugPrint_DBG_VERB   SerialCloneDebugMessage
+
+// areas switched on at each level
+extern ULONG g_DebugAreas[DBG_VERB + 1];
+
+VOID SerialCloneDebugError(
+    IN PCCHAR   Format,
+    IN          ...
+    );
+
+VOID SerialCloneDebugWarning(
+    IN PCCHAR   Format,
+    IN          ...
+    );
+
+VOID SerialCloneDebugMessage(
     IN PCCHAR   Format,
     IN          ...
     );
@@ -493,14 +762,7 @@ PCHAR WMIMinorFunctionString (
 
 #else	// !DBG
 
-__inline VOID SerialCloneDebugPrint(
-    IN ULONG    Area,
-    IN ULONG    Level,
-    IN PCCHAR   Format,
-    IN          ...
-    )
-{
-}
+#define SCDebug(Area, Level, Args)  ((void)0)
 
 #define SerialCloneDumpIrp(Irp)
 #define IrpMajorFunctionString(MajorFunction)
@@ -674,4 +936,8 @@ VOID SerialCloneRegEnumerateValueKeys(
     IN  HANDLE  RegKeyHandle
     );
 
+VOID SerialCloneReadParameters(
+    IN  PUNICODE_STRING RegistryPath
+    );
+
 #endif  // __SERIALCLONE_H__
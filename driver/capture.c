@@ -0,0 +1,231 @@
+// Capture.c
+//
+// Sampled capture of received and written data. With
+// Parameters\CaptureEvery set, one port read or owner write in that many
+// has its first CaptureBytes bytes copied into the port's ring, allocated
+// with its devices; IOCTL_SERIALCLONE_GET_CAPTURE on the port's clone
+// drains it and the sccapture tool dumps or records what comes out. With it off, a read or write costs one test and
+// nothing is copied.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Capture.tmh"
+#endif
+
+#define SCCaptureSlot(cap, seq)	((PSERIALCLONE_CAPTURE_RECORD)((cap)->Slots + \
+	((seq) & ((cap)->Count - 1)) * (cap)->SlotSize))
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureInit
+//      Allocates the port's ring, called from AddDevice. Capture just
+//      stays off on the port if there is no memory for it.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              the port's filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCCaptureInit(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension)
+{
+	PSCCAPTURE	capture = &FilterExtension->Capture;
+	ULONG		count;
+
+	KeInitializeSpinLock(&capture->Lock);
+	capture->Slots = NULL;
+	capture->Head = 0;
+	capture->Tail = 0;
+	capture->Dropped = 0;
+	capture->Offered = 0;
+
+	if(g_Data.CaptureEvery == 0)
+		return;
+
+	for(count = SCCAPTURE_MIN_RECORDS; count < g_Data.CaptureRecords; count <<= 1)
+		;
+
+	capture->Count = count;
+	capture->SlotSize = FIELD_OFFSET(SERIALCLONE_CAPTURE_RECORD, Data) + g_Data.CaptureBytes;
+	capture->SlotSize = (capture->SlotSize + sizeof(ULONGLONG) - 1) & ~(sizeof(ULONGLONG) - 1);
+
+	capture->Slots = (PUCHAR)ExAllocatePoolWithTag(NonPagedPool, count * capture->SlotSize, SERIALCLONE_POOL_TAG);
+	if(capture->Slots == NULL)
+	{
+		SCDebug(DBG_INIT, DBG_WARN, (__FUNCTION__": no memory for %d samples, capture off", count));
+		return;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureFree
+//      Frees the port's ring, called at IRP_MN_REMOVE_DEVICE once neither
+//      device is left to use it
+//
+//  Arguments:
+//      IN  FilterExtension
+//              the port's filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCCaptureFree(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension)
+{
+	PSCCAPTURE	capture = &FilterExtension->Capture;
+
+	if(capture->Slots != NULL)
+	{
+		ExFreePool(capture->Slots);
+		capture->Slots = NULL;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureData
+//      Offers the data of a completed port read, or of a write on its way
+//      to the port, for sampling. When the ring is full the oldest sample
+//      makes room. Stamped with the system time so recordings of the
+//      port line up with the wall clock.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              device whose read or write it was
+//
+//      IN  Direction
+//              SERIALCLONE_CAPTURE_RX or _TX
+//
+//      IN  Data
+//              the bytes received or written
+//
+//      IN  Length
+//              number of bytes
+//
+//  Return Value:
+//      None
+//
+VOID SCCaptureData(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  UCHAR                           Direction,
+    IN  PUCHAR                          Data,
+    IN  ULONG                           Length
+    )
+{
+	PSCCAPTURE					capture;
+	PSERIALCLONE_CAPTURE_RECORD	record;
+	ULONG						captured;
+	LARGE_INTEGER				time;
+	KLOCK_QUEUE_HANDLE			lockHandle;
+
+	// the clone's reads and writes go to its port's ring
+	capture = (DeviceExtension->TypeFlag == ISCLONE) ?
+		&DeviceExtension->Extension->Capture : &DeviceExtension->Capture;
+
+	if((capture->Slots == NULL) || (Length == 0))
+		return;
+
+	if((ULONG)InterlockedIncrement(&capture->Offered) % g_Data.CaptureEvery != 0)
+		return;
+
+	captured = (Length < g_Data.CaptureBytes) ? Length : g_Data.CaptureBytes;
+	KeQuerySystemTime(&time);
+
+	KeAcquireInStackQueuedSpinLock(&capture->Lock, &lockHandle);
+
+	if(capture->Head - capture->Tail == capture->Count)
+	{
+		capture->Tail++;
+		capture->Dropped++;
+	}
+
+	record = SCCaptureSlot(capture, capture->Head);
+	capture->Head++;
+
+	record->Time = time.QuadPart;
+	record->Sequence = capture->Head;
+	record->Instance = DeviceExtension->Instance;
+	record->Length = Length;
+	record->Captured = (USHORT)captured;
+	record->Device = (UCHAR)DeviceExtension->TypeFlag;
+	record->Direction = Direction;
+	RtlCopyMemory(record->Data, Data, captured);
+
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureIoctl
+//      IOCTL_SERIALCLONE_GET_CAPTURE, moves as many samples as fit from
+//      the port's ring to the caller. Only the clone takes it; the filter
+//      refuses it so whoever has the port open can't drain its data.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              clone device extension the IOCTL came in on
+//
+//      IN  Irp
+//              the IOCTL_SERIALCLONE_GET_CAPTURE IRP
+//
+//  Return Value:
+//      NT status code to complete the IRP with
+//
+NTSTATUS SCCaptureIoctl(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  PIRP                            Irp
+    )
+{
+	PSCCAPTURE					capture;
+	PSERIALCLONE_CAPTURE_HEADER	header;
+	PUCHAR						out;
+	ULONG						length;
+	ULONG						count;
+	ULONG						first;
+	KLOCK_QUEUE_HANDLE			lockHandle;
+
+	capture = &DeviceExtension->Extension->Capture;
+	length = IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength;
+	if(length < sizeof(SERIALCLONE_CAPTURE_HEADER))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	header = (PSERIALCLONE_CAPTURE_HEADER)Irp->AssociatedIrp.SystemBuffer;
+	header->Size = sizeof(SERIALCLONE_CAPTURE_HEADER);
+	header->SlotSize = 0;
+	header->Records = 0;
+	header->Dropped = 0;
+	header->Instance = DeviceExtension->Instance;
+	header->Reserved = 0;
+	Irp->IoStatus.Information = sizeof(SERIALCLONE_CAPTURE_HEADER);
+
+	if(capture->Slots == NULL)
+		return STATUS_SUCCESS;
+
+	header->SlotSize = capture->SlotSize;
+	out = (PUCHAR)(header + 1);
+
+	KeAcquireInStackQueuedSpinLock(&capture->Lock, &lockHandle);
+
+	count = capture->Head - capture->Tail;
+	if(count > (length - sizeof(SERIALCLONE_CAPTURE_HEADER)) / capture->SlotSize)
+		count = (length - sizeof(SERIALCLONE_CAPTURE_HEADER)) / capture->SlotSize;
+
+	// the ring may wrap once in the middle of what we hand out
+	first = capture->Count - (capture->Tail & (capture->Count - 1));
+	if(first > count)
+		first = count;
+	RtlCopyMemory(out, SCCaptureSlot(capture, capture->Tail), first * capture->SlotSize);
+	RtlCopyMemory(out + first * capture->SlotSize, capture->Slots, (count - first) * capture->SlotSize);
+
+	capture->Tail += count;
+	header->Records = count;
+	header->Dropped = capture->Dropped;
+	capture->Dropped = 0;
+
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	Irp->IoStatus.Information += count * capture->SlotSize;
+	return STATUS_SUCCESS;
+}
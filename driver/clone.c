@@ -40,7 +40,7 @@ NTSTATUS ClonePnpDispatch(
     PIO_STACK_LOCATION              irpStack;
     PDEVICE_CAPABILITIES            deviceCapabilities;
 
-    SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
     // Get our current IRP stack location
     irpStack = IoGetCurrentIrpStackLocation(Irp);
     SerialCloneDumpIrp(Irp);
@@ -48,7 +48,7 @@ NTSTATUS ClonePnpDispatch(
 
     if(deviceExtension->TypeFlag != ISCLONE)
 	{
-		SerialCloneDebugPrint(DBG_PNP, DBG_ERR, __FUNCTION__" !! IRP:%p Not Clone Device", Irp);
+		SCDebug(DBG_PNP, DBG_ERR, (__FUNCTION__" !! IRP:%p Not Clone Device", Irp));
 		FailRequest(DeviceObject,Irp,STATUS_NO_SUCH_DEVICE);
 	}
 	// if we cant get the lock bail on the irp
@@ -58,7 +58,7 @@ NTSTATUS ClonePnpDispatch(
 
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
     switch (irpStack->MinorFunction) 
@@ -93,13 +93,16 @@ NTSTATUS ClonePnpDispatch(
 		case IRP_MN_QUERY_ID:
 		{
 			PWCHAR idstring;
+			WCHAR instanceId[12];
 			ULONG nchars; 
 			ULONG size; 
 			PWCHAR id;
 			switch (irpStack->Parameters.QueryId.IdType)
 			{						// select based on id type
 				case BusQueryInstanceID:
-					idstring = L"0000";
+					// one clone per port, keep them apart
+					RtlStringCbPrintfW(instanceId, sizeof(instanceId), L"%04u", deviceExtension->Instance);
+					idstring = instanceId;
 					break;
 				// For the device ID, we need to supply an enumerator name plus a device identifer.
 				// The enumerator name is something you should choose to be unique, which is why
@@ -160,7 +163,7 @@ NTSTATUS ClonePnpDispatch(
 		IoCompleteRequest(Irp, IO_NO_INCREMENT);
 		// Adjust the active I/O count
 		SerialCloneReleaseRemoveLock(deviceExtension);
-		SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+		SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 		return STATUS_SUCCESS;
 
 	case IRP_MN_QUERY_DEVICE_RELATIONS:
@@ -206,7 +209,7 @@ NTSTATUS ClonePnpDispatch(
     // Adjust the active I/O count
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_PNP, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_PNP, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -219,12 +222,12 @@ NTSTATUS ClonePowerDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_POWER, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_POWER, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
 
     if(deviceExtension->TypeFlag!=ISCLONE)
 	{
-		SerialCloneDebugPrint(DBG_PNP, DBG_ERR, __FUNCTION__" !! IRP:%p Not Clone Device", Irp);
+		SCDebug(DBG_PNP, DBG_ERR, (__FUNCTION__" !! IRP:%p Not Clone Device", Irp));
 		FailRequest(DeviceObject,Irp,STATUS_NO_SUCH_DEVICE);
 	}
     
@@ -234,13 +237,13 @@ NTSTATUS ClonePowerDispatch(
         PoStartNextPowerIrp(Irp);
         Irp->IoStatus.Status = status;
         IoCompleteRequest(Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_POWER, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_POWER, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
         PoStartNextPowerIrp(Irp);
 
     SerialCloneReleaseRemoveLock(deviceExtension);
-    SerialCloneDebugPrint(DBG_POWER, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, STATUS_SUCCESS);
+    SCDebug(DBG_POWER, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, STATUS_SUCCESS));
     return SucceedRequest(DeviceObject,Irp);
 
 }
@@ -262,7 +265,7 @@ NTSTATUS CloneSystemControlDispatch(
 
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
 
@@ -270,7 +273,7 @@ NTSTATUS CloneSystemControlDispatch(
     //status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, STATUS_SUCCESS);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, STATUS_SUCCESS));
 
     return SucceedRequest(DeviceObject,Irp);
 }
@@ -299,7 +302,7 @@ NTSTATUS CloneCloseDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -312,7 +315,7 @@ NTSTATUS CloneCloseDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
@@ -322,7 +325,7 @@ NTSTATUS CloneCloseDispatch(
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -349,7 +352,7 @@ NTSTATUS CloneCleanupDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -362,17 +365,21 @@ NTSTATUS CloneCleanupDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
 
+    // writes from this handle still in the pacer never reached the port
+    SCPaceFlush(deviceExtension->Extension, IoGetCurrentIrpStackLocation(Irp)->FileObject);
+    SCWaitFlush(deviceExtension, IoGetCurrentIrpStackLocation(Irp)->FileObject);
+
     IoSkipCurrentIrpStackLocation(Irp);
     status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -401,57 +408,7 @@ NTSTATUS CloneWriteDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
-
-    // Get our device extension from the device object
-    deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
-
-    // Make sure we can accept IRPs
-    if (!SerialCloneAcquireRemoveLock(deviceExtension))
-    {
-        status = STATUS_DELETE_PENDING;
-
-        Irp->IoStatus.Status = status;
-        IoCompleteRequest (Irp, IO_NO_INCREMENT);
-
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
-
-        return status;
-    }
-
-    IoSkipCurrentIrpStackLocation(Irp);
-    status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
-
-    SerialCloneReleaseRemoveLock(deviceExtension);
-
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
-
-    return status;
-}
-
-///////////////////////////////////////////////////////////////////////////////////////////////////
-//  CloneDeviceIoControlDispatch
-//      Dispatch routine to handle IRP_MJ_DEVICE_CONTROL
-//
-//  Arguments:
-//      IN  DeviceObject
-//              pointer to our device object
-//
-//      IN  Irp
-//              pointer to the IRP_MJ_DEVICE_CONTROL IRP
-//
-//  Return Value:
-//      NT status code
-//
-NTSTATUS CloneDeviceIoControlDispatch(
-    IN  PDEVICE_OBJECT  DeviceObject,
-    IN  PIRP            Irp
-    )
-{
-    PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
-    NTSTATUS                        status;
-
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
 
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
@@ -464,7 +421,7 @@ NTSTATUS CloneDeviceIoControlDispatch(
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
 
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
         return status;
     }
@@ -474,7 +431,7 @@ NTSTATUS CloneDeviceIoControlDispatch(
 
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -501,7 +458,7 @@ NTSTATUS CloneInternalDeviceIoControlDispatch(
     PSERIALCLONE_DEVICE_EXTENSION    deviceExtension;
     NTSTATUS                        status;
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"++. IRP %p", Irp);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"++. IRP %p", Irp));
     // Get our device extension from the device object
     deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
 
@@ -511,7 +468,7 @@ NTSTATUS CloneInternalDeviceIoControlDispatch(
         status = STATUS_DELETE_PENDING;
         Irp->IoStatus.Status = status;
         IoCompleteRequest (Irp, IO_NO_INCREMENT);
-        SerialCloneDebugPrint(DBG_GENERAL, DBG_WARN, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+        SCDebug(DBG_GENERAL, DBG_WARN, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
         return status;
     }
 
@@ -519,7 +476,7 @@ NTSTATUS CloneInternalDeviceIoControlDispatch(
     status = IoCallDriver(deviceExtension->LowerDeviceObject, Irp);
     SerialCloneReleaseRemoveLock(deviceExtension);
 
-    SerialCloneDebugPrint(DBG_GENERAL, DBG_TRACE, __FUNCTION__"--. IRP %p STATUS %x", Irp, status);
+    SCDebug(DBG_GENERAL, DBG_TRACE, (__FUNCTION__"--. IRP %p STATUS %x", Irp, status));
 
     return status;
 }
@@ -14,9 +14,8 @@
 
 #define NUMBER_DEBUG_BUFFERS    (sizeof(g_DebugBufferBusy)/sizeof(g_DebugBufferBusy[0]))
 
-// debug level and debug area mask
-ULONG   g_DebugLevel = DBG_INFO;
-ULONG   g_DebugArea = DBG_ALL;
+// debug areas switched on at each debug level, DBG_INFO and below by default
+ULONG   g_DebugAreas[DBG_VERB + 1] = {0, DBG_ALL, DBG_ALL, DBG_ALL, DBG_ALL, 0};
 
 // Buffers for debug messages are allocated globally instead of 
 // on a stack, therefore we need g_DebugBufferBusy flags to 
@@ -25,74 +24,123 @@ LONG    g_DebugBufferBusy[] = {0, 0, 0, 0, 0, 0, 0, 0};
 CHAR    g_DebugBuffer[NUMBER_DEBUG_BUFFERS][2048];
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-//  SerialCloneDebugPrint
-//      Debug messages output routine.
+//  SerialCloneDebugVPrint
+//      Debug messages output routine. SCDebug has already checked the
+//      area and level.
 //
 //  Arguments:
-//      IN  Area
-//              Debug area (DBG_PNP, DBG_POWER, etc..)
-//
-//      IN  Level
-//              Debug Level (DBG_ERR, DBG_INFO, etc..)
+//      IN  Prefix
+//              what goes in front of the message, by level
 //
 //      IN  Format
 //              Debug Message Format
 //
+//      IN  vaList
+//              the message arguments
+//
 //  Return Value:
 //      None.
 //
-VOID SerialCloneDebugPrint(
-    IN ULONG    Area,
-    IN ULONG    Level,
+static VOID SerialCloneDebugVPrint(
+    IN PCCHAR   Prefix,
     IN PCCHAR   Format,
-    IN          ...
+    IN va_list  vaList
     )
 {
     ULONG i;
-    va_list vaList;
 
-    va_start(vaList, Format);
-
-    // check mask for debug area and debug level
-    if ((g_DebugArea & Area) && (Level <= g_DebugLevel))
+    // find a free buffer
+    for (i = 0; i < NUMBER_DEBUG_BUFFERS; ++i)
     {
-        // find a free buffer
-        for (i = 0; i < NUMBER_DEBUG_BUFFERS; ++i)
+        if (InterlockedCompareExchange(&g_DebugBufferBusy[i], 1, 0) == 0)
         {
-            if (InterlockedCompareExchange(&g_DebugBufferBusy[i], 1, 0) == 0)
-            {
-                NTSTATUS status;
-
-                status = RtlStringCbVPrintfA(
-                            g_DebugBuffer[i], 
-                            sizeof(g_DebugBuffer[i]),
-                            Format,
-                            vaList
-                            );
+            RtlStringCbVPrintfA(
+                g_DebugBuffer[i], 
+                sizeof(g_DebugBuffer[i]),
+                Format,
+                vaList
+                );
 
-                if (Level == DBG_ERR)
-                {
-                    DbgPrint("SERIALCLONE(IRQL %2.2d): ERROR %s !!!!!\n", KeGetCurrentIrql(), g_DebugBuffer[i]); 
-                }
-                else if (Level == DBG_WARN)
-                {
-                    DbgPrint("SERIALCLONE(IRQL %2.2d): WARNING %s\n", KeGetCurrentIrql(), g_DebugBuffer[i]); 
-                }
-                else if (Level == DBG_INFO)
-                {
-                    DbgPrint("SERIALCLONE(IRQL %2.2d):     %s\n", KeGetCurrentIrql(), g_DebugBuffer[i]); 
-                }
-                else
-                {
-                    DbgPrint("SERIALCLONE (IRQL %2.2d):     %s\n",KeGetCurrentIrql(), g_DebugBuffer[i]); 
-                }
+            DbgPrint("SERIALCLONE(IRQL %2.2d): %s%s\n", KeGetCurrentIrql(), Prefix, g_DebugBuffer[i]); 
 
-                InterlockedExchange(&g_DebugBufferBusy[i], 0);
-                break;
-            }
+            InterlockedExchange(&g_DebugBufferBusy[i], 0);
+            break;
         }
     }
 
+    // not silently, at least the trace knows
+    if (i == NUMBER_DEBUG_BUFFERS)
+    {
+        SCTraceEvent(NULL, SERIALCLONE_TRACE_DEBUG_DROPPED, NULL, 0, 0, 0);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneDebugError
+//      Prints a DBG_ERR message
+//
+//  Arguments:
+//      IN  Format
+//              Debug Message Format
+//
+//  Return Value:
+//      None.
+//
+VOID SerialCloneDebugError(
+    IN PCCHAR   Format,
+    IN          ...
+    )
+{
+    va_list vaList;
+
+    va_start(vaList, Format);
+    SerialCloneDebugVPrint("ERROR ", Format, vaList);
+    va_end(vaList);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneDebugWarning
+//      Prints a DBG_WARN message
+//
+//  Arguments:
+//      IN  Format
+//              Debug Message Format
+//
+//  Return Value:
+//      None.
+//
+VOID SerialCloneDebugWarning(
+    IN PCCHAR   Format,
+    IN          ...
+    )
+{
+    va_list vaList;
+
+    va_start(vaList, Format);
+    SerialCloneDebugVPrint("WARNING ", Format, vaList);
+    va_end(vaList);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneDebugMessage
+//      Prints a DBG_TRACE, DBG_INFO or DBG_VERB message
+//
+//  Arguments:
+//      IN  Format
+//              Debug Message Format
+//
+//  Return Value:
+//      None.
+//
+VOID SerialCloneDebugMessage(
+    IN PCCHAR   Format,
+    IN          ...
+    )
+{
+    va_list vaList;
+
+    va_start(vaList, Format);
+    SerialCloneDebugVPrint("    ", Format, vaList);
     va_end(vaList);
 }
 
@@ -145,28 +193,28 @@ VOID SerialCloneDumpIrp(
         break;
     }
 
-    SerialCloneDebugPrint(debugArea, DBG_INFO, "IRP %p %s", Irp, IrpMajorFunctionString(irpStack->MajorFunction));
+    SCDebug(debugArea, DBG_INFO, ("IRP %p %s", Irp, IrpMajorFunctionString(irpStack->MajorFunction)));
 
     if (irpStack->MajorFunction == IRP_MJ_PNP)
     {
-        SerialCloneDebugPrint(debugArea, DBG_INFO, "%s", PnPMinorFunctionString(irpStack->MinorFunction));
+        SCDebug(debugArea, DBG_INFO, ("%s", PnPMinorFunctionString(irpStack->MinorFunction)));
     }
     else if (irpStack->MajorFunction == IRP_MJ_POWER)
     {
-        SerialCloneDebugPrint(debugArea, DBG_INFO, "%s", PowerMinorFunctionString(irpStack->MinorFunction));
+        SCDebug(debugArea, DBG_INFO, ("%s", PowerMinorFunctionString(irpStack->MinorFunction)));
 
         if (irpStack->Parameters.Power.Type == SystemPowerState)
         {
-            SerialCloneDebugPrint(debugArea, DBG_INFO, "%s", SystemPowerStateString(irpStack->Parameters.Power.State.SystemState));
+            SCDebug(debugArea, DBG_INFO, ("%s", SystemPowerStateString(irpStack->Parameters.Power.State.SystemState)));
         }
         else
         {
-            SerialCloneDebugPrint(debugArea, DBG_INFO, "%s", DevicePowerStateString(irpStack->Parameters.Power.State.DeviceState));
+            SCDebug(debugArea, DBG_INFO, ("%s", DevicePowerStateString(irpStack->Parameters.Power.State.DeviceState)));
         }
     }
     else if (irpStack->MajorFunction == IRP_MJ_SYSTEM_CONTROL)
     {
-        SerialCloneDebugPrint(debugArea, DBG_INFO, "%s", WMIMinorFunctionString(irpStack->MinorFunction));
+        SCDebug(debugArea, DBG_INFO, ("%s", WMIMinorFunctionString(irpStack->MinorFunction)));
     }
 }
 
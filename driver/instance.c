@@ -0,0 +1,120 @@
+// Instance.c
+//
+// Driver wide table of the ports we filter. A port's slot number names
+// its clone, \Device\SerialCloneDevice<n>, and is freed for reuse when
+// the port is removed. The table is a plain bitmap, 32 ports to a word,
+// so finding a free slot among a few hundred ports is a short scan that
+// starts where the last one was found.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Instance.tmh"
+#endif
+
+#define SCINSTANCE_WORDS	(SC_MAX_INSTANCES / 32)
+
+static FAST_MUTEX	ScInstanceLock;
+static ULONG		ScInstanceBits[SCINSTANCE_WORDS];
+static ULONG		ScInstanceHint;			// word to start the next search at
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCInstanceInit
+//      Empties the instance table, called from DriverEntry
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      None
+//
+VOID SCInstanceInit(VOID)
+{
+	ExInitializeFastMutex(&ScInstanceLock);
+	RtlZeroMemory(ScInstanceBits, sizeof(ScInstanceBits));
+	ScInstanceHint = 0;
+	g_Data.InstanceCount = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCInstanceAllocate
+//      Takes the lowest free slot. Every word before ScInstanceHint is
+//      full, so the search can start there.
+//
+//  Arguments:
+//      OUT Instance
+//              receives the slot number
+//
+//  Return Value:
+//      STATUS_SUCCESS, or STATUS_INSUFFICIENT_RESOURCES with every slot taken
+//
+NTSTATUS SCInstanceAllocate(
+    OUT PULONG  Instance
+    )
+{
+	NTSTATUS	status;
+	ULONG		word;
+	ULONG		bit;
+	ULONG		i;
+
+	status = STATUS_INSUFFICIENT_RESOURCES;
+
+	ExAcquireFastMutex(&ScInstanceLock);
+
+	for(i = 0; i < SCINSTANCE_WORDS; i++)
+	{
+		word = (ScInstanceHint + i) % SCINSTANCE_WORDS;
+		if(ScInstanceBits[word] == 0xFFFFFFFF)
+			continue;
+
+		for(bit = 0; ScInstanceBits[word] & (1UL << bit); bit++)
+			;
+
+		ScInstanceBits[word] |= 1UL << bit;
+		ScInstanceHint = word;
+		g_Data.InstanceCount++;
+
+		*Instance = word * 32 + bit;
+		status = STATUS_SUCCESS;
+		break;
+	}
+
+	ExReleaseFastMutex(&ScInstanceLock);
+
+	SCDebug(DBG_INIT, DBG_INFO, (__FUNCTION__": STATUS %x instance %d, %d in use",
+		status, (status == STATUS_SUCCESS) ? *Instance : 0, g_Data.InstanceCount));
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCInstanceFree
+//      Gives a slot back
+//
+//  Arguments:
+//      IN  Instance
+//              slot from SCInstanceAllocate
+//
+//  Return Value:
+//      None
+//
+VOID SCInstanceFree(
+    IN  ULONG   Instance
+    )
+{
+	ASSERT(Instance < SC_MAX_INSTANCES);
+
+	ExAcquireFastMutex(&ScInstanceLock);
+
+	ASSERT(ScInstanceBits[Instance / 32] & (1UL << (Instance % 32)));
+	ScInstanceBits[Instance / 32] &= ~(1UL << (Instance % 32));
+	g_Data.InstanceCount--;
+
+	if(Instance / 32 < ScInstanceHint)
+		ScInstanceHint = Instance / 32;
+
+	ExReleaseFastMutex(&ScInstanceLock);
+}
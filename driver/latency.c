@@ -0,0 +1,280 @@
+// Latency.c
+//
+// Latency histograms of reads, writes and IOCTLs, for each device: the
+// time from arrival to being passed down, from the port completing the
+// request to us completing it, and the whole of it. Counts are kept per
+// processor after the other counters and summed on request through
+// IOCTL_SERIALCLONE_GET_LATENCY. They take over 4 KB a processor for
+// each device, so they are only kept with Parameters\LatencyHistograms
+// set; without it nothing is counted and the IOCTL returns zeros.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Latency.tmh"
+#endif
+
+// fastest the latency ticks may run
+#define SCLATENCY_MAX_FREQUENCY	10000000
+
+// counts in one SERIALCLONE_LATENCY
+#define SCLATENCY_COUNTS		(sizeof(SERIALCLONE_LATENCY) / sizeof(ULONG))
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLatencyInit
+//      Picks the latency tick rate, called from DriverEntry once the
+//      performance counter frequency is known
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      None
+//
+VOID SCLatencyInit(VOID)
+{
+	LONGLONG	frequency;
+	ULONG		shift;
+
+	frequency = g_Data.PerfFrequency.QuadPart;
+	for(shift = 0; frequency > SCLATENCY_MAX_FREQUENCY; shift++)
+		frequency >>= 1;
+
+	g_Data.LatencyShift = shift;
+	g_Data.LatencyFrequency = (ULONG)frequency;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLatencyRecord
+//      Counts one time in its histogram bucket, if the device keeps
+//      histograms. Safe at any IRQL.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              device the request came in on
+//
+//      IN  Major
+//              SERIALCLONE_LATENCY_READ, _WRITE or _IOCTL
+//
+//      IN  Phase
+//              SERIALCLONE_LATENCY_DISPATCH, _COMPLETION or _TOTAL
+//
+//      IN  Elapsed
+//              latency ticks
+//
+//  Return Value:
+//      None
+//
+VOID SCLatencyRecord(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  ULONG                           Major,
+    IN  ULONG                           Phase,
+    IN  ULONG                           Elapsed
+    )
+{
+	ULONG	value;
+	ULONG	msb;
+	ULONG	bucket;
+
+	if(DeviceExtension->Latency == NULL)
+		return;
+
+	if(Elapsed < SERIALCLONE_HISTOGRAM_LINEAR)
+		bucket = Elapsed;
+	else
+	{
+		// highest bit set, the power of 2 the time falls in
+		value = Elapsed;
+		msb = 0;
+		if(value & 0xFFFF0000) { msb += 16; value >>= 16; }
+		if(value & 0xFF00) { msb += 8; value >>= 8; }
+		if(value & 0xF0) { msb += 4; value >>= 4; }
+		if(value & 0xC) { msb += 2; value >>= 2; }
+		if(value & 0x2) msb += 1;
+
+		// the bits just below it pick the linear step within that power
+		bucket = (msb - SERIALCLONE_HISTOGRAM_SUB_BITS + 1) * SERIALCLONE_HISTOGRAM_LINEAR +
+			((Elapsed >> (msb - SERIALCLONE_HISTOGRAM_SUB_BITS)) & (SERIALCLONE_HISTOGRAM_LINEAR - 1));
+	}
+
+	InterlockedIncrement((PLONG)&DeviceExtension->Latency[KeGetCurrentProcessorNumber()].Latency.Counts[Major][Phase][bucket]);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLatencyForward
+//      Steps an IRP about to go to the port into the spare stack location
+//      below ours and keeps its arrival time there for SCLatencyComplete.
+//      The port gets a copy of our parameters in the location below that.
+//      The spare location keeps our DeviceObject too, which is what the
+//      completion routine is handed, so it knows which device to count.
+//
+//  Arguments:
+//      IN  Irp
+//              the IRP, current stack location ours
+//
+//      IN  StartTime
+//              SCLatencyNow() when it arrived
+//
+//  Return Value:
+//      the spare stack location, now the current one. The caller sets
+//      its completion routine and calls IoCallDriver.
+//
+PIO_STACK_LOCATION SCLatencyForward(
+    IN  PIRP    Irp,
+    IN  ULONG   StartTime
+    )
+{
+	PIO_STACK_LOCATION	irpStack;
+
+	IoCopyCurrentIrpStackLocationToNext(Irp);
+	IoSetNextIrpStackLocation(Irp);
+	irpStack = IoGetCurrentIrpStackLocation(Irp);
+	SCIrpStartTime(irpStack) = StartTime;
+	IoCopyCurrentIrpStackLocationToNext(Irp);
+
+	return irpStack;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLatencyComplete
+//      Counts the completion and total times of a request passed down
+//      with SCLatencyForward, at the end of its completion routine
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              device the request came in on
+//
+//      IN  Major
+//              SERIALCLONE_LATENCY_READ, _WRITE or _IOCTL
+//
+//      IN  Irp
+//              the completed IRP, current stack location the spare one
+//
+//      IN  Entered
+//              SCLatencyNow() when the completion routine was called
+//
+//  Return Value:
+//      None
+//
+VOID SCLatencyComplete(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  ULONG                           Major,
+    IN  PIRP                            Irp,
+    IN  ULONG                           Entered
+    )
+{
+	ULONG	now;
+
+	now = SCLatencyNow();
+	SCLatencyRecord(DeviceExtension, Major, SERIALCLONE_LATENCY_COMPLETION, now - Entered);
+	SCLatencyRecord(DeviceExtension, Major, SERIALCLONE_LATENCY_TOTAL,
+		now - SCIrpStartTime(IoGetCurrentIrpStackLocation(Irp)));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLatencyQuery
+//      Sums the per processor histograms of a device, all zero if it
+//      doesn't keep them
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension
+//
+//      OUT Latency
+//              receives the totals
+//
+//      IN  Reset
+//              TRUE to clear each count as it is read
+//
+//  Return Value:
+//      None
+//
+static VOID SCLatencyQuery(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    OUT PSERIALCLONE_LATENCY            Latency,
+    IN  BOOLEAN                         Reset
+    )
+{
+	PULONG	total;
+	PULONG	cpu;
+	ULONG	i;
+	ULONG	j;
+
+	RtlZeroMemory(Latency, sizeof(SERIALCLONE_LATENCY));
+	if(DeviceExtension->Latency == NULL)
+		return;
+
+	total = &Latency->Counts[0][0][0];
+
+	for(i = 0; i < DeviceExtension->StatsCpus; i++)
+	{
+		cpu = &DeviceExtension->Latency[i].Latency.Counts[0][0][0];
+
+		if(Reset)
+		{
+			for(j = 0; j < SCLATENCY_COUNTS; j++)
+				total[j] += (ULONG)InterlockedExchange((PLONG)&cpu[j], 0);
+		}
+		else
+		{
+			for(j = 0; j < SCLATENCY_COUNTS; j++)
+				total[j] += cpu[j];
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLatencyIoctl
+//      IOCTL_SERIALCLONE_GET_LATENCY. A reset clears them for everyone,
+//      so through the port it takes a privileged caller.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension of the port
+//
+//      IN  Irp
+//              the IOCTL_SERIALCLONE_GET_LATENCY IRP
+//
+//      IN  Clone
+//              it came in on the clone, which may reset them
+//
+//  Return Value:
+//      NT status code to complete the IRP with
+//
+NTSTATUS SCLatencyIoctl(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp,
+    IN  BOOLEAN                         Clone
+    )
+{
+	PIO_STACK_LOCATION			irpStack;
+	PSERIALCLONE_PORT_LATENCY	latency;
+	BOOLEAN						bReset;
+
+	irpStack = IoGetCurrentIrpStackLocation(Irp);
+	if(irpStack->Parameters.DeviceIoControl.OutputBufferLength < sizeof(SERIALCLONE_PORT_LATENCY))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	// the input shares the buffer, so look at it before filling it in
+	bReset = FALSE;
+	if((irpStack->Parameters.DeviceIoControl.InputBufferLength >= sizeof(ULONG)) &&
+		(*(PULONG)Irp->AssociatedIrp.SystemBuffer & SERIALCLONE_LATENCY_RESET))
+	{
+		bReset = TRUE;
+	}
+	if(bReset && !Clone && !SCCallerPrivileged(Irp))
+		return STATUS_ACCESS_DENIED;
+
+	latency = (PSERIALCLONE_PORT_LATENCY)Irp->AssociatedIrp.SystemBuffer;
+	latency->Size = sizeof(SERIALCLONE_PORT_LATENCY);
+	latency->Frequency = g_Data.LatencyFrequency;
+	SCLatencyQuery(FilterExtension, &latency->Owner, bReset);
+	SCLatencyQuery(FilterExtension->Extension, &latency->Clone, bReset);
+
+	Irp->IoStatus.Information = sizeof(SERIALCLONE_PORT_LATENCY);
+	return STATUS_SUCCESS;
+}
@@ -0,0 +1,367 @@
+// List.c
+//
+// Cancel-safe IRP list used to hold requests inside the driver
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "List.tmh"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneInitializeList
+//      Initializes a cancel-safe IRP list
+//
+//  Arguments:
+//      IN  List
+//              list to initialize
+//
+//      IN  DeviceObject
+//              device object the queued IRPs belong to
+//
+//  Return Value:
+//      None
+//
+VOID SerialCloneInitializeList(
+    IN  PSERIALCLONE_LIST   List,
+    IN  PDEVICE_OBJECT      DeviceObject
+    )
+{
+    InitializeListHead(&List->IrpList);
+    KeInitializeSpinLock(&List->ListLock);
+    List->DeviceObject = DeviceObject;
+    List->SpunIRP = NULL;
+    List->ErrorStatus = STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneListInsert
+//      Worker for SerialCloneInsertHead and SerialCloneInsertTail. Arms the
+//      cancel routine and links the IRP under the list lock.
+//
+//  Arguments:
+//      IN  List
+//              list to insert into
+//
+//      IN  Irp
+//              IRP to insert
+//
+//      IN  bHead
+//              TRUE to insert at the head of the list
+//
+//  Return Value:
+//      STATUS_PENDING if the IRP was queued, otherwise the status the
+//      caller should complete the IRP with
+//
+static NTSTATUS SerialCloneListInsert(
+    IN  PSERIALCLONE_LIST   List,
+    IN  PIRP                Irp,
+    IN  BOOLEAN             bHead
+    )
+{
+    KLOCK_QUEUE_HANDLE lockHandle;
+    NTSTATUS    status;
+
+    KeAcquireInStackQueuedSpinLock(&List->ListLock, &lockHandle);
+
+    status = List->ErrorStatus;
+    if (!NT_SUCCESS(status))
+    {
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+        return status;
+    }
+
+    Irp->Tail.Overlay.DriverContext[0] = List;
+    IoSetCancelRoutine(Irp, SerialCloneListCancelRoutine);
+
+    // if the IRP was cancelled before we armed the cancel routine, and
+    // nobody else has claimed it, hand it back to the caller
+    if (Irp->Cancel && (IoSetCancelRoutine(Irp, NULL) != NULL))
+    {
+        KeReleaseInStackQueuedSpinLock(&lockHandle);
+        return STATUS_CANCELLED;
+    }
+
+    IoMarkIrpPending(Irp);
+    if (bHead)
+    {
+        InsertHeadList(&List->IrpList, &Irp->Tail.Overlay.ListEntry);
+    }
+    else
+    {
+        InsertTailList(&List->IrpList, &Irp->Tail.Overlay.ListEntry);
+    }
+
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+    return STATUS_PENDING;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneInsertHead
+//      Inserts an IRP at the head of the list
+//
+//  Arguments:
+//      IN  List
+//              list to insert into
+//
+//      IN  Irp
+//              IRP to insert
+//
+//  Return Value:
+//      STATUS_PENDING if queued, otherwise the completion status for the IRP
+//
+NTSTATUS SerialCloneInsertHead(
+    IN  PSERIALCLONE_LIST   List,
+    IN  PIRP                Irp
+    )
+{
+    return SerialCloneListInsert(List, Irp, TRUE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneInsertTail
+//      Inserts an IRP at the tail of the list
+//
+//  Arguments:
+//      IN  List
+//              list to insert into
+//
+//      IN  Irp
+//              IRP to insert
+//
+//  Return Value:
+//      STATUS_PENDING if queued, otherwise the completion status for the IRP
+//
+NTSTATUS SerialCloneInsertTail(
+    IN  PSERIALCLONE_LIST   List,
+    IN  PIRP                Irp
+    )
+{
+    return SerialCloneListInsert(List, Irp, FALSE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneListRemove
+//      Worker for SerialCloneRemoveHead and SerialCloneRemoveTail. Skips
+//      IRPs whose cancel routine is already running.
+//
+//  Arguments:
+//      IN  List
+//              list to remove from
+//
+//      IN  bHead
+//              TRUE to remove from the head of the list
+//
+//  Return Value:
+//      IRP removed from the list, or NULL if the list is empty
+//
+static PIRP SerialCloneListRemove(
+    IN  PSERIALCLONE_LIST   List,
+    IN  BOOLEAN             bHead
+    )
+{
+    KLOCK_QUEUE_HANDLE lockHandle;
+    PLIST_ENTRY entry;
+    PIRP        irp;
+
+    irp = NULL;
+
+    KeAcquireInStackQueuedSpinLock(&List->ListLock, &lockHandle);
+
+    while (!IsListEmpty(&List->IrpList))
+    {
+        entry = bHead ? RemoveHeadList(&List->IrpList) : RemoveTailList(&List->IrpList);
+        irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+
+        if (IoSetCancelRoutine(irp, NULL) != NULL)
+        {
+            break;
+        }
+
+        // The cancel routine owns this IRP and is waiting for the list
+        // lock.  Leave the entry self-linked so its RemoveEntryList is
+        // harmless, and move on.
+        InitializeListHead(entry);
+        irp = NULL;
+    }
+
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+    return irp;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneRemoveHead
+//      Removes the IRP at the head of the list
+//
+//  Arguments:
+//      IN  List
+//              list to remove from
+//
+//  Return Value:
+//      IRP, or NULL if the list is empty
+//
+PIRP SerialCloneRemoveHead(
+    IN  PSERIALCLONE_LIST   List
+    )
+{
+    return SerialCloneListRemove(List, TRUE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneRemoveTail
+//      Removes the IRP at the tail of the list
+//
+//  Arguments:
+//      IN  List
+//              list to remove from
+//
+//  Return Value:
+//      IRP, or NULL if the list is empty
+//
+PIRP SerialCloneRemoveTail(
+    IN  PSERIALCLONE_LIST   List
+    )
+{
+    return SerialCloneListRemove(List, FALSE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneFlushList
+//      Cancels every IRP in the list that belongs to the given file object
+//
+//  Arguments:
+//      IN  List
+//              list to flush
+//
+//      IN  FileObject
+//              file object to match, NULL matches every IRP
+//
+//  Return Value:
+//      None
+//
+VOID SerialCloneFlushList(
+    IN  PSERIALCLONE_LIST   List,
+    IN  PFILE_OBJECT        FileObject
+    )
+{
+    KLOCK_QUEUE_HANDLE lockHandle;
+    LIST_ENTRY  flushList;
+    PLIST_ENTRY entry;
+    PLIST_ENTRY next;
+    PIRP        irp;
+
+    InitializeListHead(&flushList);
+
+    KeAcquireInStackQueuedSpinLock(&List->ListLock, &lockHandle);
+
+    for (entry = List->IrpList.Flink; entry != &List->IrpList; entry = next)
+    {
+        next = entry->Flink;
+        irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+
+        if ((FileObject != NULL) && (IoGetCurrentIrpStackLocation(irp)->FileObject != FileObject))
+        {
+            continue;
+        }
+
+        if (IoSetCancelRoutine(irp, NULL) == NULL)
+        {
+            // already being cancelled
+            continue;
+        }
+
+        RemoveEntryList(entry);
+        InsertTailList(&flushList, entry);
+    }
+
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+    while (!IsListEmpty(&flushList))
+    {
+        entry = RemoveHeadList(&flushList);
+        irp = CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry);
+
+        irp->IoStatus.Status = STATUS_CANCELLED;
+        irp->IoStatus.Information = 0;
+        IoCompleteRequest(irp, IO_NO_INCREMENT);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneInvalidateList
+//      Fails every IRP in the list and every IRP inserted from now on
+//
+//  Arguments:
+//      IN  List
+//              list to invalidate
+//
+//      IN  ErrorStatus
+//              status to fail the IRPs with
+//
+//  Return Value:
+//      None
+//
+VOID SerialCloneInvalidateList(
+    IN  PSERIALCLONE_LIST   List,
+    IN  NTSTATUS            ErrorStatus
+    )
+{
+    KLOCK_QUEUE_HANDLE lockHandle;
+    PIRP        irp;
+
+    ASSERT(!NT_SUCCESS(ErrorStatus));
+
+    KeAcquireInStackQueuedSpinLock(&List->ListLock, &lockHandle);
+    List->ErrorStatus = ErrorStatus;
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+    while ((irp = SerialCloneRemoveHead(List)) != NULL)
+    {
+        irp->IoStatus.Status = ErrorStatus;
+        irp->IoStatus.Information = 0;
+        IoCompleteRequest(irp, IO_NO_INCREMENT);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneListCancelRoutine
+//      Cancel routine for IRPs held in a SERIALCLONE_LIST
+//
+//  Arguments:
+//      IN  DeviceObject
+//              our device object
+//
+//      IN  Irp
+//              IRP being cancelled
+//
+//  Return Value:
+//      None
+//
+VOID SerialCloneListCancelRoutine(
+    IN  PDEVICE_OBJECT  DeviceObject,
+    IN  PIRP            Irp
+    )
+{
+    PSERIALCLONE_LIST   list;
+    KLOCK_QUEUE_HANDLE  lockHandle;
+
+    IoReleaseCancelSpinLock(Irp->CancelIrql);
+
+    list = (PSERIALCLONE_LIST)Irp->Tail.Overlay.DriverContext[0];
+
+    KeAcquireInStackQueuedSpinLock(&list->ListLock, &lockHandle);
+    RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+    KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+    SCDebug(DBG_IO, DBG_INFO, (__FUNCTION__": IRP %p cancelled", Irp));
+
+    Irp->IoStatus.Status = STATUS_CANCELLED;
+    Irp->IoStatus.Information = 0;
+    IoCompleteRequest(Irp, IO_NO_INCREMENT);
+}
@@ -0,0 +1,120 @@
+// Lock.c
+//
+// The FIFO and read list locks taken on every read. They are in-stack
+// queued spinlocks so waiters spin on their own handle instead of the
+// lock word, and each acquisition is counted against the device that
+// took it: how often it had to wait, for how long, and with
+// Parameters\LockTiming set how long it then held the lock.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Lock.tmh"
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLockAcquire
+//      Takes a read path lock and counts the acquisition
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              device whose counters it goes in, the one doing the read
+//
+//      IN  Lock
+//              the spinlock
+//
+//      OUT Handle
+//              acquirer's stack handle, hand it back to SCLockRelease
+//
+//  Return Value:
+//      None, returns at DISPATCH_LEVEL
+//
+VOID SCLockAcquire(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  PKSPIN_LOCK                     Lock,
+    OUT PSCLOCK_HANDLE                  Handle
+    )
+{
+	LARGE_INTEGER	start;
+	LARGE_INTEGER	now;
+
+	now.QuadPart = 0;
+
+	// a queued lock word is only nonzero while someone holds it. Only the
+	// waits are timed, the performance counter is too dear to read on
+	// every acquisition.
+	if(*(volatile KSPIN_LOCK *)Lock != 0)
+	{
+		start = KeQueryPerformanceCounter(NULL);
+		KeAcquireInStackQueuedSpinLock(Lock, &Handle->Queue);
+		now = KeQueryPerformanceCounter(NULL);
+
+		SCStatInc(DeviceExtension, LockContention);
+		SCStatAdd(DeviceExtension, LockWaitTime, now.QuadPart - start.QuadPart);
+	}
+	else
+		KeAcquireInStackQueuedSpinLock(Lock, &Handle->Queue);
+
+	SCStatInc(DeviceExtension, LockAcquires);
+
+	Handle->Acquired = 0;
+	if(g_Data.LockTiming)
+	{
+		if(now.QuadPart == 0)
+			now = KeQueryPerformanceCounter(NULL);
+		Handle->Acquired = now.QuadPart;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLockRelease
+//      Drops a lock taken with SCLockAcquire
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              the device passed to SCLockAcquire
+//
+//      IN  Handle
+//              the handle SCLockAcquire filled in
+//
+//  Return Value:
+//      None
+//
+VOID SCLockRelease(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  PSCLOCK_HANDLE                  Handle
+    )
+{
+	if(Handle->Acquired != 0)
+		SCStatAdd(DeviceExtension, LockHoldTime, KeQueryPerformanceCounter(NULL).QuadPart - Handle->Acquired);
+
+	KeReleaseInStackQueuedSpinLock(&Handle->Queue);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCLockTicksTo100ns
+//      Converts a sum of performance counter ticks for reporting
+//
+//  Arguments:
+//      IN  Ticks
+//              performance counter ticks
+//
+//  Return Value:
+//      the same time in 100ns units
+//
+ULONGLONG SCLockTicksTo100ns(
+    IN  ULONGLONG   Ticks
+    )
+{
+	ULONGLONG	freq = (ULONGLONG)g_Data.PerfFrequency.QuadPart;
+
+	if(freq == 0)
+		return 0;
+
+	// whole seconds first so the multiply can't overflow
+	return (Ticks / freq) * 10000000 + (Ticks % freq) * 10000000 / freq;
+}
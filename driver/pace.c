@@ -0,0 +1,256 @@
+// Pace.c
+//
+// Transmit pacing. Writes from the owner are held in our own queue and
+// only passed to the lower driver while the data already below us
+// would drain in less than TxPaceMs at the snooped baud rate. Pacing is
+// off unless Parameters\TxPaceMs is set; writes then go straight
+// through the queue.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Pace.tmh"
+#endif
+
+static NTSTATUS SCPaceWriteComplete(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp, IN PVOID Context);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPaceInit
+//      Sets up the transmit queue of a filter device
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCPaceInit(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	SerialCloneInitializeList(&FilterExtension->TxQueue, FilterExtension->FDeviceObject);
+	FilterExtension->TxOutstanding = 0;
+	FilterExtension->TxPumpCount = 0;
+	FilterExtension->TxPaceMs = g_Data.TxPaceMs;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPaceBudget
+//      Number of transmit bytes we allow below the filter
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      byte budget, MAXULONG when pacing is off or the baud rate is unknown
+//
+static ULONG SCPaceBudget(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	PSCPORT_STATE	state = &FilterExtension->PortState;
+	ULONG			baud;
+	ULONG			bits;
+	ULONGLONG		budget;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	if(FilterExtension->TxPaceMs == 0)
+		return MAXULONG;
+
+	KeAcquireInStackQueuedSpinLock(&state->StateLock, &lockHandle);
+	baud = (state->Valid & SCPORT_BAUD_RATE) ? state->BaudRate : 0;
+	bits = SCPortBitsPerChar(&state->LineControl);
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	// we have not seen the baud rate yet, don't guess
+	if(baud == 0)
+		return MAXULONG;
+
+	budget = (ULONGLONG)(baud / bits) * FilterExtension->TxPaceMs / 1000;
+	if(budget == 0)
+		return 1;
+	return (budget < MAXULONG) ? (ULONG)budget : MAXULONG;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPaceWrite
+//      Queues a write from the owner and lets the pacer decide when it goes
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//      IN  Irp
+//              the IRP_MJ_WRITE IRP
+//
+//  Return Value:
+//      STATUS_PENDING, or the status the IRP was completed with
+//
+NTSTATUS SCPaceWrite(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp
+    )
+{
+	NTSTATUS status;
+
+	status = SerialCloneInsertTail(&FilterExtension->TxQueue, Irp);
+	if(status != STATUS_PENDING)
+		return CompleteRequest(Irp, status, 0);
+
+	SCPaceStartNext(FilterExtension);
+	return STATUS_PENDING;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPaceStartNext
+//      Passes queued writes down while they fit in the budget. Only one
+//      caller runs the loop at a time; anyone arriving while it runs bumps
+//      TxPumpCount so the running caller makes another pass for them.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCPaceStartNext(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	NTSTATUS	status;
+	PIRP		irp;
+	ULONG		length;
+	ULONG		budget;
+	ULONG		outstanding;
+	PIO_STACK_LOCATION	irpStack;
+
+	if(InterlockedIncrement(&FilterExtension->TxPumpCount) != 1)
+		return;
+
+	do
+	{
+		budget = SCPaceBudget(FilterExtension);
+
+		while((irp = SerialCloneRemoveHead(&FilterExtension->TxQueue)) != NULL)
+		{
+			length = IoGetCurrentIrpStackLocation(irp)->Parameters.Write.Length;
+			outstanding = (ULONG)FilterExtension->TxOutstanding;
+
+			// always let one write through, however large, or we would stall
+			if((outstanding != 0) && ((outstanding >= budget) || (length > budget - outstanding)))
+			{
+				// over budget, it waits at the head until a write completes
+				status = SerialCloneInsertHead(&FilterExtension->TxQueue, irp);
+				if(status != STATUS_PENDING)
+					CompleteRequest(irp, status, 0);
+				break;
+			}
+
+			if(!SerialCloneAcquireRemoveLock(FilterExtension))
+			{
+				CompleteRequest(irp, STATUS_DELETE_PENDING, 0);
+				continue;
+			}
+
+			InterlockedExchangeAdd(&FilterExtension->TxOutstanding, (LONG)length);
+
+			// the time spent in our queue counts as dispatch time of
+			// whichever device the write came in on
+			irpStack = SCLatencyForward(irp, SCIrpQueuedTime(irp));
+			IoSetCompletionRoutine(irp, SCPaceWriteComplete, FilterExtension, TRUE, TRUE, TRUE);
+			SCLatencyRecord((PSERIALCLONE_DEVICE_EXTENSION)irpStack->DeviceObject->DeviceExtension,
+				SERIALCLONE_LATENCY_WRITE, SERIALCLONE_LATENCY_DISPATCH, SCLatencyNow() - SCIrpStartTime(irpStack));
+			IoCallDriver(FilterExtension->LowerDeviceObject, irp);
+		}
+	}
+	while(InterlockedDecrement(&FilterExtension->TxPumpCount) != 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPaceWriteComplete
+//      Completion routine for paced writes, returns the bytes to the budget
+//
+//  Arguments:
+//      IN  DeviceObject
+//              the filter or clone device object the write came in on
+//
+//      IN  Irp
+//              the completed write
+//
+//      IN  Context
+//              filter device extension
+//
+//  Return Value:
+//      STATUS_SUCCESS
+//
+static NTSTATUS SCPaceWriteComplete(
+    IN  PDEVICE_OBJECT  DeviceObject,
+    IN  PIRP            Irp,
+    IN  PVOID           Context
+    )
+{
+	PSERIALCLONE_DEVICE_EXTENSION fdx = (PSERIALCLONE_DEVICE_EXTENSION)Context;
+	ULONG	entered;
+
+	entered = SCLatencyNow();
+
+	if(Irp->PendingReturned)
+		IoMarkIrpPending(Irp);
+
+	InterlockedExchangeAdd(&fdx->TxOutstanding,
+		-(LONG)IoGetCurrentIrpStackLocation(Irp)->Parameters.Write.Length);
+
+	SCPaceStartNext(fdx);
+
+	SCLatencyComplete((PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension,
+		SERIALCLONE_LATENCY_WRITE, Irp, entered);
+	SerialCloneReleaseRemoveLock(fdx);
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPaceFlush
+//      Cancels queued writes that have not been passed down yet
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//      IN  FileObject
+//              only cancel writes for this file object, NULL for all
+//
+//  Return Value:
+//      None
+//
+VOID SCPaceFlush(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PFILE_OBJECT                    FileObject
+    )
+{
+	SerialCloneFlushList(&FilterExtension->TxQueue, FileObject);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPaceStop
+//      Fails queued and future writes, used when the device goes away
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCPaceStop(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	SerialCloneInvalidateList(&FilterExtension->TxQueue, STATUS_DELETE_PENDING);
+}
@@ -14,6 +14,7 @@ extern "C" {
 #include <stddef.h>
 #include <initguid.h>
 #include <wdm.h>
+#include <ntddser.h>
 //#include <ntddk.h>
 #include <wmilib.h>
 #include <wmistr.h>
@@ -22,4 +23,5 @@ extern "C" {
 #ifdef __cplusplus
 }
 #endif // __cplusplus
+#include "../intrface.h"
 #include "SerialClone.h"
@@ -0,0 +1,486 @@
+// PortState.c
+//
+// Snoops the port configuration out of the IOCTLs the owner sends
+// down to the real serial driver.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "PortState.tmh"
+#endif
+
+static NTSTATUS SCSnoopIoctlComplete(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp, IN PVOID Context);
+
+// the settings we cache, and the IOCTLs that carry them
+typedef struct _SCPORT_SETTING
+{
+	ULONG	SetCode;
+	ULONG	GetCode;
+	ULONG	Valid;			// SCPORT_xxx
+	ULONG	Offset;			// of the field in SCPORT_STATE
+	ULONG	Size;
+} SCPORT_SETTING, *PSCPORT_SETTING;
+
+static const SCPORT_SETTING ScPortSettings[] =
+{
+	{ IOCTL_SERIAL_SET_BAUD_RATE,		IOCTL_SERIAL_GET_BAUD_RATE,		SCPORT_BAUD_RATE,
+		FIELD_OFFSET(SCPORT_STATE, BaudRate),		sizeof(SERIAL_BAUD_RATE) },
+	{ IOCTL_SERIAL_SET_LINE_CONTROL,	IOCTL_SERIAL_GET_LINE_CONTROL,	SCPORT_LINE_CONTROL,
+		FIELD_OFFSET(SCPORT_STATE, LineControl),	sizeof(SERIAL_LINE_CONTROL) },
+	{ IOCTL_SERIAL_SET_TIMEOUTS,		IOCTL_SERIAL_GET_TIMEOUTS,		SCPORT_TIMEOUTS,
+		FIELD_OFFSET(SCPORT_STATE, Timeouts),		sizeof(SERIAL_TIMEOUTS) },
+	{ IOCTL_SERIAL_SET_CHARS,			IOCTL_SERIAL_GET_CHARS,			SCPORT_CHARS,
+		FIELD_OFFSET(SCPORT_STATE, Chars),			sizeof(SERIAL_CHARS) },
+	{ IOCTL_SERIAL_SET_HANDFLOW,		IOCTL_SERIAL_GET_HANDFLOW,		SCPORT_HANDFLOW,
+		FIELD_OFFSET(SCPORT_STATE, HandFlow),		sizeof(SERIAL_HANDFLOW) },
+};
+
+#define SCPORT_SETTINGS (sizeof(ScPortSettings) / sizeof(ScPortSettings[0]))
+
+static VOID SCPortStateRecord(IN PSERIALCLONE_DEVICE_EXTENSION FilterExtension,
+	IN const SCPORT_SETTING * Setting, IN PVOID Source);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortStateDefaults
+//      Marks every cached setting unknown. Line control falls back to 8N1
+//      so the pacer has something to work with once the baud rate shows up.
+//
+//  Arguments:
+//      IN  State
+//              port state, StateLock held or not yet shared
+//
+//  Return Value:
+//      None
+//
+static VOID SCPortStateDefaults(
+    IN  PSCPORT_STATE   State
+    )
+{
+	State->Valid = 0;
+	State->BaudRate = 0;
+	RtlZeroMemory(&State->LineControl, sizeof(SERIAL_LINE_CONTROL));
+	State->LineControl.WordLength = 8;
+	State->LineControl.Parity = NO_PARITY;
+	State->LineControl.StopBits = STOP_BIT_1;
+	RtlZeroMemory(&State->Timeouts, sizeof(SERIAL_TIMEOUTS));
+	RtlZeroMemory(&State->Chars, sizeof(SERIAL_CHARS));
+	RtlZeroMemory(&State->HandFlow, sizeof(SERIAL_HANDFLOW));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortStateInit
+//      Resets the snooped port state of a filter device
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCPortStateInit(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	KeInitializeSpinLock(&FilterExtension->PortState.StateLock);
+	SCPortStateDefaults(&FilterExtension->PortState);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortStateInvalidate
+//      Drops the cached port configuration, used when the lower driver
+//      (re)starts and goes back to its own defaults
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCPortStateInvalidate(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	PSCPORT_STATE	state = &FilterExtension->PortState;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	KeAcquireInStackQueuedSpinLock(&state->StateLock, &lockHandle);
+	SCPortStateDefaults(state);
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortBitsPerChar
+//      Number of bit times one character occupies on the wire
+//
+//  Arguments:
+//      IN  LineControl
+//              line control settings
+//
+//  Return Value:
+//      bits per character, start and stop bits included
+//
+ULONG SCPortBitsPerChar(
+    IN  PSERIAL_LINE_CONTROL    LineControl
+    )
+{
+	ULONG bits;
+
+	bits = 1 + ((LineControl->WordLength != 0) ? LineControl->WordLength : 8);
+	if(LineControl->Parity != NO_PARITY)
+		bits++;
+	// 1.5 stop bits is rounded up, we would rather under estimate the line
+	bits += (LineControl->StopBits == STOP_BIT_1) ? 1 : 2;
+	return bits;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSnoopIoctl
+//      Sets up the next stack location for an IOCTL going to the lower
+//      driver. Every one gets a completion routine, to time it for the
+//      latency histograms, and the ones that set or report the port
+//      configuration have the settings recorded there once the lower
+//      driver accepts them.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension, owner of the port state
+//
+//      IN  Irp
+//              the IRP_MJ_DEVICE_CONTROL IRP about to be passed down
+//
+//      IN  StartTime
+//              SCLatencyNow() when the IRP arrived
+//
+//  Return Value:
+//      None, the caller still calls IoCallDriver
+//
+VOID SCSnoopIoctl(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp,
+    IN  ULONG                           StartTime
+    )
+{
+    PIO_STACK_LOCATION  irpStack;
+
+    irpStack = IoGetCurrentIrpStackLocation(Irp);
+
+    // writes still held by the pacer have to go with the ones below us
+    if ((irpStack->Parameters.DeviceIoControl.IoControlCode == IOCTL_SERIAL_PURGE) &&
+        (irpStack->Parameters.DeviceIoControl.InputBufferLength >= sizeof(ULONG)) &&
+        (*(PULONG)Irp->AssociatedIrp.SystemBuffer & SERIAL_PURGE_TXABORT))
+    {
+        SCPaceFlush(FilterExtension, NULL);
+    }
+
+    irpStack = SCLatencyForward(Irp, StartTime);
+    IoSetCompletionRoutine(Irp, SCSnoopIoctlComplete, FilterExtension, TRUE, TRUE, TRUE);
+
+    SCLatencyRecord((PSERIALCLONE_DEVICE_EXTENSION)irpStack->DeviceObject->DeviceExtension,
+        SERIALCLONE_LATENCY_IOCTL, SERIALCLONE_LATENCY_DISPATCH, SCLatencyNow() - StartTime);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSnoopIoctlComplete
+//      Records a port setting the lower driver has accepted or reported.
+//      SET requests are taken from the input buffer, GET replies from the
+//      bytes the lower driver returned.
+//
+//  Arguments:
+//      IN  DeviceObject
+//              the filter or clone device object the IOCTL came in on
+//
+//      IN  Irp
+//              the completed IOCTL, current stack location the spare one
+//
+//      IN  Context
+//              filter device extension
+//
+//  Return Value:
+//      STATUS_SUCCESS
+//
+static NTSTATUS SCSnoopIoctlComplete(
+    IN  PDEVICE_OBJECT  DeviceObject,
+    IN  PIRP            Irp,
+    IN  PVOID           Context
+    )
+{
+	PSERIALCLONE_DEVICE_EXTENSION	fdx = (PSERIALCLONE_DEVICE_EXTENSION)Context;
+	PIO_STACK_LOCATION				irpStack;
+	const SCPORT_SETTING *			setting;
+	ULONG							code;
+	ULONG							length;
+	ULONG							entered;
+	ULONG							i;
+
+	entered = SCLatencyNow();
+
+	if(Irp->PendingReturned)
+		IoMarkIrpPending(Irp);
+
+	irpStack = IoGetCurrentIrpStackLocation(Irp);
+	code = irpStack->Parameters.DeviceIoControl.IoControlCode;
+
+	for(i = 0; NT_SUCCESS(Irp->IoStatus.Status) && (i < SCPORT_SETTINGS); i++)
+	{
+		setting = &ScPortSettings[i];
+		if(code == setting->SetCode)
+			length = irpStack->Parameters.DeviceIoControl.InputBufferLength;
+		else if(code == setting->GetCode)
+			length = (ULONG)Irp->IoStatus.Information;
+		else
+			continue;
+
+		if(length >= setting->Size)
+			SCPortStateRecord(fdx, setting, Irp->AssociatedIrp.SystemBuffer);
+		break;
+	}
+
+	// counted against the filter or the clone, whichever it came in on
+	SCLatencyComplete((PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension,
+		SERIALCLONE_LATENCY_IOCTL, Irp, entered);
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortStateRecord
+//      Stores one setting in the port state
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension, owner of the port state
+//
+//      IN  Setting
+//              which setting
+//
+//      IN  Source
+//              the new value, Setting->Size bytes
+//
+//  Return Value:
+//      None
+//
+static VOID SCPortStateRecord(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  const SCPORT_SETTING *          Setting,
+    IN  PVOID                           Source
+    )
+{
+	PSCPORT_STATE	state = &FilterExtension->PortState;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	KeAcquireInStackQueuedSpinLock(&state->StateLock, &lockHandle);
+	RtlCopyMemory((PUCHAR)state + Setting->Offset, Source, Setting->Size);
+	state->Valid |= Setting->Valid;
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	SCDebug(DBG_IO, DBG_INFO, (__FUNCTION__": valid %x baud %d bits/char %d",
+		state->Valid, state->BaudRate, SCPortBitsPerChar(&state->LineControl)));
+
+	// the transmit budget may have just grown
+	if(Setting->Valid & (SCPORT_BAUD_RATE | SCPORT_LINE_CONTROL))
+		SCPaceStartNext(FilterExtension);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortStateQuery
+//      Answers an IOCTL_SERIAL_GET_xxx request from the snooped state
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension, owner of the port state
+//
+//      IN  Irp
+//              the GET request, buffer length already checked by the caller
+//
+//      IN  Valid
+//              SCPORT_xxx bit of the setting asked for
+//
+//      IN  Source
+//              the cached setting inside FilterExtension->PortState
+//
+//      IN  Size
+//              size of the setting
+//
+//  Return Value:
+//      TRUE if the IRP buffer was filled, FALSE if the setting has not been
+//      seen yet and the request has to go to the lower driver
+//
+BOOLEAN SCPortStateQuery(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp,
+    IN  ULONG                           Valid,
+    IN  PVOID                           Source,
+    IN  ULONG                           Size
+    )
+{
+	PSCPORT_STATE	state = &FilterExtension->PortState;
+	BOOLEAN			bCached;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	KeAcquireInStackQueuedSpinLock(&state->StateLock, &lockHandle);
+	bCached = (state->Valid & Valid) ? TRUE : FALSE;
+	if(bCached)
+		RtlCopyMemory(Irp->AssociatedIrp.SystemBuffer, Source, Size);
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	if(bCached)
+		Irp->IoStatus.Information = Size;
+	return bCached;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortQuery
+//      Sends a GET request of our own down to the port and waits for it.
+//      Must be called at PASSIVE_LEVEL.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//      IN  IoControlCode
+//              IOCTL_SERIAL_GET_xxx
+//
+//      OUT Buffer
+//              receives the reply
+//
+//      IN  Length
+//              size of the reply expected
+//
+//  Return Value:
+//      NT status code, an error if the port returned less than Length
+//
+static NTSTATUS SCPortQuery(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  ULONG                           IoControlCode,
+    OUT PVOID                           Buffer,
+    IN  ULONG                           Length
+    )
+{
+	KEVENT			event;
+	IO_STATUS_BLOCK	ioStatus;
+	PIRP			irp;
+	NTSTATUS		status;
+
+	KeInitializeEvent(&event, NotificationEvent, FALSE);
+
+	irp = IoBuildDeviceIoControlRequest(IoControlCode, FilterExtension->LowerDeviceObject,
+		NULL, 0, Buffer, Length, FALSE, &event, &ioStatus);
+	if(irp == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	status = IoCallDriver(FilterExtension->LowerDeviceObject, irp);
+	if(status == STATUS_PENDING)
+	{
+		KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, NULL);
+		status = ioStatus.Status;
+	}
+
+	if(NT_SUCCESS(status) && (ioStatus.Information < Length))
+		status = STATUS_UNSUCCESSFUL;
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCPortStateSnapshot
+//      IOCTL_SERIALCLONE_GET_PORT_STATE. Fills a SERIALCLONE_PORT_STATE from
+//      the cache, asking the port only for settings not seen yet and for the
+//      modem, DTR/RTS and comm status which change on their own.
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension, owner of the port state
+//
+//      IN  Irp
+//              the IOCTL_SERIALCLONE_GET_PORT_STATE IRP, at PASSIVE_LEVEL
+//
+//  Return Value:
+//      NT status code to complete the IRP with
+//
+NTSTATUS SCPortStateSnapshot(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp
+    )
+{
+	PSCPORT_STATE			state = &FilterExtension->PortState;
+	PSERIALCLONE_PORT_STATE	snap;
+	const SCPORT_SETTING *	setting;
+	SERIAL_STATUS			commStatus;
+	ULONG					reply[(sizeof(SERIAL_TIMEOUTS) + sizeof(ULONG) - 1) / sizeof(ULONG)];
+	ULONG					valid;
+	ULONG					i;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	if(IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength < sizeof(SERIALCLONE_PORT_STATE))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	// settings nobody has set or read yet, the replies go in the cache too
+	KeAcquireInStackQueuedSpinLock(&state->StateLock, &lockHandle);
+	valid = state->Valid;
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+	for(i = 0; i < SCPORT_SETTINGS; i++)
+	{
+		setting = &ScPortSettings[i];
+		ASSERT(setting->Size <= sizeof(reply));
+		if(valid & setting->Valid)
+			continue;
+		if(NT_SUCCESS(SCPortQuery(FilterExtension, setting->GetCode, reply, setting->Size)))
+			SCPortStateRecord(FilterExtension, setting, reply);
+	}
+
+	snap = (PSERIALCLONE_PORT_STATE)Irp->AssociatedIrp.SystemBuffer;
+	RtlZeroMemory(snap, sizeof(SERIALCLONE_PORT_STATE));
+	snap->Size = sizeof(SERIALCLONE_PORT_STATE);
+
+	KeAcquireInStackQueuedSpinLock(&state->StateLock, &lockHandle);
+	valid = state->Valid;
+	snap->BaudRate = state->BaudRate;
+	snap->StopBits = state->LineControl.StopBits;
+	snap->Parity = state->LineControl.Parity;
+	snap->WordLength = state->LineControl.WordLength;
+	snap->ReadIntervalTimeout = state->Timeouts.ReadIntervalTimeout;
+	snap->ReadTotalTimeoutMultiplier = state->Timeouts.ReadTotalTimeoutMultiplier;
+	snap->ReadTotalTimeoutConstant = state->Timeouts.ReadTotalTimeoutConstant;
+	snap->WriteTotalTimeoutMultiplier = state->Timeouts.WriteTotalTimeoutMultiplier;
+	snap->WriteTotalTimeoutConstant = state->Timeouts.WriteTotalTimeoutConstant;
+	snap->EofChar = state->Chars.EofChar;
+	snap->ErrorChar = state->Chars.ErrorChar;
+	snap->BreakChar = state->Chars.BreakChar;
+	snap->EventChar = state->Chars.EventChar;
+	snap->XonChar = state->Chars.XonChar;
+	snap->XoffChar = state->Chars.XoffChar;
+	snap->ControlHandShake = state->HandFlow.ControlHandShake;
+	snap->FlowReplace = state->HandFlow.FlowReplace;
+	snap->XonLimit = state->HandFlow.XonLimit;
+	snap->XoffLimit = state->HandFlow.XoffLimit;
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	// SCPORT_xxx and SERIALCLONE_STATE_xxx share their bits
+	snap->Valid = valid & (SERIALCLONE_STATE_BAUD_RATE | SERIALCLONE_STATE_LINE_CONTROL |
+		SERIALCLONE_STATE_TIMEOUTS | SERIALCLONE_STATE_CHARS | SERIALCLONE_STATE_HANDFLOW);
+
+	// the live part always comes from the port
+	if(NT_SUCCESS(SCPortQuery(FilterExtension, IOCTL_SERIAL_GET_MODEMSTATUS, &snap->ModemStatus, sizeof(ULONG))))
+		snap->Valid |= SERIALCLONE_STATE_MODEMSTATUS;
+
+	if(NT_SUCCESS(SCPortQuery(FilterExtension, IOCTL_SERIAL_GET_DTRRTS, &snap->DtrRts, sizeof(ULONG))))
+		snap->Valid |= SERIALCLONE_STATE_DTRRTS;
+
+	if(NT_SUCCESS(SCPortQuery(FilterExtension, IOCTL_SERIAL_GET_COMMSTATUS, &commStatus, sizeof(SERIAL_STATUS))))
+	{
+		snap->Errors = commStatus.Errors;
+		snap->HoldReasons = commStatus.HoldReasons;
+		snap->AmountInInQueue = commStatus.AmountInInQueue;
+		snap->AmountInOutQueue = commStatus.AmountInOutQueue;
+		snap->EofReceived = commStatus.EofReceived;
+		snap->WaitForImmediate = commStatus.WaitForImmediate;
+		snap->Valid |= SERIALCLONE_STATE_COMMSTATUS;
+	}
+
+	Irp->IoStatus.Information = sizeof(SERIALCLONE_PORT_STATE);
+	return STATUS_SUCCESS;
+}
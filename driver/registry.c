@@ -82,7 +82,7 @@ PVOID SerialCloneRegQueryValueKey(
 
             if (!NT_SUCCESS(status))
             {
-                SerialCloneDebugPrint(DBG_PNP, DBG_WARN, __FUNCTION__ ": ZwOpenKey failed %x", status);
+                SCDebug(DBG_PNP, DBG_WARN, (__FUNCTION__ ": ZwOpenKey failed %x", status));
                 break;
             }
 
@@ -107,7 +107,7 @@ PVOID SerialCloneRegQueryValueKey(
     
         if ((status != STATUS_BUFFER_TOO_SMALL) && (status != STATUS_BUFFER_OVERFLOW))
         {
-            SerialCloneDebugPrint(DBG_PNP, DBG_WARN, __FUNCTION__ ": ZwQueryValueKey failed %x", status);
+            SCDebug(DBG_PNP, DBG_WARN, (__FUNCTION__ ": ZwQueryValueKey failed %x", status));
             break;
         }
 
@@ -131,7 +131,7 @@ PVOID SerialCloneRegQueryValueKey(
 
         if (!NT_SUCCESS(status))
         {
-            SerialCloneDebugPrint(DBG_PNP, DBG_WARN, __FUNCTION__ ": ZwQueryValueKey failed %x", status);
+            SCDebug(DBG_PNP, DBG_WARN, (__FUNCTION__ ": ZwQueryValueKey failed %x", status));
             break;
         }
     }
@@ -230,11 +230,11 @@ VOID SerialCloneRegEnumerateKeys(
         {
             if (status != STATUS_NO_MORE_ENTRIES)
             {
-                SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": ZwEnumerateKey failed %x", status);
+                SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": ZwEnumerateKey failed %x", status));
             }
             else
             {
-                SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": Enumerated %d keys", index);
+                SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": Enumerated %d keys", index));
             }
 
             break;
@@ -260,7 +260,7 @@ VOID SerialCloneRegEnumerateKeys(
 
         if (!NT_SUCCESS(status))
         {
-            SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": ZwEnumerateKey failed %x", status);
+            SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": ZwEnumerateKey failed %x", status));
 
             // Free our temporary storage
             ExFreePool(regBuffer);
@@ -289,7 +289,7 @@ VOID SerialCloneRegEnumerateKeys(
         // Copy the name over
         RtlCopyMemory(nameBuffer, regBuffer->Name, regBuffer->NameLength);
         
-        SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": ZwEnumerateKey returned %S", nameBuffer);
+        SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": ZwEnumerateKey returned %S", nameBuffer));
 
         // Free both buffers
         ExFreePool(regBuffer);
@@ -344,11 +344,11 @@ VOID SerialCloneRegEnumerateValueKeys(
         {
             if (status != STATUS_NO_MORE_ENTRIES)
             {
-                SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": ZwEnumerateValueKey failed %x", status);
+                SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": ZwEnumerateValueKey failed %x", status));
             }
             else
             {
-                SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": Enumerated %d value keys", index);
+                SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": Enumerated %d value keys", index));
             }
 
             break;
@@ -374,7 +374,7 @@ VOID SerialCloneRegEnumerateValueKeys(
 
         if (!NT_SUCCESS(status))
         {
-            SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": ZwEnumerateValueKey failed %x", status);
+            SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": ZwEnumerateValueKey failed %x", status));
 
             // Free our temporary storage
             ExFreePool(regBuffer);
@@ -403,7 +403,7 @@ VOID SerialCloneRegEnumerateValueKeys(
         // Copy the name over
         RtlCopyMemory(nameBuffer, regBuffer->Name, regBuffer->NameLength);
         
-        SerialCloneDebugPrint(DBG_PNP, DBG_INFO, __FUNCTION__ ": ZwEnumerateValueKey returned %S", nameBuffer);
+        SCDebug(DBG_PNP, DBG_INFO, (__FUNCTION__ ": ZwEnumerateValueKey returned %S", nameBuffer));
 
         // Free both buffers
         ExFreePool(regBuffer);
@@ -415,3 +415,109 @@ VOID SerialCloneRegEnumerateValueKeys(
 
     return;
 }
+
+// the tunables under Parameters, where each goes in g_Data, and what a
+// missing value defaults to and a present one is clamped into
+typedef struct _SCPARAMETER
+{
+	PWSTR	Name;
+	ULONG	Offset;			// of the ULONG in SERIALCLONE_DATA
+	ULONG	Default;
+	ULONG	Min;
+	ULONG	Max;
+} SCPARAMETER, *PSCPARAMETER;
+
+static const SCPARAMETER ScParameters[] =
+{
+	{ L"TxPaceMs",			FIELD_OFFSET(SERIALCLONE_DATA, TxPaceMs),
+		SCPACE_DEFAULT_MS,			0,	SCPACE_MAX_MS },
+	{ L"LockTiming",		FIELD_OFFSET(SERIALCLONE_DATA, LockTiming),
+		0,							0,	MAXULONG },
+	{ L"LatencyHistograms",	FIELD_OFFSET(SERIALCLONE_DATA, LatencyHistograms),
+		0,							0,	MAXULONG },
+	{ L"RxRetainMs",		FIELD_OFFSET(SERIALCLONE_DATA, RxRetainMs),
+		0,							0,	SCRX_RETAIN_MAX_MS },
+	{ L"TraceRecords",		FIELD_OFFSET(SERIALCLONE_DATA, TraceRecords),
+		SCTRACE_DEFAULT_RECORDS,	0,	SCTRACE_MAX_RECORDS },
+	{ L"CaptureEvery",		FIELD_OFFSET(SERIALCLONE_DATA, CaptureEvery),
+		0,							0,	MAXULONG },
+	{ L"CaptureBytes",		FIELD_OFFSET(SERIALCLONE_DATA, CaptureBytes),
+		SCCAPTURE_DEFAULT_BYTES,	0,	SCCAPTURE_MAX_BYTES },
+	{ L"CaptureRecords",	FIELD_OFFSET(SERIALCLONE_DATA, CaptureRecords),
+		SCCAPTURE_DEFAULT_RECORDS,	0,	SCCAPTURE_MAX_RECORDS },
+};
+
+#define SC_PARAMETERS (sizeof(ScParameters) / sizeof(ScParameters[0]))
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SerialCloneReadParameters
+//      Reads the driver tunables in ScParameters from the Parameters
+//      subkey of our service key into g_Data. Missing or malformed values
+//      keep their defaults.
+//
+//  Arguments:
+//      IN  RegistryPath
+//              driver service key path handed to DriverEntry
+//
+//  Return Value:
+//      none
+//
+VOID SerialCloneReadParameters(
+    IN  PUNICODE_STRING RegistryPath
+    )
+{
+    NTSTATUS            status;
+    OBJECT_ATTRIBUTES   objAttributes;
+    HANDLE              hReg;
+    const SCPARAMETER * parameter;
+    PULONG              field;
+    PULONG              value;
+    ULONG               length;
+    ULONG               i;
+
+    for (i = 0; i < SC_PARAMETERS; i++)
+    {
+        parameter = &ScParameters[i];
+        *(PULONG)((PUCHAR)&g_Data + parameter->Offset) = parameter->Default;
+    }
+
+    InitializeObjectAttributes(
+        &objAttributes,
+        RegistryPath,
+        OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+        NULL,
+        NULL
+        );
+
+    status = ZwOpenKey(&hReg, KEY_READ, &objAttributes);
+    if (!NT_SUCCESS(status))
+    {
+        SCDebug(DBG_INIT, DBG_WARN, (__FUNCTION__ ": ZwOpenKey failed %x", status));
+        return;
+    }
+
+    for (i = 0; i < SC_PARAMETERS; i++)
+    {
+        parameter = &ScParameters[i];
+        field = (PULONG)((PUCHAR)&g_Data + parameter->Offset);
+
+        value = (PULONG)SerialCloneRegQueryValueKey(hReg, L"Parameters", parameter->Name, &length);
+        if (value != NULL)
+        {
+            if (length == sizeof(ULONG))
+            {
+                *field = (*value < parameter->Min) ? parameter->Min :
+                    (*value > parameter->Max) ? parameter->Max : *value;
+            }
+
+            ExFreePool(value);
+        }
+    }
+
+    SCDebug(DBG_INIT, DBG_INFO, (__FUNCTION__ ": TxPaceMs %d LockTiming %d LatencyHistograms %d RxRetainMs %d TraceRecords %d",
+        g_Data.TxPaceMs, g_Data.LockTiming, g_Data.LatencyHistograms, g_Data.RxRetainMs, g_Data.TraceRecords));
+    SCDebug(DBG_INIT, DBG_INFO, (__FUNCTION__ ": CaptureEvery %d CaptureBytes %d CaptureRecords %d",
+        g_Data.CaptureEvery, g_Data.CaptureBytes, g_Data.CaptureRecords));
+
+    ZwClose(hReg);
+}
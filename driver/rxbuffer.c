@@ -0,0 +1,242 @@
+// RxBuffer.c
+//
+// Storage for the read buffers. Most ports never have the clone opened,
+// so a device only gets its buffer when it is opened and gives it back
+// after the last close, or Parameters\RxRetainMs later so a quick reopen
+// doesn't go back to the pool. A FIFO with no storage has no room and
+// SCFifoWrite simply drops what is put in it.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "RxBuffer.tmh"
+#endif
+
+static VOID SCRxBufferRetainDpc(IN PKDPC Dpc, IN PVOID Context, IN PVOID Arg1, IN PVOID Arg2);
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCRxBufferInit
+//      Sets up an empty read buffer and its retention timer
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCRxBufferInit(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension
+    )
+{
+	KeInitializeSpinLock(&DeviceExtension->ReadBuffer.FifoLock);
+	SCFifoInit(&DeviceExtension->ReadBuffer, NULL, 0);
+
+	KeInitializeTimer(&DeviceExtension->RxRetainTimer);
+	KeInitializeDpc(&DeviceExtension->RxRetainDpc, SCRxBufferRetainDpc, DeviceExtension);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCRxBufferFree
+//      Takes the storage away from the FIFO and frees it. Whether it is
+//      still closed is decided under the FIFO lock, where SCRxBufferOpen
+//      looks for the storage after counting the open.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension
+//
+//      IN  bIfClosed
+//              only if the device has not been opened again meanwhile
+//
+//  Return Value:
+//      None
+//
+static VOID SCRxBufferFree(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  BOOLEAN                         bIfClosed
+    )
+{
+	KLOCK_QUEUE_HANDLE	lockHandle;
+	char *				buffer = NULL;
+
+	KeAcquireInStackQueuedSpinLock(&DeviceExtension->ReadBuffer.FifoLock, &lockHandle);
+	if(!bIfClosed || (DeviceExtension->OpenHandleCount == 0))
+	{
+		buffer = DeviceExtension->ReadBuffer.Buffer;
+		SCFifoInit(&DeviceExtension->ReadBuffer, NULL, 0);
+	}
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	if(buffer != NULL)
+	{
+		ExFreePool(buffer);
+		SCDebug(DBG_GENERAL, DBG_INFO, (__FUNCTION__": type %d freed", DeviceExtension->TypeFlag));
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCRxBufferRetainDpc
+//      The retention time after the last close is up
+//
+//  Arguments:
+//      IN  Dpc
+//              RxRetainDpc
+//
+//      IN  Context
+//              filter or clone device extension
+//
+//      IN  Arg1, Arg2
+//              unused
+//
+//  Return Value:
+//      None
+//
+static VOID SCRxBufferRetainDpc(
+    IN  PKDPC   Dpc,
+    IN  PVOID   Context,
+    IN  PVOID   Arg1,
+    IN  PVOID   Arg2
+    )
+{
+	PSERIALCLONE_DEVICE_EXTENSION deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)Context;
+
+	// a reopen that came too late to cancel us keeps the buffer
+	SCRxBufferFree(deviceExtension, TRUE);
+
+	// taken when the timer was set
+	SerialCloneReleaseRemoveLock(deviceExtension);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCRxBufferOpen
+//      Makes sure an opened device has its read buffer
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension, already counted as open
+//
+//  Return Value:
+//      STATUS_SUCCESS or STATUS_INSUFFICIENT_RESOURCES
+//
+NTSTATUS SCRxBufferOpen(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension
+    )
+{
+	KLOCK_QUEUE_HANDLE	lockHandle;
+	char *				buffer;
+
+	// a retained buffer is still there, stop the timer giving it back
+	if(KeCancelTimer(&DeviceExtension->RxRetainTimer))
+		SerialCloneReleaseRemoveLock(DeviceExtension);
+
+	// the retention DPC may be past the cancel. It decides under the FIFO
+	// lock by OpenHandleCount, which we have bumped already, so a buffer
+	// seen here under the lock is one it will leave alone.
+	KeAcquireInStackQueuedSpinLock(&DeviceExtension->ReadBuffer.FifoLock, &lockHandle);
+	buffer = DeviceExtension->ReadBuffer.Buffer;
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+	if(buffer != NULL)
+		return STATUS_SUCCESS;
+
+	buffer = (char *)ExAllocatePoolWithTag(NonPagedPool, SCRX_BUFFER_SIZE, SERIALCLONE_POOL_TAG);
+	if(buffer == NULL)
+	{
+		SCDebug(DBG_GENERAL, DBG_ERR, (__FUNCTION__": Insufficient memory"));
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	KeAcquireInStackQueuedSpinLock(&DeviceExtension->ReadBuffer.FifoLock, &lockHandle);
+	if(DeviceExtension->ReadBuffer.Buffer == NULL)
+	{
+		SCFifoInit(&DeviceExtension->ReadBuffer, buffer, SCRX_BUFFER_SIZE);
+		buffer = NULL;
+	}
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	// only the one open gets here, but a buffer already there is kept
+	if(buffer != NULL)
+		ExFreePool(buffer);
+
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCRxBufferClose
+//      Gives the read buffer back after the last close, now or after
+//      the retention time
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension, no longer counted as open
+//
+//  Return Value:
+//      None
+//
+VOID SCRxBufferClose(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension
+    )
+{
+	LARGE_INTEGER	dueTime;
+
+	if(DeviceExtension->OpenHandleCount != 0)
+		return;
+
+	// the timer holds a remove lock so removal waits for it
+	if((g_Data.RxRetainMs != 0) && SerialCloneAcquireRemoveLock(DeviceExtension))
+	{
+		dueTime.QuadPart = -10000 * (LONGLONG)g_Data.RxRetainMs;
+		if(KeSetTimer(&DeviceExtension->RxRetainTimer, dueTime, &DeviceExtension->RxRetainDpc))
+			SerialCloneReleaseRemoveLock(DeviceExtension);
+		return;
+	}
+
+	SCRxBufferFree(DeviceExtension, TRUE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCRxBufferCancelRetain
+//      Stops a retention timer still running when the device goes away,
+//      so the wait for its remove locks isn't held up by the retention
+//      time. A close that slips in after this sets the timer again and
+//      the wait lasts until it goes off.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCRxBufferCancelRetain(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension
+    )
+{
+	if(KeCancelTimer(&DeviceExtension->RxRetainTimer))
+		SerialCloneReleaseRemoveLock(DeviceExtension);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCRxBufferStop
+//      Frees the read buffer whatever state it is in, used when the
+//      device goes away. Called once the wait for its remove locks is
+//      over, when no IRP can be putting data in it and no retention
+//      timer is left, one would have held a remove lock.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCRxBufferStop(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension
+    )
+{
+	SCRxBufferFree(DeviceExtension, FALSE);
+}
@@ -0,0 +1,472 @@
+// Stats.c
+//
+// Performance counters. Each device keeps one block of counters per
+// processor, each on its own cache lines, so the read and write paths
+// never share a line with another CPU. The blocks are summed when
+// someone asks, through IOCTL_SERIALCLONE_GET_COUNTERS or WMI.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Stats.tmh"
+#endif
+
+static NTSTATUS SCWmiQueryRegInfo(IN PDEVICE_OBJECT DeviceObject, OUT PULONG RegFlags,
+	OUT PUNICODE_STRING InstanceName, OUT PUNICODE_STRING *RegistryPath,
+	OUT PUNICODE_STRING MofResourceName, OUT PDEVICE_OBJECT *Pdo);
+static NTSTATUS SCWmiQueryDataBlock(IN PDEVICE_OBJECT DeviceObject, IN PIRP Irp,
+	IN ULONG GuidIndex, IN ULONG InstanceIndex, IN ULONG InstanceCount,
+	IN OUT PULONG InstanceLengthArray, IN ULONG BufferAvail, OUT PUCHAR Buffer);
+
+static WMIGUIDREGINFO ScWmiGuidList[] =
+{
+	{ &SERIALCLONE_WMI_COUNTERS_GUID, 1, 0 },
+};
+
+static WMILIB_CONTEXT ScWmiLibInfo =
+{
+	sizeof(ScWmiGuidList) / sizeof(ScWmiGuidList[0]),
+	ScWmiGuidList,
+	SCWmiQueryRegInfo,
+	SCWmiQueryDataBlock,
+	NULL,					// read only
+	NULL,
+	NULL,
+	NULL
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCStatsCpus
+//      Number of per processor slots a device, or the trace, needs
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      one more than the highest processor number we could run on
+//
+ULONG SCStatsCpus(VOID)
+{
+	KAFFINITY	active;
+	ULONG		cpus;
+
+	active = KeQueryActiveProcessors();
+	for(cpus = 0; active != 0; cpus++)
+		active >>= 1;
+
+	return cpus;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCStatsExtensionSize
+//      Device extension size to ask IoCreateDevice for. The per processor
+//      slots live at the end of the extension so they last exactly as
+//      long as the device object; the remove lock is in them and must
+//      still answer after removal for IRPs on handles left open. The
+//      latency histograms follow them if they are kept.
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      size in bytes
+//
+ULONG SCStatsExtensionSize(VOID)
+{
+	ULONG	slot;
+
+	slot = sizeof(SCSTATS_CPU);
+	if(g_Data.LatencyHistograms)
+		slot += sizeof(SCLATENCY_CPU);
+
+	// room to round the slots up to a cache line
+	return sizeof(SERIALCLONE_DEVICE_EXTENSION) + SC_CACHE_LINE - 1 + SCStatsCpus() * slot;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCStatsInit
+//      Sets up the per processor counters of a device
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension, SCStatsExtensionSize bytes
+//
+//  Return Value:
+//      None
+//
+VOID SCStatsInit(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension
+    )
+{
+	ULONG_PTR	slots;
+	ULONG		cpus;
+
+	cpus = SCStatsCpus();
+
+	slots = (ULONG_PTR)(DeviceExtension + 1);
+	slots = (slots + SC_CACHE_LINE - 1) & ~(ULONG_PTR)(SC_CACHE_LINE - 1);
+
+	DeviceExtension->Stats = (PSCSTATS_CPU)slots;
+	RtlZeroMemory(DeviceExtension->Stats, cpus * sizeof(SCSTATS_CPU));
+	DeviceExtension->StatsCpus = cpus;
+	DeviceExtension->FifoHighWater = 0;
+
+	// whole cache lines each, so still aligned after the counters
+	DeviceExtension->Latency = NULL;
+	if(g_Data.LatencyHistograms)
+	{
+		DeviceExtension->Latency = (PSCLATENCY_CPU)(DeviceExtension->Stats + cpus);
+		RtlZeroMemory(DeviceExtension->Latency, cpus * sizeof(SCLATENCY_CPU));
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCStatsLatency
+//      Counts a completed lower read in its latency bucket
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              device the read came in on
+//
+//      IN  Elapsed
+//              latency ticks from the read arriving to the port completing it
+//
+//  Return Value:
+//      None
+//
+VOID SCStatsLatency(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  ULONG                           Elapsed
+    )
+{
+	ULONG		limit;
+	ULONG		bucket;
+
+	// the first bucket ends at 100us. Latency ticks run at 10MHz or less,
+	// so the ULONG they are kept in lasts at least 7 minutes.
+	limit = g_Data.LatencyFrequency / 10000;
+	for(bucket = 0; bucket < SERIALCLONE_LATENCY_BUCKETS - 1; bucket++)
+	{
+		if(Elapsed < limit)
+			break;
+		limit *= 10;
+	}
+
+	SCStatInc(DeviceExtension, ReadLatency[bucket]);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCStatsQuery
+//      Sums the per processor counters of a device
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              filter or clone device extension
+//
+//      OUT Counters
+//              receives the totals
+//
+//  Return Value:
+//      None
+//
+VOID SCStatsQuery(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    OUT PSERIALCLONE_COUNTERS           Counters
+    )
+{
+	PSERIALCLONE_COUNTERS	cpu;
+	ULONG					i;
+	ULONG					j;
+
+	RtlZeroMemory(Counters, sizeof(SERIALCLONE_COUNTERS));
+
+	for(i = 0; i < DeviceExtension->StatsCpus; i++)
+	{
+		cpu = &DeviceExtension->Stats[i].Counters;
+
+		Counters->BytesIn += cpu->BytesIn;
+		Counters->BytesOut += cpu->BytesOut;
+		Counters->OverflowBytes += cpu->OverflowBytes;
+		Counters->ReadIrps += cpu->ReadIrps;
+		Counters->FastReads += cpu->FastReads;
+		Counters->LowerReads += cpu->LowerReads;
+		Counters->WriteIrps += cpu->WriteIrps;
+		Counters->LockAcquires += cpu->LockAcquires;
+		Counters->LockContention += cpu->LockContention;
+		Counters->LockWaitTime += cpu->LockWaitTime;
+		Counters->LockHoldTime += cpu->LockHoldTime;
+		for(j = 0; j < SERIALCLONE_LATENCY_BUCKETS; j++)
+			Counters->ReadLatency[j] += cpu->ReadLatency[j];
+	}
+
+	// kept under the FIFO lock rather than per processor
+	Counters->FifoHighWater = DeviceExtension->FifoHighWater;
+	Counters->BufferBytes = DeviceExtension->ReadBuffer.BuffSize;
+
+	// the lock times were counted in performance counter ticks
+	Counters->LockWaitTime = SCLockTicksTo100ns(Counters->LockWaitTime);
+	Counters->LockHoldTime = SCLockTicksTo100ns(Counters->LockHoldTime);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCStatsPortQuery
+//      Fills a SERIALCLONE_PORT_COUNTERS for a port
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//      OUT PortCounters
+//              receives the owner and clone totals
+//
+//  Return Value:
+//      None
+//
+static VOID SCStatsPortQuery(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    OUT PSERIALCLONE_PORT_COUNTERS      PortCounters
+    )
+{
+	PortCounters->Size = sizeof(SERIALCLONE_PORT_COUNTERS);
+	PortCounters->Reserved = 0;
+	SCStatsQuery(FilterExtension, &PortCounters->Owner);
+	SCStatsQuery(FilterExtension->Extension, &PortCounters->Clone);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCStatsIoctl
+//      IOCTL_SERIALCLONE_GET_COUNTERS
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension of the port
+//
+//      IN  Irp
+//              the IOCTL_SERIALCLONE_GET_COUNTERS IRP
+//
+//  Return Value:
+//      NT status code to complete the IRP with
+//
+NTSTATUS SCStatsIoctl(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp
+    )
+{
+	if(IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength < sizeof(SERIALCLONE_PORT_COUNTERS))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	SCStatsPortQuery(FilterExtension, (PSERIALCLONE_PORT_COUNTERS)Irp->AssociatedIrp.SystemBuffer);
+	Irp->IoStatus.Information = sizeof(SERIALCLONE_PORT_COUNTERS);
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWmiRegister
+//      Registers the filter device as a WMI data provider
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCWmiRegister(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	NTSTATUS	status;
+
+	status = IoWMIRegistrationControl(FilterExtension->FDeviceObject, WMIREG_ACTION_REGISTER);
+	FilterExtension->WmiRegistered = NT_SUCCESS(status);
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWmiDeregister
+//      Removes the filter device from WMI, if SCWmiRegister got it there
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCWmiDeregister(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension
+    )
+{
+	if(!FilterExtension->WmiRegistered)
+		return;
+
+	IoWMIRegistrationControl(FilterExtension->FDeviceObject, WMIREG_ACTION_DEREGISTER);
+	FilterExtension->WmiRegistered = FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWmiSystemControl
+//      Hands IRP_MJ_SYSTEM_CONTROL to WMILIB and passes down whatever is
+//      not for us
+//
+//  Arguments:
+//      IN  FilterExtension
+//              filter device extension, remove lock held by the caller
+//
+//      IN  Irp
+//              the IRP_MJ_SYSTEM_CONTROL IRP
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCWmiSystemControl(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   FilterExtension,
+    IN  PIRP                            Irp
+    )
+{
+	SYSCTL_IRP_DISPOSITION	disposition;
+	NTSTATUS				status;
+
+	status = WmiSystemControl(&ScWmiLibInfo, FilterExtension->FDeviceObject, Irp, &disposition);
+
+	switch(disposition)
+	{
+	case IrpProcessed:
+		// WMILIB called us back and we completed it there
+		break;
+
+	case IrpNotCompleted:
+		IoCompleteRequest(Irp, IO_NO_INCREMENT);
+		break;
+
+	case IrpForward:
+	case IrpNotWmi:
+	default:
+		IoSkipCurrentIrpStackLocation(Irp);
+		status = IoCallDriver(FilterExtension->LowerDeviceObject, Irp);
+		break;
+	}
+
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWmiQueryRegInfo
+//      WMILIB callback, describes our data blocks
+//
+//  Arguments:
+//      IN  DeviceObject
+//              filter device object
+//
+//      OUT RegFlags
+//              WMIREG_FLAG_xxx
+//
+//      OUT InstanceName
+//              unused, instance names come from the PDO
+//
+//      OUT RegistryPath
+//              our service key
+//
+//      OUT MofResourceName
+//              name of the MOF resource in SerialClone.rc
+//
+//      OUT Pdo
+//              PDO the instance names are built from
+//
+//  Return Value:
+//      STATUS_SUCCESS
+//
+static NTSTATUS SCWmiQueryRegInfo(
+    IN  PDEVICE_OBJECT      DeviceObject,
+    OUT PULONG              RegFlags,
+    OUT PUNICODE_STRING     InstanceName,
+    OUT PUNICODE_STRING *   RegistryPath,
+    OUT PUNICODE_STRING     MofResourceName,
+    OUT PDEVICE_OBJECT *    Pdo
+    )
+{
+	PSERIALCLONE_DEVICE_EXTENSION deviceExtension;
+
+	deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+
+	*RegFlags = WMIREG_FLAG_INSTANCE_PDO;
+	*RegistryPath = &g_Data.RegistryPath;
+	*Pdo = deviceExtension->PhysicalDeviceObject;
+	RtlInitUnicodeString(MofResourceName, L"MofResource");
+
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWmiQueryDataBlock
+//      WMILIB callback, returns the port counters
+//
+//  Arguments:
+//      IN  DeviceObject
+//              filter device object
+//
+//      IN  Irp
+//              the WMI IRP
+//
+//      IN  GuidIndex
+//              index into ScWmiGuidList
+//
+//      IN  InstanceIndex
+//              first instance asked for
+//
+//      IN  InstanceCount
+//              number of instances asked for
+//
+//      IN OUT InstanceLengthArray
+//              receives the size of each instance
+//
+//      IN  BufferAvail
+//              size of Buffer
+//
+//      OUT Buffer
+//              receives the data
+//
+//  Return Value:
+//      status passed to WmiCompleteRequest
+//
+static NTSTATUS SCWmiQueryDataBlock(
+    IN  PDEVICE_OBJECT  DeviceObject,
+    IN  PIRP            Irp,
+    IN  ULONG           GuidIndex,
+    IN  ULONG           InstanceIndex,
+    IN  ULONG           InstanceCount,
+    IN OUT PULONG       InstanceLengthArray,
+    IN  ULONG           BufferAvail,
+    OUT PUCHAR          Buffer
+    )
+{
+	PSERIALCLONE_DEVICE_EXTENSION	deviceExtension;
+	NTSTATUS						status;
+	ULONG							size;
+
+	deviceExtension = (PSERIALCLONE_DEVICE_EXTENSION)DeviceObject->DeviceExtension;
+	size = 0;
+
+	if(GuidIndex != 0)
+		status = STATUS_WMI_GUID_NOT_FOUND;
+	else if((InstanceIndex != 0) || (InstanceCount != 1))
+		status = STATUS_WMI_INSTANCE_NOT_FOUND;
+	else
+	{
+		size = sizeof(SERIALCLONE_PORT_COUNTERS);
+		if(BufferAvail < size)
+			status = STATUS_BUFFER_TOO_SMALL;
+		else
+		{
+			SCStatsPortQuery(deviceExtension, (PSERIALCLONE_PORT_COUNTERS)Buffer);
+			*InstanceLengthArray = size;
+			status = STATUS_SUCCESS;
+		}
+	}
+
+	return WmiCompleteRequest(DeviceObject, Irp, status, size, IO_NO_INCREMENT);
+}
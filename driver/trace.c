@@ -0,0 +1,219 @@
+// Trace.c
+//
+// Binary trace of the read and write paths. Each processor has its own
+// ring of fixed size SERIALCLONE_TRACE_RECORDs; recording one is a slot
+// claim on that processor's ring and a few stores, with no formatting,
+// no lock and no DbgPrint. IOCTL_SERIALCLONE_GET_TRACE copies the rings
+// out and the sctrace tool turns them into text.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Trace.tmh"
+#endif
+
+// one processor's ring. Next is only shared with code that migrated
+// between reading the processor number and claiming the slot, so it
+// gets a cache line of its own and the records start on the next one.
+typedef struct _SCTRACE_RING
+{
+	LONG						Next;			// sequence of the last record claimed
+	UCHAR						Pad[SC_CACHE_LINE - sizeof(LONG)];
+	SERIALCLONE_TRACE_RECORD	Records[1];
+} SCTRACE_RING, *PSCTRACE_RING;
+
+static PUCHAR	ScTraceRings;			// NULL while tracing is off
+static ULONG	ScTraceCpus;
+static ULONG	ScTraceRecords;			// per ring, a power of 2
+static ULONG	ScTraceStride;			// bytes from one ring to the next
+
+#define SCTraceRing(cpu)	((PSCTRACE_RING)(ScTraceRings + (cpu) * ScTraceStride))
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceInit
+//      Allocates the rings, called from DriverEntry after the parameters
+//      are read. Tracing just stays off if there is no memory for it.
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      None
+//
+VOID SCTraceInit(VOID)
+{
+	ULONG	records;
+
+	ScTraceRings = NULL;
+	if(g_Data.TraceRecords == 0)
+		return;
+
+	// a power of 2 so the slot is a mask of the sequence
+	for(records = SCTRACE_MIN_RECORDS; records < g_Data.TraceRecords; records <<= 1)
+		;
+
+	ScTraceCpus = SCStatsCpus();
+	ScTraceRecords = records;
+	ScTraceStride = FIELD_OFFSET(SCTRACE_RING, Records) + records * sizeof(SERIALCLONE_TRACE_RECORD);
+	ScTraceStride = (ScTraceStride + SC_CACHE_LINE - 1) & ~(SC_CACHE_LINE - 1);
+
+	ScTraceRings = (PUCHAR)ExAllocatePoolWithTag(NonPagedPool, ScTraceCpus * ScTraceStride, SERIALCLONE_POOL_TAG);
+	if(ScTraceRings == NULL)
+	{
+		SCDebug(DBG_INIT, DBG_WARN, (__FUNCTION__": no memory for %d records, tracing off", records));
+		return;
+	}
+
+	RtlZeroMemory(ScTraceRings, ScTraceCpus * ScTraceStride);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceFree
+//      Frees the rings, called from SerialCloneUnload
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      None
+//
+VOID SCTraceFree(VOID)
+{
+	if(ScTraceRings != NULL)
+	{
+		ExFreePool(ScTraceRings);
+		ScTraceRings = NULL;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceEvent
+//      Records one event in the current processor's ring. Safe at any
+//      IRQL. The sequence is cleared first and stored last, so a record
+//      copied out halfway through being written mostly shows up with a
+//      sequence of 0.
+//
+//  Arguments:
+//      IN  DeviceExtension
+//              device the event is about, NULL for the driver
+//
+//      IN  Event
+//              SERIALCLONE_TRACE_xxx
+//
+//      IN  Irp
+//              IRP the event is about, NULL for none
+//
+//      IN  Arg0, Arg1, Arg2
+//              event specific, see intrface.h
+//
+//  Return Value:
+//      None
+//
+VOID SCTraceEvent(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   DeviceExtension,
+    IN  USHORT                          Event,
+    IN  PIRP                            Irp,
+    IN  ULONG                           Arg0,
+    IN  ULONG                           Arg1,
+    IN  ULONG                           Arg2
+    )
+{
+	PSCTRACE_RING				ring;
+	PSERIALCLONE_TRACE_RECORD	record;
+	ULONG						sequence;
+
+	if(ScTraceRings == NULL)
+		return;
+
+	ring = SCTraceRing(KeGetCurrentProcessorNumber());
+	sequence = (ULONG)InterlockedIncrement(&ring->Next);
+	record = &ring->Records[(sequence - 1) & (ScTraceRecords - 1)];
+
+	record->Sequence = 0;
+	record->Time = KeQueryInterruptTime();
+	record->Irp = (ULONGLONG)(ULONG_PTR)Irp;
+	record->Event = Event;
+	record->Irql = KeGetCurrentIrql();
+	if(DeviceExtension != NULL)
+	{
+		record->Device = (UCHAR)DeviceExtension->TypeFlag;
+		record->Instance = DeviceExtension->Instance;
+	}
+	else
+	{
+		record->Device = SERIALCLONE_TRACE_DRIVER;
+		record->Instance = 0;
+	}
+	record->Args[0] = Arg0;
+	record->Args[1] = Arg1;
+	record->Args[2] = Arg2;
+
+	InterlockedExchange((PLONG)&record->Sequence, (LONG)sequence);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceIoctl
+//      IOCTL_SERIALCLONE_GET_TRACE. The rings are copied as they are,
+//      while they are still being written; sctrace puts the records in
+//      order and drops the ones whose sequence doesn't fit their slot.
+//      IRP addresses are kernel addresses and only go to a privileged
+//      caller, the others get 0 in their place.
+//
+//  Arguments:
+//      IN  Irp
+//              the IOCTL_SERIALCLONE_GET_TRACE IRP
+//
+//      IN  Privileged
+//              SCCallerPrivileged(Irp)
+//
+//  Return Value:
+//      NT status code to complete the IRP with
+//
+NTSTATUS SCTraceIoctl(
+    IN  PIRP    Irp,
+    IN  BOOLEAN Privileged
+    )
+{
+	PSERIALCLONE_TRACE_HEADER	header;
+	PSERIALCLONE_TRACE_RECORD	record;
+	PUCHAR						out;
+	ULONG						length;
+	ULONG						ringBytes;
+	ULONG						cpu;
+	ULONG						i;
+
+	length = IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength;
+	if(length < sizeof(SERIALCLONE_TRACE_HEADER))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	header = (PSERIALCLONE_TRACE_HEADER)Irp->AssociatedIrp.SystemBuffer;
+	header->Size = sizeof(SERIALCLONE_TRACE_HEADER);
+	header->RecordSize = sizeof(SERIALCLONE_TRACE_RECORD);
+	header->Processors = (ScTraceRings != NULL) ? ScTraceCpus : 0;
+	header->RecordsPerRing = (ScTraceRings != NULL) ? ScTraceRecords : 0;
+	Irp->IoStatus.Information = sizeof(SERIALCLONE_TRACE_HEADER);
+
+	ringBytes = header->RecordsPerRing * sizeof(SERIALCLONE_TRACE_RECORD);
+	if(length - sizeof(SERIALCLONE_TRACE_HEADER) < header->Processors * ringBytes)
+		return STATUS_BUFFER_OVERFLOW;
+
+	out = (PUCHAR)(header + 1);
+	for(cpu = 0; cpu < header->Processors; cpu++)
+	{
+		RtlCopyMemory(out, SCTraceRing(cpu)->Records, ringBytes);
+		if(!Privileged)
+		{
+			record = (PSERIALCLONE_TRACE_RECORD)out;
+			for(i = 0; i < header->RecordsPerRing; i++)
+				record[i].Irp = 0;
+		}
+		out += ringBytes;
+	}
+
+	Irp->IoStatus.Information += header->Processors * ringBytes;
+	return STATUS_SUCCESS;
+}
@@ -0,0 +1,338 @@
+// Wait.c
+//
+// IOCTL_SERIAL_WAIT_ON_MASK for the clone. The port only takes one wait
+// mask and that belongs to the owner, so the clone keeps its own and
+// raises the receive events itself as data lands in its buffer.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include "pch.h"
+#ifdef SERIALCLONE_WMI_TRACE
+#include "Wait.tmh"
+#endif
+
+// every event serial.sys will accept in a wait mask
+#define SCWAIT_VALID_EVENTS (SERIAL_EV_RXCHAR | SERIAL_EV_RXFLAG | SERIAL_EV_TXEMPTY | \
+	SERIAL_EV_CTS | SERIAL_EV_DSR | SERIAL_EV_RLSD | SERIAL_EV_BREAK | SERIAL_EV_ERR | \
+	SERIAL_EV_RING | SERIAL_EV_PERR | SERIAL_EV_RX80FULL | SERIAL_EV_EVENT1 | SERIAL_EV_EVENT2)
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitInit
+//      Sets up the wait mask state of a clone device
+//
+//  Arguments:
+//      IN  CloneExtension
+//              clone device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCWaitInit(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   CloneExtension
+    )
+{
+	KeInitializeSpinLock(&CloneExtension->WaitLock);
+	CloneExtension->WaitMask = 0;
+	CloneExtension->WaitHistory = 0;
+	SerialCloneInitializeList(&CloneExtension->WaitQueue, CloneExtension->CDeviceObject);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitComplete
+//      Completes a wait IRP with the events that satisfied it
+//
+//  Arguments:
+//      IN  Irp
+//              the IOCTL_SERIAL_WAIT_ON_MASK IRP
+//
+//      IN  Events
+//              SERIAL_EV_xxx to report, 0 when the mask was changed under it
+//
+//  Return Value:
+//      None
+//
+static VOID SCWaitComplete(
+    IN  PIRP    Irp,
+    IN  ULONG   Events
+    )
+{
+	*(PULONG)Irp->AssociatedIrp.SystemBuffer = Events;
+	Irp->IoStatus.Status = STATUS_SUCCESS;
+	Irp->IoStatus.Information = sizeof(ULONG);
+	IoCompleteRequest(Irp, IO_SERIAL_INCREMENT);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitSetMask
+//      IOCTL_SERIAL_SET_WAIT_MASK. Like serial.sys, a new mask releases a
+//      pending wait with no events and forgets anything seen so far.
+//
+//  Arguments:
+//      IN  CloneExtension
+//              clone device extension
+//
+//      IN  Irp
+//              the IOCTL_SERIAL_SET_WAIT_MASK IRP
+//
+//  Return Value:
+//      NT status code to complete the IRP with
+//
+NTSTATUS SCWaitSetMask(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   CloneExtension,
+    IN  PIRP                            Irp
+    )
+{
+	PIO_STACK_LOCATION	irpStack;
+	ULONG				mask;
+	PIRP				waitIrp;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	irpStack = IoGetCurrentIrpStackLocation(Irp);
+	if(irpStack->Parameters.DeviceIoControl.InputBufferLength < sizeof(ULONG))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	mask = *(PULONG)Irp->AssociatedIrp.SystemBuffer;
+	if(mask & ~SCWAIT_VALID_EVENTS)
+		return STATUS_INVALID_PARAMETER;
+
+	KeAcquireInStackQueuedSpinLock(&CloneExtension->WaitLock, &lockHandle);
+	CloneExtension->WaitMask = mask;
+	CloneExtension->WaitHistory = 0;
+	waitIrp = SerialCloneRemoveHead(&CloneExtension->WaitQueue);
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	if(waitIrp != NULL)
+		SCWaitComplete(waitIrp, 0);
+
+	SCDebug(DBG_IO, DBG_INFO, (__FUNCTION__": mask %x", mask));
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitGetMask
+//      IOCTL_SERIAL_GET_WAIT_MASK
+//
+//  Arguments:
+//      IN  CloneExtension
+//              clone device extension
+//
+//      IN  Irp
+//              the IOCTL_SERIAL_GET_WAIT_MASK IRP
+//
+//  Return Value:
+//      NT status code to complete the IRP with
+//
+NTSTATUS SCWaitGetMask(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   CloneExtension,
+    IN  PIRP                            Irp
+    )
+{
+	if(IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength < sizeof(ULONG))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	*(PULONG)Irp->AssociatedIrp.SystemBuffer = CloneExtension->WaitMask;
+	Irp->IoStatus.Information = sizeof(ULONG);
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitOnMask
+//      IOCTL_SERIAL_WAIT_ON_MASK. Completes at once if an event in the mask
+//      has happened since the last wait, otherwise holds the IRP until one
+//      does. Only one wait may be outstanding.
+//
+//  Arguments:
+//      IN  CloneExtension
+//              clone device extension
+//
+//      IN  Irp
+//              the IOCTL_SERIAL_WAIT_ON_MASK IRP
+//
+//  Return Value:
+//      STATUS_PENDING if the IRP was queued, otherwise the status to
+//      complete it with
+//
+NTSTATUS SCWaitOnMask(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   CloneExtension,
+    IN  PIRP                            Irp
+    )
+{
+	NTSTATUS	status;
+	ULONG		events;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	if(IoGetCurrentIrpStackLocation(Irp)->Parameters.DeviceIoControl.OutputBufferLength < sizeof(ULONG))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	KeAcquireInStackQueuedSpinLock(&CloneExtension->WaitLock, &lockHandle);
+
+	if((CloneExtension->WaitMask == 0) || !IsListEmpty(&CloneExtension->WaitQueue.IrpList))
+	{
+		KeReleaseInStackQueuedSpinLock(&lockHandle);
+		return STATUS_INVALID_PARAMETER;
+	}
+
+	events = CloneExtension->WaitHistory;
+	if(events != 0)
+	{
+		CloneExtension->WaitHistory = 0;
+		KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+		*(PULONG)Irp->AssociatedIrp.SystemBuffer = events;
+		Irp->IoStatus.Information = sizeof(ULONG);
+		return STATUS_SUCCESS;
+	}
+
+	status = SerialCloneInsertTail(&CloneExtension->WaitQueue, Irp);
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitRaise
+//      Raises the receive events for data that just went into the clone
+//      read buffer and wakes the pending wait if it was waiting for one
+//
+//  Arguments:
+//      IN  CloneExtension
+//              clone device extension
+//
+//      IN  Data
+//              the bytes just received
+//
+//      IN  Length
+//              number of bytes received
+//
+//      IN  OldSize
+//              bytes in the read buffer before this data went in
+//
+//      IN  NewSize
+//              bytes in the read buffer after this data went in
+//
+//  Return Value:
+//      None
+//
+VOID SCWaitRaise(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   CloneExtension,
+    IN  PCHAR                           Data,
+    IN  ULONG                           Length,
+    IN  ULONG                           OldSize,
+    IN  ULONG                           NewSize
+    )
+{
+	PSCPORT_STATE	state = &CloneExtension->Extension->PortState;
+	ULONG			mask;
+	ULONG			events;
+	ULONG			fullMark;
+	UCHAR			eventChar;
+	BOOLEAN			bEventChar;
+	PIRP			waitIrp;
+	KLOCK_QUEUE_HANDLE	lockHandle;
+	ULONG			i;
+
+	mask = CloneExtension->WaitMask;
+	if((mask == 0) || (Length == 0))
+		return;
+
+	events = SERIAL_EV_RXCHAR;
+
+	if(mask & SERIAL_EV_RXFLAG)
+	{
+		KeAcquireInStackQueuedSpinLock(&state->StateLock, &lockHandle);
+		bEventChar = (state->Valid & SCPORT_CHARS) ? TRUE : FALSE;
+		eventChar = state->Chars.EventChar;
+		KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+		if(bEventChar)
+		{
+			for(i = 0; i < Length; i++)
+			{
+				if((UCHAR)Data[i] == eventChar)
+				{
+					events |= SERIAL_EV_RXFLAG;
+					break;
+				}
+			}
+		}
+	}
+
+	// only on the way up through the mark, not on every read above it
+	fullMark = CloneExtension->ReadBuffer.BuffSize / 10 * 8;
+	if((OldSize < fullMark) && (NewSize >= fullMark))
+		events |= SERIAL_EV_RX80FULL;
+
+	waitIrp = NULL;
+
+	KeAcquireInStackQueuedSpinLock(&CloneExtension->WaitLock, &lockHandle);
+	events &= CloneExtension->WaitMask;
+	if(events != 0)
+	{
+		waitIrp = SerialCloneRemoveHead(&CloneExtension->WaitQueue);
+		if(waitIrp != NULL)
+		{
+			events |= CloneExtension->WaitHistory;
+			CloneExtension->WaitHistory = 0;
+		}
+		else
+			CloneExtension->WaitHistory |= events;
+	}
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+
+	if(waitIrp != NULL)
+	{
+		SCTraceEvent(CloneExtension, SERIALCLONE_TRACE_WAIT_EVENT, waitIrp, events, 0, 0);
+		SCWaitComplete(waitIrp, events);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitFlush
+//      Cancels the pending wait of a handle being cleaned up and clears
+//      the mask so the next open starts out with none
+//
+//  Arguments:
+//      IN  CloneExtension
+//              clone device extension
+//
+//      IN  FileObject
+//              only cancel a wait for this file object, NULL for any
+//
+//  Return Value:
+//      None
+//
+VOID SCWaitFlush(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   CloneExtension,
+    IN  PFILE_OBJECT                    FileObject
+    )
+{
+	KLOCK_QUEUE_HANDLE	lockHandle;
+
+	SerialCloneFlushList(&CloneExtension->WaitQueue, FileObject);
+
+	KeAcquireInStackQueuedSpinLock(&CloneExtension->WaitLock, &lockHandle);
+	CloneExtension->WaitMask = 0;
+	CloneExtension->WaitHistory = 0;
+	KeReleaseInStackQueuedSpinLock(&lockHandle);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCWaitStop
+//      Fails the pending and any future wait, used when the device goes away
+//
+//  Arguments:
+//      IN  CloneExtension
+//              clone device extension
+//
+//  Return Value:
+//      None
+//
+VOID SCWaitStop(
+    IN  PSERIALCLONE_DEVICE_EXTENSION   CloneExtension
+    )
+{
+	SerialCloneInvalidateList(&CloneExtension->WaitQueue, STATUS_DELETE_PENDING);
+}
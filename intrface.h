@@ -14,6 +14,11 @@
 DEFINE_GUID(GUID_DEVINTERFACE_SERIALCLONE,
     0xE705CB6F, 0x46DF, 0x4582, 0x85, 0xD2, 0x34, 0x1F, 0x4E, 0x72, 0x0E, 0x48);
 
+// WMI data block holding a SERIALCLONE_PORT_COUNTERS, see SerialClone.mof
+//  {615F0CAE-6062-4E28-89AD-C212208E6092}
+DEFINE_GUID(SERIALCLONE_WMI_COUNTERS_GUID,
+    0x615F0CAE, 0x6062, 0x4E28, 0x89, 0xAD, 0xC2, 0x12, 0x20, 0x8E, 0x60, 0x92);
+
 // GUID definition are required to be outside of header inclusion pragma to avoid
 // error during precompiled headers.
 //
@@ -29,5 +34,242 @@ DEFINE_GUID(GUID_DEVINTERFACE_SERIALCLONE,
 #define SERIALCLONE_IOCTL(index) \
     CTL_CODE(FILE_DEVICE_SERIALCLONE, index, METHOD_BUFFERED, FILE_READ_DATA)
 
+// Returns a SERIALCLONE_PORT_STATE, the whole port state in one round trip
+#define IOCTL_SERIALCLONE_GET_PORT_STATE    SERIALCLONE_IOCTL(0x800)
+
+// SERIALCLONE_PORT_STATE.Valid, which groups of fields were filled in
+#define SERIALCLONE_STATE_BAUD_RATE     0x00000001
+#define SERIALCLONE_STATE_LINE_CONTROL  0x00000002
+#define SERIALCLONE_STATE_TIMEOUTS      0x00000004
+#define SERIALCLONE_STATE_CHARS         0x00000008
+#define SERIALCLONE_STATE_HANDFLOW      0x00000010
+#define SERIALCLONE_STATE_MODEMSTATUS   0x00000020
+#define SERIALCLONE_STATE_DTRRTS        0x00000040
+#define SERIALCLONE_STATE_COMMSTATUS    0x00000080
+
+// The fields follow the SERIAL_xxx structures of ntddser.h, flattened so
+// applications can use this header without the DDK.
+typedef struct _SERIALCLONE_PORT_STATE
+{
+    ULONG   Size;                           // sizeof(SERIALCLONE_PORT_STATE)
+    ULONG   Valid;                          // SERIALCLONE_STATE_xxx
+
+    // SERIAL_BAUD_RATE
+    ULONG   BaudRate;
+
+    // SERIAL_LINE_CONTROL
+    UCHAR   StopBits;
+    UCHAR   Parity;
+    UCHAR   WordLength;
+    UCHAR   Reserved1;
+
+    // SERIAL_TIMEOUTS
+    ULONG   ReadIntervalTimeout;
+    ULONG   ReadTotalTimeoutMultiplier;
+    ULONG   ReadTotalTimeoutConstant;
+    ULONG   WriteTotalTimeoutMultiplier;
+    ULONG   WriteTotalTimeoutConstant;
+
+    // SERIAL_CHARS
+    UCHAR   EofChar;
+    UCHAR   ErrorChar;
+    UCHAR   BreakChar;
+    UCHAR   EventChar;
+    UCHAR   XonChar;
+    UCHAR   XoffChar;
+    UCHAR   Reserved2[2];
+
+    // SERIAL_HANDFLOW
+    ULONG   ControlHandShake;
+    ULONG   FlowReplace;
+    LONG    XonLimit;
+    LONG    XoffLimit;
+
+    // IOCTL_SERIAL_GET_MODEMSTATUS and IOCTL_SERIAL_GET_DTRRTS
+    ULONG   ModemStatus;
+    ULONG   DtrRts;
+
+    // SERIAL_STATUS
+    ULONG   Errors;
+    ULONG   HoldReasons;
+    ULONG   AmountInInQueue;
+    ULONG   AmountInOutQueue;
+    BOOLEAN EofReceived;
+    BOOLEAN WaitForImmediate;
+    UCHAR   Reserved3[2];
+} SERIALCLONE_PORT_STATE, *PSERIALCLONE_PORT_STATE;
+
+
+// Returns a SERIALCLONE_PORT_COUNTERS
+#define IOCTL_SERIALCLONE_GET_COUNTERS      SERIALCLONE_IOCTL(0x801)
+
+// SERIALCLONE_COUNTERS.ReadLatency, completion time of reads sent to the
+// port: under 100us, 1ms, 10ms, 100ms, 1s, and longer
+#define SERIALCLONE_LATENCY_BUCKETS     6
+
+// Counters of one consumer of the port, the owner or the clone. Fields
+// are laid out largest first to keep the WMI block naturally aligned.
+typedef struct _SERIALCLONE_COUNTERS
+{
+    ULONGLONG   BytesIn;                    // received bytes put in this consumer's buffer
+    ULONGLONG   BytesOut;                   // bytes this consumer wrote
+    ULONGLONG   OverflowBytes;              // received bytes lost to a full buffer
+    ULONGLONG   LockWaitTime;               // 100ns units spent waiting for the buffer and read list locks
+    ULONGLONG   LockHoldTime;               // 100ns units those locks were held, only with Parameters\LockTiming set
+    ULONG       ReadIrps;                   // read requests from this consumer
+    ULONG       FastReads;                  // reads satisfied from the buffer alone
+    ULONG       LowerReads;                 // reads sent down to the port
+    ULONG       WriteIrps;                  // write requests from this consumer
+    ULONG       LockAcquires;               // times the buffer and read list locks were taken
+    ULONG       LockContention;             // times one of them was found held
+    ULONG       FifoHighWater;              // most bytes ever held in the buffer
+    ULONG       BufferBytes;                // nonpaged bytes the buffer has now, 0 while not opened
+    ULONG       ReadLatency[SERIALCLONE_LATENCY_BUCKETS];
+} SERIALCLONE_COUNTERS, *PSERIALCLONE_COUNTERS;
+
+typedef struct _SERIALCLONE_PORT_COUNTERS
+{
+    ULONG                   Size;           // sizeof(SERIALCLONE_PORT_COUNTERS)
+    ULONG                   Reserved;
+    SERIALCLONE_COUNTERS    Owner;          // the filter, used by whoever opened the port itself
+    SERIALCLONE_COUNTERS    Clone;
+} SERIALCLONE_PORT_COUNTERS, *PSERIALCLONE_PORT_COUNTERS;
+
+
+// Returns the driver's binary trace: a SERIALCLONE_TRACE_HEADER, then
+// RecordsPerRing SERIALCLONE_TRACE_RECORDs for each processor. With too
+// small a buffer only the header comes back, with STATUS_BUFFER_OVERFLOW,
+// so the caller learns how much to ask for. sctrace formats the records.
+// The trace covers every port. Through the port itself it needs a caller
+// with the system profile privilege, which administrators have, and fails
+// with STATUS_ACCESS_DENIED otherwise; through the clone it comes back
+// either way, IRP addresses 0 for a caller without it.
+#define IOCTL_SERIALCLONE_GET_TRACE         SERIALCLONE_IOCTL(0x802)
+
+// SERIALCLONE_TRACE_RECORD.Event, and what Args hold for each
+#define SERIALCLONE_TRACE_READ              1   // read arrived: requested, bytes buffered
+#define SERIALCLONE_TRACE_READ_FAST         2   // read satisfied from the buffer: length
+#define SERIALCLONE_TRACE_READ_LOWER        3   // read sent to the port: requested, sent, already pending
+#define SERIALCLONE_TRACE_READ_COMPLETE     4   // port read came back: status, received, returned
+#define SERIALCLONE_TRACE_READ_UNORDERED    5   // that read was not the oldest one outstanding
+#define SERIALCLONE_TRACE_FIFO_WRITE        6   // received data buffered: length, size before, size after
+#define SERIALCLONE_TRACE_WRITE             7   // write arrived: length, status
+#define SERIALCLONE_TRACE_WAIT_EVENT        8   // wait on mask completed: events
+#define SERIALCLONE_TRACE_REJECTED          9   // IRP failed on the way in: major function, status
+#define SERIALCLONE_TRACE_DEBUG_DROPPED     10  // debug message lost, every buffer busy
+#define SERIALCLONE_TRACE_READ_ABORT        11  // read at the port cancelled by the device's PURGE_RXABORT
+
+// SERIALCLONE_TRACE_RECORD.Device
+#define SERIALCLONE_TRACE_DRIVER            0   // not about one device
+#define SERIALCLONE_TRACE_FILTER            1
+#define SERIALCLONE_TRACE_CLONE             2
+
+typedef struct _SERIALCLONE_TRACE_RECORD
+{
+    ULONGLONG   Time;                       // system interrupt time, 100ns units
+    ULONGLONG   Irp;                        // IRP address, 0 for none or for a caller without the privilege
+    ULONG       Sequence;                   // per processor from 1, 0 for a record never written
+    USHORT      Event;                      // SERIALCLONE_TRACE_xxx
+    UCHAR       Device;                     // SERIALCLONE_TRACE_FILTER or _CLONE
+    UCHAR       Irql;
+    ULONG       Instance;                   // port, as in \Device\SerialCloneDevice<n>
+    ULONG       Args[3];
+} SERIALCLONE_TRACE_RECORD, *PSERIALCLONE_TRACE_RECORD;
+
+typedef struct _SERIALCLONE_TRACE_HEADER
+{
+    ULONG       Size;                       // sizeof(SERIALCLONE_TRACE_HEADER)
+    ULONG       RecordSize;                 // sizeof(SERIALCLONE_TRACE_RECORD)
+    ULONG       Processors;                 // rings that follow, 0 when tracing is off
+    ULONG       RecordsPerRing;             // Parameters\TraceRecords, rounded to a power of 2
+} SERIALCLONE_TRACE_HEADER, *PSERIALCLONE_TRACE_HEADER;
+
+
+// Returns a SERIALCLONE_PORT_LATENCY. With SERIALCLONE_LATENCY_RESET in a
+// ULONG of input the histograms are cleared as they are read, so a count
+// made in between is neither lost nor returned twice. A reset through the
+// port itself, rather than its clone, takes a caller with the system
+// profile privilege and fails with STATUS_ACCESS_DENIED otherwise. The
+// histograms are only kept with the driver's Parameters\LatencyHistograms
+// set, without it they are all zero.
+#define IOCTL_SERIALCLONE_GET_LATENCY       SERIALCLONE_IOCTL(0x803)
+
+#define SERIALCLONE_LATENCY_RESET           0x00000001
+
+// SERIALCLONE_LATENCY.Counts first index, the kind of request
+#define SERIALCLONE_LATENCY_READ            0
+#define SERIALCLONE_LATENCY_WRITE           1
+#define SERIALCLONE_LATENCY_IOCTL           2
+#define SERIALCLONE_LATENCY_MAJORS          3
+
+// second index, the part of the request's life being timed. Requests the
+// port never sees, such as reads from the buffer, only count in TOTAL.
+#define SERIALCLONE_LATENCY_DISPATCH        0   // arrival to being passed to the port, pacing included
+#define SERIALCLONE_LATENCY_COMPLETION      1   // port completion to ours
+#define SERIALCLONE_LATENCY_TOTAL           2   // arrival to completion
+#define SERIALCLONE_LATENCY_PHASES          3
+
+// Log-linear buckets of SERIALCLONE_PORT_LATENCY.Frequency ticks. Below
+// SERIALCLONE_HISTOGRAM_LINEAR bucket b is exactly b ticks; above it each
+// power of 2 is split into SERIALCLONE_HISTOGRAM_LINEAR equal buckets,
+// so no bucket is wider than a quarter of its lower edge. The first tick
+// count in bucket b is SERIALCLONE_HISTOGRAM_LOW(b).
+#define SERIALCLONE_HISTOGRAM_SUB_BITS      2
+#define SERIALCLONE_HISTOGRAM_LINEAR        (1 << SERIALCLONE_HISTOGRAM_SUB_BITS)
+#define SERIALCLONE_HISTOGRAM_BUCKETS       ((32 - SERIALCLONE_HISTOGRAM_SUB_BITS + 1) * SERIALCLONE_HISTOGRAM_LINEAR)
+
+#define SERIALCLONE_HISTOGRAM_LOW(b) \
+    (((b) < SERIALCLONE_HISTOGRAM_LINEAR) ? (ULONG)(b) : \
+     (ULONG)(SERIALCLONE_HISTOGRAM_LINEAR + ((b) & (SERIALCLONE_HISTOGRAM_LINEAR - 1))) << \
+        ((b) / SERIALCLONE_HISTOGRAM_LINEAR - 1))
+
+typedef struct _SERIALCLONE_LATENCY
+{
+    ULONG       Counts[SERIALCLONE_LATENCY_MAJORS][SERIALCLONE_LATENCY_PHASES][SERIALCLONE_HISTOGRAM_BUCKETS];
+} SERIALCLONE_LATENCY, *PSERIALCLONE_LATENCY;
+
+typedef struct _SERIALCLONE_PORT_LATENCY
+{
+    ULONG                   Size;           // sizeof(SERIALCLONE_PORT_LATENCY)
+    ULONG                   Frequency;      // histogram ticks per second
+    SERIALCLONE_LATENCY     Owner;          // the filter, used by whoever opened the port itself
+    SERIALCLONE_LATENCY     Clone;
+} SERIALCLONE_PORT_LATENCY, *PSERIALCLONE_PORT_LATENCY;
+
+
+// Drains the sampled capture of received and written data: a
+// SERIALCLONE_CAPTURE_HEADER, then Records slots of SlotSize bytes, each a
+// SERIALCLONE_CAPTURE_RECORD and its data, oldest first. Each port has its
+// own ring, drained only through the port's clone (\\.\COM30 for COM3);
+// the port itself refuses it. Records returned are gone from the ring; as
+// many as fit in the buffer come back, the rest wait for the next call.
+// Parameters\CaptureEvery turns sampling on.
+#define IOCTL_SERIALCLONE_GET_CAPTURE       SERIALCLONE_IOCTL(0x804)
+
+// SERIALCLONE_CAPTURE_RECORD.Direction
+#define SERIALCLONE_CAPTURE_RX              0   // read from the port
+#define SERIALCLONE_CAPTURE_TX              1   // written to the port
+
+typedef struct _SERIALCLONE_CAPTURE_RECORD
+{
+    ULONGLONG   Time;                       // system time, 100ns units since 1601 UTC
+    ULONG       Sequence;                   // sample number from 1, a gap is samples overwritten before being drained
+    ULONG       Instance;                   // port, as in \Device\SerialCloneDevice<n>
+    ULONG       Length;                     // bytes the port returned, or the consumer wrote
+    USHORT      Captured;                   // of those, bytes in Data
+    UCHAR       Device;                     // SERIALCLONE_TRACE_FILTER or _CLONE, whose read or write it was
+    UCHAR       Direction;                  // SERIALCLONE_CAPTURE_RX or _TX
+    UCHAR       Data[1];                    // first Captured bytes, the slot has room for Parameters\CaptureBytes
+} SERIALCLONE_CAPTURE_RECORD, *PSERIALCLONE_CAPTURE_RECORD;
+
+typedef struct _SERIALCLONE_CAPTURE_HEADER
+{
+    ULONG       Size;                       // sizeof(SERIALCLONE_CAPTURE_HEADER)
+    ULONG       SlotSize;                   // bytes from one record to the next, 0 when capture is off
+    ULONG       Records;                    // records that follow
+    ULONG       Dropped;                    // overwritten before anyone drained them, since the last call
+    ULONG       Instance;                   // port the call came in on, as in SERIALCLONE_CAPTURE_RECORD
+    ULONG       Reserved;
+} SERIALCLONE_CAPTURE_HEADER, *PSERIALCLONE_CAPTURE_HEADER;
 
 #endif // __INTRFACE_H__
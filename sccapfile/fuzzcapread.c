@@ -0,0 +1,134 @@
+// fuzzcapread.c
+//
+// A fuzz target for the capture file reader, sccapread.c: an input is a
+// capture file, header, records, index points, segments and footer all
+// as they come. It is opened and read from the start to where the reader
+// stops, then sought to the times of the records read and of the index
+// entries, to just before and after each and to either end of time. The
+// reader may refuse any of it, but only by saying so: every record it
+// hands out has to lie in the file or in the segment just unpacked, and
+// the first record after a seek mustn't be earlier than the time sought.
+// The file is mapped, so the checks stand in for the sanitizer there.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sccapfile.h"
+
+#define FUZZCAPREAD_TIMES		64		// times sought to, at most
+
+static char			FuzzCapReadPath[] = "/tmp/fuzzcapreadXXXXXX";
+static int			FuzzCapReadFd = -1;
+
+static void FuzzCapReadFatal(const char * What, SCCAP_UINT64 Value)
+{
+	fprintf(stderr, "fuzzcapread: %s, %llu\n", What, Value);
+	abort();
+}
+
+static void FuzzCapReadRemove(void)
+{
+	unlink(FuzzCapReadPath);
+}
+
+// the record lies in the mapping or the segment cache
+static void FuzzCapReadCheck(const SCCAP_FILE * File, const SCCAP_RECORD * Record)
+{
+	const unsigned char *	data;
+	const SCCAP_CACHE *		cache;
+
+	data = Record->Data;
+	cache = File->Cache;
+	if((data >= File->Base) && (data <= File->Base + File->End) &&
+		(Record->Length <= (SCCAP_UINT64)(File->Base + File->End - data)))
+	{
+		return;
+	}
+	if((cache->Segment != 0) && (data >= cache->Data) && (data <= cache->Data + cache->Length) &&
+		(Record->Length <= (SCCAP_UINT64)(cache->Data + cache->Length - data)))
+	{
+		return;
+	}
+	FuzzCapReadFatal("record outside the file and the segment", Record->Length);
+}
+
+// seeks and looks at what is there
+static void FuzzCapReadSeek(const SCCAP_FILE * File, SCCAP_UINT64 Time)
+{
+	SCCAP_CURSOR	cursor;
+	SCCAP_RECORD	record;
+
+	if(SCCapSeek(File, Time, &cursor) != SCCAP_OK)
+		return;
+	if(SCCapNext(File, &cursor, &record) != SCCAP_OK)
+		return;
+
+	FuzzCapReadCheck(File, &record);
+	if(record.Time < Time)
+		FuzzCapReadFatal("seek found a record earlier than the time", Time);
+}
+
+int LLVMFuzzerTestOneInput(const unsigned char * Data, size_t Size)
+{
+	SCCAP_FILE			file;
+	SCCAP_CURSOR		cursor;
+	SCCAP_RECORD		record;
+	SCCAP_INDEX_ENTRY	entry;
+	SCCAP_UINT64		times[FUZZCAPREAD_TIMES];
+	SCCAP_UINT64		i;
+	unsigned int		count;
+	unsigned int		t;
+	int					result;
+
+	if(FuzzCapReadFd < 0)
+	{
+		FuzzCapReadFd = mkstemp(FuzzCapReadPath);
+		if(FuzzCapReadFd < 0)
+			FuzzCapReadFatal("can't make a file in /tmp", 0);
+		atexit(FuzzCapReadRemove);
+	}
+	if((ftruncate(FuzzCapReadFd, 0) != 0) || (pwrite(FuzzCapReadFd, Data, Size, 0) != (ssize_t)Size))
+		FuzzCapReadFatal("can't write the file", Size);
+
+	if(SCCapOpen(&file, FuzzCapReadPath) != SCCAP_OK)
+		return 0;
+
+	count = 0;
+	SCCapRewind(&file, &cursor);
+	while((result = SCCapNext(&file, &cursor, &record)) == SCCAP_OK)
+	{
+		FuzzCapReadCheck(&file, &record);
+		if(count < FUZZCAPREAD_TIMES / 2)
+			times[count++] = record.Time;
+	}
+	if((result != SCCAP_END) && (result != SCCAP_ERROR_TRUNCATED) && (result != SCCAP_ERROR_FORMAT) &&
+		(result != SCCAP_ERROR_OPEN))
+	{
+		FuzzCapReadFatal("reading stopped with no reason", (SCCAP_UINT64)result);
+	}
+
+	for(i = 0; (i < file.Trailer.IndexEntries) && (count < FUZZCAPREAD_TIMES); i++)
+	{
+		memcpy(&entry, file.Base + file.Trailer.IndexOffset + i * sizeof(SCCAP_INDEX_ENTRY), sizeof(entry));
+		times[count++] = entry.Time;
+	}
+
+	FuzzCapReadSeek(&file, 0);
+	FuzzCapReadSeek(&file, ~(SCCAP_UINT64)0);
+	for(t = 0; t < count; t++)
+	{
+		FuzzCapReadSeek(&file, times[t] - 1);
+		FuzzCapReadSeek(&file, times[t]);
+		FuzzCapReadSeek(&file, times[t] + 1);
+	}
+
+	SCCapClose(&file);
+	return 0;
+}
@@ -0,0 +1,99 @@
+// fuzzlz.c
+//
+// A fuzz target for the codec capture segments are compressed with,
+// sccaplz.c. An input is taken two ways. As data: compressed with room to
+// spare and with less room than the data, as the writer does, the block
+// has to come back to the data exactly, or not be made at all when room
+// is short. As a block: the first two bytes, little endian, the length it
+// claims to come to, the rest the block; decompressed into a buffer of
+// exactly that length it may fail, but only by saying so, and what it
+// makes has to compress and come back again. Every buffer is exactly its
+// size so reading or writing past one is the sanitizer's to catch.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sccaplz.h"
+
+// bytes a block of Length bytes of data can take, all of it literals
+#define FuzzLzBound(Length)		((Length) + (Length) / 255 + 16)
+
+static void FuzzLzFatal(const char * What, size_t Size)
+{
+	fprintf(stderr, "fuzzlz: %s, %lu bytes\n", What, (unsigned long)Size);
+	abort();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  FuzzLzRoundTrip
+//      Compresses data and decompresses the block again
+//
+//  Arguments:
+//      IN  Data
+//              the data
+//
+//      IN  Size
+//              bytes of it
+//
+//      IN  Room
+//              room the block is given
+//
+//  Return Value:
+//      None, stops the run if the data doesn't come back
+//
+static void FuzzLzRoundTrip(const unsigned char * Data, size_t Size, size_t Room)
+{
+	unsigned char *	block;
+	unsigned char *	back;
+	size_t			length;
+
+	block = malloc((Room > 0) ? Room : 1);
+	back = malloc((Size > 0) ? Size : 1);
+	if((block == NULL) || (back == NULL))
+		FuzzLzFatal("no memory", Size);
+
+	length = SCCapLzCompress(Data, Size, block, Room);
+	if(length > Room)
+		FuzzLzFatal("block longer than its room", Size);
+	if((length == 0) && (Room >= FuzzLzBound(Size)))
+		FuzzLzFatal("no block with room to spare", Size);
+
+	if((length != 0) &&
+		((SCCapLzDecompress(block, length, back, Size) != 0) || (memcmp(back, Data, Size) != 0)))
+	{
+		FuzzLzFatal("block didn't come back to the data", Size);
+	}
+
+	free(back);
+	free(block);
+}
+
+int LLVMFuzzerTestOneInput(const unsigned char * Data, size_t Size)
+{
+	unsigned char *	out;
+	size_t			outLength;
+
+	FuzzLzRoundTrip(Data, Size, FuzzLzBound(Size));
+	if(Size > 0)
+		FuzzLzRoundTrip(Data, Size, Size - 1);
+
+	if(Size < 2)
+		return 0;
+
+	outLength = Data[0] | ((size_t)Data[1] << 8);
+	out = malloc((outLength > 0) ? outLength : 1);
+	if(out == NULL)
+		FuzzLzFatal("no memory", outLength);
+
+	if(SCCapLzDecompress(Data + 2, Size - 2, out, outLength) == 0)
+		FuzzLzRoundTrip(out, outLength, FuzzLzBound(outLength));
+
+	free(out);
+	return 0;
+}
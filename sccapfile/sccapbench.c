@@ -0,0 +1,564 @@
+// sccapbench.c
+//
+// Times the capture file library on this machine and its disk. A capture
+// of -s MB of records is written plain, then compressed, and each is read
+// back whole twice: first from the disk, its pages dropped from the
+// cache, then again from the cache. Then for every size in -k a capture
+// that size is written plain and compressed and sought in at random
+// times, -n seeks from the cache and, opening it afresh after dropping
+// its pages each time, a few from the disk. Records are what sccapture
+// writes of a busy port: -z bytes of NMEA text with its numbers changing,
+// 50 to 150 microseconds apart, one in four written to the port.
+//
+//	sccapbench [options]
+//
+//	-d dir			where the captures go, /tmp by default; each is removed
+//					once timed
+//	-s MB			the capture written and read, 4096 by default, 0 for none
+//	-k MB,...		the captures sought in, 16,256,4096 by default, 0 for none
+//	-z N			bytes a record, 64 by default
+//	-i N			records an index point or segment, 1024 by default
+//	-n N			seeks in a capture from the cache, 100000 by default; a
+//					hundredth as many from the disk
+//	-S N			the seed for the seeks, 1 by default
+//
+// Write and read lines have the records' MB and the file's, then records,
+// the records' MB and the file's MB a second: written to the cache, until
+// SCCapFinish returned, and to the disk, until fsync did; read by
+// SCCapNext from the disk and from the cache. A seek line has the
+// records and index entries of the capture, the p50, p99 and mean
+// microseconds of an SCCapSeek and the SCCapNext after it from the
+// cache, and the p50 and p99 of opening the capture, seeking and reading
+// the record from the disk.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sccapfile.h"
+
+#define SCCAPBENCH_LIST_MAX		16
+#define SCCAPBENCH_POOL			(1 << 20)	// the text records take theirs from
+#define SCCAPBENCH_MB			(1024.0 * 1024.0)
+
+// a capture as written
+typedef struct _SCCAPBENCH_CAPTURE
+{
+	SCCAP_UINT64	Records;
+	SCCAP_UINT64	Bytes;				// of records, headers and payloads, as a plain file has them
+	SCCAP_UINT64	FileBytes;
+	SCCAP_UINT64	FirstTime;
+	SCCAP_UINT64	LastTime;
+	double			Written;			// seconds until SCCapFinish returned
+	double			Synced;				// and until fsync did
+} SCCAPBENCH_CAPTURE;
+
+static unsigned char	SCCapBenchPool[SCCAPBENCH_POOL];
+static SCCAP_UINT64		SCCapBenchState;
+
+static unsigned int SCCapBenchRandom(void)
+{
+	SCCapBenchState ^= SCCapBenchState << 13;
+	SCCapBenchState ^= SCCapBenchState >> 7;
+	SCCapBenchState ^= SCCapBenchState << 17;
+	return (unsigned int)(SCCapBenchState >> 32);
+}
+
+static double SCCapBenchNow(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int SCCapBenchCompare(const void * a, const void * b)
+{
+	double	x = *(const double *)a;
+	double	y = *(const double *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+// a percentile of sorted seconds, in microseconds
+static double SCCapBenchPercentile(const double * Sorted, unsigned int Count, double Percent)
+{
+	unsigned int	i;
+
+	i = (unsigned int)(Percent / 100 * Count);
+	if(i >= Count)
+		i = Count - 1;
+	return Sorted[i] * 1e6;
+}
+
+// drops a capture's pages from the cache; they must not be mapped
+static void SCCapBenchDrop(const char * Path)
+{
+	int	fd;
+
+	fd = open(Path, O_RDONLY);
+	if(fd >= 0)
+	{
+		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+		close(fd);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapBenchWrite
+//      Writes a capture of records and syncs it to the disk
+//
+//  Arguments:
+//      IN  Path
+//              where it goes
+//
+//      IN  Bytes
+//              of records to write, headers and payloads
+//
+//      IN  RecordSize
+//              payload bytes a record
+//
+//      IN  Compress
+//              nonzero for segments
+//
+//      IN  IndexEvery
+//              records an index point or segment
+//
+//      OUT Capture
+//              receives what was written and how long it took
+//
+//  Return Value:
+//      SCCAP_OK or what the writer failed with
+//
+static int SCCapBenchWrite(const char * Path, SCCAP_UINT64 Bytes, unsigned int RecordSize, int Compress,
+	unsigned int IndexEvery, SCCAPBENCH_CAPTURE * Capture)
+{
+	SCCAP_FILE_HEADER	header;
+	SCCAP_WRITER		writer;
+	SCCAP_UINT64		time;
+	SCCAP_UINT64		delta;
+	SCCAP_UINT64		offset;
+	SCCAP_UINT64		bytes;
+	double				start;
+	int					result;
+	int					fd;
+
+	memset(Capture, 0, sizeof(SCCAPBENCH_CAPTURE));
+	memset(&header, 0, sizeof(header));
+	header.StartTime = 127000000000000000ULL;
+	header.BaudRate = 3000000;
+
+	unlink(Path);
+	result = SCCapCreate(&writer, Path, &header);
+	if(result != SCCAP_OK)
+		return result;
+	writer.Compress = Compress;
+	writer.IndexEvery = IndexEvery;
+
+	// a record header is Kind, a delta of a byte or two and a length
+	start = SCCapBenchNow();
+	time = header.StartTime;
+	offset = 0;
+	bytes = 0;
+	Capture->FirstTime = time + 500;
+	while(bytes < Bytes)
+	{
+		delta = 500 + SCCapBenchRandom() % 1000;
+		time += delta;
+		result = SCCapAppend(&writer, time, (Capture->Records % 4 == 3) ? SCCAP_RECORD_TX : 0,
+			SCCapBenchPool + offset, RecordSize, RecordSize);
+		if(result != SCCAP_OK)
+		{
+			SCCapFinish(&writer);
+			return result;
+		}
+
+		offset = (offset + 4099) % (SCCAPBENCH_POOL - RecordSize);
+		bytes += 1 + ((delta < 128) ? 1 : 2) + ((RecordSize < 128) ? 1 : 2) + RecordSize;
+		Capture->Records++;
+	}
+
+	result = SCCapFinish(&writer);
+	Capture->Written = SCCapBenchNow() - start;
+	Capture->Bytes = bytes;
+	Capture->LastTime = time;
+	if(result != SCCAP_OK)
+		return result;
+
+	fd = open(Path, O_RDONLY);
+	if((fd < 0) || (fsync(fd) != 0))
+		result = SCCAP_ERROR_WRITE;
+	if(fd >= 0)
+	{
+		Capture->FileBytes = (SCCAP_UINT64)lseek(fd, 0, SEEK_END);
+		close(fd);
+	}
+	Capture->Synced = SCCapBenchNow() - start;
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapBenchScan
+//      Reads a capture through once
+//
+//  Arguments:
+//      IN  File
+//              the capture, open
+//
+//      IN  Capture
+//              as written, to check what was read against
+//
+//  Return Value:
+//      Seconds it took, or a negative number if the records didn't all
+//      read back
+//
+static double SCCapBenchScan(const SCCAP_FILE * File, const SCCAPBENCH_CAPTURE * Capture)
+{
+	SCCAP_CURSOR	cursor;
+	SCCAP_RECORD	record;
+	SCCAP_UINT64	records;
+	unsigned int	sum;
+	double			start;
+	int				result;
+
+	// a byte of every record, so its data is read too
+	start = SCCapBenchNow();
+	records = 0;
+	sum = 0;
+	SCCapRewind(File, &cursor);
+	while((result = SCCapNext(File, &cursor, &record)) == SCCAP_OK)
+	{
+		sum += record.Data[record.Length / 2];
+		records++;
+	}
+
+	if((result != SCCAP_END) || (records != Capture->Records) || (sum == 0))
+		return -1;
+	return SCCapBenchNow() - start;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapBenchReadWrite
+//      Writes a capture, reads it from the disk and the cache, prints its
+//      lines and removes it
+//
+//  Arguments:
+//      IN  Path
+//              where it goes
+//
+//      IN  Megabytes
+//              of records
+//
+//      IN  RecordSize
+//              payload bytes a record
+//
+//      IN  Compress
+//              nonzero for segments
+//
+//      IN  IndexEvery
+//              records an index point or segment
+//
+//  Return Value:
+//      0, or 1 if the capture couldn't be written or read back
+//
+static int SCCapBenchReadWrite(const char * Path, unsigned int Megabytes, unsigned int RecordSize, int Compress,
+	unsigned int IndexEvery)
+{
+	SCCAPBENCH_CAPTURE	capture;
+	SCCAP_FILE			file;
+	double				cold;
+	double				warm;
+	double				mb;
+	double				fileMb;
+	int					result;
+
+	result = SCCapBenchWrite(Path, (SCCAP_UINT64)Megabytes << 20, RecordSize, Compress, IndexEvery, &capture);
+	if(result != SCCAP_OK)
+	{
+		fprintf(stderr, "sccapbench: can't write %s, %d\n", Path, result);
+		unlink(Path);
+		return 1;
+	}
+
+	mb = capture.Bytes / SCCAPBENCH_MB;
+	fileMb = capture.FileBytes / SCCAPBENCH_MB;
+	printf("%-10s %-5s %9.0f %9.0f %11.0f %9.0f %9.0f  cache\n", Compress ? "compressed" : "plain", "write",
+		mb, fileMb, capture.Records / capture.Written, mb / capture.Written, fileMb / capture.Written);
+	printf("%-10s %-5s %9.0f %9.0f %11.0f %9.0f %9.0f  disk\n", "", "write", mb, fileMb,
+		capture.Records / capture.Synced, mb / capture.Synced, fileMb / capture.Synced);
+
+	SCCapBenchDrop(Path);
+	cold = -1;
+	warm = -1;
+	if(SCCapOpen(&file, Path) == SCCAP_OK)
+	{
+		cold = SCCapBenchScan(&file, &capture);
+		warm = SCCapBenchScan(&file, &capture);
+		SCCapClose(&file);
+	}
+	unlink(Path);
+
+	if((cold < 0) || (warm < 0))
+	{
+		fprintf(stderr, "sccapbench: %s didn't read back\n", Path);
+		return 1;
+	}
+
+	printf("%-10s %-5s %9.0f %9.0f %11.0f %9.0f %9.0f  disk\n", "", "read", mb, fileMb,
+		capture.Records / cold, mb / cold, fileMb / cold);
+	printf("%-10s %-5s %9.0f %9.0f %11.0f %9.0f %9.0f  cache\n", "", "read", mb, fileMb,
+		capture.Records / warm, mb / warm, fileMb / warm);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapBenchSeek
+//      Writes a capture, seeks in it from the cache and from the disk,
+//      prints its line and removes it
+//
+//  Arguments:
+//      IN  Path
+//              where it goes
+//
+//      IN  Megabytes
+//              of records
+//
+//      IN  RecordSize
+//              payload bytes a record
+//
+//      IN  Compress
+//              nonzero for segments
+//
+//      IN  IndexEvery
+//              records an index point or segment
+//
+//      IN  Seeks
+//              from the cache, a hundredth as many from the disk
+//
+//  Return Value:
+//      0, or 1 if the capture couldn't be written or a seek failed
+//
+static int SCCapBenchSeek(const char * Path, unsigned int Megabytes, unsigned int RecordSize, int Compress,
+	unsigned int IndexEvery, unsigned int Seeks)
+{
+	SCCAPBENCH_CAPTURE	capture;
+	SCCAP_FILE			file;
+	SCCAP_CURSOR		cursor;
+	SCCAP_RECORD		record;
+	SCCAP_UINT64		time;
+	SCCAP_UINT64		span;
+	double *			hot;
+	double *			cold;
+	double				start;
+	double				total;
+	unsigned int		coldSeeks;
+	unsigned int		i;
+	int					result;
+
+	result = SCCapBenchWrite(Path, (SCCAP_UINT64)Megabytes << 20, RecordSize, Compress, IndexEvery, &capture);
+	if(result != SCCAP_OK)
+	{
+		fprintf(stderr, "sccapbench: can't write %s, %d\n", Path, result);
+		unlink(Path);
+		return 1;
+	}
+
+	coldSeeks = (Seeks + 99) / 100;
+	hot = malloc(Seeks * sizeof(double));
+	cold = malloc(coldSeeks * sizeof(double));
+	if((hot == NULL) || (cold == NULL) || (SCCapOpen(&file, Path) != SCCAP_OK))
+	{
+		fprintf(stderr, "sccapbench: can't open %s\n", Path);
+		unlink(Path);
+		return 1;
+	}
+
+	// the whole capture in the cache first
+	SCCapBenchScan(&file, &capture);
+
+	span = capture.LastTime - capture.FirstTime + 1;
+	total = 0;
+	result = SCCAP_OK;
+	for(i = 0; (i < Seeks) && (result == SCCAP_OK); i++)
+	{
+		time = capture.FirstTime + (((SCCAP_UINT64)SCCapBenchRandom() << 32) | SCCapBenchRandom()) % span;
+
+		start = SCCapBenchNow();
+		result = SCCapSeek(&file, time, &cursor);
+		if(result == SCCAP_OK)
+			result = SCCapNext(&file, &cursor, &record);
+		hot[i] = SCCapBenchNow() - start;
+		total += hot[i];
+
+		if((result == SCCAP_OK) && (record.Time < time))
+			result = SCCAP_ERROR_FORMAT;
+	}
+	printf("%-10s %9u %11llu %9llu ", Compress ? "compressed" : "plain", Megabytes, capture.Records,
+		file.Trailer.IndexEntries);
+	SCCapClose(&file);
+
+	for(i = 0; (i < coldSeeks) && (result == SCCAP_OK); i++)
+	{
+		time = capture.FirstTime + (((SCCAP_UINT64)SCCapBenchRandom() << 32) | SCCapBenchRandom()) % span;
+		SCCapBenchDrop(Path);
+
+		start = SCCapBenchNow();
+		result = SCCapOpen(&file, Path);
+		if(result == SCCAP_OK)
+		{
+			result = SCCapSeek(&file, time, &cursor);
+			if(result == SCCAP_OK)
+				result = SCCapNext(&file, &cursor, &record);
+			cold[i] = SCCapBenchNow() - start;
+			SCCapClose(&file);
+		}
+	}
+	unlink(Path);
+
+	if(result != SCCAP_OK)
+	{
+		printf("\n");
+		fprintf(stderr, "sccapbench: a seek in %s failed, %d\n", Path, result);
+		free(cold);
+		free(hot);
+		return 1;
+	}
+
+	qsort(hot, Seeks, sizeof(double), SCCapBenchCompare);
+	qsort(cold, coldSeeks, sizeof(double), SCCapBenchCompare);
+	printf("%9.2f %9.2f %9.2f %9.0f %9.0f\n", SCCapBenchPercentile(hot, Seeks, 50),
+		SCCapBenchPercentile(hot, Seeks, 99), total / Seeks * 1e6,
+		SCCapBenchPercentile(cold, coldSeeks, 50), SCCapBenchPercentile(cold, coldSeeks, 99));
+
+	free(cold);
+	free(hot);
+	return 0;
+}
+
+// a comma separated list of numbers, 0 alone for none
+static int SCCapBenchList(char * Text, unsigned int * List)
+{
+	int		count;
+	char *	next;
+
+	for(count = 0; (count < SCCAPBENCH_LIST_MAX) && (*Text != 0); count++)
+	{
+		List[count] = (unsigned int)strtoul(Text, &next, 0);
+		if((next == Text) || ((*next != ',') && (*next != 0)))
+			return -1;
+		Text = (*next == ',') ? next + 1 : next;
+	}
+	if(*Text != 0)
+		return -1;
+	return ((count == 1) && (List[0] == 0)) ? 0 : count;
+}
+
+static void SCCapBenchUsage(void)
+{
+	fprintf(stderr, "usage: sccapbench [-d dir] [-s MB] [-k MB,...] [-z bytes] [-i records] [-n seeks] [-S seed]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	unsigned int	sizes[SCCAPBENCH_LIST_MAX] = { 16, 256, 4096 };
+	const char *	directory;
+	char			path[4096];
+	unsigned int	megabytes;
+	unsigned int	recordSize;
+	unsigned int	indexEvery;
+	unsigned int	seeks;
+	unsigned int	i;
+	int				sizeCount;
+	int				compress;
+	int				result;
+	int				bad;
+
+	directory = "/tmp";
+	megabytes = 4096;
+	sizeCount = 3;
+	recordSize = 64;
+	indexEvery = SCCAP_DEFAULT_INDEX_EVERY;
+	seeks = 100000;
+	SCCapBenchState = 1;
+	bad = 0;
+
+	for(i = 1; (i < (unsigned int)argc) && !bad; i++)
+	{
+		if(i + 1 == (unsigned int)argc)
+			bad = 1;
+		else if(!strcmp(argv[i], "-d"))
+			directory = argv[++i];
+		else if(!strcmp(argv[i], "-s"))
+			megabytes = (unsigned int)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-k"))
+			bad = (sizeCount = SCCapBenchList(argv[++i], sizes)) < 0;
+		else if(!strcmp(argv[i], "-z"))
+			recordSize = (unsigned int)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-i"))
+			indexEvery = (unsigned int)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-n"))
+			seeks = (unsigned int)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-S"))
+			SCCapBenchState = strtoull(argv[++i], NULL, 0);
+		else
+			bad = 1;
+	}
+
+	for(i = 0; i < (unsigned int)sizeCount; i++)
+		if(sizes[i] == 0)
+			bad = 1;
+	if(bad || (recordSize == 0) || (recordSize > 4096) || (indexEvery == 0) || (seeks == 0) ||
+		(SCCapBenchState == 0))
+	{
+		SCCapBenchUsage();
+		return 2;
+	}
+
+	// text with its numbers changing, lines of about a fix
+	for(i = 0; i < SCCAPBENCH_POOL; i++)
+	{
+		if(i % 72 == 70)
+			SCCapBenchPool[i] = '\r';
+		else if(i % 72 == 71)
+			SCCapBenchPool[i] = '\n';
+		else if(i % 6 == 0)
+			SCCapBenchPool[i] = ',';
+		else
+			SCCapBenchPool[i] = (unsigned char)('0' + (i / 72 * 7 + i % 6 + SCCapBenchRandom() % 2) % 10);
+	}
+
+	snprintf(path, sizeof(path), "%s/sccapbench-%d.scap", directory, (int)getpid());
+	printf("# %u byte records, %u an index point or segment, in %s\n", recordSize, indexEvery, directory);
+
+	result = 0;
+	if(megabytes != 0)
+	{
+		printf("%-10s %-5s %9s %9s %11s %9s %9s\n", "capture", "", "MB", "file MB", "records/s", "MB/s",
+			"file MB/s");
+		for(compress = 0; compress <= 1; compress++)
+			result |= SCCapBenchReadWrite(path, megabytes, recordSize, compress, indexEvery);
+	}
+
+	if(sizeCount != 0)
+	{
+		printf("%-10s %9s %11s %9s %9s %9s %9s %9s %9s\n", "capture", "MB", "records", "index",
+			"p50 us", "p99 us", "mean us", "disk p50", "disk p99");
+		for(i = 0; i < (unsigned int)sizeCount; i++)
+			for(compress = 0; compress <= 1; compress++)
+				result |= SCCapBenchSeek(path, sizes[i], recordSize, compress, indexEvery, seeks);
+	}
+
+	return result;
+}
@@ -0,0 +1,243 @@
+// sccapfile.h
+//
+// SerialClone capture files, recordings of a port meant to be kept for
+// hours and replayed later. A capture file is append only:
+//
+//	SCCAP_FILE_HEADER			port and settings, written once at creation
+//	record, record, ...			one per read from or write to the port, with
+//								an index point every IndexEvery records
+//	footer						the index of those points, written on finishing
+//
+// or, written compressed, the records grouped IndexEvery at a time into
+// segments in place of the index points:
+//
+//	SCCAP_FILE_HEADER
+//	segment, segment, ...
+//	footer						the index of the segments
+//
+// Each record is
+//
+//	UCHAR		Kind			SCCAP_RECORD_xxx
+//	varint		TimeDelta		100ns units since the previous record, the first
+//								since StartTime
+//	varint		Length			payload bytes that follow
+//	varint		Original		only with SCCAP_RECORD_TRUNCATED, bytes the port
+//								actually moved
+//	UCHAR		Payload[Length]
+//
+// An index point is
+//
+//	UCHAR		Kind			SCCAP_BLOCK_INDEX
+//	varint		Time			system time the next record's delta adds to
+//	varint		Record			records before this point
+//
+// so reading can start at any of them. A segment is
+//
+//	UCHAR		Kind			SCCAP_BLOCK_SEGMENT
+//	varint		Time			system time the first record's delta adds to
+//	varint		Record			records before this segment
+//	varint		Records			records in it
+//	UCHAR		Method			SCCAP_SEGMENT_xxx
+//	varint		RawLength		bytes of records
+//	varint		PackedLength	bytes that follow
+//	UCHAR		Packed[PackedLength]
+//
+// the records, compressed on their own so any segment can be read without
+// the ones before it. The footer is
+//
+//	UCHAR		Kind			SCCAP_BLOCK_FOOTER
+//	SCCAP_INDEX_ENTRY	[n]		one per index point, in file order
+//	SCCAP_FILE_TRAILER			where the entries are, at the very end
+//
+// and lets the reader find the point or segment before any time with a
+// binary search, leaving at most IndexEvery records to step through.
+//
+// A varint is the value 7 bits at a time, low bits first, with the top bit
+// of each byte set when another follows. Everything is little endian. A
+// writer that dies leaves no footer and at worst a cut short last record,
+// which the reader reports and stops before; seeking such a file steps
+// through it from the start. A compressing writer that dies loses the
+// segment it was filling too.
+//
+// The reader maps the whole file, so a capture larger than the address
+// space can only be read by a 64 bit build.
+//
+// Plain C with standard types only, so the driver's tools, Windows
+// applications and anything on Linux, C or C++, can use it as it is.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCCAPFILE_H__
+#define __SCCAPFILE_H__
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef _MSC_VER
+typedef unsigned __int64	SCCAP_UINT64;
+#else
+typedef unsigned long long	SCCAP_UINT64;
+#endif
+
+#define SCCAP_MAGIC			"SCAP"
+#define SCCAP_VERSION		3			// 1 had no index, 2 no segments
+
+typedef struct _SCCAP_FILE_HEADER
+{
+	unsigned char	Magic[4];			// SCCAP_MAGIC
+	unsigned short	Version;			// SCCAP_VERSION
+	unsigned short	HeaderSize;			// sizeof(SCCAP_FILE_HEADER), the records start here
+	SCCAP_UINT64	StartTime;			// system time records are timed from, 100ns units since 1601 UTC
+	unsigned int	Instance;			// port, as in \Device\SerialCloneDevice<n>
+	unsigned int	Valid;				// SERIALCLONE_STATE_xxx, which settings below were known
+	unsigned int	BaudRate;			// settings when the recording started
+	unsigned char	StopBits;
+	unsigned char	Parity;
+	unsigned char	WordLength;
+	unsigned char	Reserved1;
+	unsigned int	ControlHandShake;
+	unsigned int	FlowReplace;
+	unsigned char	XonChar;
+	unsigned char	XoffChar;
+	unsigned char	Reserved2[22];
+} SCCAP_FILE_HEADER;
+
+// record Kind. The values from 0x80 up are not data; a reader stops at
+// the ones it doesn't know.
+#define SCCAP_RECORD_TX			0x01	// written to the port, otherwise read from it
+#define SCCAP_RECORD_TRUNCATED	0x02	// payload is the start of what the port moved
+#define SCCAP_RECORD_GAP		0x04	// data was lost between the previous record and this one
+#define SCCAP_RECORD_FLAGS		0x07
+#define SCCAP_BLOCK_INDEX		0x80	// an index point
+#define SCCAP_BLOCK_FOOTER		0x81	// the footer, no records after it
+#define SCCAP_BLOCK_SEGMENT		0x82	// a segment of records
+
+// segment Method
+#define SCCAP_SEGMENT_STORED	0		// as they are, they didn't compress
+#define SCCAP_SEGMENT_LZ		1		// see sccaplz.h
+
+// records between index points unless the writer is told otherwise
+#define SCCAP_DEFAULT_INDEX_EVERY	1024
+
+typedef struct _SCCAP_INDEX_ENTRY
+{
+	SCCAP_UINT64	Time;				// as in the index point or segment
+	SCCAP_UINT64	Offset;				// of the index point or segment
+	SCCAP_UINT64	Record;				// as in the index point or segment
+} SCCAP_INDEX_ENTRY;
+
+#define SCCAP_TRAILER_MAGIC		"SCAE"
+
+typedef struct _SCCAP_FILE_TRAILER
+{
+	SCCAP_UINT64	IndexOffset;		// of the first SCCAP_INDEX_ENTRY
+	SCCAP_UINT64	IndexEntries;
+	SCCAP_UINT64	Records;			// in the whole file
+	SCCAP_UINT64	EndTime;			// of the last record
+	unsigned int	Size;				// sizeof(SCCAP_FILE_TRAILER)
+	unsigned char	Magic[4];			// SCCAP_TRAILER_MAGIC, the last bytes of the file
+} SCCAP_FILE_TRAILER;
+
+// longest a record header can be: Kind and three varints of a 64 bit
+// delta and two 32 bit lengths. An index point is shorter.
+#define SCCAP_RECORD_HEADER_MAX	(1 + 10 + 5 + 5)
+
+// results, SCCAP_OK or one of the errors
+#define SCCAP_OK				0
+#define SCCAP_END				1		// SCCapNext, no more records
+#define SCCAP_ERROR_OPEN		-1		// the file could not be opened, created or mapped
+#define SCCAP_ERROR_EXISTS		-2		// SCCapCreate, the file is already there
+#define SCCAP_ERROR_FORMAT		-3		// not a capture file, or a version we don't know
+#define SCCAP_ERROR_TRUNCATED	-4		// the last record is cut short
+#define SCCAP_ERROR_WRITE		-5		// the disk is full or gone
+
+// one record as the reader hands it out
+typedef struct _SCCAP_RECORD
+{
+	SCCAP_UINT64			Time;		// system time, 100ns units since 1601 UTC
+	const unsigned char *	Data;		// into the mapped file, or the segment cache until the next call
+	unsigned int			Length;		// bytes at Data
+	unsigned int			Original;	// bytes the port moved, Length unless truncated
+	unsigned char			Kind;		// SCCAP_RECORD_xxx
+} SCCAP_RECORD;
+
+// the last segment read, as records
+typedef struct _SCCAP_CACHE
+{
+	SCCAP_UINT64			Segment;	// its offset, 0 for none
+	const unsigned char *	Data;		// its records, in Buffer or, when stored, the mapping
+	SCCAP_UINT64			Length;
+	unsigned char *			Buffer;
+	size_t					Room;
+} SCCAP_CACHE;
+
+// an open capture file, mapped read only. The segment cache makes it
+// one thread's; another thread opens the file again.
+typedef struct _SCCAP_FILE
+{
+	SCCAP_FILE_HEADER		Header;
+	SCCAP_FILE_TRAILER		Trailer;	// all 0 when there is no footer
+	const unsigned char *	Base;
+	SCCAP_UINT64			Size;
+	SCCAP_UINT64			End;		// where the records end, the footer or the end of the file
+	SCCAP_CACHE *			Cache;
+#ifdef _WIN32
+	void *					File;
+	void *					Mapping;
+#else
+	int						Fd;
+#endif
+} SCCAP_FILE;
+
+// position in a capture file; copy it to come back to a record later
+typedef struct _SCCAP_CURSOR
+{
+	SCCAP_UINT64			Offset;		// of the next block, past the segment when in one
+	SCCAP_UINT64			Time;		// of the record before it, what its delta adds to
+	SCCAP_UINT64			Segment;	// offset of the segment the next record is in, 0 for none
+	SCCAP_UINT64			Position;	// of the next record in the segment's records
+} SCCAP_CURSOR;
+
+struct _SCCAP_WORKER;
+
+// a capture file being recorded
+typedef struct _SCCAP_WRITER
+{
+	FILE *					File;
+	char *					Buffer;		// stdio buffer, large so a long recording costs few writes
+	SCCAP_UINT64			LastTime;
+	SCCAP_UINT64			Records;
+	SCCAP_UINT64			Bytes;		// file size so far
+	unsigned int			IndexEvery;	// records between index points or in a segment, may be changed
+										// before the first append
+	int						Compress;	// nonzero to write compressed segments, set before the first append
+	struct _SCCAP_WORKER *	Worker;		// compresses and writes the segments, NULL until the first append
+	SCCAP_INDEX_ENTRY *		Index;		// the points so far, for the footer
+	SCCAP_UINT64			IndexEntries;
+	SCCAP_UINT64			IndexRoom;
+	int						Failed;		// an index entry could not be kept, finish without a footer
+} SCCAP_WRITER;
+
+int SCCapOpen(SCCAP_FILE * File, const char * Path);
+void SCCapClose(SCCAP_FILE * File);
+void SCCapRewind(const SCCAP_FILE * File, SCCAP_CURSOR * Cursor);
+int SCCapNext(const SCCAP_FILE * File, SCCAP_CURSOR * Cursor, SCCAP_RECORD * Record);
+int SCCapSeek(const SCCAP_FILE * File, SCCAP_UINT64 Time, SCCAP_CURSOR * Cursor);
+
+int SCCapCreate(SCCAP_WRITER * Writer, const char * Path, const SCCAP_FILE_HEADER * Header);
+int SCCapAppend(SCCAP_WRITER * Writer, SCCAP_UINT64 Time, unsigned int Kind,
+	const void * Data, unsigned int Length, unsigned int Original);
+int SCCapFlush(SCCAP_WRITER * Writer);
+int SCCapFinish(SCCAP_WRITER * Writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCCAPFILE_H__
@@ -0,0 +1,307 @@
+// sccaplz.c
+//
+// Greedy LZ77 over a 64KB window, for speed rather than the last bit of
+// ratio: one hash of the next 4 bytes finds the only match candidate.
+// Serial traffic, repeated sentences and framing, gives it plenty.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <string.h>
+#include "sccaplz.h"
+
+#define SCCAPLZ_MIN_MATCH	4
+#define SCCAPLZ_MAX_DISTANCE	65535
+#define SCCAPLZ_HASH_BITS	13
+
+// last match may not start this close to the end, so the hash never
+// reads past the input
+#define SCCAPLZ_TAIL		SCCAPLZ_MIN_MATCH
+
+#define SCCapLzRead32(p)	((unsigned int)(p)[0] | ((unsigned int)(p)[1] << 8) | \
+	((unsigned int)(p)[2] << 16) | ((unsigned int)(p)[3] << 24))
+
+#define SCCapLzHash(v)		(((v) * 2654435761U) >> (32 - SCCAPLZ_HASH_BITS))
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapLzPutCount
+//      Writes the part of a count that did not fit in its token nibble
+//
+//  Arguments:
+//      IN  Out
+//              where it goes
+//
+//      IN  End
+//              end of the output
+//
+//      IN  Count
+//              the count less 15
+//
+//  Return Value:
+//      past what was written, NULL if it did not fit
+//
+static unsigned char * SCCapLzPutCount(unsigned char * Out, const unsigned char * End, size_t Count)
+{
+	for(; Count >= 255; Count -= 255)
+	{
+		if(Out >= End)
+			return NULL;
+		*Out++ = 255;
+	}
+
+	if(Out >= End)
+		return NULL;
+	*Out++ = (unsigned char)Count;
+	return Out;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapLzPutSequence
+//      Writes one sequence, literals and the match after them
+//
+//  Arguments:
+//      IN  Out
+//              where it goes
+//
+//      IN  End
+//              end of the output
+//
+//      IN  Literals
+//              the literals
+//
+//      IN  LiteralCount
+//              how many
+//
+//      IN  Distance
+//              back to the match, 0 for the last sequence that has none
+//
+//      IN  MatchLength
+//              length of the match
+//
+//  Return Value:
+//      past what was written, NULL if it did not fit
+//
+static unsigned char * SCCapLzPutSequence(unsigned char * Out, const unsigned char * End,
+	const unsigned char * Literals, size_t LiteralCount, size_t Distance, size_t MatchLength)
+{
+	unsigned char *	token;
+	size_t			match;
+
+	if(Out >= End)
+		return NULL;
+
+	match = (Distance != 0) ? MatchLength - SCCAPLZ_MIN_MATCH : 0;
+	token = Out++;
+	*token = (unsigned char)((((LiteralCount < 15) ? LiteralCount : 15) << 4) | ((match < 15) ? match : 15));
+
+	if((LiteralCount >= 15) && ((Out = SCCapLzPutCount(Out, End, LiteralCount - 15)) == NULL))
+		return NULL;
+
+	if((size_t)(End - Out) < LiteralCount)
+		return NULL;
+	memcpy(Out, Literals, LiteralCount);
+	Out += LiteralCount;
+
+	if(Distance == 0)
+		return Out;
+
+	if(End - Out < 2)
+		return NULL;
+	*Out++ = (unsigned char)Distance;
+	*Out++ = (unsigned char)(Distance >> 8);
+
+	if((match >= 15) && ((Out = SCCapLzPutCount(Out, End, match - 15)) == NULL))
+		return NULL;
+	return Out;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapLzCompress
+//      Compresses a block
+//
+//  Arguments:
+//      IN  In
+//              the data
+//
+//      IN  InLength
+//              bytes of it
+//
+//      OUT Out
+//              receives the block
+//
+//      IN  OutRoom
+//              size of Out; a caller that only wants a block smaller than
+//              the data passes less than InLength
+//
+//  Return Value:
+//      bytes in the block, 0 if it did not fit in OutRoom
+//
+size_t SCCapLzCompress(const unsigned char * In, size_t InLength, unsigned char * Out, size_t OutRoom)
+{
+	size_t					table[1 << SCCAPLZ_HASH_BITS];
+	const unsigned char *	p;
+	const unsigned char *	anchor;
+	const unsigned char *	limit;
+	const unsigned char *	end;
+	const unsigned char *	candidate;
+	const unsigned char *	outEnd;
+	unsigned char *			o;
+	unsigned int			hash;
+	size_t					length;
+
+	// positions are kept +1 so 0 means none yet
+	memset(table, 0, sizeof(table));
+	o = Out;
+	outEnd = Out + OutRoom;
+	p = In;
+	anchor = In;
+	end = In + InLength;
+	limit = (InLength > SCCAPLZ_TAIL) ? end - SCCAPLZ_TAIL : In;
+
+	while(p < limit)
+	{
+		hash = SCCapLzHash(SCCapLzRead32(p));
+		candidate = (table[hash] != 0) ? In + table[hash] - 1 : NULL;
+		table[hash] = (size_t)(p - In) + 1;
+
+		if((candidate == NULL) || ((size_t)(p - candidate) > SCCAPLZ_MAX_DISTANCE) ||
+			(SCCapLzRead32(candidate) != SCCapLzRead32(p)))
+		{
+			p++;
+			continue;
+		}
+
+		for(length = SCCAPLZ_MIN_MATCH; (p + length < end) && (candidate[length] == p[length]); length++)
+			;
+
+		o = SCCapLzPutSequence(o, outEnd, anchor, (size_t)(p - anchor), (size_t)(p - candidate), length);
+		if(o == NULL)
+			return 0;
+
+		p += length;
+		anchor = p;
+	}
+
+	o = SCCapLzPutSequence(o, outEnd, anchor, (size_t)(end - anchor), 0, 0);
+	return (o != NULL) ? (size_t)(o - Out) : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapLzGetCount
+//      Reads the rest of a count whose token nibble was 15
+//
+//  Arguments:
+//      IN OUT In
+//              where it starts, moved past it
+//
+//      IN  End
+//              end of the block
+//
+//      IN OUT Count
+//              15 on the way in, the count on the way out
+//
+//  Return Value:
+//      0, or -1 if the block ends inside it
+//
+static int SCCapLzGetCount(const unsigned char ** In, const unsigned char * End, size_t * Count)
+{
+	unsigned char	b;
+
+	do
+	{
+		if(*In >= End)
+			return -1;
+		b = *(*In)++;
+		*Count += b;
+	} while(b == 255);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapLzDecompress
+//      Decompresses a block
+//
+//  Arguments:
+//      IN  In
+//              the block
+//
+//      IN  InLength
+//              bytes of it
+//
+//      OUT Out
+//              receives the data
+//
+//      IN  OutLength
+//              bytes the data must come to
+//
+//  Return Value:
+//      0, or -1 if the block is damaged or doesn't come to OutLength
+//
+int SCCapLzDecompress(const unsigned char * In, size_t InLength, unsigned char * Out, size_t OutLength)
+{
+	const unsigned char *	end;
+	unsigned char *			o;
+	unsigned char *			outEnd;
+	const unsigned char *	match;
+	size_t					literals;
+	size_t					length;
+	size_t					distance;
+	size_t					chunk;
+	unsigned char			token;
+
+	end = In + InLength;
+	o = Out;
+	outEnd = Out + OutLength;
+
+	while(In < end)
+	{
+		token = *In++;
+
+		literals = token >> 4;
+		if((literals == 15) && (SCCapLzGetCount(&In, end, &literals) != 0))
+			return -1;
+		if(((size_t)(end - In) < literals) || ((size_t)(outEnd - o) < literals))
+			return -1;
+		// a block coming to nothing may have nowhere to go
+		if(literals != 0)
+			memcpy(o, In, literals);
+		o += literals;
+		In += literals;
+
+		// the last sequence has no match
+		if(In == end)
+			break;
+
+		if(end - In < 2)
+			return -1;
+		distance = In[0] | ((size_t)In[1] << 8);
+		In += 2;
+
+		length = token & 15;
+		if((length == 15) && (SCCapLzGetCount(&In, end, &length) != 0))
+			return -1;
+		length += SCCAPLZ_MIN_MATCH;
+
+		if((distance == 0) || (distance > (size_t)(o - Out)) || ((size_t)(outEnd - o) < length))
+			return -1;
+
+		// a match may overlap what it is copying; copying no more than
+		// has been written since the match started keeps each copy clear
+		// of itself, and the chunks double as the output grows
+		match = o - distance;
+		while(length != 0)
+		{
+			chunk = (size_t)(o - match);
+			if(chunk > length)
+				chunk = length;
+			memcpy(o, match, chunk);
+			o += chunk;
+			length -= chunk;
+		}
+	}
+
+	return (o == outEnd) ? 0 : -1;
+}
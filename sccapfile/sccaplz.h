@@ -0,0 +1,38 @@
+// sccaplz.h
+//
+// The LZ codec capture segments are compressed with. A block is a run of
+// sequences, each
+//
+//	UCHAR		Token			literal count in the high 4 bits, match length
+//								less 4 in the low 4; 15 means more follows
+//	UCHAR		More[]			255s and a last byte under 255, added to the count
+//	UCHAR		Literals[]
+//	USHORT		Distance		back to the match, 1 to 65535
+//	UCHAR		More[]			as above, added to the match length
+//
+// and the last sequence of a block is literals only, ending at the end of
+// the block. Decoding checks every length against both buffers, so a
+// damaged block fails instead of writing where it shouldn't.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCCAPLZ_H__
+#define __SCCAPLZ_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+size_t SCCapLzCompress(const unsigned char * In, size_t InLength, unsigned char * Out, size_t OutRoom);
+int SCCapLzDecompress(const unsigned char * In, size_t InLength, unsigned char * Out, size_t OutLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCCAPLZ_H__
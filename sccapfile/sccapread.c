@@ -0,0 +1,636 @@
+// sccapread.c
+//
+// Capture file reader. The file is mapped rather than read, so scanning
+// a capture of many GB is a walk through memory the system pages in
+// ahead of us, and a record's payload is handed out where it lies.
+// Seeking searches the footer's index in place too. Compressed segments
+// are the exception, each is unpacked into the file's cache as it is
+// reached.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdlib.h>
+#include <string.h>
+#include "sccapfile.h"
+#include "sccaplz.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapGetVarint
+//      Decodes a varint
+//
+//  Arguments:
+//      IN  Base
+//              the file or segment
+//
+//      IN  Size
+//              where it ends
+//
+//      IN OUT Offset
+//              where the varint starts, moved past it
+//
+//      OUT Value
+//              receives the value
+//
+//  Return Value:
+//      SCCAP_OK, or SCCAP_ERROR_TRUNCATED if the file ends inside it, or
+//      SCCAP_ERROR_FORMAT if it is longer than a 64 bit value can be
+//
+static int SCCapGetVarint(const unsigned char * Base, SCCAP_UINT64 Size, SCCAP_UINT64 * Offset,
+	SCCAP_UINT64 * Value)
+{
+	const unsigned char *	p;
+	SCCAP_UINT64			value;
+	unsigned int			shift;
+
+	value = 0;
+	for(shift = 0; shift < 64; shift += 7)
+	{
+		if(*Offset >= Size)
+			return SCCAP_ERROR_TRUNCATED;
+
+		p = Base + (*Offset)++;
+		value |= (SCCAP_UINT64)(*p & 0x7f) << shift;
+		if(!(*p & 0x80))
+		{
+			*Value = value;
+			return SCCAP_OK;
+		}
+	}
+
+	return SCCAP_ERROR_FORMAT;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapGetRecord
+//      Decodes a record
+//
+//  Arguments:
+//      IN  Base
+//              the file or segment
+//
+//      IN  Size
+//              where it ends
+//
+//      IN OUT Offset
+//              where the record starts, moved past it only if it is whole
+//
+//      IN  Time
+//              what its delta adds to
+//
+//      OUT Record
+//              receives the record
+//
+//  Return Value:
+//      SCCAP_OK, SCCAP_ERROR_TRUNCATED if it runs past Size or
+//      SCCAP_ERROR_FORMAT if it is not a record
+//
+static int SCCapGetRecord(const unsigned char * Base, SCCAP_UINT64 Size, SCCAP_UINT64 * Offset,
+	SCCAP_UINT64 Time, SCCAP_RECORD * Record)
+{
+	SCCAP_UINT64	offset;
+	SCCAP_UINT64	delta;
+	SCCAP_UINT64	length;
+	SCCAP_UINT64	original;
+	unsigned char	kind;
+	int				result;
+
+	offset = *Offset;
+	if(offset >= Size)
+		return SCCAP_ERROR_TRUNCATED;
+
+	kind = Base[offset++];
+	if(kind & ~SCCAP_RECORD_FLAGS)
+		return SCCAP_ERROR_FORMAT;
+
+	if(((result = SCCapGetVarint(Base, Size, &offset, &delta)) != SCCAP_OK) ||
+		((result = SCCapGetVarint(Base, Size, &offset, &length)) != SCCAP_OK))
+	{
+		return result;
+	}
+
+	original = length;
+	if((kind & SCCAP_RECORD_TRUNCATED) && ((result = SCCapGetVarint(Base, Size, &offset, &original)) != SCCAP_OK))
+		return result;
+
+	if((length > 0xFFFFFFFF) || (original > 0xFFFFFFFF))
+		return SCCAP_ERROR_FORMAT;
+	if(length > Size - offset)
+		return SCCAP_ERROR_TRUNCATED;
+
+	Record->Time = Time + delta;
+	Record->Data = Base + offset;
+	Record->Length = (unsigned int)length;
+	Record->Original = (unsigned int)original;
+	Record->Kind = kind;
+
+	*Offset = offset + length;
+	return SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapGetSegment
+//      Decodes the header of a segment
+//
+//  Arguments:
+//      IN  File
+//              the capture file
+//
+//      IN OUT Offset
+//              where the segment starts, just past its kind, moved to its
+//              packed data
+//
+//      OUT Time
+//              receives what its first record's delta adds to
+//
+//      OUT Method
+//              receives its SCCAP_SEGMENT_xxx
+//
+//      OUT RawLength
+//              receives the bytes of records it holds
+//
+//      OUT PackedLength
+//              receives the bytes of its packed data
+//
+//  Return Value:
+//      SCCAP_OK, SCCAP_ERROR_TRUNCATED if the file ends inside it or
+//      SCCAP_ERROR_FORMAT if it makes no sense
+//
+static int SCCapGetSegment(const SCCAP_FILE * File, SCCAP_UINT64 * Offset, SCCAP_UINT64 * Time,
+	unsigned char * Method, SCCAP_UINT64 * RawLength, SCCAP_UINT64 * PackedLength)
+{
+	SCCAP_UINT64	record;
+	SCCAP_UINT64	records;
+	int				result;
+
+	if(((result = SCCapGetVarint(File->Base, File->End, Offset, Time)) != SCCAP_OK) ||
+		((result = SCCapGetVarint(File->Base, File->End, Offset, &record)) != SCCAP_OK) ||
+		((result = SCCapGetVarint(File->Base, File->End, Offset, &records)) != SCCAP_OK))
+	{
+		return result;
+	}
+
+	if(*Offset >= File->End)
+		return SCCAP_ERROR_TRUNCATED;
+	*Method = File->Base[(*Offset)++];
+
+	if(((result = SCCapGetVarint(File->Base, File->End, Offset, RawLength)) != SCCAP_OK) ||
+		((result = SCCapGetVarint(File->Base, File->End, Offset, PackedLength)) != SCCAP_OK))
+	{
+		return result;
+	}
+
+	// a byte of a block comes to 255 at most, so a damaged length can't
+	// have the cache grown past what the file could hold
+	if((*Method > SCCAP_SEGMENT_LZ) ||
+		((*Method == SCCAP_SEGMENT_STORED) && (*RawLength != *PackedLength)) ||
+		((*Method == SCCAP_SEGMENT_LZ) && (*RawLength / 255 > *PackedLength)) ||
+		((SCCAP_UINT64)(size_t)*RawLength != *RawLength))
+	{
+		return SCCAP_ERROR_FORMAT;
+	}
+
+	return (*PackedLength <= File->End - *Offset) ? SCCAP_OK : SCCAP_ERROR_TRUNCATED;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapLoadSegment
+//      Makes a segment's records the ones in the cache, unpacking them
+//      unless they already are
+//
+//  Arguments:
+//      IN  File
+//              the capture file
+//
+//      IN  Segment
+//              offset of the segment
+//
+//  Return Value:
+//      SCCAP_OK or an SCCAP_ERROR_xxx
+//
+static int SCCapLoadSegment(const SCCAP_FILE * File, SCCAP_UINT64 Segment)
+{
+	SCCAP_CACHE *	cache;
+	SCCAP_UINT64	offset;
+	SCCAP_UINT64	time;
+	SCCAP_UINT64	rawLength;
+	SCCAP_UINT64	packedLength;
+	unsigned char *	buffer;
+	unsigned char	method;
+	int				result;
+
+	cache = File->Cache;
+	if(cache->Segment == Segment)
+		return SCCAP_OK;
+
+	cache->Segment = 0;
+	offset = Segment + 1;
+	result = SCCapGetSegment(File, &offset, &time, &method, &rawLength, &packedLength);
+	if(result != SCCAP_OK)
+		return result;
+
+	if(method == SCCAP_SEGMENT_STORED)
+		cache->Data = File->Base + offset;
+	else
+	{
+		if(cache->Room < rawLength)
+		{
+			buffer = (unsigned char *)realloc(cache->Buffer, (size_t)rawLength);
+			if(buffer == NULL)
+				return SCCAP_ERROR_OPEN;
+			cache->Buffer = buffer;
+			cache->Room = (size_t)rawLength;
+		}
+
+		if(SCCapLzDecompress(File->Base + offset, (size_t)packedLength, cache->Buffer, (size_t)rawLength) != 0)
+			return SCCAP_ERROR_FORMAT;
+		cache->Data = cache->Buffer;
+	}
+
+	cache->Length = rawLength;
+	cache->Segment = Segment;
+	return SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapFindFooter
+//      Looks for the footer of a finished file and, when it is sound,
+//      makes the records end where it starts
+//
+//  Arguments:
+//      IN  File
+//              the capture file, header checked
+//
+//  Return Value:
+//      None, the trailer is left 0 if there is no usable footer
+//
+static void SCCapFindFooter(SCCAP_FILE * File)
+{
+	SCCAP_FILE_TRAILER	trailer;
+	SCCAP_UINT64		tail;
+
+	File->End = File->Size;
+	if(File->Size - File->Header.HeaderSize < 1 + sizeof(SCCAP_FILE_TRAILER))
+		return;
+
+	tail = File->Size - sizeof(SCCAP_FILE_TRAILER);
+	memcpy(&trailer, File->Base + tail, sizeof(SCCAP_FILE_TRAILER));
+	if((memcmp(trailer.Magic, SCCAP_TRAILER_MAGIC, sizeof(trailer.Magic)) != 0) ||
+		(trailer.Size != sizeof(SCCAP_FILE_TRAILER)) ||
+		(trailer.IndexOffset <= File->Header.HeaderSize) || (trailer.IndexOffset > tail) ||
+		(trailer.IndexEntries != (tail - trailer.IndexOffset) / sizeof(SCCAP_INDEX_ENTRY)) ||
+		((tail - trailer.IndexOffset) % sizeof(SCCAP_INDEX_ENTRY) != 0) ||
+		(File->Base[trailer.IndexOffset - 1] != SCCAP_BLOCK_FOOTER))
+	{
+		return;
+	}
+
+	File->Trailer = trailer;
+	File->End = trailer.IndexOffset - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapOpen
+//      Opens and maps a capture file
+//
+//  Arguments:
+//      OUT File
+//              receives the open file
+//
+//      IN  Path
+//              the capture file
+//
+//  Return Value:
+//      SCCAP_OK or an SCCAP_ERROR_xxx
+//
+int SCCapOpen(SCCAP_FILE * File, const char * Path)
+{
+#ifdef _WIN32
+	LARGE_INTEGER	size;
+#else
+	struct stat		st;
+	void *			base;
+#endif
+
+	memset(File, 0, sizeof(SCCAP_FILE));
+	File->Cache = (SCCAP_CACHE *)calloc(1, sizeof(SCCAP_CACHE));
+	if(File->Cache == NULL)
+		return SCCAP_ERROR_OPEN;
+
+#ifdef _WIN32
+	File->File = CreateFileA(Path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(File->File == INVALID_HANDLE_VALUE)
+	{
+		File->File = NULL;
+		SCCapClose(File);
+		return SCCAP_ERROR_OPEN;
+	}
+
+	size.LowPart = GetFileSize(File->File, (LPDWORD)&size.HighPart);
+	File->Size = (SCCAP_UINT64)size.QuadPart;
+	if((File->Size < sizeof(SCCAP_FILE_HEADER)) || ((SIZE_T)File->Size != File->Size))
+	{
+		SCCapClose(File);
+		return (File->Size < sizeof(SCCAP_FILE_HEADER)) ? SCCAP_ERROR_FORMAT : SCCAP_ERROR_OPEN;
+	}
+
+	File->Mapping = CreateFileMappingA(File->File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(File->Mapping != NULL)
+		File->Base = (const unsigned char *)MapViewOfFile(File->Mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+	File->Fd = open(Path, O_RDONLY);
+	if(File->Fd < 0)
+	{
+		SCCapClose(File);
+		return SCCAP_ERROR_OPEN;
+	}
+
+	if(fstat(File->Fd, &st) != 0)
+	{
+		SCCapClose(File);
+		return SCCAP_ERROR_OPEN;
+	}
+
+	File->Size = (SCCAP_UINT64)st.st_size;
+	if((File->Size < sizeof(SCCAP_FILE_HEADER)) || ((size_t)File->Size != File->Size))
+	{
+		SCCapClose(File);
+		return (File->Size < sizeof(SCCAP_FILE_HEADER)) ? SCCAP_ERROR_FORMAT : SCCAP_ERROR_OPEN;
+	}
+
+	base = mmap(NULL, (size_t)File->Size, PROT_READ, MAP_SHARED, File->Fd, 0);
+	if(base != MAP_FAILED)
+	{
+		File->Base = (const unsigned char *)base;
+		madvise(base, (size_t)File->Size, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if(File->Base == NULL)
+	{
+		SCCapClose(File);
+		return SCCAP_ERROR_OPEN;
+	}
+
+	memcpy(&File->Header, File->Base, sizeof(SCCAP_FILE_HEADER));
+	if((memcmp(File->Header.Magic, SCCAP_MAGIC, sizeof(File->Header.Magic)) != 0) ||
+		(File->Header.Version == 0) || (File->Header.Version > SCCAP_VERSION) ||
+		(File->Header.HeaderSize < sizeof(SCCAP_FILE_HEADER)) ||
+		(File->Header.HeaderSize > File->Size))
+	{
+		SCCapClose(File);
+		return SCCAP_ERROR_FORMAT;
+	}
+
+	SCCapFindFooter(File);
+	return SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapClose
+//      Unmaps and closes a capture file. Records handed out point into
+//      the mapping or the cache and are gone with them.
+//
+//  Arguments:
+//      IN  File
+//              the file, unusable afterwards
+//
+//  Return Value:
+//      None
+//
+void SCCapClose(SCCAP_FILE * File)
+{
+#ifdef _WIN32
+	if(File->Base != NULL)
+		UnmapViewOfFile((LPCVOID)File->Base);
+	if(File->Mapping != NULL)
+		CloseHandle(File->Mapping);
+	if(File->File != NULL)
+		CloseHandle(File->File);
+	File->Mapping = NULL;
+	File->File = NULL;
+#else
+	if(File->Base != NULL)
+		munmap((void *)File->Base, (size_t)File->Size);
+	if(File->Fd >= 0)
+		close(File->Fd);
+	File->Fd = -1;
+#endif
+	File->Base = NULL;
+
+	if(File->Cache != NULL)
+	{
+		free(File->Cache->Buffer);
+		free(File->Cache);
+		File->Cache = NULL;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapRewind
+//      Points a cursor at the first record
+//
+//  Arguments:
+//      IN  File
+//              the capture file
+//
+//      OUT Cursor
+//              the cursor
+//
+//  Return Value:
+//      None
+//
+void SCCapRewind(const SCCAP_FILE * File, SCCAP_CURSOR * Cursor)
+{
+	Cursor->Offset = File->Header.HeaderSize;
+	Cursor->Time = File->Header.StartTime;
+	Cursor->Segment = 0;
+	Cursor->Position = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapNext
+//      Reads the record at a cursor and moves the cursor past it, and
+//      past any index point or segment boundary on the way. On an error
+//      the cursor stays on the bad record.
+//
+//  Arguments:
+//      IN  File
+//              the capture file
+//
+//      IN OUT Cursor
+//              the cursor
+//
+//      OUT Record
+//              receives the record
+//
+//  Return Value:
+//      SCCAP_OK, SCCAP_END at the end of the file, SCCAP_ERROR_TRUNCATED
+//      if the last record was cut short or SCCAP_ERROR_FORMAT if the file
+//      has something we don't understand
+//
+int SCCapNext(const SCCAP_FILE * File, SCCAP_CURSOR * Cursor, SCCAP_RECORD * Record)
+{
+	SCCAP_UINT64	offset;
+	SCCAP_UINT64	time;
+	SCCAP_UINT64	value;
+	SCCAP_UINT64	rawLength;
+	SCCAP_UINT64	packedLength;
+	unsigned char	kind;
+	unsigned char	method;
+	int				result;
+
+	for(;;)
+	{
+		if(Cursor->Segment != 0)
+		{
+			if((result = SCCapLoadSegment(File, Cursor->Segment)) != SCCAP_OK)
+				return result;
+
+			if(Cursor->Position < File->Cache->Length)
+			{
+				// a segment is written whole, a record cut short in one is damage
+				result = SCCapGetRecord(File->Cache->Data, File->Cache->Length, &Cursor->Position, Cursor->Time,
+					Record);
+				if(result != SCCAP_OK)
+					return SCCAP_ERROR_FORMAT;
+
+				Cursor->Time = Record->Time;
+				return SCCAP_OK;
+			}
+
+			Cursor->Segment = 0;
+			Cursor->Position = 0;
+		}
+
+		offset = Cursor->Offset;
+		if(offset >= File->End)
+			return SCCAP_END;
+
+		kind = File->Base[offset];
+		if(!(kind & ~SCCAP_RECORD_FLAGS))
+		{
+			result = SCCapGetRecord(File->Base, File->End, &offset, Cursor->Time, Record);
+			if(result != SCCAP_OK)
+				return result;
+
+			Cursor->Offset = offset;
+			Cursor->Time = Record->Time;
+			return SCCAP_OK;
+		}
+
+		offset++;
+		switch(kind)
+		{
+		// the footer of a file we found no sound footer in still ends it
+		case SCCAP_BLOCK_FOOTER:
+			return SCCAP_END;
+
+		// the point's time is the one the deltas after it add to
+		case SCCAP_BLOCK_INDEX:
+			if(((result = SCCapGetVarint(File->Base, File->End, &offset, &time)) != SCCAP_OK) ||
+				((result = SCCapGetVarint(File->Base, File->End, &offset, &value)) != SCCAP_OK))
+			{
+				return result;
+			}
+			Cursor->Offset = offset;
+			Cursor->Time = time;
+			break;
+
+		// its records come from the cache, the cursor itself goes on
+		// past it
+		case SCCAP_BLOCK_SEGMENT:
+			result = SCCapGetSegment(File, &offset, &time, &method, &rawLength, &packedLength);
+			if(result != SCCAP_OK)
+				return result;
+			Cursor->Segment = Cursor->Offset;
+			Cursor->Position = 0;
+			Cursor->Offset = offset + packedLength;
+			Cursor->Time = time;
+			break;
+
+		default:
+			return SCCAP_ERROR_FORMAT;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapSeek
+//      Points a cursor at the first record at or after a time. With a
+//      footer that is a binary search of the index and a walk of at most
+//      one index point's or segment's worth of records; without, a walk
+//      from the start.
+//
+//  Arguments:
+//      IN  File
+//              the capture file
+//
+//      IN  Time
+//              system time, 100ns units since 1601 UTC
+//
+//      OUT Cursor
+//              receives the cursor, past the last record if none is that late
+//
+//  Return Value:
+//      SCCAP_OK, or the error that stopped the walk
+//
+int SCCapSeek(const SCCAP_FILE * File, SCCAP_UINT64 Time, SCCAP_CURSOR * Cursor)
+{
+	SCCAP_INDEX_ENTRY	entry;
+	SCCAP_RECORD		record;
+	SCCAP_CURSOR		next;
+	SCCAP_UINT64		low;
+	SCCAP_UINT64		high;
+	SCCAP_UINT64		middle;
+	int					result;
+
+	SCCapRewind(File, Cursor);
+
+	// the last point timed before Time; records at Time itself may sit
+	// just ahead of a point with that time, so not at or before
+	low = 0;
+	high = File->Trailer.IndexEntries;
+	while(low < high)
+	{
+		middle = low + (high - low) / 2;
+		memcpy(&entry, File->Base + File->Trailer.IndexOffset + middle * sizeof(SCCAP_INDEX_ENTRY),
+			sizeof(SCCAP_INDEX_ENTRY));
+		if(entry.Time < Time)
+		{
+			Cursor->Offset = entry.Offset;
+			Cursor->Time = entry.Time;
+			Cursor->Segment = 0;
+			Cursor->Position = 0;
+			low = middle + 1;
+		}
+		else
+			high = middle;
+	}
+
+	for(;;)
+	{
+		next = *Cursor;
+		result = SCCapNext(File, &next, &record);
+		if(result == SCCAP_END)
+			return SCCAP_OK;
+		if(result != SCCAP_OK)
+			return result;
+		if(record.Time >= Time)
+			return SCCAP_OK;
+		*Cursor = next;
+	}
+}
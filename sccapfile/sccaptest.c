@@ -0,0 +1,559 @@
+// sccaptest.c
+//
+// Round trips through the capture file library. The codec compresses
+// blocks of the shapes it has to get right, nothing, a few bytes, literal
+// and match counts either side of where their token nibble runs out, a
+// match at the furthest distance and one just out of reach, text, runs
+// and noise, and each has to decompress to the data exactly, and fail
+// when told the wrong length. Every block cut short either fails or,
+// when only its closing token was cut, still comes to the data; hand
+// made damaged blocks fail. Then capture files are written plain and
+// compressed, with index points and segments few records apart, read
+// back record by record and sought to every record's time and either
+// side of it. Copies of them cut short anywhere open to a correct start
+// of the records and then stop, with an error or at the end; cut inside
+// the footer they still read whole. Every buffer is exactly its size and
+// make check builds this with the sanitizers, so reading or writing past
+// one fails too.
+//
+//	sccaptest [options]
+//
+//	-d dir			directory for the capture files, a new one in /tmp by default,
+//					removed afterwards
+//	-s N			the seed for the records and data, 1 by default
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sccapfile.h"
+#include "sccaplz.h"
+
+// bytes a block of Length bytes of data can take, all of it literals
+#define SCCapTestBound(Length)	((Length) + (Length) / 255 + 16)
+
+#define SCCAPTEST_CUTS			512		// cuts tried of a block or a file, at most
+#define SCCAPTEST_POOL			65536	// the data records take theirs from
+
+// one record as written
+typedef struct _SCCAPTEST_RECORD
+{
+	SCCAP_UINT64	Time;
+	unsigned int	Kind;
+	unsigned int	Length;
+	unsigned int	Original;
+	unsigned int	Data;				// offset in SCCapTestPool
+} SCCAPTEST_RECORD;
+
+static SCCAP_UINT64		SCCapTestState;
+static unsigned char	SCCapTestPool[SCCAPTEST_POOL];
+static unsigned int		SCCapTestFailed;
+static unsigned int		SCCapTestBlocks;
+static unsigned int		SCCapTestFiles;
+
+static unsigned int SCCapTestRandom(void)
+{
+	SCCapTestState ^= SCCapTestState << 13;
+	SCCapTestState ^= SCCapTestState >> 7;
+	SCCapTestState ^= SCCapTestState << 17;
+	return (unsigned int)(SCCapTestState >> 32);
+}
+
+static void SCCapTestFail(const char * Name, const char * What)
+{
+	fprintf(stderr, "sccaptest: %s: %s\n", Name, What);
+	SCCapTestFailed++;
+}
+
+// a copy in a buffer of exactly its size
+static unsigned char * SCCapTestCopy(const unsigned char * Data, size_t Size)
+{
+	unsigned char *	copy;
+
+	copy = malloc((Size > 0) ? Size : 1);
+	if(copy == NULL)
+	{
+		fprintf(stderr, "sccaptest: no memory\n");
+		exit(1);
+	}
+	memcpy(copy, Data, Size);
+	return copy;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapTestLz
+//      Compresses data, decompresses the block and damages it
+//
+//  Arguments:
+//      IN  Name
+//              what the data is, for the failures
+//
+//      IN  Data
+//              the data
+//
+//      IN  Size
+//              bytes of it
+//
+//  Return Value:
+//      None, failures are counted
+//
+static void SCCapTestLz(const char * Name, const unsigned char * Data, size_t Size)
+{
+	unsigned char *	block;
+	unsigned char *	cut;
+	unsigned char *	back;
+	size_t			room;
+	size_t			length;
+	size_t			shortLength;
+	size_t			at;
+	size_t			step;
+
+	SCCapTestBlocks++;
+	room = SCCapTestBound(Size);
+	block = malloc(room);
+	back = malloc(Size + 1);
+	if((block == NULL) || (back == NULL))
+	{
+		fprintf(stderr, "sccaptest: no memory\n");
+		exit(1);
+	}
+
+	length = SCCapLzCompress(Data, Size, block, room);
+	if((length == 0) || (length > room))
+	{
+		SCCapTestFail(Name, "no block with room to spare");
+		goto done;
+	}
+
+	cut = SCCapTestCopy(block, length);
+	if((SCCapLzDecompress(cut, length, back, Size) != 0) || (memcmp(back, Data, Size) != 0))
+		SCCapTestFail(Name, "the block doesn't come back to the data");
+	if(SCCapLzDecompress(cut, length, back, Size + 1) == 0)
+		SCCapTestFail(Name, "the block comes to a byte more");
+	if((Size > 0) && (SCCapLzDecompress(cut, length, back, Size - 1) == 0))
+		SCCapTestFail(Name, "the block comes to a byte less");
+	free(cut);
+
+	// cut anywhere, every cut of a short block and spread over a long one
+	step = (length + SCCAPTEST_CUTS - 1) / SCCAPTEST_CUTS;
+	for(at = 0; at < length; at += (at + 16 < length) ? step : 1)
+	{
+		cut = SCCapTestCopy(block, at);
+		if((SCCapLzDecompress(cut, at, back, Size) == 0) && (memcmp(back, Data, Size) != 0))
+			SCCapTestFail(Name, "a block cut short comes to other data");
+		free(cut);
+	}
+
+	// less room than the data, the writer stores what doesn't fit
+	if(Size > 0)
+	{
+		shortLength = SCCapLzCompress(Data, Size, block, Size - 1);
+		if(shortLength > Size - 1)
+			SCCapTestFail(Name, "the block is longer than its room");
+		else if((shortLength != 0) &&
+			((SCCapLzDecompress(block, shortLength, back, Size) != 0) || (memcmp(back, Data, Size) != 0)))
+		{
+			SCCapTestFail(Name, "the block made in less room doesn't come back to the data");
+		}
+	}
+
+done:
+	free(back);
+	free(block);
+}
+
+// hand made blocks, Result what decompressing to Expected has to return
+static void SCCapTestLzBlock(const char * Name, const char * Block, size_t Length, const char * Expected,
+	int Result)
+{
+	unsigned char *	block;
+	unsigned char *	out;
+	size_t			size;
+
+	SCCapTestBlocks++;
+	size = strlen(Expected);
+	block = SCCapTestCopy((const unsigned char *)Block, Length);
+	out = SCCapTestCopy((const unsigned char *)Expected, size);
+	memset(out, 0, size);
+
+	if(SCCapLzDecompress(block, Length, out, size) != Result)
+		SCCapTestFail(Name, (Result == 0) ? "the block doesn't decompress" : "the damage isn't found");
+	else if((Result == 0) && (memcmp(out, Expected, size) != 0))
+		SCCapTestFail(Name, "the block comes to other data");
+
+	free(out);
+	free(block);
+}
+
+static void SCCapTestCodec(void)
+{
+	static const char	text[] = "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n";
+	unsigned char *		data;
+	char				name[64];
+	size_t				size;
+	size_t				i;
+	static const size_t	runs[] = { 4, 18, 19, 20, 21, 273, 274, 275, 276, 100000 };
+	static const size_t	literals[] = { 1, 3, 4, 14, 15, 16, 269, 270, 271, 526 };
+
+	data = malloc(200000);
+	if(data == NULL)
+	{
+		fprintf(stderr, "sccaptest: no memory\n");
+		exit(1);
+	}
+
+	SCCapTestLz("nothing", data, 0);
+
+	for(i = 0; i < sizeof(literals) / sizeof(literals[0]); i++)
+	{
+		for(size = 0; size < literals[i]; size++)
+			data[size] = (unsigned char)SCCapTestRandom();
+		snprintf(name, sizeof(name), "%lu bytes of noise", (unsigned long)literals[i]);
+		SCCapTestLz(name, data, literals[i]);
+	}
+
+	for(i = 0; i < sizeof(runs) / sizeof(runs[0]); i++)
+	{
+		memset(data, 'x', runs[i]);
+		snprintf(name, sizeof(name), "a run of %lu bytes", (unsigned long)runs[i]);
+		SCCapTestLz(name, data, runs[i]);
+
+		// a match its token nibble runs out in, after literals that don't
+		for(size = 0; size < 20; size++)
+			data[size] = (unsigned char)SCCapTestRandom();
+		memset(data + 20, 'x', runs[i]);
+		snprintf(name, sizeof(name), "noise, then a run of %lu bytes", (unsigned long)runs[i]);
+		SCCapTestLz(name, data, 20 + runs[i]);
+	}
+
+	for(size = 0; size + sizeof(text) - 1 <= 100000; size += sizeof(text) - 1)
+		memcpy(data + size, text, sizeof(text) - 1);
+	SCCapTestLz("a line over and over", data, size);
+	for(i = 0; i < size; i += 1 + SCCapTestRandom() % 64)
+		data[i] = (unsigned char)('0' + SCCapTestRandom() % 10);
+	SCCapTestLz("lines with their numbers changing", data, size);
+
+	for(size = 0; size < 70000; size++)
+		data[size] = (unsigned char)SCCapTestRandom();
+	SCCapTestLz("70000 bytes of noise", data, size);
+
+	// the same 64 bytes again as far back as a match reaches, and a byte
+	// further
+	for(size = 0; size < 65536 + 64; size++)
+		data[size] = (unsigned char)SCCapTestRandom();
+	memcpy(data + 65535, data, 64);
+	SCCapTestLz("a match 65535 bytes back", data, 65535 + 64);
+	memcpy(data + 65536, data, 64);
+	SCCapTestLz("a match 65536 bytes back", data, 65536 + 64);
+	free(data);
+
+	SCCapTestLzBlock("an overlapping match", "\x10" "a" "\x01\x00" "\x10" "b", 6, "aaaaab", 0);
+	SCCapTestLzBlock("a match longer than its nibble", "\x1f" "a" "\x01\x00" "\x01" "\x10" "b", 7,
+		"aaaaaaaaaaaaaaaaaaaaab", 0);
+	SCCapTestLzBlock("a distance of 0", "\x10" "a" "\x00\x00", 4, "aaaaa", -1);
+	SCCapTestLzBlock("a distance before the data", "\x10" "a" "\x02\x00", 4, "aaaaa", -1);
+	SCCapTestLzBlock("a distance cut short", "\x10" "a" "\x01", 3, "aaaaa", -1);
+	SCCapTestLzBlock("literals past the block", "\x20" "a", 2, "aa", -1);
+	SCCapTestLzBlock("a literal count past the block", "\xf0" "\xff", 2, "a", -1);
+	SCCapTestLzBlock("a match past the data", "\x10" "a" "\x01\x00", 4, "aaaa", -1);
+	SCCapTestLzBlock("literals past the data", "\x30" "abc", 4, "ab", -1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapTestRead
+//      Reads a capture file from the start and compares its records
+//      with those written
+//
+//  Arguments:
+//      IN  Name
+//              what the file is, for the failures
+//
+//      IN  Path
+//              the file
+//
+//      IN  Records
+//              as written
+//
+//      IN  Count
+//              records written
+//
+//      OUT Read
+//              receives how many records read back as written
+//
+//  Return Value:
+//      What reading stopped with, or what opening failed with
+//
+static int SCCapTestRead(const char * Name, const char * Path, const SCCAPTEST_RECORD * Records,
+	unsigned int Count, unsigned int * Read)
+{
+	SCCAP_FILE		file;
+	SCCAP_CURSOR	cursor;
+	SCCAP_RECORD	record;
+	int				result;
+
+	*Read = 0;
+	result = SCCapOpen(&file, Path);
+	if(result != SCCAP_OK)
+		return result;
+
+	SCCapRewind(&file, &cursor);
+	while((result = SCCapNext(&file, &cursor, &record)) == SCCAP_OK)
+	{
+		if((*Read >= Count) ||
+			(record.Time != Records[*Read].Time) || (record.Kind != Records[*Read].Kind) ||
+			(record.Length != Records[*Read].Length) || (record.Original != Records[*Read].Original) ||
+			(memcmp(record.Data, SCCapTestPool + Records[*Read].Data, record.Length) != 0))
+		{
+			SCCapTestFail(Name, "a record doesn't read back as written");
+			break;
+		}
+		(*Read)++;
+	}
+
+	SCCapClose(&file);
+	return result;
+}
+
+// seeks to a time, Expected the record that has to be found
+static void SCCapTestSeek(const char * Name, const SCCAP_FILE * File, SCCAP_UINT64 Time,
+	const SCCAPTEST_RECORD * Records, unsigned int Count)
+{
+	SCCAP_CURSOR	cursor;
+	SCCAP_RECORD	record;
+	unsigned int	expected;
+	int				result;
+
+	for(expected = 0; (expected < Count) && (Records[expected].Time < Time); expected++)
+		;
+
+	if(SCCapSeek(File, Time, &cursor) != SCCAP_OK)
+	{
+		SCCapTestFail(Name, "a seek failed");
+		return;
+	}
+
+	result = SCCapNext(File, &cursor, &record);
+	if(expected == Count)
+	{
+		if(result != SCCAP_END)
+			SCCapTestFail(Name, "a seek past the last record found one");
+	}
+	else if((result != SCCAP_OK) || (record.Time != Records[expected].Time) ||
+		(record.Length != Records[expected].Length) ||
+		(memcmp(record.Data, SCCapTestPool + Records[expected].Data, record.Length) != 0))
+	{
+		SCCapTestFail(Name, "a seek found another record than the first at or after the time");
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapTestFile
+//      Writes a capture file, reads it back, seeks in it and reads
+//      copies of it cut short
+//
+//  Arguments:
+//      IN  Directory
+//              where the files go
+//
+//      IN  Count
+//              records to write
+//
+//      IN  Compress
+//              nonzero for segments
+//
+//      IN  IndexEvery
+//              records between index points or in a segment
+//
+//  Return Value:
+//      None, failures are counted
+//
+static void SCCapTestFile(const char * Directory, unsigned int Count, int Compress, unsigned int IndexEvery)
+{
+	SCCAP_FILE_HEADER	header;
+	SCCAP_WRITER		writer;
+	SCCAP_FILE			file;
+	SCCAPTEST_RECORD *	records;
+	SCCAPTEST_RECORD *	r;
+	SCCAP_UINT64		time;
+	SCCAP_UINT64		at;
+	SCCAP_UINT64		step;
+	unsigned int		read;
+	unsigned int		i;
+	char				name[96];
+	char				path[4096];
+	char				cutPath[4096];
+	unsigned char *		contents;
+	FILE *				f;
+	int					result;
+
+	SCCapTestFiles++;
+	snprintf(name, sizeof(name), "%u records, %s, every %u", Count, Compress ? "compressed" : "plain",
+		IndexEvery);
+	snprintf(path, sizeof(path), "%s/%u-%d-%u.scap", Directory, Count, Compress, IndexEvery);
+	snprintf(cutPath, sizeof(cutPath), "%s/cut.scap", Directory);
+
+	records = malloc((Count + 1) * sizeof(SCCAPTEST_RECORD));
+	if(records == NULL)
+	{
+		fprintf(stderr, "sccaptest: no memory\n");
+		exit(1);
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.StartTime = 127000000000000000ULL;
+	header.BaudRate = 115200;
+	if(SCCapCreate(&writer, path, &header) != SCCAP_OK)
+	{
+		SCCapTestFail(name, "can't create the file");
+		free(records);
+		return;
+	}
+	writer.Compress = Compress;
+	writer.IndexEvery = IndexEvery;
+
+	// deltas of nothing, a tick and more than 32 bits, the clock set back
+	// once, reads and writes cut short and empty
+	time = header.StartTime;
+	for(i = 0; i < Count; i++)
+	{
+		r = &records[i];
+		switch(SCCapTestRandom() % 8)
+		{
+		case 0:		r->Time = time; break;
+		case 1:		r->Time = time + 0x100000000ULL + SCCapTestRandom(); break;
+		case 2:		r->Time = (i == Count / 2) ? time - 1000 : time + 1; break;
+		default:	r->Time = time + SCCapTestRandom() % 100000; break;
+		}
+
+		r->Kind = SCCapTestRandom() % (SCCAP_RECORD_FLAGS + 1);
+		r->Length = (SCCapTestRandom() % 16 == 0) ? 0 : SCCapTestRandom() % ((SCCapTestRandom() % 8 == 0) ? 4096 : 64);
+		r->Original = (r->Kind & SCCAP_RECORD_TRUNCATED) ? r->Length + SCCapTestRandom() % 1000 : r->Length;
+		r->Data = SCCapTestRandom() % (SCCAPTEST_POOL - 4096);
+
+		if(SCCapAppend(&writer, r->Time, r->Kind, SCCapTestPool + r->Data, r->Length, r->Original) != SCCAP_OK)
+			SCCapTestFail(name, "an append failed");
+
+		// the writer takes a time gone back as none passing
+		if(r->Time < time)
+			r->Time = time;
+		time = r->Time;
+	}
+	if(SCCapFinish(&writer) != SCCAP_OK)
+		SCCapTestFail(name, "finishing failed");
+
+	result = SCCapTestRead(name, path, records, Count, &read);
+	if((result != SCCAP_END) || (read != Count))
+		SCCapTestFail(name, "the records don't all read back");
+
+	if(SCCapOpen(&file, path) != SCCAP_OK)
+		SCCapTestFail(name, "can't open the file");
+	else
+	{
+		if((file.Trailer.Records != Count) || ((Count != 0) && (file.Trailer.EndTime != records[Count - 1].Time)))
+			SCCapTestFail(name, "the footer doesn't count the records");
+
+		SCCapTestSeek(name, &file, 0, records, Count);
+		SCCapTestSeek(name, &file, ~(SCCAP_UINT64)0, records, Count);
+		for(i = 0; i < Count; i++)
+		{
+			SCCapTestSeek(name, &file, records[i].Time - 1, records, Count);
+			SCCapTestSeek(name, &file, records[i].Time, records, Count);
+			SCCapTestSeek(name, &file, records[i].Time + 1, records, Count);
+		}
+
+		// copies cut short anywhere: a correct start of the records
+		contents = SCCapTestCopy(file.Base, (size_t)file.Size);
+		step = (file.Size + SCCAPTEST_CUTS - 1) / SCCAPTEST_CUTS;
+		for(at = 0; at < file.Size; at += (at + sizeof(SCCAP_FILE_TRAILER) + 16 < file.Size) ? step : 1)
+		{
+			unlink(cutPath);
+			f = fopen(cutPath, "wb");
+			if((f == NULL) || (fwrite(contents, 1, (size_t)at, f) != at) || (fclose(f) != 0))
+			{
+				SCCapTestFail(name, "can't write a copy cut short");
+				break;
+			}
+
+			result = SCCapTestRead(name, cutPath, records, Count, &read);
+			if((result == SCCAP_ERROR_FORMAT) && (at < sizeof(SCCAP_FILE_HEADER)))
+				continue;
+			if((result != SCCAP_END) && (result != SCCAP_ERROR_TRUNCATED) && (result != SCCAP_ERROR_FORMAT))
+				SCCapTestFail(name, "a copy cut short stops with no reason");
+
+			// cut in the footer, its block still ends the records
+			if((at >= file.Trailer.IndexOffset - 1) && (read != Count))
+				SCCapTestFail(name, "a copy cut in the footer doesn't read whole");
+		}
+		unlink(cutPath);
+		free(contents);
+		SCCapClose(&file);
+	}
+
+	unlink(path);
+	free(records);
+}
+
+static void SCCapTestUsage(void)
+{
+	fprintf(stderr, "usage: sccaptest [-d dir] [-s seed]\n");
+}
+
+int main(int argc, char * argv[])
+{
+	char			temporary[] = "/tmp/sccaptestXXXXXX";
+	const char *	directory;
+	unsigned int	i;
+	int				c;
+
+	directory = NULL;
+	SCCapTestState = 1;
+	while((c = getopt(argc, argv, "d:s:")) != -1)
+	{
+		switch(c)
+		{
+		case 'd':	directory = optarg; break;
+		case 's':	SCCapTestState = strtoull(optarg, NULL, 0); break;
+		default:	SCCapTestUsage(); return 2;
+		}
+	}
+	if((optind != argc) || (SCCapTestState == 0))
+	{
+		SCCapTestUsage();
+		return 2;
+	}
+
+	if((directory == NULL) && ((directory = mkdtemp(temporary)) == NULL))
+	{
+		fprintf(stderr, "sccaptest: can't make a directory in /tmp\n");
+		return 1;
+	}
+
+	// text with the digits changing, as a port's traffic is
+	for(i = 0; i < SCCAPTEST_POOL; i++)
+		SCCapTestPool[i] = (unsigned char)((i % 41 == 40) ? '\n' : ('0' + (i * 7 + SCCapTestRandom() % 3) % 40));
+
+	SCCapTestCodec();
+
+	SCCapTestFile(directory, 0, 0, 4);
+	SCCapTestFile(directory, 0, 1, 4);
+	SCCapTestFile(directory, 1, 1, 4);
+	SCCapTestFile(directory, 300, 0, 1);
+	SCCapTestFile(directory, 300, 0, 7);
+	SCCapTestFile(directory, 300, 1, 1);
+	SCCapTestFile(directory, 300, 1, 7);
+	SCCapTestFile(directory, 3000, 0, 64);
+	SCCapTestFile(directory, 3000, 1, 64);
+
+	if(directory == temporary)
+		rmdir(temporary);
+
+	printf("%u blocks, %u capture files: %s\n", SCCapTestBlocks, SCCapTestFiles,
+		(SCCapTestFailed == 0) ? "passed" : "FAILED");
+	return (SCCapTestFailed == 0) ? 0 : 1;
+}
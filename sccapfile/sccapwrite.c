@@ -0,0 +1,772 @@
+// sccapwrite.c
+//
+// Capture file writer. Records go out through one large stdio buffer, so
+// appending is a few stores and a memcpy until the buffer fills. The
+// index points are remembered as they are written and go out again, as
+// the footer's table, when the file is finished.
+//
+// A compressing writer gathers the records of a segment in memory instead
+// and hands each full segment to a worker thread, which compresses and
+// writes it while the caller goes on appending to the next. The segments
+// travel through a short queue whose buffers are swapped rather than
+// copied, so once they have grown to a segment's size appending allocates
+// nothing. The worker owns the file, Bytes and the index from the first
+// append until SCCapFinish has stopped it.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdlib.h>
+#include <string.h>
+#include "sccapfile.h"
+#include "sccaplz.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// stdio buffer of a writer
+#define SCCAP_WRITE_BUFFER	(1024 * 1024)
+
+// full segments that may wait for the worker before appending waits too
+#define SCCAP_QUEUE_DEPTH	4
+
+#ifdef _WIN32
+typedef HANDLE SCCAP_SEMAPHORE;
+#else
+typedef struct _SCCAP_SEMAPHORE
+{
+	pthread_mutex_t			Lock;
+	pthread_cond_t			Signal;
+	unsigned int			Count;
+} SCCAP_SEMAPHORE;
+#endif
+
+// records of one segment
+typedef struct _SCCAP_SEGMENT
+{
+	unsigned char *			Data;
+	size_t					Length;
+	size_t					Room;
+	SCCAP_UINT64			Time;		// what the first record's delta adds to
+	SCCAP_UINT64			Record;		// records before it
+	unsigned int			Records;	// in it, 0 in the last one queued tells the worker to stop
+} SCCAP_SEGMENT;
+
+struct _SCCAP_WORKER
+{
+	SCCAP_SEGMENT			Open;		// the one being appended to
+	SCCAP_SEGMENT			Queue[SCCAP_QUEUE_DEPTH];
+	unsigned int			Head;		// next the worker takes, only it moves this
+	unsigned int			Tail;		// next the caller fills, only it moves this
+	SCCAP_SEMAPHORE			Free;		// slots the caller may fill
+	SCCAP_SEMAPHORE			Full;		// slots the worker may take
+	unsigned char *			Packed;		// the worker's, for compressing into
+	size_t					PackedRoom;
+	int						Error;		// set by the worker when a write failed
+#ifdef _WIN32
+	HANDLE					Thread;
+#else
+	pthread_t				Thread;
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapPutVarint
+//      Encodes a varint
+//
+//  Arguments:
+//      OUT Out
+//              room for 10 bytes
+//
+//      IN  Value
+//              what to encode
+//
+//  Return Value:
+//      bytes used
+//
+static unsigned int SCCapPutVarint(unsigned char * Out, SCCAP_UINT64 Value)
+{
+	unsigned int	length;
+
+	for(length = 0; Value >= 0x80; length++)
+	{
+		Out[length] = (unsigned char)(Value | 0x80);
+		Value >>= 7;
+	}
+	Out[length++] = (unsigned char)Value;
+
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapKeepIndex
+//      Remembers an index point or segment for the footer. If there is no
+//      memory to, the file gets no footer rather than one with entries
+//      missing.
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//      IN  Time
+//              as in the point or segment
+//
+//      IN  Record
+//              as in the point or segment
+//
+//  Return Value:
+//      None
+//
+static void SCCapKeepIndex(SCCAP_WRITER * Writer, SCCAP_UINT64 Time, SCCAP_UINT64 Record)
+{
+	SCCAP_INDEX_ENTRY *	index;
+	SCCAP_UINT64		room;
+
+	if(!Writer->Failed && (Writer->IndexEntries == Writer->IndexRoom))
+	{
+		room = (Writer->IndexRoom != 0) ? Writer->IndexRoom * 2 : 256;
+		index = ((size_t)(room * sizeof(SCCAP_INDEX_ENTRY)) == room * sizeof(SCCAP_INDEX_ENTRY)) ?
+			(SCCAP_INDEX_ENTRY *)realloc(Writer->Index, (size_t)(room * sizeof(SCCAP_INDEX_ENTRY))) : NULL;
+		if(index == NULL)
+			Writer->Failed = 1;
+		else
+		{
+			Writer->Index = index;
+			Writer->IndexRoom = room;
+		}
+	}
+
+	if(!Writer->Failed)
+	{
+		index = &Writer->Index[Writer->IndexEntries++];
+		index->Time = Time;
+		index->Offset = Writer->Bytes;
+		index->Record = Record;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapPutIndex
+//      Writes an index point and remembers it for the footer
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//  Return Value:
+//      SCCAP_OK or SCCAP_ERROR_WRITE
+//
+static int SCCapPutIndex(SCCAP_WRITER * Writer)
+{
+	unsigned char		point[1 + 10 + 10];
+	unsigned int		used;
+
+	SCCapKeepIndex(Writer, Writer->LastTime, Writer->Records);
+
+	point[0] = SCCAP_BLOCK_INDEX;
+	used = 1;
+	used += SCCapPutVarint(point + used, Writer->LastTime);
+	used += SCCapPutVarint(point + used, Writer->Records);
+	if(fwrite(point, 1, used, Writer->File) != used)
+		return SCCAP_ERROR_WRITE;
+
+	Writer->Bytes += used;
+	return SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapSemaphoreCreate, SCCapSemaphoreWait, SCCapSemaphorePost, SCCapSemaphoreDelete
+//      A counting semaphore, the one thing the caller and the worker share
+//      besides the queue itself
+//
+//  Arguments:
+//      IN  Semaphore
+//              the semaphore
+//
+//      IN  Count
+//              SCCapSemaphoreCreate, what it starts at
+//
+//  Return Value:
+//      SCCapSemaphoreCreate, nonzero if it was created
+//
+static int SCCapSemaphoreCreate(SCCAP_SEMAPHORE * Semaphore, unsigned int Count)
+{
+#ifdef _WIN32
+	*Semaphore = CreateSemaphore(NULL, Count, SCCAP_QUEUE_DEPTH, NULL);
+	return *Semaphore != NULL;
+#else
+	Semaphore->Count = Count;
+	if(pthread_mutex_init(&Semaphore->Lock, NULL) != 0)
+		return 0;
+	if(pthread_cond_init(&Semaphore->Signal, NULL) != 0)
+	{
+		pthread_mutex_destroy(&Semaphore->Lock);
+		return 0;
+	}
+	return 1;
+#endif
+}
+
+static void SCCapSemaphoreWait(SCCAP_SEMAPHORE * Semaphore)
+{
+#ifdef _WIN32
+	WaitForSingleObject(*Semaphore, INFINITE);
+#else
+	pthread_mutex_lock(&Semaphore->Lock);
+	while(Semaphore->Count == 0)
+		pthread_cond_wait(&Semaphore->Signal, &Semaphore->Lock);
+	Semaphore->Count--;
+	pthread_mutex_unlock(&Semaphore->Lock);
+#endif
+}
+
+static void SCCapSemaphorePost(SCCAP_SEMAPHORE * Semaphore)
+{
+#ifdef _WIN32
+	ReleaseSemaphore(*Semaphore, 1, NULL);
+#else
+	pthread_mutex_lock(&Semaphore->Lock);
+	Semaphore->Count++;
+	pthread_cond_signal(&Semaphore->Signal);
+	pthread_mutex_unlock(&Semaphore->Lock);
+#endif
+}
+
+static void SCCapSemaphoreDelete(SCCAP_SEMAPHORE * Semaphore)
+{
+#ifdef _WIN32
+	CloseHandle(*Semaphore);
+#else
+	pthread_cond_destroy(&Semaphore->Signal);
+	pthread_mutex_destroy(&Semaphore->Lock);
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapGrow
+//      Makes room in a buffer, at least doubling it so growing is rare
+//
+//  Arguments:
+//      IN OUT Data
+//              the buffer, moved if it had to be
+//
+//      IN OUT Room
+//              its size
+//
+//      IN  Needed
+//              bytes it must hold
+//
+//  Return Value:
+//      nonzero if it holds them
+//
+static int SCCapGrow(unsigned char ** Data, size_t * Room, size_t Needed)
+{
+	unsigned char *	data;
+	size_t			room;
+
+	if(Needed <= *Room)
+		return 1;
+
+	room = (*Room > Needed / 2) ? *Room * 2 : Needed;
+	if(room < Needed)
+		room = Needed;
+	data = (unsigned char *)realloc(*Data, room);
+	if(data == NULL)
+		return 0;
+
+	*Data = data;
+	*Room = room;
+	return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapPutSegment
+//      Compresses a segment and writes it, storing it as it is when it
+//      won't compress
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//      IN  Segment
+//              the segment
+//
+//  Return Value:
+//      SCCAP_OK or SCCAP_ERROR_WRITE
+//
+static int SCCapPutSegment(SCCAP_WRITER * Writer, const SCCAP_SEGMENT * Segment)
+{
+	struct _SCCAP_WORKER *	worker;
+	unsigned char			header[1 + 10 + 10 + 10 + 1 + 10 + 10];
+	const unsigned char *	packed;
+	size_t					packedLength;
+	unsigned int			used;
+
+	worker = Writer->Worker;
+
+	// only a block smaller than the records is worth keeping, and without
+	// room for one the segment is simply stored
+	packedLength = 0;
+	if((Segment->Length > 1) && SCCapGrow(&worker->Packed, &worker->PackedRoom, Segment->Length - 1))
+		packedLength = SCCapLzCompress(Segment->Data, Segment->Length, worker->Packed, Segment->Length - 1);
+	packed = (packedLength != 0) ? worker->Packed : Segment->Data;
+	if(packedLength == 0)
+		packedLength = Segment->Length;
+
+	header[0] = SCCAP_BLOCK_SEGMENT;
+	used = 1;
+	used += SCCapPutVarint(header + used, Segment->Time);
+	used += SCCapPutVarint(header + used, Segment->Record);
+	used += SCCapPutVarint(header + used, Segment->Records);
+	header[used++] = (unsigned char)((packed != Segment->Data) ? SCCAP_SEGMENT_LZ : SCCAP_SEGMENT_STORED);
+	used += SCCapPutVarint(header + used, Segment->Length);
+	used += SCCapPutVarint(header + used, packedLength);
+
+	SCCapKeepIndex(Writer, Segment->Time, Segment->Record);
+
+	if((fwrite(header, 1, used, Writer->File) != used) ||
+		(fwrite(packed, 1, packedLength, Writer->File) != packedLength))
+	{
+		return SCCAP_ERROR_WRITE;
+	}
+
+	Writer->Bytes += used + packedLength;
+	return SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapWorker
+//      The worker thread. Writes the queued segments in order until it
+//      takes the empty one that stops it. After a failed write it goes on
+//      taking segments, so the caller never waits on it, but writes
+//      nothing more.
+//
+//  Arguments:
+//      IN  Context
+//              the writer
+//
+//  Return Value:
+//      0
+//
+#ifdef _WIN32
+static DWORD WINAPI SCCapWorker(LPVOID Context)
+#else
+static void * SCCapWorker(void * Context)
+#endif
+{
+	SCCAP_WRITER *			writer;
+	struct _SCCAP_WORKER *	worker;
+	SCCAP_SEGMENT *			segment;
+	unsigned int			records;
+
+	writer = (SCCAP_WRITER *)Context;
+	worker = writer->Worker;
+
+	do
+	{
+		SCCapSemaphoreWait(&worker->Full);
+		segment = &worker->Queue[worker->Head];
+		worker->Head = (worker->Head + 1) % SCCAP_QUEUE_DEPTH;
+
+		records = segment->Records;
+		if((records != 0) && !worker->Error && (SCCapPutSegment(writer, segment) != SCCAP_OK))
+			worker->Error = 1;
+
+		SCCapSemaphorePost(&worker->Free);
+	} while(records != 0);
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapQueue
+//      Hands the open segment to the worker and starts the next, waiting
+//      while the queue is full
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//  Return Value:
+//      SCCAP_OK, or SCCAP_ERROR_WRITE if the worker has failed to write
+//
+static int SCCapQueue(SCCAP_WRITER * Writer)
+{
+	struct _SCCAP_WORKER *	worker;
+	SCCAP_SEGMENT			slot;
+
+	worker = Writer->Worker;
+	SCCapSemaphoreWait(&worker->Free);
+
+	// the slot takes the records and the open segment the slot's old
+	// buffer
+	slot = worker->Queue[worker->Tail];
+	worker->Queue[worker->Tail] = worker->Open;
+	worker->Open.Data = slot.Data;
+	worker->Open.Room = slot.Room;
+	worker->Open.Length = 0;
+	worker->Open.Time = Writer->LastTime;
+	worker->Open.Record = Writer->Records;
+	worker->Open.Records = 0;
+
+	worker->Tail = (worker->Tail + 1) % SCCAP_QUEUE_DEPTH;
+	SCCapSemaphorePost(&worker->Full);
+
+	return worker->Error ? SCCAP_ERROR_WRITE : SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapDrain
+//      Waits for the worker to write everything queued
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//  Return Value:
+//      SCCAP_OK, or SCCAP_ERROR_WRITE if the worker has failed to write
+//
+static int SCCapDrain(SCCAP_WRITER * Writer)
+{
+	struct _SCCAP_WORKER *	worker;
+	unsigned int			slot;
+
+	// holding every free slot means the worker has none left to write
+	worker = Writer->Worker;
+	for(slot = 0; slot < SCCAP_QUEUE_DEPTH; slot++)
+		SCCapSemaphoreWait(&worker->Free);
+	for(slot = 0; slot < SCCAP_QUEUE_DEPTH; slot++)
+		SCCapSemaphorePost(&worker->Free);
+
+	return worker->Error ? SCCAP_ERROR_WRITE : SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapStartWorker
+//      Starts the worker of a compressing writer
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//  Return Value:
+//      SCCAP_OK, or SCCAP_ERROR_WRITE if there was no memory or thread
+//      for it
+//
+static int SCCapStartWorker(SCCAP_WRITER * Writer)
+{
+	struct _SCCAP_WORKER *	worker;
+
+	worker = (struct _SCCAP_WORKER *)calloc(1, sizeof(struct _SCCAP_WORKER));
+	if(worker == NULL)
+		return SCCAP_ERROR_WRITE;
+
+	if(!SCCapSemaphoreCreate(&worker->Free, SCCAP_QUEUE_DEPTH))
+	{
+		free(worker);
+		return SCCAP_ERROR_WRITE;
+	}
+	if(!SCCapSemaphoreCreate(&worker->Full, 0))
+	{
+		SCCapSemaphoreDelete(&worker->Free);
+		free(worker);
+		return SCCAP_ERROR_WRITE;
+	}
+
+	worker->Open.Time = Writer->LastTime;
+	worker->Open.Record = Writer->Records;
+	Writer->Worker = worker;
+
+#ifdef _WIN32
+	worker->Thread = CreateThread(NULL, 0, SCCapWorker, Writer, 0, NULL);
+	if(worker->Thread != NULL)
+		return SCCAP_OK;
+#else
+	if(pthread_create(&worker->Thread, NULL, SCCapWorker, Writer) == 0)
+		return SCCAP_OK;
+#endif
+
+	Writer->Worker = NULL;
+	SCCapSemaphoreDelete(&worker->Full);
+	SCCapSemaphoreDelete(&worker->Free);
+	free(worker);
+	return SCCAP_ERROR_WRITE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapStopWorker
+//      Queues what is left of the open segment, stops the worker once it
+//      has written it and frees it. The file is the caller's again.
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//  Return Value:
+//      SCCAP_OK, or SCCAP_ERROR_WRITE if the worker failed to write
+//
+static int SCCapStopWorker(SCCAP_WRITER * Writer)
+{
+	struct _SCCAP_WORKER *	worker;
+	unsigned int			slot;
+	int						result;
+
+	worker = Writer->Worker;
+	if(worker->Open.Records != 0)
+		SCCapQueue(Writer);
+	SCCapQueue(Writer);
+
+#ifdef _WIN32
+	WaitForSingleObject(worker->Thread, INFINITE);
+	CloseHandle(worker->Thread);
+#else
+	pthread_join(worker->Thread, NULL);
+#endif
+
+	result = worker->Error ? SCCAP_ERROR_WRITE : SCCAP_OK;
+
+	SCCapSemaphoreDelete(&worker->Full);
+	SCCapSemaphoreDelete(&worker->Free);
+	free(worker->Open.Data);
+	for(slot = 0; slot < SCCAP_QUEUE_DEPTH; slot++)
+		free(worker->Queue[slot].Data);
+	free(worker->Packed);
+	free(worker);
+	Writer->Worker = NULL;
+	return result;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapCreate
+//      Creates a capture file and writes its header. An existing file is
+//      never overwritten, so a slip on the command line can't lose hours
+//      of recording.
+//
+//  Arguments:
+//      OUT Writer
+//              receives the open writer
+//
+//      IN  Path
+//              file to create
+//
+//      IN  Header
+//              StartTime, Instance and the settings; Magic, Version and
+//              HeaderSize are filled in here
+//
+//  Return Value:
+//      SCCAP_OK or an SCCAP_ERROR_xxx
+//
+int SCCapCreate(SCCAP_WRITER * Writer, const char * Path, const SCCAP_FILE_HEADER * Header)
+{
+	SCCAP_FILE_HEADER	header;
+	FILE *				existing;
+
+	memset(Writer, 0, sizeof(SCCAP_WRITER));
+
+	existing = fopen(Path, "rb");
+	if(existing != NULL)
+	{
+		fclose(existing);
+		return SCCAP_ERROR_EXISTS;
+	}
+
+	Writer->File = fopen(Path, "wb");
+	if(Writer->File == NULL)
+		return SCCAP_ERROR_OPEN;
+
+	Writer->Buffer = (char *)malloc(SCCAP_WRITE_BUFFER);
+	if(Writer->Buffer != NULL)
+		setvbuf(Writer->File, Writer->Buffer, _IOFBF, SCCAP_WRITE_BUFFER);
+
+	header = *Header;
+	memcpy(header.Magic, SCCAP_MAGIC, sizeof(header.Magic));
+	header.Version = SCCAP_VERSION;
+	header.HeaderSize = sizeof(SCCAP_FILE_HEADER);
+
+	Writer->LastTime = header.StartTime;
+	Writer->Bytes = sizeof(SCCAP_FILE_HEADER);
+	Writer->IndexEvery = SCCAP_DEFAULT_INDEX_EVERY;
+	if(fwrite(&header, sizeof(SCCAP_FILE_HEADER), 1, Writer->File) != 1)
+	{
+		Writer->Failed = 1;
+		SCCapFinish(Writer);
+		return SCCAP_ERROR_WRITE;
+	}
+
+	return SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapAppend
+//      Appends one record. A time earlier than the last record's, the
+//      system clock set back, is recorded as no time passing. A
+//      compressing writer starts its worker on the first append, and
+//      reports a failed write one or more segments after it happened.
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//      IN  Time
+//              system time of the data, 100ns units since 1601 UTC
+//
+//      IN  Kind
+//              SCCAP_RECORD_xxx
+//
+//      IN  Data
+//              the payload
+//
+//      IN  Length
+//              bytes at Data
+//
+//      IN  Original
+//              bytes the port moved, for SCCAP_RECORD_TRUNCATED
+//
+//  Return Value:
+//      SCCAP_OK or SCCAP_ERROR_WRITE
+//
+int SCCapAppend(SCCAP_WRITER * Writer, SCCAP_UINT64 Time, unsigned int Kind,
+	const void * Data, unsigned int Length, unsigned int Original)
+{
+	unsigned char		header[SCCAP_RECORD_HEADER_MAX];
+	unsigned int		used;
+	SCCAP_SEGMENT *		segment;
+
+	if(Time < Writer->LastTime)
+		Time = Writer->LastTime;
+
+	header[0] = (unsigned char)(Kind & SCCAP_RECORD_FLAGS);
+	used = 1;
+	used += SCCapPutVarint(header + used, Time - Writer->LastTime);
+	used += SCCapPutVarint(header + used, Length);
+	if(Kind & SCCAP_RECORD_TRUNCATED)
+		used += SCCapPutVarint(header + used, Original);
+
+	if(Writer->Compress)
+	{
+		if((Writer->Worker == NULL) && (SCCapStartWorker(Writer) != SCCAP_OK))
+			return SCCAP_ERROR_WRITE;
+
+		segment = &Writer->Worker->Open;
+		if(!SCCapGrow(&segment->Data, &segment->Room, segment->Length + used + Length))
+			return SCCAP_ERROR_WRITE;
+		memcpy(segment->Data + segment->Length, header, used);
+		if(Length != 0)
+			memcpy(segment->Data + segment->Length + used, Data, Length);
+		segment->Length += used + Length;
+		segment->Records++;
+
+		Writer->LastTime = Time;
+		Writer->Records++;
+
+		if(segment->Records >= ((Writer->IndexEvery != 0) ? Writer->IndexEvery : SCCAP_DEFAULT_INDEX_EVERY))
+			return SCCapQueue(Writer);
+		return SCCAP_OK;
+	}
+
+	if((Writer->Records != 0) && (Writer->IndexEvery != 0) && (Writer->Records % Writer->IndexEvery == 0) &&
+		(SCCapPutIndex(Writer) != SCCAP_OK))
+	{
+		return SCCAP_ERROR_WRITE;
+	}
+
+	if((fwrite(header, 1, used, Writer->File) != used) ||
+		((Length != 0) && (fwrite(Data, 1, Length, Writer->File) != Length)))
+	{
+		return SCCAP_ERROR_WRITE;
+	}
+
+	Writer->LastTime = Time;
+	Writer->Records++;
+	Writer->Bytes += used + Length;
+	return SCCAP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapFlush
+//      Pushes what is buffered to the file, so a reader or a crash sees
+//      everything appended so far. A compressing writer waits for its
+//      worker to write the full segments; the records of the open one
+//      are only written once it is full or the file is finished.
+//
+//  Arguments:
+//      IN  Writer
+//              the writer
+//
+//  Return Value:
+//      SCCAP_OK or SCCAP_ERROR_WRITE
+//
+int SCCapFlush(SCCAP_WRITER * Writer)
+{
+	if((Writer->Worker != NULL) && (SCCapDrain(Writer) != SCCAP_OK))
+		return SCCAP_ERROR_WRITE;
+
+	return (fflush(Writer->File) == 0) ? SCCAP_OK : SCCAP_ERROR_WRITE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCapFinish
+//      Writes the last segment and the footer, then flushes and closes a
+//      capture file. A writer that failed on the way closes the file
+//      without a footer.
+//
+//  Arguments:
+//      IN  Writer
+//              the writer, unusable afterwards
+//
+//  Return Value:
+//      SCCAP_OK or SCCAP_ERROR_WRITE
+//
+int SCCapFinish(SCCAP_WRITER * Writer)
+{
+	SCCAP_FILE_TRAILER	trailer;
+	unsigned char		kind;
+	int					result;
+
+	result = SCCAP_OK;
+	if((Writer->Worker != NULL) && (SCCapStopWorker(Writer) != SCCAP_OK))
+	{
+		Writer->Failed = 1;
+		result = SCCAP_ERROR_WRITE;
+	}
+
+	if(Writer->File != NULL)
+	{
+		if(!Writer->Failed)
+		{
+			memset(&trailer, 0, sizeof(trailer));
+			trailer.IndexOffset = Writer->Bytes + 1;
+			trailer.IndexEntries = Writer->IndexEntries;
+			trailer.Records = Writer->Records;
+			trailer.EndTime = Writer->LastTime;
+			trailer.Size = sizeof(SCCAP_FILE_TRAILER);
+			memcpy(trailer.Magic, SCCAP_TRAILER_MAGIC, sizeof(trailer.Magic));
+
+			kind = SCCAP_BLOCK_FOOTER;
+			if((fwrite(&kind, 1, 1, Writer->File) != 1) ||
+				((Writer->IndexEntries != 0) &&
+					(fwrite(Writer->Index, sizeof(SCCAP_INDEX_ENTRY), (size_t)Writer->IndexEntries, Writer->File) !=
+						(size_t)Writer->IndexEntries)) ||
+				(fwrite(&trailer, sizeof(trailer), 1, Writer->File) != 1))
+			{
+				result = SCCAP_ERROR_WRITE;
+			}
+			Writer->Bytes += 1 + Writer->IndexEntries * sizeof(SCCAP_INDEX_ENTRY) + sizeof(trailer);
+		}
+
+		if(fclose(Writer->File) != 0)
+			result = SCCAP_ERROR_WRITE;
+		Writer->File = NULL;
+	}
+
+	free(Writer->Buffer);
+	Writer->Buffer = NULL;
+	free(Writer->Index);
+	Writer->Index = NULL;
+	return result;
+}
@@ -0,0 +1,704 @@
+// sccapture.c
+//
+// Reader for the SerialClone capture. On Windows it drains a port's
+// capture ring through the port's clone, \\.\COM30 for COM3, with
+// IOCTL_SERIALCLONE_GET_CAPTURE, once or until stopped, and saves or dumps
+// what comes out, or records the port into a capture file; anywhere,
+// including Linux, it dumps either kind of file.
+//
+//	sccapture -d \\.\COM30 [file]	drain once, save to file or dump
+//	sccapture -f \\.\COM30 [file]	keep draining until Ctrl+C
+//	sccapture -w \\.\COM30 file		record the port into a compressed capture file
+//									until Ctrl+C
+//	sccapture file					dump a saved drain or a capture file
+//	sccapture file from [seconds]	dump a capture file from a UTC time,
+//									2005-06-01T14:02:17 say, on
+//
+// A saved drain is each drain appended as the IOCTL returned it: a little
+// endian SERIALCLONE_CAPTURE_HEADER followed by its records. A capture
+// file is described in sccapfile.h; recording one wants CaptureEvery set
+// to 1 and CaptureBytes at least as large as the reads.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#else
+// just enough of the Windows types for intrface.h
+#include <stdint.h>
+typedef uint8_t		UCHAR;
+typedef uint8_t		BOOLEAN;
+typedef uint16_t	USHORT;
+typedef int32_t		LONG;
+typedef uint32_t	ULONG;
+typedef unsigned long long	ULONGLONG;
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
+#define CTL_CODE(type, function, method, access) \
+	(((type) << 16) | ((access) << 14) | ((function) << 2) | (method))
+#define METHOD_BUFFERED		0
+#define FILE_READ_DATA		1
+#endif
+
+#include "../intrface.h"
+#include "../sccapfile/sccapfile.h"
+
+// the layout is fixed by the driver, whatever this compiler thinks
+typedef char SCCAPTURE_HEADER_SIZE_CHECK[(sizeof(SERIALCLONE_CAPTURE_HEADER) == 24) ? 1 : -1];
+typedef char SCCAPTURE_DATA_OFFSET_CHECK[(offsetof(SERIALCLONE_CAPTURE_RECORD, Data) == 24) ? 1 : -1];
+typedef char SCCAPTURE_FILE_HEADER_CHECK[(sizeof(SCCAP_FILE_HEADER) == 64) ? 1 : -1];
+
+// bytes of data on a dump line
+#define SCCAPTURE_LINE		16
+
+// 100ns units from 1601, where system time starts, to 1970, where time_t does
+#define SCCAPTURE_EPOCH		((ULONGLONG)116444736 * 1000000000)
+
+static const char * ScDeviceNames[] = { "drv", "fil", "cln" };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureTime
+//      Formats a system time as UTC date and time to the 100ns
+//
+//  Arguments:
+//      IN  Time
+//              100ns units since 1601 UTC
+//
+//      OUT Text
+//              room for 32 characters
+//
+//  Return Value:
+//      Text
+//
+static const char * SCCaptureTime(ULONGLONG Time, char * Text)
+{
+	time_t		seconds;
+	struct tm *	utc;
+
+	utc = NULL;
+	if(Time >= SCCAPTURE_EPOCH)
+	{
+		seconds = (time_t)((Time - SCCAPTURE_EPOCH) / 10000000);
+		utc = gmtime(&seconds);
+	}
+
+	if(utc == NULL)
+		sprintf(Text, "%lu.%07lu", (unsigned long)(Time / 10000000), (unsigned long)(Time % 10000000));
+	else
+	{
+		sprintf(Text, "%04d-%02d-%02d %02d:%02d:%02d.%07lu", utc->tm_year + 1900, utc->tm_mon + 1, utc->tm_mday,
+			utc->tm_hour, utc->tm_min, utc->tm_sec, (unsigned long)(Time % 10000000));
+	}
+
+	return Text;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureHexdump
+//      Prints bytes as hex and characters, 16 to a line
+//
+//  Arguments:
+//      IN  Data
+//              the bytes
+//
+//      IN  Length
+//              how many
+//
+//  Return Value:
+//      None
+//
+static void SCCaptureHexdump(const unsigned char * Data, ULONG Length)
+{
+	ULONG	i;
+	ULONG	j;
+
+	for(i = 0; i < Length; i += SCCAPTURE_LINE)
+	{
+		printf("  %04lx ", (unsigned long)i);
+		for(j = i; j < i + SCCAPTURE_LINE; j++)
+		{
+			if(j < Length)
+				printf(" %02x", Data[j]);
+			else
+				printf("   ");
+		}
+
+		printf("  ");
+		for(j = i; (j < i + SCCAPTURE_LINE) && (j < Length); j++)
+			putchar(((Data[j] >= 0x20) && (Data[j] < 0x7f)) ? Data[j] : '.');
+		putchar('\n');
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureDumpRecord
+//      Prints one sample, a hex and character dump of the bytes kept
+//
+//  Arguments:
+//      IN  Record
+//              the sample
+//
+//  Return Value:
+//      None
+//
+static void SCCaptureDumpRecord(const SERIALCLONE_CAPTURE_RECORD * Record)
+{
+	char	time[32];
+
+	printf("#%lu %s port %lu %s, %lu bytes %s, %u kept\n",
+		(unsigned long)Record->Sequence, SCCaptureTime(Record->Time, time),
+		(unsigned long)Record->Instance,
+		(Record->Device < sizeof(ScDeviceNames) / sizeof(ScDeviceNames[0])) ? ScDeviceNames[Record->Device] : "?",
+		(unsigned long)Record->Length, (Record->Direction == SERIALCLONE_CAPTURE_TX) ? "written" : "received",
+		(unsigned)Record->Captured);
+
+	SCCaptureHexdump(Record->Data, Record->Captured);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureDump
+//      Prints every drain in a buffer
+//
+//  Arguments:
+//      IN  Capture
+//              one or more drains, back to back
+//
+//      IN  Length
+//              bytes in Capture
+//
+//  Return Value:
+//      0, or 1 if the capture is not one we understand
+//
+static int SCCaptureDump(const unsigned char * Capture, size_t Length)
+{
+	const SERIALCLONE_CAPTURE_HEADER *	header;
+	size_t								records;
+	ULONG								i;
+
+	while(Length != 0)
+	{
+		header = (const SERIALCLONE_CAPTURE_HEADER *)Capture;
+		if((Length < sizeof(SERIALCLONE_CAPTURE_HEADER)) ||
+			(header->Size != sizeof(SERIALCLONE_CAPTURE_HEADER)) ||
+			((header->Records != 0) && (header->SlotSize < offsetof(SERIALCLONE_CAPTURE_RECORD, Data))))
+		{
+			fprintf(stderr, "sccapture: not a SerialClone capture\n");
+			return 1;
+		}
+
+		if(header->SlotSize == 0)
+		{
+			printf("capture is off, see Parameters\\CaptureEvery\n");
+			return 0;
+		}
+
+		records = (size_t)header->Records * header->SlotSize;
+		if(Length - sizeof(SERIALCLONE_CAPTURE_HEADER) < records)
+		{
+			fprintf(stderr, "sccapture: capture is cut short\n");
+			return 1;
+		}
+
+		if(header->Dropped != 0)
+			printf("-- %lu samples overwritten before they were drained\n", (unsigned long)header->Dropped);
+
+		Capture += sizeof(SERIALCLONE_CAPTURE_HEADER);
+		for(i = 0; i < header->Records; i++)
+			SCCaptureDumpRecord((const SERIALCLONE_CAPTURE_RECORD *)(Capture + (size_t)i * header->SlotSize));
+
+		Capture += records;
+		Length -= sizeof(SERIALCLONE_CAPTURE_HEADER) + records;
+	}
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureLoad
+//      Reads a saved capture
+//
+//  Arguments:
+//      IN  Path
+//              the file
+//
+//      OUT Length
+//              bytes read
+//
+//  Return Value:
+//      malloc'd capture, NULL on error
+//
+static unsigned char * SCCaptureLoad(const char * Path, size_t * Length)
+{
+	FILE *			file;
+	unsigned char *	capture;
+	long			size;
+
+	file = fopen(Path, "rb");
+	if(file == NULL)
+	{
+		fprintf(stderr, "sccapture: can't open %s\n", Path);
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	capture = (size > 0) ? (unsigned char *)malloc(size) : NULL;
+	if((capture == NULL) || (fread(capture, 1, size, file) != (size_t)size))
+	{
+		fprintf(stderr, "sccapture: can't read %s\n", Path);
+		free(capture);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+	*Length = (size_t)size;
+	return capture;
+}
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureParseTime
+//      Reads a UTC date and time, YYYY-MM-DDTHH:MM:SS with optional
+//      fractions of a second, a space instead of the T will do
+//
+//  Arguments:
+//      IN  Text
+//              the date and time
+//
+//      OUT Time
+//              receives it as system time, 100ns units since 1601 UTC
+//
+//  Return Value:
+//      nonzero if Text was understood
+//
+static int SCCaptureParseTime(const char * Text, ULONGLONG * Time)
+{
+	int		year, month, day, hour, minute;
+	double	second;
+	long	days;
+	long	era;
+	long	yoe;
+	long	doy;
+
+	if((sscanf(Text, "%d-%d-%d%*c%d:%d:%lf", &year, &month, &day, &hour, &minute, &second) != 6) ||
+		(year < 1970) || (month < 1) || (month > 12) || (day < 1) || (day > 31) ||
+		(hour < 0) || (hour > 23) || (minute < 0) || (minute > 59) || (second < 0) || (second >= 61))
+	{
+		return 0;
+	}
+
+	// days since 1970-01-01 of a proleptic Gregorian date, counted in
+	// 400 year eras that start on March 1st
+	year -= (month <= 2);
+	era = year / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month + ((month > 2) ? -3 : 9)) + 2) / 5 + day - 1;
+	days = era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+
+	*Time = SCCAPTURE_EPOCH + ((ULONGLONG)days * 86400 + hour * 3600 + minute * 60) * 10000000 +
+		(ULONGLONG)(second * 10000000 + 0.5);
+	return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureDumpFile
+//      Prints a capture file, its settings and then the records in a
+//      time range
+//
+//  Arguments:
+//      IN  File
+//              the open capture file
+//
+//      IN  From
+//              first time to print, 0 for the start of the file
+//
+//      IN  To
+//              time to stop at
+//
+//  Return Value:
+//      0, or 1 if the file is damaged
+//
+static int SCCaptureDumpFile(const SCCAP_FILE * File, ULONGLONG From, ULONGLONG To)
+{
+	const SCCAP_FILE_HEADER *	header;
+	SCCAP_CURSOR				cursor;
+	SCCAP_RECORD				record;
+	ULONGLONG					records;
+	ULONGLONG					bytes[2];
+	char						time[32];
+	int							result;
+
+	header = &File->Header;
+	printf("port %lu, recording started %s\n", (unsigned long)header->Instance, SCCaptureTime(header->StartTime, time));
+	if(header->Valid & SERIALCLONE_STATE_BAUD_RATE)
+		printf("  %lu baud\n", (unsigned long)header->BaudRate);
+	if(header->Valid & SERIALCLONE_STATE_LINE_CONTROL)
+	{
+		printf("  %u data bits, parity %u, stop bits %u\n", (unsigned)header->WordLength, (unsigned)header->Parity,
+			(unsigned)header->StopBits);
+	}
+	if(header->Valid & SERIALCLONE_STATE_HANDFLOW)
+	{
+		printf("  handshake %08lx flow %08lx xon %02x xoff %02x\n", (unsigned long)header->ControlHandShake,
+			(unsigned long)header->FlowReplace, (unsigned)header->XonChar, (unsigned)header->XoffChar);
+	}
+
+	if(File->Trailer.Size != 0)
+	{
+		printf("  %lu records to %s, indexed at %lu points\n", (unsigned long)File->Trailer.Records,
+			SCCaptureTime(File->Trailer.EndTime, time), (unsigned long)File->Trailer.IndexEntries);
+	}
+	else
+		printf("  not finished, no index\n");
+
+	records = 0;
+	bytes[0] = 0;
+	bytes[1] = 0;
+	result = SCCapSeek(File, From, &cursor);
+	while((result == SCCAP_OK) && ((result = SCCapNext(File, &cursor, &record)) == SCCAP_OK))
+	{
+		if(record.Time >= To)
+		{
+			result = SCCAP_END;
+			break;
+		}
+
+		if(record.Kind & SCCAP_RECORD_GAP)
+			printf("-- samples lost here\n");
+
+		printf("%s %s %lu bytes", SCCaptureTime(record.Time, time),
+			(record.Kind & SCCAP_RECORD_TX) ? "tx" : "rx", (unsigned long)record.Length);
+		if(record.Kind & SCCAP_RECORD_TRUNCATED)
+			printf(" of %lu", (unsigned long)record.Original);
+		putchar('\n');
+
+		SCCaptureHexdump(record.Data, record.Length);
+		records++;
+		bytes[record.Kind & SCCAP_RECORD_TX] += record.Original;
+	}
+
+	printf("%lu records, %lu bytes received, %lu written\n", (unsigned long)records, (unsigned long)bytes[0],
+		(unsigned long)bytes[1]);
+
+	if(result == SCCAP_ERROR_TRUNCATED)
+		printf("-- the last record is cut short, the recording was not finished\n");
+	else if(result != SCCAP_END)
+	{
+		fprintf(stderr, "sccapture: damaged at offset %lu\n", (unsigned long)cursor.Offset);
+		return 1;
+	}
+
+	return 0;
+}
+
+#ifdef _WIN32
+// room for a full default ring in one drain
+#define SCCAPTURE_DRAIN_BYTES	(256 * 1024)
+
+// how long -f and -w wait between drains
+#define SCCAPTURE_POLL_MS		250
+
+static volatile LONG ScCaptureStop;
+
+static BOOL WINAPI SCCaptureCtrlHandler(DWORD CtrlType)
+{
+	InterlockedExchange((LONG *)&ScCaptureStop, 1);
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureCreateFile
+//      Starts a capture file of the port a drain came from, with the
+//      settings the port has now
+//
+//  Arguments:
+//      IN  hDev
+//              the port
+//
+//      IN  Instance
+//              the port's instance, from the drain
+//
+//      OUT Writer
+//              receives the writer
+//
+//      IN  Path
+//              capture file to create
+//
+//  Return Value:
+//      0, or 1 on error
+//
+static int SCCaptureCreateFile(HANDLE hDev, ULONG Instance, SCCAP_WRITER * Writer, const char * Path)
+{
+	SERIALCLONE_PORT_STATE	state;
+	SCCAP_FILE_HEADER		header;
+	FILETIME				now;
+	DWORD					returned;
+	int						result;
+
+	memset(&header, 0, sizeof(header));
+	GetSystemTimeAsFileTime(&now);
+	header.StartTime = ((ULONGLONG)now.dwHighDateTime << 32) | now.dwLowDateTime;
+	header.Instance = Instance;
+
+	// the settings are nice to have, a recording without them still replays
+	if(DeviceIoControl(hDev, IOCTL_SERIALCLONE_GET_PORT_STATE, NULL, 0, &state, sizeof(state), &returned, NULL) &&
+		(returned >= sizeof(state)))
+	{
+		header.Valid = state.Valid & (SERIALCLONE_STATE_BAUD_RATE | SERIALCLONE_STATE_LINE_CONTROL |
+			SERIALCLONE_STATE_HANDFLOW);
+		header.BaudRate = state.BaudRate;
+		header.StopBits = state.StopBits;
+		header.Parity = state.Parity;
+		header.WordLength = state.WordLength;
+		header.ControlHandShake = state.ControlHandShake;
+		header.FlowReplace = state.FlowReplace;
+		header.XonChar = state.XonChar;
+		header.XoffChar = state.XoffChar;
+	}
+
+	// serial traffic is mostly text and framing, and hours of it
+	// compress well
+	result = SCCapCreate(Writer, Path, &header);
+	Writer->Compress = 1;
+	if(result == SCCAP_ERROR_EXISTS)
+		fprintf(stderr, "sccapture: %s is already there, not overwriting it\n", Path);
+	else if(result != SCCAP_OK)
+		fprintf(stderr, "sccapture: can't create %s\n", Path);
+
+	return (result != SCCAP_OK);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureRecord
+//      Appends the records of one drain to the port's capture file
+//
+//  Arguments:
+//      IN  Writer
+//              the capture file
+//
+//      IN  Drain
+//              what IOCTL_SERIALCLONE_GET_CAPTURE returned
+//
+//  Return Value:
+//      0, or 1 on error
+//
+static int SCCaptureRecord(SCCAP_WRITER * Writer, const unsigned char * Drain)
+{
+	const SERIALCLONE_CAPTURE_HEADER *	header;
+	const SERIALCLONE_CAPTURE_RECORD *	record;
+	unsigned int						kind;
+	unsigned int						gap;
+	ULONG								i;
+
+	header = (const SERIALCLONE_CAPTURE_HEADER *)Drain;
+	gap = (header->Dropped != 0) ? SCCAP_RECORD_GAP : 0;
+
+	for(i = 0; i < header->Records; i++)
+	{
+		record = (const SERIALCLONE_CAPTURE_RECORD *)(Drain + sizeof(SERIALCLONE_CAPTURE_HEADER) +
+			(size_t)i * header->SlotSize);
+		kind = gap;
+		if(record->Direction == SERIALCLONE_CAPTURE_TX)
+			kind |= SCCAP_RECORD_TX;
+		if(record->Captured < record->Length)
+			kind |= SCCAP_RECORD_TRUNCATED;
+
+		if(SCCapAppend(Writer, record->Time, kind, record->Data, record->Captured, record->Length) != SCCAP_OK)
+			return 1;
+		gap = 0;
+	}
+
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCCaptureDrain
+//      Drains a port's capture ring through its clone, once or until
+//      Ctrl+C, saving or dumping each drain as it comes, or recording
+//      the port into a capture file
+//
+//  Arguments:
+//      IN  Device
+//              the clone's name, \\.\COM30 for COM3; the port itself
+//              refuses the drain
+//
+//      IN  Path
+//              file to append to or capture file to create, NULL to dump
+//
+//      IN  Mode
+//              'd' to drain once, 'f' to keep draining, 'w' to record
+//
+//  Return Value:
+//      0, or 1 on error
+//
+static int SCCaptureDrain(const char * Device, const char * Path, int Mode)
+{
+	HANDLE								hDev;
+	FILE *								file;
+	SCCAP_WRITER						writer;
+	unsigned char *						buffer;
+	const SERIALCLONE_CAPTURE_HEADER *	header;
+	DWORD								returned;
+	int									result;
+
+	hDev = CreateFileA(Device, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+	if(hDev == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "sccapture: can't open %s (%lu)\n", Device, GetLastError());
+		return 1;
+	}
+
+	file = NULL;
+	if((Mode != 'w') && (Path != NULL) && ((file = fopen(Path, "ab")) == NULL))
+	{
+		fprintf(stderr, "sccapture: can't open %s\n", Path);
+		CloseHandle(hDev);
+		return 1;
+	}
+
+	memset(&writer, 0, sizeof(writer));
+	buffer = (unsigned char *)malloc(SCCAPTURE_DRAIN_BYTES);
+	header = (const SERIALCLONE_CAPTURE_HEADER *)buffer;
+	result = (buffer == NULL);
+	if(Mode != 'd')
+		SetConsoleCtrlHandler(SCCaptureCtrlHandler, TRUE);
+
+	while(!result && !ScCaptureStop)
+	{
+		if(!DeviceIoControl(hDev, IOCTL_SERIALCLONE_GET_CAPTURE, NULL, 0, buffer, SCCAPTURE_DRAIN_BYTES, &returned, NULL))
+		{
+			fprintf(stderr, "sccapture: IOCTL_SERIALCLONE_GET_CAPTURE failed (%lu)\n", GetLastError());
+			result = 1;
+			break;
+		}
+
+		if(Mode == 'w')
+		{
+			if(header->SlotSize == 0)
+			{
+				fprintf(stderr, "sccapture: capture is off, see Parameters\\CaptureEvery\n");
+				result = 1;
+				break;
+			}
+
+			// the first drain tells us which port this is
+			if(writer.File == NULL)
+				result = SCCaptureCreateFile(hDev, header->Instance, &writer, Path);
+			if(!result && SCCaptureRecord(&writer, buffer))
+			{
+				fprintf(stderr, "sccapture: can't write %s\n", Path);
+				result = 1;
+			}
+		}
+		else if(file == NULL)
+			result = SCCaptureDump(buffer, returned);
+		else if((header->Records != 0) || (header->Dropped != 0))
+		{
+			if(fwrite(buffer, 1, returned, file) != returned)
+			{
+				fprintf(stderr, "sccapture: can't write %s\n", Path);
+				result = 1;
+			}
+		}
+
+		if((Mode == 'd') || (header->SlotSize == 0))
+			break;
+
+		// a full buffer means there is more waiting, go straight back for it
+		if(SCCAPTURE_DRAIN_BYTES - returned < header->SlotSize)
+			continue;
+
+		// caught up, let what we have reach the disk while we wait
+		if((writer.File != NULL) && (SCCapFlush(&writer) != SCCAP_OK))
+		{
+			fprintf(stderr, "sccapture: can't write %s\n", Path);
+			result = 1;
+		}
+		Sleep(SCCAPTURE_POLL_MS);
+	}
+
+	if(writer.File != NULL)
+	{
+		if((SCCapFinish(&writer) != SCCAP_OK) && !result)
+		{
+			fprintf(stderr, "sccapture: can't write %s\n", Path);
+			result = 1;
+		}
+		printf("%lu records, %lu bytes in %s\n", (unsigned long)writer.Records, (unsigned long)writer.Bytes, Path);
+	}
+
+	free(buffer);
+	if(file != NULL)
+		fclose(file);
+	CloseHandle(hDev);
+	return result;
+}
+#endif
+
+int main(int argc, char ** argv)
+{
+	SCCAP_FILE		capfile;
+	unsigned char *	capture;
+	size_t			length;
+	ULONGLONG		from;
+	ULONGLONG		to;
+	int				result;
+
+#ifdef _WIN32
+	if((argc == 3 || argc == 4) && ((strcmp(argv[1], "-d") == 0) || (strcmp(argv[1], "-f") == 0)))
+		return SCCaptureDrain(argv[2], (argc == 4) ? argv[3] : NULL, argv[1][1]);
+	if((argc == 4) && (strcmp(argv[1], "-w") == 0))
+		return SCCaptureDrain(argv[2], argv[3], 'w');
+#endif
+
+	from = 0;
+	to = ~(ULONGLONG)0;
+	if((argc >= 3) && !SCCaptureParseTime(argv[2], &from))
+		argc = 0;
+	if(argc == 4)
+		to = from + (ULONGLONG)(atof(argv[3]) * 10000000);
+
+	if(argc < 2 || argc > 4 || argv[1][0] == '-')
+	{
+		fprintf(stderr, "usage: sccapture file [YYYY-MM-DDTHH:MM:SS [seconds]]\n");
+#ifdef _WIN32
+		fprintf(stderr, "       sccapture -d|-f \\\\.\\COMn0 [file]\n");
+		fprintf(stderr, "       sccapture -w \\\\.\\COMn0 file\n");
+#endif
+		return 2;
+	}
+
+	// a capture file, or failing that a saved drain
+	result = SCCapOpen(&capfile, argv[1]);
+	if(result == SCCAP_OK)
+	{
+		result = SCCaptureDumpFile(&capfile, from, to);
+		SCCapClose(&capfile);
+		return result;
+	}
+
+	if(argc != 2)
+	{
+		fprintf(stderr, "sccapture: only capture files can be dumped from a time\n");
+		return 2;
+	}
+
+	length = 0;
+	capture = SCCaptureLoad(argv[1], &length);
+	if(capture == NULL)
+		return 1;
+
+	result = SCCaptureDump(capture, length);
+	free(capture);
+	return result;
+}
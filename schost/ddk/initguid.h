@@ -0,0 +1,11 @@
+// initguid.h
+//
+// Included ahead of the headers that DEFINE_GUID, makes them define the
+// GUIDs rather than declare them.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#define INITGUID
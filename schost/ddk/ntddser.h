@@ -0,0 +1,142 @@
+// ntddser.h
+//
+// Serial port IOCTLs and their structures, as the DDK's ntddser.h defines
+// them, for the driver and the simulated ports below it.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCHOST_NTDDSER_H__
+#define __SCHOST_NTDDSER_H__
+
+#define SERIAL_CTL_CODE(f)	CTL_CODE(FILE_DEVICE_SERIAL_PORT, (f), METHOD_BUFFERED, FILE_ANY_ACCESS)
+
+#define IOCTL_SERIAL_SET_BAUD_RATE		SERIAL_CTL_CODE(1)
+#define IOCTL_SERIAL_SET_QUEUE_SIZE		SERIAL_CTL_CODE(2)
+#define IOCTL_SERIAL_SET_LINE_CONTROL	SERIAL_CTL_CODE(3)
+#define IOCTL_SERIAL_SET_BREAK_ON		SERIAL_CTL_CODE(4)
+#define IOCTL_SERIAL_SET_BREAK_OFF		SERIAL_CTL_CODE(5)
+#define IOCTL_SERIAL_IMMEDIATE_CHAR		SERIAL_CTL_CODE(6)
+#define IOCTL_SERIAL_SET_TIMEOUTS		SERIAL_CTL_CODE(7)
+#define IOCTL_SERIAL_GET_TIMEOUTS		SERIAL_CTL_CODE(8)
+#define IOCTL_SERIAL_SET_DTR			SERIAL_CTL_CODE(9)
+#define IOCTL_SERIAL_CLR_DTR			SERIAL_CTL_CODE(10)
+#define IOCTL_SERIAL_RESET_DEVICE		SERIAL_CTL_CODE(11)
+#define IOCTL_SERIAL_SET_RTS			SERIAL_CTL_CODE(12)
+#define IOCTL_SERIAL_CLR_RTS			SERIAL_CTL_CODE(13)
+#define IOCTL_SERIAL_SET_XOFF			SERIAL_CTL_CODE(14)
+#define IOCTL_SERIAL_SET_XON			SERIAL_CTL_CODE(15)
+#define IOCTL_SERIAL_GET_WAIT_MASK		SERIAL_CTL_CODE(16)
+#define IOCTL_SERIAL_SET_WAIT_MASK		SERIAL_CTL_CODE(17)
+#define IOCTL_SERIAL_WAIT_ON_MASK		SERIAL_CTL_CODE(18)
+#define IOCTL_SERIAL_PURGE				SERIAL_CTL_CODE(19)
+#define IOCTL_SERIAL_GET_BAUD_RATE		SERIAL_CTL_CODE(20)
+#define IOCTL_SERIAL_GET_LINE_CONTROL	SERIAL_CTL_CODE(21)
+#define IOCTL_SERIAL_GET_CHARS			SERIAL_CTL_CODE(22)
+#define IOCTL_SERIAL_SET_CHARS			SERIAL_CTL_CODE(23)
+#define IOCTL_SERIAL_GET_HANDFLOW		SERIAL_CTL_CODE(24)
+#define IOCTL_SERIAL_SET_HANDFLOW		SERIAL_CTL_CODE(25)
+#define IOCTL_SERIAL_GET_MODEMSTATUS	SERIAL_CTL_CODE(26)
+#define IOCTL_SERIAL_GET_COMMSTATUS		SERIAL_CTL_CODE(27)
+#define IOCTL_SERIAL_XOFF_COUNTER		SERIAL_CTL_CODE(28)
+#define IOCTL_SERIAL_GET_PROPERTIES		SERIAL_CTL_CODE(29)
+#define IOCTL_SERIAL_GET_DTRRTS			SERIAL_CTL_CODE(30)
+#define IOCTL_SERIAL_LSRMST_INSERT		SERIAL_CTL_CODE(31)
+#define IOCTL_SERIAL_CONFIG_SIZE		SERIAL_CTL_CODE(32)
+#define IOCTL_SERIAL_GET_STATS			SERIAL_CTL_CODE(35)
+#define IOCTL_SERIAL_CLEAR_STATS		SERIAL_CTL_CODE(36)
+#define IOCTL_SERIAL_GET_MODEM_CONTROL	SERIAL_CTL_CODE(37)
+#define IOCTL_SERIAL_SET_MODEM_CONTROL	SERIAL_CTL_CODE(38)
+#define IOCTL_SERIAL_SET_FIFO_CONTROL	SERIAL_CTL_CODE(39)
+
+typedef struct _SERIAL_BAUD_RATE
+{
+	ULONG		BaudRate;
+} SERIAL_BAUD_RATE, *PSERIAL_BAUD_RATE;
+
+typedef struct _SERIAL_LINE_CONTROL
+{
+	UCHAR		StopBits;
+	UCHAR		Parity;
+	UCHAR		WordLength;
+} SERIAL_LINE_CONTROL, *PSERIAL_LINE_CONTROL;
+
+typedef struct _SERIAL_TIMEOUTS
+{
+	ULONG		ReadIntervalTimeout;
+	ULONG		ReadTotalTimeoutMultiplier;
+	ULONG		ReadTotalTimeoutConstant;
+	ULONG		WriteTotalTimeoutMultiplier;
+	ULONG		WriteTotalTimeoutConstant;
+} SERIAL_TIMEOUTS, *PSERIAL_TIMEOUTS;
+
+typedef struct _SERIAL_CHARS
+{
+	UCHAR		EofChar;
+	UCHAR		ErrorChar;
+	UCHAR		BreakChar;
+	UCHAR		EventChar;
+	UCHAR		XonChar;
+	UCHAR		XoffChar;
+} SERIAL_CHARS, *PSERIAL_CHARS;
+
+typedef struct _SERIAL_HANDFLOW
+{
+	ULONG		ControlHandShake;
+	ULONG		FlowReplace;
+	LONG		XonLimit;
+	LONG		XoffLimit;
+} SERIAL_HANDFLOW, *PSERIAL_HANDFLOW;
+
+typedef struct _SERIAL_STATUS
+{
+	ULONG		Errors;
+	ULONG		HoldReasons;
+	ULONG		AmountInInQueue;
+	ULONG		AmountInOutQueue;
+	BOOLEAN		EofReceived;
+	BOOLEAN		WaitForImmediate;
+} SERIAL_STATUS, *PSERIAL_STATUS;
+
+#define STOP_BIT_1			0
+#define STOP_BITS_1_5		1
+#define STOP_BITS_2			2
+
+#define NO_PARITY			0
+#define ODD_PARITY			1
+#define EVEN_PARITY			2
+#define MARK_PARITY			3
+#define SPACE_PARITY		4
+
+#define SERIAL_EV_RXCHAR	0x0001
+#define SERIAL_EV_RXFLAG	0x0002
+#define SERIAL_EV_TXEMPTY	0x0004
+#define SERIAL_EV_CTS		0x0008
+#define SERIAL_EV_DSR		0x0010
+#define SERIAL_EV_RLSD		0x0020
+#define SERIAL_EV_BREAK		0x0040
+#define SERIAL_EV_ERR		0x0080
+#define SERIAL_EV_RING		0x0100
+#define SERIAL_EV_PERR		0x0200
+#define SERIAL_EV_RX80FULL	0x0400
+#define SERIAL_EV_EVENT1	0x0800
+#define SERIAL_EV_EVENT2	0x1000
+
+#define SERIAL_PURGE_TXABORT	0x00000001
+#define SERIAL_PURGE_RXABORT	0x00000002
+#define SERIAL_PURGE_TXCLEAR	0x00000004
+#define SERIAL_PURGE_RXCLEAR	0x00000008
+
+// IOCTL_SERIAL_GET_DTRRTS
+#define SERIAL_DTR_STATE		0x00000001
+#define SERIAL_RTS_STATE		0x00000002
+
+// IOCTL_SERIAL_GET_MODEMSTATUS, the modem status register
+#define SERIAL_MSR_CTS			0x10
+#define SERIAL_MSR_DSR			0x20
+#define SERIAL_MSR_RI			0x40
+#define SERIAL_MSR_DCD			0x80
+
+#endif // __SCHOST_NTDDSER_H__
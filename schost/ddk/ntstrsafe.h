@@ -0,0 +1,24 @@
+// ntstrsafe.h
+//
+// The bounded string functions the driver uses. Wide formats are taken to
+// be plain ASCII, which all of the driver's are. Formats go to the C
+// library, so the Microsoft only %S is not understood; the driver only
+// uses it for names read by registry enumeration, which the shim doesn't do.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCHOST_NTSTRSAFE_H__
+#define __SCHOST_NTSTRSAFE_H__
+
+#include <stdarg.h>
+
+NTSTATUS RtlStringCbLengthA(PCSTR String, size_t Size, size_t * Length);
+NTSTATUS RtlStringCbCopyW(PWSTR Destination, size_t Size, PCWSTR Source);
+NTSTATUS RtlStringCbPrintfA(PSTR Destination, size_t Size, PCSTR Format, ...);
+NTSTATUS RtlStringCbVPrintfA(PSTR Destination, size_t Size, PCSTR Format, va_list Arguments);
+NTSTATUS RtlStringCbPrintfW(PWSTR Destination, size_t Size, PCWSTR Format, ...);
+
+#endif // __SCHOST_NTSTRSAFE_H__
@@ -0,0 +1,1056 @@
+// wdm.h
+//
+// The part of the DDK's wdm.h the driver uses, for building it on the
+// host. Names, types and the IRP layout follow the DDK so the driver
+// compiles unchanged; the objects themselves only carry what shim.c and
+// io.c need to run it, and are not binary compatible with the real ones.
+//
+// Types are sized as on 32 and 64 bit Windows: LONG and ULONG stay 32 bits
+// on an LP64 host, ULONG_PTR follows the pointer. Wide strings need
+// -fshort-wchar.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCHOST_WDM_H__
+#define __SCHOST_WDM_H__
+
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// compiler and annotation keywords
+#define __stdcall
+#define __inline			static inline
+#define FORCEINLINE			static inline
+#define IN
+#define OUT
+#define OPTIONAL
+#define VOID				void
+#define CONST				const
+#define DECLSPEC_ALIGN(x)	__attribute__((aligned(x)))
+#define C_ASSERT(e)			typedef char __C_ASSERT__[(e) ? 1 : -1]
+
+// the driver pastes __FUNCTION__ onto string literals as MSVC allows;
+// gcc's is not a literal, so messages carry the file instead
+#undef __FUNCTION__
+#define __FUNCTION__		__FILE__ ": "
+
+// basic types
+typedef void *				PVOID;
+typedef char				CHAR, *PCHAR, *PCCHAR, *PSTR;
+typedef const char *		PCSTR;
+typedef char				CCHAR;
+typedef unsigned char		UCHAR, *PUCHAR;
+typedef UCHAR				BOOLEAN, *PBOOLEAN;
+typedef short				SHORT, CSHORT;
+typedef unsigned short		USHORT, *PUSHORT;
+typedef unsigned short		WCHAR, *PWCHAR, *PWSTR;
+typedef const WCHAR *		PCWSTR;
+typedef int					LONG, *PLONG;
+typedef unsigned int		ULONG, *PULONG, DWORD;
+typedef long long			LONGLONG, *PLONGLONG;
+typedef unsigned long long	ULONGLONG, *PULONGLONG;
+typedef long				LONG_PTR;
+typedef unsigned long		ULONG_PTR, *PULONG_PTR, SIZE_T, *PSIZE_T;
+typedef LONG				NTSTATUS;
+typedef UCHAR				KIRQL, *PKIRQL;
+typedef ULONG_PTR			KSPIN_LOCK, *PKSPIN_LOCK;
+typedef PVOID				HANDLE, *PHANDLE;
+typedef ULONG				ACCESS_MASK;
+typedef LONG				KPRIORITY;
+typedef CCHAR				KPROCESSOR_MODE;
+typedef ULONG_PTR			KAFFINITY;
+
+typedef union _LARGE_INTEGER
+{
+	struct
+	{
+		ULONG	LowPart;
+		LONG	HighPart;
+	};
+	struct
+	{
+		ULONG	LowPart;
+		LONG	HighPart;
+	} u;
+	LONGLONG	QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef struct _GUID
+{
+	ULONG	Data1;
+	USHORT	Data2;
+	USHORT	Data3;
+	UCHAR	Data4[8];
+} GUID, *LPGUID, *PGUID;
+typedef const GUID *		LPCGUID;
+
+// with initguid.h included first every file defines the GUIDs it sees, as
+// the DDK's do; the definitions are weak so the linker keeps one of each
+#ifdef INITGUID
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+	const GUID __attribute__((weak)) name = { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }
+#else
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+	extern const GUID name
+#endif
+
+#define TRUE				1
+#define FALSE				0
+#define MAXUCHAR			0xff
+#define MAXUSHORT			0xffff
+#define MAXULONG			0xffffffffU
+#define MAXLONG				0x7fffffff
+#define UNICODE_NULL		((WCHAR)0)
+#define ANSI_NULL			((CHAR)0)
+
+#define FIELD_OFFSET(type, field)		((LONG)offsetof(type, field))
+#define RTL_FIELD_SIZE(type, field)		(sizeof(((type *)0)->field))
+#define CONTAINING_RECORD(address, type, field) \
+	((type *)((PCHAR)(address) - offsetof(type, field)))
+#define ARGUMENT_PRESENT(p)				((p) != NULL)
+#define UNREFERENCED_PARAMETER(p)		((void)(p))
+
+#ifndef min
+#define min(a, b)			(((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)			(((a) > (b)) ? (a) : (b))
+#endif
+
+// status codes
+#define NT_SUCCESS(s)		(((NTSTATUS)(s)) >= 0)
+#define NT_ERROR(s)			((((ULONG)(s)) >> 30) == 3)
+
+#define STATUS_SUCCESS						((NTSTATUS)0x00000000L)
+#define STATUS_TIMEOUT						((NTSTATUS)0x00000102L)
+#define STATUS_PENDING						((NTSTATUS)0x00000103L)
+#define STATUS_BUFFER_OVERFLOW				((NTSTATUS)0x80000005L)
+#define STATUS_DEVICE_BUSY					((NTSTATUS)0x80000011L)
+#define STATUS_NO_MORE_ENTRIES				((NTSTATUS)0x8000001AL)
+#define STATUS_UNSUCCESSFUL					((NTSTATUS)0xC0000001L)
+#define STATUS_NOT_IMPLEMENTED				((NTSTATUS)0xC0000002L)
+#define STATUS_INVALID_PARAMETER			((NTSTATUS)0xC000000DL)
+#define STATUS_NO_SUCH_DEVICE				((NTSTATUS)0xC000000EL)
+#define STATUS_INVALID_DEVICE_REQUEST		((NTSTATUS)0xC0000010L)
+#define STATUS_MORE_PROCESSING_REQUIRED		((NTSTATUS)0xC0000016L)
+#define STATUS_ACCESS_DENIED				((NTSTATUS)0xC0000022L)
+#define STATUS_BUFFER_TOO_SMALL				((NTSTATUS)0xC0000023L)
+#define STATUS_OBJECT_NAME_NOT_FOUND		((NTSTATUS)0xC0000034L)
+#define STATUS_OBJECT_NAME_COLLISION		((NTSTATUS)0xC0000035L)
+#define STATUS_DELETE_PENDING				((NTSTATUS)0xC0000056L)
+#define STATUS_INSUFFICIENT_RESOURCES		((NTSTATUS)0xC000009AL)
+#define STATUS_NOT_SUPPORTED				((NTSTATUS)0xC00000BBL)
+#define STATUS_CANCELLED					((NTSTATUS)0xC0000120L)
+#define STATUS_INVALID_DEVICE_STATE			((NTSTATUS)0xC0000184L)
+#define STATUS_WMI_GUID_NOT_FOUND			((NTSTATUS)0xC0000295L)
+#define STATUS_WMI_INSTANCE_NOT_FOUND		((NTSTATUS)0xC0000296L)
+#define STATUS_DEVICE_REMOVED				((NTSTATUS)0xC00002B6L)
+#define STATUS_WMI_READ_ONLY				((NTSTATUS)0xC00002C6L)
+
+// IRQLs and priority boosts
+#define PASSIVE_LEVEL		0
+#define APC_LEVEL			1
+#define DISPATCH_LEVEL		2
+
+#define IO_NO_INCREMENT		0
+#define IO_SERIAL_INCREMENT	2
+
+#define MAXIMUM_PROCESSORS	32
+#define PAGE_SIZE			4096
+
+// debugging
+ULONG DbgPrint(PCSTR Format, ...);
+VOID DbgBreakPoint(VOID);
+VOID SCHostAssert(PCSTR Expression, PCSTR File, int Line);
+
+#if DBG
+#define ASSERT(e)			((e) ? (void)0 : SCHostAssert(#e, __FILE__, __LINE__))
+#define ASSERTMSG(m, e)		((e) ? (void)0 : SCHostAssert(m, __FILE__, __LINE__))
+#else
+#define ASSERT(e)			((void)0)
+#define ASSERTMSG(m, e)		((void)0)
+#endif
+#define PAGED_CODE()		((void)0)
+
+// doubly and singly linked lists
+typedef struct _LIST_ENTRY
+{
+	struct _LIST_ENTRY *	Flink;
+	struct _LIST_ENTRY *	Blink;
+} LIST_ENTRY, *PLIST_ENTRY;
+
+typedef struct _SINGLE_LIST_ENTRY
+{
+	struct _SINGLE_LIST_ENTRY *	Next;
+} SINGLE_LIST_ENTRY, *PSINGLE_LIST_ENTRY;
+
+// The driver's own list updates, with SCHOST_LIST_POINTS, are points
+// where processors racing may be switched, between reading the links and
+// writing them as a processor can be; the shim's lists are the kernel's
+// and stay whole, the kernel keeps them under its own locks.
+VOID SCHostRacePoint(VOID);
+
+#ifdef SCHOST_LIST_POINTS
+#define SCHostListPoint()	SCHostRacePoint()
+#else
+#define SCHostListPoint()
+#endif
+
+FORCEINLINE VOID InitializeListHead(PLIST_ENTRY ListHead)
+{
+	ListHead->Flink = ListHead->Blink = ListHead;
+}
+
+FORCEINLINE BOOLEAN IsListEmpty(const LIST_ENTRY * ListHead)
+{
+	return (BOOLEAN)(ListHead->Flink == ListHead);
+}
+
+FORCEINLINE BOOLEAN RemoveEntryList(PLIST_ENTRY Entry)
+{
+	PLIST_ENTRY	flink = Entry->Flink;
+	PLIST_ENTRY	blink = Entry->Blink;
+
+	SCHostListPoint();
+	blink->Flink = flink;
+	flink->Blink = blink;
+	return (BOOLEAN)(flink == blink);
+}
+
+FORCEINLINE PLIST_ENTRY RemoveHeadList(PLIST_ENTRY ListHead)
+{
+	PLIST_ENTRY	entry = ListHead->Flink;
+
+	RemoveEntryList(entry);
+	return entry;
+}
+
+FORCEINLINE PLIST_ENTRY RemoveTailList(PLIST_ENTRY ListHead)
+{
+	PLIST_ENTRY	entry = ListHead->Blink;
+
+	RemoveEntryList(entry);
+	return entry;
+}
+
+FORCEINLINE VOID InsertTailList(PLIST_ENTRY ListHead, PLIST_ENTRY Entry)
+{
+	PLIST_ENTRY	blink = ListHead->Blink;
+
+	SCHostListPoint();
+	Entry->Flink = ListHead;
+	Entry->Blink = blink;
+	blink->Flink = Entry;
+	ListHead->Blink = Entry;
+}
+
+FORCEINLINE VOID InsertHeadList(PLIST_ENTRY ListHead, PLIST_ENTRY Entry)
+{
+	PLIST_ENTRY	flink = ListHead->Flink;
+
+	SCHostListPoint();
+	Entry->Flink = flink;
+	Entry->Blink = ListHead;
+	flink->Blink = Entry;
+	ListHead->Flink = Entry;
+}
+
+// strings
+typedef struct _UNICODE_STRING
+{
+	USHORT		Length;
+	USHORT		MaximumLength;
+	PWSTR		Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+typedef const UNICODE_STRING *	PCUNICODE_STRING;
+
+typedef struct _STRING
+{
+	USHORT		Length;
+	USHORT		MaximumLength;
+	PCHAR		Buffer;
+} STRING, ANSI_STRING, *PANSI_STRING;
+
+// the C library's wcslen is for its own wchar_t, not WCHAR
+#define wcslen				SCHostWcslen
+size_t SCHostWcslen(const WCHAR * String);
+
+VOID RtlInitUnicodeString(PUNICODE_STRING Destination, PCWSTR Source);
+VOID RtlCopyUnicodeString(PUNICODE_STRING Destination, PCUNICODE_STRING Source);
+NTSTATUS RtlAppendUnicodeToString(PUNICODE_STRING Destination, PCWSTR Source);
+NTSTATUS RtlAppendUnicodeStringToString(PUNICODE_STRING Destination, PCUNICODE_STRING Source);
+NTSTATUS RtlIntegerToUnicodeString(ULONG Value, ULONG Base, PUNICODE_STRING String);
+NTSTATUS RtlUnicodeStringToAnsiString(PANSI_STRING Destination, PCUNICODE_STRING Source, BOOLEAN Allocate);
+VOID RtlFreeAnsiString(PANSI_STRING String);
+
+// memory
+#define RtlCopyMemory(d, s, l)		memcpy((d), (s), (l))
+#define RtlMoveMemory(d, s, l)		memmove((d), (s), (l))
+#define RtlZeroMemory(d, l)			memset((d), 0, (l))
+#define RtlFillMemory(d, l, f)		memset((d), (f), (l))
+#define RtlEqualMemory(a, b, l)		(!memcmp((a), (b), (l)))
+SIZE_T RtlCompareMemory(const VOID * Source1, const VOID * Source2, SIZE_T Length);
+
+typedef enum _POOL_TYPE
+{
+	NonPagedPool,
+	PagedPool,
+	NonPagedPoolMustSucceed,
+	DontUseThisType,
+	NonPagedPoolCacheAligned,
+	PagedPoolCacheAligned
+} POOL_TYPE;
+
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
+VOID ExFreePool(PVOID P);
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag);
+#define ExAllocatePool(type, size)	ExAllocatePoolWithTag((type), (size), 0)
+
+// interlocked operations, full barriers as on x86; each is a point where
+// processors racing, race.c, may be switched
+#define InterlockedIncrement(p)					(SCHostRacePoint(), __sync_add_and_fetch((p), 1))
+#define InterlockedDecrement(p)					(SCHostRacePoint(), __sync_sub_and_fetch((p), 1))
+#define InterlockedExchangeAdd(p, v)			(SCHostRacePoint(), __sync_fetch_and_add((p), (v)))
+#define InterlockedCompareExchange(p, v, c)		(SCHostRacePoint(), __sync_val_compare_and_swap((p), (c), (v)))
+#define InterlockedCompareExchange64(p, v, c)	(SCHostRacePoint(), __sync_val_compare_and_swap((p), (c), (v)))
+#define InterlockedCompareExchangePointer(p, v, c) \
+	(SCHostRacePoint(), (PVOID)__sync_val_compare_and_swap((p), (c), (v)))
+#define InterlockedExchange(p, v)				SCHostExchange((p), (v))
+#define InterlockedExchangePointer(p, v)		SCHostExchangePointer((p), (v))
+#define KeMemoryBarrier()						__sync_synchronize()
+
+LONG SCHostExchange(LONG volatile * Target, LONG Value);
+PVOID SCHostExchangePointer(PVOID volatile * Target, PVOID Value);
+VOID ExInterlockedAddLargeStatistic(PLARGE_INTEGER Addend, ULONG Increment);
+
+// dispatcher objects
+typedef struct _DISPATCHER_HEADER
+{
+	UCHAR		Type;
+	LONG		SignalState;
+} DISPATCHER_HEADER;
+
+typedef enum _EVENT_TYPE
+{
+	NotificationEvent,
+	SynchronizationEvent
+} EVENT_TYPE;
+
+typedef struct _KEVENT
+{
+	DISPATCHER_HEADER	Header;
+} KEVENT, *PKEVENT, *PRKEVENT;
+
+struct _KDPC;
+typedef VOID (*PKDEFERRED_ROUTINE)(struct _KDPC * Dpc, PVOID DeferredContext,
+	PVOID SystemArgument1, PVOID SystemArgument2);
+
+typedef struct _KDPC
+{
+	UCHAR				Type;
+	LIST_ENTRY			DpcListEntry;		// in the DPC queue while DpcData is set
+	PKDEFERRED_ROUTINE	DeferredRoutine;
+	PVOID				DeferredContext;
+	PVOID				SystemArgument1;
+	PVOID				SystemArgument2;
+	PVOID				DpcData;
+} KDPC, *PKDPC, *PRKDPC;
+
+typedef struct _KTIMER
+{
+	DISPATCHER_HEADER	Header;
+	ULONGLONG			DueTime;			// host clock, see SCHostNow
+	LIST_ENTRY			TimerListEntry;		// in the timer queue while Inserted
+	PKDPC				Dpc;
+	BOOLEAN				Inserted;
+} KTIMER, *PKTIMER;
+
+typedef struct _FAST_MUTEX
+{
+	LONG				Count;
+	PVOID				Owner;
+	KIRQL				OldIrql;
+} FAST_MUTEX, *PFAST_MUTEX;
+
+typedef struct _KLOCK_QUEUE_HANDLE
+{
+	struct
+	{
+		PVOID			Next;
+		PKSPIN_LOCK		Lock;
+	} LockQueue;
+	KIRQL				OldIrql;
+} KLOCK_QUEUE_HANDLE, *PKLOCK_QUEUE_HANDLE;
+
+typedef enum _KWAIT_REASON
+{
+	Executive
+} KWAIT_REASON;
+
+#define KernelMode			0
+#define UserMode			1
+
+VOID KeInitializeEvent(PRKEVENT Event, EVENT_TYPE Type, BOOLEAN State);
+LONG KeSetEvent(PRKEVENT Event, KPRIORITY Increment, BOOLEAN Wait);
+VOID KeClearEvent(PRKEVENT Event);
+LONG KeReadStateEvent(PRKEVENT Event);
+NTSTATUS KeWaitForSingleObject(PVOID Object, KWAIT_REASON WaitReason, KPROCESSOR_MODE WaitMode,
+	BOOLEAN Alertable, PLARGE_INTEGER Timeout);
+
+VOID KeInitializeSpinLock(PKSPIN_LOCK SpinLock);
+VOID KeAcquireSpinLock(PKSPIN_LOCK SpinLock, PKIRQL OldIrql);
+VOID KeReleaseSpinLock(PKSPIN_LOCK SpinLock, KIRQL NewIrql);
+VOID KeAcquireSpinLockAtDpcLevel(PKSPIN_LOCK SpinLock);
+VOID KeReleaseSpinLockFromDpcLevel(PKSPIN_LOCK SpinLock);
+VOID KeAcquireInStackQueuedSpinLock(PKSPIN_LOCK SpinLock, PKLOCK_QUEUE_HANDLE LockHandle);
+VOID KeReleaseInStackQueuedSpinLock(PKLOCK_QUEUE_HANDLE LockHandle);
+VOID KeAcquireInStackQueuedSpinLockAtDpcLevel(PKSPIN_LOCK SpinLock, PKLOCK_QUEUE_HANDLE LockHandle);
+VOID KeReleaseInStackQueuedSpinLockFromDpcLevel(PKLOCK_QUEUE_HANDLE LockHandle);
+
+VOID ExInitializeFastMutex(PFAST_MUTEX FastMutex);
+VOID ExAcquireFastMutex(PFAST_MUTEX FastMutex);
+VOID ExReleaseFastMutex(PFAST_MUTEX FastMutex);
+
+KIRQL KeGetCurrentIrql(VOID);
+VOID KeRaiseIrql(KIRQL NewIrql, PKIRQL OldIrql);
+VOID KeLowerIrql(KIRQL NewIrql);
+ULONG KeGetCurrentProcessorNumber(VOID);
+KAFFINITY KeQueryActiveProcessors(VOID);
+
+VOID KeQuerySystemTime(PLARGE_INTEGER CurrentTime);
+ULONGLONG KeQueryInterruptTime(VOID);
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency);
+VOID KeStallExecutionProcessor(ULONG MicroSeconds);
+
+VOID KeInitializeTimer(PKTIMER Timer);
+BOOLEAN KeSetTimer(PKTIMER Timer, LARGE_INTEGER DueTime, PKDPC Dpc);
+BOOLEAN KeCancelTimer(PKTIMER Timer);
+BOOLEAN KeReadStateTimer(PKTIMER Timer);
+VOID KeInitializeDpc(PRKDPC Dpc, PKDEFERRED_ROUTINE DeferredRoutine, PVOID DeferredContext);
+BOOLEAN KeInsertQueueDpc(PRKDPC Dpc, PVOID SystemArgument1, PVOID SystemArgument2);
+BOOLEAN KeRemoveQueueDpc(PRKDPC Dpc);
+VOID KeFlushQueuedDpcs(VOID);
+
+// registry
+#define REG_NONE			0
+#define REG_SZ				1
+#define REG_EXPAND_SZ		2
+#define REG_BINARY			3
+#define REG_DWORD			4
+#define REG_MULTI_SZ		7
+
+#define KEY_READ			0x20019
+#define KEY_WRITE			0x20006
+#define KEY_ALL_ACCESS		0xf003f
+#define STANDARD_RIGHTS_READ	0x20000
+
+#define OBJ_CASE_INSENSITIVE	0x00000040L
+#define OBJ_KERNEL_HANDLE		0x00000200L
+
+typedef struct _OBJECT_ATTRIBUTES
+{
+	ULONG				Length;
+	HANDLE				RootDirectory;
+	PUNICODE_STRING		ObjectName;
+	ULONG				Attributes;
+	PVOID				SecurityDescriptor;
+	PVOID				SecurityQualityOfService;
+} OBJECT_ATTRIBUTES, *POBJECT_ATTRIBUTES;
+
+#define InitializeObjectAttributes(p, n, a, r, s) \
+	do \
+	{ \
+		(p)->Length = sizeof(OBJECT_ATTRIBUTES); \
+		(p)->RootDirectory = (r); \
+		(p)->Attributes = (a); \
+		(p)->ObjectName = (n); \
+		(p)->SecurityDescriptor = (s); \
+		(p)->SecurityQualityOfService = NULL; \
+	} while(0)
+
+typedef enum _KEY_INFORMATION_CLASS
+{
+	KeyBasicInformation
+} KEY_INFORMATION_CLASS;
+
+typedef enum _KEY_VALUE_INFORMATION_CLASS
+{
+	KeyValueBasicInformation,
+	KeyValueFullInformation,
+	KeyValuePartialInformation
+} KEY_VALUE_INFORMATION_CLASS;
+
+typedef struct _KEY_BASIC_INFORMATION
+{
+	LARGE_INTEGER	LastWriteTime;
+	ULONG			TitleIndex;
+	ULONG			NameLength;
+	WCHAR			Name[1];
+} KEY_BASIC_INFORMATION, *PKEY_BASIC_INFORMATION;
+
+typedef struct _KEY_VALUE_BASIC_INFORMATION
+{
+	ULONG			TitleIndex;
+	ULONG			Type;
+	ULONG			NameLength;
+	WCHAR			Name[1];
+} KEY_VALUE_BASIC_INFORMATION, *PKEY_VALUE_BASIC_INFORMATION;
+
+typedef struct _KEY_VALUE_PARTIAL_INFORMATION
+{
+	ULONG			TitleIndex;
+	ULONG			Type;
+	ULONG			DataLength;
+	UCHAR			Data[1];
+} KEY_VALUE_PARTIAL_INFORMATION, *PKEY_VALUE_PARTIAL_INFORMATION;
+
+#define RTL_REGISTRY_ABSOLUTE		0
+#define RTL_REGISTRY_SERVICES		1
+#define RTL_REGISTRY_CONTROL		2
+#define RTL_REGISTRY_WINDOWS_NT		3
+#define RTL_REGISTRY_DEVICEMAP		4
+
+NTSTATUS ZwOpenKey(PHANDLE KeyHandle, ACCESS_MASK DesiredAccess, POBJECT_ATTRIBUTES ObjectAttributes);
+NTSTATUS ZwClose(HANDLE Handle);
+NTSTATUS ZwQueryValueKey(HANDLE KeyHandle, PUNICODE_STRING ValueName,
+	KEY_VALUE_INFORMATION_CLASS KeyValueInformationClass, PVOID KeyValueInformation, ULONG Length,
+	PULONG ResultLength);
+NTSTATUS ZwEnumerateKey(HANDLE KeyHandle, ULONG Index, KEY_INFORMATION_CLASS KeyInformationClass,
+	PVOID KeyInformation, ULONG Length, PULONG ResultLength);
+NTSTATUS ZwEnumerateValueKey(HANDLE KeyHandle, ULONG Index,
+	KEY_VALUE_INFORMATION_CLASS KeyValueInformationClass, PVOID KeyValueInformation, ULONG Length,
+	PULONG ResultLength);
+NTSTATUS RtlWriteRegistryValue(ULONG RelativeTo, PCWSTR Path, PCWSTR ValueName, ULONG ValueType,
+	PVOID ValueData, ULONG ValueLength);
+NTSTATUS RtlDeleteRegistryValue(ULONG RelativeTo, PCWSTR Path, PCWSTR ValueName);
+
+// power
+typedef enum _SYSTEM_POWER_STATE
+{
+	PowerSystemUnspecified = 0,
+	PowerSystemWorking,
+	PowerSystemSleeping1,
+	PowerSystemSleeping2,
+	PowerSystemSleeping3,
+	PowerSystemHibernate,
+	PowerSystemShutdown,
+	PowerSystemMaximum
+} SYSTEM_POWER_STATE;
+#define PowerSystemUnknown	PowerSystemUnspecified
+
+typedef enum _DEVICE_POWER_STATE
+{
+	PowerDeviceUnspecified = 0,
+	PowerDeviceD0,
+	PowerDeviceD1,
+	PowerDeviceD2,
+	PowerDeviceD3,
+	PowerDeviceMaximum
+} DEVICE_POWER_STATE;
+#define PowerDeviceUnknown	PowerDeviceUnspecified
+
+typedef union _POWER_STATE
+{
+	SYSTEM_POWER_STATE	SystemState;
+	DEVICE_POWER_STATE	DeviceState;
+} POWER_STATE;
+
+typedef enum _POWER_STATE_TYPE
+{
+	SystemPowerState,
+	DevicePowerState
+} POWER_STATE_TYPE;
+
+// PnP
+typedef enum _DEVICE_RELATION_TYPE
+{
+	BusRelations,
+	EjectionRelations,
+	PowerRelations,
+	RemovalRelations,
+	TargetDeviceRelation
+} DEVICE_RELATION_TYPE;
+
+typedef enum _BUS_QUERY_ID_TYPE
+{
+	BusQueryDeviceID,
+	BusQueryHardwareIDs,
+	BusQueryCompatibleIDs,
+	BusQueryInstanceID
+} BUS_QUERY_ID_TYPE;
+
+typedef struct _DEVICE_CAPABILITIES
+{
+	USHORT		Size;
+	USHORT		Version;
+	ULONG		DeviceD1:1;
+	ULONG		DeviceD2:1;
+	ULONG		LockSupported:1;
+	ULONG		EjectSupported:1;
+	ULONG		Removable:1;
+	ULONG		DockDevice:1;
+	ULONG		UniqueID:1;
+	ULONG		SilentInstall:1;
+	ULONG		RawDeviceOK:1;
+	ULONG		SurpriseRemovalOK:1;
+	ULONG		Reserved:22;
+	ULONG		Address;
+	ULONG		UINumber;
+	DEVICE_POWER_STATE	DeviceState[PowerSystemMaximum];
+	SYSTEM_POWER_STATE	SystemWake;
+	DEVICE_POWER_STATE	DeviceWake;
+} DEVICE_CAPABILITIES, *PDEVICE_CAPABILITIES;
+
+struct _DEVICE_OBJECT;
+struct _DRIVER_OBJECT;
+struct _IRP;
+
+typedef struct _DEVICE_RELATIONS
+{
+	ULONG						Count;
+	struct _DEVICE_OBJECT *		Objects[1];
+} DEVICE_RELATIONS, *PDEVICE_RELATIONS;
+
+// security
+typedef struct _LUID
+{
+	ULONG	LowPart;
+	LONG	HighPart;
+} LUID, *PLUID;
+
+#define SE_SYSTEM_PROFILE_PRIVILEGE		(11L)
+
+FORCEINLINE LUID RtlConvertLongToLuid(LONG Long)
+{
+	LUID	luid;
+
+	luid.LowPart = (ULONG)Long;
+	luid.HighPart = (Long < 0) ? -1 : 0;
+	return luid;
+}
+
+BOOLEAN SeSinglePrivilegeCheck(LUID PrivilegeValue, KPROCESSOR_MODE PreviousMode);
+
+// I/O manager objects
+typedef NTSTATUS (*PIO_COMPLETION_ROUTINE)(struct _DEVICE_OBJECT * DeviceObject, struct _IRP * Irp,
+	PVOID Context);
+typedef VOID (*PDRIVER_CANCEL)(struct _DEVICE_OBJECT * DeviceObject, struct _IRP * Irp);
+typedef NTSTATUS (*PDRIVER_DISPATCH)(struct _DEVICE_OBJECT * DeviceObject, struct _IRP * Irp);
+typedef NTSTATUS (*PDRIVER_ADD_DEVICE)(struct _DRIVER_OBJECT * DriverObject,
+	struct _DEVICE_OBJECT * PhysicalDeviceObject);
+typedef VOID (*PDRIVER_UNLOAD)(struct _DRIVER_OBJECT * DriverObject);
+
+typedef struct _IO_STATUS_BLOCK
+{
+	union
+	{
+		NTSTATUS	Status;
+		PVOID		Pointer;
+	};
+	ULONG_PTR		Information;
+} IO_STATUS_BLOCK, *PIO_STATUS_BLOCK;
+
+typedef struct _FILE_OBJECT
+{
+	CSHORT						Type;
+	CSHORT						Size;
+	struct _DEVICE_OBJECT *		DeviceObject;
+	PVOID						FsContext;
+	PVOID						FsContext2;
+} FILE_OBJECT, *PFILE_OBJECT;
+
+typedef struct _MDL
+{
+	struct _MDL *	Next;
+	PVOID			StartVa;
+	ULONG			ByteCount;
+} MDL, *PMDL;
+
+typedef struct _IO_STACK_LOCATION
+{
+	UCHAR		MajorFunction;
+	UCHAR		MinorFunction;
+	UCHAR		Flags;
+	UCHAR		Control;
+
+	union
+	{
+		struct
+		{
+			PVOID			SecurityContext;
+			ULONG			Options;
+			USHORT			FileAttributes;
+			USHORT			ShareAccess;
+			ULONG			EaLength;
+		} Create;
+
+		struct
+		{
+			ULONG			Length;
+			ULONG			Key;
+			LARGE_INTEGER	ByteOffset;
+		} Read;
+
+		struct
+		{
+			ULONG			Length;
+			ULONG			Key;
+			LARGE_INTEGER	ByteOffset;
+		} Write;
+
+		struct
+		{
+			ULONG			OutputBufferLength;
+			ULONG			InputBufferLength;
+			ULONG			IoControlCode;
+			PVOID			Type3InputBuffer;
+		} DeviceIoControl;
+
+		struct
+		{
+			DEVICE_RELATION_TYPE	Type;
+		} QueryDeviceRelations;
+
+		struct
+		{
+			BUS_QUERY_ID_TYPE		IdType;
+		} QueryId;
+
+		struct
+		{
+			PDEVICE_CAPABILITIES	Capabilities;
+		} DeviceCapabilities;
+
+		struct
+		{
+			ULONG				SystemContext;
+			POWER_STATE_TYPE	Type;
+			POWER_STATE			State;
+			ULONG				ShutdownType;
+		} Power;
+
+		struct
+		{
+			ULONG_PTR		ProviderId;
+			PVOID			DataPath;
+			ULONG			BufferSize;
+			PVOID			Buffer;
+		} WMI;
+
+		struct
+		{
+			PVOID			Argument1;
+			PVOID			Argument2;
+			PVOID			Argument3;
+			PVOID			Argument4;
+		} Others;
+	} Parameters;
+
+	struct _DEVICE_OBJECT *		DeviceObject;
+	PFILE_OBJECT				FileObject;
+	PIO_COMPLETION_ROUTINE		CompletionRoutine;
+	PVOID						Context;
+} IO_STACK_LOCATION, *PIO_STACK_LOCATION;
+
+// IO_STACK_LOCATION Control
+#define SL_PENDING_RETURNED		0x01
+#define SL_INVOKE_ON_CANCEL		0x20
+#define SL_INVOKE_ON_SUCCESS	0x40
+#define SL_INVOKE_ON_ERROR		0x80
+
+// An IRP is followed in memory by its StackCount stack locations. The
+// current one is the location of the driver the IRP is at; it starts out
+// one past the last, and IoCallDriver steps it down one.
+typedef struct _IRP
+{
+	CSHORT				Type;
+	USHORT				Size;
+	PMDL				MdlAddress;
+	ULONG				Flags;
+
+	union
+	{
+		struct _IRP *	MasterIrp;
+		PVOID			SystemBuffer;
+	} AssociatedIrp;
+
+	LIST_ENTRY			ThreadListEntry;
+	IO_STATUS_BLOCK		IoStatus;
+	KPROCESSOR_MODE		RequestorMode;
+	BOOLEAN				PendingReturned;
+	CHAR				StackCount;
+	CHAR				CurrentLocation;
+	BOOLEAN				Cancel;
+	KIRQL				CancelIrql;
+	PDRIVER_CANCEL		CancelRoutine;
+	PIO_STATUS_BLOCK	UserIosb;
+	PKEVENT				UserEvent;
+	PVOID				UserBuffer;
+
+	union
+	{
+		struct
+		{
+			union
+			{
+				LIST_ENTRY	DeviceQueueEntry;
+				struct
+				{
+					PVOID	DriverContext[4];
+				};
+			};
+			PVOID		Thread;
+			PCHAR		AuxiliaryBuffer;
+			struct
+			{
+				LIST_ENTRY	ListEntry;
+				union
+				{
+					struct _IO_STACK_LOCATION *	CurrentStackLocation;
+					ULONG						PacketType;
+				};
+			};
+			PFILE_OBJECT	OriginalFileObject;
+		} Overlay;
+	} Tail;
+} IRP, *PIRP;
+
+// IRP Flags
+#define IRP_BUFFERED_IO				0x00000010
+#define IRP_DEALLOCATE_BUFFER		0x00000020
+#define IRP_INPUT_OPERATION			0x00000040
+
+typedef struct _DRIVER_EXTENSION
+{
+	struct _DRIVER_OBJECT *	DriverObject;
+	PDRIVER_ADD_DEVICE		AddDevice;
+} DRIVER_EXTENSION, *PDRIVER_EXTENSION;
+
+#define IRP_MJ_CREATE					0x00
+#define IRP_MJ_CREATE_NAMED_PIPE		0x01
+#define IRP_MJ_CLOSE					0x02
+#define IRP_MJ_READ						0x03
+#define IRP_MJ_WRITE					0x04
+#define IRP_MJ_QUERY_INFORMATION		0x05
+#define IRP_MJ_SET_INFORMATION			0x06
+#define IRP_MJ_QUERY_EA					0x07
+#define IRP_MJ_SET_EA					0x08
+#define IRP_MJ_FLUSH_BUFFERS			0x09
+#define IRP_MJ_QUERY_VOLUME_INFORMATION	0x0a
+#define IRP_MJ_SET_VOLUME_INFORMATION	0x0b
+#define IRP_MJ_DIRECTORY_CONTROL		0x0c
+#define IRP_MJ_FILE_SYSTEM_CONTROL		0x0d
+#define IRP_MJ_DEVICE_CONTROL			0x0e
+#define IRP_MJ_INTERNAL_DEVICE_CONTROL	0x0f
+#define IRP_MJ_SHUTDOWN					0x10
+#define IRP_MJ_LOCK_CONTROL				0x11
+#define IRP_MJ_CLEANUP					0x12
+#define IRP_MJ_CREATE_MAILSLOT			0x13
+#define IRP_MJ_QUERY_SECURITY			0x14
+#define IRP_MJ_SET_SECURITY				0x15
+#define IRP_MJ_POWER					0x16
+#define IRP_MJ_SYSTEM_CONTROL			0x17
+#define IRP_MJ_DEVICE_CHANGE			0x18
+#define IRP_MJ_QUERY_QUOTA				0x19
+#define IRP_MJ_SET_QUOTA				0x1a
+#define IRP_MJ_PNP						0x1b
+#define IRP_MJ_MAXIMUM_FUNCTION			0x1b
+
+#define IRP_MN_START_DEVICE					0x00
+#define IRP_MN_QUERY_REMOVE_DEVICE			0x01
+#define IRP_MN_REMOVE_DEVICE				0x02
+#define IRP_MN_CANCEL_REMOVE_DEVICE			0x03
+#define IRP_MN_STOP_DEVICE					0x04
+#define IRP_MN_QUERY_STOP_DEVICE			0x05
+#define IRP_MN_CANCEL_STOP_DEVICE			0x06
+#define IRP_MN_QUERY_DEVICE_RELATIONS		0x07
+#define IRP_MN_QUERY_INTERFACE				0x08
+#define IRP_MN_QUERY_CAPABILITIES			0x09
+#define IRP_MN_QUERY_RESOURCES				0x0A
+#define IRP_MN_QUERY_RESOURCE_REQUIREMENTS	0x0B
+#define IRP_MN_QUERY_DEVICE_TEXT			0x0C
+#define IRP_MN_FILTER_RESOURCE_REQUIREMENTS	0x0D
+#define IRP_MN_READ_CONFIG					0x0F
+#define IRP_MN_WRITE_CONFIG					0x10
+#define IRP_MN_EJECT						0x11
+#define IRP_MN_SET_LOCK						0x12
+#define IRP_MN_QUERY_ID						0x13
+#define IRP_MN_QUERY_PNP_DEVICE_STATE		0x14
+#define IRP_MN_QUERY_BUS_INFORMATION		0x15
+#define IRP_MN_DEVICE_USAGE_NOTIFICATION	0x16
+#define IRP_MN_SURPRISE_REMOVAL				0x17
+
+#define IRP_MN_WAIT_WAKE					0x00
+#define IRP_MN_POWER_SEQUENCE				0x01
+#define IRP_MN_SET_POWER					0x02
+#define IRP_MN_QUERY_POWER					0x03
+
+#define IRP_MN_QUERY_ALL_DATA				0x00
+#define IRP_MN_QUERY_SINGLE_INSTANCE		0x01
+#define IRP_MN_CHANGE_SINGLE_INSTANCE		0x02
+#define IRP_MN_CHANGE_SINGLE_ITEM			0x03
+#define IRP_MN_ENABLE_EVENTS				0x04
+#define IRP_MN_DISABLE_EVENTS				0x05
+#define IRP_MN_ENABLE_COLLECTION			0x06
+#define IRP_MN_DISABLE_COLLECTION			0x07
+#define IRP_MN_REGINFO						0x08
+#define IRP_MN_EXECUTE_METHOD				0x09
+#define IRP_MN_REGINFO_EX					0x0b
+
+typedef struct _DRIVER_OBJECT
+{
+	CSHORT						Type;
+	CSHORT						Size;
+	struct _DEVICE_OBJECT *		DeviceObject;		// first of the driver's devices
+	PDRIVER_EXTENSION			DriverExtension;
+	UNICODE_STRING				DriverName;
+	PDRIVER_UNLOAD				DriverUnload;
+	PDRIVER_DISPATCH			MajorFunction[IRP_MJ_MAXIMUM_FUNCTION + 1];
+} DRIVER_OBJECT, *PDRIVER_OBJECT;
+
+typedef struct _DEVICE_OBJECT
+{
+	CSHORT						Type;
+	USHORT						Size;
+	LONG						ReferenceCount;
+	PDRIVER_OBJECT				DriverObject;
+	struct _DEVICE_OBJECT *		NextDevice;			// next of the same driver
+	struct _DEVICE_OBJECT *		AttachedDevice;		// the one attached on top of this one
+	PIRP						CurrentIrp;
+	ULONG						Flags;
+	ULONG						Characteristics;
+	PVOID						DeviceExtension;
+	ULONG						DeviceType;
+	CCHAR						StackSize;
+	UNICODE_STRING				Name;				// not in the DDK's, kept for the host
+	BOOLEAN						DeletePending;		// deleted, freed when the last reference goes
+} DEVICE_OBJECT, *PDEVICE_OBJECT;
+
+// DEVICE_OBJECT Flags
+#define DO_BUFFERED_IO				0x00000004
+#define DO_EXCLUSIVE				0x00000008
+#define DO_DIRECT_IO				0x00000010
+#define DO_DEVICE_INITIALIZING		0x00000080
+#define DO_POWER_PAGABLE			0x00002000
+
+// DEVICE_OBJECT Characteristics
+#define FILE_REMOVABLE_MEDIA		0x00000001
+#define FILE_DEVICE_SECURE_OPEN		0x00000100
+
+#define FILE_DEVICE_SERIAL_PORT		0x0000001b
+#define FILE_DEVICE_UNKNOWN			0x00000022
+
+// I/O control codes
+#define CTL_CODE(DeviceType, Function, Method, Access) \
+	(((DeviceType) << 16) | ((Access) << 14) | ((Function) << 2) | (Method))
+#define DEVICE_TYPE_FROM_CTL_CODE(c)	(((ULONG)(c) & 0xffff0000) >> 16)
+#define METHOD_FROM_CTL_CODE(c)			((ULONG)((c) & 3))
+
+#define METHOD_BUFFERED			0
+#define METHOD_IN_DIRECT		1
+#define METHOD_OUT_DIRECT		2
+#define METHOD_NEITHER			3
+
+#define FILE_ANY_ACCESS			0
+#define FILE_READ_ACCESS		0x0001
+#define FILE_WRITE_ACCESS		0x0002
+#define FILE_READ_DATA			0x0001
+#define FILE_WRITE_DATA			0x0002
+
+// stack location macros, as the DDK's
+#define IoGetCurrentIrpStackLocation(Irp)	((Irp)->Tail.Overlay.CurrentStackLocation)
+#define IoGetNextIrpStackLocation(Irp)		((Irp)->Tail.Overlay.CurrentStackLocation - 1)
+
+#define IoSkipCurrentIrpStackLocation(Irp) \
+	((Irp)->CurrentLocation++, (Irp)->Tail.Overlay.CurrentStackLocation++)
+
+#define IoSetNextIrpStackLocation(Irp) \
+	((Irp)->CurrentLocation--, (Irp)->Tail.Overlay.CurrentStackLocation--)
+
+#define IoCopyCurrentIrpStackLocationToNext(Irp) \
+	do \
+	{ \
+		PIO_STACK_LOCATION	__next = IoGetNextIrpStackLocation(Irp); \
+		RtlCopyMemory(__next, IoGetCurrentIrpStackLocation(Irp), FIELD_OFFSET(IO_STACK_LOCATION, CompletionRoutine)); \
+		__next->Control = 0; \
+	} while(0)
+
+#define IoSetCompletionRoutine(Irp, Routine, CompletionContext, Success, Error, Cancel) \
+	do \
+	{ \
+		PIO_STACK_LOCATION	__next = IoGetNextIrpStackLocation(Irp); \
+		__next->CompletionRoutine = (Routine); \
+		__next->Context = (CompletionContext); \
+		__next->Control = 0; \
+		if(Success) \
+			__next->Control = SL_INVOKE_ON_SUCCESS; \
+		if(Error) \
+			__next->Control |= SL_INVOKE_ON_ERROR; \
+		if(Cancel) \
+			__next->Control |= SL_INVOKE_ON_CANCEL; \
+	} while(0)
+
+#define IoMarkIrpPending(Irp) \
+	(IoGetCurrentIrpStackLocation(Irp)->Control |= SL_PENDING_RETURNED)
+
+#define IoSizeOfIrp(StackSize) \
+	((USHORT)(sizeof(IRP) + ((StackSize) * sizeof(IO_STACK_LOCATION))))
+
+NTSTATUS IoCallDriver(PDEVICE_OBJECT DeviceObject, PIRP Irp);
+VOID IoCompleteRequest(PIRP Irp, CCHAR PriorityBoost);
+#define IofCallDriver		IoCallDriver
+#define IofCompleteRequest	IoCompleteRequest
+
+PIRP IoAllocateIrp(CCHAR StackSize, BOOLEAN ChargeQuota);
+VOID IoInitializeIrp(PIRP Irp, USHORT PacketSize, CCHAR StackSize);
+VOID IoFreeIrp(PIRP Irp);
+BOOLEAN IoCancelIrp(PIRP Irp);
+PDRIVER_CANCEL IoSetCancelRoutine(PIRP Irp, PDRIVER_CANCEL CancelRoutine);
+VOID IoAcquireCancelSpinLock(PKIRQL Irql);
+VOID IoReleaseCancelSpinLock(KIRQL Irql);
+PIRP IoBuildDeviceIoControlRequest(ULONG IoControlCode, PDEVICE_OBJECT DeviceObject, PVOID InputBuffer,
+	ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength, BOOLEAN InternalDeviceIoControl,
+	PKEVENT Event, PIO_STATUS_BLOCK IoStatusBlock);
+BOOLEAN IoForwardIrpSynchronously(PDEVICE_OBJECT DeviceObject, PIRP Irp);
+
+NTSTATUS IoCreateDevice(PDRIVER_OBJECT DriverObject, ULONG DeviceExtensionSize, PUNICODE_STRING DeviceName,
+	ULONG DeviceType, ULONG DeviceCharacteristics, BOOLEAN Exclusive, PDEVICE_OBJECT * DeviceObject);
+VOID IoDeleteDevice(PDEVICE_OBJECT DeviceObject);
+PDEVICE_OBJECT IoAttachDeviceToDeviceStack(PDEVICE_OBJECT SourceDevice, PDEVICE_OBJECT TargetDevice);
+VOID IoDetachDevice(PDEVICE_OBJECT TargetDevice);
+PDEVICE_OBJECT IoGetAttachedDeviceReference(PDEVICE_OBJECT DeviceObject);
+BOOLEAN IoIsWdmVersionAvailable(UCHAR MajorVersion, UCHAR MinorVersion);
+
+NTSTATUS IoCreateSymbolicLink(PUNICODE_STRING SymbolicLinkName, PUNICODE_STRING DeviceName);
+NTSTATUS IoDeleteSymbolicLink(PUNICODE_STRING SymbolicLinkName);
+NTSTATUS IoRegisterDeviceInterface(PDEVICE_OBJECT PhysicalDeviceObject, const GUID * InterfaceClassGuid,
+	PUNICODE_STRING ReferenceString, PUNICODE_STRING SymbolicLinkName);
+NTSTATUS IoSetDeviceInterfaceState(PUNICODE_STRING SymbolicLinkName, BOOLEAN Enable);
+
+#define PLUGPLAY_REGKEY_DEVICE	1
+#define PLUGPLAY_REGKEY_DRIVER	2
+NTSTATUS IoOpenDeviceRegistryKey(PDEVICE_OBJECT DeviceObject, ULONG DevInstKeyType, ACCESS_MASK DesiredAccess,
+	PHANDLE DevInstRegKey);
+
+#define WMIREG_ACTION_REGISTER		1
+#define WMIREG_ACTION_DEREGISTER	2
+NTSTATUS IoWMIRegistrationControl(PDEVICE_OBJECT DeviceObject, ULONG Action);
+
+#define PoCallDriver		IoCallDriver
+VOID PoStartNextPowerIrp(PIRP Irp);
+
+VOID ObReferenceObject(PVOID Object);
+VOID ObDereferenceObject(PVOID Object);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCHOST_WDM_H__
@@ -0,0 +1,17 @@
+// wmistr.h
+//
+// The WMI registration flags the driver passes to WMILIB.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCHOST_WMISTR_H__
+#define __SCHOST_WMISTR_H__
+
+#define WMIREG_FLAG_EXPENSIVE			0x00000001
+#define WMIREG_FLAG_INSTANCE_BASENAME	0x00000008
+#define WMIREG_FLAG_INSTANCE_PDO		0x00000020
+
+#endif // __SCHOST_WMISTR_H__
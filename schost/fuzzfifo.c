@@ -0,0 +1,146 @@
+// fuzzfifo.c
+//
+// A fuzz target for the driver's read buffer, SCFIFO: an input is a
+// buffer size and a run of writes, reads and purges on a FIFO of that
+// size, each checked against a plain model of what the FIFO should hold.
+// A write of more than there is room for keeps the newest bytes, as the
+// driver's overflow does; a read takes the oldest. The storage is exactly
+// the buffer's size so any access past it is the sanitizer's to catch.
+//
+// The input, byte by byte: the buffer size, 0 for a FIFO without storage,
+// then operations, each a byte whose low two bits say which, 0 a write, 1
+// a read, 2 a purge, 3 a write the size of the buffer. A write takes a
+// length byte and that many bytes, as many as are left; a read takes a
+// length byte.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../driver/pch.h"
+#include "shim.h"
+
+#define FUZZFIFO_SIZE_MAX		64		// small, so the pointers wrap often
+
+// what the FIFO should hold, oldest first
+typedef struct _FUZZFIFO_MODEL
+{
+	UCHAR		Data[FUZZFIFO_SIZE_MAX];
+	ULONG		Size;
+	ULONG		Room;
+} FUZZFIFO_MODEL;
+
+static VOID FuzzFifoWrite(FUZZFIFO_MODEL * Model, const UCHAR * Data, ULONG Length)
+{
+	ULONG	keep;
+
+	// the newest Room bytes of what it held and what comes
+	if(Length >= Model->Room)
+	{
+		memcpy(Model->Data, Data + Length - Model->Room, Model->Room);
+		Model->Size = Model->Room;
+		return;
+	}
+	keep = min(Model->Size, Model->Room - Length);
+	memmove(Model->Data, Model->Data + Model->Size - keep, keep);
+	memcpy(Model->Data + keep, Data, Length);
+	Model->Size = keep + Length;
+}
+
+static ULONG FuzzFifoRead(FUZZFIFO_MODEL * Model, UCHAR * Data, ULONG Length)
+{
+	Length = min(Length, Model->Size);
+	memcpy(Data, Model->Data, Length);
+	memmove(Model->Data, Model->Data + Length, Model->Size - Length);
+	Model->Size -= Length;
+	return Length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  FuzzFifoCheck
+//      The FIFO's pointers agree with its count and with the model
+//
+static VOID FuzzFifoCheck(PSCFIFO Fifo, const FUZZFIFO_MODEL * Model, ULONG Op)
+{
+	ULONG	in;
+	ULONG	out;
+
+	if(Fifo->Size != Model->Size)
+		SCHostFatal("op %u: FIFO holds %u bytes, %u expected", Op, Fifo->Size, Model->Size);
+	if(Fifo->Buffer == NULL)
+		return;
+	if((Fifo->End != Fifo->Buffer + Fifo->BuffSize) ||
+		(Fifo->In < Fifo->Buffer) || (Fifo->In > Fifo->End) || (Fifo->Out < Fifo->Buffer) || (Fifo->Out > Fifo->End))
+		SCHostFatal("op %u: FIFO pointers outside it, In %ld Out %ld", Op,
+			(long)(Fifo->In - Fifo->Buffer), (long)(Fifo->Out - Fifo->Buffer));
+
+	in = (ULONG)(Fifo->In - Fifo->Buffer) % Fifo->BuffSize;
+	out = (ULONG)(Fifo->Out - Fifo->Buffer) % Fifo->BuffSize;
+	if((in + Fifo->BuffSize - out) % Fifo->BuffSize != Fifo->Size % Fifo->BuffSize)
+		SCHostFatal("op %u: FIFO In %u and Out %u don't span its %u bytes", Op, in, out, Fifo->Size);
+}
+
+int LLVMFuzzerTestOneInput(const UCHAR * Data, size_t Size)
+{
+	FUZZFIFO_MODEL	model;
+	SCFIFO			fifo;
+	UCHAR			got[2 * FUZZFIFO_SIZE_MAX + 2];
+	UCHAR			expected[2 * FUZZFIFO_SIZE_MAX + 2];
+	char *			buffer;
+	size_t			i;
+	ULONG			op;
+	ULONG			length;
+	ULONG			read;
+	ULONG			modelRead;
+
+	if(Size == 0)
+		return 0;
+
+	model.Room = Data[0] % (FUZZFIFO_SIZE_MAX + 1);
+	model.Size = 0;
+	buffer = (model.Room == 0) ? NULL : malloc(model.Room);
+	memset(&fifo, 0, sizeof(fifo));
+	SCFifoInit(&fifo, buffer, model.Room);
+
+	for(i = 1, op = 0; i < Size; op++)
+	{
+		switch(Data[i++] & 3)
+		{
+		case 0:
+		case 3:
+			if((Data[i - 1] & 3) == 3)
+				length = model.Room;
+			else
+				length = (i < Size) ? Data[i++] % (2 * model.Room + 2) : 0;
+			length = (ULONG)min(length, Size - i);
+			SCFifoWrite(&fifo, (char *)Data + i, length);
+			FuzzFifoWrite(&model, Data + i, length);
+			i += length;
+			break;
+
+		case 1:
+			length = (i < Size) ? Data[i++] % (2 * model.Room + 2) : 0;
+			SCFifoRead(&fifo, (char *)got, length, &read);
+			modelRead = FuzzFifoRead(&model, expected, length);
+			if(read != modelRead)
+				SCHostFatal("op %u: read %u of %u bytes, %u expected", op, read, length, modelRead);
+			if(memcmp(got, expected, read) != 0)
+				SCHostFatal("op %u: read %u bytes that aren't the oldest ones", op, read);
+			break;
+
+		case 2:
+			SCFifoPurge(&fifo);
+			model.Size = 0;
+			break;
+		}
+		FuzzFifoCheck(&fifo, &model, op);
+	}
+
+	free(buffer);
+	return 0;
+}
@@ -0,0 +1,481 @@
+// fuzzmain.c
+//
+// Runs a fuzz target's LLVMFuzzerTestOneInput for builds without
+// libFuzzer. Given inputs, files and every file in a directory in name
+// order, it runs each once; that is how the inputs kept in fuzz/ are run
+// again. Given -runs=N as well it fuzzes: the inputs are the corpus, and
+// N times it mutates one of them, bits and bytes changed, inserted,
+// erased or copied over from another, and runs the result. One that
+// reaches an edge of the target's code no input reached before, or
+// reaches one more often by a power of two, joins the corpus and, when
+// the first input named is a directory, is written into it. The edges
+// are counted by gcc's -fsanitize-coverage=trace-pc in everything but
+// this file, which make fuzzcheck builds without it. An input that stops
+// the run, a sanitizer's report, an abort or a fault, is written to
+// crash-<hash> first, as libFuzzer does.
+//
+//	fuzzxxx [-runs=N] [-seed=N] [-max_len=N] input|directory...
+//
+//	-runs=N			mutated inputs to run, none by default
+//	-seed=N			for the mutations, the time by default
+//	-max_len=N		longest mutated input, 4096 by default
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+int LLVMFuzzerTestOneInput(const unsigned char * Data, size_t Size);
+
+// the sanitizers', when they are linked in
+void __sanitizer_set_death_callback(void (*Callback)(void)) __attribute__((weak));
+
+#define FUZZ_EDGES			65536		// edge counters, a power of 2
+#define FUZZ_MAX_LEN		4096
+#define FUZZ_CORPUS_MAX		65536
+
+typedef struct _FUZZ_INPUT
+{
+	unsigned char *		Data;
+	size_t				Size;
+} FUZZ_INPUT;
+
+static const char *		FuzzName;
+
+// what the instrumented code has done in the run going on
+static unsigned char	FuzzCounters[FUZZ_EDGES];
+static unsigned long	FuzzPrevious;
+
+// each edge's hit count classes any run reached
+static unsigned char	FuzzSeen[FUZZ_EDGES];
+static unsigned long	FuzzEdges;
+
+static FUZZ_INPUT		FuzzCorpus[FUZZ_CORPUS_MAX];
+static unsigned long	FuzzCorpusCount;
+
+// the input being run, written out if it stops the run
+static const unsigned char *	FuzzCurrent;
+static size_t					FuzzCurrentSize;
+
+static unsigned long			FuzzRuns;
+static unsigned long long		FuzzRandomState;
+
+// called by gcc's instrumentation on every basic block: the block and the
+// one before it make an edge, as AFL counts them
+void __sanitizer_cov_trace_pc(void)
+{
+	unsigned long	pc;
+
+	pc = (unsigned long)__builtin_return_address(0);
+	pc ^= pc >> 16;
+	FuzzCounters[(pc ^ FuzzPrevious) & (FUZZ_EDGES - 1)]++;
+	FuzzPrevious = pc >> 1;
+}
+
+static unsigned long long FuzzRandom(void)
+{
+	FuzzRandomState ^= FuzzRandomState << 13;
+	FuzzRandomState ^= FuzzRandomState >> 7;
+	FuzzRandomState ^= FuzzRandomState << 17;
+	return FuzzRandomState;
+}
+
+// FNV-1a, names the inputs written out
+static unsigned long long FuzzHash(const unsigned char * Data, size_t Size)
+{
+	unsigned long long	hash;
+	size_t				i;
+
+	hash = 14695981039346656037ULL;
+	for(i = 0; i < Size; i++)
+		hash = (hash ^ Data[i]) * 1099511628211ULL;
+	return hash;
+}
+
+// writes an input to Directory/Prefix<hash>, 0 if it couldn't
+static int FuzzWrite(const char * Directory, const char * Prefix, const unsigned char * Data, size_t Size)
+{
+	char	path[4096];
+	FILE *	file;
+	int		written;
+
+	snprintf(path, sizeof(path), "%s/%s%016llx", Directory, Prefix, FuzzHash(Data, Size));
+	file = fopen(path, "wb");
+	if(file == NULL)
+		return 0;
+	written = (fwrite(Data, 1, Size, file) == Size);
+	written &= (fclose(file) == 0);
+	return written;
+}
+
+// the run is stopping on the input going on, keep it
+static void FuzzDeath(void)
+{
+	static int	dying;
+
+	if(dying++ || (FuzzCurrent == NULL))
+		return;
+	if(FuzzWrite(".", "crash-", FuzzCurrent, FuzzCurrentSize))
+		fprintf(stderr, "%s: stopped on run %lu, the input is in crash-%016llx\n", FuzzName, FuzzRuns,
+			FuzzHash(FuzzCurrent, FuzzCurrentSize));
+}
+
+static void FuzzSignal(int Signal)
+{
+	FuzzDeath();
+	signal(Signal, SIG_DFL);
+	raise(Signal);
+}
+
+// gcc links UBSan's runtime apart from ASan's, and UBSan's reports don't
+// run the death callback; an abort after them reaches FuzzSignal
+const char * __ubsan_default_options(void)
+{
+	return "abort_on_error=1";
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  FuzzRun
+//      Runs one input and looks at what it reached
+//
+//  Arguments:
+//      IN  Data
+//              the input, exactly its size so reading past it is caught
+//
+//      IN  Size
+//              bytes of it
+//
+//  Return Value:
+//      the edges it reached or reached more often than any run before
+//
+static unsigned long FuzzRun(const unsigned char * Data, size_t Size)
+{
+	unsigned long	found;
+	unsigned char	count;
+	unsigned char	class;
+	unsigned long	i;
+
+	memset(FuzzCounters, 0, sizeof(FuzzCounters));
+	FuzzPrevious = 0;
+	FuzzCurrent = Data;
+	FuzzCurrentSize = Size;
+	FuzzRuns++;
+
+	LLVMFuzzerTestOneInput(Data, Size);
+
+	FuzzCurrent = NULL;
+	found = 0;
+	for(i = 0; i < FUZZ_EDGES; i++)
+	{
+		if((count = FuzzCounters[i]) == 0)
+			continue;
+
+		// 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128 and more
+		class = (count < 4) ? (1 << (count - 1)) : (count < 8) ? 8 : (count < 16) ? 16 :
+			(count < 32) ? 32 : (count < 128) ? 64 : 128;
+		if(FuzzSeen[i] & class)
+			continue;
+		if(FuzzSeen[i] == 0)
+			FuzzEdges++;
+		FuzzSeen[i] |= class;
+		found++;
+	}
+	return found;
+}
+
+// keeps an input in the corpus, a copy of its own; 0 if it couldn't
+static int FuzzKeep(const unsigned char * Data, size_t Size)
+{
+	unsigned char *	copy;
+
+	if(FuzzCorpusCount == FUZZ_CORPUS_MAX)
+		return 0;
+	copy = malloc((Size > 0) ? Size : 1);
+	if(copy == NULL)
+		return 0;
+	memcpy(copy, Data, Size);
+	FuzzCorpus[FuzzCorpusCount].Data = copy;
+	FuzzCorpus[FuzzCorpusCount].Size = Size;
+	FuzzCorpusCount++;
+	return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  FuzzMutate
+//      Changes an input a little, a few times over
+//
+//  Arguments:
+//      IN OUT Data
+//              the input, with room for MaxSize bytes
+//
+//      IN  Size
+//              bytes of it
+//
+//      IN  MaxSize
+//              longest it may become
+//
+//  Return Value:
+//      bytes of it now
+//
+static size_t FuzzMutate(unsigned char * Data, size_t Size, size_t MaxSize)
+{
+	static const unsigned char	interesting[] = { 0, 1, 2, 3, 4, 7, 8, 15, 16, 31, 32, 63, 64, 127, 128, 255 };
+	const FUZZ_INPUT *			other;
+	size_t						at;
+	size_t						from;
+	size_t						length;
+	unsigned long				changes;
+
+	for(changes = 1 + FuzzRandom() % 4; changes != 0; changes--)
+	{
+		at = (Size > 0) ? FuzzRandom() % Size : 0;
+		switch(FuzzRandom() % 8)
+		{
+		case 0:		// a bit flipped
+			if(Size > 0)
+				Data[at] ^= (unsigned char)(1 << (FuzzRandom() % 8));
+			break;
+
+		case 1:		// a byte anything
+			if(Size > 0)
+				Data[at] = (unsigned char)FuzzRandom();
+			break;
+
+		case 2:		// a byte a length or a size often is
+			if(Size > 0)
+				Data[at] = interesting[FuzzRandom() % sizeof(interesting)];
+			break;
+
+		case 3:		// a byte a little more or less
+			if(Size > 0)
+				Data[at] += (unsigned char)(FuzzRandom() % 33) - 16;
+			break;
+
+		case 4:		// bytes inserted
+			length = 1 + FuzzRandom() % 8;
+			if(Size + length > MaxSize)
+				break;
+			memmove(Data + at + length, Data + at, Size - at);
+			for(from = 0; from < length; from++)
+				Data[at + from] = (unsigned char)FuzzRandom();
+			Size += length;
+			break;
+
+		case 5:		// bytes erased
+			if(Size == 0)
+				break;
+			length = 1 + FuzzRandom() % ((Size - at < 16) ? Size - at : 16);
+			memmove(Data + at, Data + at + length, Size - at - length);
+			Size -= length;
+			break;
+
+		case 6:		// a run of it copied over another place in it
+			if(Size < 2)
+				break;
+			from = FuzzRandom() % Size;
+			length = 1 + FuzzRandom() % (Size - ((at > from) ? at : from));
+			memmove(Data + at, Data + from, length);
+			break;
+
+		default:	// a run of another input put in
+			other = &FuzzCorpus[FuzzRandom() % FuzzCorpusCount];
+			if(other->Size == 0)
+				break;
+			from = FuzzRandom() % other->Size;
+			length = 1 + FuzzRandom() % (other->Size - from);
+			if(length > MaxSize - Size)
+				length = MaxSize - Size;
+			memmove(Data + at + length, Data + at, Size - at);
+			memcpy(Data + at, other->Data + from, length);
+			Size += length;
+			break;
+		}
+	}
+	return Size;
+}
+
+// runs one input from a file, and keeps it when fuzzing; 0 if it
+// couldn't be read
+static int FuzzRunFile(const char * Path, int Keep)
+{
+	unsigned char *	data;
+	FILE *			file;
+	long			size;
+
+	file = fopen(Path, "rb");
+	if(file == NULL)
+	{
+		fprintf(stderr, "%s: can't open %s\n", FuzzName, Path);
+		return 0;
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = malloc((size > 0) ? (size_t)size : 1);
+	if((data == NULL) || (fread(data, 1, (size_t)size, file) != (size_t)size))
+	{
+		fprintf(stderr, "%s: can't read %s\n", FuzzName, Path);
+		fclose(file);
+		free(data);
+		return 0;
+	}
+	fclose(file);
+
+	// a copy of exactly its size, so reading past the input is caught
+	FuzzRun(data, (size_t)size);
+	if(Keep)
+		FuzzKeep(data, (size_t)size);
+	free(data);
+	return 1;
+}
+
+static void FuzzUsage(void)
+{
+	fprintf(stderr, "usage: %s [-runs=N] [-seed=N] [-max_len=N] input|directory...\n", FuzzName);
+}
+
+int main(int argc, char ** argv)
+{
+	struct dirent **	names;
+	struct stat			st;
+	char				path[4096];
+	const char *		save;
+	unsigned char *		data;
+	unsigned char *		copy;
+	unsigned long long	seed;
+	unsigned long		runs;
+	unsigned long		run;
+	unsigned long		added;
+	size_t				maxLen;
+	size_t				size;
+	const FUZZ_INPUT *	input;
+	int					count;
+	int					files;
+	int					bad;
+	int					n;
+	int					i;
+
+	FuzzName = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+
+	runs = 0;
+	seed = (unsigned long long)time(NULL);
+	maxLen = FUZZ_MAX_LEN;
+	for(i = 1; (i < argc) && (argv[i][0] == '-'); i++)
+	{
+		if(!strncmp(argv[i], "-runs=", 6))
+			runs = strtoul(argv[i] + 6, NULL, 0);
+		else if(!strncmp(argv[i], "-seed=", 6))
+			seed = strtoull(argv[i] + 6, NULL, 0);
+		else if(!strncmp(argv[i], "-max_len=", 9))
+			maxLen = strtoul(argv[i] + 9, NULL, 0);
+		else
+		{
+			FuzzUsage();
+			return 2;
+		}
+	}
+	if((i == argc) || (maxLen == 0))
+	{
+		FuzzUsage();
+		return 2;
+	}
+
+	signal(SIGABRT, FuzzSignal);
+	signal(SIGSEGV, FuzzSignal);
+	signal(SIGBUS, FuzzSignal);
+	signal(SIGFPE, FuzzSignal);
+	signal(SIGILL, FuzzSignal);
+	if(__sanitizer_set_death_callback != NULL)
+		__sanitizer_set_death_callback(FuzzDeath);
+
+	save = NULL;
+	files = 0;
+	bad = 0;
+	for(; i < argc; i++)
+	{
+		if((stat(argv[i], &st) == 0) && S_ISDIR(st.st_mode))
+		{
+			if((save == NULL) && (files == 0) && (runs != 0))
+				save = argv[i];
+
+			count = scandir(argv[i], &names, NULL, alphasort);
+			if(count < 0)
+			{
+				fprintf(stderr, "%s: can't list %s\n", FuzzName, argv[i]);
+				bad++;
+				continue;
+			}
+			for(n = 0; n < count; n++)
+			{
+				snprintf(path, sizeof(path), "%s/%s", argv[i], names[n]->d_name);
+				if((stat(path, &st) == 0) && S_ISREG(st.st_mode))
+				{
+					if(FuzzRunFile(path, runs != 0))
+						files++;
+					else
+						bad++;
+				}
+				free(names[n]);
+			}
+			free(names);
+		}
+		else if(FuzzRunFile(argv[i], runs != 0))
+			files++;
+		else
+			bad++;
+	}
+
+	printf("%s: %d inputs run\n", FuzzName, files);
+	if((runs == 0) || (bad != 0))
+		return (bad == 0) ? 0 : 1;
+
+	// something to start from even without inputs
+	if(FuzzCorpusCount == 0)
+		FuzzKeep((const unsigned char *)"", 0);
+
+	FuzzRandomState = (seed != 0) ? seed : 1;
+	data = malloc(maxLen);
+	if(data == NULL)
+	{
+		fprintf(stderr, "%s: no memory for a %lu byte input\n", FuzzName, (unsigned long)maxLen);
+		return 1;
+	}
+
+	added = 0;
+	for(run = 0; run < runs; run++)
+	{
+		input = &FuzzCorpus[FuzzRandom() % FuzzCorpusCount];
+		size = (input->Size < maxLen) ? input->Size : maxLen;
+		memcpy(data, input->Data, size);
+		size = FuzzMutate(data, size, maxLen);
+
+		// run from a copy of exactly its size, as above
+		copy = malloc((size > 0) ? size : 1);
+		if(copy == NULL)
+			break;
+		memcpy(copy, data, size);
+		if(FuzzRun(copy, size) != 0)
+		{
+			if(FuzzKeep(copy, size))
+				added++;
+			if((save != NULL) && !FuzzWrite(save, "", copy, size))
+				fprintf(stderr, "%s: can't write to %s\n", FuzzName, save);
+		}
+		free(copy);
+	}
+	free(data);
+
+	printf("%s: %lu mutated inputs run, seed %llu; %lu new, %lu edges, %lu inputs\n", FuzzName, run, seed,
+		added, FuzzEdges, FuzzCorpusCount);
+	return 0;
+}
@@ -0,0 +1,345 @@
+// fuzzpath.c
+//
+// A fuzz target for SerialClone's data path: an input is a run of events
+// on the driver loaded on the simulated port, a consumer on the filter and
+// one on the clone opening, closing, reading, writing and sending IOCTLs,
+// bytes arriving at the port, the port's reads being cancelled and time
+// passing, with whatever the events leave pending run after each. Every
+// read has to return bytes that came in, in the order they came, none of
+// them twice; a consumer may miss some, bytes that arrive while it has
+// no buffer or that overflow it are dropped, but never get them out of
+// order. Within one read it may only miss bytes a purge dropped at the
+// port. Once the input is done both handles close, the driver unloads
+// and has to have left nothing behind. The shim's own checks, IRQL, locks
+// and IRPs, and the sanitizers find the rest.
+//
+// The input, byte by byte: events, each a byte whose low three bits say
+// which and whose next bit which consumer, 0 the filter and 1 the clone,
+// followed by what the event takes:
+//
+//	0	open, nothing; the second handle on one that is open
+//	1	close, nothing
+//	2	read, a length byte
+//	3	write, a length byte and that many bytes, as many as are left
+//	4	IOCTL, an IOCTL byte, an input length byte and that many bytes, an
+//		output length byte
+//	5	bytes arrive, a count byte
+//	6	the port's reads cancelled, nothing
+//	7	time passes, a byte of milliseconds
+//
+// WAIT_ON_MASK isn't among the IOCTLs, SCHostIoctl waits for what it
+// sends and nothing would come to complete it.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../driver/pch.h"
+#include "schost.h"
+
+#define FUZZPATH_CONSUMERS		2
+#define FUZZPATH_READ_SIZE		256
+#define FUZZPATH_STREAM_MAX		65536
+#define FUZZPATH_IOCTL_MAX		1024		// room an IOCTL's output can have
+
+typedef struct _FUZZPATH_CONSUMER
+{
+	SCHOST_CONSUMER		Host;
+	ULONG				Offset;			// stream bytes read or passed over so far
+} FUZZPATH_CONSUMER;
+
+// the IOCTLs an event can send
+static const ULONG FuzzPathIoctls[] =
+{
+	IOCTL_SERIAL_SET_TIMEOUTS,
+	IOCTL_SERIAL_GET_TIMEOUTS,
+	IOCTL_SERIAL_SET_BAUD_RATE,
+	IOCTL_SERIAL_GET_BAUD_RATE,
+	IOCTL_SERIAL_SET_LINE_CONTROL,
+	IOCTL_SERIAL_GET_LINE_CONTROL,
+	IOCTL_SERIAL_SET_CHARS,
+	IOCTL_SERIAL_GET_CHARS,
+	IOCTL_SERIAL_SET_HANDFLOW,
+	IOCTL_SERIAL_GET_HANDFLOW,
+	IOCTL_SERIAL_SET_WAIT_MASK,
+	IOCTL_SERIAL_GET_WAIT_MASK,
+	IOCTL_SERIAL_PURGE,
+	IOCTL_SERIAL_GET_COMMSTATUS,
+	IOCTL_SERIAL_GET_DTRRTS,
+	IOCTL_SERIAL_GET_MODEMSTATUS,
+	IOCTL_SERIALCLONE_GET_PORT_STATE,
+	IOCTL_SERIALCLONE_GET_COUNTERS,
+	IOCTL_SERIALCLONE_GET_TRACE,
+	IOCTL_SERIALCLONE_GET_LATENCY,
+	IOCTL_SERIALCLONE_GET_CAPTURE,
+};
+
+static SCHOST				FuzzPathHost;
+static FUZZPATH_CONSUMER	FuzzPathConsumers[FUZZPATH_CONSUMERS];
+static UCHAR				FuzzPathStream[FUZZPATH_STREAM_MAX];
+static ULONG				FuzzPathDelivered;
+static BOOLEAN				FuzzPathDropped[FUZZPATH_STREAM_MAX];	// may have gone with a purge at the port
+
+// where in the stream a read's bytes so far may have ended, and the next
+static ULONG				FuzzPathEnds[FUZZPATH_STREAM_MAX];
+static ULONG				FuzzPathNextEnds[FUZZPATH_STREAM_MAX];
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  FuzzPathReadDone
+//      A consumer's read is done; what it got has to be the stream's
+//      bytes from somewhere at or past where it had read to, each the
+//      one after the byte before it or after bytes a purge dropped
+//
+static VOID FuzzPathReadDone(PSCHOST_CONSUMER Consumer, NTSTATUS Status, const UCHAR * Data, ULONG Length)
+{
+	FUZZPATH_CONSUMER *	consumer;
+	ULONG *				ends;
+	ULONG *				nextEnds;
+	ULONG				count;
+	ULONG				next;
+	ULONG				scanned;
+	ULONG				at;
+	ULONG				i;
+	ULONG				j;
+
+	consumer = (FUZZPATH_CONSUMER *)Consumer->Context;
+	if(Length == 0)
+		return;
+
+	// every place the first byte may be, then every place each next one
+	// may follow those; a dropped byte matching may have been either
+	ends = FuzzPathEnds;
+	nextEnds = FuzzPathNextEnds;
+	count = 0;
+	for(at = consumer->Offset; at < FuzzPathDelivered; at++)
+		if(FuzzPathStream[at] == Data[0])
+			ends[count++] = at + 1;
+
+	for(i = 1; (i < Length) && (count != 0); i++)
+	{
+		next = 0;
+		scanned = 0;
+		for(j = 0; j < count; j++)
+		{
+			// the ends before it reached as far
+			if(ends[j] < scanned)
+				continue;
+			for(at = ends[j]; at < FuzzPathDelivered; at++)
+			{
+				if(FuzzPathStream[at] == Data[i])
+					nextEnds[next++] = at + 1;
+				if(!FuzzPathDropped[at])
+					break;
+			}
+			scanned = at + 1;
+		}
+		ends = nextEnds;
+		nextEnds = (ends == FuzzPathEnds) ? FuzzPathNextEnds : FuzzPathEnds;
+		count = next;
+	}
+
+	if(count == 0)
+		SCHostFatal("%s read %u bytes, status %x, that aren't the stream's from %u of %u", Consumer->Name,
+			Length, Status, consumer->Offset, FuzzPathDelivered);
+
+	// the earliest end; a later one, if it was that, only lets the next
+	// read start earlier
+	consumer->Offset = ends[0];
+}
+
+// bytes that came in and haven't reached the driver, in the port's
+// buffer or its reads
+static ULONG FuzzPathAtPort(VOID)
+{
+	PLIST_ENTRY	entry;
+	ULONG		count;
+
+	count = FuzzPathHost.Port->Count;
+	for(entry = FuzzPathHost.Port->Reads.Flink; entry != &FuzzPathHost.Port->Reads; entry = entry->Flink)
+		count += (ULONG)CONTAINING_RECORD(entry, IRP, Tail.Overlay.ListEntry)->IoStatus.Information;
+	return count;
+}
+
+// runs whatever the last event left to run
+static VOID FuzzPathSettle(VOID)
+{
+	while(SCHostRunPending())
+		;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  FuzzPathClose
+//      Closes a consumer once the port's reads are cancelled and its
+//      writes have had time to go
+//
+//  Return Value:
+//      FALSE if something it sent is still outstanding, and it is left
+//      open
+//
+static BOOLEAN FuzzPathClose(FUZZPATH_CONSUMER * Consumer)
+{
+	SCSimPortFlush(FuzzPathHost.Port);
+	FuzzPathSettle();
+	SCHostRunUntil(SCHostNow() + 10 * 1000 * 10000);
+	FuzzPathSettle();
+	if((Consumer->Host.Irp != NULL) || (Consumer->Host.WritesPending != 0))
+		return FALSE;
+
+	SCHostConsumerClose(&Consumer->Host);
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  FuzzPathIoctl
+//      An IOCTL event, its buffers from the input, sent if the consumer
+//      is open
+//
+//  Return Value:
+//      bytes of the input it took
+//
+static size_t FuzzPathIoctl(FUZZPATH_CONSUMER * Consumer, const UCHAR * Data, size_t Size)
+{
+	static UCHAR	input[256];
+	static UCHAR	output[FUZZPATH_IOCTL_MAX];
+	ULONG			code;
+	ULONG			inputLength;
+	ULONG			outputLength;
+	ULONG			at;
+	size_t			i;
+
+	i = 0;
+	code = FuzzPathIoctls[((i < Size) ? Data[i++] : 0) % (sizeof(FuzzPathIoctls) / sizeof(FuzzPathIoctls[0]))];
+	inputLength = (i < Size) ? Data[i++] : 0;
+	inputLength = (ULONG)min(inputLength, Size - i);
+	memcpy(input, Data + i, inputLength);
+	i += inputLength;
+	outputLength = ((i < Size) ? Data[i++] : 0) * 4;
+
+	// the owner's purge empties the port's buffer, what is in it or in
+	// the port's reads may never reach a read
+	if((code == IOCTL_SERIAL_PURGE) && (inputLength >= sizeof(ULONG)) && (*(PULONG)input & SERIAL_PURGE_RXCLEAR))
+		for(at = FuzzPathDelivered - FuzzPathAtPort(); at < FuzzPathDelivered; at++)
+			FuzzPathDropped[at] = TRUE;
+
+	if(Consumer->Host.Open)
+		SCHostIoctl(Consumer->Host.DeviceObject, &Consumer->Host.FileObject, code, input, inputLength,
+			output, outputLength, NULL);
+	return i;
+}
+
+int LLVMFuzzerTestOneInput(const UCHAR * Data, size_t Size)
+{
+	static BOOLEAN		started;
+	FUZZPATH_CONSUMER *	consumer;
+	FILE_OBJECT			second;
+	ULONGLONG			random;
+	NTSTATUS			status;
+	size_t				i;
+	ULONG				length;
+	ULONG				c;
+
+	if(!started)
+	{
+		random = 1;
+		for(i = 0; i < FUZZPATH_STREAM_MAX; i++)
+			FuzzPathStream[i] = (UCHAR)SCHostRandom(&random);
+		started = TRUE;
+	}
+
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+	status = SCHostLoad(&FuzzPathHost);
+	if(!NT_SUCCESS(status))
+		SCHostFatal("SerialClone didn't load, status %x", status);
+	memset(FuzzPathConsumers, 0, sizeof(FuzzPathConsumers));
+	memset(FuzzPathDropped, 0, sizeof(FuzzPathDropped));
+	FuzzPathDelivered = 0;
+
+	for(i = 0; i < Size; )
+	{
+		consumer = &FuzzPathConsumers[(Data[i] >> 3) & 1];
+		c = (ULONG)(consumer - FuzzPathConsumers);
+		switch(Data[i++] & 7)
+		{
+		case 0:
+			if(!consumer->Host.Open)
+			{
+				// bytes that reached the driver before it opened are
+				// passed over, those still at the port aren't
+				status = SCHostConsumerOpen(&consumer->Host, (c == 0) ? "filter" : "clone",
+					(c == 0) ? FuzzPathHost.Filter : FuzzPathHost.Clone, FUZZPATH_READ_SIZE,
+					FuzzPathReadDone, consumer);
+				consumer->Offset = FuzzPathDelivered - FuzzPathAtPort();
+				break;
+			}
+
+			// a second handle, which the driver refuses; closed if it doesn't
+			memset(&second, 0, sizeof(second));
+			second.Type = 5;
+			second.Size = sizeof(FILE_OBJECT);
+			second.DeviceObject = consumer->Host.DeviceObject;
+			if(NT_SUCCESS(SCHostRequest(second.DeviceObject, &second, IRP_MJ_CREATE, 0, NULL)))
+			{
+				SCHostRequest(second.DeviceObject, &second, IRP_MJ_CLEANUP, 0, NULL);
+				SCHostRequest(second.DeviceObject, &second, IRP_MJ_CLOSE, 0, NULL);
+			}
+			break;
+
+		case 1:
+			if(consumer->Host.Open)
+				FuzzPathClose(consumer);
+			break;
+
+		case 2:
+			length = ((i < Size) ? Data[i++] : 0) % (FUZZPATH_READ_SIZE + 1);
+			if(consumer->Host.Open)
+				SCHostConsumerRead(&consumer->Host, length);
+			break;
+
+		case 3:
+			length = (i < Size) ? Data[i++] : 0;
+			length = (ULONG)min(length, Size - i);
+			if(consumer->Host.Open)
+				SCHostConsumerWrite(&consumer->Host, Data + i, length);
+			i += length;
+			break;
+
+		case 4:
+			i += FuzzPathIoctl(consumer, Data + i, Size - i);
+			break;
+
+		case 5:
+			length = ((i < Size) ? Data[i++] : 0) + 1;
+			length = min(length, FUZZPATH_STREAM_MAX - FuzzPathDelivered);
+			FuzzPathDelivered += length;
+			SCSimPortReceive(FuzzPathHost.Port, FuzzPathStream + FuzzPathDelivered - length, length);
+			break;
+
+		case 6:
+			SCSimPortFlush(FuzzPathHost.Port);
+			break;
+
+		case 7:
+			length = (i < Size) ? Data[i++] : 0;
+			SCHostRunUntil(SCHostNow() + (ULONGLONG)(length + 1) * 10000);
+			break;
+		}
+		FuzzPathSettle();
+	}
+
+	for(c = 0; c < FUZZPATH_CONSUMERS; c++)
+		if(FuzzPathConsumers[c].Host.Open && !FuzzPathClose(&FuzzPathConsumers[c]))
+			SCHostFatal("%s's read or write outstanding with the port's reads cancelled and 10s gone",
+				FuzzPathConsumers[c].Host.Name);
+
+	status = SCHostUnload(&FuzzPathHost);
+	if(!NT_SUCCESS(status))
+		SCHostFatal("SerialClone didn't unload, status %x", status);
+	if(SCHostCheckLeaks() != 0)
+		SCHostFatal("the driver left things behind");
+	return 0;
+}
@@ -0,0 +1,698 @@
+// io.c
+//
+// The I/O manager of the host harness: driver and device objects, device
+// stacks, and IRPs from allocation through IoCallDriver to completion.
+// IoCompleteRequest walks the stack as the kernel's does, so completion
+// routines see the same current location, device object and
+// PendingReturned a real completion gives them.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <wdm.h>
+#include "shim.h"
+
+#define SCHOST_IO_TYPE_DRIVER	4
+#define SCHOST_IO_TYPE_DEVICE	3
+#define SCHOST_IO_TYPE_IRP		6
+
+#define SCHOST_MAX_DRIVERS		8
+
+#define SCHOST_IO_BUFFER_TAG	'fuBI'		// system buffers of IRPs the shim builds
+
+static PDRIVER_OBJECT	ScHostDrivers[SCHOST_MAX_DRIVERS];
+static KSPIN_LOCK		ScHostCancelLock;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostInvalidDeviceRequest
+//      What a driver object dispatches to for what its driver doesn't handle
+//
+static NTSTATUS ScHostInvalidDeviceRequest(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+	Irp->IoStatus.Status = STATUS_INVALID_DEVICE_REQUEST;
+	Irp->IoStatus.Information = 0;
+	IoCompleteRequest(Irp, IO_NO_INCREMENT);
+	return STATUS_INVALID_DEVICE_REQUEST;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostCopyName
+//      Copies a name into memory of its own
+//
+//  Arguments:
+//      OUT Destination
+//              the copy, terminated
+//
+//      IN  Source
+//              the name
+//
+//      IN  Length
+//              bytes of it
+//
+//  Return Value:
+//      FALSE if out of memory
+//
+static BOOLEAN ScHostCopyName(PUNICODE_STRING Destination, const WCHAR * Source, USHORT Length)
+{
+	Destination->Buffer = malloc(Length + sizeof(WCHAR));
+	if(Destination->Buffer == NULL)
+		return FALSE;
+
+	memcpy(Destination->Buffer, Source, Length);
+	Destination->Buffer[Length / sizeof(WCHAR)] = UNICODE_NULL;
+	Destination->Length = Length;
+	Destination->MaximumLength = Length + sizeof(WCHAR);
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostCreateDriver
+//      Creates a driver object, for the driver to fill in from DriverEntry
+//      or for a simulated driver to fill in itself
+//
+//  Arguments:
+//      IN  Name
+//              \Driver\xxx
+//
+//      IN  DefaultDispatch
+//              every major function to start with, NULL for the I/O
+//              manager's invalid device request
+//
+//  Return Value:
+//      the driver object, NULL if out of memory or room
+//
+PDRIVER_OBJECT SCHostCreateDriver(PCWSTR Name, PDRIVER_DISPATCH DefaultDispatch)
+{
+	PDRIVER_OBJECT	driver;
+	ULONG			slot;
+	ULONG			i;
+
+	for(slot = 0; (slot < SCHOST_MAX_DRIVERS) && (ScHostDrivers[slot] != NULL); slot++)
+		;
+	if(slot == SCHOST_MAX_DRIVERS)
+		return NULL;
+
+	driver = calloc(1, sizeof(DRIVER_OBJECT) + sizeof(DRIVER_EXTENSION));
+	if(driver == NULL)
+		return NULL;
+
+	if(!ScHostCopyName(&driver->DriverName, Name, (USHORT)(wcslen(Name) * sizeof(WCHAR))))
+	{
+		free(driver);
+		return NULL;
+	}
+
+	driver->Type = SCHOST_IO_TYPE_DRIVER;
+	driver->Size = sizeof(DRIVER_OBJECT);
+	driver->DriverExtension = (PDRIVER_EXTENSION)(driver + 1);
+	driver->DriverExtension->DriverObject = driver;
+	for(i = 0; i <= IRP_MJ_MAXIMUM_FUNCTION; i++)
+		driver->MajorFunction[i] = (DefaultDispatch != NULL) ? DefaultDispatch : ScHostInvalidDeviceRequest;
+
+	ScHostDrivers[slot] = driver;
+	return driver;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostDeleteDriver
+//      Deletes a driver object once its devices are gone
+//
+//  Arguments:
+//      IN  DriverObject
+//              from SCHostCreateDriver
+//
+//  Return Value:
+//      None
+//
+VOID SCHostDeleteDriver(PDRIVER_OBJECT DriverObject)
+{
+	ULONG	slot;
+
+	if(DriverObject->DeviceObject != NULL)
+		SCHostFatal("driver %p deleted with devices left", DriverObject);
+
+	for(slot = 0; slot < SCHOST_MAX_DRIVERS; slot++)
+		if(ScHostDrivers[slot] == DriverObject)
+			ScHostDrivers[slot] = NULL;
+
+	free(DriverObject->DriverName.Buffer);
+	free(DriverObject);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostFindDevice
+//      Looks up a named device
+//
+//  Arguments:
+//      IN  Name
+//              \Device\xxx
+//
+//  Return Value:
+//      the device, NULL if there is none of that name
+//
+PDEVICE_OBJECT SCHostFindDevice(PCWSTR Name)
+{
+	PDEVICE_OBJECT	device;
+	USHORT			length;
+	ULONG			slot;
+
+	length = (USHORT)(wcslen(Name) * sizeof(WCHAR));
+	for(slot = 0; slot < SCHOST_MAX_DRIVERS; slot++)
+	{
+		if(ScHostDrivers[slot] == NULL)
+			continue;
+
+		for(device = ScHostDrivers[slot]->DeviceObject; device != NULL; device = device->NextDevice)
+			if((device->Name.Length == length) && !memcmp(device->Name.Buffer, Name, length))
+				return device;
+	}
+
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Devices
+//
+NTSTATUS IoCreateDevice(PDRIVER_OBJECT DriverObject, ULONG DeviceExtensionSize, PUNICODE_STRING DeviceName,
+	ULONG DeviceType, ULONG DeviceCharacteristics, BOOLEAN Exclusive, PDEVICE_OBJECT * DeviceObject)
+{
+	PDEVICE_OBJECT	device;
+	size_t			size;
+
+	if(KeGetCurrentIrql() != PASSIVE_LEVEL)
+		SCHostFatal("IoCreateDevice at IRQL %d", KeGetCurrentIrql());
+
+	if(DeviceName != NULL)
+	{
+		WCHAR	name[128];
+
+		if(DeviceName->Length >= sizeof(name))
+			return STATUS_INVALID_PARAMETER;
+		memcpy(name, DeviceName->Buffer, DeviceName->Length);
+		name[DeviceName->Length / sizeof(WCHAR)] = UNICODE_NULL;
+		if(SCHostFindDevice(name) != NULL)
+			return STATUS_OBJECT_NAME_COLLISION;
+	}
+
+	// the extension follows the object, aligned as pool is
+	size = (sizeof(DEVICE_OBJECT) + 63) & ~(size_t)63;
+	if(posix_memalign((void **)&device, 64, size + DeviceExtensionSize) != 0)
+		return STATUS_INSUFFICIENT_RESOURCES;
+	memset(device, 0, size + DeviceExtensionSize);
+
+	if((DeviceName != NULL) && !ScHostCopyName(&device->Name, DeviceName->Buffer, DeviceName->Length))
+	{
+		free(device);
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	device->Type = SCHOST_IO_TYPE_DEVICE;
+	device->Size = (USHORT)(sizeof(DEVICE_OBJECT) + DeviceExtensionSize);
+	device->DriverObject = DriverObject;
+	device->Flags = DO_DEVICE_INITIALIZING | (Exclusive ? DO_EXCLUSIVE : 0);
+	device->Characteristics = DeviceCharacteristics;
+	device->DeviceExtension = (DeviceExtensionSize != 0) ? (PUCHAR)device + size : NULL;
+	device->DeviceType = DeviceType;
+	device->StackSize = 1;
+
+	device->NextDevice = DriverObject->DeviceObject;
+	DriverObject->DeviceObject = device;
+
+	*DeviceObject = device;
+	return STATUS_SUCCESS;
+}
+
+static VOID ScHostFreeDevice(PDEVICE_OBJECT DeviceObject)
+{
+	DeviceObject->Type = 0;
+	free(DeviceObject->Name.Buffer);
+	free(DeviceObject);
+}
+
+VOID IoDeleteDevice(PDEVICE_OBJECT DeviceObject)
+{
+	PDEVICE_OBJECT *	link;
+
+	if(DeviceObject->Type != SCHOST_IO_TYPE_DEVICE)
+		SCHostFatal("IoDeleteDevice of %p, not a device", DeviceObject);
+	if(DeviceObject->DeletePending)
+		SCHostFatal("device %p deleted twice", DeviceObject);
+	if(DeviceObject->AttachedDevice != NULL)
+		SCHostFatal("device %p deleted with %p still attached to it", DeviceObject, DeviceObject->AttachedDevice);
+
+	for(link = &DeviceObject->DriverObject->DeviceObject; *link != NULL; link = &(*link)->NextDevice)
+		if(*link == DeviceObject)
+		{
+			*link = DeviceObject->NextDevice;
+			break;
+		}
+
+	DeviceObject->DeletePending = TRUE;
+	if(DeviceObject->ReferenceCount == 0)
+		ScHostFreeDevice(DeviceObject);
+}
+
+PDEVICE_OBJECT IoAttachDeviceToDeviceStack(PDEVICE_OBJECT SourceDevice, PDEVICE_OBJECT TargetDevice)
+{
+	PDEVICE_OBJECT	top;
+
+	for(top = TargetDevice; top->AttachedDevice != NULL; top = top->AttachedDevice)
+		;
+	if(top->DeletePending)
+		return NULL;
+
+	top->AttachedDevice = SourceDevice;
+	SourceDevice->StackSize = top->StackSize + 1;
+	return top;
+}
+
+VOID IoDetachDevice(PDEVICE_OBJECT TargetDevice)
+{
+	if(TargetDevice->AttachedDevice == NULL)
+		SCHostFatal("IoDetachDevice of %p, nothing is attached", TargetDevice);
+	TargetDevice->AttachedDevice = NULL;
+}
+
+PDEVICE_OBJECT IoGetAttachedDeviceReference(PDEVICE_OBJECT DeviceObject)
+{
+	while(DeviceObject->AttachedDevice != NULL)
+		DeviceObject = DeviceObject->AttachedDevice;
+	ObReferenceObject(DeviceObject);
+	return DeviceObject;
+}
+
+// the shim is Windows XP, WDM 1.20
+BOOLEAN IoIsWdmVersionAvailable(UCHAR MajorVersion, UCHAR MinorVersion)
+{
+	return (BOOLEAN)((MajorVersion < 1) || ((MajorVersion == 1) && (MinorVersion <= 0x20)));
+}
+
+// device objects are the only objects the shim has
+VOID ObReferenceObject(PVOID Object)
+{
+	PDEVICE_OBJECT	device = (PDEVICE_OBJECT)Object;
+
+	if(device->Type != SCHOST_IO_TYPE_DEVICE)
+		SCHostFatal("ObReferenceObject of %p, not a device", Object);
+	device->ReferenceCount++;
+}
+
+VOID ObDereferenceObject(PVOID Object)
+{
+	PDEVICE_OBJECT	device = (PDEVICE_OBJECT)Object;
+
+	if((device->Type != SCHOST_IO_TYPE_DEVICE) || (device->ReferenceCount <= 0))
+		SCHostFatal("ObDereferenceObject of %p, not a referenced device", Object);
+	if((--device->ReferenceCount == 0) && device->DeletePending)
+		ScHostFreeDevice(device);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  IRPs
+//
+VOID IoInitializeIrp(PIRP Irp, USHORT PacketSize, CCHAR StackSize)
+{
+	memset(Irp, 0, PacketSize);
+	Irp->Type = SCHOST_IO_TYPE_IRP;
+	Irp->Size = PacketSize;
+	Irp->StackCount = StackSize;
+	Irp->CurrentLocation = StackSize + 1;
+	Irp->Tail.Overlay.CurrentStackLocation = (PIO_STACK_LOCATION)(Irp + 1) + StackSize;
+	InitializeListHead(&Irp->ThreadListEntry);
+}
+
+PIRP IoAllocateIrp(CCHAR StackSize, BOOLEAN ChargeQuota)
+{
+	PIRP	irp;
+	USHORT	size;
+
+	if(KeGetCurrentIrql() > DISPATCH_LEVEL)
+		SCHostFatal("IoAllocateIrp above DISPATCH_LEVEL");
+	if(StackSize <= 0)
+		SCHostFatal("IoAllocateIrp of %d stack locations", StackSize);
+
+	size = IoSizeOfIrp(StackSize);
+	irp = malloc(size);
+	if(irp == NULL)
+		return NULL;
+
+	IoInitializeIrp(irp, size, StackSize);
+	g_SCHostStats.Irps++;
+	g_SCHostStats.IrpsOutstanding++;
+	return irp;
+}
+
+VOID IoFreeIrp(PIRP Irp)
+{
+	if(Irp->Type != SCHOST_IO_TYPE_IRP)
+		SCHostFatal("IoFreeIrp of %p, not an IRP", Irp);
+	if(Irp->CancelRoutine != NULL)
+		SCHostFatal("IRP %p freed with a cancel routine set", Irp);
+
+	Irp->Type = 0;
+	g_SCHostStats.IrpsOutstanding--;
+	free(Irp);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  IoCallDriver
+//      Steps an IRP down to the next stack location and dispatches it
+//
+//  Arguments:
+//      IN  DeviceObject
+//              the device the IRP goes to
+//
+//      IN  Irp
+//              the IRP, its next stack location filled in
+//
+//  Return Value:
+//      what the driver's dispatch routine returns
+//
+NTSTATUS IoCallDriver(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+	PIO_STACK_LOCATION	irpStack;
+	KIRQL				irql;
+	NTSTATUS			status;
+
+	if(Irp->Type != SCHOST_IO_TYPE_IRP)
+		SCHostFatal("IoCallDriver of %p, not an IRP", Irp);
+	if(DeviceObject->Type != SCHOST_IO_TYPE_DEVICE)
+		SCHostFatal("IRP %p sent to %p, not a device", Irp, DeviceObject);
+
+	irql = KeGetCurrentIrql();
+	if(irql > DISPATCH_LEVEL)
+		SCHostFatal("IoCallDriver above DISPATCH_LEVEL");
+
+	IoSetNextIrpStackLocation(Irp);
+	if(Irp->CurrentLocation <= 0)
+		SCHostFatal("IRP %p sent to %p with no stack location left for it", Irp, DeviceObject);
+
+	irpStack = IoGetCurrentIrpStackLocation(Irp);
+	irpStack->DeviceObject = DeviceObject;
+
+	SCHostRacePoint();
+	status = DeviceObject->DriverObject->MajorFunction[irpStack->MajorFunction](DeviceObject, Irp);
+
+	if(KeGetCurrentIrql() != irql)
+		SCHostFatal("dispatch of major function %d by %p returned at IRQL %d, called at %d",
+			irpStack->MajorFunction, DeviceObject, KeGetCurrentIrql(), irql);
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostCompleteBuiltIrp
+//      Finishes an IRP from IoBuildDeviceIoControlRequest once the last
+//      driver has completed it: the reply is copied out, the status block
+//      filled in and the event set, as the kernel's completion APC does in
+//      the thread that built it
+//
+static VOID ScHostCompleteBuiltIrp(PIRP Irp)
+{
+	if(Irp->Flags & IRP_BUFFERED_IO)
+	{
+		if((Irp->Flags & IRP_INPUT_OPERATION) && !NT_ERROR(Irp->IoStatus.Status) && (Irp->IoStatus.Information != 0))
+			memcpy(Irp->UserBuffer, Irp->AssociatedIrp.SystemBuffer, Irp->IoStatus.Information);
+		if(Irp->Flags & IRP_DEALLOCATE_BUFFER)
+			ExFreePoolWithTag(Irp->AssociatedIrp.SystemBuffer, SCHOST_IO_BUFFER_TAG);
+	}
+
+	*Irp->UserIosb = Irp->IoStatus;
+	if(Irp->UserEvent != NULL)
+		KeSetEvent(Irp->UserEvent, IO_NO_INCREMENT, FALSE);
+	IoFreeIrp(Irp);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  IoCompleteRequest
+//      Completes an IRP, calling the completion routines of the stack
+//      locations above the current one on the way up. A routine that
+//      returns STATUS_MORE_PROCESSING_REQUIRED takes the IRP back.
+//
+//  Arguments:
+//      IN  Irp
+//              the IRP, its IoStatus set
+//
+//      IN  PriorityBoost
+//              unused
+//
+//  Return Value:
+//      None
+//
+VOID IoCompleteRequest(PIRP Irp, CCHAR PriorityBoost)
+{
+	PIO_STACK_LOCATION	irpStack;
+	PDEVICE_OBJECT		device;
+	NTSTATUS			status;
+
+	if((Irp->Type != SCHOST_IO_TYPE_IRP) || (Irp->CurrentLocation > Irp->StackCount + 1))
+		SCHostFatal("IRP %p completed more than once", Irp);
+	if(Irp->IoStatus.Status == STATUS_PENDING)
+		SCHostFatal("IRP %p completed with STATUS_PENDING", Irp);
+	if(Irp->CancelRoutine != NULL)
+		SCHostFatal("IRP %p completed with a cancel routine set", Irp);
+	if(KeGetCurrentIrql() > DISPATCH_LEVEL)
+		SCHostFatal("IoCompleteRequest above DISPATCH_LEVEL");
+
+	SCHostRacePoint();
+
+	for(irpStack = IoGetCurrentIrpStackLocation(Irp), IoSkipCurrentIrpStackLocation(Irp);
+		Irp->CurrentLocation <= Irp->StackCount + 1;
+		irpStack++, IoSkipCurrentIrpStackLocation(Irp))
+	{
+		Irp->PendingReturned = irpStack->Control & SL_PENDING_RETURNED;
+
+		// the location is cleared before its routine runs, as the
+		// kernel's is, leaving only the routine and its context
+		irpStack->MinorFunction = 0;
+		irpStack->Flags = 0;
+		irpStack->Parameters.Others.Argument1 = NULL;
+		irpStack->Parameters.Others.Argument2 = NULL;
+		irpStack->Parameters.Others.Argument3 = NULL;
+		irpStack->Parameters.Others.Argument4 = NULL;
+		irpStack->FileObject = NULL;
+
+		if((NT_SUCCESS(Irp->IoStatus.Status) && (irpStack->Control & SL_INVOKE_ON_SUCCESS)) ||
+			(!NT_SUCCESS(Irp->IoStatus.Status) && (irpStack->Control & SL_INVOKE_ON_ERROR)) ||
+			(Irp->Cancel && (irpStack->Control & SL_INVOKE_ON_CANCEL)))
+		{
+			irpStack->Control = 0;
+			device = (Irp->CurrentLocation == Irp->StackCount + 1) ? NULL :
+				IoGetCurrentIrpStackLocation(Irp)->DeviceObject;
+
+			status = irpStack->CompletionRoutine(device, Irp, irpStack->Context);
+			if(status == STATUS_MORE_PROCESSING_REQUIRED)
+				return;
+		}
+		else
+		{
+			irpStack->Control = 0;
+			if(Irp->PendingReturned && (Irp->CurrentLocation <= Irp->StackCount))
+				IoMarkIrpPending(Irp);
+		}
+	}
+
+	// past the last location the IRP is the I/O manager's. The harness
+	// owns its own IRPs through a completion routine, so only IRPs a
+	// driver built for itself get here.
+	if(Irp->UserIosb == NULL)
+		SCHostFatal("IRP %p completed past its last stack location with no one to take it", Irp);
+	ScHostCompleteBuiltIrp(Irp);
+}
+
+PDRIVER_CANCEL IoSetCancelRoutine(PIRP Irp, PDRIVER_CANCEL CancelRoutine)
+{
+	return (PDRIVER_CANCEL)InterlockedExchangePointer((PVOID volatile *)&Irp->CancelRoutine, (PVOID)CancelRoutine);
+}
+
+VOID IoAcquireCancelSpinLock(PKIRQL Irql)
+{
+	KeAcquireSpinLock(&ScHostCancelLock, Irql);
+}
+
+VOID IoReleaseCancelSpinLock(KIRQL Irql)
+{
+	KeReleaseSpinLock(&ScHostCancelLock, Irql);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  IoCancelIrp
+//      Marks an IRP cancelled and calls its cancel routine if it has one
+//
+//  Arguments:
+//      IN  Irp
+//              the IRP
+//
+//  Return Value:
+//      TRUE if a cancel routine was called
+//
+BOOLEAN IoCancelIrp(PIRP Irp)
+{
+	PDRIVER_CANCEL	routine;
+	KIRQL			irql;
+
+	IoAcquireCancelSpinLock(&irql);
+	Irp->Cancel = TRUE;
+
+	routine = IoSetCancelRoutine(Irp, NULL);
+	if(routine == NULL)
+	{
+		IoReleaseCancelSpinLock(irql);
+		return FALSE;
+	}
+
+	// the cancel routine releases the cancel spin lock
+	Irp->CancelIrql = irql;
+	routine(IoGetCurrentIrpStackLocation(Irp)->DeviceObject, Irp);
+	return TRUE;
+}
+
+static NTSTATUS ScHostForwardComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp, PVOID Context)
+{
+	if(Irp->PendingReturned)
+		KeSetEvent((PKEVENT)Context, IO_NO_INCREMENT, FALSE);
+	return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+BOOLEAN IoForwardIrpSynchronously(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+	KEVENT	event;
+
+	if(KeGetCurrentIrql() != PASSIVE_LEVEL)
+		SCHostFatal("IoForwardIrpSynchronously at IRQL %d", KeGetCurrentIrql());
+
+	KeInitializeEvent(&event, NotificationEvent, FALSE);
+	IoCopyCurrentIrpStackLocationToNext(Irp);
+	IoSetCompletionRoutine(Irp, ScHostForwardComplete, &event, TRUE, TRUE, TRUE);
+
+	if(IoCallDriver(DeviceObject, Irp) == STATUS_PENDING)
+		KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, NULL);
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  IoBuildDeviceIoControlRequest
+//      Builds an IOCTL for a driver to send itself. Only METHOD_BUFFERED
+//      codes, the serial ones all are. The IRP frees itself when it is
+//      completed, see ScHostCompleteBuiltIrp.
+//
+//  Arguments:
+//      IN  IoControlCode
+//              the IOCTL
+//
+//      IN  DeviceObject
+//              where it will be sent, for its stack size
+//
+//      IN  InputBuffer
+//              what goes down, optional
+//
+//      IN  InputBufferLength
+//              bytes of it
+//
+//      OUT OutputBuffer
+//              gets the reply, optional
+//
+//      IN  OutputBufferLength
+//              bytes of it
+//
+//      IN  InternalDeviceIoControl
+//              TRUE for IRP_MJ_INTERNAL_DEVICE_CONTROL
+//
+//      IN  Event
+//              set when it completes, optional
+//
+//      OUT IoStatusBlock
+//              its final status
+//
+//  Return Value:
+//      the IRP, NULL if out of memory
+//
+PIRP IoBuildDeviceIoControlRequest(ULONG IoControlCode, PDEVICE_OBJECT DeviceObject, PVOID InputBuffer,
+	ULONG InputBufferLength, PVOID OutputBuffer, ULONG OutputBufferLength, BOOLEAN InternalDeviceIoControl,
+	PKEVENT Event, PIO_STATUS_BLOCK IoStatusBlock)
+{
+	PIO_STACK_LOCATION	irpStack;
+	PIRP				irp;
+	ULONG				length;
+
+	if(METHOD_FROM_CTL_CODE(IoControlCode) != METHOD_BUFFERED)
+		SCHostFatal("IoBuildDeviceIoControlRequest of %x, only METHOD_BUFFERED is simulated", IoControlCode);
+	if(IoStatusBlock == NULL)
+		SCHostFatal("IoBuildDeviceIoControlRequest of %x with no status block", IoControlCode);
+
+	irp = IoAllocateIrp(DeviceObject->StackSize, FALSE);
+	if(irp == NULL)
+		return NULL;
+
+	length = max(InputBufferLength, OutputBufferLength);
+	if(length != 0)
+	{
+		irp->AssociatedIrp.SystemBuffer = ExAllocatePoolWithTag(NonPagedPool, length, SCHOST_IO_BUFFER_TAG);
+		if(irp->AssociatedIrp.SystemBuffer == NULL)
+		{
+			IoFreeIrp(irp);
+			return NULL;
+		}
+		if(InputBuffer != NULL)
+			memcpy(irp->AssociatedIrp.SystemBuffer, InputBuffer, InputBufferLength);
+
+		irp->Flags = IRP_BUFFERED_IO | IRP_DEALLOCATE_BUFFER;
+		if(OutputBuffer != NULL)
+			irp->Flags |= IRP_INPUT_OPERATION;
+	}
+
+	irp->UserBuffer = OutputBuffer;
+	irp->UserIosb = IoStatusBlock;
+	irp->UserEvent = Event;
+
+	irpStack = IoGetNextIrpStackLocation(irp);
+	irpStack->MajorFunction = InternalDeviceIoControl ? IRP_MJ_INTERNAL_DEVICE_CONTROL : IRP_MJ_DEVICE_CONTROL;
+	irpStack->Parameters.DeviceIoControl.IoControlCode = IoControlCode;
+	irpStack->Parameters.DeviceIoControl.InputBufferLength = InputBufferLength;
+	irpStack->Parameters.DeviceIoControl.OutputBufferLength = OutputBufferLength;
+	return irp;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  PnP, power and WMI registration, none of which the host has
+//
+NTSTATUS IoCreateSymbolicLink(PUNICODE_STRING SymbolicLinkName, PUNICODE_STRING DeviceName)
+{
+	SCHostNotSimulated();
+}
+
+NTSTATUS IoDeleteSymbolicLink(PUNICODE_STRING SymbolicLinkName)
+{
+	SCHostNotSimulated();
+}
+
+NTSTATUS IoRegisterDeviceInterface(PDEVICE_OBJECT PhysicalDeviceObject, const GUID * InterfaceClassGuid,
+	PUNICODE_STRING ReferenceString, PUNICODE_STRING SymbolicLinkName)
+{
+	SCHostNotSimulated();
+}
+
+NTSTATUS IoSetDeviceInterfaceState(PUNICODE_STRING SymbolicLinkName, BOOLEAN Enable)
+{
+	SCHostNotSimulated();
+}
+
+NTSTATUS IoOpenDeviceRegistryKey(PDEVICE_OBJECT DeviceObject, ULONG DevInstKeyType, ACCESS_MASK DesiredAccess,
+	PHANDLE DevInstRegKey)
+{
+	SCHostNotSimulated();
+}
+
+// registration is accepted and nothing is ever asked of it
+NTSTATUS IoWMIRegistrationControl(PDEVICE_OBJECT DeviceObject, ULONG Action)
+{
+	return STATUS_SUCCESS;
+}
+
+VOID PoStartNextPowerIrp(PIRP Irp)
+{
+}
@@ -0,0 +1,297 @@
+// race.c
+//
+// Races code on simulated processors, for what only goes wrong when a
+// dispatch routine on one processor and a completion routine on another
+// run into each other. Each task runs as a coroutine on a processor of its
+// own, on the harness's one thread, and is switched out at every point
+// where a real processor could fall behind another: taking and dropping a
+// spin lock, an interlocked operation, IoCallDriver and IoCompleteRequest.
+// A task taking a lock another holds is switched out until it is free.
+//
+// Which task goes on at each point is PCT's choice (Burckhardt et al.,
+// "A Randomized Scheduler with Probabilistic Guarantees of Finding Bugs"):
+// the tasks get random priorities, the highest runnable one always runs,
+// and at Depth - 1 points picked at random out of the Steps a race is
+// expected to take the one running drops below everything else. A bug
+// that needs d things to happen in order is found by one race in
+// n * k^(d-1) or better. Depth 0 picks a task at random at every point
+// instead. Either way the seed decides everything, so a race that fails
+// is repeated by running its seed again, and SCHostFatal says which seed
+// and point it stopped at.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ucontext.h>
+
+#include <wdm.h>
+#include "shim.h"
+
+#define SCHOST_RACE_STACK		(256 * 1024)
+
+typedef struct _SCHOST_RACER
+{
+	SCHOST_TASK				Task;
+	ucontext_t				Context;
+	PVOID					Stack;				// kept from race to race
+	PKSPIN_LOCK				Waiting;			// spinning on it
+	ULONG					Priority;
+	BOOLEAN					Done;
+} SCHOST_RACER, *PSCHOST_RACER;
+
+static SCHOST_RACER			ScHostRacers[SCHOST_RACE_MAX];
+static ucontext_t			ScHostRaceMain;
+static PSCHOST_RACE			ScHostRaceCurrent;	// NULL when not racing
+static PSCHOST_RACER		ScHostRacer;		// the one running, NULL in the scheduler
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostRaceTask
+//      A task from start to finish on its processor, back to the
+//      scheduler when it returns
+//
+static VOID ScHostRaceTask(int Index)
+{
+	PSCHOST_RACER	racer;
+	KIRQL			oldIrql;
+
+	racer = &ScHostRacers[Index];
+	if(racer->Task.Irql != PASSIVE_LEVEL)
+		KeRaiseIrql(racer->Task.Irql, &oldIrql);
+
+	racer->Task.Routine(racer->Task.Context);
+
+	if(KeGetCurrentIrql() != racer->Task.Irql)
+		SCHostFatal("race task %p returned at IRQL %d", racer->Task.Routine, KeGetCurrentIrql());
+	if(SCHostGetLocksHeld() != 0)
+		SCHostFatal("race task %p returned holding %u spin locks", racer->Task.Routine, SCHostGetLocksHeld());
+	KeLowerIrql(PASSIVE_LEVEL);
+
+	racer->Done = TRUE;
+}
+
+// TRUE if a task can go on: not finished, and not spinning on a lock
+// still held
+static BOOLEAN ScHostRaceRunnable(PSCHOST_RACER Racer)
+{
+	return !Racer->Done && ((Racer->Waiting == NULL) || (*Racer->Waiting == 0));
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostRacePick
+//      Picks the task to go on, the highest priority runnable one or,
+//      Depth 0, any runnable one
+//
+//  Return Value:
+//      the task, NULL if none can go on
+//
+static PSCHOST_RACER ScHostRacePick(PSCHOST_RACE Race, ULONG Count, PULONGLONG Random)
+{
+	PSCHOST_RACER	pick;
+	ULONG			runnable;
+	ULONG			n;
+	ULONG			i;
+
+	for(runnable = 0, i = 0; i < Count; i++)
+		if(ScHostRaceRunnable(&ScHostRacers[i]))
+			runnable++;
+	if(runnable == 0)
+		return NULL;
+
+	pick = NULL;
+	if(Race->Depth == 0)
+	{
+		n = SCHostRandom(Random) % runnable;
+		for(i = 0; i < Count; i++)
+			if(ScHostRaceRunnable(&ScHostRacers[i]) && (n-- == 0))
+				pick = &ScHostRacers[i];
+	}
+	else
+	{
+		for(i = 0; i < Count; i++)
+			if(ScHostRaceRunnable(&ScHostRacers[i]) && ((pick == NULL) || (ScHostRacers[i].Priority > pick->Priority)))
+				pick = &ScHostRacers[i];
+	}
+	return pick;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRace
+//      Runs tasks, one to a processor, interleaved as the seed decides,
+//      until all of them have returned
+//
+//  Arguments:
+//      IN  Tasks
+//              what each processor does, Tasks[i] on processor i
+//
+//      IN  Count
+//              how many, up to SCHOST_RACE_MAX and the processors set
+//
+//      IN OUT Race
+//              the seed and how to schedule; what happened is filled in
+//
+//  Return Value:
+//      STATUS_SUCCESS, or STATUS_UNSUCCESSFUL when Check found something
+//      wrong, in Race->Failure, and the race was abandoned. Abandoned
+//      tasks are left where they were, with whatever they held; the
+//      harness can only report it and stop.
+//
+NTSTATUS SCHostRace(PSCHOST_TASK Tasks, ULONG Count, PSCHOST_RACE Race)
+{
+	PSCHOST_RACER	racer;
+	PSCHOST_RACER	last;
+	ULONGLONG		random;
+	ULONG			changes[16];
+	ULONG			depth;
+	ULONG			done;
+	ULONG			i;
+	ULONG			j;
+
+	if((Count == 0) || (Count > SCHOST_RACE_MAX) || (Count > SCHostGetProcessors()))
+		SCHostFatal("a race of %u tasks on %u processors", Count, SCHostGetProcessors());
+	if(ScHostRaceCurrent != NULL)
+		SCHostFatal("a race within a race");
+	if(KeGetCurrentIrql() != PASSIVE_LEVEL)
+		SCHostFatal("SCHostRace at IRQL %d", KeGetCurrentIrql());
+
+	Race->Points = 0;
+	Race->Switches = 0;
+	Race->Spins = 0;
+	Race->Failure = NULL;
+	random = Race->Seed;
+
+	depth = min(Race->Depth, sizeof(changes) / sizeof(changes[0]) + 1);
+	for(i = 0; i + 1 < depth; i++)
+		changes[i] = 1 + SCHostRandom(&random) % max(Race->Steps, 1);
+
+	for(i = 0; i < Count; i++)
+	{
+		racer = &ScHostRacers[i];
+		if(racer->Stack == NULL)
+		{
+			racer->Stack = malloc(SCHOST_RACE_STACK);
+			if(racer->Stack == NULL)
+				SCHostFatal("out of memory for a race stack");
+		}
+		racer->Task = Tasks[i];
+		racer->Waiting = NULL;
+		racer->Done = FALSE;
+		racer->Priority = 0;
+
+		getcontext(&racer->Context);
+		racer->Context.uc_stack.ss_sp = racer->Stack;
+		racer->Context.uc_stack.ss_size = SCHOST_RACE_STACK;
+		racer->Context.uc_link = &ScHostRaceMain;
+		makecontext(&racer->Context, (void (*)(void))ScHostRaceTask, 1, (int)i);
+	}
+
+	// priorities depth and up, shuffled; those below depth are for the
+	// change points
+	for(i = 0; i < Count; i++)
+	{
+		j = SCHostRandom(&random) % (i + 1);
+		ScHostRacers[i].Priority = ScHostRacers[j].Priority;
+		ScHostRacers[j].Priority = depth + i;
+	}
+
+	ScHostRaceCurrent = Race;
+	last = NULL;
+	for(;;)
+	{
+		if(Race->Check != NULL)
+		{
+			Race->Failure = Race->Check(Race->CheckContext);
+			if(Race->Failure != NULL)
+				break;
+		}
+
+		for(done = 0, i = 0; i < Count; i++)
+			if(ScHostRacers[i].Done)
+				done++;
+		if(done == Count)
+			break;
+
+		// the one that was running drops below the rest at a change point
+		if(last != NULL)
+			for(i = 0; i + 1 < depth; i++)
+				if(changes[i] == Race->Points)
+					last->Priority = i + 1;
+
+		racer = ScHostRacePick(Race, Count, &random);
+		if(racer == NULL)
+			SCHostFatal("racing processors all spinning on held locks, a deadlock");
+		if((last != NULL) && (racer != last))
+			Race->Switches++;
+		last = racer;
+
+		racer->Waiting = NULL;
+		ScHostRacer = racer;
+		SCHostSetProcessor((ULONG)(racer - ScHostRacers));
+		swapcontext(&ScHostRaceMain, &racer->Context);
+		SCHostSetProcessor(0);
+		ScHostRacer = NULL;
+	}
+	ScHostRaceCurrent = NULL;
+
+	return (Race->Failure == NULL) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRacePoint
+//      Where a racing processor may be switched for another; nothing when
+//      not racing
+//
+VOID SCHostRacePoint(VOID)
+{
+	PSCHOST_RACER	racer;
+
+	racer = ScHostRacer;
+	if(racer == NULL)
+		return;
+
+	ScHostRaceCurrent->Points++;
+	swapcontext(&racer->Context, &ScHostRaceMain);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRaceSpin
+//      A racing processor spins on a lock another holds; it goes on once
+//      the lock is free
+//
+//  Arguments:
+//      IN  SpinLock
+//              the lock
+//
+//  Return Value:
+//      FALSE when not racing, the lock can't be freed by anyone else
+//
+BOOLEAN SCHostRaceSpin(PKSPIN_LOCK SpinLock)
+{
+	PSCHOST_RACER	racer;
+
+	racer = ScHostRacer;
+	if(racer == NULL)
+		return FALSE;
+
+	racer->Waiting = SpinLock;
+	ScHostRaceCurrent->Spins++;
+	swapcontext(&racer->Context, &ScHostRaceMain);
+	return TRUE;
+}
+
+// TRUE while a race is being run, the seed and the point it is at for
+// messages
+BOOLEAN SCHostRaceRunning(PULONGLONG Seed, PULONG Point)
+{
+	if(ScHostRaceCurrent == NULL)
+		return FALSE;
+
+	if(Seed != NULL)
+		*Seed = ScHostRaceCurrent->Seed;
+	if(Point != NULL)
+		*Point = ScHostRaceCurrent->Points;
+	return TRUE;
+}
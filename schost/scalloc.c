@@ -0,0 +1,270 @@
+// scalloc.c
+//
+// Counts what SerialClone allocates for each read. The driver is loaded
+// on a simulated port, the filter's consumer and the clone's keep a read
+// outstanding, and bytes arrive at the port a read's worth at a time.
+// Once both consumers are reading and their read buffers are there, the
+// pool allocations and IRPs made while the reads go on are counted and
+// divided by the reads the consumers completed. The read path keeps what
+// it tracks of a read in the IRP, so a read should cost no pool at all;
+// the one IRP a read is the consumer's own.
+//
+//	scalloc [options]
+//
+//	-r N,...		bytes a read asks for, 16,256,4096 by default
+//	-n N			deliveries counted at each size, 100000 by default
+//	-p Name=Value	a driver parameter, as under its Parameters key
+//	-v				show the driver's debug output
+//
+// A tab separated line per read size, after a line naming the columns:
+// the read size, the reads both consumers completed, the pool
+// allocations and IRPs made meanwhile, each of those per read, and the
+// host's CPU time per read, for comparing one build with another.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "schost.h"
+
+#define SCALLOC_CONSUMERS		2		// the filter's and the clone's
+#define SCALLOC_LIST_MAX		16
+#define SCALLOC_PARAMETERS		16
+#define SCALLOC_WARMUP			100		// deliveries before counting starts
+
+typedef struct _SCALLOC_PARAMETER
+{
+	PCSTR					Name;
+	ULONG					Value;
+} SCALLOC_PARAMETER;
+
+typedef struct _SCALLOC_RESULT
+{
+	ULONGLONG				Reads;
+	ULONGLONG				Allocations;
+	ULONGLONG				Irps;
+	double					Cpu;			// seconds
+} SCALLOC_RESULT;
+
+// the process's CPU time, in seconds
+static double ScAllocCpu(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// runs whatever the last delivery left to run
+static VOID ScAllocSettle(VOID)
+{
+	while(SCHostRunPending())
+		;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScAllocRun
+//      One read size, the driver loaded afresh
+//
+//  Arguments:
+//      IN  ReadSize
+//              bytes each read asks for, and each delivery
+//
+//      IN  Deliveries
+//              deliveries counted
+//
+//      IN  Parameters, ParameterCount
+//              driver parameters to set first
+//
+//      OUT Result
+//              what was counted
+//
+//  Return Value:
+//      0, or -1 if the driver wouldn't load, open or unload
+//
+static int ScAllocRun(ULONG ReadSize, ULONG Deliveries, const SCALLOC_PARAMETER * Parameters,
+	ULONG ParameterCount, SCALLOC_RESULT * Result)
+{
+	static SCHOST			host;
+	static SCHOST_CONSUMER	consumers[SCALLOC_CONSUMERS];
+	UCHAR *					data;
+	ULONGLONG				reads;
+	ULONGLONG				allocations;
+	ULONGLONG				irps;
+	NTSTATUS				status;
+	ULONG					leaks;
+	ULONG					i;
+	ULONG					c;
+	double					cpu;
+
+	data = malloc(ReadSize);
+	if(data == NULL)
+		return -1;
+	for(i = 0; i < ReadSize; i++)
+		data[i] = (UCHAR)i;
+
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+	for(i = 0; i < ParameterCount; i++)
+		if(!NT_SUCCESS(SCHostSetParameter(Parameters[i].Name, Parameters[i].Value)))
+			SCHostFatal("couldn't set %s", Parameters[i].Name);
+
+	status = SCHostLoad(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scalloc: SerialClone didn't load, status %x\n", status);
+		free(data);
+		return -1;
+	}
+
+	for(c = 0; c < SCALLOC_CONSUMERS; c++)
+	{
+		status = SCHostConsumerOpen(&consumers[c], (c == 0) ? "filter" : "clone",
+			(c == 0) ? host.Filter : host.Clone, ReadSize, NULL, NULL);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scalloc: the %s didn't open, status %x\n", consumers[c].Name, status);
+			free(data);
+			return -1;
+		}
+		SCHostConsumerStart(&consumers[c]);
+	}
+	ScAllocSettle();
+
+	for(i = 0; i < SCALLOC_WARMUP; i++)
+	{
+		SCSimPortReceive(host.Port, data, ReadSize);
+		ScAllocSettle();
+	}
+
+	reads = consumers[0].Reads + consumers[1].Reads;
+	allocations = g_SCHostStats.Allocations;
+	irps = g_SCHostStats.Irps;
+	cpu = ScAllocCpu();
+	for(i = 0; i < Deliveries; i++)
+	{
+		SCSimPortReceive(host.Port, data, ReadSize);
+		ScAllocSettle();
+	}
+
+	Result->Cpu = ScAllocCpu() - cpu;
+	Result->Reads = consumers[0].Reads + consumers[1].Reads - reads;
+	Result->Allocations = g_SCHostStats.Allocations - allocations;
+	Result->Irps = g_SCHostStats.Irps - irps;
+
+	// the last reads go back with nothing once the port's are cancelled
+	for(c = 0; c < SCALLOC_CONSUMERS; c++)
+		SCHostConsumerStop(&consumers[c]);
+	SCSimPortFlush(host.Port);
+	ScAllocSettle();
+	for(c = 0; c < SCALLOC_CONSUMERS; c++)
+		SCHostConsumerClose(&consumers[c]);
+	free(data);
+
+	status = SCHostUnload(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scalloc: SerialClone didn't unload, status %x\n", status);
+		return -1;
+	}
+	if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		fprintf(stderr, "scalloc: %u things left behind by the driver\n", leaks);
+		return -1;
+	}
+	return 0;
+}
+
+// a comma separated list of numbers, how many there were
+static ULONG ScAllocList(char * Text, ULONG * List)
+{
+	ULONG	count;
+	char *	next;
+
+	for(count = 0; (count < SCALLOC_LIST_MAX) && (*Text != 0); count++)
+	{
+		List[count] = (ULONG)strtoul(Text, &next, 0);
+		if((next == Text) || ((*next != ',') && (*next != 0)))
+			return 0;
+		Text = (*next == ',') ? next + 1 : next;
+	}
+	return (*Text == 0) ? count : 0;
+}
+
+static void ScAllocUsage(void)
+{
+	fprintf(stderr, "usage: scalloc [-r bytes,...] [-n deliveries] [-p name=value]... [-v]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	SCALLOC_PARAMETER	parameters[SCALLOC_PARAMETERS];
+	SCALLOC_RESULT		result;
+	ULONG				sizes[SCALLOC_LIST_MAX] = { 16, 256, 4096 };
+	ULONG				sizeCount;
+	ULONG				parameterCount;
+	ULONG				deliveries;
+	ULONG				r;
+	char *				value;
+	double				reads;
+	BOOLEAN				verbose;
+	BOOLEAN				bad;
+	int					i;
+
+	sizeCount = 3;
+	parameterCount = 0;
+	deliveries = 100000;
+	verbose = FALSE;
+	bad = FALSE;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(!strcmp(argv[i], "-v"))
+			verbose = TRUE;
+		else if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-r"))
+			bad = (sizeCount = ScAllocList(argv[++i], sizes)) == 0;
+		else if(!strcmp(argv[i], "-n"))
+			deliveries = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-p") && ((value = strchr(argv[i + 1], '=')) != NULL) &&
+			(parameterCount < SCALLOC_PARAMETERS))
+		{
+			*value++ = 0;
+			parameters[parameterCount].Name = argv[++i];
+			parameters[parameterCount].Value = (ULONG)strtoul(value, NULL, 0);
+			parameterCount++;
+		}
+		else
+			bad = TRUE;
+	}
+	for(r = 0; r < sizeCount; r++)
+		if(sizes[r] == 0)
+			bad = TRUE;
+	if(bad || (deliveries == 0))
+	{
+		ScAllocUsage();
+		return 2;
+	}
+
+	SCHostSetDebugOutput(verbose);
+
+	printf("read\treads\tallocs\tirps\tallocs_read\tirps_read\tcpu_ns_read\n");
+	for(r = 0; r < sizeCount; r++)
+	{
+		if(ScAllocRun(sizes[r], deliveries, parameters, parameterCount, &result) < 0)
+			return 1;
+
+		reads = (result.Reads != 0) ? (double)result.Reads : 1;
+		printf("%u\t%llu\t%llu\t%llu\t%.3f\t%.3f\t%.0f\n", sizes[r], (unsigned long long)result.Reads,
+			(unsigned long long)result.Allocations, (unsigned long long)result.Irps,
+			result.Allocations / reads, result.Irps / reads, result.Cpu * 1e9 / reads);
+		fflush(stdout);
+	}
+	return 0;
+}
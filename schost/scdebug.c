@@ -0,0 +1,284 @@
+// scdebug.c
+//
+// Times SerialClone's dispatch path to see what its debug messages cost.
+// The driver is loaded on a simulated port, the filter's consumer and the
+// clone's keep a read outstanding, and the same requests go through again
+// and again: an IOCTL the filter passes down to the port, one the clone
+// answers itself, a write from the port's owner, and bytes arriving for
+// both reads. Built free, SCDebug sites are gone; built checked, each
+// costs a test of g_DebugAreas and those switched on format their
+// message; built checked with SC_DEBUG_LEVEL or SC_DEBUG_AREAS set,
+// those outside them are gone again. make debugbench builds it those
+// ways and runs each.
+//
+//	scdebug [options]
+//
+//	-n N			times each request goes through, 100000 by default
+//	-R N			runs, the fastest kept, 3 by default
+//	-l Label		what the first column says, the build by default
+//	-q				switch every area off in g_DebugAreas, checked builds
+//	-v				show the driver's debug output
+//
+// A tab separated line per request, after a line naming the columns:
+// the label, the request, how many went through and the host's CPU time
+// for one. Debug output is formatted either way and only shown with -v.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../driver/pch.h"
+#include "schost.h"
+
+#define SCDEBUG_CONSUMERS		2		// the filter's and the clone's
+#define SCDEBUG_DATA			16		// bytes a write, and a delivery
+#define SCDEBUG_WARMUP			100
+
+// the requests timed
+#define SCDEBUG_FILTER_IOCTL	0
+#define SCDEBUG_CLONE_IOCTL		1
+#define SCDEBUG_WRITE			2
+#define SCDEBUG_DELIVERY		3
+#define SCDEBUG_REQUESTS		4
+
+static PCSTR ScDebugRequestNames[SCDEBUG_REQUESTS] = { "filter_ioctl", "clone_ioctl", "write", "delivery" };
+
+// the process's CPU time, in seconds
+static double ScDebugCpu(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// runs whatever the last request left to run
+static VOID ScDebugSettle(VOID)
+{
+	while(SCHostRunPending())
+		;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScDebugRequest
+//      Sends one request and lets it finish
+//
+//  Arguments:
+//      IN  Host
+//              the driver
+//
+//      IN  Consumers
+//              the filter's and the clone's, open and reading
+//
+//      IN  Request
+//              SCDEBUG_xxx
+//
+//  Return Value:
+//      FALSE, having said why, if it failed
+//
+static BOOLEAN ScDebugRequest(PSCHOST Host, PSCHOST_CONSUMER Consumers, ULONG Request)
+{
+	static const UCHAR		data[SCDEBUG_DATA] = "0123456789ABCDE";
+	SERIAL_BAUD_RATE		baud;
+	SERIALCLONE_PORT_STATE	state;
+	NTSTATUS				status;
+
+	switch(Request)
+	{
+	case SCDEBUG_FILTER_IOCTL:
+		status = SCHostIoctl(Host->Filter, &Consumers[0].FileObject, IOCTL_SERIAL_GET_BAUD_RATE, NULL, 0,
+			&baud, sizeof(baud), NULL);
+		break;
+
+	case SCDEBUG_CLONE_IOCTL:
+		status = SCHostIoctl(Host->Clone, &Consumers[1].FileObject, IOCTL_SERIALCLONE_GET_PORT_STATE, NULL, 0,
+			&state, sizeof(state), NULL);
+		break;
+
+	case SCDEBUG_WRITE:
+		status = SCHostConsumerWrite(&Consumers[0], data, sizeof(data));
+		if(status == STATUS_PENDING)
+			status = STATUS_SUCCESS;
+		ScDebugSettle();
+		if(Consumers[0].WritesPending != 0)
+		{
+			fprintf(stderr, "scdebug: a write is still pending\n");
+			return FALSE;
+		}
+		break;
+
+	default:
+		SCSimPortReceive(Host->Port, data, sizeof(data));
+		status = STATUS_SUCCESS;
+		break;
+	}
+	ScDebugSettle();
+
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scdebug: %s failed, status %x\n", ScDebugRequestNames[Request], status);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScDebugRun
+//      Every request Count times, the driver loaded afresh
+//
+//  Arguments:
+//      IN  Count
+//              times each request goes through
+//
+//      IN  Quiet
+//              switch every area off first
+//
+//      OUT Seconds
+//              CPU time each request took in all
+//
+//  Return Value:
+//      0, or -1 if the driver wouldn't load, open, take a request or
+//      unload
+//
+static int ScDebugRun(ULONG Count, BOOLEAN Quiet, double * Seconds)
+{
+	static SCHOST			host;
+	static SCHOST_CONSUMER	consumers[SCDEBUG_CONSUMERS];
+	NTSTATUS				status;
+	ULONG					leaks;
+	ULONG					request;
+	ULONG					c;
+	ULONG					i;
+	double					cpu;
+
+#if DBG
+	if(Quiet)
+		memset(g_DebugAreas, 0, sizeof(g_DebugAreas));
+#endif
+
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+	status = SCHostLoad(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scdebug: SerialClone didn't load, status %x\n", status);
+		return -1;
+	}
+
+	for(c = 0; c < SCDEBUG_CONSUMERS; c++)
+	{
+		status = SCHostConsumerOpen(&consumers[c], (c == 0) ? "filter" : "clone",
+			(c == 0) ? host.Filter : host.Clone, SCDEBUG_DATA, NULL, NULL);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scdebug: the %s didn't open, status %x\n", consumers[c].Name, status);
+			return -1;
+		}
+		SCHostConsumerStart(&consumers[c]);
+	}
+	ScDebugSettle();
+
+	for(request = 0; request < SCDEBUG_REQUESTS; request++)
+	{
+		for(i = 0; i < SCDEBUG_WARMUP; i++)
+			if(!ScDebugRequest(&host, consumers, request))
+				return -1;
+
+		cpu = ScDebugCpu();
+		for(i = 0; i < Count; i++)
+			if(!ScDebugRequest(&host, consumers, request))
+				return -1;
+		Seconds[request] = ScDebugCpu() - cpu;
+	}
+
+	for(c = 0; c < SCDEBUG_CONSUMERS; c++)
+		SCHostConsumerStop(&consumers[c]);
+	SCSimPortFlush(host.Port);
+	ScDebugSettle();
+	for(c = 0; c < SCDEBUG_CONSUMERS; c++)
+		SCHostConsumerClose(&consumers[c]);
+
+	status = SCHostUnload(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scdebug: SerialClone didn't unload, status %x\n", status);
+		return -1;
+	}
+	if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		fprintf(stderr, "scdebug: %u things left behind by the driver\n", leaks);
+		return -1;
+	}
+	return 0;
+}
+
+static void ScDebugUsage(void)
+{
+	fprintf(stderr, "usage: scdebug [-n count] [-R runs] [-l label] [-q] [-v]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	double		seconds[SCDEBUG_REQUESTS];
+	double		best[SCDEBUG_REQUESTS];
+	PCSTR		label;
+	ULONG		count;
+	ULONG		runs;
+	ULONG		request;
+	ULONG		k;
+	BOOLEAN		quiet;
+	BOOLEAN		verbose;
+	BOOLEAN		bad;
+	int			i;
+
+	label = DBG ? "checked" : "free";
+	count = 100000;
+	runs = 3;
+	quiet = FALSE;
+	verbose = FALSE;
+	bad = FALSE;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(!strcmp(argv[i], "-q"))
+			quiet = TRUE;
+		else if(!strcmp(argv[i], "-v"))
+			verbose = TRUE;
+		else if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-n"))
+			count = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-R"))
+			runs = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-l"))
+			label = argv[++i];
+		else
+			bad = TRUE;
+	}
+	if(bad || (count == 0) || (runs == 0))
+	{
+		ScDebugUsage();
+		return 2;
+	}
+
+	SCHostSetDebugOutput(verbose);
+
+	for(k = 0; k < runs; k++)
+	{
+		if(ScDebugRun(count, quiet, seconds) < 0)
+			return 1;
+		for(request = 0; request < SCDEBUG_REQUESTS; request++)
+			if((k == 0) || (seconds[request] < best[request]))
+				best[request] = seconds[request];
+	}
+
+	printf("build\trequest\tcount\tcpu_ns\n");
+	for(request = 0; request < SCDEBUG_REQUESTS; request++)
+		printf("%s\t%s\t%u\t%.0f\n", label, ScDebugRequestNames[request], count, best[request] * 1e9 / count);
+	return 0;
+}
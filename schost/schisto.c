@@ -0,0 +1,342 @@
+// schisto.c
+//
+// Checks where SerialClone's latency histograms put a time. With
+// Parameters\LatencyHistograms set, every bucket's first and last tick
+// count, as SERIALCLONE_HISTOGRAM_LOW in intrface.h gives them, and a
+// run of random ones, are recorded with SCLatencyRecord against the
+// filter and the clone, for each kind of request and part of its life,
+// and IOCTL_SERIALCLONE_GET_LATENCY has to return each of them in the
+// one count it belongs in, and clear them with SERIALCLONE_LATENCY_RESET,
+// which through the filter is refused unless the caller is privileged.
+// Without the parameter the devices have to keep no histograms and the
+// IOCTL has to return zeros.
+//
+//	schisto [options]
+//
+//	-n N			random times, 100000 by default
+//	-s N			the seed for them, 1 by default
+//	-v				the driver's debug output
+//
+// The IOCTL itself is counted as one of the filter's IOCTL totals, once
+// it has been answered, so that count is expected to go up by one from
+// one query to the next.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../driver/pch.h"
+#include "schost.h"
+
+#define SCHISTO_COUNTS		(sizeof(SERIALCLONE_LATENCY) / sizeof(ULONG))
+
+typedef struct _SCHISTO
+{
+	SCHOST							Host;
+	PSERIALCLONE_DEVICE_EXTENSION	Device[2];		// the filter and the clone
+	SERIALCLONE_LATENCY				Expected[2];
+	SERIALCLONE_PORT_LATENCY		Latency;
+	ULONG							Answered;		// IOCTLs counted against the filter since the last check
+	ULONG							Failures;
+} SCHISTO;
+
+static const char * ScHistoDevices[2] = { "filter", "clone" };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHistoBucket
+//      The bucket a tick count belongs in, the last one whose first
+//      tick count, by SERIALCLONE_HISTOGRAM_LOW, is at or below it
+//
+static ULONG ScHistoBucket(ULONG Elapsed)
+{
+	ULONG	low;
+	ULONG	high;
+	ULONG	mid;
+
+	low = 0;
+	high = SERIALCLONE_HISTOGRAM_BUCKETS - 1;
+	while(low < high)
+	{
+		mid = (low + high + 1) / 2;
+		if(SERIALCLONE_HISTOGRAM_LOW(mid) <= Elapsed)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return low;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHistoRecord
+//      Records a time against a device and counts it where it is
+//      expected to go
+//
+static VOID ScHistoRecord(SCHISTO * Histo, ULONG Device, ULONG Major, ULONG Phase, ULONG Elapsed)
+{
+	KIRQL	irql;
+
+	// as a completion routine would
+	KeRaiseIrql(DISPATCH_LEVEL, &irql);
+	SCLatencyRecord(Histo->Device[Device], Major, Phase, Elapsed);
+	KeLowerIrql(irql);
+
+	Histo->Expected[Device].Counts[Major][Phase][ScHistoBucket(Elapsed)]++;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHistoCheck
+//      Reads the histograms back, clearing them, and compares them with
+//      what was recorded since the last time
+//
+//  Arguments:
+//      IN  Histo
+//              the run
+//
+//      IN  What
+//              what was recorded, for the report
+//
+//  Return Value:
+//      FALSE if the IOCTL failed
+//
+static BOOLEAN ScHistoCheck(SCHISTO * Histo, PCSTR What)
+{
+	PSERIALCLONE_LATENCY	got[2];
+	PULONG					expected;
+	PULONG					counts;
+	PULONG					ioctls;
+	ULONG_PTR				information;
+	NTSTATUS				status;
+	ULONG					reset;
+	ULONG					extra;
+	ULONG					bucket;
+	ULONG					phase;
+	ULONG					major;
+	ULONG					i;
+	ULONG					d;
+
+	reset = SERIALCLONE_LATENCY_RESET;
+	memset(&Histo->Latency, 0xCC, sizeof(Histo->Latency));
+	status = SCHostIoctl(Histo->Host.Filter, NULL, IOCTL_SERIALCLONE_GET_LATENCY, &reset, sizeof(reset),
+		&Histo->Latency, sizeof(Histo->Latency), &information);
+	if(!NT_SUCCESS(status) || (information != sizeof(Histo->Latency)) ||
+		(Histo->Latency.Size != sizeof(Histo->Latency)))
+	{
+		fprintf(stderr, "schisto: IOCTL_SERIALCLONE_GET_LATENCY returned status %x, %u bytes\n", status,
+			(ULONG)information);
+		Histo->Failures++;
+		return FALSE;
+	}
+
+	got[0] = &Histo->Latency.Owner;
+	got[1] = &Histo->Latency.Clone;
+
+	// the IOCTLs answered since the last check are in the filter's
+	// IOCTL totals as well, wherever their times put them
+	ioctls = &got[0]->Counts[SERIALCLONE_LATENCY_IOCTL][SERIALCLONE_LATENCY_TOTAL][0];
+	expected = &Histo->Expected[0].Counts[SERIALCLONE_LATENCY_IOCTL][SERIALCLONE_LATENCY_TOTAL][0];
+	extra = 0;
+	for(bucket = 0; bucket < SERIALCLONE_HISTOGRAM_BUCKETS; bucket++)
+		if(ioctls[bucket] > expected[bucket])
+		{
+			extra += ioctls[bucket] - expected[bucket];
+			expected[bucket] = ioctls[bucket];
+		}
+	if(extra != Histo->Answered)
+	{
+		fprintf(stderr, "schisto: %s, filter IOCTL totals have %u more than recorded, expected %u\n", What,
+			extra, Histo->Answered);
+		Histo->Failures++;
+	}
+	Histo->Answered = (Histo->Device[0]->Latency != NULL) ? 1 : 0;
+
+	for(d = 0; d < 2; d++)
+	{
+		expected = &Histo->Expected[d].Counts[0][0][0];
+		counts = &got[d]->Counts[0][0][0];
+		for(i = 0; i < SCHISTO_COUNTS; i++)
+		{
+			if(counts[i] == expected[i])
+				continue;
+
+			major = i / (SERIALCLONE_LATENCY_PHASES * SERIALCLONE_HISTOGRAM_BUCKETS);
+			phase = i / SERIALCLONE_HISTOGRAM_BUCKETS % SERIALCLONE_LATENCY_PHASES;
+			bucket = i % SERIALCLONE_HISTOGRAM_BUCKETS;
+			if(Histo->Failures++ < 10)
+				fprintf(stderr, "schisto: %s, %s major %u phase %u bucket %u (from %u ticks): %u, expected %u\n",
+					What, ScHistoDevices[d], major, phase, bucket, SERIALCLONE_HISTOGRAM_LOW(bucket),
+					counts[i], expected[i]);
+		}
+	}
+
+	memset(Histo->Expected, 0, sizeof(Histo->Expected));
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHistoRun
+//      One load of the driver, with or without the histograms
+//
+//  Return Value:
+//      0 if everything was where it belonged, 1 if not, -1 if the
+//      driver wouldn't load or unload
+//
+static int ScHistoRun(SCHISTO * Histo, BOOLEAN Kept, ULONG Randoms, ULONGLONG Seed)
+{
+	ULONGLONG	random;
+	NTSTATUS	status;
+	ULONG		bucket;
+	ULONG		major;
+	ULONG		phase;
+	ULONG		elapsed;
+	ULONG		leaks;
+	ULONG		reset;
+	ULONG		i;
+	ULONG		d;
+	ULONG_PTR	information;
+
+	memset(Histo, 0, sizeof(*Histo));
+	SCHostSetParameter("LatencyHistograms", Kept ? 1 : 0);
+	status = SCHostLoad(&Histo->Host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "schisto: SerialClone didn't load, status %x\n", status);
+		return -1;
+	}
+	Histo->Device[0] = (PSERIALCLONE_DEVICE_EXTENSION)Histo->Host.Filter->DeviceExtension;
+	Histo->Device[1] = (PSERIALCLONE_DEVICE_EXTENSION)Histo->Host.Clone->DeviceExtension;
+
+	for(d = 0; d < 2; d++)
+		if((Histo->Device[d]->Latency != NULL) != Kept)
+		{
+			fprintf(stderr, "schisto: the %s %s histograms\n", ScHistoDevices[d], Kept ? "has no" : "keeps");
+			Histo->Failures++;
+		}
+
+	// an application without the privilege can't clear them through the
+	// port, the refusal is counted like any other IOCTL the filter answers
+	SCHostSetPrivileged(FALSE);
+	reset = SERIALCLONE_LATENCY_RESET;
+	status = SCHostIoctl(Histo->Host.Filter, NULL, IOCTL_SERIALCLONE_GET_LATENCY, &reset, sizeof(reset),
+		&Histo->Latency, sizeof(Histo->Latency), &information);
+	if((status != STATUS_ACCESS_DENIED) || (information != 0))
+	{
+		fprintf(stderr, "schisto: an unprivileged reset returned status %x, %u bytes\n", status,
+			(ULONG)information);
+		Histo->Failures++;
+	}
+	Histo->Answered = (Histo->Device[0]->Latency != NULL) ? 1 : 0;
+	SCHostSetPrivileged(TRUE);
+
+	// the buckets' edges, every kind and part on both devices
+	for(bucket = 0; bucket < SERIALCLONE_HISTOGRAM_BUCKETS; bucket++)
+	{
+		for(d = 0; d < 2; d++)
+			for(major = 0; major < SERIALCLONE_LATENCY_MAJORS; major++)
+				for(phase = 0; phase < SERIALCLONE_LATENCY_PHASES; phase++)
+				{
+					ScHistoRecord(Histo, d, major, phase, SERIALCLONE_HISTOGRAM_LOW(bucket));
+					elapsed = (bucket + 1 < SERIALCLONE_HISTOGRAM_BUCKETS) ?
+						SERIALCLONE_HISTOGRAM_LOW(bucket + 1) - 1 : 0xFFFFFFFF;
+					ScHistoRecord(Histo, d, major, phase, elapsed);
+				}
+		if(!Kept)
+			memset(Histo->Expected, 0, sizeof(Histo->Expected));
+		if(!ScHistoCheck(Histo, "bucket edges"))
+			break;
+	}
+
+	// random times, of random sizes, one part at a time
+	random = Seed;
+	for(i = 0; i < Randoms; i++)
+	{
+		elapsed = (ULONG)SCHostRandom(&random) >> (SCHostRandom(&random) % 32);
+		d = (ULONG)(SCHostRandom(&random) % 2);
+		major = (ULONG)(SCHostRandom(&random) % SERIALCLONE_LATENCY_MAJORS);
+		phase = (ULONG)(SCHostRandom(&random) % SERIALCLONE_LATENCY_PHASES);
+		ScHistoRecord(Histo, d, major, phase, elapsed);
+	}
+	if(!Kept)
+		memset(Histo->Expected, 0, sizeof(Histo->Expected));
+	ScHistoCheck(Histo, "random times");
+
+	status = SCHostUnload(&Histo->Host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "schisto: SerialClone didn't unload, status %x\n", status);
+		return -1;
+	}
+	if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		fprintf(stderr, "schisto: %u things left behind by the driver\n", leaks);
+		return -1;
+	}
+	return (Histo->Failures == 0) ? 0 : 1;
+}
+
+static void ScHistoUsage(void)
+{
+	fprintf(stderr, "usage: schisto [-n times] [-s seed] [-v]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	static SCHISTO	histo;
+	ULONGLONG		seed;
+	ULONG			randoms;
+	BOOLEAN			verbose;
+	BOOLEAN			bad;
+	int				result;
+	int				i;
+
+	randoms = 100000;
+	seed = 1;
+	verbose = FALSE;
+	bad = FALSE;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(!strcmp(argv[i], "-v"))
+			verbose = TRUE;
+		else if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-n"))
+			randoms = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-s"))
+			seed = strtoull(argv[++i], NULL, 0);
+		else
+			bad = TRUE;
+	}
+	if(bad)
+	{
+		ScHistoUsage();
+		return 2;
+	}
+
+	// the buckets have to follow each other, each starting past the last
+	for(i = 1; i < SERIALCLONE_HISTOGRAM_BUCKETS; i++)
+		if(SERIALCLONE_HISTOGRAM_LOW(i) <= SERIALCLONE_HISTOGRAM_LOW(i - 1))
+		{
+			fprintf(stderr, "schisto: bucket %d starts at %u, bucket %d at %u\n", i - 1,
+				SERIALCLONE_HISTOGRAM_LOW(i - 1), i, SERIALCLONE_HISTOGRAM_LOW(i));
+			return 1;
+		}
+
+	SCHostSetDebugOutput(verbose);
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+	for(i = 0; i < 2; i++)
+	{
+		result = ScHistoRun(&histo, (BOOLEAN)(i == 0), randoms, seed);
+		if(result < 0)
+			return 1;
+		printf("histograms %s: %u buckets, %u random times, %s\n", (i == 0) ? "kept" : "not kept",
+			SERIALCLONE_HISTOGRAM_BUCKETS, randoms, (result == 0) ? "all where they belong" : "failed");
+		if(result != 0)
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,699 @@
+// schost.c
+//
+// Loads SerialClone on a simulated port the way the PnP manager would,
+// DriverEntry, AddDevice, then IRP_MN_START_DEVICE, runs the consumers
+// on top of it and removes and unloads it again. See schost.h.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "schost.h"
+
+// the driver's, linked in
+NTSTATUS DriverEntry(PDRIVER_OBJECT DriverObject, PUNICODE_STRING RegistryPath);
+
+#define SCHOST_PARAMETERS_KEY	SCHOST_SERVICE_KEY L"\\Parameters"
+
+#define SCHOST_IOCTL_TAG		'ltCI'
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostSetParameter
+//      Sets one of the driver's tunables, before it is loaded
+//
+//  Arguments:
+//      IN  Name
+//              value name under the Parameters key, TxPaceMs for one
+//
+//      IN  Value
+//              the REG_DWORD
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCHostSetParameter(PCSTR Name, ULONG Value)
+{
+	WCHAR	name[64];
+	size_t	i;
+
+	for(i = 0; (i + 1 < sizeof(name) / sizeof(WCHAR)) && (Name[i] != 0); i++)
+		name[i] = (UCHAR)Name[i];
+	name[i] = UNICODE_NULL;
+
+	return SCHostRegistrySetValue(SCHOST_PARAMETERS_KEY, name, REG_DWORD, &Value, sizeof(Value));
+}
+
+static NTSTATUS ScHostRequestComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp, PVOID Context)
+{
+	if(Irp->PendingReturned)
+		KeSetEvent((PKEVENT)Context, IO_NO_INCREMENT, FALSE);
+	return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+// sends an IRP its caller has set up and waits for it
+static NTSTATUS ScHostCallAndWait(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+	KEVENT		event;
+	NTSTATUS	status;
+
+	KeInitializeEvent(&event, NotificationEvent, FALSE);
+	IoSetCompletionRoutine(Irp, ScHostRequestComplete, &event, TRUE, TRUE, TRUE);
+
+	status = IoCallDriver(DeviceObject, Irp);
+	if(status == STATUS_PENDING)
+	{
+		KeWaitForSingleObject(&event, Executive, KernelMode, FALSE, NULL);
+		status = Irp->IoStatus.Status;
+	}
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRequest
+//      Sends a request with no buffer and waits for it, at PASSIVE_LEVEL
+//
+//  Arguments:
+//      IN  DeviceObject
+//              where it goes
+//
+//      IN  FileObject
+//              the handle it is on, optional
+//
+//      IN  MajorFunction
+//              IRP_MJ_xxx
+//
+//      IN  MinorFunction
+//              IRP_MN_xxx
+//
+//      OUT Information
+//              the IRP's IoStatus.Information, optional
+//
+//  Return Value:
+//      NT status code. A dispatch routine that returns without pending
+//      may not have completed the IRP, SerialClone's create doesn't when
+//      it sends it on itself, so its return is taken as the status.
+//
+NTSTATUS SCHostRequest(PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject, UCHAR MajorFunction,
+	UCHAR MinorFunction, PULONG_PTR Information)
+{
+	PIRP				irp;
+	PIO_STACK_LOCATION	irpStack;
+	NTSTATUS			status;
+
+	irp = IoAllocateIrp(DeviceObject->StackSize + 1, FALSE);
+	if(irp == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	// the top location is ours, for the completion routine to be set in
+	IoSetNextIrpStackLocation(irp);
+
+	// the PnP manager sends its requests not supported until someone
+	// says otherwise
+	irp->IoStatus.Status = (MajorFunction == IRP_MJ_PNP) ? STATUS_NOT_SUPPORTED : STATUS_SUCCESS;
+
+	irpStack = IoGetNextIrpStackLocation(irp);
+	irpStack->MajorFunction = MajorFunction;
+	irpStack->MinorFunction = MinorFunction;
+	irpStack->FileObject = FileObject;
+
+	status = ScHostCallAndWait(DeviceObject, irp);
+	if(Information != NULL)
+		*Information = irp->IoStatus.Information;
+	IoFreeIrp(irp);
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostIoctl
+//      Sends a METHOD_BUFFERED IOCTL and waits for it, at PASSIVE_LEVEL,
+//      as DeviceIoControl would for an application
+//
+//  Arguments:
+//      IN  DeviceObject
+//              where it goes
+//
+//      IN  FileObject
+//              the handle it is on, optional
+//
+//      IN  IoControlCode
+//              IOCTL_xxx
+//
+//      IN  InputBuffer
+//              optional
+//
+//      IN  InputLength
+//              bytes in it
+//
+//      OUT OutputBuffer
+//              optional
+//
+//      IN  OutputLength
+//              bytes it has room for
+//
+//      OUT Information
+//              bytes returned, optional
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCHostIoctl(PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject, ULONG IoControlCode,
+	const VOID * InputBuffer, ULONG InputLength, PVOID OutputBuffer, ULONG OutputLength,
+	PULONG_PTR Information)
+{
+	PIRP				irp;
+	PIO_STACK_LOCATION	irpStack;
+	PVOID				buffer;
+	ULONG_PTR			returned;
+	NTSTATUS			status;
+
+	irp = IoAllocateIrp(DeviceObject->StackSize + 1, FALSE);
+	if(irp == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	buffer = NULL;
+	if((InputLength != 0) || (OutputLength != 0))
+	{
+		buffer = ExAllocatePoolWithTag(NonPagedPool, max(InputLength, OutputLength), SCHOST_IOCTL_TAG);
+		if(buffer == NULL)
+		{
+			IoFreeIrp(irp);
+			return STATUS_INSUFFICIENT_RESOURCES;
+		}
+		if(InputLength != 0)
+			RtlCopyMemory(buffer, InputBuffer, InputLength);
+	}
+
+	IoSetNextIrpStackLocation(irp);
+	irp->AssociatedIrp.SystemBuffer = buffer;
+	irp->Flags = IRP_BUFFERED_IO;
+	irp->RequestorMode = UserMode;
+
+	irpStack = IoGetNextIrpStackLocation(irp);
+	irpStack->MajorFunction = IRP_MJ_DEVICE_CONTROL;
+	irpStack->FileObject = FileObject;
+	irpStack->Parameters.DeviceIoControl.IoControlCode = IoControlCode;
+	irpStack->Parameters.DeviceIoControl.InputBufferLength = InputLength;
+	irpStack->Parameters.DeviceIoControl.OutputBufferLength = OutputLength;
+
+	status = ScHostCallAndWait(DeviceObject, irp);
+
+	returned = NT_ERROR(status) ? 0 : irp->IoStatus.Information;
+	if(returned > OutputLength)
+		SCHostFatal("IOCTL %08X returned %lu bytes, %u were room for", IoControlCode,
+			(unsigned long)returned, OutputLength);
+	if(returned != 0)
+		RtlCopyMemory(OutputBuffer, buffer, returned);
+	if(Information != NULL)
+		*Information = returned;
+
+	if(buffer != NULL)
+		ExFreePool(buffer);
+	IoFreeIrp(irp);
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostAddPort
+//      Creates a simulated port, \Device\Serial<Index>, and has the
+//      driver, already loaded for the others, add and start its devices
+//      on it as the PnP manager would for a port that has just arrived
+//
+//  Arguments:
+//      IN OUT  Hosts
+//              one for each port, sharing the driver; Hosts[Index] has
+//              no port, the others may
+//
+//      IN  Count
+//              entries in Hosts
+//
+//      IN  Index
+//              the one to add
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCHostAddPort(PSCHOST Hosts, ULONG Count, ULONG Index)
+{
+	PDRIVER_OBJECT	driverObject;
+	PDEVICE_OBJECT	device;
+	PSCHOST			host;
+	WCHAR			name[32];
+	char			narrow[32];
+	NTSTATUS		status;
+	ULONG			j;
+	ULONG			n;
+
+	host = &Hosts[Index];
+	driverObject = host->DriverObject;
+	if((host->Port != NULL) || (driverObject == NULL))
+		SCHostFatal("port %u added twice or before the driver", Index);
+
+	snprintf(narrow, sizeof(narrow), "\\Device\\Serial%u", Index);
+	for(n = 0; narrow[n] != 0; n++)
+		name[n] = (UCHAR)narrow[n];
+	name[n] = UNICODE_NULL;
+
+	status = SCSimPortCreate(name, &host->Port);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	// the port stands in for the PDO, there being no bus below it
+	status = driverObject->DriverExtension->AddDevice(driverObject, host->Port->DeviceObject);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	// the clone is the one device no other port has
+	host->Filter = host->Port->DeviceObject->AttachedDevice;
+	for(device = driverObject->DeviceObject; device != NULL; device = device->NextDevice)
+	{
+		for(j = 0; (j < Count) && (device != Hosts[j].Filter) && (device != Hosts[j].Clone); j++)
+			;
+		if(j == Count)
+			host->Clone = device;
+	}
+	if((host->Filter == NULL) || (host->Clone == NULL))
+		SCHostFatal("AddDevice left no filter and clone on port %u", Index);
+
+	return SCHostRequest(host->Filter, NULL, IRP_MJ_PNP, IRP_MN_START_DEVICE, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRemovePort
+//      Removes a port's stack as the PnP manager would and deletes the
+//      port, leaving the driver loaded for the others
+//
+//  Arguments:
+//      IN OUT  Host
+//              the port's, its consumers all closed; keeps the driver
+//              for SCHostAddPort
+//
+//  Return Value:
+//      status of the query remove if it failed, and the port is left;
+//      the remove itself can't fail
+//
+NTSTATUS SCHostRemovePort(PSCHOST Host)
+{
+	NTSTATUS	status;
+
+	status = SCHostRequest(Host->Filter, NULL, IRP_MJ_PNP, IRP_MN_QUERY_REMOVE_DEVICE, NULL);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	SCHostRequest(Host->Filter, NULL, IRP_MJ_PNP, IRP_MN_REMOVE_DEVICE, NULL);
+	Host->Filter = NULL;
+	Host->Clone = NULL;
+
+	// REMOVE may leave work behind it
+	while(SCHostRunPending())
+		;
+
+	SCSimPortDelete(Host->Port);
+	Host->Port = NULL;
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostLoadPorts
+//      Creates simulated ports, \Device\Serial0 and on, and loads
+//      SerialClone once and starts it on each, as for a machine with
+//      that many COM ports
+//
+//  Arguments:
+//      OUT Hosts
+//              one for each port, sharing the driver
+//
+//      IN  Count
+//              ports, at least one
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCHostLoadPorts(PSCHOST Hosts, ULONG Count)
+{
+	UNICODE_STRING	registryPath;
+	PDRIVER_OBJECT	driverObject;
+	NTSTATUS		status;
+	ULONG			i;
+
+	memset(Hosts, 0, Count * sizeof(SCHOST));
+
+	status = SCHostRegistrySetValue(SCHOST_SERVICE_KEY, NULL, REG_NONE, NULL, 0);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	driverObject = SCHostCreateDriver(L"\\Driver\\SerialClone", NULL);
+	if(driverObject == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+	for(i = 0; i < Count; i++)
+		Hosts[i].DriverObject = driverObject;
+
+	RtlInitUnicodeString(&registryPath, SCHOST_SERVICE_KEY);
+	status = DriverEntry(driverObject, &registryPath);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	for(i = 0; i < Count; i++)
+	{
+		status = SCHostAddPort(Hosts, Count, i);
+		if(!NT_SUCCESS(status))
+			return status;
+	}
+	return STATUS_SUCCESS;
+}
+
+// the driver on one port, \Device\Serial0
+NTSTATUS SCHostLoad(PSCHOST Host)
+{
+	return SCHostLoadPorts(Host, 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostUnloadPorts
+//      Removes each port's stack as the PnP manager would, unloads the
+//      driver and deletes the ports, leaving nothing behind
+//
+//  Arguments:
+//      IN  Hosts
+//              as SCHostLoadPorts loaded them, their consumers all closed;
+//              ports SCHostRemovePort took away are passed over
+//
+//      IN  Count
+//              ports
+//
+//  Return Value:
+//      status of the first query remove to fail, with the ports from
+//      that one on left; the remove itself can't fail
+//
+NTSTATUS SCHostUnloadPorts(PSCHOST Hosts, ULONG Count)
+{
+	PDRIVER_OBJECT	driverObject;
+	NTSTATUS		status;
+	ULONG			i;
+
+	for(i = 0; i < Count; i++)
+	{
+		if(Hosts[i].Port == NULL)
+			continue;
+
+		status = SCHostRemovePort(&Hosts[i]);
+		if(!NT_SUCCESS(status))
+			return status;
+	}
+
+	driverObject = Hosts[0].DriverObject;
+	if(driverObject->DeviceObject != NULL)
+		SCHostFatal("REMOVE_DEVICE left the driver's devices");
+	if(driverObject->DriverUnload != NULL)
+		driverObject->DriverUnload(driverObject);
+	SCHostDeleteDriver(driverObject);
+
+	for(i = 0; i < Count; i++)
+		Hosts[i].DriverObject = NULL;
+
+	SCHostRegistryFree();
+	return STATUS_SUCCESS;
+}
+
+// the driver on one port, SCHostLoad's
+NTSTATUS SCHostUnload(PSCHOST Host)
+{
+	return SCHostUnloadPorts(Host, 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostReadComplete
+//      A consumer's read is done; hands the data over and has the next
+//      one issued from the loop rather than from under the completion
+//
+static NTSTATUS ScHostReadComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp, PVOID Context)
+{
+	PSCHOST_CONSUMER	consumer;
+	ULONG				length;
+
+	consumer = (PSCHOST_CONSUMER)Context;
+	if(consumer->Irp != Irp)
+		SCHostFatal("%s read %p completed, %p was outstanding", consumer->Name, Irp, consumer->Irp);
+
+	length = (ULONG)Irp->IoStatus.Information;
+	if(length > consumer->ReadLength)
+		SCHostFatal("%s read %p completed with %u bytes, %u were asked for", consumer->Name, Irp,
+			length, consumer->ReadLength);
+
+	consumer->Irp = NULL;
+	consumer->Reads++;
+	consumer->Bytes += length;
+	if(consumer->ReadDone != NULL)
+		consumer->ReadDone(consumer, Irp->IoStatus.Status, consumer->Buffer, length);
+
+	IoFreeIrp(Irp);
+	if(consumer->Reading)
+		SCHostQueueWorkItem(&consumer->Reissue);
+	return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+// sends a read of Length bytes into the consumer's buffer
+static VOID ScHostSendRead(PSCHOST_CONSUMER Consumer, ULONG Length)
+{
+	PIO_STACK_LOCATION	irpStack;
+	PIRP				irp;
+
+	irp = IoAllocateIrp(Consumer->DeviceObject->StackSize + 1, FALSE);
+	if(irp == NULL)
+		SCHostFatal("out of memory for %s's read", Consumer->Name);
+
+	IoSetNextIrpStackLocation(irp);
+	irp->AssociatedIrp.SystemBuffer = Consumer->Buffer;
+	irp->Flags = IRP_BUFFERED_IO | IRP_INPUT_OPERATION;
+
+	irpStack = IoGetNextIrpStackLocation(irp);
+	irpStack->MajorFunction = IRP_MJ_READ;
+	irpStack->Parameters.Read.Length = Length;
+	irpStack->FileObject = &Consumer->FileObject;
+	IoSetCompletionRoutine(irp, ScHostReadComplete, Consumer, TRUE, TRUE, TRUE);
+
+	Consumer->Irp = irp;
+	Consumer->ReadLength = Length;
+	IoCallDriver(Consumer->DeviceObject, irp);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostIssueRead
+//      Sends a consumer's next read, a work routine
+//
+static VOID ScHostIssueRead(PVOID Context)
+{
+	PSCHOST_CONSUMER	consumer;
+
+	consumer = (PSCHOST_CONSUMER)Context;
+	if(!consumer->Reading || (consumer->Irp != NULL))
+		return;
+
+	ScHostSendRead(consumer, consumer->ReadSize);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostConsumerRead
+//      Sends one read on a consumer's handle now, for a harness that
+//      decides when reads go rather than keeping one outstanding
+//
+//  Arguments:
+//      IN  Consumer
+//              the consumer, open and not started
+//
+//      IN  Length
+//              bytes to ask for, up to its ReadSize
+//
+//  Return Value:
+//      FALSE if a read is outstanding already and none was sent
+//
+BOOLEAN SCHostConsumerRead(PSCHOST_CONSUMER Consumer, ULONG Length)
+{
+	if(!Consumer->Open || Consumer->Reading || (Length > Consumer->ReadSize))
+		SCHostFatal("%s read for %u bytes when it can't be", Consumer->Name, Length);
+	if(Consumer->Irp != NULL)
+		return FALSE;
+
+	ScHostSendRead(Consumer, Length);
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostWriteComplete
+//      A consumer's write is done
+//
+static NTSTATUS ScHostWriteComplete(PDEVICE_OBJECT DeviceObject, PIRP Irp, PVOID Context)
+{
+	PSCHOST_CONSUMER	consumer;
+
+	consumer = (PSCHOST_CONSUMER)Context;
+	if(consumer->WritesPending == 0)
+		SCHostFatal("%s write %p completed, none were outstanding", consumer->Name, Irp);
+
+	consumer->WritesPending--;
+	if(NT_SUCCESS(Irp->IoStatus.Status))
+	{
+		consumer->Writes++;
+		consumer->BytesWritten += Irp->IoStatus.Information;
+	}
+	else
+		consumer->WritesFailed++;
+
+	free(Irp->AssociatedIrp.SystemBuffer);
+	IoFreeIrp(Irp);
+	return STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostConsumerWrite
+//      Sends a write on a consumer's handle and returns without waiting,
+//      as overlapped WriteFile would; its outcome is in the counts
+//
+//  Arguments:
+//      IN  Consumer
+//              the consumer, open
+//
+//      IN  Data
+//              the bytes, copied
+//
+//      IN  Length
+//              how many
+//
+//  Return Value:
+//      NT status code of the send
+//
+NTSTATUS SCHostConsumerWrite(PSCHOST_CONSUMER Consumer, const UCHAR * Data, ULONG Length)
+{
+	PIO_STACK_LOCATION	irpStack;
+	PIRP				irp;
+	PUCHAR				buffer;
+
+	if(!Consumer->Open)
+		SCHostFatal("%s written when not open", Consumer->Name);
+
+	irp = IoAllocateIrp(Consumer->DeviceObject->StackSize + 1, FALSE);
+	buffer = malloc(max(Length, 1));
+	if((irp == NULL) || (buffer == NULL))
+		SCHostFatal("out of memory for %s's write", Consumer->Name);
+	memcpy(buffer, Data, Length);
+
+	IoSetNextIrpStackLocation(irp);
+	irp->AssociatedIrp.SystemBuffer = buffer;
+	irp->Flags = IRP_BUFFERED_IO;
+
+	irpStack = IoGetNextIrpStackLocation(irp);
+	irpStack->MajorFunction = IRP_MJ_WRITE;
+	irpStack->Parameters.Write.Length = Length;
+	irpStack->FileObject = &Consumer->FileObject;
+	IoSetCompletionRoutine(irp, ScHostWriteComplete, Consumer, TRUE, TRUE, TRUE);
+
+	Consumer->WritesPending++;
+	return IoCallDriver(Consumer->DeviceObject, irp);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostConsumerOpen
+//      Opens the filter or the clone for a consumer
+//
+//  Arguments:
+//      OUT Consumer
+//              the consumer
+//
+//      IN  Name
+//              for messages
+//
+//      IN  DeviceObject
+//              SCHOST's Filter or Clone
+//
+//      IN  ReadSize
+//              bytes each read asks for
+//
+//      IN  ReadDone
+//              called as each read completes, optional
+//
+//      IN  Context
+//              for ReadDone
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCHostConsumerOpen(PSCHOST_CONSUMER Consumer, PCSTR Name, PDEVICE_OBJECT DeviceObject,
+	ULONG ReadSize, PSCHOST_READ_DONE ReadDone, PVOID Context)
+{
+	NTSTATUS	status;
+
+	memset(Consumer, 0, sizeof(SCHOST_CONSUMER));
+	Consumer->Name = Name;
+	Consumer->DeviceObject = DeviceObject;
+	Consumer->FileObject.Type = 5;
+	Consumer->FileObject.Size = sizeof(FILE_OBJECT);
+	Consumer->FileObject.DeviceObject = DeviceObject;
+	Consumer->ReadSize = ReadSize;
+	Consumer->ReadDone = ReadDone;
+	Consumer->Context = Context;
+	SCHostInitializeWorkItem(&Consumer->Reissue, ScHostIssueRead, Consumer);
+
+	Consumer->Buffer = malloc(ReadSize);
+	if(Consumer->Buffer == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	status = SCHostRequest(DeviceObject, &Consumer->FileObject, IRP_MJ_CREATE, 0, NULL);
+	if(!NT_SUCCESS(status))
+	{
+		free(Consumer->Buffer);
+		Consumer->Buffer = NULL;
+		return status;
+	}
+
+	Consumer->Open = TRUE;
+	return STATUS_SUCCESS;
+}
+
+// keeps a read outstanding from the next time the loop runs
+VOID SCHostConsumerStart(PSCHOST_CONSUMER Consumer)
+{
+	Consumer->Reading = TRUE;
+	SCHostQueueWorkItem(&Consumer->Reissue);
+}
+
+// issues no more reads; one outstanding stays so until it completes
+VOID SCHostConsumerStop(PSCHOST_CONSUMER Consumer)
+{
+	Consumer->Reading = FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostConsumerClose
+//      Cleans up and closes a consumer's handle, after its last read
+//
+//  Arguments:
+//      IN  Consumer
+//              the consumer, stopped
+//
+//  Return Value:
+//      status of the close
+//
+NTSTATUS SCHostConsumerClose(PSCHOST_CONSUMER Consumer)
+{
+	NTSTATUS	status;
+
+	if(Consumer->Reading || (Consumer->Irp != NULL))
+		SCHostFatal("%s closed with reads going", Consumer->Name);
+	if(Consumer->WritesPending != 0)
+		SCHostFatal("%s closed with %u writes outstanding", Consumer->Name, Consumer->WritesPending);
+
+	status = STATUS_SUCCESS;
+	if(Consumer->Open)
+	{
+		SCHostRequest(Consumer->DeviceObject, &Consumer->FileObject, IRP_MJ_CLEANUP, 0, NULL);
+		status = SCHostRequest(Consumer->DeviceObject, &Consumer->FileObject, IRP_MJ_CLOSE, 0, NULL);
+		Consumer->Open = FALSE;
+	}
+
+	free(Consumer->Buffer);
+	Consumer->Buffer = NULL;
+	return status;
+}
@@ -0,0 +1,92 @@
+// schost.h
+//
+// SerialClone loaded in the host harness: the driver on a simulated port,
+// or on several, started, and consumers that open a filter or a clone,
+// keep a read outstanding on it and write to it as an application would.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCHOST_H__
+#define __SCHOST_H__
+
+#include <wdm.h>
+#include "shim.h"
+#include "simport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCHOST_SERVICE_KEY	L"\\Registry\\Machine\\System\\CurrentControlSet\\Services\\SerialClone"
+
+struct _SCHOST_CONSUMER;
+
+// a read has completed; Data is the consumer's buffer, good until the
+// next read is issued
+typedef VOID (*PSCHOST_READ_DONE)(struct _SCHOST_CONSUMER * Consumer, NTSTATUS Status,
+	const UCHAR * Data, ULONG Length);
+
+typedef struct _SCHOST_CONSUMER
+{
+	PCSTR					Name;
+	PDEVICE_OBJECT			DeviceObject;		// the filter or the clone
+	FILE_OBJECT				FileObject;			// its handle
+	BOOLEAN					Open;
+
+	ULONG					ReadSize;
+	UCHAR *					Buffer;
+	PIRP					Irp;				// the read outstanding, if any
+	ULONG					ReadLength;			// what it asked for
+	BOOLEAN					Reading;			// reissue reads as they complete
+	SCHOST_WORK_ITEM		Reissue;
+
+	PSCHOST_READ_DONE		ReadDone;
+	PVOID					Context;
+
+	ULONGLONG				Reads;
+	ULONGLONG				Bytes;
+
+	ULONG					WritesPending;
+	ULONGLONG				Writes;
+	ULONGLONG				BytesWritten;
+	ULONGLONG				WritesFailed;
+} SCHOST_CONSUMER, *PSCHOST_CONSUMER;
+
+typedef struct _SCHOST
+{
+	PDRIVER_OBJECT			DriverObject;
+	PSCSIMPORT				Port;
+	PDEVICE_OBJECT			Filter;				// the driver's device on the port's stack
+	PDEVICE_OBJECT			Clone;
+} SCHOST, *PSCHOST;
+
+NTSTATUS SCHostSetParameter(PCSTR Name, ULONG Value);
+NTSTATUS SCHostLoad(PSCHOST Host);
+NTSTATUS SCHostUnload(PSCHOST Host);
+NTSTATUS SCHostLoadPorts(PSCHOST Hosts, ULONG Count);
+NTSTATUS SCHostUnloadPorts(PSCHOST Hosts, ULONG Count);
+NTSTATUS SCHostAddPort(PSCHOST Hosts, ULONG Count, ULONG Index);
+NTSTATUS SCHostRemovePort(PSCHOST Host);
+
+NTSTATUS SCHostRequest(PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject, UCHAR MajorFunction,
+	UCHAR MinorFunction, PULONG_PTR Information);
+NTSTATUS SCHostIoctl(PDEVICE_OBJECT DeviceObject, PFILE_OBJECT FileObject, ULONG IoControlCode,
+	const VOID * InputBuffer, ULONG InputLength, PVOID OutputBuffer, ULONG OutputLength,
+	PULONG_PTR Information);
+
+NTSTATUS SCHostConsumerOpen(PSCHOST_CONSUMER Consumer, PCSTR Name, PDEVICE_OBJECT DeviceObject,
+	ULONG ReadSize, PSCHOST_READ_DONE ReadDone, PVOID Context);
+VOID SCHostConsumerStart(PSCHOST_CONSUMER Consumer);
+VOID SCHostConsumerStop(PSCHOST_CONSUMER Consumer);
+BOOLEAN SCHostConsumerRead(PSCHOST_CONSUMER Consumer, ULONG Length);
+NTSTATUS SCHostConsumerWrite(PSCHOST_CONSUMER Consumer, const UCHAR * Data, ULONG Length);
+NTSTATUS SCHostConsumerClose(PSCHOST_CONSUMER Consumer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCHOST_H__
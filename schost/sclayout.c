@@ -0,0 +1,395 @@
+// sclayout.c
+//
+// Measures what SerialClone's device extension layout saves in cache
+// line traffic. Two host threads, on processors of their own where the
+// machine has them, each hammer one field of a real extension, laid out
+// by SerialClone.h and with its per processor slots set up by
+// SCStatsInit, the way two processors do on the read path: one
+// completing a read while another dispatches one, each counting in its
+// own slot, one taking the remove lock while another looks at PnpState.
+// Fields in different groups are a cache line apart and each thread
+// should run about as fast as it does alone. The last pairs share a line
+// on purpose, one field twice for the worst case, and show what the
+// layout is keeping the others from.
+//
+// The fifo pairs are the read buffer's producer, a read completing, and
+// its consumer, a read dispatched, each taking FifoLock and moving In or
+// Out and Size, once with the fields where SCFIFO has them and once with
+// In and Out each a line from the rest, to show what splitting them would
+// gain against the lock and Size both sides write anyway.
+//
+//	sclayout [options]
+//
+//	-n N			operations each thread does, 10000000 by default
+//	-R N			runs of each pair, the fastest kept, 5 by default
+//
+// A tab separated line per pair, after a line naming the columns: the
+// pair, the two fields' offsets in the extension, or in the split fifo's
+// lines, and whether they share a cache line, then ns an operation for
+// one thread alone and for the two at once, the slower thread's. With one processor the threads take
+// turns, nothing is shared at the same time, and each thread's time
+// takes in the other's turns, about twice its time alone for every pair.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "../driver/pch.h"
+#include "schost.h"
+
+// what a thread does to its field
+#define SCLAYOUT_WRITE			0		// an interlocked add, as a counter or lock would
+#define SCLAYOUT_READ			1		// a load, as of a read mostly field
+#define SCLAYOUT_PRODUCE		2		// a fifo's lock taken, In and Size moved
+#define SCLAYOUT_CONSUME		3		// a fifo's lock taken, Out and Size moved
+
+// where a fifo's fields are, for SCLAYOUT_PRODUCE and _CONSUME
+typedef struct _SCLAYOUT_FIFO
+{
+	volatile LONG *			Lock;
+	volatile LONG *			Size;
+	volatile LONG *			In;
+	volatile LONG *			Out;
+} SCLAYOUT_FIFO;
+
+typedef struct _SCLAYOUT_SIDE
+{
+	PCSTR					Field;
+	volatile LONG *			Address;		// for a fifo, its In or Out
+	ULONG					Op;
+	SCLAYOUT_FIFO *			Fifo;
+} SCLAYOUT_SIDE;
+
+typedef struct _SCLAYOUT_PAIR
+{
+	PCSTR					Name;
+	PUCHAR					Base;			// what the offsets are from
+	SCLAYOUT_SIDE			Side[2];
+} SCLAYOUT_PAIR;
+
+typedef struct _SCLAYOUT_THREAD
+{
+	SCLAYOUT_SIDE *			Side;
+	ULONG					Operations;
+	int						Cpu;			// -1 to leave it where it is
+	pthread_barrier_t *		Start;
+	double					Seconds;
+} SCLAYOUT_THREAD;
+
+// seconds on the host's monotonic clock
+static double ScLayoutNow(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// a fifo's lock, a spin as KeAcquireInStackQueuedSpinLock's would. The
+// holder's thread isn't kept running at DISPATCH_LEVEL, so a long spin
+// gives the processor up in case it is waiting for that one.
+static void ScLayoutLock(volatile LONG * Lock)
+{
+	ULONG	spins;
+
+	while(__atomic_exchange_n(Lock, 1, __ATOMIC_ACQUIRE) != 0)
+		for(spins = 0; *Lock != 0; spins++)
+			if(spins >= 1000)
+			{
+				sched_yield();
+				spins = 0;
+			}
+}
+
+static void ScLayoutUnlock(volatile LONG * Lock)
+{
+	__atomic_store_n(Lock, 0, __ATOMIC_RELEASE);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScLayoutThread
+//      One side of a pair: its operations on its field, timed from when
+//      both threads are ready
+//
+static void * ScLayoutThread(void * Context)
+{
+	SCLAYOUT_THREAD *	thread;
+	SCLAYOUT_FIFO *		fifo;
+	volatile LONG *		address;
+	cpu_set_t			cpus;
+	ULONG				i;
+	LONG				sink;
+	double				start;
+
+	thread = (SCLAYOUT_THREAD *)Context;
+	if(thread->Cpu >= 0)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(thread->Cpu, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+
+	address = thread->Side->Address;
+	fifo = thread->Side->Fifo;
+	sink = 0;
+	if(thread->Start != NULL)
+		pthread_barrier_wait(thread->Start);
+	start = ScLayoutNow();
+	if(thread->Side->Op == SCLAYOUT_WRITE)
+	{
+		for(i = 0; i < thread->Operations; i++)
+			__atomic_fetch_add(address, 1, __ATOMIC_SEQ_CST);
+	}
+	else if(thread->Side->Op == SCLAYOUT_READ)
+	{
+		for(i = 0; i < thread->Operations; i++)
+			sink += *address;
+	}
+	else
+	{
+		// the consumer takes what there is, as a read does
+		for(i = 0; i < thread->Operations; i++)
+		{
+			ScLayoutLock(fifo->Lock);
+			if(thread->Side->Op == SCLAYOUT_PRODUCE)
+			{
+				*fifo->In += 1;
+				*fifo->Size += 1;
+			}
+			else if(*fifo->Size != 0)
+			{
+				*fifo->Out += *fifo->Size;
+				*fifo->Size = 0;
+			}
+			ScLayoutUnlock(fifo->Lock);
+		}
+	}
+	thread->Seconds = ScLayoutNow() - start;
+
+	// keeps the loads from being dropped
+	if(sink == 0x7FFFFFFF)
+		printf("\n");
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScLayoutRun
+//      Times a pair, one side alone and then both at once
+//
+//  Arguments:
+//      IN  Pair
+//              the fields
+//
+//      IN  Operations
+//              each thread's
+//
+//      IN  Processors
+//              the host's, threads are put on 0 and 1 if there are two
+//
+//      OUT Alone, Together
+//              ns an operation, the slower side's when together
+//
+//  Return Value:
+//      FALSE if the threads couldn't be started
+//
+static BOOLEAN ScLayoutRun(SCLAYOUT_PAIR * Pair, ULONG Operations, long Processors, double * Alone,
+	double * Together)
+{
+	pthread_barrier_t	start;
+	pthread_t			threads[2];
+	SCLAYOUT_THREAD		sides[2];
+	double				slowest;
+	ULONG				s;
+
+	// the other pairs leave the read buffer's lock looking taken
+	if(Pair->Side[0].Fifo != NULL)
+		*Pair->Side[0].Fifo->Lock = 0;
+
+	memset(sides, 0, sizeof(sides));
+	sides[0].Side = &Pair->Side[0];
+	sides[0].Operations = Operations;
+	sides[0].Cpu = (Processors >= 2) ? 0 : -1;
+	if(pthread_create(&threads[0], NULL, ScLayoutThread, &sides[0]) != 0)
+		return FALSE;
+	pthread_join(threads[0], NULL);
+	*Alone = sides[0].Seconds * 1e9 / Operations;
+
+	pthread_barrier_init(&start, NULL, 2);
+	slowest = 0;
+	for(s = 0; s < 2; s++)
+	{
+		sides[s].Side = &Pair->Side[s];
+		sides[s].Operations = Operations;
+		sides[s].Cpu = (Processors >= 2) ? (int)s : -1;
+		sides[s].Start = &start;
+		if(pthread_create(&threads[s], NULL, ScLayoutThread, &sides[s]) != 0)
+			return FALSE;
+	}
+	for(s = 0; s < 2; s++)
+	{
+		pthread_join(threads[s], NULL);
+		if(sides[s].Seconds > slowest)
+			slowest = sides[s].Seconds;
+	}
+	pthread_barrier_destroy(&start);
+
+	*Together = slowest * 1e9 / Operations;
+	return TRUE;
+}
+
+static void ScLayoutUsage(void)
+{
+	fprintf(stderr, "usage: sclayout [-n operations] [-R runs]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	PSERIALCLONE_DEVICE_EXTENSION	ext;
+	SCLAYOUT_PAIR					pairs[10];
+	SCLAYOUT_FIFO					fifos[2];
+	PUCHAR							split;
+	ULONG_PTR						offsets[2];
+	ULONG							pairCount;
+	ULONG							operations;
+	ULONG							runs;
+	ULONG							p;
+	ULONG							k;
+	long							processors;
+	double							alone;
+	double							together;
+	double							bestAlone;
+	double							bestTogether;
+	BOOLEAN							bad;
+	int								i;
+
+	operations = 10000000;
+	runs = 5;
+	bad = FALSE;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-n"))
+			operations = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-R"))
+			runs = (ULONG)strtoul(argv[++i], NULL, 0);
+		else
+			bad = TRUE;
+	}
+	if(bad || (operations == 0) || (runs == 0))
+	{
+		ScLayoutUsage();
+		return 2;
+	}
+
+	// an extension as IoCreateDevice would make it, slots for at least
+	// the two processors the threads stand for
+	processors = sysconf(_SC_NPROCESSORS_ONLN);
+	SCHostSetProcessors(2);
+	if(posix_memalign((void **)&ext, SC_CACHE_LINE, SCStatsExtensionSize()) != 0)
+	{
+		fprintf(stderr, "sclayout: no memory for an extension\n");
+		return 1;
+	}
+	memset(ext, 0, SCStatsExtensionSize());
+	SCStatsInit(ext);
+
+	// the read buffer's fields where SCFIFO puts them, and a copy with In
+	// and Out each a line from the lock and Size
+	fifos[0].Lock = (volatile LONG *)&ext->ReadBuffer.FifoLock;
+	fifos[0].Size = (volatile LONG *)&ext->ReadBuffer.Size;
+	fifos[0].In = (volatile LONG *)&ext->ReadBuffer.In;
+	fifos[0].Out = (volatile LONG *)&ext->ReadBuffer.Out;
+	if(posix_memalign((void **)&split, SC_CACHE_LINE, 3 * SC_CACHE_LINE) != 0)
+	{
+		fprintf(stderr, "sclayout: no memory for a fifo\n");
+		return 1;
+	}
+	memset(split, 0, 3 * SC_CACHE_LINE);
+	fifos[1].Lock = (volatile LONG *)split;
+	fifos[1].Size = (volatile LONG *)(split + sizeof(LONG));
+	fifos[1].In = (volatile LONG *)(split + SC_CACHE_LINE);
+	fifos[1].Out = (volatile LONG *)(split + 2 * SC_CACHE_LINE);
+
+	memset(pairs, 0, sizeof(pairs));
+	pairCount = 0;
+#define SCLAYOUT_PAIR_OF(name, a, opA, b, opB) \
+	pairs[pairCount].Name = name; \
+	pairs[pairCount].Base = (PUCHAR)ext; \
+	pairs[pairCount].Side[0].Field = #a; \
+	pairs[pairCount].Side[0].Address = (volatile LONG *)&ext->a; \
+	pairs[pairCount].Side[0].Op = opA; \
+	pairs[pairCount].Side[1].Field = #b; \
+	pairs[pairCount].Side[1].Address = (volatile LONG *)&ext->b; \
+	pairs[pairCount].Side[1].Op = opB; \
+	pairCount++;
+#define SCLAYOUT_FIFO_PAIR(name, fifo, base) \
+	pairs[pairCount].Name = name; \
+	pairs[pairCount].Base = (PUCHAR)(base); \
+	pairs[pairCount].Side[0].Field = "In"; \
+	pairs[pairCount].Side[0].Address = (fifo)->In; \
+	pairs[pairCount].Side[0].Op = SCLAYOUT_PRODUCE; \
+	pairs[pairCount].Side[0].Fifo = (fifo); \
+	pairs[pairCount].Side[1].Field = "Out"; \
+	pairs[pairCount].Side[1].Address = (fifo)->Out; \
+	pairs[pairCount].Side[1].Op = SCLAYOUT_CONSUME; \
+	pairs[pairCount].Side[1].Fifo = (fifo); \
+	pairCount++;
+
+	// groups a line apart
+	SCLAYOUT_PAIR_OF("reads list / read buffer", ListLock, SCLAYOUT_WRITE, ReadBuffer.FifoLock, SCLAYOUT_WRITE);
+	SCLAYOUT_PAIR_OF("read buffer / remove lock", ReadBuffer.Size, SCLAYOUT_WRITE, Stats[1].RemoveRefs, SCLAYOUT_WRITE);
+	SCLAYOUT_PAIR_OF("counters, cpu 0 / cpu 1", Stats[0].Counters.ReadIrps, SCLAYOUT_WRITE,
+		Stats[1].Counters.ReadIrps, SCLAYOUT_WRITE);
+	SCLAYOUT_PAIR_OF("remove lock, cpu 0 / cpu 1", Stats[0].RemoveRefs, SCLAYOUT_WRITE,
+		Stats[1].RemoveRefs, SCLAYOUT_WRITE);
+	SCLAYOUT_PAIR_OF("PnpState read / reads list", PnpState, SCLAYOUT_READ, ListLock, SCLAYOUT_WRITE);
+
+	// sharing a line, for comparison
+	SCLAYOUT_PAIR_OF("read buffer In / Out, one lock", ReadBuffer.In, SCLAYOUT_WRITE, ReadBuffer.Out, SCLAYOUT_WRITE);
+	SCLAYOUT_PAIR_OF("one field, both", ListLock, SCLAYOUT_WRITE, ListLock, SCLAYOUT_WRITE);
+
+	// the read buffer's producer and consumer, as laid out and split
+	SCLAYOUT_FIFO_PAIR("fifo, as SCFIFO has it", &fifos[0], ext);
+	SCLAYOUT_FIFO_PAIR("fifo, In and Out a line apart", &fifos[1], split);
+
+	printf("# %ld processors%s\n", processors, (processors < 2) ? ", the threads take turns" : "");
+	printf("pair\tfield_a\toffset_a\tfield_b\toffset_b\tone_line\tns_alone\tns_together\n");
+	for(p = 0; p < pairCount; p++)
+	{
+		for(k = 0; k < runs; k++)
+		{
+			if(!ScLayoutRun(&pairs[p], operations, processors, &alone, &together))
+			{
+				fprintf(stderr, "sclayout: couldn't start the threads\n");
+				return 1;
+			}
+			if((k == 0) || (alone < bestAlone))
+				bestAlone = alone;
+			if((k == 0) || (together < bestTogether))
+				bestTogether = together;
+		}
+
+		for(k = 0; k < 2; k++)
+			offsets[k] = (ULONG_PTR)pairs[p].Side[k].Address - (ULONG_PTR)pairs[p].Base;
+		printf("%s\t%s\t%lu\t%s\t%lu\t%s\t%.2f\t%.2f\n", pairs[p].Name, pairs[p].Side[0].Field,
+			(unsigned long)offsets[0], pairs[p].Side[1].Field, (unsigned long)offsets[1],
+			(offsets[0] / SC_CACHE_LINE == offsets[1] / SC_CACHE_LINE) ? "yes" : "no", bestAlone, bestTogether);
+		fflush(stdout);
+	}
+
+	free(split);
+	free(ext);
+	return 0;
+}
@@ -0,0 +1,290 @@
+// scports.c
+//
+// Brings SerialClone up on hundreds of simulated ports, as on a machine
+// with multi-port serial cards, and takes them away and adds them again
+// at random. Whenever a port is added its clone has to be numbered from
+// the instance table: the lowest number no port still there has, named
+// \Device\SerialCloneDevice<n>, and paired with the port's filter both
+// ways. Every port there has to have a number of its own, and the table
+// has to count as many ports as there are. The driver has to unload
+// leaving nothing behind.
+//
+//	scports [options]
+//
+//	-n N			ports, 512 by default, at most SC_MAX_INSTANCES
+//	-r N			rounds of taking ports away and adding them, 20 by default
+//	-s N			the seed for which ones, 1 by default
+//	-v				the driver's debug output
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../driver/pch.h"
+#include "schost.h"
+
+typedef struct _SCPORTS
+{
+	SCHOST			Hosts[SC_MAX_INSTANCES];
+	ULONG			Count;
+	BOOLEAN			Used[SC_MAX_INSTANCES];		// instance numbers the ports there have
+	ULONG			Present;
+	ULONGLONG		Added;
+	ULONGLONG		Removed;
+	ULONGLONG		Reused;						// numbers a port had before
+	BOOLEAN			Had[SC_MAX_INSTANCES];
+} SCPORTS;
+
+static SCPORTS	ScPorts;
+
+// the filter's extension of one port
+static PSERIALCLONE_DEVICE_EXTENSION ScPortsFilter(PSCHOST Host)
+{
+	return (PSERIALCLONE_DEVICE_EXTENSION)Host->Filter->DeviceExtension;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScPortsAdded
+//      A port has just been added; its clone has to have the lowest
+//      free number, under its name, paired with its filter
+//
+//  Return Value:
+//      FALSE, having said why, if not
+//
+static BOOLEAN ScPortsAdded(SCPORTS * Ports, ULONG Index)
+{
+	PSERIALCLONE_DEVICE_EXTENSION	filter;
+	PSERIALCLONE_DEVICE_EXTENSION	clone;
+	PSCHOST							host;
+	WCHAR							name[64];
+	char							narrow[64];
+	ULONG							lowest;
+	ULONG							n;
+
+	host = &Ports->Hosts[Index];
+	filter = ScPortsFilter(host);
+	clone = (PSERIALCLONE_DEVICE_EXTENSION)host->Clone->DeviceExtension;
+
+	for(lowest = 0; (lowest < SC_MAX_INSTANCES) && Ports->Used[lowest]; lowest++)
+		;
+	if(filter->Instance != lowest)
+	{
+		fprintf(stderr, "scports: port %u got instance %u, %u is the lowest free\n", Index, filter->Instance,
+			lowest);
+		return FALSE;
+	}
+	if((filter->TypeFlag != ISFILTER) || (clone->TypeFlag != ISCLONE) || (filter->Extension != clone) ||
+		(clone->Extension != filter))
+	{
+		fprintf(stderr, "scports: port %u's filter and clone aren't paired\n", Index);
+		return FALSE;
+	}
+
+	snprintf(narrow, sizeof(narrow), "\\Device\\SerialCloneDevice%u", filter->Instance);
+	for(n = 0; narrow[n] != 0; n++)
+		name[n] = (UCHAR)narrow[n];
+	name[n] = UNICODE_NULL;
+	if(SCHostFindDevice(name) != host->Clone)
+	{
+		fprintf(stderr, "scports: port %u's clone isn't %s\n", Index, narrow);
+		return FALSE;
+	}
+
+	Ports->Used[filter->Instance] = TRUE;
+	if(Ports->Had[filter->Instance])
+		Ports->Reused++;
+	Ports->Had[filter->Instance] = TRUE;
+	Ports->Present++;
+	Ports->Added++;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScPortsCheck
+//      Every port there has a number of its own, and the table counts
+//      them all
+//
+//  Return Value:
+//      FALSE, having said why, if not
+//
+static BOOLEAN ScPortsCheck(SCPORTS * Ports)
+{
+	static ULONG	owner[SC_MAX_INSTANCES];
+	ULONG			instance;
+	ULONG			i;
+
+	for(i = 0; i < SC_MAX_INSTANCES; i++)
+		owner[i] = (ULONG)-1;
+
+	for(i = 0; i < Ports->Count; i++)
+	{
+		if(Ports->Hosts[i].Port == NULL)
+			continue;
+
+		instance = ScPortsFilter(&Ports->Hosts[i])->Instance;
+		if((instance >= SC_MAX_INSTANCES) || !Ports->Used[instance] || (owner[instance] != (ULONG)-1))
+		{
+			fprintf(stderr, "scports: port %u's instance %u is out of range, free or port %u's too\n", i,
+				instance, (instance < SC_MAX_INSTANCES) ? owner[instance] : 0);
+			return FALSE;
+		}
+		owner[instance] = i;
+	}
+
+	if(g_Data.InstanceCount != Ports->Present)
+	{
+		fprintf(stderr, "scports: the instance table counts %u ports, %u are there\n", g_Data.InstanceCount,
+			Ports->Present);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScPortsRound
+//      Takes some of the ports away, a few at first up to all of them,
+//      checks what is left and adds them again in another order
+//
+//  Return Value:
+//      FALSE, having said why, if anything went wrong
+//
+static BOOLEAN ScPortsRound(SCPORTS * Ports, PULONGLONG Random)
+{
+	static ULONG	taken[SC_MAX_INSTANCES];
+	NTSTATUS		status;
+	ULONG			count;
+	ULONG			index;
+	ULONG			swap;
+	ULONG			i;
+
+	count = 1 + SCHostRandom(Random) % Ports->Count;
+	for(i = 0; i < Ports->Count; i++)
+		taken[i] = i;
+	for(i = 0; i < count; i++)
+	{
+		// a random one of those not yet taken
+		index = i + SCHostRandom(Random) % (Ports->Count - i);
+		swap = taken[i];
+		taken[i] = taken[index];
+		taken[index] = swap;
+
+		index = taken[i];
+		Ports->Used[ScPortsFilter(&Ports->Hosts[index])->Instance] = FALSE;
+		status = SCHostRemovePort(&Ports->Hosts[index]);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scports: port %u wouldn't go, status %x\n", index, status);
+			return FALSE;
+		}
+		Ports->Present--;
+		Ports->Removed++;
+	}
+	if(!ScPortsCheck(Ports))
+		return FALSE;
+
+	// back in reverse, so they don't get their own numbers back only by
+	// coming in the order they left
+	for(i = count; i-- > 0; )
+	{
+		status = SCHostAddPort(Ports->Hosts, Ports->Count, taken[i]);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scports: port %u wouldn't come back, status %x\n", taken[i], status);
+			return FALSE;
+		}
+		if(!ScPortsAdded(Ports, taken[i]))
+			return FALSE;
+	}
+	return ScPortsCheck(Ports);
+}
+
+static void ScPortsUsage(void)
+{
+	fprintf(stderr, "usage: scports [-n ports] [-r rounds] [-s seed] [-v]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	SCPORTS *	ports;
+	ULONGLONG	random;
+	NTSTATUS	status;
+	ULONG		rounds;
+	ULONG		leaks;
+	ULONG		i;
+	BOOLEAN		verbose;
+	BOOLEAN		bad;
+	BOOLEAN		ok;
+
+	ports = &ScPorts;
+	ports->Count = 512;
+	rounds = 20;
+	random = 1;
+	verbose = FALSE;
+	bad = FALSE;
+
+	for(i = 1; (i < (ULONG)argc) && !bad; i++)
+	{
+		if(!strcmp(argv[i], "-v"))
+			verbose = TRUE;
+		else if(i + 1 == (ULONG)argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-n"))
+			ports->Count = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-r"))
+			rounds = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-s"))
+			random = strtoull(argv[++i], NULL, 0);
+		else
+			bad = TRUE;
+	}
+	if(bad || (ports->Count == 0) || (ports->Count > SC_MAX_INSTANCES))
+	{
+		ScPortsUsage();
+		return 2;
+	}
+
+	SCHostSetDebugOutput(verbose);
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+
+	status = SCHostLoadPorts(ports->Hosts, ports->Count);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scports: SerialClone didn't load on %u ports, status %x\n", ports->Count, status);
+		return 1;
+	}
+
+	// brought up in order, each took the next number
+	ok = TRUE;
+	for(i = 0; (i < ports->Count) && ok; i++)
+		ok = ScPortsAdded(ports, i);
+	ok = ok && ScPortsCheck(ports);
+	for(i = 0; (i < rounds) && ok; i++)
+		ok = ScPortsRound(ports, &random);
+
+	status = SCHostUnloadPorts(ports->Hosts, ports->Count);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scports: SerialClone didn't unload, status %x\n", status);
+		return 1;
+	}
+	if(g_Data.InstanceCount != 0)
+	{
+		fprintf(stderr, "scports: the instance table counts %u ports after unload\n", g_Data.InstanceCount);
+		ok = FALSE;
+	}
+	if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		fprintf(stderr, "scports: %u things left behind by the driver\n", leaks);
+		ok = FALSE;
+	}
+
+	printf("%u ports, %u rounds: %llu added, %llu removed, %llu numbers reused, %s\n", ports->Count, rounds,
+		(unsigned long long)ports->Added, (unsigned long long)ports->Removed, (unsigned long long)ports->Reused,
+		ok ? "all unique" : "failed");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,589 @@
+// scrace.c
+//
+// Races SerialClone's read path on simulated processors: the filter's and
+// the clone's consumers reading, data arriving at the port and the port's
+// reads being cancelled, a round at a time, each round's tasks on
+// processors of their own interleaved by race.c as its seed decides.
+// Between every switch the driver's reads list and both read buffers
+// have to be well formed wherever their locks aren't held; once a round
+// has run down, every read sent to the port has to be on the list, each
+// device's buffer has to hold the stream's bytes from where its consumer
+// has read to, no more and no fewer than came in, and every read has to
+// have returned the stream's next bytes. A seed that gets anything else
+// is reported and ends there; a race abandoned on a broken list or buffer
+// ends the run, what it was in the middle of can't be unwound.
+//
+//	scrace [options]
+//
+//	-s N			the first seed, 1 by default
+//	-n N			seeds, 100 by default
+//	-r N			rounds a seed, 50 by default
+//	-P N			processors, 2 to 8, 4 by default
+//	-d N			PCT depth, 3 by default; 0 for a random pick at every point
+//	-k N			points a race is expected to take, 100 by default
+//	-c N			bytes a read asks for, at most, 64 by default
+//	-v				a line per seed, and the driver's debug output
+//
+// make check runs it with the defaults. SCReadComplete used to put what
+// its read got into the filter's buffer and then the clone's, each under
+// its own lock, as it came back from the port, and the reads went to the
+// port in whatever order their dispatches got there; two reads on two
+// processors could get their data into one buffer in either order, and
+// 58 of these 100 seeds failed. The read path now sends the reads in the
+// order they are listed and buffers what they got in that order too.
+//
+// A round's race is seeded with the run's seed times 65536 plus the
+// round, which is what SCHostFatal reports; the run's seed with -n 1 runs
+// it again.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../driver/pch.h"
+#include "schost.h"
+
+#define SCRACE_CONSUMERS		2
+#define SCRACE_STREAM_MAX		(SCRX_BUFFER_SIZE / 2)	// all of it fits in a read buffer
+#define SCRACE_DELIVER_MAX		64
+#define SCRACE_LIST_MAX			16						// entries on Reads before it is taken as a loop
+
+// SCRACE_TASK.Kind
+#define SCRACE_DELIVER			0		// bytes come in at the port, as its DPC
+#define SCRACE_READ				1		// a consumer reads
+#define SCRACE_FLUSH			2		// the port's reads are cancelled
+
+typedef struct _SCRACE_CONSUMER
+{
+	SCHOST_CONSUMER					Host;
+	struct _SCRACE *				Race;
+	PSERIALCLONE_DEVICE_EXTENSION	Extension;
+	ULONG							Offset;			// stream bytes read so far
+} SCRACE_CONSUMER;
+
+typedef struct _SCRACE_TASK
+{
+	struct _SCRACE *				Race;
+	ULONG							Kind;
+	SCRACE_CONSUMER *				Consumer;		// _READ
+	ULONG							Length;			// _DELIVER and _READ
+} SCRACE_TASK;
+
+typedef struct _SCRACE
+{
+	SCHOST							Host;
+	SCRACE_CONSUMER					Consumers[SCRACE_CONSUMERS];
+	PSERIALCLONE_DEVICE_EXTENSION	Filter;
+	UCHAR							Stream[SCRACE_STREAM_MAX];
+	ULONG							Delivered;
+	char							Failure[256];
+
+	// for the totals
+	ULONGLONG						Races;
+	ULONGLONG						Points;
+	ULONGLONG						Switches;
+	ULONGLONG						Spins;
+	ULONGLONG						Reads[SCRACE_CONSUMERS];
+} SCRACE;
+
+// records the first thing found wrong
+static VOID ScRaceFail(SCRACE * Race, PCSTR Format, ...) __attribute__((format(printf, 2, 3)));
+static VOID ScRaceFail(SCRACE * Race, PCSTR Format, ...)
+{
+	va_list	args;
+
+	if(Race->Failure[0] != 0)
+		return;
+	va_start(args, Format);
+	vsnprintf(Race->Failure, sizeof(Race->Failure), Format, args);
+	va_end(args);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRaceReadDone
+//      A consumer's read is done; what it got has to be the stream's next
+//      bytes
+//
+static VOID ScRaceReadDone(PSCHOST_CONSUMER Consumer, NTSTATUS Status, const UCHAR * Data, ULONG Length)
+{
+	SCRACE_CONSUMER *	consumer;
+	SCRACE *			race;
+
+	consumer = (SCRACE_CONSUMER *)Consumer->Context;
+	race = consumer->Race;
+
+	if(consumer->Offset + Length > race->Delivered)
+		ScRaceFail(race, "%s read %u bytes at %u, only %u came in", Consumer->Name, Length,
+			consumer->Offset, race->Delivered);
+	else if(memcmp(Data, race->Stream + consumer->Offset, Length) != 0)
+		ScRaceFail(race, "%s read %u bytes at %u that aren't the stream's", Consumer->Name, Length,
+			consumer->Offset);
+	consumer->Offset += Length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRaceCheckFifo
+//      A read buffer's pointers and count agree with each other
+//
+//  Return Value:
+//      NULL, or what is wrong
+//
+static PCSTR ScRaceCheckFifo(PSCFIFO Fifo)
+{
+	ULONG	in;
+	ULONG	out;
+
+	if(Fifo->Buffer == NULL)
+		return ((Fifo->Size == 0) && (Fifo->BuffSize == 0)) ? NULL : "a read buffer without storage holds data";
+	if(Fifo->End != Fifo->Buffer + Fifo->BuffSize)
+		return "a read buffer's End moved";
+	if(Fifo->Size > Fifo->BuffSize)
+		return "a read buffer holds more than it has room for";
+	if((Fifo->In < Fifo->Buffer) || (Fifo->In > Fifo->End) || (Fifo->Out < Fifo->Buffer) || (Fifo->Out > Fifo->End))
+		return "a read buffer's In or Out is outside it";
+
+	in = (ULONG)(Fifo->In - Fifo->Buffer) % Fifo->BuffSize;
+	out = (ULONG)(Fifo->Out - Fifo->Buffer) % Fifo->BuffSize;
+	if((in + Fifo->BuffSize - out) % Fifo->BuffSize != Fifo->Size % Fifo->BuffSize)
+		return "a read buffer's count doesn't match its In and Out";
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRaceCheckReads
+//      The filter's list of reads at the port is well formed and holds
+//      only reads the consumers have outstanding
+//
+//  Arguments:
+//      IN  Race
+//              the run
+//
+//      OUT Count
+//              entries on it, optional
+//
+//  Return Value:
+//      NULL, or what is wrong
+//
+static PCSTR ScRaceCheckReads(SCRACE * Race, PULONG Count)
+{
+	PLIST_ENTRY		head;
+	PLIST_ENTRY		entry;
+	PIRP			irp;
+	ULONG			count;
+	ULONG			i;
+	BOOLEAN			found;
+
+	head = &Race->Filter->Reads;
+	count = 0;
+	for(entry = head->Flink; entry != head; entry = entry->Flink)
+	{
+		if((entry->Flink->Blink != entry) || (entry->Blink->Flink != entry))
+			return "the reads list is broken";
+		if(++count > SCRACE_LIST_MAX)
+			return "the reads list loops";
+
+		found = FALSE;
+		for(i = 0; (i < SCRACE_CONSUMERS) && !found; i++)
+		{
+			irp = Race->Consumers[i].Host.Irp;
+			found = (irp != NULL) && ((PUCHAR)entry > (PUCHAR)irp) &&
+				((PUCHAR)entry + sizeof(SERIALCLONE_IRP_STATUS) <= (PUCHAR)irp + irp->Size);
+		}
+		if(!found)
+			return "the reads list has an entry no outstanding read owns";
+	}
+	if((head->Flink->Blink != head) || (head->Blink->Flink != head))
+		return "the reads list's head is broken";
+
+	if(Count != NULL)
+		*Count = count;
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRaceCheck
+//      What has to hold between any two switches, as far as the locks
+//      let it be looked at
+//
+static PCSTR ScRaceCheck(PVOID Context)
+{
+	SCRACE *	race;
+	PSCFIFO		fifo;
+	PCSTR		failure;
+	ULONG		i;
+
+	race = (SCRACE *)Context;
+	if(race->Filter->ListLock == 0)
+	{
+		failure = ScRaceCheckReads(race, NULL);
+		if(failure != NULL)
+			return failure;
+	}
+
+	for(i = 0; i < SCRACE_CONSUMERS; i++)
+	{
+		fifo = &race->Consumers[i].Extension->ReadBuffer;
+		if(fifo->FifoLock == 0)
+		{
+			failure = ScRaceCheckFifo(fifo);
+			if(failure != NULL)
+				return failure;
+		}
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRaceCheckQuiet
+//      What has to hold once a round has run down: every read at the port
+//      listed, and each device's buffer holding the stream from where its
+//      consumer is to everything that came in, less what the port has
+//
+static VOID ScRaceCheckQuiet(SCRACE * Race)
+{
+	SCRACE_CONSUMER *	consumer;
+	PSCFIFO				fifo;
+	PCSTR				failure;
+	ULONG				count;
+	ULONG				outstanding;
+	ULONG				first;
+	ULONG				i;
+
+	failure = ScRaceCheck(Race);
+	if(failure != NULL)
+	{
+		ScRaceFail(Race, "%s", failure);
+		return;
+	}
+
+	// a read that isn't done went to the port, the buffers satisfy the others at once
+	failure = ScRaceCheckReads(Race, &count);
+	for(outstanding = 0, i = 0; i < SCRACE_CONSUMERS; i++)
+		if(Race->Consumers[i].Host.Irp != NULL)
+			outstanding++;
+	if(failure != NULL)
+		ScRaceFail(Race, "%s", failure);
+	else if(count != outstanding)
+		ScRaceFail(Race, "%u reads on the list, %u outstanding", count, outstanding);
+
+	for(i = 0; i < SCRACE_CONSUMERS; i++)
+	{
+		consumer = &Race->Consumers[i];
+		fifo = &consumer->Extension->ReadBuffer;
+		if(consumer->Offset + fifo->Size + Race->Host.Port->Count != Race->Delivered)
+		{
+			ScRaceFail(Race, "%s read %u, has %u buffered and the port %u, %u came in", consumer->Host.Name,
+				consumer->Offset, fifo->Size, Race->Host.Port->Count, Race->Delivered);
+			return;
+		}
+
+		// Out may sit on End, the next byte is at Buffer then
+		first = (fifo->Size == 0) ? 0 : (ULONG)(fifo->Out - fifo->Buffer) % fifo->BuffSize;
+		if((fifo->Size > fifo->BuffSize - first) ?
+			((memcmp(fifo->Buffer + first, Race->Stream + consumer->Offset, fifo->BuffSize - first) != 0) ||
+			(memcmp(fifo->Buffer, Race->Stream + consumer->Offset + fifo->BuffSize - first,
+				fifo->Size - (fifo->BuffSize - first)) != 0)) :
+			(memcmp(fifo->Buffer + first, Race->Stream + consumer->Offset, fifo->Size) != 0))
+		{
+			ScRaceFail(Race, "%s's buffer doesn't hold the stream from %u", consumer->Host.Name, consumer->Offset);
+			return;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRaceTask
+//      One processor's part in a round
+//
+static VOID ScRaceTask(PVOID Context)
+{
+	SCRACE_TASK *	task;
+	SCRACE *		race;
+
+	task = (SCRACE_TASK *)Context;
+	race = task->Race;
+	switch(task->Kind)
+	{
+	case SCRACE_DELIVER:
+		// counted in first, what arrives can be read before the port returns
+		race->Delivered += task->Length;
+		SCSimPortReceive(race->Host.Port, race->Stream + race->Delivered - task->Length, task->Length);
+		break;
+	case SCRACE_READ:
+		if(SCHostConsumerRead(&task->Consumer->Host, task->Length))
+			race->Reads[task->Consumer - race->Consumers]++;
+		break;
+	case SCRACE_FLUSH:
+		SCSimPortFlush(race->Host.Port);
+		break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRaceRun
+//      Loads the driver, opens both devices and races a seed's rounds on
+//      them
+//
+//  Arguments:
+//      IN OUT Race
+//              the run, its totals added to
+//
+//      IN  Seed
+//              the seed
+//
+//      IN  Rounds
+//              races to run
+//
+//      IN  Processors
+//              up to this many tasks a round
+//
+//      IN  Depth, Steps
+//              for race.c
+//
+//      IN  ReadSize
+//              most bytes a read asks for
+//
+//  Return Value:
+//      0 if everything held, 1 if not, -1 if the run can't go on
+//
+static int ScRaceRun(SCRACE * Race, ULONGLONG Seed, ULONG Rounds, ULONG Processors, ULONG Depth,
+	ULONG Steps, ULONG ReadSize)
+{
+	SCHOST_TASK			tasks[SCHOST_RACE_MAX];
+	SCRACE_TASK			raceTasks[SCHOST_RACE_MAX];
+	SCHOST_RACE			race;
+	SERIAL_TIMEOUTS		timeouts;
+	SCRACE_CONSUMER *	consumer;
+	ULONGLONG			random;
+	ULONG				round;
+	ULONG				count;
+	ULONG				leaks;
+	ULONG				i;
+	BOOLEAN				delivering;
+	NTSTATUS			status;
+
+	Race->Delivered = 0;
+	Race->Failure[0] = 0;
+	random = Seed;
+	for(i = 0; i < SCRACE_STREAM_MAX; i++)
+		Race->Stream[i] = (UCHAR)SCHostRandom(&random);
+
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+	SCHostSetProcessors(Processors);
+	status = SCHostLoad(&Race->Host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scrace: SerialClone didn't load, status %x\n", status);
+		return -1;
+	}
+	Race->Filter = (PSERIALCLONE_DEVICE_EXTENSION)Race->Host.Filter->DeviceExtension;
+
+	for(i = 0; i < SCRACE_CONSUMERS; i++)
+	{
+		consumer = &Race->Consumers[i];
+		consumer->Race = Race;
+		consumer->Offset = 0;
+		status = SCHostConsumerOpen(&consumer->Host, (i == 0) ? "filter" : "clone",
+			(i == 0) ? Race->Host.Filter : Race->Host.Clone, ReadSize, ScRaceReadDone, consumer);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scrace: can't open the %s, status %x\n", (i == 0) ? "filter" : "clone", status);
+			return -1;
+		}
+		consumer->Extension = (PSERIALCLONE_DEVICE_EXTENSION)consumer->Host.DeviceObject->DeviceExtension;
+	}
+
+	// reads return with whatever there is as soon as there is anything,
+	// so they wait at the port for the data the rounds bring
+	timeouts.ReadIntervalTimeout = MAXULONG;
+	timeouts.ReadTotalTimeoutMultiplier = MAXULONG;
+	timeouts.ReadTotalTimeoutConstant = 1000;
+	timeouts.WriteTotalTimeoutMultiplier = 0;
+	timeouts.WriteTotalTimeoutConstant = 0;
+	status = SCHostIoctl(Race->Host.Filter, &Race->Consumers[0].Host.FileObject, IOCTL_SERIAL_SET_TIMEOUTS,
+		&timeouts, sizeof(timeouts), NULL, 0, NULL);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scrace: the port's timeouts weren't taken, status %x\n", status);
+		return -1;
+	}
+
+	for(round = 0; (round < Rounds) && (Race->Failure[0] == 0); round++)
+	{
+		count = 2 + SCHostRandom(&random) % (Processors - 1);
+		delivering = FALSE;
+		for(i = 0; i < count; i++)
+		{
+			raceTasks[i].Race = Race;
+			raceTasks[i].Kind = SCHostRandom(&random) % 8;
+			if((raceTasks[i].Kind == SCRACE_DELIVER) && (delivering || (Race->Delivered >= SCRACE_STREAM_MAX)))
+				raceTasks[i].Kind = SCRACE_READ;
+			else if(raceTasks[i].Kind >= 4)
+				raceTasks[i].Kind = (raceTasks[i].Kind == 7) ? SCRACE_FLUSH : SCRACE_READ;
+			else if(raceTasks[i].Kind != SCRACE_DELIVER)
+				raceTasks[i].Kind = (i == 0) ? SCRACE_DELIVER : SCRACE_READ;
+
+			// one processor delivers, bytes from two would arrive in no
+			// order the stream could say
+			if(raceTasks[i].Kind == SCRACE_DELIVER)
+			{
+				delivering = TRUE;
+				raceTasks[i].Length = 1 + SCHostRandom(&random) % SCRACE_DELIVER_MAX;
+				raceTasks[i].Length = min(raceTasks[i].Length, SCRACE_STREAM_MAX - Race->Delivered);
+			}
+			else
+			{
+				raceTasks[i].Consumer = &Race->Consumers[SCHostRandom(&random) % SCRACE_CONSUMERS];
+				raceTasks[i].Length = 1 + SCHostRandom(&random) % ReadSize;
+			}
+
+			tasks[i].Routine = ScRaceTask;
+			tasks[i].Context = &raceTasks[i];
+			tasks[i].Irql = (raceTasks[i].Kind == SCRACE_DELIVER) ? DISPATCH_LEVEL : PASSIVE_LEVEL;
+		}
+
+		memset(&race, 0, sizeof(race));
+		race.Seed = Seed * 65536 + round;
+		race.Depth = Depth;
+		race.Steps = Steps;
+		race.Check = ScRaceCheck;
+		race.CheckContext = Race;
+		if(!NT_SUCCESS(SCHostRace(tasks, count, &race)))
+		{
+			// the tasks were left where they stood, there is no going on
+			fprintf(stderr, "scrace: seed %llu, round %u, race seed %llu, at point %u: %s\n",
+				(unsigned long long)Seed, round, (unsigned long long)race.Seed, race.Points, race.Failure);
+			return -1;
+		}
+		Race->Races++;
+		Race->Points += race.Points;
+		Race->Switches += race.Switches;
+		Race->Spins += race.Spins;
+
+		while(SCHostRunPending())
+			;
+		ScRaceCheckQuiet(Race);
+
+		// now and then the reads left at the port time out empty
+		if(SCHostRandom(&random) % 8 == 0)
+		{
+			SCHostRunUntil(SCHostNow() + (ULONGLONG)(timeouts.ReadTotalTimeoutConstant + 1) * 10000);
+			ScRaceCheckQuiet(Race);
+		}
+	}
+
+	if(Race->Failure[0] != 0)
+		fprintf(stderr, "scrace: seed %llu, round %u, race seed %llu: %s\n", (unsigned long long)Seed,
+			round - 1, (unsigned long long)(Seed * 65536 + round - 1), Race->Failure);
+
+	SCSimPortFlush(Race->Host.Port);
+	while(SCHostRunPending())
+		;
+	for(i = 0; i < SCRACE_CONSUMERS; i++)
+		SCHostConsumerClose(&Race->Consumers[i].Host);
+
+	status = SCHostUnload(&Race->Host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scrace: SerialClone didn't unload, status %x\n", status);
+		return 1;
+	}
+	if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		fprintf(stderr, "scrace: seed %llu, %u things left behind by the driver\n", (unsigned long long)Seed, leaks);
+		return 1;
+	}
+	return (Race->Failure[0] == 0) ? 0 : 1;
+}
+
+static void ScRaceUsage(void)
+{
+	fprintf(stderr, "usage: scrace [-s seed] [-n seeds] [-r rounds] [-P processors] [-d depth] [-k steps]\n");
+	fprintf(stderr, "              [-c bytes] [-v]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	static SCRACE	race;
+	ULONGLONG		seed;
+	ULONGLONG		first;
+	ULONGLONG		lastPoints;
+	ULONG			seeds;
+	ULONG			failed;
+	ULONG			rounds;
+	ULONG			processors;
+	ULONG			depth;
+	ULONG			steps;
+	ULONG			readSize;
+	BOOLEAN			verbose;
+	BOOLEAN			bad;
+	int				result;
+	int				i;
+
+	first = 1;
+	seeds = 100;
+	rounds = 50;
+	processors = 4;
+	depth = 3;
+	steps = 100;
+	readSize = 64;
+	verbose = FALSE;
+	bad = FALSE;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(!strcmp(argv[i], "-v"))
+			verbose = TRUE;
+		else if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-s"))
+			first = strtoull(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-n"))
+			seeds = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-r"))
+			rounds = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-P"))
+			processors = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-d"))
+			depth = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-k"))
+			steps = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-c"))
+			readSize = (ULONG)strtoul(argv[++i], NULL, 0);
+		else
+			bad = TRUE;
+	}
+	if(bad || (processors < 2) || (processors > SCHOST_RACE_MAX) || (readSize == 0) || (steps == 0))
+	{
+		ScRaceUsage();
+		return 2;
+	}
+
+	SCHostSetDebugOutput(verbose);
+
+	failed = 0;
+	for(seed = first; seed < first + seeds; seed++)
+	{
+		lastPoints = race.Points;
+		result = ScRaceRun(&race, seed, rounds, processors, depth, steps, readSize);
+		if(result < 0)
+			return 1;
+		if(result != 0)
+			failed++;
+		if(verbose)
+			printf("seed %llu: %u bytes, filter read %u, clone %u, %llu points%s\n", (unsigned long long)seed,
+				race.Delivered, race.Consumers[0].Offset, race.Consumers[1].Offset,
+				(unsigned long long)(race.Points - lastPoints), (result != 0) ? ", failed" : "");
+	}
+
+	printf("%u seeds from %llu, %u failed; %llu races, %llu points, %llu switches, %llu spins; "
+		"%llu filter reads, %llu clone reads\n", seeds, (unsigned long long)first, failed,
+		(unsigned long long)race.Races, (unsigned long long)race.Points, (unsigned long long)race.Switches,
+		(unsigned long long)race.Spins, (unsigned long long)race.Reads[0], (unsigned long long)race.Reads[1]);
+	return (failed == 0) ? 0 : 1;
+}
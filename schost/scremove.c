@@ -0,0 +1,396 @@
+// scremove.c
+//
+// Times SerialClone's remove lock with host threads taking it and
+// dropping it at once, as every dispatch routine does on every processor
+// an IRP comes in on. Each thread runs as a processor of its own, on a
+// host processor of its own where the machine has them, and calls the
+// driver's SerialCloneAcquireRemoveLock and SerialCloneReleaseRemoveLock
+// on one extension, each counting in its processor's slot. For
+// comparison the same is done with the one interlocked RemoveCount the
+// driver had before, every processor on the same cache line. Afterwards
+// each lock is drained as removal drains it, with a reference the last
+// thread's processor took still held; removal has to wait until a DPC
+// drops it on another processor, and refuse the lock from then on.
+//
+//	scremove [options]
+//
+//	-t N,...		threads taking the lock at once, 1,2,4 by default
+//	-n N			times each thread takes it and drops it, 10000000 by default
+//	-R N			runs of each, the fastest kept, 3 by default
+//
+// A tab separated line per lock and thread count, after a line naming
+// the columns: the threads, the lock, per_cpu or interlocked, ns a take
+// and drop for the slowest thread, and whether the lock drained. With
+// fewer host processors than threads they take turns and the two locks
+// only differ by what a take and drop costs on its own.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "../driver/pch.h"
+#include "schost.h"
+
+#define SCREMOVE_LIST_MAX		16
+#define SCREMOVE_THREADS_MAX	32
+
+#define SCREMOVE_PER_CPU		0		// the driver's, SerialCloneAcquireRemoveLock
+#define SCREMOVE_INTERLOCKED	1		// one RemoveCount for every processor
+
+static PCSTR ScRemoveLockNames[] = { "per_cpu", "interlocked" };
+
+typedef struct _SCREMOVE_THREAD
+{
+	PSERIALCLONE_DEVICE_EXTENSION	Extension;
+	ULONG							Lock;
+	ULONG							Processor;		// simulated, and the host's if Pin
+	BOOLEAN							Pin;
+	ULONG							Operations;
+	pthread_barrier_t *				Start;
+	double							Seconds;
+	BOOLEAN							Refused;		// the lock wasn't given once
+} SCREMOVE_THREAD;
+
+// the reference held through removal, and the DPC that drops it
+typedef struct _SCREMOVE_LATE
+{
+	PSERIALCLONE_DEVICE_EXTENSION	Extension;
+	ULONG							Lock;
+	KTIMER							Timer;
+	KDPC							Dpc;
+	BOOLEAN							Released;
+} SCREMOVE_LATE;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRemoveAcquireInterlocked, ScRemoveReleaseInterlocked
+//      The remove lock as it was, every reference in RemoveCount
+//
+static BOOLEAN ScRemoveAcquireInterlocked(PSERIALCLONE_DEVICE_EXTENSION DeviceExtension)
+{
+	InterlockedIncrement(&DeviceExtension->RemoveCount);
+	if(PnpStateRemoved == DeviceExtension->PnpState)
+	{
+		if(InterlockedDecrement(&DeviceExtension->RemoveCount) == 0)
+			KeSetEvent(&DeviceExtension->RemoveEvent, IO_NO_INCREMENT, FALSE);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static VOID ScRemoveReleaseInterlocked(PSERIALCLONE_DEVICE_EXTENSION DeviceExtension)
+{
+	if(InterlockedDecrement(&DeviceExtension->RemoveCount) == 0)
+		KeSetEvent(&DeviceExtension->RemoveEvent, IO_NO_INCREMENT, FALSE);
+}
+
+// takes the lock, SCREMOVE_xxx's
+static BOOLEAN ScRemoveAcquire(PSERIALCLONE_DEVICE_EXTENSION DeviceExtension, ULONG Lock)
+{
+	if(Lock == SCREMOVE_PER_CPU)
+		return SerialCloneAcquireRemoveLock(DeviceExtension);
+	return ScRemoveAcquireInterlocked(DeviceExtension);
+}
+
+// drops the reference held through removal, while removal waits
+static VOID ScRemoveLateDpc(PKDPC Dpc, PVOID Context, PVOID Arg1, PVOID Arg2)
+{
+	SCREMOVE_LATE *	late;
+
+	late = (SCREMOVE_LATE *)Context;
+	if(late->Lock == SCREMOVE_PER_CPU)
+		SerialCloneReleaseRemoveLock(late->Extension);
+	else
+		ScRemoveReleaseInterlocked(late->Extension);
+	late->Released = TRUE;
+}
+
+// seconds on the host's monotonic clock
+static double ScRemoveNow(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRemoveThread
+//      One processor taking and dropping the lock, timed from when all
+//      the threads are ready
+//
+static void * ScRemoveThread(void * Context)
+{
+	PSERIALCLONE_DEVICE_EXTENSION	ext;
+	SCREMOVE_THREAD *				thread;
+	cpu_set_t						cpus;
+	ULONG							i;
+	double							start;
+
+	thread = (SCREMOVE_THREAD *)Context;
+	ext = thread->Extension;
+	if(thread->Pin)
+	{
+		CPU_ZERO(&cpus);
+		CPU_SET(thread->Processor, &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	}
+	SCHostSetProcessor(thread->Processor);
+
+	pthread_barrier_wait(thread->Start);
+	start = ScRemoveNow();
+	if(thread->Lock == SCREMOVE_PER_CPU)
+	{
+		for(i = 0; i < thread->Operations; i++)
+		{
+			if(!SerialCloneAcquireRemoveLock(ext))
+			{
+				thread->Refused = TRUE;
+				break;
+			}
+			SerialCloneReleaseRemoveLock(ext);
+		}
+	}
+	else
+	{
+		for(i = 0; i < thread->Operations; i++)
+		{
+			if(!ScRemoveAcquireInterlocked(ext))
+			{
+				thread->Refused = TRUE;
+				break;
+			}
+			ScRemoveReleaseInterlocked(ext);
+		}
+	}
+	thread->Seconds = ScRemoveNow() - start;
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScRemoveRun
+//      One lock on a fresh extension, Threads at once, then drained
+//
+//  Arguments:
+//      IN  Lock
+//              SCREMOVE_xxx
+//
+//      IN  Threads, Operations
+//              how many take it, and how many times each
+//
+//      IN  Processors
+//              the host's, each thread has one of them if there are enough
+//
+//      OUT Ns
+//              ns a take and drop for the slowest thread
+//
+//      OUT Drained
+//              removal waited for the reference still held, and the lock
+//              was refused after
+//
+//  Return Value:
+//      0, or -1, having said why, if the run couldn't be made
+//
+static int ScRemoveRun(ULONG Lock, ULONG Threads, ULONG Operations, long Processors, double * Ns,
+	BOOLEAN * Drained)
+{
+	static SCREMOVE_THREAD			threads[SCREMOVE_THREADS_MAX];
+	static pthread_t				handles[SCREMOVE_THREADS_MAX];
+	static SCREMOVE_LATE			late;
+	PSERIALCLONE_DEVICE_EXTENSION	ext;
+	pthread_barrier_t				start;
+	LARGE_INTEGER					dueTime;
+	double							slowest;
+	BOOLEAN							refused;
+	ULONG							t;
+
+	// as AddDevice leaves it
+	if(posix_memalign((void **)&ext, SC_CACHE_LINE, SCStatsExtensionSize()) != 0)
+	{
+		fprintf(stderr, "scremove: no memory for an extension\n");
+		return -1;
+	}
+	memset(ext, 0, SCStatsExtensionSize());
+	SCStatsInit(ext);
+	ext->RemoveCount = 1;
+	KeInitializeEvent(&ext->RemoveEvent, NotificationEvent, FALSE);
+	ext->PnpState = PnpStateStarted;
+
+	pthread_barrier_init(&start, NULL, Threads);
+	for(t = 0; t < Threads; t++)
+	{
+		memset(&threads[t], 0, sizeof(threads[t]));
+		threads[t].Extension = ext;
+		threads[t].Lock = Lock;
+		threads[t].Processor = t;
+		threads[t].Pin = (Processors >= (long)Threads);
+		threads[t].Operations = Operations;
+		threads[t].Start = &start;
+		if(pthread_create(&handles[t], NULL, ScRemoveThread, &threads[t]) != 0)
+		{
+			fprintf(stderr, "scremove: couldn't start %u threads\n", Threads);
+			exit(1);
+		}
+	}
+
+	slowest = 0;
+	refused = FALSE;
+	for(t = 0; t < Threads; t++)
+	{
+		pthread_join(handles[t], NULL);
+		if(threads[t].Seconds > slowest)
+			slowest = threads[t].Seconds;
+		refused = refused || threads[t].Refused;
+	}
+	pthread_barrier_destroy(&start);
+	*Ns = slowest * 1e9 / Operations;
+
+	// a reference the last thread's processor still holds, dropped on
+	// this one while removal waits
+	memset(&late, 0, sizeof(late));
+	late.Extension = ext;
+	late.Lock = Lock;
+	SCHostSetProcessor(Threads - 1);
+	refused = refused || !ScRemoveAcquire(ext, Lock);
+	SCHostSetProcessor(0);
+	KeInitializeTimer(&late.Timer);
+	KeInitializeDpc(&late.Dpc, ScRemoveLateDpc, &late);
+	dueTime.QuadPart = -10 * 1000 * 10;
+	KeSetTimer(&late.Timer, dueTime, &late.Dpc);
+
+	// removal, as SerialCloneWaitForSafeRemove did it before and does now
+	if(Lock == SCREMOVE_PER_CPU)
+		SerialCloneWaitForSafeRemove(ext);
+	else
+	{
+		ext->PnpState = PnpStateRemoved;
+		ScRemoveReleaseInterlocked(ext);
+		KeWaitForSingleObject(&ext->RemoveEvent, Executive, KernelMode, FALSE, NULL);
+	}
+	// not if removal didn't wait for it
+	if(!late.Released)
+		KeCancelTimer(&late.Timer);
+	*Drained = !refused && late.Released && !ScRemoveAcquire(ext, Lock) && (ext->RemoveCount == 0);
+
+	free(ext);
+	return 0;
+}
+
+// a comma separated list of numbers, how many there were
+static ULONG ScRemoveList(char * Text, ULONG * List)
+{
+	ULONG	count;
+	char *	next;
+
+	for(count = 0; (count < SCREMOVE_LIST_MAX) && (*Text != 0); count++)
+	{
+		List[count] = (ULONG)strtoul(Text, &next, 0);
+		if((next == Text) || ((*next != ',') && (*next != 0)))
+			return 0;
+		Text = (*next == ',') ? next + 1 : next;
+	}
+	return (*Text == 0) ? count : 0;
+}
+
+static void ScRemoveUsage(void)
+{
+	fprintf(stderr, "usage: scremove [-t threads,...] [-n operations] [-R runs]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	ULONG		counts[SCREMOVE_LIST_MAX] = { 1, 2, 4 };
+	ULONG		countCount;
+	ULONG		operations;
+	ULONG		runs;
+	ULONG		most;
+	ULONG		lock;
+	ULONG		c;
+	ULONG		k;
+	long		processors;
+	double		ns;
+	double		best;
+	BOOLEAN		ran;
+	BOOLEAN		drained;
+	BOOLEAN		allDrained;
+	BOOLEAN		bad;
+	int			i;
+
+	countCount = 3;
+	operations = 10000000;
+	runs = 3;
+	bad = FALSE;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-t"))
+			bad = (countCount = ScRemoveList(argv[++i], counts)) == 0;
+		else if(!strcmp(argv[i], "-n"))
+			operations = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-R"))
+			runs = (ULONG)strtoul(argv[++i], NULL, 0);
+		else
+			bad = TRUE;
+	}
+	most = 0;
+	for(c = 0; c < countCount; c++)
+	{
+		if((counts[c] == 0) || (counts[c] > SCREMOVE_THREADS_MAX))
+			bad = TRUE;
+		else if(counts[c] > most)
+			most = counts[c];
+	}
+	if(bad || (operations == 0) || (runs == 0))
+	{
+		ScRemoveUsage();
+		return 2;
+	}
+
+	// a slot for every thread
+	processors = sysconf(_SC_NPROCESSORS_ONLN);
+	SCHostSetProcessors(most);
+	SCHostSetDebugOutput(FALSE);
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+
+	printf("# %ld processors\n", processors);
+	printf("threads\tlock\tns_take_drop\tdrained\n");
+	allDrained = TRUE;
+	for(c = 0; c < countCount; c++)
+	{
+		for(lock = SCREMOVE_PER_CPU; lock <= SCREMOVE_INTERLOCKED; lock++)
+		{
+			best = 0;
+			drained = TRUE;
+			for(k = 0; k < runs; k++)
+			{
+				if(ScRemoveRun(lock, counts[c], operations, processors, &ns, &ran) < 0)
+					return 1;
+				if((k == 0) || (ns < best))
+					best = ns;
+				drained = drained && ran;
+			}
+			allDrained = allDrained && drained;
+
+			printf("%u\t%s\t%.2f\t%s\n", counts[c], ScRemoveLockNames[lock], best, drained ? "yes" : "no");
+			fflush(stdout);
+		}
+	}
+
+	if(!allDrained)
+	{
+		fprintf(stderr, "scremove: a lock didn't drain\n");
+		return 1;
+	}
+	return 0;
+}
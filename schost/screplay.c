@@ -0,0 +1,650 @@
+// screplay.c
+//
+// Replays a capture file through SerialClone on the host. The driver is
+// loaded on a simulated port, the filter and the clone are opened by a
+// consumer each that keeps a read going, and the received records of the
+// capture arrive at the port at their recorded times. Everything the
+// consumers read is checked against what went in, and the time from a
+// record arriving to a consumer having all of it is its latency. The
+// transmitted records are written by the filter's consumer, the port's
+// owner, and checked as they leave the port; the capture's settings are
+// set on the port through the filter first and read back at the end.
+// Once done the consumers close and the driver is removed and unloaded,
+// and anything it left allocated or queued is a failure.
+//
+//	screplay [options] capture
+//
+//	-s N			times the recorded speed, 2 runs twice as fast, 0.5 half
+//	-r				keep to the host's clock, sleeping out the gaps; without
+//					it time is simulated and the replay runs as fast as it
+//					can, the same every time
+//	-f N			bytes per filter read, 0 for no filter consumer
+//	-c N			bytes per clone read, 0 for no clone consumer
+//	-t S			start S seconds into the capture
+//	-n N			replay N records at most
+//	-p Name=Value	a driver parameter, as under its Parameters key
+//	-v				list mismatches and show the driver's debug output
+//
+// Latencies are in the replay's time: scaled by -s, simulated without -r.
+// With no -r they are what the driver adds by design, a consumer whose
+// data waits on the next record to come up shows that record's gap; with
+// -r the host's scheduling is in them too.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "schost.h"
+#include "../intrface.h"
+#include "../sccapfile/sccapfile.h"
+
+#define SCREPLAY_CONSUMERS		2
+#define SCREPLAY_SHOW_MISMATCHES	8
+#define SCREPLAY_READ_TIMEOUT		1000	// ms an empty read waits at the port
+
+// a record replayed, waiting for the consumers to read to its end
+typedef struct _SCREPLAY_PENDING
+{
+	ULONGLONG			End;			// stream offset past its last byte
+	ULONGLONG			Arrived;		// clock when it was given to the port
+} SCREPLAY_PENDING;
+
+typedef struct _SCREPLAY_CONSUMER
+{
+	SCHOST_CONSUMER		Host;
+	struct _SCREPLAY *	Replay;
+	ULONG				ReadSize;
+	ULONGLONG			Offset;			// stream bytes read so far
+	ULONGLONG			Next;			// index of the next record to complete
+	ULONGLONG			Mismatches;		// bytes that differ from the stream
+	ULONGLONG			Extra;			// bytes read past the end of the stream
+	ULONGLONG			Failed;			// reads completed with an error while replaying
+	ULONGLONG *			Latency;		// one per record completed
+	ULONGLONG			Latencies;
+	ULONGLONG			LatencyRoom;
+} SCREPLAY_CONSUMER;
+
+typedef struct _SCREPLAY
+{
+	SCREPLAY_CONSUMER	Consumers[SCREPLAY_CONSUMERS];
+	BOOLEAN				Verbose;
+
+	// the stream as given to the port, from Base on
+	UCHAR *				Stream;
+	ULONGLONG			Base;
+	ULONGLONG			Length;			// offset past the last byte
+	size_t				StreamRoom;
+
+	// records not completed by every consumer yet, from First on
+	SCREPLAY_PENDING *	Pending;
+	ULONGLONG			First;
+	ULONGLONG			Records;		// replayed
+	size_t				PendingRoom;
+
+	// transmitted records written, and what left the port, hashed in order
+	ULONGLONG			TxBytes;
+	ULONG				TxHash;
+	ULONGLONG			PortTxBytes;
+	ULONG				PortTxHash;
+} SCREPLAY;
+
+#define SCREPLAY_HASH_BASIS		2166136261u
+
+// FNV-1a, carried on from Hash
+static ULONG ScReplayHash(ULONG Hash, const UCHAR * Data, ULONG Length)
+{
+	ULONG	i;
+
+	for(i = 0; i < Length; i++)
+		Hash = (Hash ^ Data[i]) * 16777619u;
+	return Hash;
+}
+
+// what the driver passed down to the port to transmit
+static VOID ScReplayTransmit(PSCSIMPORT Port, const UCHAR * Data, ULONG Length, PVOID Context)
+{
+	SCREPLAY *	replay = (SCREPLAY *)Context;
+
+	replay->PortTxBytes += Length;
+	replay->PortTxHash = ScReplayHash(replay->PortTxHash, Data, Length);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScReplayTimeouts
+//      Has the port's reads return as soon as there is anything, as an
+//      application reading whatever comes sets them up; what the port
+//      keeps back until a read is full is not what the capture recorded
+//
+//  Arguments:
+//      IN  Consumer
+//              the consumer opened first
+//
+//  Return Value:
+//      NT status code
+//
+static NTSTATUS ScReplayTimeouts(PSCHOST_CONSUMER Consumer)
+{
+	SERIAL_TIMEOUTS		timeouts;
+
+	memset(&timeouts, 0, sizeof(timeouts));
+	timeouts.ReadIntervalTimeout = MAXULONG;
+	timeouts.ReadTotalTimeoutMultiplier = MAXULONG;
+	timeouts.ReadTotalTimeoutConstant = SCREPLAY_READ_TIMEOUT;
+	return SCHostIoctl(Consumer->DeviceObject, &Consumer->FileObject, IOCTL_SERIAL_SET_TIMEOUTS,
+		&timeouts, sizeof(timeouts), NULL, 0, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScReplaySettings
+//      Sets the port up as the capture says it was, through the filter as
+//      the owner's application would so the driver sees the settings go by
+//
+//  Arguments:
+//      IN  Owner
+//              the filter's consumer
+//
+//      IN  Header
+//              the capture's header
+//
+//  Return Value:
+//      NT status code
+//
+static NTSTATUS ScReplaySettings(PSCHOST_CONSUMER Owner, const SCCAP_FILE_HEADER * Header)
+{
+	SERIAL_BAUD_RATE	baudRate;
+	SERIAL_LINE_CONTROL	lineControl;
+	NTSTATUS			status;
+
+	status = STATUS_SUCCESS;
+	if(Header->Valid & SERIALCLONE_STATE_BAUD_RATE)
+	{
+		baudRate.BaudRate = Header->BaudRate;
+		status = SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_BAUD_RATE,
+			&baudRate, sizeof(baudRate), NULL, 0, NULL);
+	}
+	if(NT_SUCCESS(status) && (Header->Valid & SERIALCLONE_STATE_LINE_CONTROL))
+	{
+		lineControl.StopBits = Header->StopBits;
+		lineControl.Parity = Header->Parity;
+		lineControl.WordLength = Header->WordLength;
+		status = SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_LINE_CONTROL,
+			&lineControl, sizeof(lineControl), NULL, 0, NULL);
+	}
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScReplayLow
+//      Finds the lowest stream offset and record the consumers still need
+//
+static VOID ScReplayLow(SCREPLAY * Replay, PULONGLONG Offset, PULONGLONG Record)
+{
+	ULONG	i;
+
+	*Offset = Replay->Length;
+	*Record = Replay->Records;
+	for(i = 0; i < SCREPLAY_CONSUMERS; i++)
+	{
+		if(Replay->Consumers[i].ReadSize == 0)
+			continue;
+		if(Replay->Consumers[i].Offset < *Offset)
+			*Offset = Replay->Consumers[i].Offset;
+		if(Replay->Consumers[i].Next < *Record)
+			*Record = Replay->Consumers[i].Next;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScReplayAdd
+//      Keeps a record's payload and arrival for the consumers to be checked
+//      against, dropping what they have all read already
+//
+//  Arguments:
+//      IN  Replay
+//              the replay
+//
+//      IN  Data
+//              the payload given to the port
+//
+//      IN  Length
+//              bytes of it
+//
+//      IN  Arrived
+//              clock when it was given
+//
+//  Return Value:
+//      FALSE if out of memory
+//
+static BOOLEAN ScReplayAdd(SCREPLAY * Replay, const UCHAR * Data, ULONG Length, ULONGLONG Arrived)
+{
+	ULONGLONG	offset;
+	ULONGLONG	record;
+	size_t		keep;
+	size_t		room;
+	void *		grown;
+
+	ScReplayLow(Replay, &offset, &record);
+
+	keep = (size_t)(Replay->Length - offset);
+	if(offset > Replay->Base)
+	{
+		memmove(Replay->Stream, Replay->Stream + (offset - Replay->Base), keep);
+		Replay->Base = offset;
+	}
+	if(keep + Length > Replay->StreamRoom)
+	{
+		for(room = (Replay->StreamRoom != 0) ? Replay->StreamRoom : 65536; room < keep + Length; room *= 2)
+			;
+		if((grown = realloc(Replay->Stream, room)) == NULL)
+			return FALSE;
+		Replay->Stream = grown;
+		Replay->StreamRoom = room;
+	}
+	memcpy(Replay->Stream + keep, Data, Length);
+	Replay->Length += Length;
+
+	keep = (size_t)(Replay->Records - record);
+	if(record > Replay->First)
+	{
+		memmove(Replay->Pending, Replay->Pending + (record - Replay->First), keep * sizeof(SCREPLAY_PENDING));
+		Replay->First = record;
+	}
+	if(keep + 1 > Replay->PendingRoom)
+	{
+		room = (Replay->PendingRoom != 0) ? Replay->PendingRoom * 2 : 1024;
+		if((grown = realloc(Replay->Pending, room * sizeof(SCREPLAY_PENDING))) == NULL)
+			return FALSE;
+		Replay->Pending = grown;
+		Replay->PendingRoom = room;
+	}
+	Replay->Pending[keep].End = Replay->Length;
+	Replay->Pending[keep].Arrived = Arrived;
+	Replay->Records++;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScReplayReadDone
+//      Checks what a consumer read against the stream and times the
+//      records it finished
+//
+static VOID ScReplayReadDone(PSCHOST_CONSUMER Consumer, NTSTATUS Status, const UCHAR * Data, ULONG Length)
+{
+	SCREPLAY_CONSUMER *	consumer;
+	SCREPLAY *			replay;
+	ULONGLONG			now;
+	ULONG				checked;
+	ULONG				i;
+	void *				grown;
+
+	consumer = (SCREPLAY_CONSUMER *)Consumer->Context;
+	replay = consumer->Replay;
+
+	// the read cancelled at the end of the replay is not a failure
+	if(!NT_SUCCESS(Status) && Consumer->Reading)
+		consumer->Failed++;
+
+	checked = Length;
+	if(consumer->Offset + checked > replay->Length)
+	{
+		checked = (ULONG)(replay->Length - consumer->Offset);
+		consumer->Extra += Length - checked;
+	}
+
+	for(i = 0; i < checked; i++)
+		if(Data[i] != replay->Stream[consumer->Offset - replay->Base + i])
+		{
+			if(replay->Verbose && (consumer->Mismatches < SCREPLAY_SHOW_MISMATCHES))
+				printf("%s: byte %llu is %02x, %02x was sent\n", Consumer->Name,
+					consumer->Offset + i, Data[i], replay->Stream[consumer->Offset - replay->Base + i]);
+			consumer->Mismatches++;
+		}
+	consumer->Offset += checked;
+
+	now = SCHostNow();
+	while((consumer->Next < replay->Records) &&
+		(replay->Pending[consumer->Next - replay->First].End <= consumer->Offset))
+	{
+		if(consumer->Latencies == consumer->LatencyRoom)
+		{
+			consumer->LatencyRoom = (consumer->LatencyRoom != 0) ? consumer->LatencyRoom * 2 : 4096;
+			grown = realloc(consumer->Latency, consumer->LatencyRoom * sizeof(ULONGLONG));
+			if(grown == NULL)
+				SCHostFatal("out of memory for latencies");
+			consumer->Latency = grown;
+		}
+		consumer->Latency[consumer->Latencies++] = now - replay->Pending[consumer->Next - replay->First].Arrived;
+		consumer->Next++;
+	}
+}
+
+static int ScReplayCompare(const void * a, const void * b)
+{
+	ULONGLONG	x = *(const ULONGLONG *)a;
+	ULONGLONG	y = *(const ULONGLONG *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+// a percentile of sorted latencies, in microseconds
+static double ScReplayPercentile(const ULONGLONG * Sorted, ULONGLONG Count, double Percent)
+{
+	ULONGLONG	i;
+
+	i = (ULONGLONG)(Percent / 100 * Count);
+	if(i >= Count)
+		i = Count - 1;
+	return Sorted[i] / 10.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScReplayReport
+//      Prints what a consumer saw
+//
+//  Arguments:
+//      IN  Replay
+//              the replay, finished
+//
+//      IN  Consumer
+//              the consumer
+//
+//  Return Value:
+//      nonzero if it did not read the stream exactly
+//
+static int ScReplayReport(SCREPLAY * Replay, SCREPLAY_CONSUMER * Consumer)
+{
+	ULONGLONG *	sorted;
+	ULONGLONG	n;
+
+	printf("%s: %llu reads, %llu bytes, %llu mismatched, %llu extra, %llu short, %llu failed reads\n",
+		Consumer->Host.Name, Consumer->Host.Reads, Consumer->Host.Bytes, Consumer->Mismatches,
+		Consumer->Extra, Replay->Length - Consumer->Offset, Consumer->Failed);
+
+	sorted = Consumer->Latency;
+	n = Consumer->Latencies;
+	if(n != 0)
+	{
+		qsort(sorted, (size_t)n, sizeof(ULONGLONG), ScReplayCompare);
+		printf("%s: latency us over %llu records, p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+			Consumer->Host.Name, n, ScReplayPercentile(sorted, n, 50), ScReplayPercentile(sorted, n, 90),
+			ScReplayPercentile(sorted, n, 99), ScReplayPercentile(sorted, n, 99.9), sorted[n - 1] / 10.0);
+	}
+
+	return (Consumer->Mismatches != 0) || (Consumer->Extra != 0) || (Consumer->Offset != Replay->Length) ||
+		(Consumer->Failed != 0);
+}
+
+static void ScReplayUsage(void)
+{
+	fprintf(stderr, "usage: screplay [-s speed] [-r] [-f bytes] [-c bytes] [-t seconds] [-n records]\n");
+	fprintf(stderr, "                [-p Name=Value]... [-v] capture\n");
+}
+
+int main(int argc, char ** argv)
+{
+	static SCREPLAY		replay;
+	SCHOST				host;
+	SCCAP_FILE			capfile;
+	SCCAP_CURSOR		cursor;
+	SCCAP_RECORD		record;
+	SCREPLAY_CONSUMER *	consumer;
+	PSCHOST_CONSUMER	owner;
+	SERIALCLONE_PORT_STATE	state;
+	PDEVICE_OBJECT		device;
+	PCSTR				path;
+	char *				value;
+	double				speed;
+	double				skip;
+	ULONGLONG			limit;
+	ULONGLONG			start;
+	ULONGLONG			due;
+	ULONGLONG			sent;
+	ULONGLONG			transmitted;
+	ULONGLONG			truncated;
+	ULONG				leaks;
+	struct timespec		wallStart;
+	struct timespec		wallEnd;
+	double				wall;
+	BOOLEAN				real;
+	NTSTATUS			status;
+	int					result;
+	int					i;
+
+	speed = 1;
+	real = FALSE;
+	skip = 0;
+	limit = ~(ULONGLONG)0;
+	path = NULL;
+	replay.Consumers[0].ReadSize = 256;
+	replay.Consumers[1].ReadSize = 256;
+
+	for(i = 1; i < argc; i++)
+	{
+		if((argv[i][0] != '-') && (path == NULL))
+			path = argv[i];
+		else if(!strcmp(argv[i], "-r"))
+			real = TRUE;
+		else if(!strcmp(argv[i], "-v"))
+			replay.Verbose = TRUE;
+		else if(i + 1 == argc)
+			break;
+		else if(!strcmp(argv[i], "-s"))
+			speed = atof(argv[++i]);
+		else if(!strcmp(argv[i], "-f"))
+			replay.Consumers[0].ReadSize = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-c"))
+			replay.Consumers[1].ReadSize = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-t"))
+			skip = atof(argv[++i]);
+		else if(!strcmp(argv[i], "-n"))
+			limit = strtoull(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-p") && ((value = strchr(argv[i + 1], '=')) != NULL))
+		{
+			*value++ = 0;
+			if(!NT_SUCCESS(SCHostSetParameter(argv[++i], (ULONG)strtoul(value, NULL, 0))))
+				return 1;
+		}
+		else
+			break;
+	}
+
+	if((i != argc) || (path == NULL) || (speed <= 0) || (skip < 0) ||
+		((replay.Consumers[0].ReadSize == 0) && (replay.Consumers[1].ReadSize == 0)))
+	{
+		ScReplayUsage();
+		return 2;
+	}
+
+	if(SCCapOpen(&capfile, path) != SCCAP_OK)
+	{
+		fprintf(stderr, "screplay: can't read %s\n", path);
+		return 1;
+	}
+
+	// the first record replayed is the start of the replay's time, and
+	// the clock's boot so the driver's system time matches the recording
+	SCCapRewind(&capfile, &cursor);
+	if(skip != 0)
+		SCCapSeek(&capfile, capfile.Header.StartTime + (ULONGLONG)(skip * 10000000), &cursor);
+	result = SCCapNext(&capfile, &cursor, &record);
+	if(result != SCCAP_OK)
+	{
+		fprintf(stderr, "screplay: no records in %s%s\n", path, (skip != 0) ? " from there" : "");
+		SCCapClose(&capfile);
+		return 1;
+	}
+	start = record.Time;
+
+	SCHostClockInit(real ? SCHOST_CLOCK_REAL : SCHOST_CLOCK_VIRTUAL, start);
+	SCHostSetDebugOutput(replay.Verbose);
+
+	status = SCHostLoad(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "screplay: SerialClone didn't load, status %x\n", status);
+		return 1;
+	}
+
+	for(i = 0; i < SCREPLAY_CONSUMERS; i++)
+	{
+		consumer = &replay.Consumers[i];
+		consumer->Replay = &replay;
+		if(consumer->ReadSize == 0)
+			continue;
+
+		device = (i == 0) ? host.Filter : host.Clone;
+		status = SCHostConsumerOpen(&consumer->Host, (i == 0) ? "filter" : "clone", device,
+			consumer->ReadSize, ScReplayReadDone, consumer);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "screplay: can't open the %s, status %x\n", (i == 0) ? "filter" : "clone", status);
+			return 1;
+		}
+		SCHostConsumerStart(&consumer->Host);
+	}
+
+	// the filter's consumer opened first, it owns the port
+	owner = (replay.Consumers[0].ReadSize != 0) ? &replay.Consumers[0].Host : NULL;
+	replay.TxHash = SCREPLAY_HASH_BASIS;
+	replay.PortTxHash = SCREPLAY_HASH_BASIS;
+	host.Port->Transmit = ScReplayTransmit;
+	host.Port->TransmitContext = &replay;
+	status = ScReplayTimeouts((owner != NULL) ? owner : &replay.Consumers[1].Host);
+	if(NT_SUCCESS(status) && (owner != NULL))
+		status = ScReplaySettings(owner, &capfile.Header);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "screplay: the port's settings weren't taken, status %x\n", status);
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &wallStart);
+
+	sent = 0;
+	transmitted = 0;
+	truncated = 0;
+	for(; (result == SCCAP_OK) && (sent < limit); result = SCCapNext(&capfile, &cursor, &record))
+	{
+		if(record.Kind & SCCAP_RECORD_TRUNCATED)
+			truncated++;
+		if(record.Length == 0)
+			continue;
+
+		due = (ULONGLONG)((record.Time - start) / speed);
+		SCHostRunUntil(due);
+
+		if(record.Kind & SCCAP_RECORD_TX)
+		{
+			transmitted++;
+			if(owner == NULL)
+				continue;
+			replay.TxBytes += record.Length;
+			replay.TxHash = ScReplayHash(replay.TxHash, record.Data, record.Length);
+			SCHostConsumerWrite(owner, record.Data, record.Length);
+			SCHostRunPending();
+			continue;
+		}
+
+		if(!ScReplayAdd(&replay, record.Data, record.Length, SCHostNow()))
+		{
+			fprintf(stderr, "screplay: out of memory\n");
+			return 1;
+		}
+		SCSimPortReceive(host.Port, record.Data, record.Length);
+		SCHostRunPending();
+		sent++;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+	wall = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+
+	if(result == SCCAP_ERROR_TRUNCATED)
+		fprintf(stderr, "screplay: %s ends in a cut short record\n", path);
+
+	// what is still waiting at the port comes back cancelled, with what
+	// the driver had buffered for it
+	for(i = 0; i < SCREPLAY_CONSUMERS; i++)
+		if(replay.Consumers[i].ReadSize != 0)
+			SCHostConsumerStop(&replay.Consumers[i].Host);
+	SCSimPortFlush(host.Port);
+	SCHostRunPending();
+
+	// paced writes go as earlier ones complete, let them all out
+	while((owner != NULL) && (owner->WritesPending != 0) && SCHostNextDue(&due))
+		SCHostRunUntil(due);
+
+	memset(&state, 0, sizeof(state));
+	state.Size = sizeof(state);
+	device = (owner != NULL) ? owner->DeviceObject : host.Clone;
+	status = SCHostIoctl(device, (owner != NULL) ? &owner->FileObject : &replay.Consumers[1].Host.FileObject,
+		IOCTL_SERIALCLONE_GET_PORT_STATE, &state, sizeof(state), &state, sizeof(state), NULL);
+
+	printf("%llu records, %llu bytes replayed over %.3f s in %.3f s wall, %.0f records/s, %.2f MB/s\n",
+		sent, replay.Length, SCHostNow() / 1e7, wall, (wall > 0) ? sent / wall : 0.0,
+		(wall > 0) ? replay.Length / wall / 1e6 : 0.0);
+	if((transmitted != 0) || (truncated != 0))
+		printf("%llu transmitted records %s, %llu truncated records replayed as far as kept\n",
+			transmitted, (owner != NULL) ? "written" : "skipped, no owner", truncated);
+	printf("port: %llu reads, %llu pended, %llu cancelled, %llu bytes dropped, %llu written, %llu ioctls\n",
+		host.Port->Stats.Reads, host.Port->Stats.ReadsPended, host.Port->Stats.ReadsCancelled,
+		host.Port->Stats.BytesDropped, host.Port->Stats.BytesWritten, host.Port->Stats.Ioctls);
+
+	result = 0;
+	if(owner != NULL)
+	{
+		printf("filter: %llu writes, %llu bytes, %llu failed writes, %llu of %llu bytes left the port%s\n",
+			owner->Writes, owner->BytesWritten, owner->WritesFailed, replay.PortTxBytes, replay.TxBytes,
+			(replay.PortTxHash == replay.TxHash) ? "" : ", not as written");
+		if((owner->WritesFailed != 0) || (owner->WritesPending != 0) ||
+			(replay.PortTxBytes != replay.TxBytes) || (replay.PortTxHash != replay.TxHash))
+			result = 1;
+	}
+
+	if(!NT_SUCCESS(status))
+	{
+		printf("port state: status %x\n", status);
+		result = 1;
+	}
+	else
+	{
+		printf("port state: valid %x, %u baud, %u data bits\n", state.Valid, state.BaudRate, state.WordLength);
+		if((state.BaudRate != host.Port->BaudRate.BaudRate) ||
+			(state.WordLength != host.Port->LineControl.WordLength))
+			result = 1;
+	}
+
+	for(i = 0; i < SCREPLAY_CONSUMERS; i++)
+	{
+		consumer = &replay.Consumers[i];
+		if(consumer->ReadSize == 0)
+			continue;
+
+		if(ScReplayReport(&replay, consumer))
+			result = 1;
+		SCHostConsumerClose(&consumer->Host);
+		free(consumer->Latency);
+	}
+
+	status = SCHostUnload(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "screplay: SerialClone didn't unload, status %x\n", status);
+		result = 1;
+	}
+	else if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		printf("%u things left behind by the driver\n", leaks);
+		result = 1;
+	}
+
+	free(replay.Stream);
+	free(replay.Pending);
+	SCCapClose(&capfile);
+	return result;
+}
@@ -0,0 +1,666 @@
+// scsimbench.c
+//
+// Runs SerialClone's read strategies against a modelled line: the driver
+// is loaded on a simulated port with a UART, something at the far end
+// sends on it, and the filter's consumer, the port's owner, reads it the
+// way an application would with one set of timeouts and read size; the
+// clone's consumer reads alongside if asked for. For every baud rate,
+// read size and strategy in the sweep the driver is loaded afresh and
+// run for the same simulated time, so the numbers are the same run to
+// run and machine to machine.
+//
+//	scsimbench [options]
+//
+//	-b B,...		baud rates, 9600,115200,921600,3000000 by default
+//	-r N,...		bytes per filter read, 1,16,256,4096 by default
+//	-m M,...		read strategies, any by default:
+//					any			return with whatever has come, or empty
+//								after a second
+//					interval	wait until full or the line pauses -i ms
+//					full		wait until full
+//					now			return at once, and when empty poll
+//								again -i ms later
+//	-i MS			the interval, and the poll, 1 by default
+//	-c N			bytes per clone read, 0 for no clone consumer, the default
+//	-P payload		stream, nmea or binary; stream by default
+//	-z N			bytes a frame, stream and binary, 64 by default
+//	-k N			frames a burst, 1 by default
+//	-T US			from a burst to the next, 0 for as soon as the line is free
+//	-J US			bursts late by up to this, 0 by default
+//	-x				Poisson bursts, -T between them on average
+//	-F N			the UART's FIFO depth, 16 by default
+//	-G N			its receive trigger, 14 by default
+//	-L US			the interrupt's latency, 20 by default
+//	-j US			up to this much more, 10 by default
+//	-d S			simulated seconds a run, 2 by default
+//	-S N			the seed, 1 by default
+//	-p Name=Value	a driver parameter, as under its Parameters key
+//	-v				show the driver's debug output
+//
+// A line per consumer per run: what it read a simulated second and as a
+// share of what the line can carry, reads completed a second and the
+// bytes a read, the latency from a frame's last character reaching the
+// UART to the read with it done, the port's timed out reads, interrupts,
+// overruns and bytes dropped, the bytes sent the consumer never got, left
+// in the driver or lost, whether it read exactly what was sent, and the
+// host's time for the run. Latencies are left out of a run
+// that lost anything, frames can't be told apart there.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "schost.h"
+#include "simsource.h"
+
+#define SCBENCH_CONSUMERS		2
+#define SCBENCH_LIST_MAX		16
+#define SCBENCH_PARAMETERS		16
+#define SCBENCH_EMPTY_TIMEOUT	1000	// ms an any read waits with nothing come
+
+// SCBENCH_RUN.Mode
+#define SCBENCH_ANY				0
+#define SCBENCH_INTERVAL		1
+#define SCBENCH_FULL			2
+#define SCBENCH_NOW				3
+
+static const char * ScBenchModes[] = { "any", "interval", "full", "now" };
+static const char * ScBenchPayloads[] = { "nmea", "binary", "stream" };
+
+typedef struct _SCBENCH_CONSUMER
+{
+	SCHOST_CONSUMER		Host;
+	struct _SCBENCH *	Bench;
+	ULONG				ReadSize;
+	ULONGLONG			Offset;			// stream bytes read so far
+	ULONGLONG			InTime;			// by the end of the run's time
+	ULONGLONG			ReadsInTime;
+	ULONG				Hash;
+	ULONGLONG			Next;			// index of the next frame to complete
+	ULONGLONG *			Latency;		// one per frame completed in time
+	ULONGLONG			Latencies;
+	ULONGLONG			LatencyRoom;
+	ULONGLONG			Failed;			// reads completed with an error in time
+	ULONGLONG			Empty;			// and with nothing
+
+	// polling, the now strategy
+	KTIMER				Poll;
+	KDPC				PollDpc;
+} SCBENCH_CONSUMER;
+
+// a frame on the line, for latencies
+typedef struct _SCBENCH_FRAME
+{
+	ULONGLONG			End;			// stream offset past its last byte
+	ULONGLONG			Arrival;		// clock it was all at the UART
+} SCBENCH_FRAME;
+
+typedef struct _SCBENCH
+{
+	SCBENCH_CONSUMER	Consumers[SCBENCH_CONSUMERS];
+	ULONG				Mode;
+	ULONG				Interval;		// ms
+	BOOLEAN				Running;		// in the run's time
+	BOOLEAN				Reading;		// and after, until the line is drained
+
+	SCBENCH_FRAME *		Frames;
+	ULONGLONG			FrameCount;
+	size_t				FrameRoom;
+} SCBENCH;
+
+typedef struct _SCBENCH_PARAMETER
+{
+	char *				Name;
+	ULONG				Value;
+} SCBENCH_PARAMETER;
+
+// the frame the source just put on the line
+static VOID ScBenchFrameSent(PSCSIMSOURCE Source, ULONGLONG End, ULONGLONG Arrival)
+{
+	SCBENCH *	bench = (SCBENCH *)Source->Context;
+	void *		grown;
+
+	if(bench->FrameCount == bench->FrameRoom)
+	{
+		bench->FrameRoom = (bench->FrameRoom != 0) ? bench->FrameRoom * 2 : 4096;
+		grown = realloc(bench->Frames, bench->FrameRoom * sizeof(SCBENCH_FRAME));
+		if(grown == NULL)
+			SCHostFatal("out of memory for frames");
+		bench->Frames = grown;
+	}
+	bench->Frames[bench->FrameCount].End = End;
+	bench->Frames[bench->FrameCount].Arrival = Arrival;
+	bench->FrameCount++;
+}
+
+// the poll timer's DPC, the now strategy reads again
+static VOID ScBenchPoll(PKDPC Dpc, PVOID Context, PVOID Argument1, PVOID Argument2)
+{
+	SCBENCH_CONSUMER *	consumer = (SCBENCH_CONSUMER *)Context;
+
+	if(consumer->Bench->Reading)
+		SCHostConsumerStart(&consumer->Host);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScBenchReadDone
+//      Hashes what a consumer read and times the frames it finished
+//
+static VOID ScBenchReadDone(PSCHOST_CONSUMER Consumer, NTSTATUS Status, const UCHAR * Data, ULONG Length)
+{
+	SCBENCH_CONSUMER *	consumer;
+	SCBENCH *			bench;
+	LARGE_INTEGER		dueTime;
+	ULONGLONG			now;
+	void *				grown;
+
+	consumer = (SCBENCH_CONSUMER *)Consumer->Context;
+	bench = consumer->Bench;
+
+	consumer->Hash = SCSimSourceHash(consumer->Hash, Data, Length);
+	consumer->Offset += Length;
+
+	// an application polling sleeps on an empty read before the next
+	if((Length == 0) && (bench->Mode == SCBENCH_NOW) && bench->Reading)
+	{
+		SCHostConsumerStop(Consumer);
+		dueTime.QuadPart = -(LONGLONG)bench->Interval * 10000;
+		KeSetTimer(&consumer->Poll, dueTime, &consumer->PollDpc);
+	}
+	if(!bench->Running)
+		return;
+
+	consumer->InTime = consumer->Offset;
+	consumer->ReadsInTime++;
+	if(!NT_SUCCESS(Status))
+		consumer->Failed++;
+
+	now = SCHostNow();
+	while((consumer->Next < bench->FrameCount) && (bench->Frames[consumer->Next].End <= consumer->Offset))
+	{
+		if(consumer->Latencies == consumer->LatencyRoom)
+		{
+			consumer->LatencyRoom = (consumer->LatencyRoom != 0) ? consumer->LatencyRoom * 2 : 4096;
+			grown = realloc(consumer->Latency, consumer->LatencyRoom * sizeof(ULONGLONG));
+			if(grown == NULL)
+				SCHostFatal("out of memory for latencies");
+			consumer->Latency = grown;
+		}
+		consumer->Latency[consumer->Latencies++] = now - bench->Frames[consumer->Next].Arrival;
+		consumer->Next++;
+	}
+	if(Length == 0)
+		consumer->Empty++;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScBenchSettings
+//      Sets the port up through the filter as the owner's application
+//      would: the baud rate, 8N1 and the strategy's timeouts
+//
+//  Arguments:
+//      IN  Owner
+//              the filter's consumer
+//
+//      IN  Baud
+//              the baud rate
+//
+//      IN  Mode
+//              SCBENCH_xxx
+//
+//      IN  Interval
+//              ms, the interval strategy's
+//
+//  Return Value:
+//      NT status code
+//
+static NTSTATUS ScBenchSettings(PSCHOST_CONSUMER Owner, ULONG Baud, ULONG Mode, ULONG Interval)
+{
+	SERIAL_BAUD_RATE	baudRate;
+	SERIAL_LINE_CONTROL	lineControl;
+	SERIAL_TIMEOUTS		timeouts;
+	NTSTATUS			status;
+
+	baudRate.BaudRate = Baud;
+	status = SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_BAUD_RATE,
+		&baudRate, sizeof(baudRate), NULL, 0, NULL);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	lineControl.StopBits = STOP_BIT_1;
+	lineControl.Parity = NO_PARITY;
+	lineControl.WordLength = 8;
+	status = SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_LINE_CONTROL,
+		&lineControl, sizeof(lineControl), NULL, 0, NULL);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	memset(&timeouts, 0, sizeof(timeouts));
+	switch(Mode)
+	{
+	case SCBENCH_ANY:
+		timeouts.ReadIntervalTimeout = MAXULONG;
+		timeouts.ReadTotalTimeoutMultiplier = MAXULONG;
+		timeouts.ReadTotalTimeoutConstant = SCBENCH_EMPTY_TIMEOUT;
+		break;
+	case SCBENCH_INTERVAL:
+		timeouts.ReadIntervalTimeout = Interval;
+		break;
+	case SCBENCH_NOW:
+		timeouts.ReadIntervalTimeout = MAXULONG;
+		break;
+	}
+	return SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_TIMEOUTS,
+		&timeouts, sizeof(timeouts), NULL, 0, NULL);
+}
+
+static int ScBenchCompare(const void * a, const void * b)
+{
+	ULONGLONG	x = *(const ULONGLONG *)a;
+	ULONGLONG	y = *(const ULONGLONG *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+// a percentile of sorted latencies, in microseconds
+static double ScBenchPercentile(const ULONGLONG * Sorted, ULONGLONG Count, double Percent)
+{
+	ULONGLONG	i;
+
+	i = (ULONGLONG)(Percent / 100 * Count);
+	if(i >= Count)
+		i = Count - 1;
+	return Sorted[i] / 10.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScBenchRun
+//      Loads the driver, runs one point of the sweep and prints its lines
+//
+//  Arguments:
+//      IN  Bench
+//              the consumers' read sizes, the strategy and the interval set
+//
+//      IN  Baud
+//              the baud rate
+//
+//      IN  Source
+//              what the far end sends
+//
+//      IN  Line
+//              the UART
+//
+//      IN  Duration
+//              100ns to run for
+//
+//      IN  Parameters, ParameterCount
+//              the driver's parameters
+//
+//  Return Value:
+//      0, 1 if a consumer lost or garbled what was sent without anything
+//      having been dropped on the way, or -1 if the run couldn't be set up
+//
+static int ScBenchRun(SCBENCH * Bench, ULONG Baud, const SCSIMSOURCE_CONFIG * Source,
+	const SCSIMPORT_LINE * Line, ULONGLONG Duration, const SCBENCH_PARAMETER * Parameters,
+	ULONG ParameterCount)
+{
+	static SCSIMSOURCE	source;
+	SCHOST				host;
+	SCBENCH_CONSUMER *	consumer;
+	SCSIMPORT_STATS		stats;
+	ULONGLONG			due;
+	ULONGLONG			n;
+	ULONG				leaks;
+	struct timespec		wallStart;
+	struct timespec		wallEnd;
+	double				wall;
+	double				seconds;
+	double				capacity;
+	char				p50[16];
+	char				p99[16];
+	BOOLEAN				lost;
+	BOOLEAN				exact;
+	NTSTATUS			status;
+	int					result;
+	ULONG				i;
+
+	clock_gettime(CLOCK_MONOTONIC, &wallStart);
+
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+	for(i = 0; i < ParameterCount; i++)
+		if(!NT_SUCCESS(SCHostSetParameter(Parameters[i].Name, Parameters[i].Value)))
+			return -1;
+
+	status = SCHostLoad(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scsimbench: SerialClone didn't load, status %x\n", status);
+		return -1;
+	}
+	status = SCSimPortSetLine(host.Port, Line);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scsimbench: the UART wasn't taken, status %x\n", status);
+		return -1;
+	}
+
+	Bench->FrameCount = 0;
+	for(i = 0; i < SCBENCH_CONSUMERS; i++)
+	{
+		consumer = &Bench->Consumers[i];
+		consumer->Bench = Bench;
+		consumer->Offset = 0;
+		consumer->InTime = 0;
+		consumer->ReadsInTime = 0;
+		consumer->Hash = SCSIMSOURCE_HASH_BASIS;
+		consumer->Next = 0;
+		consumer->Latencies = 0;
+		consumer->Failed = 0;
+		consumer->Empty = 0;
+		KeInitializeTimer(&consumer->Poll);
+		KeInitializeDpc(&consumer->PollDpc, ScBenchPoll, consumer);
+		if(consumer->ReadSize == 0)
+			continue;
+
+		status = SCHostConsumerOpen(&consumer->Host, (i == 0) ? "filter" : "clone",
+			(i == 0) ? host.Filter : host.Clone, consumer->ReadSize, ScBenchReadDone, consumer);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scsimbench: can't open the %s, status %x\n", (i == 0) ? "filter" : "clone", status);
+			return -1;
+		}
+	}
+
+	// the filter's consumer opened first, it owns the port
+	status = ScBenchSettings(&Bench->Consumers[0].Host, Baud, Bench->Mode, Bench->Interval);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scsimbench: the port's settings weren't taken, status %x\n", status);
+		return -1;
+	}
+
+	Bench->Running = TRUE;
+	Bench->Reading = TRUE;
+	for(i = 0; i < SCBENCH_CONSUMERS; i++)
+		if(Bench->Consumers[i].ReadSize != 0)
+			SCHostConsumerStart(&Bench->Consumers[i].Host);
+	status = SCSimSourceStart(&source, host.Port, Source, ScBenchFrameSent, Bench);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scsimbench: the source didn't start, status %x\n", status);
+		return -1;
+	}
+
+	SCHostRunUntil(Duration);
+	stats = host.Port->Stats;
+	Bench->Running = FALSE;
+
+	// let what is on the line come in and the reads finish with it
+	SCSimSourceStop(&source);
+	due = SCSimPortLineIdle(host.Port);
+	SCHostRunUntil(((due > SCHostNow()) ? due : SCHostNow()) + (ULONGLONG)SCBENCH_EMPTY_TIMEOUT * 10000);
+	Bench->Reading = FALSE;
+	for(i = 0; i < SCBENCH_CONSUMERS; i++)
+	{
+		KeCancelTimer(&Bench->Consumers[i].Poll);
+		if(Bench->Consumers[i].ReadSize != 0)
+			SCHostConsumerStop(&Bench->Consumers[i].Host);
+	}
+	SCSimPortFlush(host.Port);
+	SCHostRunPending();
+
+	clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+	wall = (wallEnd.tv_sec - wallStart.tv_sec) + (wallEnd.tv_nsec - wallStart.tv_nsec) / 1e9;
+
+	result = 0;
+	seconds = Duration / 1e7;
+	capacity = Baud / 10.0;
+	lost = (source.Lost != 0) || (host.Port->Stats.Overruns != 0) || (host.Port->Stats.BytesDropped != 0);
+	for(i = 0; i < SCBENCH_CONSUMERS; i++)
+	{
+		consumer = &Bench->Consumers[i];
+		if(consumer->ReadSize == 0)
+			continue;
+
+		exact = (consumer->Offset == source.Bytes) && (consumer->Hash == source.Hash);
+		if(!exact && !lost)
+			result = 1;
+
+		n = consumer->Latencies;
+		strcpy(p50, "-");
+		strcpy(p99, "-");
+		if(!lost && (n != 0))
+		{
+			qsort(consumer->Latency, (size_t)n, sizeof(ULONGLONG), ScBenchCompare);
+			snprintf(p50, sizeof(p50), "%.1f", ScBenchPercentile(consumer->Latency, n, 50));
+			snprintf(p99, sizeof(p99), "%.1f", ScBenchPercentile(consumer->Latency, n, 99));
+		}
+
+		printf("%-8s %7u %5u %-6s %9.0f %5.1f %8.0f %7.1f %9s %9s %6llu %7llu %6llu %6llu %6lld %-5s %7.1f\n",
+			ScBenchModes[Bench->Mode], Baud, consumer->ReadSize, consumer->Host.Name,
+			consumer->InTime / seconds, consumer->InTime / seconds / capacity * 100,
+			consumer->ReadsInTime / seconds,
+			(consumer->ReadsInTime != 0) ? (double)consumer->InTime / consumer->ReadsInTime : 0.0,
+			p50, p99, stats.ReadsTimedOut, stats.Interrupts, stats.Overruns, stats.BytesDropped,
+			(LONGLONG)(source.Bytes - consumer->Offset), exact ? "yes" : "no", wall * 1000);
+
+		SCHostConsumerClose(&consumer->Host);
+	}
+
+	status = SCHostUnload(&host);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scsimbench: SerialClone didn't unload, status %x\n", status);
+		result = 1;
+	}
+	else if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		printf("%u things left behind by the driver\n", leaks);
+		result = 1;
+	}
+	return result;
+}
+
+// a comma separated list of numbers
+static ULONG ScBenchList(char * Text, ULONG * List)
+{
+	ULONG	count;
+	char *	next;
+
+	for(count = 0; (count < SCBENCH_LIST_MAX) && (*Text != 0); count++)
+	{
+		List[count] = (ULONG)strtoul(Text, &next, 0);
+		if((next == Text) || ((*next != ',') && (*next != 0)))
+			return 0;
+		Text = (*next == ',') ? next + 1 : next;
+	}
+	return (*Text == 0) ? count : 0;
+}
+
+// and of names, their indexes in Names
+static ULONG ScBenchNames(char * Text, const char ** Names, ULONG NameCount, ULONG * List)
+{
+	ULONG	count;
+	ULONG	i;
+	char *	name;
+
+	count = 0;
+	for(name = strtok(Text, ","); name != NULL; name = strtok(NULL, ","))
+	{
+		for(i = 0; (i < NameCount) && strcmp(name, Names[i]); i++)
+			;
+		if((i == NameCount) || (count == SCBENCH_LIST_MAX))
+			return 0;
+		List[count++] = i;
+	}
+	return count;
+}
+
+static void ScBenchUsage(void)
+{
+	fprintf(stderr, "usage: scsimbench [-b bauds] [-r bytes] [-m any|interval|full|now,...] [-i ms] [-c bytes]\n");
+	fprintf(stderr, "                  [-P stream|nmea|binary] [-z bytes] [-k frames] [-T us] [-J us] [-x]\n");
+	fprintf(stderr, "                  [-F depth] [-G trigger] [-L us] [-j us] [-d seconds] [-S seed]\n");
+	fprintf(stderr, "                  [-p Name=Value]... [-v]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	static SCBENCH		bench;
+	SCBENCH_PARAMETER	parameters[SCBENCH_PARAMETERS];
+	SCSIMSOURCE_CONFIG	source;
+	SCSIMPORT_LINE		line;
+	ULONG				bauds[SCBENCH_LIST_MAX] = { 9600, 115200, 921600, 3000000 };
+	ULONG				sizes[SCBENCH_LIST_MAX] = { 1, 16, 256, 4096 };
+	ULONG				modes[SCBENCH_LIST_MAX] = { SCBENCH_ANY };
+	ULONG				payload[1];
+	ULONG				baudCount;
+	ULONG				sizeCount;
+	ULONG				modeCount;
+	ULONG				parameterCount;
+	ULONG				b;
+	ULONG				r;
+	ULONG				m;
+	char *				value;
+	char				frame[32];
+	double				duration;
+	BOOLEAN				verbose;
+	BOOLEAN				bad;
+	int					result;
+	int					run;
+	int					i;
+
+	baudCount = 4;
+	sizeCount = 4;
+	modeCount = 1;
+	parameterCount = 0;
+	duration = 2;
+	verbose = FALSE;
+	bad = FALSE;
+	bench.Interval = 1;
+
+	memset(&source, 0, sizeof(source));
+	source.Payload = SCSIMSOURCE_STREAM;
+	source.FrameSize = 64;
+	source.Frames = 1;
+	source.Seed = 1;
+
+	memset(&line, 0, sizeof(line));
+	line.FifoDepth = 16;
+	line.RxTrigger = 14;
+	line.Latency = 200;
+	line.Jitter = 100;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(!strcmp(argv[i], "-x"))
+			source.Poisson = TRUE;
+		else if(!strcmp(argv[i], "-v"))
+			verbose = TRUE;
+		else if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-b"))
+			bad = (baudCount = ScBenchList(argv[++i], bauds)) == 0;
+		else if(!strcmp(argv[i], "-r"))
+			bad = (sizeCount = ScBenchList(argv[++i], sizes)) == 0;
+		else if(!strcmp(argv[i], "-m"))
+			bad = (modeCount = ScBenchNames(argv[++i], ScBenchModes, 4, modes)) == 0;
+		else if(!strcmp(argv[i], "-P"))
+		{
+			bad = ScBenchNames(argv[++i], ScBenchPayloads, 3, payload) != 1;
+			source.Payload = payload[0];
+		}
+		else if(!strcmp(argv[i], "-i"))
+			bench.Interval = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-c"))
+			bench.Consumers[1].ReadSize = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-z"))
+			source.FrameSize = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-k"))
+			source.Frames = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-T"))
+			source.Period = (ULONG)strtoul(argv[++i], NULL, 0) * 10;
+		else if(!strcmp(argv[i], "-J"))
+			source.Jitter = (ULONG)strtoul(argv[++i], NULL, 0) * 10;
+		else if(!strcmp(argv[i], "-F"))
+			line.FifoDepth = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-G"))
+			line.RxTrigger = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-L"))
+			line.Latency = (ULONG)strtoul(argv[++i], NULL, 0) * 10;
+		else if(!strcmp(argv[i], "-j"))
+			line.Jitter = (ULONG)strtoul(argv[++i], NULL, 0) * 10;
+		else if(!strcmp(argv[i], "-d"))
+			duration = atof(argv[++i]);
+		else if(!strcmp(argv[i], "-S"))
+			source.Seed = strtoull(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-p") && ((value = strchr(argv[i + 1], '=')) != NULL) &&
+			(parameterCount < SCBENCH_PARAMETERS))
+		{
+			*value++ = 0;
+			parameters[parameterCount].Name = argv[++i];
+			parameters[parameterCount].Value = (ULONG)strtoul(value, NULL, 0);
+			parameterCount++;
+		}
+		else
+			bad = TRUE;
+	}
+
+	for(b = 0; b < baudCount; b++)
+		if(bauds[b] == 0)
+			bad = TRUE;
+	for(r = 0; r < sizeCount; r++)
+		if(sizes[r] == 0)
+			bad = TRUE;
+	if(bad || (duration <= 0) || (bench.Interval == 0) || (source.Frames == 0) ||
+		(line.FifoDepth == 0) || (line.FifoDepth > SCSIMPORT_FIFO_MAX) ||
+		(line.RxTrigger == 0) || (line.RxTrigger > line.FifoDepth) ||
+		((source.Payload != SCSIMSOURCE_NMEA) && ((source.FrameSize == 0) || (source.FrameSize > SCSIMSOURCE_FRAME_MAX))))
+	{
+		ScBenchUsage();
+		return 2;
+	}
+
+	// the UART's jitter and what is sent are the seed's, apart
+	line.Seed = source.Seed * 2 + 1;
+	SCHostSetDebugOutput(verbose);
+
+	if(source.Payload == SCSIMSOURCE_NMEA)
+		snprintf(frame, sizeof(frame), "fixes");
+	else
+		snprintf(frame, sizeof(frame), "%u byte frames", source.FrameSize);
+	printf("# %s %s, %u a burst, every %u us%s, jitter %u us; "
+		"UART %u deep, trigger %u, latency %u+%u us; %.3g s a run, seed %llu\n",
+		ScBenchPayloads[source.Payload], frame, source.Frames, source.Period / 10,
+		source.Poisson ? " on average" : "", source.Jitter / 10, line.FifoDepth, line.RxTrigger,
+		line.Latency / 10, line.Jitter / 10, duration, source.Seed);
+	printf("%-8s %7s %5s %-6s %9s %5s %8s %7s %9s %9s %6s %7s %6s %6s %6s %-5s %7s\n",
+		"strategy", "baud", "read", "reader", "bytes/s", "line%", "reads/s", "B/read",
+		"p50 us", "p99 us", "tmo", "intr", "ovrun", "drop", "short", "exact", "wall ms");
+
+	result = 0;
+	for(m = 0; m < modeCount; m++)
+		for(b = 0; b < baudCount; b++)
+			for(r = 0; r < sizeCount; r++)
+			{
+				bench.Mode = modes[m];
+				bench.Consumers[0].ReadSize = sizes[r];
+				run = ScBenchRun(&bench, bauds[b], &source, &line, (ULONGLONG)(duration * 1e7),
+					parameters, parameterCount);
+				if(run < 0)
+					return 1;
+				if(run != 0)
+					result = 1;
+			}
+
+	free(bench.Frames);
+	for(i = 0; i < SCBENCH_CONSUMERS; i++)
+		free(bench.Consumers[i].Latency);
+	return result;
+}
@@ -0,0 +1,512 @@
+// scthru.c
+//
+// Measures what SerialClone's read path costs end to end: the driver is
+// loaded on N simulated ports with a UART each, something at the far end
+// of every line sends as fast as it takes, and on each port the filter's
+// consumer, the port's owner, and the clone's read it with the same read
+// size, returning with whatever has come. The driver gives a port one
+// clone, so a run with N clones is N ports under the one driver, 2N
+// consumers reading through SerialCloneReadDispatch and SCReadComplete
+// at once. For every port count, baud rate and read size in the sweep
+// the driver is loaded afresh and run for the same simulated time.
+//
+//	scthru [options]
+//
+//	-n N,...		clones, each on a port of its own, 1,2,4,8 by default
+//	-b B,...		baud rates, 115200,921600,3000000 by default
+//	-r N,...		bytes a read asks for, 16,256,4096 by default
+//	-d S			simulated seconds a run, 1 by default
+//	-R N			runs of each point, the least CPU time kept, 5 by default
+//	-S N			the seed, 1 by default
+//	-p Name=Value	a driver parameter, as under its Parameters key
+//	-v				show the driver's debug output
+//
+// A tab separated line per run, after a line naming the columns: the
+// clones, baud rate and read size; the bytes every consumer read
+// together a simulated second and each one's share of what its line can
+// carry; the reads consumers had completed and the reads the driver sent
+// down to the ports, a simulated second, and the two together; the
+// host's CPU time for the run's simulated time, for each MB the
+// consumers read and as IRPs for each CPU second; overruns and bytes the
+// ports dropped, and whether every consumer read exactly what was sent.
+// Bytes and IRPs a second are the simulation's and the same run to run
+// and machine to machine; the CPU time is the whole harness's, the
+// simulated UARTs and the shim along with the driver, so it is for
+// comparing one build of the driver with another on the same machine.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "schost.h"
+#include "simsource.h"
+
+#define SCTHRU_PORTS_MAX		16
+#define SCTHRU_CONSUMERS		2		// the filter's and the clone's, on each port
+#define SCTHRU_LIST_MAX			16
+#define SCTHRU_PARAMETERS		16
+#define SCTHRU_EMPTY_TIMEOUT	1000	// ms a read waits with nothing come
+
+typedef struct _SCTHRU_CONSUMER
+{
+	SCHOST_CONSUMER			Host;
+	struct _SCTHRU *		Thru;
+	ULONGLONG				Offset;			// stream bytes read so far
+	ULONG					Hash;
+	ULONGLONG				InTime;			// by the end of the run's time
+	ULONGLONG				ReadsInTime;
+} SCTHRU_CONSUMER;
+
+typedef struct _SCTHRU
+{
+	SCHOST					Hosts[SCTHRU_PORTS_MAX];
+	SCSIMSOURCE				Sources[SCTHRU_PORTS_MAX];
+	SCTHRU_CONSUMER			Consumers[SCTHRU_PORTS_MAX][SCTHRU_CONSUMERS];
+	BOOLEAN					Running;		// in the run's time
+} SCTHRU;
+
+typedef struct _SCTHRU_PARAMETER
+{
+	char *					Name;
+	ULONG					Value;
+} SCTHRU_PARAMETER;
+
+// what a run measured
+typedef struct _SCTHRU_RESULT
+{
+	ULONGLONG				Bytes;			// all the consumers read in the run's time
+	ULONGLONG				Reads;			// and the reads they completed
+	ULONGLONG				LowerReads;		// the ports'
+	ULONGLONG				Overruns;
+	ULONGLONG				Dropped;
+	double					Cpu;			// seconds
+	BOOLEAN					Exact;
+} SCTHRU_RESULT;
+
+// the process's CPU time, in seconds
+static double ScThruCpu(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// a consumer's read is done, hashed into what it has read
+static VOID ScThruReadDone(PSCHOST_CONSUMER Consumer, NTSTATUS Status, const UCHAR * Data, ULONG Length)
+{
+	SCTHRU_CONSUMER *	consumer;
+
+	consumer = (SCTHRU_CONSUMER *)Consumer->Context;
+	consumer->Hash = SCSimSourceHash(consumer->Hash, Data, Length);
+	consumer->Offset += Length;
+	if(consumer->Thru->Running)
+	{
+		consumer->InTime = consumer->Offset;
+		consumer->ReadsInTime++;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScThruSettings
+//      Sets a port up through its filter as the owner's application
+//      would: the baud rate, 8N1, and reads that return with whatever
+//      has come as soon as anything has
+//
+//  Arguments:
+//      IN  Owner
+//              the filter's consumer
+//
+//      IN  Baud
+//              the baud rate
+//
+//  Return Value:
+//      NT status code
+//
+static NTSTATUS ScThruSettings(PSCHOST_CONSUMER Owner, ULONG Baud)
+{
+	SERIAL_BAUD_RATE	baudRate;
+	SERIAL_LINE_CONTROL	lineControl;
+	SERIAL_TIMEOUTS		timeouts;
+	NTSTATUS			status;
+
+	baudRate.BaudRate = Baud;
+	status = SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_BAUD_RATE,
+		&baudRate, sizeof(baudRate), NULL, 0, NULL);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	lineControl.StopBits = STOP_BIT_1;
+	lineControl.Parity = NO_PARITY;
+	lineControl.WordLength = 8;
+	status = SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_LINE_CONTROL,
+		&lineControl, sizeof(lineControl), NULL, 0, NULL);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	memset(&timeouts, 0, sizeof(timeouts));
+	timeouts.ReadIntervalTimeout = MAXULONG;
+	timeouts.ReadTotalTimeoutMultiplier = MAXULONG;
+	timeouts.ReadTotalTimeoutConstant = SCTHRU_EMPTY_TIMEOUT;
+	return SCHostIoctl(Owner->DeviceObject, &Owner->FileObject, IOCTL_SERIAL_SET_TIMEOUTS,
+		&timeouts, sizeof(timeouts), NULL, 0, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScThruRun
+//      Loads the driver on the ports and runs one point of the sweep
+//
+//  Arguments:
+//      IN  Thru
+//              the run's state
+//
+//      IN  Ports
+//              clones, a port each
+//
+//      IN  Baud
+//              every line's baud rate
+//
+//      IN  ReadSize
+//              bytes each read asks for
+//
+//      IN  Source
+//              what the far ends send, each port's seed the next one up
+//
+//      IN  Line
+//              the UARTs
+//
+//      IN  Duration
+//              100ns to run for
+//
+//      IN  Parameters, ParameterCount
+//              the driver's parameters
+//
+//      OUT Result
+//              what was measured
+//
+//  Return Value:
+//      0, 1 if a consumer lost or garbled what was sent without anything
+//      having been dropped on the way or the driver didn't unload clean,
+//      or -1 if the run couldn't be set up
+//
+static int ScThruRun(SCTHRU * Thru, ULONG Ports, ULONG Baud, ULONG ReadSize, const SCSIMSOURCE_CONFIG * Source,
+	const SCSIMPORT_LINE * Line, ULONGLONG Duration, const SCTHRU_PARAMETER * Parameters,
+	ULONG ParameterCount, SCTHRU_RESULT * Result)
+{
+	SCSIMSOURCE_CONFIG	source;
+	SCTHRU_CONSUMER *	consumer;
+	SCSIMPORT_LINE		line;
+	ULONGLONG			due;
+	ULONGLONG			idle;
+	double				cpu;
+	ULONG				leaks;
+	BOOLEAN				lost;
+	NTSTATUS			status;
+	int					result;
+	ULONG				p;
+	ULONG				i;
+
+	SCHostClockInit(SCHOST_CLOCK_VIRTUAL, 0);
+	for(i = 0; i < ParameterCount; i++)
+		if(!NT_SUCCESS(SCHostSetParameter(Parameters[i].Name, Parameters[i].Value)))
+			return -1;
+
+	status = SCHostLoadPorts(Thru->Hosts, Ports);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scthru: SerialClone didn't load on %u ports, status %x\n", Ports, status);
+		return -1;
+	}
+
+	Thru->Running = FALSE;
+	for(p = 0; p < Ports; p++)
+	{
+		line = *Line;
+		line.Seed = Line->Seed + p * 2;
+		status = SCSimPortSetLine(Thru->Hosts[p].Port, &line);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scthru: the UART wasn't taken, status %x\n", status);
+			return -1;
+		}
+
+		// the filter's consumer opens first, it owns the port
+		for(i = 0; i < SCTHRU_CONSUMERS; i++)
+		{
+			consumer = &Thru->Consumers[p][i];
+			consumer->Thru = Thru;
+			consumer->Offset = 0;
+			consumer->Hash = SCSIMSOURCE_HASH_BASIS;
+			consumer->InTime = 0;
+			consumer->ReadsInTime = 0;
+			status = SCHostConsumerOpen(&consumer->Host, (i == 0) ? "filter" : "clone",
+				(i == 0) ? Thru->Hosts[p].Filter : Thru->Hosts[p].Clone, ReadSize, ScThruReadDone, consumer);
+			if(!NT_SUCCESS(status))
+			{
+				fprintf(stderr, "scthru: can't open port %u's %s, status %x\n", p, (i == 0) ? "filter" : "clone",
+					status);
+				return -1;
+			}
+		}
+
+		status = ScThruSettings(&Thru->Consumers[p][0].Host, Baud);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scthru: port %u's settings weren't taken, status %x\n", p, status);
+			return -1;
+		}
+	}
+
+	for(p = 0; p < Ports; p++)
+	{
+		for(i = 0; i < SCTHRU_CONSUMERS; i++)
+			SCHostConsumerStart(&Thru->Consumers[p][i].Host);
+
+		source = *Source;
+		source.Seed = Source->Seed + p;
+		status = SCSimSourceStart(&Thru->Sources[p], Thru->Hosts[p].Port, &source, NULL, NULL);
+		if(!NT_SUCCESS(status))
+		{
+			fprintf(stderr, "scthru: port %u's source didn't start, status %x\n", p, status);
+			return -1;
+		}
+	}
+
+	// only the run's time is on the CPU clock, not the load and unload
+	Thru->Running = TRUE;
+	cpu = ScThruCpu();
+	SCHostRunUntil(Duration);
+	Result->Cpu = ScThruCpu() - cpu;
+	Thru->Running = FALSE;
+
+	Result->LowerReads = 0;
+	Result->Overruns = 0;
+	Result->Dropped = 0;
+	for(p = 0; p < Ports; p++)
+	{
+		Result->LowerReads += Thru->Hosts[p].Port->Stats.Reads;
+		Result->Overruns += Thru->Hosts[p].Port->Stats.Overruns;
+		Result->Dropped += Thru->Hosts[p].Port->Stats.BytesDropped;
+	}
+
+	// let what is on the lines come in and the reads finish with it
+	due = SCHostNow();
+	for(p = 0; p < Ports; p++)
+	{
+		SCSimSourceStop(&Thru->Sources[p]);
+		idle = SCSimPortLineIdle(Thru->Hosts[p].Port);
+		if(idle > due)
+			due = idle;
+	}
+	SCHostRunUntil(due + (ULONGLONG)SCTHRU_EMPTY_TIMEOUT * 10000);
+	for(p = 0; p < Ports; p++)
+	{
+		for(i = 0; i < SCTHRU_CONSUMERS; i++)
+			SCHostConsumerStop(&Thru->Consumers[p][i].Host);
+		SCSimPortFlush(Thru->Hosts[p].Port);
+	}
+	SCHostRunPending();
+
+	result = 0;
+	Result->Bytes = 0;
+	Result->Reads = 0;
+	Result->Exact = TRUE;
+	for(p = 0; p < Ports; p++)
+	{
+		lost = (Thru->Sources[p].Lost != 0) || (Thru->Hosts[p].Port->Stats.Overruns != 0) ||
+			(Thru->Hosts[p].Port->Stats.BytesDropped != 0);
+		for(i = 0; i < SCTHRU_CONSUMERS; i++)
+		{
+			consumer = &Thru->Consumers[p][i];
+			Result->Bytes += consumer->InTime;
+			Result->Reads += consumer->ReadsInTime;
+			if((consumer->Offset != Thru->Sources[p].Bytes) || (consumer->Hash != Thru->Sources[p].Hash))
+			{
+				Result->Exact = FALSE;
+				if(!lost)
+					result = 1;
+			}
+			SCHostConsumerClose(&consumer->Host);
+		}
+	}
+
+	status = SCHostUnloadPorts(Thru->Hosts, Ports);
+	if(!NT_SUCCESS(status))
+	{
+		fprintf(stderr, "scthru: SerialClone didn't unload, status %x\n", status);
+		return 1;
+	}
+	if((leaks = SCHostCheckLeaks()) != 0)
+	{
+		fprintf(stderr, "scthru: %u ports, %u things left behind by the driver\n", Ports, leaks);
+		return 1;
+	}
+	return result;
+}
+
+// a comma separated list of numbers
+static ULONG ScThruList(char * Text, ULONG * List)
+{
+	ULONG	count;
+	char *	next;
+
+	for(count = 0; (count < SCTHRU_LIST_MAX) && (*Text != 0); count++)
+	{
+		List[count] = (ULONG)strtoul(Text, &next, 0);
+		if((next == Text) || ((*next != ',') && (*next != 0)))
+			return 0;
+		Text = (*next == ',') ? next + 1 : next;
+	}
+	return (*Text == 0) ? count : 0;
+}
+
+static void ScThruUsage(void)
+{
+	fprintf(stderr, "usage: scthru [-n clones] [-b bauds] [-r bytes] [-d seconds] [-R runs] [-S seed]\n");
+	fprintf(stderr, "              [-p Name=Value]... [-v]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	static SCTHRU		thru;
+	SCTHRU_PARAMETER	parameters[SCTHRU_PARAMETERS];
+	SCTHRU_RESULT		best;
+	SCTHRU_RESULT		run;
+	SCSIMSOURCE_CONFIG	source;
+	SCSIMPORT_LINE		line;
+	ULONG				ports[SCTHRU_LIST_MAX] = { 1, 2, 4, 8 };
+	ULONG				bauds[SCTHRU_LIST_MAX] = { 115200, 921600, 3000000 };
+	ULONG				sizes[SCTHRU_LIST_MAX] = { 16, 256, 4096 };
+	ULONG				portCount;
+	ULONG				baudCount;
+	ULONG				sizeCount;
+	ULONG				parameterCount;
+	ULONG				runs;
+	ULONG				n;
+	ULONG				b;
+	ULONG				r;
+	ULONG				k;
+	char *				value;
+	double				duration;
+	double				seconds;
+	double				mb;
+	BOOLEAN				verbose;
+	BOOLEAN				bad;
+	int					result;
+	int					status;
+	int					i;
+
+	portCount = 4;
+	baudCount = 3;
+	sizeCount = 3;
+	parameterCount = 0;
+	duration = 1;
+	runs = 5;
+	verbose = FALSE;
+	bad = FALSE;
+
+	// bytes as fast as each line takes them
+	memset(&source, 0, sizeof(source));
+	source.Payload = SCSIMSOURCE_STREAM;
+	source.FrameSize = 64;
+	source.Frames = 1;
+	source.Seed = 1;
+
+	// a 16750, its 64 byte FIFO interrupting half full so the fastest
+	// line in the sweep doesn't overrun it
+	memset(&line, 0, sizeof(line));
+	line.FifoDepth = 64;
+	line.RxTrigger = 32;
+	line.Latency = 200;
+	line.Jitter = 100;
+
+	for(i = 1; (i < argc) && !bad; i++)
+	{
+		if(!strcmp(argv[i], "-v"))
+			verbose = TRUE;
+		else if(i + 1 == argc)
+			bad = TRUE;
+		else if(!strcmp(argv[i], "-n"))
+			bad = (portCount = ScThruList(argv[++i], ports)) == 0;
+		else if(!strcmp(argv[i], "-b"))
+			bad = (baudCount = ScThruList(argv[++i], bauds)) == 0;
+		else if(!strcmp(argv[i], "-r"))
+			bad = (sizeCount = ScThruList(argv[++i], sizes)) == 0;
+		else if(!strcmp(argv[i], "-d"))
+			duration = atof(argv[++i]);
+		else if(!strcmp(argv[i], "-R"))
+			runs = (ULONG)strtoul(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-S"))
+			source.Seed = strtoull(argv[++i], NULL, 0);
+		else if(!strcmp(argv[i], "-p") && ((value = strchr(argv[i + 1], '=')) != NULL) &&
+			(parameterCount < SCTHRU_PARAMETERS))
+		{
+			*value++ = 0;
+			parameters[parameterCount].Name = argv[++i];
+			parameters[parameterCount].Value = (ULONG)strtoul(value, NULL, 0);
+			parameterCount++;
+		}
+		else
+			bad = TRUE;
+	}
+
+	for(n = 0; n < portCount; n++)
+		if((ports[n] == 0) || (ports[n] > SCTHRU_PORTS_MAX))
+			bad = TRUE;
+	for(b = 0; b < baudCount; b++)
+		if(bauds[b] == 0)
+			bad = TRUE;
+	for(r = 0; r < sizeCount; r++)
+		if(sizes[r] == 0)
+			bad = TRUE;
+	if(bad || (duration <= 0) || (runs == 0))
+	{
+		ScThruUsage();
+		return 2;
+	}
+
+	// the UARTs' jitter and what is sent are the seed's, apart
+	line.Seed = source.Seed * 2 + 1;
+	SCHostSetDebugOutput(verbose);
+
+	printf("clones\tbaud\tread\tbytes_s\tline_pct\treads_s\tlower_s\tirps_s\tcpu_ms\tcpu_ms_mb\tirps_cpu_s\t"
+		"overruns\tdropped\texact\n");
+
+	result = 0;
+	seconds = duration;
+	for(n = 0; n < portCount; n++)
+		for(b = 0; b < baudCount; b++)
+			for(r = 0; r < sizeCount; r++)
+			{
+				// the simulation is the same every run, only the CPU time isn't
+				for(k = 0; k < runs; k++)
+				{
+					status = ScThruRun(&thru, ports[n], bauds[b], sizes[r], &source, &line,
+						(ULONGLONG)(duration * 1e7), parameters, parameterCount, &run);
+					if(status < 0)
+						return 1;
+					if(status != 0)
+						result = 1;
+					if((k == 0) || (run.Cpu < best.Cpu))
+						best = run;
+				}
+
+				mb = best.Bytes / 1e6;
+				printf("%u\t%u\t%u\t%.0f\t%.1f\t%.0f\t%.0f\t%.0f\t%.3f\t%.3f\t%.0f\t%llu\t%llu\t%s\n",
+					ports[n], bauds[b], sizes[r], best.Bytes / seconds,
+					best.Bytes / seconds / (SCTHRU_CONSUMERS * ports[n]) / (bauds[b] / 10.0) * 100,
+					best.Reads / seconds, best.LowerReads / seconds, (best.Reads + best.LowerReads) / seconds,
+					best.Cpu * 1000, (mb != 0) ? best.Cpu * 1000 / mb : 0.0,
+					(best.Cpu != 0) ? (best.Reads + best.LowerReads) / best.Cpu : 0.0,
+					best.Overruns, best.Dropped, best.Exact ? "yes" : "no");
+				fflush(stdout);
+			}
+
+	return result;
+}
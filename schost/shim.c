@@ -0,0 +1,1588 @@
+// shim.c
+//
+// The kernel the driver runs on in the host harness, less the I/O manager
+// which is io.c: pool, IRQL, spin locks and fast mutexes, events and
+// waits, the clock, timers, DPCs, strings and the registry.
+//
+// Where a real kernel would bug check, the shim stops the run with
+// SCHostFatal, naming what the driver did. Being on one thread it also
+// stops on what would only hang a real one: acquiring a lock that is
+// already held, or waiting on an event nothing left can set.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+
+#include <wdm.h>
+#include <ntstrsafe.h>
+#include <wmilib.h>
+#include "shim.h"
+
+#define SCHOST_POOL_MAGIC		0x6c6f6f50		// 'Pool'
+#define SCHOST_POOL_FREED		0x65657246		// 'Free'
+#define SCHOST_POOL_ALIGN		64				// keeps allocations 64 byte aligned
+
+#define SCHOST_EVENT_NOTIFICATION		0
+#define SCHOST_EVENT_SYNCHRONIZATION	1
+#define SCHOST_TIMER_NOTIFICATION		8
+
+#define SCHOST_LEAKS_SHOWN		16				// pool blocks listed by SCHostCheckLeaks
+
+#define SCHOST_KEY_MAGIC		0x4b676552		// 'RegK'
+#define SCHOST_KEY_PATH			512
+
+typedef struct _SCHOST_POOL_HEADER
+{
+	ULONG		Magic;
+	ULONG		Tag;
+	SIZE_T		Size;
+	POOL_TYPE	Type;
+	LIST_ENTRY	Link;				// on ScHostPool while allocated
+} SCHOST_POOL_HEADER, *PSCHOST_POOL_HEADER;
+
+C_ASSERT(sizeof(SCHOST_POOL_HEADER) <= SCHOST_POOL_ALIGN);
+
+// a registry value, or with Name NULL a key that has no values yet. Paths
+// and names are kept lower case, the registry not caring.
+typedef struct _SCHOST_REG_VALUE
+{
+	struct _SCHOST_REG_VALUE *	Next;
+	char *						Key;
+	char *						Name;
+	ULONG						Type;
+	ULONG						Length;
+	UCHAR						Data[1];
+} SCHOST_REG_VALUE, *PSCHOST_REG_VALUE;
+
+typedef struct _SCHOST_KEY
+{
+	ULONG		Magic;
+	char		Path[SCHOST_KEY_PATH];
+} SCHOST_KEY, *PSCHOST_KEY;
+
+SCHOST_SHIM_STATS	g_SCHostStats;
+
+static int					ScHostClockMode = SCHOST_CLOCK_VIRTUAL;
+static ULONGLONG			ScHostBootTime;
+static ULONGLONG			ScHostVirtualNow;
+static struct timespec		ScHostRealStart;
+
+// a simulated processor's state; the loop and the harness run on the
+// first, race.c moves ScHostCpu between them as it switches. ScHostCpu
+// is the host thread's, so a tool timing driver code from threads of its
+// own can run each as a processor; nothing else in here is theirs to use
+typedef struct _SCHOST_CPU
+{
+	KIRQL					Irql;
+	ULONG					LocksHeld;
+} SCHOST_CPU, *PSCHOST_CPU;
+
+static SCHOST_CPU			ScHostCpus[MAXIMUM_PROCESSORS];
+static __thread PSCHOST_CPU	ScHostCpu = &ScHostCpus[0];
+static ULONG				ScHostProcessors = 1;
+static BOOLEAN				ScHostDebugOutput = TRUE;
+static BOOLEAN				ScHostPrivileged = FALSE;
+
+static LIST_ENTRY			ScHostTimerQueue = { &ScHostTimerQueue, &ScHostTimerQueue };
+static LIST_ENTRY			ScHostDpcQueue = { &ScHostDpcQueue, &ScHostDpcQueue };
+static LIST_ENTRY			ScHostWorkQueue = { &ScHostWorkQueue, &ScHostWorkQueue };
+static LIST_ENTRY			ScHostPool = { &ScHostPool, &ScHostPool };
+
+static PSCHOST_REG_VALUE	ScHostRegistry;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostFatal
+//      Stops the run
+//
+//  Arguments:
+//      IN  Format
+//              printf format of the reason
+//
+//  Return Value:
+//      None, does not return
+//
+VOID SCHostFatal(PCSTR Format, ...)
+{
+	va_list		args;
+	ULONGLONG	seed;
+	ULONG		point;
+
+	fflush(stdout);
+	fprintf(stderr, "schost: ");
+	va_start(args, Format);
+	vfprintf(stderr, Format, args);
+	va_end(args);
+	fprintf(stderr, " (processor %u, IRQL %d, clock %llu)\n", KeGetCurrentProcessorNumber(), ScHostCpu->Irql,
+		(unsigned long long)SCHostNow());
+	if(SCHostRaceRunning(&seed, &point))
+		fprintf(stderr, "schost: racing, seed %llu, at point %u\n", (unsigned long long)seed, point);
+	abort();
+}
+
+VOID SCHostAssert(PCSTR Expression, PCSTR File, int Line)
+{
+	SCHostFatal("assertion %s failed at %s(%d)", Expression, File, Line);
+}
+
+ULONG DbgPrint(PCSTR Format, ...)
+{
+	va_list	args;
+
+	if(ScHostDebugOutput)
+	{
+		va_start(args, Format);
+		vfprintf(stderr, Format, args);
+		va_end(args);
+	}
+	return 0;
+}
+
+VOID DbgBreakPoint(VOID)
+{
+	SCHostFatal("DbgBreakPoint");
+}
+
+VOID SCHostSetDebugOutput(BOOLEAN Enable)
+{
+	ScHostDebugOutput = Enable;
+}
+
+VOID SCHostSetPrivileged(BOOLEAN Privileged)
+{
+	ScHostPrivileged = Privileged;
+}
+
+VOID SCHostSetProcessors(ULONG Count)
+{
+	if((Count == 0) || (Count > MAXIMUM_PROCESSORS))
+		SCHostFatal("%u processors, 1 to %d are supported", Count, MAXIMUM_PROCESSORS);
+	ScHostProcessors = Count;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostClockInit
+//      Picks the clock, before the driver is loaded
+//
+//  Arguments:
+//      IN  Mode
+//              SCHOST_CLOCK_VIRTUAL or SCHOST_CLOCK_REAL
+//
+//      IN  BootTime
+//              system time, 100ns units since 1601, the clock starts from
+//
+//  Return Value:
+//      None
+//
+VOID SCHostClockInit(int Mode, ULONGLONG BootTime)
+{
+	ScHostClockMode = Mode;
+	ScHostBootTime = BootTime;
+	ScHostVirtualNow = 0;
+	clock_gettime(CLOCK_MONOTONIC, &ScHostRealStart);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostNow
+//      Reads the clock
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      100ns units since boot
+//
+ULONGLONG SCHostNow(VOID)
+{
+	struct timespec	now;
+
+	if(ScHostClockMode == SCHOST_CLOCK_VIRTUAL)
+		return ScHostVirtualNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((ULONGLONG)(now.tv_sec - ScHostRealStart.tv_sec) * 1000000000 +
+		now.tv_nsec - ScHostRealStart.tv_nsec) / 100;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostWaitUntil
+//      Lets the clock get to a time, moving a virtual one there or sleeping
+//      until a real one is
+//
+//  Arguments:
+//      IN  Time
+//              100ns units since boot
+//
+//  Return Value:
+//      None
+//
+static VOID ScHostWaitUntil(ULONGLONG Time)
+{
+	struct timespec	until;
+	ULONGLONG		ns;
+
+	if(ScHostClockMode == SCHOST_CLOCK_VIRTUAL)
+	{
+		if(Time > ScHostVirtualNow)
+			ScHostVirtualNow = Time;
+		return;
+	}
+
+	ns = Time * 100 + ScHostRealStart.tv_nsec;
+	until.tv_sec = ScHostRealStart.tv_sec + (time_t)(ns / 1000000000);
+	until.tv_nsec = (long)(ns % 1000000000);
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR)
+		;
+}
+
+VOID KeQuerySystemTime(PLARGE_INTEGER CurrentTime)
+{
+	CurrentTime->QuadPart = (LONGLONG)(ScHostBootTime + SCHostNow());
+}
+
+ULONGLONG KeQueryInterruptTime(VOID)
+{
+	return SCHostNow();
+}
+
+// the counter ticks in the clock's own 100ns units
+LARGE_INTEGER KeQueryPerformanceCounter(PLARGE_INTEGER PerformanceFrequency)
+{
+	LARGE_INTEGER	counter;
+
+	if(PerformanceFrequency != NULL)
+		PerformanceFrequency->QuadPart = SCHOST_PERF_FREQUENCY;
+	counter.QuadPart = (LONGLONG)SCHostNow();
+	return counter;
+}
+
+// spins without letting anything else run, as on a real processor
+VOID KeStallExecutionProcessor(ULONG MicroSeconds)
+{
+	ULONGLONG	until;
+
+	until = SCHostNow() + (ULONGLONG)MicroSeconds * 10;
+	if(ScHostClockMode == SCHOST_CLOCK_VIRTUAL)
+		ScHostVirtualNow = until;
+	else
+		while(SCHostNow() < until)
+			;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  IRQL and processors
+//
+KIRQL KeGetCurrentIrql(VOID)
+{
+	return ScHostCpu->Irql;
+}
+
+VOID KeRaiseIrql(KIRQL NewIrql, PKIRQL OldIrql)
+{
+	if(NewIrql < ScHostCpu->Irql)
+		SCHostFatal("KeRaiseIrql to %d, below the current IRQL", NewIrql);
+	*OldIrql = ScHostCpu->Irql;
+	ScHostCpu->Irql = NewIrql;
+}
+
+VOID KeLowerIrql(KIRQL NewIrql)
+{
+	if(NewIrql > ScHostCpu->Irql)
+		SCHostFatal("KeLowerIrql to %d, above the current IRQL", NewIrql);
+	ScHostCpu->Irql = NewIrql;
+}
+
+ULONG KeGetCurrentProcessorNumber(VOID)
+{
+	return (ULONG)(ScHostCpu - ScHostCpus);
+}
+
+// runs as another processor from here on, race.c's
+VOID SCHostSetProcessor(ULONG Number)
+{
+	if(Number >= ScHostProcessors)
+		SCHostFatal("processor %u of %u", Number, ScHostProcessors);
+	ScHostCpu = &ScHostCpus[Number];
+}
+
+ULONG SCHostGetProcessors(VOID)
+{
+	return ScHostProcessors;
+}
+
+// spin locks the current processor holds, for race.c
+ULONG SCHostGetLocksHeld(VOID)
+{
+	return ScHostCpu->LocksHeld;
+}
+
+KAFFINITY KeQueryActiveProcessors(VOID)
+{
+	return (ScHostProcessors == sizeof(KAFFINITY) * 8) ? ~(KAFFINITY)0 : ((KAFFINITY)1 << ScHostProcessors) - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Pool
+//
+PVOID ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag)
+{
+	PSCHOST_POOL_HEADER	header;
+
+	if(ScHostCpu->Irql > DISPATCH_LEVEL)
+		SCHostFatal("ExAllocatePoolWithTag above DISPATCH_LEVEL");
+	if((PoolType & 1) && (ScHostCpu->Irql > APC_LEVEL))
+		SCHostFatal("paged pool allocated at IRQL %d", ScHostCpu->Irql);
+
+	if(posix_memalign((void **)&header, SCHOST_POOL_ALIGN, SCHOST_POOL_ALIGN + NumberOfBytes) != 0)
+		return NULL;
+
+	header->Magic = SCHOST_POOL_MAGIC;
+	header->Tag = Tag;
+	header->Size = NumberOfBytes;
+	header->Type = PoolType;
+	InsertTailList(&ScHostPool, &header->Link);
+
+	// new pool is never zeroed, filled so a driver that reads it before
+	// writing sees the same garbage every run
+	memset((PUCHAR)header + SCHOST_POOL_ALIGN, 0xcd, NumberOfBytes);
+
+	g_SCHostStats.Allocations++;
+	g_SCHostStats.Outstanding++;
+	g_SCHostStats.OutstandingBytes += NumberOfBytes;
+	return (PUCHAR)header + SCHOST_POOL_ALIGN;
+}
+
+VOID ExFreePoolWithTag(PVOID P, ULONG Tag)
+{
+	PSCHOST_POOL_HEADER	header;
+
+	if(ScHostCpu->Irql > DISPATCH_LEVEL)
+		SCHostFatal("ExFreePool above DISPATCH_LEVEL");
+	if(P == NULL)
+		SCHostFatal("ExFreePool of NULL");
+
+	header = (PSCHOST_POOL_HEADER)((PUCHAR)P - SCHOST_POOL_ALIGN);
+	if(header->Magic == SCHOST_POOL_FREED)
+		SCHostFatal("pool %p freed twice", P);
+	if(header->Magic != SCHOST_POOL_MAGIC)
+		SCHostFatal("ExFreePool of %p, not pool", P);
+	if((Tag != 0) && (Tag != header->Tag))
+		SCHostFatal("pool %p tagged %.4s freed as %.4s", P, (char *)&header->Tag, (char *)&Tag);
+
+	g_SCHostStats.Outstanding--;
+	g_SCHostStats.OutstandingBytes -= header->Size;
+
+	RemoveEntryList(&header->Link);
+	header->Magic = SCHOST_POOL_FREED;
+	memset(P, 0xdd, header->Size);
+	free(header);
+}
+
+VOID ExFreePool(PVOID P)
+{
+	ExFreePoolWithTag(P, 0);
+}
+
+SIZE_T RtlCompareMemory(const VOID * Source1, const VOID * Source2, SIZE_T Length)
+{
+	SIZE_T	i;
+
+	for(i = 0; (i < Length) && (((const UCHAR *)Source1)[i] == ((const UCHAR *)Source2)[i]); i++)
+		;
+	return i;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Interlocked operations
+//
+LONG SCHostExchange(LONG volatile * Target, LONG Value)
+{
+	SCHostRacePoint();
+	return __sync_lock_test_and_set(Target, Value);
+}
+
+PVOID SCHostExchangePointer(PVOID volatile * Target, PVOID Value)
+{
+	SCHostRacePoint();
+	return __sync_lock_test_and_set(Target, Value);
+}
+
+VOID ExInterlockedAddLargeStatistic(PLARGE_INTEGER Addend, ULONG Increment)
+{
+	SCHostRacePoint();
+	__sync_fetch_and_add(&Addend->QuadPart, (LONGLONG)Increment);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Spin locks
+//
+//  A held lock's word is nonzero, lock.c relies on it, and holds the queue
+//  handle for an in stack queued acquisition. Taking and dropping one are
+//  where processors racing are switched, and one taking a lock another
+//  holds spins, switched out until the lock is free.
+//
+static VOID ScHostLockTake(PKSPIN_LOCK SpinLock, KSPIN_LOCK Owner)
+{
+	SCHostRacePoint();
+	while(*SpinLock != 0)
+		if(!SCHostRaceSpin(SpinLock))
+			SCHostFatal("spin lock %p acquired while already held, a deadlock", SpinLock);
+	*SpinLock = Owner;
+	ScHostCpu->LocksHeld++;
+}
+
+static VOID ScHostLockDrop(PKSPIN_LOCK SpinLock)
+{
+	if(ScHostCpu->Irql != DISPATCH_LEVEL)
+		SCHostFatal("spin lock %p released below DISPATCH_LEVEL", SpinLock);
+	if(*SpinLock == 0)
+		SCHostFatal("spin lock %p released when not held", SpinLock);
+	*SpinLock = 0;
+	ScHostCpu->LocksHeld--;
+	SCHostRacePoint();
+}
+
+VOID KeInitializeSpinLock(PKSPIN_LOCK SpinLock)
+{
+	*SpinLock = 0;
+}
+
+VOID KeAcquireSpinLock(PKSPIN_LOCK SpinLock, PKIRQL OldIrql)
+{
+	if(ScHostCpu->Irql > DISPATCH_LEVEL)
+		SCHostFatal("KeAcquireSpinLock above DISPATCH_LEVEL");
+	KeRaiseIrql(DISPATCH_LEVEL, OldIrql);
+	ScHostLockTake(SpinLock, 1);
+}
+
+VOID KeReleaseSpinLock(PKSPIN_LOCK SpinLock, KIRQL NewIrql)
+{
+	ScHostLockDrop(SpinLock);
+	KeLowerIrql(NewIrql);
+}
+
+VOID KeAcquireSpinLockAtDpcLevel(PKSPIN_LOCK SpinLock)
+{
+	if(ScHostCpu->Irql != DISPATCH_LEVEL)
+		SCHostFatal("KeAcquireSpinLockAtDpcLevel at IRQL %d", ScHostCpu->Irql);
+	ScHostLockTake(SpinLock, 1);
+}
+
+VOID KeReleaseSpinLockFromDpcLevel(PKSPIN_LOCK SpinLock)
+{
+	ScHostLockDrop(SpinLock);
+}
+
+VOID KeAcquireInStackQueuedSpinLock(PKSPIN_LOCK SpinLock, PKLOCK_QUEUE_HANDLE LockHandle)
+{
+	if(ScHostCpu->Irql > DISPATCH_LEVEL)
+		SCHostFatal("KeAcquireInStackQueuedSpinLock above DISPATCH_LEVEL");
+	KeRaiseIrql(DISPATCH_LEVEL, &LockHandle->OldIrql);
+	KeAcquireInStackQueuedSpinLockAtDpcLevel(SpinLock, LockHandle);
+}
+
+VOID KeReleaseInStackQueuedSpinLock(PKLOCK_QUEUE_HANDLE LockHandle)
+{
+	KeReleaseInStackQueuedSpinLockFromDpcLevel(LockHandle);
+	KeLowerIrql(LockHandle->OldIrql);
+}
+
+VOID KeAcquireInStackQueuedSpinLockAtDpcLevel(PKSPIN_LOCK SpinLock, PKLOCK_QUEUE_HANDLE LockHandle)
+{
+	if(ScHostCpu->Irql != DISPATCH_LEVEL)
+		SCHostFatal("queued spin lock %p acquired at IRQL %d", SpinLock, ScHostCpu->Irql);
+	LockHandle->LockQueue.Next = NULL;
+	LockHandle->LockQueue.Lock = SpinLock;
+	ScHostLockTake(SpinLock, (KSPIN_LOCK)&LockHandle->LockQueue);
+}
+
+VOID KeReleaseInStackQueuedSpinLockFromDpcLevel(PKLOCK_QUEUE_HANDLE LockHandle)
+{
+	if(*LockHandle->LockQueue.Lock != (KSPIN_LOCK)&LockHandle->LockQueue)
+		SCHostFatal("queued spin lock %p released through a handle that doesn't hold it",
+			LockHandle->LockQueue.Lock);
+	ScHostLockDrop(LockHandle->LockQueue.Lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Fast mutexes
+//
+VOID ExInitializeFastMutex(PFAST_MUTEX FastMutex)
+{
+	FastMutex->Count = 1;
+	FastMutex->Owner = NULL;
+	FastMutex->OldIrql = PASSIVE_LEVEL;
+}
+
+VOID ExAcquireFastMutex(PFAST_MUTEX FastMutex)
+{
+	KIRQL	oldIrql;
+
+	if(ScHostCpu->Irql > APC_LEVEL)
+		SCHostFatal("ExAcquireFastMutex at IRQL %d", ScHostCpu->Irql);
+	if(FastMutex->Count != 1)
+		SCHostFatal("fast mutex %p acquired while already held, a deadlock", FastMutex);
+
+	KeRaiseIrql(APC_LEVEL, &oldIrql);
+	FastMutex->Count = 0;
+	FastMutex->Owner = FastMutex;
+	FastMutex->OldIrql = oldIrql;
+}
+
+VOID ExReleaseFastMutex(PFAST_MUTEX FastMutex)
+{
+	if(FastMutex->Count != 0)
+		SCHostFatal("fast mutex %p released when not held", FastMutex);
+	if(ScHostCpu->Irql != APC_LEVEL)
+		SCHostFatal("fast mutex %p released at IRQL %d", FastMutex, ScHostCpu->Irql);
+
+	FastMutex->Count = 1;
+	FastMutex->Owner = NULL;
+	KeLowerIrql(FastMutex->OldIrql);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Events
+//
+VOID KeInitializeEvent(PRKEVENT Event, EVENT_TYPE Type, BOOLEAN State)
+{
+	Event->Header.Type = (Type == SynchronizationEvent) ? SCHOST_EVENT_SYNCHRONIZATION : SCHOST_EVENT_NOTIFICATION;
+	Event->Header.SignalState = State;
+}
+
+LONG KeSetEvent(PRKEVENT Event, KPRIORITY Increment, BOOLEAN Wait)
+{
+	LONG	previous;
+
+	if(ScHostCpu->Irql > DISPATCH_LEVEL)
+		SCHostFatal("KeSetEvent above DISPATCH_LEVEL");
+	previous = Event->Header.SignalState;
+	Event->Header.SignalState = 1;
+	return previous;
+}
+
+VOID KeClearEvent(PRKEVENT Event)
+{
+	Event->Header.SignalState = 0;
+}
+
+LONG KeReadStateEvent(PRKEVENT Event)
+{
+	return Event->Header.SignalState;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Timers and DPCs
+//
+VOID KeInitializeTimer(PKTIMER Timer)
+{
+	Timer->Header.Type = SCHOST_TIMER_NOTIFICATION;
+	Timer->Header.SignalState = 0;
+	Timer->DueTime = 0;
+	Timer->Dpc = NULL;
+	Timer->Inserted = FALSE;
+	InitializeListHead(&Timer->TimerListEntry);
+}
+
+BOOLEAN KeCancelTimer(PKTIMER Timer)
+{
+	if(ScHostCpu->Irql > DISPATCH_LEVEL)
+		SCHostFatal("KeCancelTimer above DISPATCH_LEVEL");
+	if(!Timer->Inserted)
+		return FALSE;
+
+	RemoveEntryList(&Timer->TimerListEntry);
+	Timer->Inserted = FALSE;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  KeSetTimer
+//      Sets a timer, replacing any time it was already set for
+//
+//  Arguments:
+//      IN  Timer
+//              the timer
+//
+//      IN  DueTime
+//              negative, 100ns units from now; positive, system time
+//
+//      IN  Dpc
+//              queued when the timer expires, optional
+//
+//  Return Value:
+//      TRUE if the timer was already set
+//
+BOOLEAN KeSetTimer(PKTIMER Timer, LARGE_INTEGER DueTime, PKDPC Dpc)
+{
+	BOOLEAN		wasSet;
+	ULONGLONG	now;
+	ULONGLONG	due;
+	PLIST_ENTRY	entry;
+
+	wasSet = KeCancelTimer(Timer);
+
+	now = SCHostNow();
+	if(DueTime.QuadPart < 0)
+		due = now + (ULONGLONG)-DueTime.QuadPart;
+	else if((ULONGLONG)DueTime.QuadPart > ScHostBootTime + now)
+		due = (ULONGLONG)DueTime.QuadPart - ScHostBootTime;
+	else
+		due = now;
+
+	Timer->DueTime = due;
+	Timer->Dpc = Dpc;
+	Timer->Header.SignalState = 0;
+	Timer->Inserted = TRUE;
+
+	// after any timer due at the same time, so they expire in the order set
+	for(entry = ScHostTimerQueue.Blink; entry != &ScHostTimerQueue; entry = entry->Blink)
+		if(CONTAINING_RECORD(entry, KTIMER, TimerListEntry)->DueTime <= due)
+			break;
+	InsertHeadList(entry, &Timer->TimerListEntry);
+
+	return wasSet;
+}
+
+BOOLEAN KeReadStateTimer(PKTIMER Timer)
+{
+	return (BOOLEAN)(Timer->Header.SignalState != 0);
+}
+
+VOID KeInitializeDpc(PRKDPC Dpc, PKDEFERRED_ROUTINE DeferredRoutine, PVOID DeferredContext)
+{
+	Dpc->Type = 0x13;
+	Dpc->DeferredRoutine = DeferredRoutine;
+	Dpc->DeferredContext = DeferredContext;
+	Dpc->DpcData = NULL;
+	InitializeListHead(&Dpc->DpcListEntry);
+}
+
+BOOLEAN KeInsertQueueDpc(PRKDPC Dpc, PVOID SystemArgument1, PVOID SystemArgument2)
+{
+	if(Dpc->DpcData != NULL)
+		return FALSE;
+
+	Dpc->SystemArgument1 = SystemArgument1;
+	Dpc->SystemArgument2 = SystemArgument2;
+	Dpc->DpcData = &ScHostDpcQueue;
+	InsertTailList(&ScHostDpcQueue, &Dpc->DpcListEntry);
+	return TRUE;
+}
+
+BOOLEAN KeRemoveQueueDpc(PRKDPC Dpc)
+{
+	if(Dpc->DpcData == NULL)
+		return FALSE;
+
+	RemoveEntryList(&Dpc->DpcListEntry);
+	Dpc->DpcData = NULL;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostExpireTimers
+//      Expires the timers that are due, queueing their DPCs
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      TRUE if any expired
+//
+static BOOLEAN ScHostExpireTimers(VOID)
+{
+	PKTIMER			timer;
+	ULONGLONG		now;
+	LARGE_INTEGER	systemTime;
+	BOOLEAN			expired;
+
+	expired = FALSE;
+	now = SCHostNow();
+	while(!IsListEmpty(&ScHostTimerQueue))
+	{
+		timer = CONTAINING_RECORD(ScHostTimerQueue.Flink, KTIMER, TimerListEntry);
+		if(timer->DueTime > now)
+			break;
+
+		RemoveEntryList(&timer->TimerListEntry);
+		timer->Inserted = FALSE;
+		timer->Header.SignalState = 1;
+		g_SCHostStats.Timers++;
+		expired = TRUE;
+
+		if(timer->Dpc != NULL)
+		{
+			systemTime.QuadPart = (LONGLONG)(ScHostBootTime + now);
+			KeInsertQueueDpc(timer->Dpc, (PVOID)(ULONG_PTR)systemTime.LowPart,
+				(PVOID)(ULONG_PTR)(ULONG)systemTime.HighPart);
+		}
+	}
+
+	return expired;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostRunDpcs
+//      Expires due timers and runs the DPC queue until both are done
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      TRUE if anything ran
+//
+static BOOLEAN ScHostRunDpcs(VOID)
+{
+	PKDPC	dpc;
+	KIRQL	oldIrql;
+	BOOLEAN	ran;
+
+	if(ScHostCpu->Irql >= DISPATCH_LEVEL)
+		return FALSE;
+
+	ran = ScHostExpireTimers();
+	while(!IsListEmpty(&ScHostDpcQueue))
+	{
+		dpc = CONTAINING_RECORD(RemoveHeadList(&ScHostDpcQueue), KDPC, DpcListEntry);
+		dpc->DpcData = NULL;
+		g_SCHostStats.Dpcs++;
+
+		KeRaiseIrql(DISPATCH_LEVEL, &oldIrql);
+		dpc->DeferredRoutine(dpc, dpc->DeferredContext, dpc->SystemArgument1, dpc->SystemArgument2);
+		if(ScHostCpu->Irql != DISPATCH_LEVEL)
+			SCHostFatal("DPC routine %p returned at IRQL %d", dpc->DeferredRoutine, ScHostCpu->Irql);
+		if(ScHostCpu->LocksHeld != 0)
+			SCHostFatal("DPC routine %p returned holding a spin lock", dpc->DeferredRoutine);
+		KeLowerIrql(oldIrql);
+
+		ran = TRUE;
+		ScHostExpireTimers();
+	}
+
+	return ran;
+}
+
+VOID KeFlushQueuedDpcs(VOID)
+{
+	if(ScHostCpu->Irql != PASSIVE_LEVEL)
+		SCHostFatal("KeFlushQueuedDpcs at IRQL %d", ScHostCpu->Irql);
+
+	// the queue is run with the clock as it is, a flush waits for nothing
+	// but what is already queued
+	while(!IsListEmpty(&ScHostDpcQueue))
+		ScHostRunDpcs();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SeSinglePrivilegeCheck
+//      Any privilege for the kernel; an application has them all or none,
+//      see SCHostSetPrivileged
+//
+BOOLEAN SeSinglePrivilegeCheck(LUID PrivilegeValue, KPROCESSOR_MODE PreviousMode)
+{
+	if(ScHostCpu->Irql != PASSIVE_LEVEL)
+		SCHostFatal("SeSinglePrivilegeCheck at IRQL %d", ScHostCpu->Irql);
+
+	return (PreviousMode == KernelMode) || ScHostPrivileged;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  KeWaitForSingleObject
+//      Waits on an event or timer. Only the clock, timers and DPCs can
+//      move while the one thread waits, so they are run until the object
+//      is signalled; work items wait for the loop.
+//
+//  Arguments:
+//      IN  Object
+//              a KEVENT or KTIMER
+//
+//      IN  WaitReason
+//              unused
+//
+//      IN  WaitMode
+//              unused
+//
+//      IN  Alertable
+//              unused
+//
+//      IN  Timeout
+//              optional, negative relative or positive absolute as KeSetTimer
+//
+//  Return Value:
+//      STATUS_SUCCESS or STATUS_TIMEOUT
+//
+NTSTATUS KeWaitForSingleObject(PVOID Object, KWAIT_REASON WaitReason, KPROCESSOR_MODE WaitMode,
+	BOOLEAN Alertable, PLARGE_INTEGER Timeout)
+{
+	DISPATCHER_HEADER *	header;
+	ULONGLONG			deadline;
+	ULONGLONG			next;
+	BOOLEAN				due;
+
+	header = (DISPATCHER_HEADER *)Object;
+
+	if((Timeout != NULL) && (Timeout->QuadPart == 0))
+	{
+		if(ScHostCpu->Irql > DISPATCH_LEVEL)
+			SCHostFatal("KeWaitForSingleObject above DISPATCH_LEVEL");
+	}
+	else if(ScHostCpu->Irql > APC_LEVEL)
+		SCHostFatal("KeWaitForSingleObject at IRQL %d", ScHostCpu->Irql);
+	else if(SCHostRaceRunning(NULL, NULL))
+		SCHostFatal("KeWaitForSingleObject on %p racing, waits aren't simulated there", Object);
+
+	deadline = 0;
+	if(Timeout != NULL)
+	{
+		if(Timeout->QuadPart <= 0)
+			deadline = SCHostNow() + (ULONGLONG)-Timeout->QuadPart;
+		else if((ULONGLONG)Timeout->QuadPart > ScHostBootTime)
+			deadline = (ULONGLONG)Timeout->QuadPart - ScHostBootTime;
+	}
+
+	for(;;)
+	{
+		if(header->SignalState > 0)
+		{
+			if(header->Type == SCHOST_EVENT_SYNCHRONIZATION)
+				header->SignalState = 0;
+			return STATUS_SUCCESS;
+		}
+
+		if((Timeout != NULL) && (SCHostNow() >= deadline))
+			return STATUS_TIMEOUT;
+
+		if(ScHostRunDpcs())
+			continue;
+
+		due = SCHostNextDue(&next);
+		if((Timeout != NULL) && (!due || (deadline < next)))
+		{
+			next = deadline;
+			due = TRUE;
+		}
+		if(!due)
+			SCHostFatal("wait on %p that nothing left can signal", Object);
+
+		ScHostWaitUntil(next);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  The loop
+//
+VOID SCHostInitializeWorkItem(PSCHOST_WORK_ITEM Item, PSCHOST_WORK_ROUTINE Routine, PVOID Context)
+{
+	Item->Routine = Routine;
+	Item->Context = Context;
+	Item->Queued = FALSE;
+	InitializeListHead(&Item->Link);
+}
+
+BOOLEAN SCHostQueueWorkItem(PSCHOST_WORK_ITEM Item)
+{
+	if(Item->Queued)
+		return FALSE;
+
+	Item->Queued = TRUE;
+	InsertTailList(&ScHostWorkQueue, &Item->Link);
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostNextDue
+//      Finds when the next timer expires
+//
+//  Arguments:
+//      OUT Time
+//              when, 100ns units since boot
+//
+//  Return Value:
+//      FALSE if no timer is set
+//
+BOOLEAN SCHostNextDue(PULONGLONG Time)
+{
+	if(IsListEmpty(&ScHostTimerQueue))
+		return FALSE;
+
+	*Time = CONTAINING_RECORD(ScHostTimerQueue.Flink, KTIMER, TimerListEntry)->DueTime;
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRunPending
+//      Runs what is ready without moving the clock: expired timers, DPCs,
+//      then work items, going back to DPCs after each work item
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      TRUE if anything ran
+//
+BOOLEAN SCHostRunPending(VOID)
+{
+	PSCHOST_WORK_ITEM	item;
+	BOOLEAN				ran;
+
+	if(ScHostCpu->Irql != PASSIVE_LEVEL)
+		SCHostFatal("SCHostRunPending at IRQL %d", ScHostCpu->Irql);
+	if(SCHostRaceRunning(NULL, NULL))
+		SCHostFatal("SCHostRunPending while racing");
+
+	ran = FALSE;
+	for(;;)
+	{
+		if(ScHostRunDpcs())
+			ran = TRUE;
+
+		if(IsListEmpty(&ScHostWorkQueue))
+			break;
+
+		item = CONTAINING_RECORD(RemoveHeadList(&ScHostWorkQueue), SCHOST_WORK_ITEM, Link);
+		item->Queued = FALSE;
+		g_SCHostStats.WorkItems++;
+
+		item->Routine(item->Context);
+		if(ScHostCpu->Irql != PASSIVE_LEVEL)
+			SCHostFatal("work routine %p returned at IRQL %d", item->Routine, ScHostCpu->Irql);
+		if(ScHostCpu->LocksHeld != 0)
+			SCHostFatal("work routine %p returned holding a spin lock", item->Routine);
+		ran = TRUE;
+	}
+
+	return ran;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRunUntil
+//      Runs everything that comes due up to a time, and leaves the clock
+//      there
+//
+//  Arguments:
+//      IN  Time
+//              100ns units since boot
+//
+//  Return Value:
+//      None
+//
+VOID SCHostRunUntil(ULONGLONG Time)
+{
+	ULONGLONG	next;
+
+	for(;;)
+	{
+		SCHostRunPending();
+
+		if(!SCHostNextDue(&next) || (next > Time))
+			break;
+		ScHostWaitUntil(next);
+	}
+
+	if(SCHostNow() < Time)
+		ScHostWaitUntil(Time);
+	SCHostRunPending();
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostCheckLeaks
+//      Reports what is left once the driver is unloaded: pool not freed,
+//      by tag, IRPs not freed, and timers, DPCs and work items still queued
+//
+//  Arguments:
+//      None
+//
+//  Return Value:
+//      number of things left, 0 for a clean unload
+//
+ULONG SCHostCheckLeaks(VOID)
+{
+	PSCHOST_POOL_HEADER	header;
+	PLIST_ENTRY			entry;
+	ULONG				left;
+
+	left = 0;
+	for(entry = ScHostPool.Flink; entry != &ScHostPool; entry = entry->Flink)
+	{
+		header = CONTAINING_RECORD(entry, SCHOST_POOL_HEADER, Link);
+		if(left < SCHOST_LEAKS_SHOWN)
+			fprintf(stderr, "schost: pool %p tagged %.4s, %zu bytes, not freed\n",
+				(PUCHAR)header + SCHOST_POOL_ALIGN, (char *)&header->Tag, (size_t)header->Size);
+		left++;
+	}
+	if(left > SCHOST_LEAKS_SHOWN)
+		fprintf(stderr, "schost: %u more pool blocks not freed\n", left - SCHOST_LEAKS_SHOWN);
+
+	if(g_SCHostStats.IrpsOutstanding != 0)
+		fprintf(stderr, "schost: %llu IRPs not freed\n", g_SCHostStats.IrpsOutstanding);
+	left += (ULONG)g_SCHostStats.IrpsOutstanding;
+
+	for(entry = ScHostTimerQueue.Flink; entry != &ScHostTimerQueue; entry = entry->Flink, left++)
+		fprintf(stderr, "schost: timer %p still set\n", CONTAINING_RECORD(entry, KTIMER, TimerListEntry));
+	for(entry = ScHostDpcQueue.Flink; entry != &ScHostDpcQueue; entry = entry->Flink, left++)
+		fprintf(stderr, "schost: DPC %p still queued\n", CONTAINING_RECORD(entry, KDPC, DpcListEntry));
+	for(entry = ScHostWorkQueue.Flink; entry != &ScHostWorkQueue; entry = entry->Flink, left++)
+		fprintf(stderr, "schost: work item %p still queued\n", CONTAINING_RECORD(entry, SCHOST_WORK_ITEM, Link));
+
+	return left;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCHostRandom
+//      Next of a seeded sequence, xorshift64*. Anything random in a
+//      simulation comes from one of these so a run repeats with its seed.
+//
+//  Arguments:
+//      IN OUT State
+//              the sequence, its seed to start; 0 is taken as 1
+//
+//  Return Value:
+//      32 random bits
+//
+ULONG SCHostRandom(PULONGLONG State)
+{
+	ULONGLONG	x;
+
+	x = (*State != 0) ? *State : 1;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*State = x;
+	return (ULONG)((x * 2685821657736338717ULL) >> 32);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Strings
+//
+size_t SCHostWcslen(const WCHAR * String)
+{
+	size_t	length;
+
+	for(length = 0; String[length] != 0; length++)
+		;
+	return length;
+}
+
+char * SCHostNarrow(PCWSTR Wide, char * Narrow, size_t Size)
+{
+	size_t	i;
+
+	for(i = 0; (i + 1 < Size) && (Wide[i] != 0); i++)
+		Narrow[i] = (Wide[i] < 0x80) ? (char)Wide[i] : '?';
+	if(Size != 0)
+		Narrow[i] = 0;
+	return Narrow;
+}
+
+VOID RtlInitUnicodeString(PUNICODE_STRING Destination, PCWSTR Source)
+{
+	Destination->Buffer = (PWSTR)Source;
+	Destination->Length = 0;
+	Destination->MaximumLength = 0;
+	if(Source != NULL)
+	{
+		Destination->Length = (USHORT)(wcslen(Source) * sizeof(WCHAR));
+		Destination->MaximumLength = Destination->Length + sizeof(WCHAR);
+	}
+}
+
+// appends what fits, and a terminator if there is room for it
+static NTSTATUS ScHostAppendUnicode(PUNICODE_STRING Destination, const WCHAR * Source, USHORT Length)
+{
+	if((ULONG)Destination->Length + Length > Destination->MaximumLength)
+		return STATUS_BUFFER_TOO_SMALL;
+
+	memmove((PUCHAR)Destination->Buffer + Destination->Length, Source, Length);
+	Destination->Length += Length;
+	if(Destination->Length + sizeof(WCHAR) <= Destination->MaximumLength)
+		Destination->Buffer[Destination->Length / sizeof(WCHAR)] = UNICODE_NULL;
+	return STATUS_SUCCESS;
+}
+
+VOID RtlCopyUnicodeString(PUNICODE_STRING Destination, PCUNICODE_STRING Source)
+{
+	Destination->Length = 0;
+	if(Source != NULL)
+		ScHostAppendUnicode(Destination, Source->Buffer, min(Source->Length, Destination->MaximumLength));
+}
+
+NTSTATUS RtlAppendUnicodeToString(PUNICODE_STRING Destination, PCWSTR Source)
+{
+	if(Source == NULL)
+		return STATUS_SUCCESS;
+	return ScHostAppendUnicode(Destination, Source, (USHORT)(wcslen(Source) * sizeof(WCHAR)));
+}
+
+NTSTATUS RtlAppendUnicodeStringToString(PUNICODE_STRING Destination, PCUNICODE_STRING Source)
+{
+	return ScHostAppendUnicode(Destination, Source->Buffer, Source->Length);
+}
+
+NTSTATUS RtlIntegerToUnicodeString(ULONG Value, ULONG Base, PUNICODE_STRING String)
+{
+	char	digits[40];
+	WCHAR	wide[40];
+	int		i;
+	int		length;
+
+	if(Base == 0)
+		Base = 10;
+	if((Base != 2) && (Base != 8) && (Base != 10) && (Base != 16))
+		return STATUS_INVALID_PARAMETER;
+
+	length = 0;
+	do
+	{
+		digits[length++] = "0123456789ABCDEF"[Value % Base];
+		Value /= Base;
+	} while(Value != 0);
+
+	for(i = 0; i < length; i++)
+		wide[i] = digits[length - 1 - i];
+
+	if((length + 1) * sizeof(WCHAR) > String->MaximumLength)
+		return STATUS_BUFFER_OVERFLOW;
+
+	memcpy(String->Buffer, wide, length * sizeof(WCHAR));
+	String->Buffer[length] = UNICODE_NULL;
+	String->Length = (USHORT)(length * sizeof(WCHAR));
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS RtlUnicodeStringToAnsiString(PANSI_STRING Destination, PCUNICODE_STRING Source, BOOLEAN Allocate)
+{
+	ULONG	length;
+	ULONG	i;
+
+	length = Source->Length / sizeof(WCHAR);
+	if(Allocate)
+	{
+		Destination->Buffer = ExAllocatePoolWithTag(PagedPool, length + 1, 'grtS');
+		if(Destination->Buffer == NULL)
+			return STATUS_INSUFFICIENT_RESOURCES;
+		Destination->MaximumLength = (USHORT)(length + 1);
+	}
+	else if(length >= Destination->MaximumLength)
+		return STATUS_BUFFER_OVERFLOW;
+
+	for(i = 0; i < length; i++)
+		Destination->Buffer[i] = (Source->Buffer[i] < 0x80) ? (CHAR)Source->Buffer[i] : '?';
+	Destination->Buffer[length] = ANSI_NULL;
+	Destination->Length = (USHORT)length;
+	return STATUS_SUCCESS;
+}
+
+VOID RtlFreeAnsiString(PANSI_STRING String)
+{
+	if(String->Buffer != NULL)
+		ExFreePoolWithTag(String->Buffer, 'grtS');
+	String->Buffer = NULL;
+	String->Length = String->MaximumLength = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ntstrsafe
+//
+#define SCHOST_STRSAFE_MAX		0x7fffffff
+
+NTSTATUS RtlStringCbLengthA(PCSTR String, size_t Size, size_t * Length)
+{
+	size_t	i;
+
+	if((String == NULL) || (Size > SCHOST_STRSAFE_MAX))
+		return STATUS_INVALID_PARAMETER;
+
+	for(i = 0; i < Size; i++)
+		if(String[i] == 0)
+		{
+			if(Length != NULL)
+				*Length = i;
+			return STATUS_SUCCESS;
+		}
+
+	if(Length != NULL)
+		*Length = 0;
+	return STATUS_INVALID_PARAMETER;
+}
+
+NTSTATUS RtlStringCbCopyW(PWSTR Destination, size_t Size, PCWSTR Source)
+{
+	size_t	room;
+	size_t	i;
+
+	room = Size / sizeof(WCHAR);
+	if((room == 0) || (Size > SCHOST_STRSAFE_MAX))
+		return STATUS_INVALID_PARAMETER;
+
+	for(i = 0; (i + 1 < room) && (Source[i] != 0); i++)
+		Destination[i] = Source[i];
+	Destination[i] = UNICODE_NULL;
+	return (Source[i] == 0) ? STATUS_SUCCESS : STATUS_BUFFER_OVERFLOW;
+}
+
+NTSTATUS RtlStringCbVPrintfA(PSTR Destination, size_t Size, PCSTR Format, va_list Arguments)
+{
+	int	length;
+
+	if((Size == 0) || (Size > SCHOST_STRSAFE_MAX))
+		return STATUS_INVALID_PARAMETER;
+
+	length = vsnprintf(Destination, Size, Format, Arguments);
+	if(length < 0)
+	{
+		Destination[0] = 0;
+		return STATUS_INVALID_PARAMETER;
+	}
+	return ((size_t)length >= Size) ? STATUS_BUFFER_OVERFLOW : STATUS_SUCCESS;
+}
+
+NTSTATUS RtlStringCbPrintfA(PSTR Destination, size_t Size, PCSTR Format, ...)
+{
+	va_list		args;
+	NTSTATUS	status;
+
+	va_start(args, Format);
+	status = RtlStringCbVPrintfA(Destination, Size, Format, args);
+	va_end(args);
+	return status;
+}
+
+NTSTATUS RtlStringCbPrintfW(PWSTR Destination, size_t Size, PCWSTR Format, ...)
+{
+	char		format[256];
+	char		narrow[256];
+	va_list		args;
+	NTSTATUS	status;
+	size_t		room;
+	size_t		i;
+
+	room = Size / sizeof(WCHAR);
+	if((room == 0) || (Size > SCHOST_STRSAFE_MAX))
+		return STATUS_INVALID_PARAMETER;
+
+	va_start(args, Format);
+	status = RtlStringCbVPrintfA(narrow, min(room, sizeof(narrow)), SCHostNarrow(Format, format, sizeof(format)), args);
+	va_end(args);
+
+	for(i = 0; narrow[i] != 0; i++)
+		Destination[i] = (UCHAR)narrow[i];
+	Destination[i] = UNICODE_NULL;
+	return status;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  Registry
+//
+//  One flat list of values, filled by the harness with SCHostRegistrySetValue
+//  and by the driver with RtlWriteRegistryValue. A key exists when it or a
+//  key under it has been given a value.
+//
+static VOID ScHostRegistryPath(char * Path, size_t Size, PCSTR Parent, const WCHAR * Name, size_t Length)
+{
+	size_t	used;
+	size_t	i;
+
+	used = 0;
+	if((Parent != NULL) && (Parent[0] != 0))
+		used = (size_t)snprintf(Path, Size, "%s\\", Parent);
+
+	for(i = 0; (i < Length) && (Name[i] != 0) && (used + 1 < Size); i++)
+		Path[used++] = (char)tolower((Name[i] < 0x80) ? (char)Name[i] : '?');
+	while((used > 0) && (Path[used - 1] == '\\'))
+		used--;
+	Path[used] = 0;
+}
+
+static PSCHOST_REG_VALUE ScHostRegistryFind(PCSTR Key, PCSTR Name)
+{
+	PSCHOST_REG_VALUE	value;
+
+	for(value = ScHostRegistry; value != NULL; value = value->Next)
+		if((value->Name != NULL) && !strcmp(value->Key, Key) && !strcmp(value->Name, Name))
+			return value;
+	return NULL;
+}
+
+static BOOLEAN ScHostRegistryKeyExists(PCSTR Key)
+{
+	PSCHOST_REG_VALUE	value;
+	size_t				length;
+
+	length = strlen(Key);
+	for(value = ScHostRegistry; value != NULL; value = value->Next)
+		if(!strncmp(value->Key, Key, length) && ((value->Key[length] == 0) || (value->Key[length] == '\\')))
+			return TRUE;
+	return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScHostRegistrySet
+//      Sets a value, replacing any of the same name
+//
+//  Arguments:
+//      IN  Key
+//              full path, lower case
+//
+//      IN  Name
+//              value name, lower case; NULL only creates the key
+//
+//      IN  Type
+//              REG_xxx
+//
+//      IN  Data
+//              the value
+//
+//      IN  Length
+//              bytes of it
+//
+//  Return Value:
+//      STATUS_SUCCESS or STATUS_INSUFFICIENT_RESOURCES
+//
+static NTSTATUS ScHostRegistrySet(PCSTR Key, PCSTR Name, ULONG Type, const VOID * Data, ULONG Length)
+{
+	PSCHOST_REG_VALUE *	link;
+	PSCHOST_REG_VALUE	value;
+
+	for(link = &ScHostRegistry; *link != NULL; link = &(*link)->Next)
+		if(((*link)->Name != NULL) && (Name != NULL) && !strcmp((*link)->Key, Key) && !strcmp((*link)->Name, Name))
+		{
+			value = *link;
+			*link = value->Next;
+			free(value->Key);
+			free(value->Name);
+			free(value);
+			break;
+		}
+
+	value = malloc(FIELD_OFFSET(SCHOST_REG_VALUE, Data) + Length);
+	if(value == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	value->Key = strdup(Key);
+	value->Name = (Name != NULL) ? strdup(Name) : NULL;
+	value->Type = Type;
+	value->Length = Length;
+	memcpy(value->Data, Data, Length);
+
+	value->Next = ScHostRegistry;
+	ScHostRegistry = value;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS SCHostRegistrySetValue(PCWSTR Key, PCWSTR Name, ULONG Type, const VOID * Data, ULONG Length)
+{
+	char	key[SCHOST_KEY_PATH];
+	char	name[256];
+
+	ScHostRegistryPath(key, sizeof(key), NULL, Key, wcslen(Key));
+	if(Name == NULL)
+		return ScHostRegistrySet(key, NULL, REG_NONE, NULL, 0);
+
+	ScHostRegistryPath(name, sizeof(name), NULL, Name, wcslen(Name));
+	return ScHostRegistrySet(key, name, Type, Data, Length);
+}
+
+VOID SCHostRegistryFree(VOID)
+{
+	PSCHOST_REG_VALUE	value;
+
+	while((value = ScHostRegistry) != NULL)
+	{
+		ScHostRegistry = value->Next;
+		free(value->Key);
+		free(value->Name);
+		free(value);
+	}
+}
+
+NTSTATUS ZwOpenKey(PHANDLE KeyHandle, ACCESS_MASK DesiredAccess, POBJECT_ATTRIBUTES ObjectAttributes)
+{
+	PSCHOST_KEY	parent;
+	PSCHOST_KEY	key;
+
+	if(ScHostCpu->Irql != PASSIVE_LEVEL)
+		SCHostFatal("ZwOpenKey at IRQL %d", ScHostCpu->Irql);
+
+	parent = (PSCHOST_KEY)ObjectAttributes->RootDirectory;
+	if((parent != NULL) && (parent->Magic != SCHOST_KEY_MAGIC))
+		SCHostFatal("ZwOpenKey relative to %p, not an open key", parent);
+
+	key = malloc(sizeof(SCHOST_KEY));
+	if(key == NULL)
+		return STATUS_INSUFFICIENT_RESOURCES;
+
+	key->Magic = SCHOST_KEY_MAGIC;
+	ScHostRegistryPath(key->Path, sizeof(key->Path), (parent != NULL) ? parent->Path : NULL,
+		ObjectAttributes->ObjectName->Buffer, ObjectAttributes->ObjectName->Length / sizeof(WCHAR));
+
+	if(!ScHostRegistryKeyExists(key->Path))
+	{
+		free(key);
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+	}
+
+	*KeyHandle = key;
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS ZwClose(HANDLE Handle)
+{
+	PSCHOST_KEY	key;
+
+	key = (PSCHOST_KEY)Handle;
+	if((key == NULL) || (key->Magic != SCHOST_KEY_MAGIC))
+		SCHostFatal("ZwClose of %p, not an open key", Handle);
+
+	key->Magic = 0;
+	free(key);
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ZwQueryValueKey
+//      Reads a value, as KeyValuePartialInformation only
+//
+//  Arguments:
+//      as the DDK's
+//
+//  Return Value:
+//      STATUS_SUCCESS, STATUS_OBJECT_NAME_NOT_FOUND, or, with ResultLength
+//      set to what is needed, STATUS_BUFFER_TOO_SMALL when not even the
+//      header fits and STATUS_BUFFER_OVERFLOW when the data doesn't
+//
+NTSTATUS ZwQueryValueKey(HANDLE KeyHandle, PUNICODE_STRING ValueName,
+	KEY_VALUE_INFORMATION_CLASS KeyValueInformationClass, PVOID KeyValueInformation, ULONG Length,
+	PULONG ResultLength)
+{
+	PSCHOST_KEY						key;
+	PSCHOST_REG_VALUE				value;
+	PKEY_VALUE_PARTIAL_INFORMATION	info;
+	char							name[256];
+	ULONG							needed;
+
+	if(ScHostCpu->Irql != PASSIVE_LEVEL)
+		SCHostFatal("ZwQueryValueKey at IRQL %d", ScHostCpu->Irql);
+	if(KeyValueInformationClass != KeyValuePartialInformation)
+		SCHostNotSimulated();
+
+	key = (PSCHOST_KEY)KeyHandle;
+	if((key == NULL) || (key->Magic != SCHOST_KEY_MAGIC))
+		SCHostFatal("ZwQueryValueKey of %p, not an open key", KeyHandle);
+
+	ScHostRegistryPath(name, sizeof(name), NULL, ValueName->Buffer, ValueName->Length / sizeof(WCHAR));
+	value = ScHostRegistryFind(key->Path, name);
+	if(value == NULL)
+		return STATUS_OBJECT_NAME_NOT_FOUND;
+
+	needed = FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data) + value->Length;
+	*ResultLength = needed;
+	if(Length < (ULONG)FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data))
+		return STATUS_BUFFER_TOO_SMALL;
+
+	info = (PKEY_VALUE_PARTIAL_INFORMATION)KeyValueInformation;
+	info->TitleIndex = 0;
+	info->Type = value->Type;
+	info->DataLength = value->Length;
+	if(Length < needed)
+		return STATUS_BUFFER_OVERFLOW;
+
+	memcpy(info->Data, value->Data, value->Length);
+	return STATUS_SUCCESS;
+}
+
+NTSTATUS ZwEnumerateKey(HANDLE KeyHandle, ULONG Index, KEY_INFORMATION_CLASS KeyInformationClass,
+	PVOID KeyInformation, ULONG Length, PULONG ResultLength)
+{
+	SCHostNotSimulated();
+}
+
+NTSTATUS ZwEnumerateValueKey(HANDLE KeyHandle, ULONG Index,
+	KEY_VALUE_INFORMATION_CLASS KeyValueInformationClass, PVOID KeyValueInformation, ULONG Length,
+	PULONG ResultLength)
+{
+	SCHostNotSimulated();
+}
+
+static PCSTR ScHostRtlRegistryRoot(ULONG RelativeTo)
+{
+	switch(RelativeTo)
+	{
+	case RTL_REGISTRY_ABSOLUTE:
+		return NULL;
+	case RTL_REGISTRY_SERVICES:
+		return "\\registry\\machine\\system\\currentcontrolset\\services";
+	case RTL_REGISTRY_CONTROL:
+		return "\\registry\\machine\\system\\currentcontrolset\\control";
+	case RTL_REGISTRY_WINDOWS_NT:
+		return "\\registry\\machine\\software\\microsoft\\windows nt\\currentversion";
+	case RTL_REGISTRY_DEVICEMAP:
+		return "\\registry\\machine\\hardware\\devicemap";
+	}
+	SCHostFatal("registry relative to %u", RelativeTo);
+}
+
+NTSTATUS RtlWriteRegistryValue(ULONG RelativeTo, PCWSTR Path, PCWSTR ValueName, ULONG ValueType,
+	PVOID ValueData, ULONG ValueLength)
+{
+	char	key[SCHOST_KEY_PATH];
+	char	name[256];
+
+	if(ScHostCpu->Irql != PASSIVE_LEVEL)
+		SCHostFatal("RtlWriteRegistryValue at IRQL %d", ScHostCpu->Irql);
+
+	ScHostRegistryPath(key, sizeof(key), ScHostRtlRegistryRoot(RelativeTo), Path, wcslen(Path));
+	ScHostRegistryPath(name, sizeof(name), NULL, ValueName, wcslen(ValueName));
+	return ScHostRegistrySet(key, name, ValueType, ValueData, ValueLength);
+}
+
+NTSTATUS RtlDeleteRegistryValue(ULONG RelativeTo, PCWSTR Path, PCWSTR ValueName)
+{
+	PSCHOST_REG_VALUE *	link;
+	PSCHOST_REG_VALUE	value;
+	char				key[SCHOST_KEY_PATH];
+	char				name[256];
+
+	if(ScHostCpu->Irql != PASSIVE_LEVEL)
+		SCHostFatal("RtlDeleteRegistryValue at IRQL %d", ScHostCpu->Irql);
+
+	ScHostRegistryPath(key, sizeof(key), ScHostRtlRegistryRoot(RelativeTo), Path, wcslen(Path));
+	ScHostRegistryPath(name, sizeof(name), NULL, ValueName, wcslen(ValueName));
+
+	for(link = &ScHostRegistry; *link != NULL; link = &(*link)->Next)
+		if(((*link)->Name != NULL) && !strcmp((*link)->Key, key) && !strcmp((*link)->Name, name))
+		{
+			value = *link;
+			*link = value->Next;
+			free(value->Key);
+			free(value->Name);
+			free(value);
+			return STATUS_SUCCESS;
+		}
+
+	return STATUS_OBJECT_NAME_NOT_FOUND;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  WMI, there is none on the host
+//
+NTSTATUS WmiSystemControl(PWMILIB_CONTEXT WmiLibInfo, PDEVICE_OBJECT DeviceObject, PIRP Irp,
+	PSYSCTL_IRP_DISPOSITION IrpDisposition)
+{
+	*IrpDisposition = IrpForward;
+	return Irp->IoStatus.Status;
+}
+
+NTSTATUS WmiCompleteRequest(PDEVICE_OBJECT DeviceObject, PIRP Irp, NTSTATUS Status, ULONG BufferUsed,
+	CCHAR PriorityBoost)
+{
+	SCHostNotSimulated();
+}
@@ -0,0 +1,149 @@
+// shim.h
+//
+// The host side of the kernel shim: the clock, the loop that runs timers,
+// DPCs and work items, and the settings a harness makes before loading the
+// driver. ddk/wdm.h is the driver's side of the same shim.
+//
+// Everything runs on one thread. Kernel code that would run on another
+// processor or in a DPC runs from the loop instead, at the IRQL it would
+// have, so the order things happen in is decided by the harness alone and
+// a run is repeated exactly by repeating its inputs. A harness racing
+// code on several processors has race.c interleave them, still on the
+// one thread and decided by a seed.
+//
+// The clock is virtual, standing still until the harness or a wait moves
+// it on to the next thing due, or real, the host's monotonic clock. Either
+// way it counts 100ns units from boot; the performance counter runs at
+// 10MHz on it, and system time is a boot time the harness picks plus it.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCHOST_SHIM_H__
+#define __SCHOST_SHIM_H__
+
+#include <wdm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCHOST_CLOCK_VIRTUAL	0		// moves only when told to or when waiting on a timer
+#define SCHOST_CLOCK_REAL		1		// the host's monotonic clock
+
+#define SCHOST_PERF_FREQUENCY	10000000
+
+// a call from the loop at PASSIVE_LEVEL, the harness's stand-in for a
+// thread of its own. The item belongs to the caller, as a KDPC does.
+typedef VOID (*PSCHOST_WORK_ROUTINE)(PVOID Context);
+
+typedef struct _SCHOST_WORK_ITEM
+{
+	LIST_ENTRY				Link;
+	PSCHOST_WORK_ROUTINE	Routine;
+	PVOID					Context;
+	BOOLEAN					Queued;
+} SCHOST_WORK_ITEM, *PSCHOST_WORK_ITEM;
+
+// counts the harness reports at the end of a run
+typedef struct _SCHOST_SHIM_STATS
+{
+	ULONGLONG				Allocations;
+	ULONGLONG				Outstanding;		// allocations not freed yet
+	ULONGLONG				OutstandingBytes;
+	ULONGLONG				Irps;
+	ULONGLONG				IrpsOutstanding;
+	ULONGLONG				Dpcs;
+	ULONGLONG				Timers;				// expired, not cancelled
+	ULONGLONG				WorkItems;
+} SCHOST_SHIM_STATS, *PSCHOST_SHIM_STATS;
+
+extern SCHOST_SHIM_STATS	g_SCHostStats;
+
+// set before the driver is loaded
+VOID SCHostClockInit(int Mode, ULONGLONG BootTime);
+VOID SCHostSetProcessors(ULONG Count);
+VOID SCHostSetDebugOutput(BOOLEAN Enable);
+
+// whether the application SCHostIoctl stands for holds the privileges
+// SeSinglePrivilegeCheck asks about, by default it doesn't
+VOID SCHostSetPrivileged(BOOLEAN Privileged);
+
+// the clock and the loop
+ULONGLONG SCHostNow(VOID);
+BOOLEAN SCHostNextDue(PULONGLONG Time);
+VOID SCHostRunUntil(ULONGLONG Time);
+BOOLEAN SCHostRunPending(VOID);
+
+// what is left over, for after the driver is unloaded
+ULONG SCHostCheckLeaks(VOID);
+
+// pseudo-random numbers for the simulations, the same for the same seed
+ULONG SCHostRandom(PULONGLONG State);
+
+VOID SCHostInitializeWorkItem(PSCHOST_WORK_ITEM Item, PSCHOST_WORK_ROUTINE Routine, PVOID Context);
+BOOLEAN SCHostQueueWorkItem(PSCHOST_WORK_ITEM Item);
+
+// the registry the driver reads its parameters from, keys named as the
+// kernel does, \Registry\Machine\...
+NTSTATUS SCHostRegistrySetValue(PCWSTR Key, PCWSTR Name, ULONG Type, const VOID * Data, ULONG Length);
+VOID SCHostRegistryFree(VOID);
+
+// a narrow string for a wide one, up to Size - 1 characters
+char * SCHostNarrow(PCWSTR Wide, char * Narrow, size_t Size);
+
+// stops the run with a message, for a driver doing what a real kernel
+// would bug check on and for what the shim doesn't do yet
+VOID SCHostFatal(PCSTR Format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+#define SCHostNotSimulated()	SCHostFatal("%s is not simulated yet", __func__)
+
+// race.c, see there
+typedef VOID (*PSCHOST_TASK_ROUTINE)(PVOID Context);
+
+// something one processor does in a race, at an IRQL
+typedef struct _SCHOST_TASK
+{
+	PSCHOST_TASK_ROUTINE	Routine;
+	PVOID					Context;
+	KIRQL					Irql;				// PASSIVE_LEVEL as a thread, DISPATCH_LEVEL as a DPC
+} SCHOST_TASK, *PSCHOST_TASK;
+
+// checks what the processors share between switches: NULL, or what is wrong
+typedef PCSTR (*PSCHOST_RACE_CHECK)(PVOID Context);
+
+typedef struct _SCHOST_RACE
+{
+	ULONGLONG				Seed;
+	ULONG					Depth;				// priority changes + 1, PCT's d; 0 for a random pick at every point
+	ULONG					Steps;				// points a race is expected to take, PCT's k
+	PSCHOST_RACE_CHECK		Check;				// optional
+	PVOID					CheckContext;
+
+	// what happened
+	ULONG					Points;
+	ULONG					Switches;			// points where another processor was picked
+	ULONG					Spins;				// points a processor was waiting on a lock
+	PCSTR					Failure;			// from Check
+} SCHOST_RACE, *PSCHOST_RACE;
+
+#define SCHOST_RACE_MAX		8					// processors
+
+NTSTATUS SCHostRace(PSCHOST_TASK Tasks, ULONG Count, PSCHOST_RACE Race);
+BOOLEAN SCHostRaceRunning(PULONGLONG Seed, PULONG Point);
+BOOLEAN SCHostRaceSpin(PKSPIN_LOCK SpinLock);
+VOID SCHostSetProcessor(ULONG Number);
+ULONG SCHostGetProcessors(VOID);
+ULONG SCHostGetLocksHeld(VOID);
+
+// io.c
+PDRIVER_OBJECT SCHostCreateDriver(PCWSTR Name, PDRIVER_DISPATCH DefaultDispatch);
+VOID SCHostDeleteDriver(PDRIVER_OBJECT DriverObject);
+PDEVICE_OBJECT SCHostFindDevice(PCWSTR Name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCHOST_SHIM_H__
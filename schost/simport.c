@@ -0,0 +1,1054 @@
+// simport.c
+//
+// The simulated serial port, see simport.h. One driver object serves all
+// the ports created.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdlib.h>
+
+#include <wdm.h>
+#include "shim.h"
+#include "simport.h"
+
+#define SCSIMPORT_POOL_TAG		'PmiS'
+
+// how the current read waits, from the timeouts it started with
+#define SCSIMPORT_READ_FULL		0		// until it is full, or timed out
+#define SCSIMPORT_READ_NOW		1		// not at all, it returns what there is
+#define SCSIMPORT_READ_ANY		2		// until there is anything, or timed out
+
+// character times the UART waits below its trigger before interrupting
+#define SCSIMPORT_CHAR_TIMEOUT	4
+
+static PDRIVER_OBJECT	ScSimPortDriver;
+static ULONG			ScSimPortCount;
+
+// the settings the port keeps, and the IOCTLs that set and get them
+typedef struct _SCSIMPORT_SETTING
+{
+	ULONG	SetCode;
+	ULONG	GetCode;
+	ULONG	Offset;			// of the field in SCSIMPORT
+	ULONG	Size;
+} SCSIMPORT_SETTING;
+
+static const SCSIMPORT_SETTING ScSimPortSettings[] =
+{
+	{ IOCTL_SERIAL_SET_BAUD_RATE,		IOCTL_SERIAL_GET_BAUD_RATE,
+		FIELD_OFFSET(SCSIMPORT, BaudRate),		sizeof(SERIAL_BAUD_RATE) },
+	{ IOCTL_SERIAL_SET_LINE_CONTROL,	IOCTL_SERIAL_GET_LINE_CONTROL,
+		FIELD_OFFSET(SCSIMPORT, LineControl),	sizeof(SERIAL_LINE_CONTROL) },
+	{ IOCTL_SERIAL_SET_TIMEOUTS,		IOCTL_SERIAL_GET_TIMEOUTS,
+		FIELD_OFFSET(SCSIMPORT, Timeouts),		sizeof(SERIAL_TIMEOUTS) },
+	{ IOCTL_SERIAL_SET_CHARS,			IOCTL_SERIAL_GET_CHARS,
+		FIELD_OFFSET(SCSIMPORT, Chars),			sizeof(SERIAL_CHARS) },
+	{ IOCTL_SERIAL_SET_HANDFLOW,		IOCTL_SERIAL_GET_HANDFLOW,
+		FIELD_OFFSET(SCSIMPORT, HandFlow),		sizeof(SERIAL_HANDFLOW) },
+	{ IOCTL_SERIAL_SET_WAIT_MASK,		IOCTL_SERIAL_GET_WAIT_MASK,
+		FIELD_OFFSET(SCSIMPORT, WaitMask),		sizeof(ULONG) },
+};
+
+#define SCSIMPORT_SETTINGS	(sizeof(ScSimPortSettings) / sizeof(ScSimPortSettings[0]))
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortComplete
+//      Completes an IRP
+//
+static NTSTATUS ScSimPortComplete(PIRP Irp, NTSTATUS Status, ULONG_PTR Information)
+{
+	Irp->IoStatus.Status = Status;
+	Irp->IoStatus.Information = Information;
+	IoCompleteRequest(Irp, (CCHAR)(NT_SUCCESS(Status) ? IO_SERIAL_INCREMENT : IO_NO_INCREMENT));
+	return Status;
+}
+
+// completes the reads taken off the queue, with the status and count set
+static VOID ScSimPortCompleteList(PLIST_ENTRY Completed)
+{
+	PIRP	irp;
+
+	while(!IsListEmpty(Completed))
+	{
+		irp = CONTAINING_RECORD(RemoveHeadList(Completed), IRP, Tail.Overlay.ListEntry);
+		ScSimPortComplete(irp, irp->IoStatus.Status, irp->IoStatus.Information);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortTake
+//      Copies buffered data into a read after what it has already, the
+//      port lock held
+//
+//  Arguments:
+//      IN  Port
+//              the port
+//
+//      IN  Irp
+//              the read, its IoStatus.Information the bytes it has
+//
+//  Return Value:
+//      bytes copied
+//
+static ULONG ScSimPortTake(PSCSIMPORT Port, PIRP Irp)
+{
+	ULONG	length;
+	ULONG	chunk;
+	PUCHAR	buffer;
+
+	length = IoGetCurrentIrpStackLocation(Irp)->Parameters.Read.Length - (ULONG)Irp->IoStatus.Information;
+	if(length > Port->Count)
+		length = Port->Count;
+
+	buffer = (PUCHAR)Irp->AssociatedIrp.SystemBuffer + Irp->IoStatus.Information;
+	chunk = min(length, SCSIMPORT_RING_SIZE - Port->Head);
+	RtlCopyMemory(buffer, Port->Ring + Port->Head, chunk);
+	RtlCopyMemory(buffer + chunk, Port->Ring, length - chunk);
+
+	Port->Head = (Port->Head + length) % SCSIMPORT_RING_SIZE;
+	Port->Count -= length;
+	Port->Stats.BytesRead += length;
+	Irp->IoStatus.Information += length;
+	return length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortAppend
+//      Buffers what the UART has delivered, the port lock held; what the
+//      ring has no room for is dropped
+//
+static VOID ScSimPortAppend(PSCSIMPORT Port, const UCHAR * Data, ULONG Length)
+{
+	ULONG	tail;
+	ULONG	chunk;
+
+	Port->Stats.BytesReceived += Length;
+	if(Length > SCSIMPORT_RING_SIZE - Port->Count)
+	{
+		Port->Stats.BytesDropped += Length - (SCSIMPORT_RING_SIZE - Port->Count);
+		Length = SCSIMPORT_RING_SIZE - Port->Count;
+	}
+
+	tail = (Port->Head + Port->Count) % SCSIMPORT_RING_SIZE;
+	chunk = min(Length, SCSIMPORT_RING_SIZE - tail);
+	RtlCopyMemory(Port->Ring + tail, Data, chunk);
+	RtlCopyMemory(Port->Ring, Data + chunk, Length - chunk);
+	Port->Count += Length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortUnqueue
+//      Takes a pending read off the queue for completing, the port lock
+//      held. A read whose cancel routine is already on its way is left
+//      to it, with its entry made safe for it to remove again.
+//
+//  Arguments:
+//      IN  Irp
+//              the read, on the port's queue
+//
+//  Return Value:
+//      TRUE if the caller completes the read
+//
+static BOOLEAN ScSimPortUnqueue(PIRP Irp)
+{
+	RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+	if(IoSetCancelRoutine(Irp, NULL) != NULL)
+		return TRUE;
+
+	InitializeListHead(&Irp->Tail.Overlay.ListEntry);
+	return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortStartRead
+//      Makes a read the current one and sets its timeouts going, the port
+//      lock held
+//
+//  Arguments:
+//      IN  Port
+//              the port
+//
+//      IN  Irp
+//              the read, first on the queue
+//
+//  Return Value:
+//      None
+//
+static VOID ScSimPortStartRead(PSCSIMPORT Port, PIRP Irp)
+{
+	PSERIAL_TIMEOUTS	timeouts;
+	ULONGLONG			total;
+	LARGE_INTEGER		due;
+
+	timeouts = &Port->Timeouts;
+	Port->ReadStarted = TRUE;
+	Port->ReadMode = SCSIMPORT_READ_FULL;
+	Port->ReadInterval = 0;
+	Port->ReadDeadline = 0;
+	Port->IntervalDeadline = 0;
+
+	if(timeouts->ReadIntervalTimeout == MAXULONG)
+	{
+		if((timeouts->ReadTotalTimeoutMultiplier == 0) && (timeouts->ReadTotalTimeoutConstant == 0))
+		{
+			Port->ReadMode = SCSIMPORT_READ_NOW;
+			return;
+		}
+		if((timeouts->ReadTotalTimeoutMultiplier == MAXULONG) && (timeouts->ReadTotalTimeoutConstant != 0) &&
+			(timeouts->ReadTotalTimeoutConstant != MAXULONG))
+			Port->ReadMode = SCSIMPORT_READ_ANY;
+	}
+	else
+		Port->ReadInterval = (ULONGLONG)timeouts->ReadIntervalTimeout * 10000;
+
+	if(Port->ReadMode == SCSIMPORT_READ_ANY)
+		total = timeouts->ReadTotalTimeoutConstant;
+	else
+		total = (ULONGLONG)timeouts->ReadTotalTimeoutMultiplier *
+			IoGetCurrentIrpStackLocation(Irp)->Parameters.Read.Length + timeouts->ReadTotalTimeoutConstant;
+
+	if(total != 0)
+	{
+		Port->ReadDeadline = SCHostNow() + total * 10000;
+		due.QuadPart = -(LONGLONG)(total * 10000);
+		KeSetTimer(&Port->ReadTotalTimer, due, &Port->ReadTimeoutDpc);
+	}
+}
+
+// the current read is done with, its timers with it
+static VOID ScSimPortEndRead(PSCSIMPORT Port)
+{
+	KeCancelTimer(&Port->ReadTotalTimer);
+	KeCancelTimer(&Port->ReadIntervalTimer);
+	Port->ReadStarted = FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortServe
+//      Fills the current read from the buffer and takes it off the queue
+//      if that finishes it, then the next, the port lock held
+//
+//  Arguments:
+//      IN  Port
+//              the port
+//
+//      IN  Completed
+//              the reads finished go on here, for completing after the
+//              lock is released
+//
+//  Return Value:
+//      None
+//
+static VOID ScSimPortServe(PSCSIMPORT Port, PLIST_ENTRY Completed)
+{
+	PIRP			irp;
+	ULONG			length;
+	ULONG			taken;
+	LARGE_INTEGER	due;
+
+	while(!IsListEmpty(&Port->Reads))
+	{
+		irp = CONTAINING_RECORD(Port->Reads.Flink, IRP, Tail.Overlay.ListEntry);
+		if(!Port->ReadStarted)
+			ScSimPortStartRead(Port, irp);
+
+		taken = (Port->Count != 0) ? ScSimPortTake(Port, irp) : 0;
+		length = IoGetCurrentIrpStackLocation(irp)->Parameters.Read.Length;
+		if((irp->IoStatus.Information < length) && (Port->ReadMode != SCSIMPORT_READ_NOW) &&
+			((Port->ReadMode == SCSIMPORT_READ_FULL) || (irp->IoStatus.Information == 0)))
+		{
+			// the interval runs from the last characters in
+			if((taken != 0) && (Port->ReadInterval != 0))
+			{
+				Port->IntervalDeadline = SCHostNow() + Port->ReadInterval;
+				due.QuadPart = -(LONGLONG)Port->ReadInterval;
+				KeSetTimer(&Port->ReadIntervalTimer, due, &Port->ReadTimeoutDpc);
+			}
+			return;
+		}
+
+		ScSimPortEndRead(Port);
+		if(ScSimPortUnqueue(irp))
+		{
+			irp->IoStatus.Status = STATUS_SUCCESS;
+			InsertTailList(Completed, &irp->Tail.Overlay.ListEntry);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortReadTimeout
+//      DPC of both read timers. The current read is timed out with what
+//      it has if one of its deadlines has passed; a timer that went off
+//      for a read already finished finds the next one's still ahead.
+//
+static VOID ScSimPortReadTimeout(PKDPC Dpc, PVOID Context, PVOID Argument1, PVOID Argument2)
+{
+	PSCSIMPORT	port;
+	LIST_ENTRY	completed;
+	ULONGLONG	now;
+	PIRP		irp;
+
+	port = (PSCSIMPORT)Context;
+	InitializeListHead(&completed);
+	now = SCHostNow();
+
+	KeAcquireSpinLockAtDpcLevel(&port->Lock);
+	if(port->ReadStarted && !IsListEmpty(&port->Reads) &&
+		(((port->ReadDeadline != 0) && (now >= port->ReadDeadline)) ||
+		((port->IntervalDeadline != 0) && (now >= port->IntervalDeadline))))
+	{
+		irp = CONTAINING_RECORD(port->Reads.Flink, IRP, Tail.Overlay.ListEntry);
+		ScSimPortEndRead(port);
+		if(ScSimPortUnqueue(irp))
+		{
+			port->Stats.ReadsTimedOut++;
+			irp->IoStatus.Status = STATUS_TIMEOUT;
+			InsertTailList(&completed, &irp->Tail.Overlay.ListEntry);
+		}
+		ScSimPortServe(port, &completed);
+	}
+	KeReleaseSpinLockFromDpcLevel(&port->Lock);
+
+	ScSimPortCompleteList(&completed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortCancelRead
+//      Cancel routine of a pending read. It goes with what it had, and
+//      if it was the current one the next starts.
+//
+static VOID ScSimPortCancelRead(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+	PSCSIMPORT	port;
+	LIST_ENTRY	completed;
+	BOOLEAN		current;
+	KIRQL		oldIrql;
+
+	port = (PSCSIMPORT)DeviceObject->DeviceExtension;
+	IoReleaseCancelSpinLock(Irp->CancelIrql);
+	InitializeListHead(&completed);
+
+	KeAcquireSpinLock(&port->Lock, &oldIrql);
+	current = (BOOLEAN)(port->Reads.Flink == &Irp->Tail.Overlay.ListEntry);
+	RemoveEntryList(&Irp->Tail.Overlay.ListEntry);
+	if(current && port->ReadStarted)
+	{
+		ScSimPortEndRead(port);
+		ScSimPortServe(port, &completed);
+	}
+	KeReleaseSpinLock(&port->Lock, oldIrql);
+
+	port->Stats.ReadsCancelled++;
+	ScSimPortComplete(Irp, STATUS_CANCELLED, Irp->IoStatus.Information);
+	ScSimPortCompleteList(&completed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortQueueRead
+//      Queues a read behind any others, the port lock held
+//
+//  Arguments:
+//      IN  Port
+//              the port
+//
+//      IN  Irp
+//              the read
+//
+//  Return Value:
+//      FALSE if it was cancelled already and has to be completed so
+//
+static BOOLEAN ScSimPortQueueRead(PSCSIMPORT Port, PIRP Irp)
+{
+	IoSetCancelRoutine(Irp, ScSimPortCancelRead);
+	if(Irp->Cancel && (IoSetCancelRoutine(Irp, NULL) != NULL))
+		return FALSE;
+
+	Irp->IoStatus.Information = 0;
+	IoMarkIrpPending(Irp);
+	InsertTailList(&Port->Reads, &Irp->Tail.Overlay.ListEntry);
+	return TRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortCancelReads
+//      Completes all pending reads as cancelled, with what they had
+//
+static VOID ScSimPortCancelReads(PSCSIMPORT Port)
+{
+	LIST_ENTRY	cancelled;
+	PIRP		irp;
+	KIRQL		oldIrql;
+
+	InitializeListHead(&cancelled);
+
+	KeAcquireSpinLock(&Port->Lock, &oldIrql);
+	if(Port->ReadStarted)
+		ScSimPortEndRead(Port);
+	while(!IsListEmpty(&Port->Reads))
+	{
+		irp = CONTAINING_RECORD(Port->Reads.Flink, IRP, Tail.Overlay.ListEntry);
+		if(ScSimPortUnqueue(irp))
+		{
+			irp->IoStatus.Status = STATUS_CANCELLED;
+			InsertTailList(&cancelled, &irp->Tail.Overlay.ListEntry);
+			Port->Stats.ReadsCancelled++;
+		}
+	}
+	KeReleaseSpinLock(&Port->Lock, oldIrql);
+
+	ScSimPortCompleteList(&cancelled);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  The line and the UART
+//
+
+// half bits a character takes on the line, start and stop bits included
+static ULONG ScSimPortHalfBits(PSCSIMPORT Port)
+{
+	ULONG	bits;
+
+	bits = 1 + Port->LineControl.WordLength + ((Port->LineControl.Parity != NO_PARITY) ? 1 : 0);
+	switch(Port->LineControl.StopBits)
+	{
+	case STOP_BITS_1_5:
+		return 2 * bits + 3;
+	case STOP_BITS_2:
+		return 2 * bits + 4;
+	}
+	return 2 * bits + 2;
+}
+
+// 100ns a character takes, at least 1
+static ULONGLONG ScSimPortCharTime(PSCSIMPORT Port)
+{
+	ULONGLONG	time;
+
+	time = (ULONGLONG)ScSimPortHalfBits(Port) * 10000000 / (2 * (ULONGLONG)max(Port->BaudRate.BaudRate, 1));
+	return (time != 0) ? time : 1;
+}
+
+// clock the character Index characters on from WireOrigin has arrived by
+static ULONGLONG ScSimPortArrival(PSCSIMPORT Port, ULONGLONG Index)
+{
+	ULONGLONG	baud2;
+
+	baud2 = 2 * (ULONGLONG)max(Port->BaudRate.BaudRate, 1);
+	return Port->WireOrigin + ((Index + 1) * ScSimPortHalfBits(Port) * 10000000 + baud2 - 1) / baud2;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortLineAdvance
+//      Moves the characters that have arrived by now off the line into
+//      the FIFO, the port lock held. Those finding it full are overruns.
+//
+static VOID ScSimPortLineAdvance(PSCSIMPORT Port, ULONGLONG Now)
+{
+	ULONGLONG	arrival;
+
+	while(Port->WireCount != 0)
+	{
+		arrival = ScSimPortArrival(Port, Port->WireIndex);
+		if(arrival > Now)
+			break;
+
+		if(Port->FifoCount < Port->Line.FifoDepth)
+			Port->Fifo[Port->FifoCount++] = Port->Wire[Port->WireHead];
+		else
+			Port->Stats.Overruns++;
+
+		Port->WireHead = (Port->WireHead + 1) % SCSIMPORT_WIRE_SIZE;
+		Port->WireCount--;
+		Port->WireIndex++;
+		Port->LastArrival = arrival;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortUartSchedule
+//      Sets the UART timer for when the FIFO will next be drained, the
+//      port lock held and the line advanced to Now. An interrupt coming
+//      on the trigger level stands; one on the character timeout is put
+//      off by the characters sent since.
+//
+static VOID ScSimPortUartSchedule(PSCSIMPORT Port, ULONGLONG Now)
+{
+	ULONGLONG		raise;
+	ULONGLONG		drain;
+	ULONG			need;
+	LARGE_INTEGER	due;
+
+	if(Port->UartPending)
+	{
+		if(!Port->UartTimeout)
+			return;
+		KeCancelTimer(&Port->UartTimer);
+		Port->UartPending = FALSE;
+	}
+	if((Port->FifoCount == 0) && (Port->WireCount == 0))
+		return;
+
+	need = (Port->FifoCount < Port->Line.RxTrigger) ? Port->Line.RxTrigger - Port->FifoCount : 0;
+	Port->UartTimeout = FALSE;
+	if(need == 0)
+		raise = Now;
+	else if(Port->WireCount >= need)
+		raise = ScSimPortArrival(Port, Port->WireIndex + need - 1);
+	else
+	{
+		raise = (Port->WireCount != 0) ? ScSimPortArrival(Port, Port->WireIndex + Port->WireCount - 1) :
+			Port->LastArrival;
+		raise += SCSIMPORT_CHAR_TIMEOUT * ScSimPortCharTime(Port);
+		Port->UartTimeout = TRUE;
+	}
+
+	drain = raise + Port->Line.Latency;
+	if(Port->Line.Jitter != 0)
+		drain += SCHostRandom(&Port->Random) % (Port->Line.Jitter + 1);
+
+	Port->UartPending = TRUE;
+	due.QuadPart = (drain > Now) ? -(LONGLONG)(drain - Now) : 0;
+	KeSetTimer(&Port->UartTimer, due, &Port->UartDpc);
+}
+
+// the line's speed has changed, the port lock held and the line advanced;
+// the next character goes from now at the new speed
+static VOID ScSimPortLineRetime(PSCSIMPORT Port)
+{
+	ULONGLONG	now;
+
+	now = SCHostNow();
+	Port->WireOrigin = now;
+	Port->WireIndex = 0;
+	if(Port->UartPending)
+	{
+		KeCancelTimer(&Port->UartTimer);
+		Port->UartPending = FALSE;
+	}
+	ScSimPortUartSchedule(Port, now);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortUartDpc
+//      The UART's interrupt serviced: the FIFO goes into the buffer and
+//      the reads are served from it
+//
+static VOID ScSimPortUartDpc(PKDPC Dpc, PVOID Context, PVOID Argument1, PVOID Argument2)
+{
+	PSCSIMPORT	port;
+	LIST_ENTRY	completed;
+	ULONGLONG	now;
+
+	port = (PSCSIMPORT)Context;
+	InitializeListHead(&completed);
+	now = SCHostNow();
+
+	KeAcquireSpinLockAtDpcLevel(&port->Lock);
+	port->UartPending = FALSE;
+	ScSimPortLineAdvance(port, now);
+	port->Stats.Interrupts++;
+	ScSimPortAppend(port, port->Fifo, port->FifoCount);
+	port->FifoCount = 0;
+	ScSimPortServe(port, &completed);
+	ScSimPortUartSchedule(port, now);
+	KeReleaseSpinLockFromDpcLevel(&port->Lock);
+
+	ScSimPortCompleteList(&completed);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortIoctl
+//      IRP_MJ_DEVICE_CONTROL, the serial IOCTLs
+//
+//  Arguments:
+//      IN  Port
+//              the port
+//
+//      IN  Irp
+//              the IOCTL
+//
+//  Return Value:
+//      NT status code, the IRP completed with it
+//
+static NTSTATUS ScSimPortIoctl(PSCSIMPORT Port, PIRP Irp)
+{
+	PIO_STACK_LOCATION			irpStack;
+	const SCSIMPORT_SETTING *	setting;
+	PSERIAL_STATUS				commStatus;
+	PVOID						buffer;
+	ULONG						code;
+	ULONG						inLength;
+	ULONG						outLength;
+	ULONG						i;
+	KIRQL						oldIrql;
+
+	irpStack = IoGetCurrentIrpStackLocation(Irp);
+	code = irpStack->Parameters.DeviceIoControl.IoControlCode;
+	inLength = irpStack->Parameters.DeviceIoControl.InputBufferLength;
+	outLength = irpStack->Parameters.DeviceIoControl.OutputBufferLength;
+	buffer = Irp->AssociatedIrp.SystemBuffer;
+
+	Port->Stats.Ioctls++;
+
+	for(i = 0; i < SCSIMPORT_SETTINGS; i++)
+	{
+		setting = &ScSimPortSettings[i];
+		if(code == setting->SetCode)
+		{
+			if(inLength < setting->Size)
+				return ScSimPortComplete(Irp, STATUS_BUFFER_TOO_SMALL, 0);
+			KeAcquireSpinLock(&Port->Lock, &oldIrql);
+			if(Port->LineModel && ((code == IOCTL_SERIAL_SET_BAUD_RATE) || (code == IOCTL_SERIAL_SET_LINE_CONTROL)))
+			{
+				// the characters still to come go at the new speed
+				ScSimPortLineAdvance(Port, SCHostNow());
+				RtlCopyMemory((PUCHAR)Port + setting->Offset, buffer, setting->Size);
+				ScSimPortLineRetime(Port);
+			}
+			else
+				RtlCopyMemory((PUCHAR)Port + setting->Offset, buffer, setting->Size);
+			KeReleaseSpinLock(&Port->Lock, oldIrql);
+			return ScSimPortComplete(Irp, STATUS_SUCCESS, 0);
+		}
+		if(code == setting->GetCode)
+		{
+			if(outLength < setting->Size)
+				return ScSimPortComplete(Irp, STATUS_BUFFER_TOO_SMALL, 0);
+			KeAcquireSpinLock(&Port->Lock, &oldIrql);
+			RtlCopyMemory(buffer, (PUCHAR)Port + setting->Offset, setting->Size);
+			KeReleaseSpinLock(&Port->Lock, oldIrql);
+			return ScSimPortComplete(Irp, STATUS_SUCCESS, setting->Size);
+		}
+	}
+
+	switch(code)
+	{
+	case IOCTL_SERIAL_SET_DTR:
+		Port->DtrRts |= SERIAL_DTR_STATE;
+		break;
+
+	case IOCTL_SERIAL_CLR_DTR:
+		Port->DtrRts &= ~SERIAL_DTR_STATE;
+		break;
+
+	case IOCTL_SERIAL_SET_RTS:
+		Port->DtrRts |= SERIAL_RTS_STATE;
+		break;
+
+	case IOCTL_SERIAL_CLR_RTS:
+		Port->DtrRts &= ~SERIAL_RTS_STATE;
+		break;
+
+	case IOCTL_SERIAL_GET_DTRRTS:
+	case IOCTL_SERIAL_GET_MODEMSTATUS:
+		if(outLength < sizeof(ULONG))
+			return ScSimPortComplete(Irp, STATUS_BUFFER_TOO_SMALL, 0);
+		*(PULONG)buffer = (code == IOCTL_SERIAL_GET_DTRRTS) ? Port->DtrRts : Port->ModemStatus;
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, sizeof(ULONG));
+
+	case IOCTL_SERIAL_GET_COMMSTATUS:
+		if(outLength < sizeof(SERIAL_STATUS))
+			return ScSimPortComplete(Irp, STATUS_BUFFER_TOO_SMALL, 0);
+		commStatus = (PSERIAL_STATUS)buffer;
+		RtlZeroMemory(commStatus, sizeof(SERIAL_STATUS));
+		KeAcquireSpinLock(&Port->Lock, &oldIrql);
+		commStatus->AmountInInQueue = Port->Count;
+		KeReleaseSpinLock(&Port->Lock, oldIrql);
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, sizeof(SERIAL_STATUS));
+
+	case IOCTL_SERIAL_PURGE:
+		if(inLength < sizeof(ULONG))
+			return ScSimPortComplete(Irp, STATUS_BUFFER_TOO_SMALL, 0);
+		// writes never wait here, there is nothing to abort or clear
+		if(*(PULONG)buffer & SERIAL_PURGE_RXABORT)
+			ScSimPortCancelReads(Port);
+		if(*(PULONG)buffer & SERIAL_PURGE_RXCLEAR)
+		{
+			KeAcquireSpinLock(&Port->Lock, &oldIrql);
+			Port->Head = 0;
+			Port->Count = 0;
+			Port->FifoCount = 0;
+			KeReleaseSpinLock(&Port->Lock, oldIrql);
+		}
+		break;
+
+	// accepted and of no consequence to a port with no line
+	case IOCTL_SERIAL_SET_QUEUE_SIZE:
+	case IOCTL_SERIAL_SET_BREAK_ON:
+	case IOCTL_SERIAL_SET_BREAK_OFF:
+	case IOCTL_SERIAL_SET_XON:
+	case IOCTL_SERIAL_SET_XOFF:
+	case IOCTL_SERIAL_RESET_DEVICE:
+	case IOCTL_SERIAL_CLEAR_STATS:
+	case IOCTL_SERIAL_SET_FIFO_CONTROL:
+		break;
+
+	case IOCTL_SERIAL_WAIT_ON_MASK:
+		SCHostFatal("IOCTL_SERIAL_WAIT_ON_MASK at the simulated port is not simulated yet");
+
+	default:
+		return ScSimPortComplete(Irp, STATUS_INVALID_PARAMETER, 0);
+	}
+
+	return ScSimPortComplete(Irp, STATUS_SUCCESS, 0);
+}
+
+// whether a read is among those just finished
+static BOOLEAN ScSimPortListed(PLIST_ENTRY List, PIRP Irp)
+{
+	PLIST_ENTRY	entry;
+
+	for(entry = List->Flink; entry != List; entry = entry->Flink)
+		if(entry == &Irp->Tail.Overlay.ListEntry)
+			return TRUE;
+	return FALSE;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimPortDispatch
+//      Every major function of the port
+//
+//  Arguments:
+//      IN  DeviceObject
+//              the port
+//
+//      IN  Irp
+//              the request
+//
+//  Return Value:
+//      NT status code
+//
+static NTSTATUS ScSimPortDispatch(PDEVICE_OBJECT DeviceObject, PIRP Irp)
+{
+	PSCSIMPORT			port;
+	PIO_STACK_LOCATION	irpStack;
+	LIST_ENTRY			completed;
+	ULONG				length;
+	KIRQL				oldIrql;
+
+	port = (PSCSIMPORT)DeviceObject->DeviceExtension;
+	irpStack = IoGetCurrentIrpStackLocation(Irp);
+
+	switch(irpStack->MajorFunction)
+	{
+	case IRP_MJ_CREATE:
+		port->OpenCount++;
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, 0);
+
+	case IRP_MJ_CLEANUP:
+		ScSimPortCancelReads(port);
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, 0);
+
+	case IRP_MJ_CLOSE:
+		if(port->OpenCount == 0)
+			SCHostFatal("simulated port %p closed when not open", DeviceObject);
+		port->OpenCount--;
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, 0);
+
+	case IRP_MJ_READ:
+		port->Stats.Reads++;
+		if(irpStack->Parameters.Read.Length == 0)
+			return ScSimPortComplete(Irp, STATUS_SUCCESS, 0);
+
+		// queued behind the others, it may be served at once
+		InitializeListHead(&completed);
+		KeAcquireSpinLock(&port->Lock, &oldIrql);
+		if(!ScSimPortQueueRead(port, Irp))
+		{
+			KeReleaseSpinLock(&port->Lock, oldIrql);
+			port->Stats.ReadsCancelled++;
+			return ScSimPortComplete(Irp, STATUS_CANCELLED, 0);
+		}
+		ScSimPortServe(port, &completed);
+		KeReleaseSpinLock(&port->Lock, oldIrql);
+
+		if(!ScSimPortListed(&completed, Irp))
+			port->Stats.ReadsPended++;
+		ScSimPortCompleteList(&completed);
+		return STATUS_PENDING;
+
+	case IRP_MJ_WRITE:
+		length = irpStack->Parameters.Write.Length;
+		port->Stats.Writes++;
+		port->Stats.BytesWritten += length;
+		if((port->Transmit != NULL) && (length != 0))
+			port->Transmit(port, (const UCHAR *)Irp->AssociatedIrp.SystemBuffer, length, port->TransmitContext);
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, length);
+
+	case IRP_MJ_DEVICE_CONTROL:
+		return ScSimPortIoctl(port, Irp);
+
+	case IRP_MJ_INTERNAL_DEVICE_CONTROL:
+		port->Stats.Ioctls++;
+		return ScSimPortComplete(Irp, STATUS_INVALID_DEVICE_REQUEST, 0);
+
+	case IRP_MJ_PNP:
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, Irp->IoStatus.Information);
+
+	case IRP_MJ_POWER:
+		PoStartNextPowerIrp(Irp);
+		return ScSimPortComplete(Irp, STATUS_SUCCESS, 0);
+	}
+
+	return ScSimPortComplete(Irp, STATUS_INVALID_DEVICE_REQUEST, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimPortCreate
+//      Creates a simulated port
+//
+//  Arguments:
+//      IN  Name
+//              \Device\xxx
+//
+//      OUT Port
+//              the port
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCSimPortCreate(PCWSTR Name, PSCSIMPORT * Port)
+{
+	PDEVICE_OBJECT	device;
+	PSCSIMPORT		port;
+	UNICODE_STRING	name;
+	NTSTATUS		status;
+
+	if(ScSimPortDriver == NULL)
+	{
+		ScSimPortDriver = SCHostCreateDriver(L"\\Driver\\SimSerial", ScSimPortDispatch);
+		if(ScSimPortDriver == NULL)
+			return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	RtlInitUnicodeString(&name, Name);
+	status = IoCreateDevice(ScSimPortDriver, sizeof(SCSIMPORT), &name, FILE_DEVICE_SERIAL_PORT, 0, FALSE, &device);
+	if(!NT_SUCCESS(status))
+		return status;
+
+	port = (PSCSIMPORT)device->DeviceExtension;
+	port->DeviceObject = device;
+	KeInitializeSpinLock(&port->Lock);
+	InitializeListHead(&port->Reads);
+	KeInitializeTimer(&port->ReadTotalTimer);
+	KeInitializeTimer(&port->ReadIntervalTimer);
+	KeInitializeDpc(&port->ReadTimeoutDpc, ScSimPortReadTimeout, port);
+	KeInitializeTimer(&port->UartTimer);
+	KeInitializeDpc(&port->UartDpc, ScSimPortUartDpc, port);
+
+	port->Ring = (UCHAR *)ExAllocatePoolWithTag(NonPagedPool, SCSIMPORT_RING_SIZE, SCSIMPORT_POOL_TAG);
+	if(port->Ring == NULL)
+	{
+		IoDeleteDevice(device);
+		return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	port->BaudRate.BaudRate = 9600;
+	port->LineControl.WordLength = 8;
+	port->LineControl.Parity = NO_PARITY;
+	port->LineControl.StopBits = STOP_BIT_1;
+	port->Chars.XonChar = 0x11;
+	port->Chars.XoffChar = 0x13;
+	port->ModemStatus = SERIAL_MSR_CTS | SERIAL_MSR_DSR | SERIAL_MSR_DCD;
+
+	// serial.sys buffers its reads
+	device->Flags |= DO_BUFFERED_IO;
+	device->Flags &= ~DO_DEVICE_INITIALIZING;
+
+	ScSimPortCount++;
+	*Port = port;
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimPortDelete
+//      Deletes a port once nothing is attached to it, and the driver with
+//      the last one. What is still on the line is lost.
+//
+VOID SCSimPortDelete(PSCSIMPORT Port)
+{
+	if(!IsListEmpty(&Port->Reads))
+		SCHostFatal("simulated port %p deleted with reads pending", Port->DeviceObject);
+
+	KeCancelTimer(&Port->UartTimer);
+	if(Port->Wire != NULL)
+		ExFreePoolWithTag(Port->Wire, SCSIMPORT_POOL_TAG);
+	ExFreePoolWithTag(Port->Ring, SCSIMPORT_POOL_TAG);
+	IoDeleteDevice(Port->DeviceObject);
+
+	if(--ScSimPortCount == 0)
+	{
+		SCHostDeleteDriver(ScSimPortDriver);
+		ScSimPortDriver = NULL;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimPortReceive
+//      Data arrives at the port as if the UART had just been drained. It
+//      is buffered and the reads are served from it, at DISPATCH_LEVEL
+//      as a port's DPC would.
+//
+//  Arguments:
+//      IN  Port
+//              the port
+//
+//      IN  Data
+//              what arrived
+//
+//      IN  Length
+//              bytes of it
+//
+//  Return Value:
+//      None
+//
+VOID SCSimPortReceive(PSCSIMPORT Port, const UCHAR * Data, ULONG Length)
+{
+	LIST_ENTRY	completed;
+	KIRQL		oldIrql;
+
+	InitializeListHead(&completed);
+
+	KeAcquireSpinLock(&Port->Lock, &oldIrql);
+	ScSimPortAppend(Port, Data, Length);
+	ScSimPortServe(Port, &completed);
+	KeReleaseSpinLockFromDpcLevel(&Port->Lock);
+
+	ScSimPortCompleteList(&completed);
+	KeLowerIrql(oldIrql);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimPortFlush
+//      Cancels the reads waiting at the port, the end of a run
+//
+VOID SCSimPortFlush(PSCSIMPORT Port)
+{
+	ScSimPortCancelReads(Port);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimPortSetLine
+//      Gives the port a UART, for SCSimPortSend to put characters on the
+//      line into
+//
+//  Arguments:
+//      IN  Port
+//              the port
+//
+//      IN  Line
+//              the UART's FIFO and interrupt latency
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCSimPortSetLine(PSCSIMPORT Port, const SCSIMPORT_LINE * Line)
+{
+	KIRQL	oldIrql;
+
+	if((Line->FifoDepth == 0) || (Line->FifoDepth > SCSIMPORT_FIFO_MAX) ||
+		(Line->RxTrigger == 0) || (Line->RxTrigger > Line->FifoDepth))
+		return STATUS_INVALID_PARAMETER;
+
+	if(Port->Wire == NULL)
+	{
+		Port->Wire = (UCHAR *)ExAllocatePoolWithTag(NonPagedPool, SCSIMPORT_WIRE_SIZE, SCSIMPORT_POOL_TAG);
+		if(Port->Wire == NULL)
+			return STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	KeAcquireSpinLock(&Port->Lock, &oldIrql);
+	if(Port->LineModel && ((Port->WireCount != 0) || (Port->FifoCount != 0)))
+		SCHostFatal("simulated port %p given a new UART with characters on the line", Port->DeviceObject);
+	Port->Line = *Line;
+	Port->Random = Line->Seed;
+	Port->LineModel = TRUE;
+	Port->WireOrigin = SCHostNow();
+	Port->WireIndex = 0;
+	Port->LastArrival = Port->WireOrigin;
+	KeReleaseSpinLock(&Port->Lock, oldIrql);
+	return STATUS_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimPortSend
+//      Puts characters on the line into the port, after any still going.
+//      The line holds SCSIMPORT_WIRE_SIZE at most, a sender getting ahead
+//      of it by more than that loses the rest.
+//
+//  Arguments:
+//      IN  Port
+//              the port, with a UART
+//
+//      IN  Data
+//              the characters
+//
+//      IN  Length
+//              how many
+//
+//      OUT Arrival
+//              clock the last of them reaches the UART, optional
+//
+//  Return Value:
+//      characters taken
+//
+ULONG SCSimPortSend(PSCSIMPORT Port, const UCHAR * Data, ULONG Length, PULONGLONG Arrival)
+{
+	ULONGLONG	now;
+	KIRQL		oldIrql;
+	ULONG		tail;
+	ULONG		chunk;
+
+	if(!Port->LineModel)
+		SCHostFatal("simulated port %p sent to with no UART", Port->DeviceObject);
+
+	now = SCHostNow();
+	KeAcquireSpinLock(&Port->Lock, &oldIrql);
+
+	ScSimPortLineAdvance(Port, now);
+	if(Port->WireCount == 0)
+	{
+		// the line was idle, the first character starts now
+		Port->WireOrigin = now;
+		Port->WireIndex = 0;
+	}
+
+	if(Length > SCSIMPORT_WIRE_SIZE - Port->WireCount)
+		Length = SCSIMPORT_WIRE_SIZE - Port->WireCount;
+	tail = (Port->WireHead + Port->WireCount) % SCSIMPORT_WIRE_SIZE;
+	chunk = min(Length, SCSIMPORT_WIRE_SIZE - tail);
+	RtlCopyMemory(Port->Wire + tail, Data, chunk);
+	RtlCopyMemory(Port->Wire, Data + chunk, Length - chunk);
+	Port->WireCount += Length;
+	Port->Stats.BytesSent += Length;
+
+	if(Arrival != NULL)
+		*Arrival = (Port->WireCount != 0) ? ScSimPortArrival(Port, Port->WireIndex + Port->WireCount - 1) :
+			Port->LastArrival;
+
+	ScSimPortUartSchedule(Port, now);
+	KeReleaseSpinLock(&Port->Lock, oldIrql);
+	return Length;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimPortLineIdle
+//      Clock the last character sent reaches the UART, the line is idle
+//      from then
+//
+ULONGLONG SCSimPortLineIdle(PSCSIMPORT Port)
+{
+	ULONGLONG	idle;
+	KIRQL		oldIrql;
+
+	KeAcquireSpinLock(&Port->Lock, &oldIrql);
+	ScSimPortLineAdvance(Port, SCHostNow());
+	idle = (Port->WireCount != 0) ? ScSimPortArrival(Port, Port->WireIndex + Port->WireCount - 1) :
+		Port->LastArrival;
+	KeReleaseSpinLock(&Port->Lock, oldIrql);
+	return idle;
+}
@@ -0,0 +1,148 @@
+// simport.h
+//
+// A simulated serial port for the bottom of the device stack, standing in
+// for serial.sys under the driver. Data reaches it one of two ways:
+//
+// SCSimPortReceive hands bytes straight to the port's buffer, as if the
+// UART had just been drained, the way screplay feeds it recorded reads.
+//
+// SCSimPortSend puts bytes on the line once SCSimPortSetLine has set the
+// port up with a UART. They arrive one character time apart at the baud
+// rate and line control the port is set to, into a receive FIFO of the
+// configured depth. The interrupt comes at the FIFO's trigger level, or
+// four character times after the last character when it stays below
+// it, and the FIFO is drained into the buffer a latency later, plus up
+// to the jitter. Characters arriving with the FIFO full are overruns.
+//
+// Either way reads are completed from the buffer as serial.sys does by
+// the timeouts set: all zero, a read waits until it is full; interval
+// MAXULONG with the others zero, it returns at once with what there is;
+// interval and multiplier MAXULONG with a constant, it returns with what
+// there is as soon as there is anything, or empty at the constant;
+// otherwise it waits until full, for no longer than the total timeout
+// and no longer than the interval timeout between characters once some
+// have come. Timed out reads complete with STATUS_TIMEOUT and what they
+// had. Writes go out at once, to the harness's Transmit routine if it
+// has set one. The other settings IOCTLs are kept and reported back
+// without any effect.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCSIMPORT_H__
+#define __SCSIMPORT_H__
+
+#include <wdm.h>
+#include <ntddser.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCSIMPORT_RING_SIZE		65536
+#define SCSIMPORT_WIRE_SIZE		(1024 * 1024)	// sent and not arrived yet, at most
+#define SCSIMPORT_FIFO_MAX		256
+
+typedef struct _SCSIMPORT_STATS
+{
+	ULONGLONG				BytesReceived;
+	ULONGLONG				BytesDropped;		// arrived with the ring full
+	ULONGLONG				BytesRead;
+	ULONGLONG				BytesWritten;
+	ULONGLONG				BytesSent;			// put on the line, SCSimPortSend
+	ULONGLONG				Overruns;			// characters lost with the FIFO full
+	ULONGLONG				Interrupts;
+	ULONGLONG				Reads;
+	ULONGLONG				ReadsPended;
+	ULONGLONG				ReadsCancelled;
+	ULONGLONG				ReadsTimedOut;
+	ULONGLONG				Writes;
+	ULONGLONG				Ioctls;
+} SCSIMPORT_STATS, *PSCSIMPORT_STATS;
+
+// the UART, SCSimPortSetLine
+typedef struct _SCSIMPORT_LINE
+{
+	ULONG					FifoDepth;			// 1 for an 8250, 16 for a 16550A, up to SCSIMPORT_FIFO_MAX
+	ULONG					RxTrigger;			// characters in the FIFO that raise the interrupt
+	ULONG					Latency;			// 100ns from the interrupt to the FIFO drained
+	ULONG					Jitter;				// up to this much more, uniformly
+	ULONGLONG				Seed;				// for the jitter
+} SCSIMPORT_LINE, *PSCSIMPORT_LINE;
+
+struct _SCSIMPORT;
+
+// data written to the port, as it goes out
+typedef VOID (*PSCSIMPORT_TRANSMIT)(struct _SCSIMPORT * Port, const UCHAR * Data, ULONG Length, PVOID Context);
+
+// the port's device extension
+typedef struct _SCSIMPORT
+{
+	PDEVICE_OBJECT			DeviceObject;
+	KSPIN_LOCK				Lock;
+	LIST_ENTRY				Reads;				// pending, oldest first, the first one current
+	ULONG					OpenCount;
+
+	UCHAR *					Ring;
+	ULONG					Head;				// next to read
+	ULONG					Count;
+
+	// the current read's timeouts, once it has started
+	BOOLEAN					ReadStarted;
+	ULONG					ReadMode;			// SCSIMPORT_READ_xxx, simport.c
+	ULONGLONG				ReadInterval;		// 100ns, 0 for none
+	ULONGLONG				ReadDeadline;		// clock of the total timeout, 0 for none
+	ULONGLONG				IntervalDeadline;	// and of the interval timeout
+	KTIMER					ReadTotalTimer;
+	KTIMER					ReadIntervalTimer;
+	KDPC					ReadTimeoutDpc;
+
+	// as the IOCTLs set them, serial.sys's defaults to start with
+	SERIAL_BAUD_RATE		BaudRate;
+	SERIAL_LINE_CONTROL		LineControl;
+	SERIAL_TIMEOUTS			Timeouts;
+	SERIAL_CHARS			Chars;
+	SERIAL_HANDFLOW			HandFlow;
+	ULONG					WaitMask;
+	ULONG					DtrRts;				// SERIAL_DTR_STATE, SERIAL_RTS_STATE
+	ULONG					ModemStatus;		// SERIAL_MSR_xxx
+
+	// the line and the UART, with SCSimPortSetLine
+	BOOLEAN					LineModel;
+	SCSIMPORT_LINE			Line;
+	UCHAR *					Wire;				// sent, not at the UART yet
+	ULONG					WireHead;
+	ULONG					WireCount;
+	ULONGLONG				WireOrigin;			// clock the characters on the line are timed from
+	ULONGLONG				WireIndex;			// characters arrived since then
+	ULONGLONG				LastArrival;		// clock the last character reached the FIFO
+	UCHAR					Fifo[SCSIMPORT_FIFO_MAX];
+	ULONG					FifoCount;
+	KTIMER					UartTimer;			// the FIFO drained, when it fires
+	KDPC					UartDpc;
+	BOOLEAN					UartPending;
+	BOOLEAN					UartTimeout;		// on the character timeout, not the trigger
+	ULONGLONG				Random;
+
+	PSCSIMPORT_TRANSMIT		Transmit;			// optional
+	PVOID					TransmitContext;
+
+	SCSIMPORT_STATS			Stats;
+} SCSIMPORT, *PSCSIMPORT;
+
+NTSTATUS SCSimPortCreate(PCWSTR Name, PSCSIMPORT * Port);
+VOID SCSimPortDelete(PSCSIMPORT Port);
+VOID SCSimPortReceive(PSCSIMPORT Port, const UCHAR * Data, ULONG Length);
+VOID SCSimPortFlush(PSCSIMPORT Port);
+
+NTSTATUS SCSimPortSetLine(PSCSIMPORT Port, const SCSIMPORT_LINE * Line);
+ULONG SCSimPortSend(PSCSIMPORT Port, const UCHAR * Data, ULONG Length, PULONGLONG Arrival);
+ULONGLONG SCSimPortLineIdle(PSCSIMPORT Port);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCSIMPORT_H__
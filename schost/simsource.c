@@ -0,0 +1,323 @@
+// simsource.c
+//
+// Senders for the far end of a simulated port's line, see simsource.h.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <math.h>
+
+#include <wdm.h>
+#include "shim.h"
+#include "simsource.h"
+
+#define SCSIMSOURCE_BINARY_OVERHEAD	8		// sync, class, id, length, checksum
+
+// FNV-1a, carried on from Hash
+ULONG SCSimSourceHash(ULONG Hash, const UCHAR * Data, ULONG Length)
+{
+	ULONG	i;
+
+	for(i = 0; i < Length; i++)
+		Hash = (Hash ^ Data[i]) * 16777619u;
+	return Hash;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimSourceSentence
+//      Finishes an NMEA sentence, its checksum and CR LF after the body
+//
+//  Arguments:
+//      IN  Buffer
+//              where it goes
+//
+//      IN  Room
+//              bytes there
+//
+//      IN  Body
+//              between the $ and the *
+//
+//  Return Value:
+//      its length
+//
+static ULONG ScSimSourceSentence(char * Buffer, ULONG Room, const char * Body)
+{
+	UCHAR	sum;
+	ULONG	i;
+	int		length;
+
+	for(sum = 0, i = 0; Body[i] != 0; i++)
+		sum ^= (UCHAR)Body[i];
+	length = snprintf(Buffer, Room, "$%s*%02X\r\n", Body, sum);
+	return ((length > 0) && ((ULONG)length < Room)) ? (ULONG)length : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimSourceNmea
+//      A fix's sentences, a receiver going 1 Hz with its position
+//      wandering a little each time
+//
+static ULONG ScSimSourceNmea(PSCSIMSOURCE Source)
+{
+	char	body[128];
+	char *	out;
+	ULONG	room;
+	ULONG	length;
+	ULONG	seconds;
+	ULONG	sats;
+	ULONG	i;
+	LONG	lat;
+	LONG	lon;
+
+	seconds = Source->Fixes++;
+	Source->Latitude += (LONG)(SCHostRandom(&Source->Random) % 21) - 10;
+	Source->Longitude += (LONG)(SCHostRandom(&Source->Random) % 21) - 10;
+	lat = Source->Latitude;
+	lon = Source->Longitude;
+	sats = 6 + SCHostRandom(&Source->Random) % 7;
+
+	out = (char *)Source->Frame;
+	room = SCSIMSOURCE_FRAME_MAX;
+
+	snprintf(body, sizeof(body), "GPGGA,%02u%02u%02u.00,%02d%02d.%04d,N,%03d%02d.%04d,W,1,%02u,0.9,%u.%u,M,-34.0,M,,",
+		(seconds / 3600) % 24, (seconds / 60) % 60, seconds % 60,
+		(int)(lat / 600000), (int)(lat / 10000 % 60), (int)(lat % 10000),
+		(int)(lon / 600000), (int)(lon / 10000 % 60), (int)(lon % 10000),
+		sats, 200 + SCHostRandom(&Source->Random) % 50, SCHostRandom(&Source->Random) % 10);
+	length = ScSimSourceSentence(out, room, body);
+	out += length;
+	room -= length;
+
+	snprintf(body, sizeof(body), "GPGSA,A,3,04,05,09,12,24,25,29,31,,,,,1.8,0.9,1.5");
+	length = ScSimSourceSentence(out, room, body);
+	out += length;
+	room -= length;
+
+	for(i = 0; i < 3; i++)
+	{
+		snprintf(body, sizeof(body), "GPGSV,3,%u,%02u,%02u,%02u,%03u,%02u,%02u,%02u,%03u,%02u,%02u,%02u,%03u,%02u",
+			i + 1, sats, 4 * i + 2, 10 + SCHostRandom(&Source->Random) % 80, SCHostRandom(&Source->Random) % 360,
+			20 + SCHostRandom(&Source->Random) % 30, 4 * i + 5, 10 + SCHostRandom(&Source->Random) % 80,
+			SCHostRandom(&Source->Random) % 360, 20 + SCHostRandom(&Source->Random) % 30, 4 * i + 9,
+			10 + SCHostRandom(&Source->Random) % 80, SCHostRandom(&Source->Random) % 360,
+			20 + SCHostRandom(&Source->Random) % 30);
+		length = ScSimSourceSentence(out, room, body);
+		out += length;
+		room -= length;
+	}
+
+	snprintf(body, sizeof(body), "GPRMC,%02u%02u%02u.00,A,%02d%02d.%04d,N,%03d%02d.%04d,W,0.0%u,,190705,,,A",
+		(seconds / 3600) % 24, (seconds / 60) % 60, seconds % 60,
+		(int)(lat / 600000), (int)(lat / 10000 % 60), (int)(lat % 10000),
+		(int)(lon / 600000), (int)(lon / 10000 % 60), (int)(lon % 10000),
+		SCHostRandom(&Source->Random) % 10);
+	length = ScSimSourceSentence(out, room, body);
+	out += length;
+	room -= length;
+
+	snprintf(body, sizeof(body), "GPVTG,,T,,M,0.0%u,N,0.0%u,K,A",
+		SCHostRandom(&Source->Random) % 10, SCHostRandom(&Source->Random) % 10);
+	length = ScSimSourceSentence(out, room, body);
+	room -= length;
+
+	return SCSIMSOURCE_FRAME_MAX - room;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimSourceBinary
+//      A UBX style frame: B5 62, class and id, little endian payload
+//      length, the payload, and the Fletcher checksum over class to the
+//      end of the payload
+//
+static ULONG ScSimSourceBinary(PSCSIMSOURCE Source)
+{
+	PUCHAR	frame;
+	ULONG	payload;
+	ULONG	i;
+	UCHAR	a;
+	UCHAR	b;
+
+	frame = Source->Frame;
+	payload = Source->Config.FrameSize - SCSIMSOURCE_BINARY_OVERHEAD;
+
+	frame[0] = 0xB5;
+	frame[1] = 0x62;
+	frame[2] = 0x01;
+	frame[3] = 0x07;
+	frame[4] = (UCHAR)payload;
+	frame[5] = (UCHAR)(payload >> 8);
+
+	// a sequence number, then noise
+	for(i = 0; i < payload; i++)
+		frame[6 + i] = (i < 4) ? (UCHAR)(Source->FramesSent >> (8 * i)) : (UCHAR)SCHostRandom(&Source->Random);
+
+	for(a = 0, b = 0, i = 2; i < 6 + payload; i++)
+	{
+		a = (UCHAR)(a + frame[i]);
+		b = (UCHAR)(b + a);
+	}
+	frame[6 + payload] = a;
+	frame[7 + payload] = b;
+	return Source->Config.FrameSize;
+}
+
+static ULONG ScSimSourceStream(PSCSIMSOURCE Source)
+{
+	ULONG	i;
+
+	for(i = 0; i < Source->Config.FrameSize; i++)
+		Source->Frame[i] = (UCHAR)SCHostRandom(&Source->Random);
+	return Source->Config.FrameSize;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimSourceSchedule
+//      Sets the timer for the next burst
+//
+static VOID ScSimSourceSchedule(PSCSIMSOURCE Source)
+{
+	PSCSIMSOURCE_CONFIG	config;
+	ULONGLONG			gap;
+	ULONGLONG			due;
+	ULONGLONG			now;
+	LARGE_INTEGER		dueTime;
+	double				u;
+
+	config = &Source->Config;
+	now = SCHostNow();
+
+	if(config->Period == 0)
+		Source->Next = SCSimPortLineIdle(Source->Port);
+	else
+	{
+		gap = config->Period;
+		if(config->Poisson)
+		{
+			u = (SCHostRandom(&Source->Random) + 1.0) / 4294967297.0;
+			gap = (ULONGLONG)(-log(u) * config->Period);
+		}
+		Source->Next += gap;
+	}
+
+	due = Source->Next;
+	if(config->Jitter != 0)
+		due += SCHostRandom(&Source->Random) % (config->Jitter + 1);
+
+	dueTime.QuadPart = (due > now) ? -(LONGLONG)(due - now) : 0;
+	KeSetTimer(&Source->Timer, dueTime, &Source->Dpc);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  ScSimSourceBurst
+//      The timer's DPC: a burst goes on the line, a frame at a time
+//
+static VOID ScSimSourceBurst(PKDPC Dpc, PVOID Context, PVOID Argument1, PVOID Argument2)
+{
+	PSCSIMSOURCE	source;
+	ULONGLONG		arrival;
+	ULONG			length;
+	ULONG			sent;
+	ULONG			i;
+
+	source = (PSCSIMSOURCE)Context;
+	if(!source->Running)
+		return;
+
+	for(i = 0; i < source->Config.Frames; i++)
+	{
+		switch(source->Config.Payload)
+		{
+		case SCSIMSOURCE_NMEA:
+			length = ScSimSourceNmea(source);
+			break;
+		case SCSIMSOURCE_BINARY:
+			length = ScSimSourceBinary(source);
+			break;
+		default:
+			length = ScSimSourceStream(source);
+			break;
+		}
+
+		sent = SCSimPortSend(source->Port, source->Frame, length, &arrival);
+		source->Lost += length - sent;
+		source->Hash = SCSimSourceHash(source->Hash, source->Frame, sent);
+		source->Bytes += sent;
+		source->FramesSent++;
+		if((sent != 0) && (source->FrameSent != NULL))
+			source->FrameSent(source, source->Bytes, arrival);
+	}
+	source->Bursts++;
+
+	ScSimSourceSchedule(source);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCSimSourceStart
+//      Starts a sender on a port's line, the first burst at once
+//
+//  Arguments:
+//      OUT Source
+//              the sender
+//
+//      IN  Port
+//              the port, with a UART
+//
+//      IN  Config
+//              what it sends and when
+//
+//      IN  FrameSent
+//              called as each frame goes on the line, optional
+//
+//      IN  Context
+//              for FrameSent
+//
+//  Return Value:
+//      NT status code
+//
+NTSTATUS SCSimSourceStart(PSCSIMSOURCE Source, PSCSIMPORT Port, const SCSIMSOURCE_CONFIG * Config,
+	PSCSIMSOURCE_FRAME FrameSent, PVOID Context)
+{
+	LARGE_INTEGER	now;
+
+	if((Config->Frames == 0) || (Config->Payload > SCSIMSOURCE_STREAM))
+		return STATUS_INVALID_PARAMETER;
+	if((Config->Payload == SCSIMSOURCE_BINARY) &&
+		((Config->FrameSize <= SCSIMSOURCE_BINARY_OVERHEAD) || (Config->FrameSize > SCSIMSOURCE_FRAME_MAX)))
+		return STATUS_INVALID_PARAMETER;
+	if((Config->Payload == SCSIMSOURCE_STREAM) && ((Config->FrameSize == 0) || (Config->FrameSize > SCSIMSOURCE_FRAME_MAX)))
+		return STATUS_INVALID_PARAMETER;
+	if(!Port->LineModel)
+		return STATUS_INVALID_DEVICE_STATE;
+
+	RtlZeroMemory(Source, sizeof(SCSIMSOURCE));
+	Source->Config = *Config;
+	Source->Port = Port;
+	Source->FrameSent = FrameSent;
+	Source->Context = Context;
+	Source->Random = Config->Seed;
+	Source->Hash = SCSIMSOURCE_HASH_BASIS;
+
+	// somewhere off Halifax
+	Source->Latitude = 44 * 600000 + 38 * 10000;
+	Source->Longitude = 63 * 600000 + 34 * 10000;
+	Source->Fixes = 12 * 3600;
+
+	KeInitializeTimer(&Source->Timer);
+	KeInitializeDpc(&Source->Dpc, ScSimSourceBurst, Source);
+
+	Source->Running = TRUE;
+	Source->Next = SCHostNow();
+	now.QuadPart = 0;
+	KeSetTimer(&Source->Timer, now, &Source->Dpc);
+	return STATUS_SUCCESS;
+}
+
+// sends no more; what is on the line still arrives
+VOID SCSimSourceStop(PSCSIMSOURCE Source)
+{
+	Source->Running = FALSE;
+	KeCancelTimer(&Source->Timer);
+}
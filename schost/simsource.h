@@ -0,0 +1,87 @@
+// simsource.h
+//
+// Something at the far end of a simulated port's line: a GPS receiver
+// putting out NMEA sentences, an instrument sending binary frames, or a
+// stream of bytes as fast as the line takes them. It sends in bursts of
+// frames, each burst a period after the last or, Poisson, after gaps
+// drawn around it, any burst up to a jitter late. Everything it sends is
+// the same for the same seed.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#ifndef __SCSIMSOURCE_H__
+#define __SCSIMSOURCE_H__
+
+#include <wdm.h>
+#include "simport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// SCSIMSOURCE_CONFIG.Payload
+#define SCSIMSOURCE_NMEA		0		// a fix's sentences a frame, GGA GSA GSV RMC VTG
+#define SCSIMSOURCE_BINARY		1		// UBX style frames of FrameSize, sync, length and checksum
+#define SCSIMSOURCE_STREAM		2		// random bytes, FrameSize at a time
+
+#define SCSIMSOURCE_FRAME_MAX	4096
+
+typedef struct _SCSIMSOURCE_CONFIG
+{
+	ULONG					Payload;			// SCSIMSOURCE_xxx
+	ULONG					FrameSize;			// bytes, _BINARY and _STREAM
+	ULONG					Frames;				// a burst
+	ULONG					Period;				// 100ns from a burst to the next, 0 as the line frees
+	ULONG					Jitter;				// 100ns a burst may be late, uniformly
+	BOOLEAN					Poisson;			// Period is the mean of exponential gaps
+	ULONGLONG				Seed;
+} SCSIMSOURCE_CONFIG, *PSCSIMSOURCE_CONFIG;
+
+struct _SCSIMSOURCE;
+
+// a frame is on the line, ending at stream offset End and at the UART by
+// Arrival; for the harness to time its way through the driver
+typedef VOID (*PSCSIMSOURCE_FRAME)(struct _SCSIMSOURCE * Source, ULONGLONG End, ULONGLONG Arrival);
+
+typedef struct _SCSIMSOURCE
+{
+	SCSIMSOURCE_CONFIG		Config;
+	PSCSIMPORT				Port;
+	PSCSIMSOURCE_FRAME		FrameSent;			// optional
+	PVOID					Context;
+
+	KTIMER					Timer;
+	KDPC					Dpc;
+	BOOLEAN					Running;
+	ULONGLONG				Random;
+	ULONGLONG				Next;				// clock the next burst is due, before its jitter
+	UCHAR					Frame[SCSIMSOURCE_FRAME_MAX];
+
+	// the receiver's fix, NMEA
+	ULONG					Fixes;
+	LONG					Latitude;			// 1e-4 minutes
+	LONG					Longitude;
+
+	// what went on the line
+	ULONGLONG				Bytes;
+	ULONGLONG				FramesSent;
+	ULONGLONG				Bursts;
+	ULONGLONG				Lost;				// the line was too far behind to take
+	ULONG					Hash;				// FNV-1a of the bytes, in order
+} SCSIMSOURCE, *PSCSIMSOURCE;
+
+NTSTATUS SCSimSourceStart(PSCSIMSOURCE Source, PSCSIMPORT Port, const SCSIMSOURCE_CONFIG * Config,
+	PSCSIMSOURCE_FRAME FrameSent, PVOID Context);
+VOID SCSimSourceStop(PSCSIMSOURCE Source);
+ULONG SCSimSourceHash(ULONG Hash, const UCHAR * Data, ULONG Length);
+
+#define SCSIMSOURCE_HASH_BASIS	2166136261u
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __SCSIMSOURCE_H__
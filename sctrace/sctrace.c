@@ -0,0 +1,403 @@
+// sctrace.c
+//
+// Decoder for the SerialClone binary trace. On Windows it can pull the
+// trace from a port with IOCTL_SERIALCLONE_GET_TRACE and save or print
+// it; anywhere, including Linux, it prints a saved trace.
+//
+//	sctrace -d \\.\COM3 [file]		fetch, save to file or print
+//	sctrace file					print a saved trace
+//
+// Fetching through the port itself, COM3, takes an administrator; through
+// its clone, COM30, anyone who can open it gets the trace, IRP addresses
+// left out unless an administrator.
+//
+// A saved trace is exactly what the IOCTL returns: a little endian
+// SERIALCLONE_TRACE_HEADER followed by the rings.
+//
+//;***********************************************************
+//;  Copyright 2005 Greg Honsa
+//;
+//;***********************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winioctl.h>
+#define snprintf		_snprintf
+#define SCTRACE_X64		"I64x"
+#else
+// just enough of the Windows types for intrface.h
+#include <stdint.h>
+typedef uint8_t		UCHAR;
+typedef uint8_t		BOOLEAN;
+typedef uint16_t	USHORT;
+typedef int32_t		LONG;
+typedef uint32_t	ULONG;
+typedef unsigned long long	ULONGLONG;
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8)
+#define CTL_CODE(type, function, method, access) \
+	(((type) << 16) | ((access) << 14) | ((function) << 2) | (method))
+#define METHOD_BUFFERED		0
+#define FILE_READ_DATA		1
+#define SCTRACE_X64		"llx"
+#endif
+
+#include "../intrface.h"
+
+// the layout is fixed by the driver, whatever this compiler thinks
+typedef char SCTRACE_RECORD_SIZE_CHECK[(sizeof(SERIALCLONE_TRACE_RECORD) == 40) ? 1 : -1];
+
+// a record and the processor ring it came from
+typedef struct _SCTRACE_ENTRY
+{
+	SERIALCLONE_TRACE_RECORD *	Record;
+	ULONG						Cpu;
+} SCTRACE_ENTRY;
+
+static const char * ScEventNames[] =
+{
+	"?",
+	"READ",
+	"READ_FAST",
+	"READ_LOWER",
+	"READ_COMPLETE",
+	"READ_UNORDERED",
+	"FIFO_WRITE",
+	"WRITE",
+	"WAIT_EVENT",
+	"REJECTED",
+	"DEBUG_DROPPED",
+	"READ_ABORT",
+};
+
+static const char * ScDeviceNames[] = { "drv", "fil", "cln" };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceFormatArgs
+//      Puts an event's arguments into words, see SERIALCLONE_TRACE_xxx
+//
+//  Arguments:
+//      IN  Record
+//              the record
+//
+//      OUT Text
+//              where the words go
+//
+//      IN  Size
+//              size of Text
+//
+//  Return Value:
+//      None
+//
+static void SCTraceFormatArgs(const SERIALCLONE_TRACE_RECORD * Record, char * Text, size_t Size)
+{
+	const ULONG * a = Record->Args;
+
+	switch(Record->Event)
+	{
+	case SERIALCLONE_TRACE_READ:
+		snprintf(Text, Size, "requested %lu, %lu buffered", (unsigned long)a[0], (unsigned long)a[1]);
+		break;
+	case SERIALCLONE_TRACE_READ_FAST:
+		snprintf(Text, Size, "%lu bytes from the buffer", (unsigned long)a[0]);
+		break;
+	case SERIALCLONE_TRACE_READ_LOWER:
+		snprintf(Text, Size, "requested %lu, sent %lu, %lu already pending",
+			(unsigned long)a[0], (unsigned long)a[1], (unsigned long)a[2]);
+		break;
+	case SERIALCLONE_TRACE_READ_COMPLETE:
+		snprintf(Text, Size, "status %08lx, received %lu, returned %lu",
+			(unsigned long)a[0], (unsigned long)a[1], (unsigned long)a[2]);
+		break;
+	case SERIALCLONE_TRACE_READ_UNORDERED:
+	case SERIALCLONE_TRACE_DEBUG_DROPPED:
+	case SERIALCLONE_TRACE_READ_ABORT:
+		Text[0] = 0;
+		break;
+	case SERIALCLONE_TRACE_FIFO_WRITE:
+		snprintf(Text, Size, "%lu bytes, buffer %lu -> %lu",
+			(unsigned long)a[0], (unsigned long)a[1], (unsigned long)a[2]);
+		break;
+	case SERIALCLONE_TRACE_WRITE:
+		snprintf(Text, Size, "%lu bytes, status %08lx", (unsigned long)a[0], (unsigned long)a[1]);
+		break;
+	case SERIALCLONE_TRACE_WAIT_EVENT:
+		snprintf(Text, Size, "events %08lx", (unsigned long)a[0]);
+		break;
+	case SERIALCLONE_TRACE_REJECTED:
+		snprintf(Text, Size, "major %lu, status %08lx", (unsigned long)a[0], (unsigned long)a[1]);
+		break;
+	default:
+		snprintf(Text, Size, "%08lx %08lx %08lx", (unsigned long)a[0], (unsigned long)a[1], (unsigned long)a[2]);
+		break;
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceCompare
+//      qsort order: time, then processor, then that processor's sequence
+//
+static int SCTraceCompare(const void * Left, const void * Right)
+{
+	const SCTRACE_ENTRY * l = (const SCTRACE_ENTRY *)Left;
+	const SCTRACE_ENTRY * r = (const SCTRACE_ENTRY *)Right;
+
+	if(l->Record->Time != r->Record->Time)
+		return (l->Record->Time < r->Record->Time) ? -1 : 1;
+	if(l->Cpu != r->Cpu)
+		return (l->Cpu < r->Cpu) ? -1 : 1;
+	if(l->Record->Sequence != r->Record->Sequence)
+		return (l->Record->Sequence < r->Record->Sequence) ? -1 : 1;
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTracePrint
+//      Prints a trace in time order. Slots never written, and records
+//      caught half written when the rings were copied, are skipped.
+//
+//  Arguments:
+//      IN  Trace
+//              header and rings
+//
+//      IN  Length
+//              bytes in Trace
+//
+//  Return Value:
+//      0, or 1 if the trace is not one we understand
+//
+static int SCTracePrint(unsigned char * Trace, size_t Length)
+{
+	SERIALCLONE_TRACE_HEADER *	header = (SERIALCLONE_TRACE_HEADER *)Trace;
+	SERIALCLONE_TRACE_RECORD *	records;
+	SCTRACE_ENTRY *				entries;
+	ULONG						cpu;
+	ULONG						slot;
+	size_t						count;
+	size_t						i;
+	ULONGLONG					start;
+	char						args[128];
+
+	if((Length < sizeof(SERIALCLONE_TRACE_HEADER)) ||
+		(header->Size != sizeof(SERIALCLONE_TRACE_HEADER)) ||
+		(header->RecordSize != sizeof(SERIALCLONE_TRACE_RECORD)))
+	{
+		fprintf(stderr, "sctrace: not a SerialClone trace\n");
+		return 1;
+	}
+
+	if(header->Processors == 0)
+	{
+		printf("tracing is off, see Parameters\\TraceRecords\n");
+		return 0;
+	}
+
+	if(Length - sizeof(SERIALCLONE_TRACE_HEADER) <
+		(size_t)header->Processors * header->RecordsPerRing * sizeof(SERIALCLONE_TRACE_RECORD))
+	{
+		fprintf(stderr, "sctrace: trace is cut short\n");
+		return 1;
+	}
+
+	entries = (SCTRACE_ENTRY *)malloc((size_t)header->Processors * header->RecordsPerRing * sizeof(SCTRACE_ENTRY));
+	if(entries == NULL)
+	{
+		fprintf(stderr, "sctrace: out of memory\n");
+		return 1;
+	}
+
+	records = (SERIALCLONE_TRACE_RECORD *)(header + 1);
+	count = 0;
+	for(cpu = 0; cpu < header->Processors; cpu++)
+	{
+		for(slot = 0; slot < header->RecordsPerRing; slot++, records++)
+		{
+			if((records->Sequence == 0) || ((records->Sequence - 1) % header->RecordsPerRing != slot))
+				continue;
+
+			entries[count].Record = records;
+			entries[count].Cpu = cpu;
+			count++;
+		}
+	}
+
+	qsort(entries, count, sizeof(SCTRACE_ENTRY), SCTraceCompare);
+
+	printf("%lu records from %lu processors\n", (unsigned long)count, (unsigned long)header->Processors);
+	printf("     seconds cpu irql port dev IRP              event           \n");
+
+	start = (count != 0) ? entries[0].Record->Time : 0;
+	for(i = 0; i < count; i++)
+	{
+		SERIALCLONE_TRACE_RECORD * r = entries[i].Record;
+		ULONGLONG since = r->Time - start;
+
+		SCTraceFormatArgs(r, args, sizeof(args));
+		printf("%5lu.%07lu %3lu %4u %4lu %s %016" SCTRACE_X64 " %-15s %s\n",
+			(unsigned long)(since / 10000000), (unsigned long)(since % 10000000),
+			(unsigned long)entries[i].Cpu, (unsigned)r->Irql, (unsigned long)r->Instance,
+			(r->Device < sizeof(ScDeviceNames) / sizeof(ScDeviceNames[0])) ? ScDeviceNames[r->Device] : "?",
+			r->Irp,
+			(r->Event < sizeof(ScEventNames) / sizeof(ScEventNames[0])) ? ScEventNames[r->Event] : "?",
+			args);
+	}
+
+	free(entries);
+	return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceLoad
+//      Reads a saved trace
+//
+//  Arguments:
+//      IN  Path
+//              the file
+//
+//      OUT Length
+//              bytes read
+//
+//  Return Value:
+//      malloc'd trace, NULL on error
+//
+static unsigned char * SCTraceLoad(const char * Path, size_t * Length)
+{
+	FILE *			file;
+	unsigned char *	trace;
+	long			size;
+
+	file = fopen(Path, "rb");
+	if(file == NULL)
+	{
+		fprintf(stderr, "sctrace: can't open %s\n", Path);
+		return NULL;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	trace = (size > 0) ? (unsigned char *)malloc(size) : NULL;
+	if((trace == NULL) || (fread(trace, 1, size, file) != (size_t)size))
+	{
+		fprintf(stderr, "sctrace: can't read %s\n", Path);
+		free(trace);
+		fclose(file);
+		return NULL;
+	}
+
+	fclose(file);
+	*Length = (size_t)size;
+	return trace;
+}
+
+#ifdef _WIN32
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//  SCTraceFetch
+//      Gets the trace from the driver through one of its ports, asking
+//      once for the header to learn the size
+//
+//  Arguments:
+//      IN  Device
+//              the clone's or the port's name, \\.\COM3 say
+//
+//      OUT Length
+//              bytes returned
+//
+//  Return Value:
+//      malloc'd trace, NULL on error
+//
+static unsigned char * SCTraceFetch(const char * Device, size_t * Length)
+{
+	HANDLE						hDev;
+	SERIALCLONE_TRACE_HEADER	header;
+	unsigned char *				trace;
+	DWORD						size;
+	DWORD						returned;
+
+	hDev = CreateFileA(Device, GENERIC_READ, 0, NULL, OPEN_EXISTING, 0, NULL);
+	if(hDev == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "sctrace: can't open %s (%lu)\n", Device, GetLastError());
+		return NULL;
+	}
+
+	trace = NULL;
+	if(!DeviceIoControl(hDev, IOCTL_SERIALCLONE_GET_TRACE, NULL, 0, &header, sizeof(header), &returned, NULL) &&
+		(GetLastError() != ERROR_MORE_DATA))
+	{
+		fprintf(stderr, "sctrace: IOCTL_SERIALCLONE_GET_TRACE failed (%lu)\n", GetLastError());
+	}
+	else
+	{
+		size = sizeof(header) + header.Processors * header.RecordsPerRing * sizeof(SERIALCLONE_TRACE_RECORD);
+		trace = (unsigned char *)malloc(size);
+		if((trace != NULL) &&
+			!DeviceIoControl(hDev, IOCTL_SERIALCLONE_GET_TRACE, NULL, 0, trace, size, &returned, NULL))
+		{
+			fprintf(stderr, "sctrace: IOCTL_SERIALCLONE_GET_TRACE failed (%lu)\n", GetLastError());
+			free(trace);
+			trace = NULL;
+		}
+		*Length = returned;
+	}
+
+	CloseHandle(hDev);
+	return trace;
+}
+#endif
+
+int main(int argc, char ** argv)
+{
+	unsigned char *	trace;
+	size_t			length;
+	int				result;
+
+	length = 0;
+
+#ifdef _WIN32
+	if((argc == 3 || argc == 4) && (strcmp(argv[1], "-d") == 0))
+	{
+		FILE * file;
+
+		trace = SCTraceFetch(argv[2], &length);
+		if(trace == NULL)
+			return 1;
+
+		if(argc == 3)
+			result = SCTracePrint(trace, length);
+		else
+		{
+			file = fopen(argv[3], "wb");
+			result = (file == NULL) || (fwrite(trace, 1, length, file) != length);
+			if(file != NULL)
+				fclose(file);
+			if(result)
+				fprintf(stderr, "sctrace: can't write %s\n", argv[3]);
+		}
+
+		free(trace);
+		return result;
+	}
+#endif
+
+	if(argc != 2 || argv[1][0] == '-')
+	{
+		fprintf(stderr, "usage: sctrace file\n");
+#ifdef _WIN32
+		fprintf(stderr, "       sctrace -d \\\\.\\COMn [file]\n");
+#endif
+		return 2;
+	}
+
+	trace = SCTraceLoad(argv[1], &length);
+	if(trace == NULL)
+		return 1;
+
+	result = SCTracePrint(trace, length);
+	free(trace);
+	return result;
+}